@@ -153,6 +153,19 @@ struct flb_connection {
 
     /* Each TCP connections using TLS needs a session */
     struct flb_tls_session *tls_session;
+
+    /*
+     * Multiplexed protocols (HTTP/2) attach their session to the connection
+     * so it can be shared by several coroutines at the same time:
+     *
+     *  - stream_count: number of users currently holding the connection.
+     *  - stream_limit: maximum number of concurrent users, zero means the
+     *                  connection cannot be shared.
+     */
+    void *protocol_session;
+    void (*protocol_session_destroy) (void *);
+    int stream_count;
+    int stream_limit;
 };
 
 int flb_connection_setup(struct flb_connection *connection,
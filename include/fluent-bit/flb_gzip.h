@@ -24,12 +24,18 @@
 #include <fluent-bit/flb_macros.h>
 #include <monkey/mk_http.h>
 
+/* Maximum size of the data inflated from a single GZip payload */
+#define FLB_GZIP_MAX_UNCOMPRESSED_SIZE  100000000
+
 struct flb_decompression_context;
 
 int flb_gzip_compress(void *in_data, size_t in_len,
                       void **out_data, size_t *out_len);
 int flb_gzip_uncompress(void *in_data, size_t in_len,
                         void **out_data, size_t *out_size);
+size_t flb_gzip_uncompressed_size(void *in_data, size_t in_len);
+int flb_gzip_uncompress_to(void *in_data, size_t in_len,
+                           void *out_buf, size_t out_size, size_t *out_len);
 
 void *flb_gzip_decompression_context_create();
 void flb_gzip_decompression_context_destroy(void *context);
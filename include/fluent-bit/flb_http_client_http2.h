@@ -0,0 +1,79 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2024 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_HTTP_CLIENT_HTTP2_H
+#define FLB_HTTP_CLIENT_HTTP2_H
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_coro.h>
+#include <fluent-bit/flb_upstream.h>
+#include <fluent-bit/flb_http_client.h>
+#include <monkey/mk_core.h>
+
+#include <nghttp2/nghttp2.h>
+
+/* Upper bound of concurrent streams multiplexed over one connection */
+#define FLB_HTTP2_CLIENT_MAX_STREAMS   100
+
+/* Size of the socket read buffer used by the session */
+#define FLB_HTTP2_CLIENT_READ_SIZE     16384
+
+/*
+ * HTTP/2 session bound to an upstream connection. Many coroutines can run
+ * requests over the same session, but only one of them reads from the socket
+ * (reader) and only one of them writes (writer) at a given time; the others
+ * wait until their stream completes or one of those roles becomes free.
+ */
+struct flb_http2_client_session {
+    nghttp2_session       *inner_session;
+    struct flb_connection *connection;
+
+    int                    failed;     /* connection level error            */
+    int                    reading;    /* a coroutine is reading            */
+    int                    writing;    /* a coroutine is writing            */
+    struct flb_coro       *reader;     /* coroutine reading from the socket */
+
+    flb_sds_t              outgoing;   /* frames serialized by nghttp2      */
+    flb_sds_t              sending;    /* frames being written by 'writer'  */
+
+    char                   read_buf[FLB_HTTP2_CLIENT_READ_SIZE];
+
+    struct mk_list         streams;    /* in-flight streams                 */
+};
+
+/* One request/response exchange */
+struct flb_http2_client_stream {
+    int32_t                 id;
+    int                     done;
+    int                     error;
+    int                     waiting;
+    size_t                  body_offset;
+    size_t                  headers_end;  /* offset of the payload in resp.data */
+    struct flb_coro        *coro;
+    struct flb_http_client *client;
+    struct mk_list          _head;
+};
+
+int flb_http2_client_upstream_setup(struct flb_upstream *u, struct flb_tls *tls,
+                                    const char *proxy);
+int flb_http2_client_negotiated(struct flb_connection *connection);
+int flb_http2_client_do(struct flb_http_client *c, size_t *bytes);
+
+#endif
@@ -192,6 +192,9 @@ struct flb_input_instance {
     /* flag to pause input when storage is full */
     int storage_pause_on_chunks_overlimit;
 
+    /* delta encode the metrics contexts appended to a chunk */
+    int metrics_delta;
+
     /*
      * Input network info:
      *
@@ -306,6 +309,13 @@ struct flb_input_instance {
      */
     struct flb_ring_buffer *rb;
 
+    /*
+     * Network workers (net.accept_workers) append from their own threads
+     * through the ring buffer too, 'rb_lock' serializes the producers.
+     */
+    int rb_shared;
+    pthread_mutex_t rb_lock;
+
     /* List of upstreams */
     struct mk_list upstreams;
 
@@ -739,6 +749,7 @@ struct mk_event_loop *flb_input_event_loop_get(struct flb_input_instance *ins);
 int flb_input_upstream_set(struct flb_upstream *u, struct flb_input_instance *ins);
 int flb_input_downstream_set(struct flb_downstream *stream,
                              struct flb_input_instance *ins);
+int flb_input_ring_buffer_share(struct flb_input_instance *ins);
 
 
 /* processors */
@@ -79,6 +79,15 @@ struct flb_input_chunk {
 #endif /* FLB_HAVE_CHUNK_TRACE */
     uint64_t routes_mask
         [FLB_ROUTES_MASK_ELEMENTS]; /* track the output plugins the chunk routes to */
+
+    /*
+     * metrics.delta: state described by the chunk content (struct cmt) used
+     * to encode the next appended context, and whether the chunk holds any
+     * delta encoded context.
+     */
+    void *metrics_base;
+    int  metrics_delta;
+
     struct mk_list _head;
 };
 
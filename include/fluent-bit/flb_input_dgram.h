@@ -0,0 +1,105 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2024 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_INPUT_DGRAM_H
+#define FLB_INPUT_DGRAM_H
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_input.h>
+#include <fluent-bit/flb_pipe.h>
+#include <fluent-bit/flb_downstream.h>
+#include <fluent-bit/flb_net_dgram.h>
+#include <fluent-bit/flb_log_event_encoder.h>
+
+#include <pthread.h>
+
+/* Upper bound of 'net.udp_receivers' */
+#define FLB_INPUT_DGRAM_RECEIVERS_MAX  64
+
+struct flb_input_dgram;
+struct flb_input_dgram_worker;
+
+/*
+ * Invoked from a receiver thread for every datagram. Logs are encoded into
+ * 'worker->log_encoder', metrics contexts are handed over with
+ * flb_input_dgram_metrics_append().
+ */
+typedef int (*flb_input_dgram_cb)(struct flb_input_dgram_worker *worker,
+                                  char *buf, size_t size);
+
+/* A receiver thread with its own SO_REUSEPORT socket */
+struct flb_input_dgram_worker {
+    int id;
+    int running;                          /* protected by parent->lock     */
+    pthread_t tid;
+
+    struct flb_downstream *downstream;    /* socket sharing the port       */
+    struct flb_connection *connection;    /* datagram 'connection'         */
+    struct flb_net_dgram_reader *reader;
+    struct flb_log_event_encoder *log_encoder;
+
+    void *data;                           /* per receiver plugin context   */
+    struct flb_input_dgram *parent;
+};
+
+/*
+ * Extra receivers of a UDP input: the kernel shards the traffic between
+ * all the sockets bound to the port. Every receiver reads and encodes its
+ * datagrams in its own thread and hands over complete batches to the input
+ * event loop, where they are appended to the chunks.
+ */
+struct flb_input_dgram {
+    int count;
+    struct flb_input_dgram_worker *workers;
+
+    flb_pipefd_t ch[2];                   /* batches from the receivers    */
+    int coll_id;
+    pthread_mutex_t lock;                 /* receivers 'running' flag      */
+
+    flb_input_dgram_cb cb_datagram;
+    struct cmt_counter *cmt_drops;        /* kernel drops (SO_RXQ_OVFL)    */
+    struct flb_input_instance *ins;
+};
+
+int flb_input_dgram_receivers(struct flb_input_instance *ins);
+
+struct flb_input_dgram *flb_input_dgram_create(struct flb_input_instance *ins,
+                                               const char *listen,
+                                               unsigned short int port,
+                                               int count,
+                                               size_t dgram_size,
+                                               flb_input_dgram_cb cb_datagram,
+                                               struct flb_config *config);
+int flb_input_dgram_start(struct flb_input_dgram *dgram,
+                          int (*cb_collect) (struct flb_input_instance *,
+                                             struct flb_config *, void *),
+                          struct flb_config *config);
+int flb_input_dgram_collect(struct flb_input_dgram *dgram);
+void flb_input_dgram_stop(struct flb_input_dgram *dgram);
+void flb_input_dgram_destroy(struct flb_input_dgram *dgram);
+
+int flb_input_dgram_metrics_append(struct flb_input_dgram_worker *worker,
+                                   struct cmt *cmt);
+
+struct cmt_counter *flb_input_dgram_drops_counter(struct flb_input_instance *ins);
+void flb_input_dgram_drops_report(struct flb_input_instance *ins,
+                                  struct cmt_counter *counter,
+                                  uint64_t drops);
+
+#endif
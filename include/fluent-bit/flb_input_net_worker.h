@@ -0,0 +1,118 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2024 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_INPUT_NET_WORKER_H
+#define FLB_INPUT_NET_WORKER_H
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_input.h>
+#include <fluent-bit/flb_pipe.h>
+#include <fluent-bit/flb_downstream.h>
+#include <fluent-bit/flb_connection.h>
+#include <monkey/mk_core.h>
+
+#include <pthread.h>
+
+/* Upper bound of 'net.accept_workers' */
+#define FLB_INPUT_NET_WORKERS_MAX    64
+
+/* Messages sent to a worker thread */
+#define FLB_INPUT_NET_WORKER_PAUSE   1
+#define FLB_INPUT_NET_WORKER_RESUME  2
+#define FLB_INPUT_NET_WORKER_EXIT    3
+
+struct flb_input_net_worker;
+
+/*
+ * Plugin callbacks. 'init' runs in the calling thread before the worker
+ * starts and usually sets 'worker->data' to a per-worker copy of the plugin
+ * context (own encoder, own list of connections). 'accept' runs in the
+ * worker thread for every new connection, the connection belongs to the
+ * worker event loop. 'exit' runs in the worker thread once it stops.
+ * 'pause' is optional, it runs in the worker thread when the input is paused
+ * so the plugin can drop its connections like it does in the input thread.
+ */
+typedef int (*flb_input_net_worker_init_cb)(struct flb_input_net_worker *worker);
+typedef int (*flb_input_net_worker_accept_cb)(struct flb_input_net_worker *worker,
+                                              struct flb_connection *connection);
+typedef void (*flb_input_net_worker_exit_cb)(struct flb_input_net_worker *worker);
+typedef void (*flb_input_net_worker_pause_cb)(struct flb_input_net_worker *worker);
+
+/* A thread with its own event loop and SO_REUSEPORT listener */
+struct flb_input_net_worker {
+    struct mk_event event;                /* control channel, keep it first */
+    int id;
+    int ready;                            /* plugin 'init' succeeded       */
+    int running;                          /* thread started                */
+    int stop;                             /* set by the exit message       */
+    pthread_t tid;
+    flb_pipefd_t ch[2];
+
+    struct mk_event_loop *evl;
+    struct mk_event listener;             /* accept events                 */
+    struct flb_downstream *downstream;    /* listener sharing the port     */
+    struct mk_list downstreams;           /* served by this worker         */
+
+    void *data;                           /* per worker plugin context     */
+    struct flb_input_net_workers *parent;
+};
+
+/*
+ * Extra network workers of a TCP input: every worker listens on the same
+ * port, so the kernel balances the incoming connections between the input
+ * thread and the workers. A connection is served by the thread which
+ * accepted it, records are appended through the instance ring buffer.
+ */
+struct flb_input_net_workers {
+    int count;
+    struct flb_input_net_worker *workers;
+
+    flb_input_net_worker_init_cb cb_init;
+    flb_input_net_worker_accept_cb cb_accept;
+    flb_input_net_worker_exit_cb cb_exit;
+    flb_input_net_worker_pause_cb cb_pause;
+
+    void *context;                        /* plugin context                */
+    struct flb_input_instance *ins;
+    struct flb_config *config;
+};
+
+int flb_input_net_workers_count(struct flb_input_instance *ins);
+
+struct flb_input_net_workers *flb_input_net_workers_create(
+                                  struct flb_input_instance *ins,
+                                  const char *listen,
+                                  unsigned short int port,
+                                  int count,
+                                  flb_input_net_worker_init_cb cb_init,
+                                  flb_input_net_worker_accept_cb cb_accept,
+                                  flb_input_net_worker_exit_cb cb_exit,
+                                  void *context,
+                                  struct flb_config *config);
+void flb_input_net_workers_pause_cb_set(struct flb_input_net_workers *nw,
+                                        flb_input_net_worker_pause_cb cb_pause);
+int flb_input_net_workers_start(struct flb_input_net_workers *nw);
+void flb_input_net_workers_pause(struct flb_input_net_workers *nw);
+void flb_input_net_workers_resume(struct flb_input_net_workers *nw);
+void flb_input_net_workers_destroy(struct flb_input_net_workers *nw);
+
+int flb_input_net_worker_downstream_set(struct flb_input_net_worker *worker,
+                                        struct flb_downstream *stream);
+
+#endif
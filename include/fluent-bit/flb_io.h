@@ -38,6 +38,7 @@
 
 /* Other features */
 #define FLB_IO_IPV6       32  /* network I/O uses IPv6                  */
+#define FLB_IO_HTTP2      64  /* HTTP clients speak HTTP/2              */
 
 struct flb_connection;
 
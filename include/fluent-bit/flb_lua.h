@@ -32,6 +32,9 @@
 /* global variables in Lua */
 #define FLB_LUA_VAR_FLB_NULL "flb_null"
 
+/* metatable of lazy records */
+#define FLB_LUA_LAZY_RECORD  "flb_lua_lazy_record"
+
 #define FLB_LUA_L2C_TYPES_NUM_MAX   16
 
 enum flb_lua_l2c_type_enum {
@@ -90,6 +93,9 @@ void flb_lua_pushtimetable(lua_State *l, struct flb_time *tm);
 int flb_lua_is_valid_func(lua_State *l, flb_sds_t func);
 int flb_lua_pushmpack(lua_State *l, mpack_reader_t *reader);
 void flb_lua_pushmsgpack(lua_State *l, msgpack_object *o);
+int flb_lua_lazy_init(lua_State *l);
+void flb_lua_pushmsgpack_lazy(lua_State *l, msgpack_object *o);
+void flb_lua_lazy_release_all(lua_State *l);
 void flb_lua_tomsgpack(lua_State *l,
                        msgpack_packer *pck,
                        int index,
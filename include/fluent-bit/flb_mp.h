@@ -32,6 +32,8 @@ int flb_mp_validate_log_chunk(const void *data, size_t bytes,
                               int *out_records, size_t *processed_bytes);
 int flb_mp_validate_metric_chunk(const void *data, size_t bytes,
                                  int *out_series, size_t *processed_bytes);
+int flb_mp_metrics_delta_expand(const void *data, size_t bytes,
+                                char **out_buf, size_t *out_size);
 
 void flb_mp_set_map_header_size(char *buf, int arr_size);
 
@@ -0,0 +1,85 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2024 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_NET_DGRAM_H
+#define FLB_NET_DGRAM_H
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_socket.h>
+
+#ifdef FLB_HAVE_RECVMMSG
+#include <sys/socket.h>
+#endif
+
+/* Upper bound of datagrams read in a single call */
+#define FLB_NET_DGRAM_BATCH_MAX   1024
+
+/* Size of a receive slot when GRO is enabled (coalesced datagrams) */
+#define FLB_NET_DGRAM_GRO_SIZE    65535
+
+/*
+ * Batched datagram reader: it reads up to 'slots' datagrams per call using
+ * recvmmsg(2) when available. With UDP GRO a slot can hold many datagrams
+ * of the same flow coalesced by the kernel, flb_net_dgram_next() splits
+ * them back. The receive queue overflow counter of the socket (SO_RXQ_OVFL)
+ * is tracked to report datagrams dropped by the kernel. Datagrams that do
+ * not fit in a slot (MSG_TRUNC) are dropped and logged.
+ */
+struct flb_net_dgram_reader {
+    flb_sockfd_t fd;
+    int gro;                              /* GRO enabled on the socket     */
+    int rxq_ovfl;                         /* SO_RXQ_OVFL enabled           */
+    int slots;                            /* datagrams per read            */
+    size_t slot_size;                     /* buffer size of each slot      */
+
+    char *buffers;
+    size_t *lengths;                      /* bytes received per slot       */
+    size_t *segments;                     /* GRO segment size per slot     */
+    struct sockaddr_storage *addresses;   /* sender of each slot           */
+
+#ifdef FLB_HAVE_RECVMMSG
+    struct mmsghdr *msgs;
+    struct iovec *iovecs;
+    char *controls;
+    size_t control_size;
+#endif
+
+    /* iterator over the last read */
+    int received;
+    int current;
+    size_t offset;
+
+    uint32_t drops_seen;                  /* last SO_RXQ_OVFL value        */
+    uint64_t drops;                       /* drops not collected yet       */
+    uint64_t truncated;                   /* datagrams larger than a slot  */
+};
+
+struct flb_net_dgram_reader *flb_net_dgram_reader_create(flb_sockfd_t fd,
+                                                         int slots,
+                                                         size_t slot_size,
+                                                         int gro);
+void flb_net_dgram_reader_destroy(struct flb_net_dgram_reader *reader);
+
+int flb_net_dgram_read(struct flb_net_dgram_reader *reader);
+int flb_net_dgram_next(struct flb_net_dgram_reader *reader,
+                       char **buf, size_t *size,
+                       struct sockaddr_storage **address);
+uint64_t flb_net_dgram_drops(struct flb_net_dgram_reader *reader);
+
+#endif
@@ -85,6 +85,21 @@ struct flb_net_setup {
 
     /* maximum number of allowed active TCP connections */
     int max_worker_connections;
+
+    /* connections kept established and idle per worker, ready to be used */
+    int warm_connections;
+
+    /* datagrams read per receive call on UDP servers */
+    int udp_batch_size;
+
+    /* enable UDP generic receive offload */
+    int udp_gro;
+
+    /* number of sockets/threads receiving on the same UDP port */
+    int udp_receivers;
+
+    /* number of listeners/threads accepting on the same TCP port */
+    int accept_workers;
 };
 
 /* Defines a host service and it properties */
@@ -48,10 +48,14 @@
 #include <fluent-bit/flb_upstream_ha.h>
 #include <fluent-bit/flb_event.h>
 #include <fluent-bit/flb_processor.h>
+#include <fluent-bit/flb_output_limiter.h>
+#include <fluent-bit/flb_input_chunk.h>
+#include <fluent-bit/flb_mp.h>
 
 #include <cmetrics/cmetrics.h>
 #include <cmetrics/cmt_gauge.h>
 #include <cmetrics/cmt_counter.h>
+#include <cmetrics/cmt_histogram.h>
 #include <cmetrics/cmt_decode_msgpack.h>
 #include <cmetrics/cmt_encode_msgpack.h>
 
@@ -76,6 +80,7 @@ int flb_chunk_trace_output(struct flb_chunk_trace *trace, struct flb_output_inst
 #define FLB_OUTPUT_NO_MULTIPLEX  512  /* run one task at a time, one task per flush */
 #define FLB_OUTPUT_PRIVATE      1024
 #define FLB_OUTPUT_SYNCHRONOUS  2048  /* run one task at a time, no flush cycle limit */
+#define FLB_OUTPUT_METRICS_DELTA 4096 /* decodes delta encoded metrics chunks */
 
 
 /*
@@ -380,6 +385,12 @@ struct flb_output_instance {
     struct cmt_gauge   *cmt_upstream_busy_connections;
     /* m: output_chunk_available_capacity_percent */
     struct cmt_gauge   *cmt_chunk_available_capacity_percent;
+    /* m: output_concurrency_limit */
+    struct cmt_gauge   *cmt_concurrency_limit;
+    /* m: output_upstream_tls_handshakes */
+    struct cmt_counter *cmt_upstream_tls_handshakes;
+    /* m: output_upstream_tls_handshake_seconds */
+    struct cmt_histogram *cmt_upstream_tls_handshake_seconds;
 
     /* OLD Metrics API */
 #ifdef FLB_HAVE_METRICS
@@ -416,6 +427,16 @@ struct flb_output_instance {
     /* Queue for singleplexed tasks */
     struct flb_task_queue *singleplex_queue;
 
+    /*
+     * Adaptive concurrency: 'concurrency.adaptive' enables a limiter that
+     * adjusts the number of in-flight flushes between 'concurrency.min' and
+     * 'concurrency.max' based on flush latency and retries.
+     */
+    int concurrency_adaptive;
+    int concurrency_min;
+    int concurrency_max;
+    struct flb_output_limiter *limiter;
+
     /* Thread Pool: this is optional for the caller */
     int tp_workers;
     struct flb_tp *tp;
@@ -614,6 +635,15 @@ static FLB_INLINE void output_pre_cb_flush(void)
 void flb_output_flush_prepare_destroy(struct flb_output_flush *out_flush);
 int flb_output_flush_id_get(struct flb_output_instance *ins);
 
+/* release an event chunk created to hand a transformed buffer to a flush */
+static inline void flb_output_event_chunk_release(struct flb_event_chunk *evc)
+{
+    if (evc) {
+        flb_free(evc->data);
+        flb_event_chunk_destroy(evc);
+    }
+}
+
 static FLB_INLINE
 struct flb_output_flush *flb_output_flush_create(struct flb_task *task,
                                                  struct flb_input_instance *i_ins,
@@ -638,6 +668,7 @@ struct flb_output_flush *flb_output_flush_create(struct flb_task *task,
     struct ctrace *trace_context;
     size_t chunk_offset;
     struct cmt *cmt_out_context = NULL;
+    struct flb_event_chunk *expanded = NULL;
 
     /* Custom output coroutine info */
     out_flush = (struct flb_output_flush *) flb_calloc(1, sizeof(struct flb_output_flush));
@@ -665,8 +696,38 @@ struct flb_output_flush *flb_output_flush_create(struct flb_task *task,
     out_flush->coro   = coro;
     out_flush->processed_event_chunk = NULL;
 
-    /* Logs processor */
     evc = task->event_chunk;
+
+    /*
+     * Metrics chunks holding delta encoded contexts (metrics.delta) are
+     * expanded for processors and for plugins that cannot decode them.
+     */
+    if (evc->type == FLB_EVENT_TYPE_METRICS && task->ic &&
+        ((struct flb_input_chunk *) task->ic)->metrics_delta == FLB_TRUE &&
+        (flb_processor_is_active(o_ins->processor) ||
+         !(o_ins->p->flags & FLB_OUTPUT_METRICS_DELTA))) {
+        ret = flb_mp_metrics_delta_expand(evc->data, evc->size,
+                                          (char **) &p_buf, &p_size);
+        if (ret == 0) {
+            expanded = flb_event_chunk_create(evc->type, 0, evc->tag,
+                                              flb_sds_len(evc->tag),
+                                              p_buf, p_size);
+            if (!expanded) {
+                flb_free(p_buf);
+            }
+        }
+
+        if (!expanded) {
+            flb_coro_destroy(coro);
+            flb_free(out_flush);
+            return NULL;
+        }
+
+        out_flush->processed_event_chunk = expanded;
+        evc = expanded;
+    }
+
+    /* Logs processor */
     if (flb_processor_is_active(o_ins->processor)) {
         if (evc->type == FLB_EVENT_TYPE_LOGS) {
             /* run the processor */
@@ -703,6 +764,7 @@ struct flb_output_flush *flb_output_flush_create(struct flb_task *task,
             p_buf = flb_calloc(evc->size * 2, sizeof(char));
 
             if (p_buf == NULL) {
+                flb_output_event_chunk_release(expanded);
                 flb_coro_destroy(coro);
                 flb_free(out_flush);
 
@@ -749,6 +811,7 @@ struct flb_output_flush *flb_output_flush_create(struct flb_task *task,
                     cmt_destroy(metrics_context);
 
                     if (ret != 0) {
+                        flb_output_event_chunk_release(expanded);
                         flb_coro_destroy(coro);
                         flb_free(out_flush);
                         flb_free(p_buf);
@@ -763,6 +826,7 @@ struct flb_output_flush *flb_output_flush_create(struct flb_task *task,
 
                         if (resized_serialization_buffer == NULL) {
                             cmt_encode_msgpack_destroy(serialized_context_buffer);
+                            flb_output_event_chunk_release(expanded);
                             flb_coro_destroy(coro);
                             flb_free(out_flush);
                             flb_free(p_buf);
@@ -785,6 +849,7 @@ struct flb_output_flush *flb_output_flush_create(struct flb_task *task,
             }
 
             if (serialization_buffer_offset == 0) {
+                flb_output_event_chunk_release(expanded);
                 flb_coro_destroy(coro);
                 flb_free(out_flush);
                 flb_free(p_buf);
@@ -800,6 +865,8 @@ struct flb_output_flush *flb_output_flush_create(struct flb_task *task,
                                                 p_buf,
                                                 p_size);
 
+            flb_output_event_chunk_release(expanded);
+
             if (out_flush->processed_event_chunk == NULL) {
                 flb_coro_destroy(coro);
                 flb_free(out_flush);
@@ -0,0 +1,79 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2024 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_OUTPUT_LIMITER_H
+#define FLB_OUTPUT_LIMITER_H
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_task.h>
+
+/* Default bounds for 'concurrency.min' and 'concurrency.max' */
+#define FLB_OUTPUT_LIMITER_MIN         1
+#define FLB_OUTPUT_LIMITER_MAX        64
+
+/* Initial limit, clamped to the configured bounds */
+#define FLB_OUTPUT_LIMITER_INITIAL     4
+
+/* Multiplicative decrease factor applied on congestion */
+#define FLB_OUTPUT_LIMITER_BACKOFF     0.7
+
+/* Latency above 'baseline * tolerance' is considered congestion */
+#define FLB_OUTPUT_LIMITER_TOLERANCE   2.0
+
+/* ...and at least this much above it (ns), so jitter of fast backends
+ * is not mistaken for congestion */
+#define FLB_OUTPUT_LIMITER_SLACK       20000000.0
+
+struct flb_output_instance;
+
+/*
+ * Adaptive concurrency limiter (AIMD): it caps the number of in-flight
+ * flushes of an output instance. Every completed flush that used the full
+ * capacity grows the limit by 1/limit (about +1 per round trip), a retry or
+ * a latency well above the healthy baseline shrinks it by a constant factor.
+ * Tasks over the limit wait in 'queue' until a flush completes.
+ */
+struct flb_output_limiter {
+    double limit;                 /* current limit                      */
+    int min;                      /* lower bound                        */
+    int max;                      /* upper bound                        */
+    int in_flight;                /* flushes running                    */
+
+    double latency_avg;           /* smoothed flush latency (ns)        */
+    double latency_base;          /* baseline of a healthy backend (ns) */
+    uint64_t ts_last_decrease;    /* last multiplicative decrease (ns)  */
+
+    struct flb_task_queue *queue; /* tasks waiting for a slot           */
+};
+
+struct flb_output_limiter *flb_output_limiter_create(int min, int max);
+void flb_output_limiter_destroy(struct flb_output_limiter *limiter);
+
+int flb_output_limiter_enqueue(struct flb_output_instance *ins,
+                               struct flb_task_retry *retry,
+                               struct flb_task *task,
+                               struct flb_config *config);
+void flb_output_limiter_done(struct flb_output_instance *ins,
+                             struct flb_task *task, int ret);
+
+/* Update the limit from a completed flush (exposed for unit tests) */
+void flb_output_limiter_update(struct flb_output_limiter *limiter,
+                               uint64_t now, uint64_t latency, int ret);
+
+#endif
@@ -32,6 +32,12 @@
 #define FLB_PARSER_LTSV  3
 #define FLB_PARSER_LOGFMT 4
 
+/* Syslog layouts decoded natively (regex parsers only) */
+#define FLB_PARSER_SYSLOG_NONE          0
+#define FLB_PARSER_SYSLOG_RFC5424       1
+#define FLB_PARSER_SYSLOG_RFC3164       2
+#define FLB_PARSER_SYSLOG_RFC3164_LOCAL 3
+
 struct flb_parser_types {
     char *key;
     int  key_len;
@@ -63,6 +69,7 @@ struct flb_parser {
     int time_with_year;   /* do time_fmt consider a year (%Y) ? */
     char *time_fmt_year;
     int time_with_tz;     /* do time_fmt consider a timezone ?  */
+    int syslog_format;    /* stock syslog regex with a native decoder */
     struct flb_regex *regex;
     struct mk_list _head;
 };
@@ -134,6 +134,16 @@ static inline int flb_stream_is_keepalive(struct flb_stream *stream)
     return flb_stream_get_flag_status(stream, FLB_IO_TCP_KA);
 }
 
+static inline void flb_stream_enable_http2(struct flb_stream *stream)
+{
+    flb_stream_enable_flags(stream, FLB_IO_HTTP2);
+}
+
+static inline int flb_stream_is_http2(struct flb_stream *stream)
+{
+    return flb_stream_get_flag_status(stream, FLB_IO_HTTP2);
+}
+
 static inline int flb_stream_is_secure(struct flb_stream *stream)
 {
     return flb_stream_get_flag_status(stream, FLB_IO_TLS);
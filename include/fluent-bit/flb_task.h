@@ -99,7 +99,7 @@ struct flb_task {
  * A queue of flb_task_enqueued tasks
  *
  * This structure is currently used to track pending flushes when FLB_OUTPUT_SYNCHRONOUS
- * is used.
+ * or the adaptive concurrency limiter are used.
  */
 struct flb_task_queue {
     struct mk_list pending;
@@ -120,6 +120,7 @@ struct flb_task_enqueued {
     struct flb_task_retry *retry;
     struct flb_output_instance *out_instance;
     struct flb_config *config;
+    uint64_t ts_start;          /* flush start time (ns), adaptive limiter */
     struct mk_list _head;
 };
 
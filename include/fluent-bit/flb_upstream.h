@@ -32,6 +32,8 @@
 
 #include <cmetrics/cmetrics.h>
 #include <cmetrics/cmt_gauge.h>
+#include <cmetrics/cmt_counter.h>
+#include <cmetrics/cmt_histogram.h>
 
 /*
  * Upstream creation FLAGS set by Fluent Bit sub-components
@@ -70,6 +72,16 @@ struct flb_upstream {
     struct cmt_gauge          *cmt_busy_connections;
     const char                *cmt_total_connections_label;
     const char                *cmt_busy_connections_label;
+    struct cmt_counter        *cmt_tls_handshakes;
+    struct cmt_histogram      *cmt_tls_handshake_seconds;
+    const char                *cmt_tls_handshakes_label;
+
+    /*
+     * Last TLS session issued by the remote end, connections to this upstream
+     * use it to resume instead of running a full handshake (opaque, owned by
+     * the TLS backend).
+     */
+    void                      *tls_session_cache;
 
     /*
      * If the connections will be in separate threads, this flag is
@@ -120,4 +132,15 @@ void flb_upstream_set_busy_connections_gauge(
         struct flb_upstream *stream,
         struct cmt_gauge *gauge_instance);
 
+void flb_upstream_set_tls_handshake_metrics(
+        struct flb_upstream *stream,
+        const char *label_value,
+        struct cmt_counter *counter_instance,
+        struct cmt_histogram *histogram_instance);
+void flb_upstream_tls_handshake_report(struct flb_upstream *stream,
+                                       uint64_t elapsed_ns, int resumed);
+
+int flb_upstream_conn_warmup_enabled(struct mk_list *list);
+int flb_upstream_conn_warmup(struct mk_list *list);
+
 #endif
@@ -42,6 +42,9 @@ struct flb_upstream_queue {
      * to avoid any race condition with a late event.
      */
     struct mk_list destroy_queue;
+
+    /* Number of warm connections being established (net.warm_connections) */
+    int warming;
 };
 
 #endif
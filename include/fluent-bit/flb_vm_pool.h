@@ -0,0 +1,118 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2024 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_VM_POOL_H
+#define FLB_VM_POOL_H
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_filter.h>
+
+#ifdef FLB_SYSTEM_WINDOWS
+#include <monkey/mk_core/external/winpthreads.h>
+#else
+#include <pthread.h>
+#endif
+
+/* Upper bound of the number of VMs of a pool */
+#define FLB_VM_POOL_MAX          64
+
+/* Chunks smaller than this are not split */
+#define FLB_VM_POOL_MIN_SLICE    4096
+
+/*
+ * Process 'size' bytes of records with the VM 'vm'. Same contract as a
+ * filter callback: returns FLB_FILTER_MODIFIED (setting 'out_buf') or
+ * FLB_FILTER_NOTOUCH. 'data' is the value given to flb_vm_pool_run().
+ */
+typedef int (*flb_vm_pool_cb)(void *vm, const void *buf, size_t size,
+                              void **out_buf, size_t *out_size, void *data);
+
+/*
+ * Optional, run in every worker thread when it starts and stops. A pool
+ * created without VMs relies on 'init' to create the VM of the worker in its
+ * own thread (set '*vm', return -1 on failure) and on 'exit' to destroy it:
+ * every slice then runs in the thread owning the VM.
+ */
+typedef int (*flb_vm_pool_thread_init_cb)(void **vm, void *context);
+typedef void (*flb_vm_pool_thread_exit_cb)(void *vm, void *context);
+
+struct flb_vm_pool_worker {
+    int id;
+    int running;                      /* thread started              */
+    int ready;                        /* 1: VM ready, -1: init failed */
+    int pending;                      /* a slice is assigned         */
+    pthread_t tid;
+    void *vm;
+
+    /* slice */
+    const char *buf;
+    size_t size;
+    void *out_buf;
+    size_t out_size;
+    int ret;
+
+    uint64_t cpu_ns;                  /* CPU time spent in the VM    */
+    struct flb_vm_pool *pool;
+};
+
+/*
+ * A set of VMs (Lua states, WASM instances...) loaded with the same
+ * program. A chunk is split in slices of whole records processed at the
+ * same time, one per VM, results are concatenated in the original order.
+ * The first slice runs in the calling thread with the first VM, unless the
+ * VMs are created by the worker threads.
+ */
+struct flb_vm_pool {
+    int size;
+    int exit;
+    int running;                      /* slices being processed      */
+    int first;                        /* first VM owned by a thread  */
+
+    pthread_mutex_t run_lock;         /* one chunk at a time         */
+    pthread_mutex_t lock;
+    pthread_cond_t cond_job;
+    pthread_cond_t cond_done;
+
+    flb_vm_pool_cb cb;
+    flb_vm_pool_thread_init_cb cb_thread_init;
+    flb_vm_pool_thread_exit_cb cb_thread_exit;
+    void *context;                    /* given to the thread callbacks */
+    void *data;
+
+    struct flb_vm_pool_worker *workers;
+
+#ifdef FLB_HAVE_METRICS
+    struct cmt_counter *cmt_cpu;
+#endif
+    struct flb_filter_instance *ins;
+};
+
+struct flb_vm_pool *flb_vm_pool_create(struct flb_filter_instance *ins,
+                                       int size, void **vms,
+                                       flb_vm_pool_cb cb,
+                                       flb_vm_pool_thread_init_cb cb_thread_init,
+                                       flb_vm_pool_thread_exit_cb cb_thread_exit,
+                                       void *context);
+int flb_vm_pool_run(struct flb_vm_pool *pool,
+                    const void *data, size_t bytes,
+                    void **out_buf, size_t *out_bytes,
+                    void *cb_data);
+void flb_vm_pool_destroy(struct flb_vm_pool *pool);
+
+#endif
@@ -55,10 +55,32 @@
 /* Maximum number of groups per stream */
 #define FLB_ML_MAX_GROUPS       6
 
+/* Rule prefilter limits */
+#define FLB_ML_FILTER_LITERALS     8
+#define FLB_ML_FILTER_LITERAL_LEN  32
+
 struct flb_ml;
 struct flb_ml_parser;
 struct flb_ml_stream;
 
+/*
+ * Cheap checks derived from a rule regex when the rule is created, they
+ * discard lines which cannot match before running the regex engine:
+ *
+ * - anchored: the pattern starts with '^', the first byte of a matching
+ *   line must be set in 'first' ('empty' tells if an empty line can match).
+ * - literals: at least one of these strings must be found in the line.
+ */
+struct flb_ml_rule_filter {
+    int anchored;
+    int empty;
+    uint8_t first[256];
+
+    int literals;
+    int literal_len[FLB_ML_FILTER_LITERALS];
+    char literal[FLB_ML_FILTER_LITERALS][FLB_ML_FILTER_LITERAL_LEN];
+};
+
 struct flb_ml_rule {
     /* If the rule contains a 'start_state' this flag is turned on */
     int start_state;
@@ -81,6 +103,9 @@ struct flb_ml_rule {
     /* regex end pattern */
     struct flb_regex *regex_end;
 
+    /* prefilter for 'regex' */
+    struct flb_ml_rule_filter filter;
+
     struct mk_list _head;
 };
 
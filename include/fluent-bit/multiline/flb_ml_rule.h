@@ -40,4 +40,8 @@ int flb_ml_rule_process(struct flb_ml_parser *ml_parser,
                         msgpack_object *val_pattern);
 int flb_ml_rule_init(struct flb_ml_parser *ml_parser);
 
+int flb_ml_rule_filter_create(struct flb_ml_rule *rule, const char *pattern);
+int flb_ml_rule_filter_check(struct flb_ml_rule_filter *filter,
+                             const char *buf, size_t size);
+
 #endif
@@ -25,8 +25,8 @@
 #include <fluent-bit/flb_sds.h>
 #include <fluent-bit/flb_time.h>
 #include <fluent-bit/flb_input.h>
+#include <fluent-bit/stream_processor/flb_sp_groupby.h>
 #include <monkey/mk_core.h>
-#include <rbtree.h>
 
 /* Aggregate num type */
 #define FLB_SP_NUM_I64       0
@@ -34,6 +34,10 @@
 #define FLB_SP_BOOLEAN       2
 #define FLB_SP_STRING        3
 
+/* String type to numerical conversion */
+#define FLB_STR_INT          1
+#define FLB_STR_FLOAT        2
+
 struct sp_buffer {
     char* buffer;
     size_t size;
@@ -75,14 +79,25 @@ struct aggregate_node {
     int groupby_keys;
     int records;
     int nums_size;
+    uint64_t hash;                   /* hash of the GROUP BY values */
     struct aggregate_num *nums;
     struct aggregate_num *groupby_nums;
 
     /* Aggregate data */
     struct aggregate_data **aggregate_data;
 
+    /*
+     * Hopping windows: a window node references the node collecting its
+     * records in the open slot (valid while 'slot_id' matches the window
+     * one), a slot node references the window node it belongs to.
+     */
+    int slot_id;
+    struct aggregate_node *slot_node;
+    struct aggregate_node *owner;
+
+    struct flb_sp_groupby_arena *arena;  /* memory of the node */
+
     /* To keep track of the aggregation nodes */
-    struct rb_tree_node _rb_head;
     struct mk_list _head;
 };
 
@@ -93,7 +108,6 @@ struct flb_sp_window_data {
 };
 
 struct flb_sp_hopping_slot {
-    struct rb_tree aggregate_tree;
     struct mk_list aggregate_list;
     int records;
     struct mk_list _head;
@@ -106,8 +120,12 @@ struct flb_sp_task_window {
     struct mk_event event;
     struct mk_event event_hop;
 
-    struct rb_tree aggregate_tree;
     struct mk_list aggregate_list;
+    struct flb_sp_groupby_table aggregate_table;
+    struct flb_sp_groupby_arena arena;
+
+    /* GROUP BY values of the record being processed */
+    struct flb_sp_groupby_value *groupby_values;
 
     /* Hopping window parameters */
     /*
@@ -118,6 +136,12 @@ struct flb_sp_task_window {
     int fd_hop;
     time_t advance_by;
     struct mk_list hopping_slot;
+    struct flb_sp_hopping_slot *open_slot;  /* records since the last hop */
+    int slot_id;
+
+    /* partitioned tasks only aggregate the groups of their partition */
+    int partition;
+    int partitions;
 
     int records;
 
@@ -144,17 +168,29 @@ struct flb_sp_task {
     int aggregate_keys;      /* do commands contains aggregate keys? */
     struct flb_sp *sp;       /* parent context */
     struct flb_sp_cmd *cmd;  /* (SQL) commands */
+    struct flb_sp_program *condition; /* compiled WHERE condition */
 
     struct flb_sp_task_window window; /* task window */
 
     void *snapshot;          /* snapshot pages for SNAPSHOT sream type */
 
+    /*
+     * Workers mode: the task runs in 'partitions_size' partitions, the
+     * first one is the task itself. Zero if the task runs synchronously.
+     */
+    int worker;                           /* worker of the first partition */
+    int partitions_size;
+    struct flb_sp_task **partitions;
+
     struct mk_list _head;    /* link to parent list flb_sp->tasks */
 };
 
 struct flb_sp {
     struct mk_list tasks;        /* processor tasks */
     struct flb_config *config;   /* reference to Fluent Bit context */
+
+    int workers_size;            /* zero: tasks run from flb_sp_do() */
+    struct flb_sp_worker *workers;
 };
 
 struct flb_sp *flb_sp_create(struct flb_config *config);
@@ -179,12 +215,14 @@ int sp_process_hopping_slot(const char *tag, int tag_len,
                             struct flb_sp_task *task);
 
 int flb_sp_snapshot_create(struct flb_sp_task *task);
+int flb_sp_string_to_number(const char *str, int len, int64_t *i, double *d);
 struct flb_sp_task *flb_sp_task_create(struct flb_sp *sp, const char *name,
                                        const char *query);
 int flb_sp_fd_event(int fd, struct flb_sp *sp);
 void flb_sp_task_destroy(struct flb_sp_task *task);
-void groupby_nums_destroy(struct aggregate_num *groupby_nums, int size);
 void flb_sp_aggregate_node_destroy(struct flb_sp_cmd *cmd,
                                    struct aggregate_node *aggregate_node);
+void flb_sp_hopping_slot_destroy(struct flb_sp_cmd *cmd,
+                                 struct flb_sp_hopping_slot *hs);
 
 #endif
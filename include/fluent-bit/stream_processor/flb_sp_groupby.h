@@ -21,8 +21,68 @@
 #define FLB_SP_GROUPBY_H
 
 #include <fluent-bit/flb_info.h>
-#include <fluent-bit/stream_processor/flb_sp.h>
+#include <monkey/mk_core.h>
 
-int flb_sp_groupby_compare(const void *lhs, const void *rhs);
+#include <stdint.h>
+
+struct aggregate_node;
+
+/* Number of blocks carved from every arena chunk */
+#define FLB_SP_GROUPBY_ARENA_BLOCKS   256
+
+/* Initial number of entries of the GROUP BY hash table */
+#define FLB_SP_GROUPBY_TABLE_SIZE     64
+
+/* GROUP BY value of the record being processed, strings are not copied */
+struct flb_sp_groupby_value {
+    int type;
+    int64_t i64;
+    double f64;
+    const char *str;
+    size_t str_len;
+};
+
+/*
+ * Fixed size blocks for aggregation nodes and their arrays. Released
+ * blocks are kept in a free list, memory goes back to the system only
+ * when the arena is destroyed.
+ */
+struct flb_sp_groupby_arena {
+    size_t block_size;
+    void *free_list;
+    struct mk_list chunks;
+};
+
+/* The hash is kept next to the node to skip it on collisions */
+struct flb_sp_groupby_entry {
+    uint64_t hash;
+    struct aggregate_node *node;
+};
+
+/* Open addressing (linear probing) table of aggregation nodes */
+struct flb_sp_groupby_table {
+    struct flb_sp_groupby_entry *entries;
+    size_t size;
+    size_t count;
+};
+
+void flb_sp_groupby_arena_init(struct flb_sp_groupby_arena *arena,
+                               size_t block_size);
+void *flb_sp_groupby_arena_alloc(struct flb_sp_groupby_arena *arena);
+void flb_sp_groupby_arena_free(struct flb_sp_groupby_arena *arena, void *ptr);
+void flb_sp_groupby_arena_destroy(struct flb_sp_groupby_arena *arena);
+
+uint64_t flb_sp_groupby_hash(struct flb_sp_groupby_value *values, int size);
+
+struct aggregate_node *flb_sp_groupby_table_get(struct flb_sp_groupby_table *table,
+                                                uint64_t hash,
+                                                struct flb_sp_groupby_value *values,
+                                                int size);
+int flb_sp_groupby_table_add(struct flb_sp_groupby_table *table,
+                             struct aggregate_node *aggr_node);
+void flb_sp_groupby_table_del(struct flb_sp_groupby_table *table,
+                              struct aggregate_node *aggr_node);
+void flb_sp_groupby_table_reset(struct flb_sp_groupby_table *table);
+void flb_sp_groupby_table_destroy(struct flb_sp_groupby_table *table);
 
 #endif
@@ -27,6 +27,8 @@
 struct flb_sp_value *flb_sp_key_to_value(flb_sds_t ckey,
                                          msgpack_object map,
                                          struct mk_list *subkeys);
+int flb_sp_key_to_object(msgpack_object val, struct mk_list *subkeys,
+                         msgpack_object *out);
 void flb_sp_key_value_destroy(struct flb_sp_value *v);
 void flb_sp_key_value_print(struct flb_sp_value *v);
 
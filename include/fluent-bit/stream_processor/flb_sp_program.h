@@ -0,0 +1,73 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2024 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_SP_PROGRAM_H
+#define FLB_SP_PROGRAM_H
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_time.h>
+#include <fluent-bit/stream_processor/flb_sp_parser.h>
+#include <msgpack.h>
+
+/* Limits of a compiled program, bigger expressions are interpreted */
+#define FLB_SP_PROGRAM_STACK_MAX   32
+#define FLB_SP_PROGRAM_SLOTS_MAX   32
+
+/* Instructions */
+enum flb_sp_opcode {
+    FLB_SP_OP_NONE = 0,       /* push a missing value        */
+    FLB_SP_OP_CONST,          /* push a literal              */
+    FLB_SP_OP_KEY,            /* push the value of a slot    */
+    FLB_SP_OP_CONTAINS,       /* @record.contains()          */
+    FLB_SP_OP_TIME,           /* @record.time()              */
+    FLB_SP_OP_CMP,            /* comparison, see Operations  */
+    FLB_SP_OP_PAR,
+    FLB_SP_OP_NOT,
+    FLB_SP_OP_AND,
+    FLB_SP_OP_OR
+};
+
+struct flb_sp_instruction {
+    int opcode;
+    int arg;                      /* slot or comparison operation */
+    struct mk_list *subkeys;      /* FLB_SP_OP_KEY sub-keys       */
+    struct flb_exp_val *val;      /* FLB_SP_OP_CONST literal      */
+};
+
+/*
+ * A WHERE condition compiled to a postfix program. Every record key used
+ * by the expression gets a slot, the slots are resolved with one pass
+ * over the record map and the program runs on a fixed size value stack,
+ * so evaluating a record does not allocate memory.
+ */
+struct flb_sp_program {
+    int size;
+    struct flb_sp_instruction *ins;
+
+    int slots;
+    flb_sds_t slot_names[FLB_SP_PROGRAM_SLOTS_MAX];
+};
+
+struct flb_sp_program *flb_sp_program_create(struct flb_exp *exp);
+int flb_sp_program_eval(struct flb_sp_program *prog,
+                        struct flb_time *tms, msgpack_object *map);
+void flb_sp_program_destroy(struct flb_sp_program *prog);
+
+#endif
@@ -26,7 +26,9 @@
 #define FLB_SP_WINDOW_TUMBLING  1
 #define FLB_SP_WINDOW_HOPPING   2
 
+int flb_sp_window_init(struct flb_sp_task *task);
 void flb_sp_window_prune(struct flb_sp_task *task);
+void flb_sp_window_destroy(struct flb_sp_task *task);
 int flb_sp_window_populate(struct flb_sp_task *task, const char *buf_data,
                            size_t buf_size);
 
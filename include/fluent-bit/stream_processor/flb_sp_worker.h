@@ -0,0 +1,109 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2024 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#ifndef FLB_SP_WORKER_H
+#define FLB_SP_WORKER_H
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_sds.h>
+#include <monkey/mk_core.h>
+
+#ifdef FLB_SYSTEM_WINDOWS
+#include <monkey/mk_core/external/winpthreads.h>
+#else
+#include <pthread.h>
+#endif
+
+struct flb_sp;
+struct flb_sp_task;
+
+/* Upper bound of the number of workers */
+#define FLB_SP_WORKERS_MAX       64
+
+/* Pending jobs per worker, producers wait when the queue is full */
+#define FLB_SP_WORKER_QUEUE_MAX  256
+
+/* Job types */
+#define FLB_SP_JOB_DATA          0   /* process the records of a chunk  */
+#define FLB_SP_JOB_WINDOW        1   /* window timer: emit and prune    */
+#define FLB_SP_JOB_HOP           2   /* hopping timer: close the slot   */
+
+/* Copy of the data given to flb_sp_do(), shared by all the jobs */
+struct flb_sp_worker_chunk {
+    int users;
+    int str_conv;
+    flb_sds_t tag;
+    char *buf;
+    size_t size;
+    pthread_mutex_t lock;
+};
+
+/*
+ * Results of the partitions of a task, the worker finishing the last
+ * partition appends them to the task stream.
+ */
+struct flb_sp_worker_emit {
+    int pending;
+    flb_sds_t tag;
+    char *buf;
+    size_t size;
+    struct flb_sp_task *task;
+    pthread_mutex_t lock;
+};
+
+struct flb_sp_job {
+    int type;
+    struct flb_sp_task *task;               /* partition to run        */
+    struct flb_sp_worker_chunk *chunk;      /* FLB_SP_JOB_DATA only    */
+    struct flb_sp_worker_emit *emit;
+    struct mk_list _head;
+};
+
+struct flb_sp_worker {
+    int id;
+    int exit;
+    int running;                            /* thread started          */
+    int jobs;                               /* queued jobs             */
+    pthread_t tid;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;                    /* queue state changed     */
+    struct mk_list queue;
+    struct flb_sp *sp;
+};
+
+int flb_sp_workers_create(struct flb_sp *sp, int size);
+void flb_sp_workers_destroy(struct flb_sp *sp);
+
+int flb_sp_worker_task_init(struct flb_sp *sp, struct flb_sp_task *task);
+void flb_sp_worker_task_destroy(struct flb_sp_task *task);
+
+struct flb_sp_worker_chunk *flb_sp_worker_chunk_create(const char *tag,
+                                                       int tag_len,
+                                                       const char *buf,
+                                                       size_t size,
+                                                       int str_conv);
+void flb_sp_worker_chunk_release(struct flb_sp_worker_chunk *chunk);
+
+int flb_sp_worker_push_data(struct flb_sp *sp, struct flb_sp_task *task,
+                            struct flb_sp_worker_chunk *chunk);
+int flb_sp_worker_push_event(struct flb_sp *sp, struct flb_sp_task *task,
+                             int type, const char *tag, int tag_len);
+
+#endif
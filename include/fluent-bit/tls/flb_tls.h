@@ -79,6 +79,14 @@ struct flb_tls_backend {
     void *(*session_create) (struct flb_tls *, int);
     int (*session_destroy) (void *);
 
+    /* Session resumption (optional) */
+    int (*session_cache_set) (void *, void **);
+    int (*session_reused) (void *);
+    void (*session_cache_destroy) (void *, void *);
+
+    /* Protocol selected through ALPN (optional) */
+    int (*session_alpn_get) (void *, const char **, size_t *);
+
     /* I/O */
     int (*net_read) (struct flb_tls_session *, void *, size_t);
     int (*net_write) (struct flb_tls_session *, const void *data,
@@ -125,6 +133,11 @@ int flb_tls_session_create(struct flb_tls *tls,
                            struct flb_connection *connection,
                            struct flb_coro *co);
 
+void flb_tls_session_cache_destroy(struct flb_tls *tls, void **cache);
+
+int flb_tls_session_alpn_match(struct flb_tls_session *session,
+                               const char *protocol);
+
 int flb_tls_net_read(struct flb_tls_session *session, 
                      void *buf, 
                      size_t len);
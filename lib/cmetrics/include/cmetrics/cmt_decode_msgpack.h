@@ -38,6 +38,8 @@
 
 #define CMT_DECODE_MSGPACK_DICTIONARY_LOOKUP_ERROR    CMT_MPACK_ERROR_CUTOFF + 1
 #define CMT_DECODE_MSGPACK_VERSION_ERROR              CMT_MPACK_ERROR_CUTOFF + 2
+#define CMT_DECODE_MSGPACK_DELTA_ERROR                CMT_MPACK_ERROR_CUTOFF + 3
+#define CMT_DECODE_MSGPACK_DELTA_BASE_ERROR           CMT_MPACK_ERROR_CUTOFF + 4
 
 struct cmt_msgpack_temporary_bucket {
     double upper_bound;
@@ -55,10 +57,13 @@ struct cmt_msgpack_decode_context {
     uint64_t           *summary_quantiles;
     size_t             summary_quantiles_count;
     int                aggregation_type;
+    int64_t            metric_ref;     /* delta series reference */
 };
 
 int cmt_decode_msgpack_create(struct cmt **out_cmt, char *in_buf, size_t in_size, 
                               size_t *offset);
+int cmt_decode_msgpack_delta_apply(struct cmt **base, char *in_buf, size_t in_size,
+                                   size_t *offset, int *is_delta);
 void cmt_decode_msgpack_destroy(struct cmt *cmt);
 
 #endif
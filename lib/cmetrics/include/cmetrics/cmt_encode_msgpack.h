@@ -24,8 +24,17 @@
 #include <cmetrics/cmetrics.h>
 
 #define MSGPACK_ENCODER_VERSION 2
+#define MSGPACK_ENCODER_DELTA_VERSION 1
+
+struct cmt_map;
 
 int cmt_encode_msgpack_create(struct cmt *cmt, char **out_buf, size_t *out_size);
+int cmt_encode_msgpack_delta_create(struct cmt *cmt, struct cmt *base,
+                                    char **out_buf, size_t *out_size);
+
+/* families in encoding order, used to resolve delta references */
+int cmt_encode_msgpack_maps(struct cmt *cmt, struct cmt_map ***out_maps,
+                            size_t *out_count);
 void cmt_encode_msgpack_destroy(char *out_buf);
 
 #endif
@@ -57,5 +57,9 @@ struct cmt_prometheus_remote_write_context
 
 cfl_sds_t cmt_encode_prometheus_remote_write_create(struct cmt *cmt);
 void cmt_encode_prometheus_remote_write_destroy(cfl_sds_t text);
+int cmt_encode_prometheus_remote_write_series(struct cmt *cmt,
+                                              int (*cb) (Prometheus__TimeSeries *series,
+                                                         void *data),
+                                              void *data);
 
 #endif
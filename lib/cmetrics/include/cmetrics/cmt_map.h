@@ -43,6 +43,20 @@ struct cmt_map {
     int label_count;            /* Number of labels */
     struct cfl_list label_keys;  /* Linked list of labels */
     void *parent;
+
+    /*
+     * Open addressing index of 'metrics' keyed by the series hash. It is
+     * built on first lookup and catches up with series appended directly
+     * to the list (decoders) by resuming from 'index_tail'.
+     */
+    struct cmt_metric **index;  /* slots, NULL when empty */
+    size_t index_size;          /* number of slots, power of two */
+    size_t index_count;         /* indexed series */
+    struct cfl_list *index_tail; /* last list node indexed */
+
+    /* Cardinality limit, zero means unlimited */
+    size_t cardinality_limit;
+    uint64_t cardinality_overflow; /* writes rejected by the limit */
 };
 
 struct cmt_map *cmt_map_create(int type, struct cmt_opts *opts,
@@ -56,6 +70,10 @@ int cmt_map_metric_get_val(struct cmt_opts *opts, struct cmt_map *map,
                            int labels_count, char **labels_val,
                            double *out_val);
 void cmt_map_metric_destroy(struct cmt_metric *metric);
+void cmt_map_metric_remove(struct cmt_map *map, struct cmt_metric *metric);
+
+void cmt_map_set_cardinality_limit(struct cmt_map *map, size_t limit);
+uint64_t cmt_map_get_cardinality_overflow(struct cmt_map *map);
 
 void destroy_label_list(struct cfl_list *label_list);
 
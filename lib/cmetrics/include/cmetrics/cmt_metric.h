@@ -55,8 +55,12 @@ uint64_t cmt_metric_get_timestamp(struct cmt_metric *metric);
 
 void cmt_metric_hist_inc(struct cmt_metric *metric, uint64_t timestamp,
                          int bucket_id);
+void cmt_metric_hist_add(struct cmt_metric *metric, uint64_t timestamp,
+                         int bucket_id, uint64_t val);
 
 void cmt_metric_hist_count_inc(struct cmt_metric *metric, uint64_t timestamp);
+void cmt_metric_hist_count_add(struct cmt_metric *metric, uint64_t timestamp,
+                               uint64_t val);
 void cmt_metric_hist_count_set(struct cmt_metric *metric, uint64_t timestamp,
                                uint64_t count);
 
@@ -26,6 +26,7 @@
 #include <cmetrics/cmt_gauge.h>
 #include <cmetrics/cmt_untyped.h>
 #include <cmetrics/cmt_compat.h>
+#include <cmetrics/cmt_label.h>
 #include <cmetrics/cmt_encode_msgpack.h>
 #include <cmetrics/cmt_decode_msgpack.h>
 #include <cmetrics/cmt_variant_utils.h>
@@ -611,6 +612,31 @@ static int unpack_metric_hash(mpack_reader_t *reader, size_t index, void *contex
     return cmt_mpack_consume_uint_tag(reader, &decode_context->metric->hash);
 }
 
+static int unpack_metric_ref(mpack_reader_t *reader, size_t index, void *context)
+{
+    int                                result;
+    uint64_t                           value;
+    struct cmt_msgpack_decode_context *decode_context;
+
+    if (NULL == reader  ||
+        NULL == context ) {
+        return CMT_DECODE_MSGPACK_INVALID_ARGUMENT_ERROR;
+    }
+
+    decode_context = (struct cmt_msgpack_decode_context *) context;
+
+    result = cmt_mpack_consume_uint_tag(reader, &value);
+
+    if (CMT_DECODE_MSGPACK_SUCCESS == result) {
+        if (value > INT64_MAX) {
+            return CMT_DECODE_MSGPACK_CORRUPT_INPUT_DATA_ERROR;
+        }
+        decode_context->metric_ref = (int64_t) value;
+    }
+
+    return result;
+}
+
 static int unpack_metric(mpack_reader_t *reader,
                          struct cmt_msgpack_decode_context *decode_context,
                          struct cmt_metric **out_metric)
@@ -627,6 +653,7 @@ static int unpack_metric(mpack_reader_t *reader,
             {"summary",   unpack_metric_summary},
             {"histogram", unpack_metric_histogram},
             {"hash",      unpack_metric_hash},
+            {"ref",       unpack_metric_ref},
             {NULL,        NULL}
         };
 
@@ -1405,10 +1432,17 @@ static int unpack_context_metrics(mpack_reader_t *reader, size_t index, void *co
                                   context);
 }
 
+/* delta contexts can only be decoded by cmt_decode_msgpack_delta_apply() */
+static int unpack_context_delta(mpack_reader_t *reader, size_t index, void *context)
+{
+    return CMT_DECODE_MSGPACK_DELTA_ERROR;
+}
+
 static int unpack_context(mpack_reader_t *reader, struct cmt *cmt)
 {
     struct cmt_mpack_map_entry_callback_t callbacks[] = \
         {
+            {"delta",   unpack_context_delta},
             {"meta",    unpack_context_header},
             {"metrics", unpack_context_metrics},
             {NULL,      NULL}
@@ -1422,6 +1456,518 @@ static int unpack_context(mpack_reader_t *reader, struct cmt *cmt)
     return cmt_mpack_unpack_map(reader, callbacks, (void *) cmt);
 }
 
+/*
+ * Delta contexts (see cmt_encode_msgpack_delta_create()) are applied in
+ * place over the base context.
+ */
+
+struct cmt_msgpack_delta_context {
+    struct cmt         *cmt;
+
+    /* base families in encoding order and the ones referenced so far */
+    struct cmt_map    **maps;
+    size_t              map_count;
+    char               *used;
+
+    /* family being updated */
+    struct cmt_map     *map;
+    struct cmt_metric **series;
+    size_t              series_count;
+    char               *seen;
+    uint64_t            touch_ts;
+    int                 touch;
+    uint64_t            range_start;
+};
+
+static void delta_metric_destroy(struct cmt_metric *metric)
+{
+    destroy_label_list(&metric->labels);
+
+    if (NULL != metric->hist_buckets) {
+        free(metric->hist_buckets);
+    }
+
+    if (NULL != metric->sum_quantiles) {
+        free(metric->sum_quantiles);
+    }
+
+    free(metric);
+}
+
+/* moves the values of an unpacked entry into an existing series */
+static void delta_metric_update(struct cmt_map *map, struct cmt_metric *metric,
+                                struct cmt_metric *update)
+{
+    uint64_t *tmp;
+
+    metric->val = update->val;
+    metric->timestamp = update->timestamp;
+
+    if (map->type == CMT_HISTOGRAM) {
+        tmp = metric->hist_buckets;
+        metric->hist_buckets = update->hist_buckets;
+        update->hist_buckets = tmp;
+
+        metric->hist_count = update->hist_count;
+        metric->hist_sum = update->hist_sum;
+    }
+    else if (map->type == CMT_SUMMARY) {
+        tmp = metric->sum_quantiles;
+        metric->sum_quantiles = update->sum_quantiles;
+        update->sum_quantiles = tmp;
+
+        metric->sum_quantiles_count = update->sum_quantiles_count;
+        metric->sum_quantiles_set = update->sum_quantiles_set;
+        metric->sum_count = update->sum_count;
+        metric->sum_sum = update->sum_sum;
+    }
+}
+
+static void delta_map_destroy(struct cmt_map *map)
+{
+    if (map->type == CMT_COUNTER) {
+        cmt_counter_destroy(map->parent);
+    }
+    else if (map->type == CMT_GAUGE) {
+        cmt_gauge_destroy(map->parent);
+    }
+    else if (map->type == CMT_UNTYPED) {
+        cmt_untyped_destroy(map->parent);
+    }
+    else if (map->type == CMT_SUMMARY) {
+        cmt_summary_destroy(map->parent);
+    }
+    else if (map->type == CMT_HISTOGRAM) {
+        cmt_histogram_destroy(map->parent);
+    }
+}
+
+static int unpack_delta_type_base(mpack_reader_t *reader, size_t index, void *context)
+{
+    int                               result;
+    uint64_t                          value;
+    size_t                            count;
+    struct cfl_list                  *head;
+    struct cmt_msgpack_delta_context *delta;
+
+    delta = (struct cmt_msgpack_delta_context *) context;
+
+    result = cmt_mpack_consume_uint_tag(reader, &value);
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        return result;
+    }
+
+    if (delta->map != NULL || value >= delta->map_count || delta->used[value]) {
+        return CMT_DECODE_MSGPACK_CORRUPT_INPUT_DATA_ERROR;
+    }
+
+    delta->used[value] = CMT_TRUE;
+    delta->map = delta->maps[value];
+
+    count = cfl_list_size(&delta->map->metrics);
+
+    delta->series = malloc(sizeof(struct cmt_metric *) * (count + 1));
+    delta->seen = calloc(1, count + 1);
+
+    if (NULL == delta->series || NULL == delta->seen) {
+        return CMT_DECODE_MSGPACK_ALLOCATION_ERROR;
+    }
+
+    count = 0;
+    cfl_list_foreach(head, &delta->map->metrics) {
+        delta->series[count++] = cfl_list_entry(head, struct cmt_metric, _head);
+    }
+    delta->series_count = count;
+
+    /* the static metric is only kept if the update carries it */
+    delta->map->metric_static_set = 0;
+
+    return CMT_DECODE_MSGPACK_SUCCESS;
+}
+
+static int unpack_delta_type_ts(mpack_reader_t *reader, size_t index, void *context)
+{
+    struct cmt_msgpack_delta_context *delta;
+
+    delta = (struct cmt_msgpack_delta_context *) context;
+
+    return cmt_mpack_consume_uint_tag(reader, &delta->touch_ts);
+}
+
+static int unpack_delta_range(mpack_reader_t *reader, size_t index, void *context)
+{
+    int                               result;
+    uint64_t                          value;
+    uint64_t                          entry;
+    struct cmt_msgpack_delta_context *delta;
+
+    delta = (struct cmt_msgpack_delta_context *) context;
+
+    result = cmt_mpack_consume_uint_tag(reader, &value);
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        return result;
+    }
+
+    /* [start, length] pairs */
+    if (index % 2 == 0) {
+        delta->range_start = value;
+
+        return CMT_DECODE_MSGPACK_SUCCESS;
+    }
+
+    if (delta->range_start > delta->series_count ||
+        value > delta->series_count - delta->range_start) {
+        return CMT_DECODE_MSGPACK_CORRUPT_INPUT_DATA_ERROR;
+    }
+
+    for (entry = delta->range_start ; entry < delta->range_start + value ; entry++) {
+        delta->seen[entry] = CMT_TRUE;
+
+        if (delta->touch) {
+            delta->series[entry]->timestamp = delta->touch_ts;
+        }
+    }
+
+    return CMT_DECODE_MSGPACK_SUCCESS;
+}
+
+static int unpack_delta_type_keep(mpack_reader_t *reader, size_t index, void *context)
+{
+    struct cmt_msgpack_delta_context *delta;
+
+    delta = (struct cmt_msgpack_delta_context *) context;
+
+    if (delta->map == NULL) {
+        return CMT_DECODE_MSGPACK_CORRUPT_INPUT_DATA_ERROR;
+    }
+
+    delta->touch = CMT_FALSE;
+
+    return cmt_mpack_unpack_array(reader, unpack_delta_range, context);
+}
+
+static int unpack_delta_type_touch(mpack_reader_t *reader, size_t index, void *context)
+{
+    struct cmt_msgpack_delta_context *delta;
+
+    delta = (struct cmt_msgpack_delta_context *) context;
+
+    if (delta->map == NULL) {
+        return CMT_DECODE_MSGPACK_CORRUPT_INPUT_DATA_ERROR;
+    }
+
+    delta->touch = CMT_TRUE;
+
+    return cmt_mpack_unpack_array(reader, unpack_delta_range, context);
+}
+
+static int unpack_delta_value(mpack_reader_t *reader, size_t index, void *context)
+{
+    int                                result;
+    struct cmt_metric                 *metric;
+    struct cmt_msgpack_decode_context  decode_context;
+    struct cmt_msgpack_delta_context  *delta;
+
+    delta = (struct cmt_msgpack_delta_context *) context;
+
+    memset(&decode_context, 0, sizeof(struct cmt_msgpack_decode_context));
+    decode_context.cmt = delta->cmt;
+    decode_context.map = delta->map;
+    decode_context.metric_ref = -1;
+
+    metric = NULL;
+    result = unpack_metric(reader, &decode_context, &metric);
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        return result;
+    }
+
+    if (decode_context.metric_ref >= 0) {
+        if ((uint64_t) decode_context.metric_ref >= delta->series_count) {
+            delta_metric_destroy(metric);
+
+            return CMT_DECODE_MSGPACK_CORRUPT_INPUT_DATA_ERROR;
+        }
+
+        delta_metric_update(delta->map, delta->series[decode_context.metric_ref],
+                            metric);
+        delta->seen[decode_context.metric_ref] = CMT_TRUE;
+        delta_metric_destroy(metric);
+    }
+    else if (0 == cfl_list_size(&metric->labels)) {
+        delta_metric_update(delta->map, &delta->map->metric, metric);
+        delta->map->metric.hash = metric->hash;
+        delta->map->metric_static_set = 1;
+        delta_metric_destroy(metric);
+    }
+    else {
+        cfl_list_add(&metric->_head, &delta->map->metrics);
+    }
+
+    return CMT_DECODE_MSGPACK_SUCCESS;
+}
+
+static int unpack_delta_type_values(mpack_reader_t *reader, size_t index, void *context)
+{
+    struct cmt_msgpack_delta_context *delta;
+
+    delta = (struct cmt_msgpack_delta_context *) context;
+
+    if (delta->map == NULL) {
+        return CMT_DECODE_MSGPACK_CORRUPT_INPUT_DATA_ERROR;
+    }
+
+    return cmt_mpack_unpack_array(reader, unpack_delta_value, context);
+}
+
+static int unpack_delta_type(mpack_reader_t *reader, size_t index, void *context)
+{
+    int                                   result;
+    size_t                                entry;
+    struct cmt_msgpack_delta_context     *delta;
+    struct cmt_mpack_map_entry_callback_t callbacks[] = \
+        {
+            {"base",   unpack_delta_type_base},
+            {"ts",     unpack_delta_type_ts},
+            {"keep",   unpack_delta_type_keep},
+            {"touch",  unpack_delta_type_touch},
+            {"values", unpack_delta_type_values},
+            {NULL,     NULL}
+        };
+
+    delta = (struct cmt_msgpack_delta_context *) context;
+
+    result = cmt_mpack_unpack_map(reader, callbacks, context);
+
+    if (CMT_DECODE_MSGPACK_SUCCESS == result) {
+        if (delta->map == NULL) {
+            result = CMT_DECODE_MSGPACK_CORRUPT_INPUT_DATA_ERROR;
+        }
+        else {
+            /* series not mentioned by the update are gone */
+            for (entry = 0 ; entry < delta->series_count ; entry++) {
+                if (!delta->seen[entry]) {
+                    cmt_map_metric_remove(delta->map, delta->series[entry]);
+                }
+            }
+        }
+    }
+
+    if (delta->series != NULL) {
+        free(delta->series);
+        delta->series = NULL;
+    }
+
+    if (delta->seen != NULL) {
+        free(delta->seen);
+        delta->seen = NULL;
+    }
+
+    delta->map = NULL;
+    delta->series_count = 0;
+    delta->touch_ts = 0;
+
+    return result;
+}
+
+static int unpack_delta_version(mpack_reader_t *reader, size_t index, void *context)
+{
+    int                               result;
+    uint64_t                          value;
+    struct cmt_msgpack_delta_context *delta;
+
+    delta = (struct cmt_msgpack_delta_context *) context;
+
+    result = cmt_mpack_consume_uint_tag(reader, &value);
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        return result;
+    }
+
+    if (value != MSGPACK_ENCODER_DELTA_VERSION) {
+        return CMT_DECODE_MSGPACK_VERSION_ERROR;
+    }
+
+    /* references are resolved against the base as it was before the update */
+    if (0 != cmt_encode_msgpack_maps(delta->cmt, &delta->maps, &delta->map_count)) {
+        return CMT_DECODE_MSGPACK_ALLOCATION_ERROR;
+    }
+
+    delta->used = calloc(1, delta->map_count + 1);
+
+    if (NULL == delta->used) {
+        return CMT_DECODE_MSGPACK_ALLOCATION_ERROR;
+    }
+
+    /* the header carries the full set of static labels */
+    cmt_labels_destroy(delta->cmt->static_labels);
+    delta->cmt->static_labels = cmt_labels_create();
+
+    if (NULL == delta->cmt->static_labels) {
+        return CMT_DECODE_MSGPACK_ALLOCATION_ERROR;
+    }
+
+    return CMT_DECODE_MSGPACK_SUCCESS;
+}
+
+static int unpack_delta_header(mpack_reader_t *reader, size_t index, void *context)
+{
+    struct cmt_msgpack_delta_context *delta;
+
+    delta = (struct cmt_msgpack_delta_context *) context;
+
+    if (delta->used == NULL) {
+        return CMT_DECODE_MSGPACK_CORRUPT_INPUT_DATA_ERROR;
+    }
+
+    return unpack_context_header(reader, index, delta->cmt);
+}
+
+static int unpack_delta_metrics(mpack_reader_t *reader, size_t index, void *context)
+{
+    struct cmt_msgpack_delta_context *delta;
+
+    delta = (struct cmt_msgpack_delta_context *) context;
+
+    if (delta->used == NULL) {
+        return CMT_DECODE_MSGPACK_CORRUPT_INPUT_DATA_ERROR;
+    }
+
+    return unpack_context_metrics(reader, index, delta->cmt);
+}
+
+static int unpack_delta_updates(mpack_reader_t *reader, size_t index, void *context)
+{
+    struct cmt_msgpack_delta_context *delta;
+
+    delta = (struct cmt_msgpack_delta_context *) context;
+
+    if (delta->used == NULL) {
+        return CMT_DECODE_MSGPACK_CORRUPT_INPUT_DATA_ERROR;
+    }
+
+    return cmt_mpack_unpack_array(reader, unpack_delta_type, context);
+}
+
+static int unpack_delta_context(mpack_reader_t *reader,
+                                struct cmt_msgpack_delta_context *delta)
+{
+    int                                   result;
+    size_t                                index;
+    struct cmt_mpack_map_entry_callback_t callbacks[] = \
+        {
+            {"delta",   unpack_delta_version},
+            {"meta",    unpack_delta_header},
+            {"metrics", unpack_delta_metrics},
+            {"updates", unpack_delta_updates},
+            {NULL,      NULL}
+        };
+
+    result = cmt_mpack_unpack_map(reader, callbacks, (void *) delta);
+
+    if (CMT_DECODE_MSGPACK_SUCCESS == result && delta->used == NULL) {
+        result = CMT_DECODE_MSGPACK_CORRUPT_INPUT_DATA_ERROR;
+    }
+
+    if (CMT_DECODE_MSGPACK_SUCCESS == result) {
+        /* families not referenced by the update are gone */
+        for (index = 0 ; index < delta->map_count ; index++) {
+            if (!delta->used[index]) {
+                delta_map_destroy(delta->maps[index]);
+            }
+        }
+    }
+
+    if (delta->maps != NULL) {
+        free(delta->maps);
+    }
+
+    if (delta->used != NULL) {
+        free(delta->used);
+    }
+
+    return result;
+}
+
+/*
+ * Decode the next context of a msgpack payload that might hold delta encoded
+ * contexts. A regular context replaces '*base' while a delta context is
+ * applied in place over it, so after every call '*base' holds the full state
+ * described by the payload up to 'offset'. On error '*base' is destroyed and
+ * set to NULL. 'is_delta' (optional) tells which kind of context was found.
+ */
+int cmt_decode_msgpack_delta_apply(struct cmt **base, char *in_buf, size_t in_size,
+                                   size_t *offset, int *is_delta)
+{
+    int                              result;
+    size_t                           start;
+    size_t                           remainder;
+    struct cmt                      *cmt;
+    mpack_reader_t                   reader;
+    struct cmt_msgpack_delta_context delta;
+
+    if (NULL == base ||
+        NULL == in_buf ||
+        NULL == offset ||
+        in_size < *offset ) {
+        return CMT_DECODE_MSGPACK_INVALID_ARGUMENT_ERROR;
+    }
+
+    start = *offset;
+
+    cmt = NULL;
+    result = cmt_decode_msgpack_create(&cmt, in_buf, in_size, offset);
+
+    if (CMT_DECODE_MSGPACK_SUCCESS == result) {
+        if (NULL != *base) {
+            cmt_destroy(*base);
+        }
+        *base = cmt;
+
+        if (NULL != is_delta) {
+            *is_delta = CMT_FALSE;
+        }
+
+        return result;
+    }
+    else if (CMT_DECODE_MSGPACK_DELTA_ERROR != result) {
+        return result;
+    }
+
+    *offset = start;
+
+    if (NULL == *base) {
+        return CMT_DECODE_MSGPACK_DELTA_BASE_ERROR;
+    }
+
+    memset(&delta, 0, sizeof(struct cmt_msgpack_delta_context));
+    delta.cmt = *base;
+
+    in_size -= *offset;
+
+    mpack_reader_init_data(&reader, &in_buf[*offset], in_size);
+
+    result = unpack_delta_context(&reader, &delta);
+
+    remainder = mpack_reader_remaining(&reader, NULL);
+
+    *offset += in_size - remainder;
+
+    mpack_reader_destroy(&reader);
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        cmt_destroy(*base);
+        *base = NULL;
+    }
+    else if (NULL != is_delta) {
+        *is_delta = CMT_TRUE;
+    }
+
+    return result;
+}
+
 /* Convert cmetrics msgpack payload and generate a CMetrics context */
 int cmt_decode_msgpack_create(struct cmt **out_cmt, char *in_buf, size_t in_size,
                               size_t *offset)
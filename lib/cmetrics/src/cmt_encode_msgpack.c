@@ -164,30 +164,14 @@ static void pack_header(mpack_writer_t *writer, struct cmt *cmt, struct cmt_map
     mpack_finish_map(writer); /* 'meta' */
 }
 
-static int pack_metric(mpack_writer_t *writer, struct cmt_map *map, struct cmt_metric *metric)
+static void pack_metric_value(mpack_writer_t *writer, struct cmt_map *map,
+                              struct cmt_metric *metric)
 {
-    int c_labels;
-    int s;
     double val;
     size_t index;
-    struct cfl_list *head;
-    struct cmt_map_label *label;
     struct cmt_summary *summary;
     struct cmt_histogram *histogram;
 
-    c_labels = cfl_list_size(&metric->labels);
-
-    s = 3;
-
-    if (c_labels > 0) {
-        s++;
-    }
-
-    mpack_start_map(writer, s);
-
-    mpack_write_cstr(writer, "ts");
-    mpack_write_uint(writer, metric->timestamp);
-
     if (map->type == CMT_HISTOGRAM) {
         histogram = (struct cmt_histogram *) map->parent;
 
@@ -243,6 +227,29 @@ static int pack_metric(mpack_writer_t *writer, struct cmt_map *map, struct cmt_m
         val = cmt_metric_get_value(metric);
         mpack_write_double(writer, val);
     }
+}
+
+static int pack_metric(mpack_writer_t *writer, struct cmt_map *map, struct cmt_metric *metric)
+{
+    int c_labels;
+    int s;
+    struct cfl_list *head;
+    struct cmt_map_label *label;
+
+    c_labels = cfl_list_size(&metric->labels);
+
+    s = 3;
+
+    if (c_labels > 0) {
+        s++;
+    }
+
+    mpack_start_map(writer, s);
+
+    mpack_write_cstr(writer, "ts");
+    mpack_write_uint(writer, metric->timestamp);
+
+    pack_metric_value(writer, map, metric);
 
     s = cfl_list_size(&metric->labels);
     if (s > 0) {
@@ -448,6 +455,542 @@ static int pack_context(mpack_writer_t *writer, struct cmt *cmt)
     return 0;
 }
 
+/*
+ * Delta encoding
+ * ==============
+ *
+ * A delta context describes 'cmt' in terms of a 'base' context that the
+ * decoder already holds (see cmt_decode_msgpack_delta_apply()). Families
+ * and series are referenced by their position in the base encoding order,
+ * as returned by cmt_encode_msgpack_maps().
+ */
+
+struct delta_series {
+    uint64_t hash;
+    size_t index;
+    struct cmt_metric *metric;
+};
+
+#define DELTA_SERIES_REMOVED  0
+#define DELTA_SERIES_KEEP     1
+#define DELTA_SERIES_TOUCH    2
+
+static int delta_series_compare(const void *a, const void *b)
+{
+    const struct delta_series *x = a;
+    const struct delta_series *y = b;
+
+    if (x->hash < y->hash) {
+        return -1;
+    }
+    else if (x->hash > y->hash) {
+        return 1;
+    }
+
+    return 0;
+}
+
+int cmt_encode_msgpack_maps(struct cmt *cmt, struct cmt_map ***out_maps,
+                            size_t *out_count)
+{
+    size_t                count;
+    struct cmt_map      **maps;
+    struct cfl_list      *head;
+
+    count  = cfl_list_size(&cmt->counters);
+    count += cfl_list_size(&cmt->gauges);
+    count += cfl_list_size(&cmt->untypeds);
+    count += cfl_list_size(&cmt->summaries);
+    count += cfl_list_size(&cmt->histograms);
+
+    maps = malloc(sizeof(struct cmt_map *) * (count + 1));
+    if (maps == NULL) {
+        return -1;
+    }
+
+    /* same order than pack_context_metrics() */
+    count = 0;
+    cfl_list_foreach(head, &cmt->counters) {
+        maps[count++] = cfl_list_entry(head, struct cmt_counter, _head)->map;
+    }
+    cfl_list_foreach(head, &cmt->gauges) {
+        maps[count++] = cfl_list_entry(head, struct cmt_gauge, _head)->map;
+    }
+    cfl_list_foreach(head, &cmt->untypeds) {
+        maps[count++] = cfl_list_entry(head, struct cmt_untyped, _head)->map;
+    }
+    cfl_list_foreach(head, &cmt->summaries) {
+        maps[count++] = cfl_list_entry(head, struct cmt_summary, _head)->map;
+    }
+    cfl_list_foreach(head, &cmt->histograms) {
+        maps[count++] = cfl_list_entry(head, struct cmt_histogram, _head)->map;
+    }
+
+    *out_maps = maps;
+    *out_count = count;
+
+    return 0;
+}
+
+static int delta_str_equal(cfl_sds_t a, cfl_sds_t b)
+{
+    if (a == NULL || b == NULL) {
+        return a == b;
+    }
+
+    return strcmp(a, b) == 0;
+}
+
+/* tells if both families share type, name and label keys */
+static int delta_map_match(struct cmt_map *map, struct cmt_map *base)
+{
+    size_t                index;
+    struct cfl_list      *head;
+    struct cfl_list      *base_head;
+    struct cmt_map_label *label;
+    struct cmt_map_label *base_label;
+    struct cmt_histogram *histogram;
+    struct cmt_histogram *base_histogram;
+    struct cmt_summary   *summary;
+    struct cmt_summary   *base_summary;
+
+    if (map->type != base->type || map->label_count != base->label_count) {
+        return CMT_FALSE;
+    }
+
+    if (!delta_str_equal(map->opts->ns, base->opts->ns) ||
+        !delta_str_equal(map->opts->subsystem, base->opts->subsystem) ||
+        !delta_str_equal(map->opts->name, base->opts->name) ||
+        !delta_str_equal(map->opts->description, base->opts->description)) {
+        return CMT_FALSE;
+    }
+
+    base_head = base->label_keys.next;
+    cfl_list_foreach(head, &map->label_keys) {
+        if (base_head == &base->label_keys) {
+            return CMT_FALSE;
+        }
+        label = cfl_list_entry(head, struct cmt_map_label, _head);
+        base_label = cfl_list_entry(base_head, struct cmt_map_label, _head);
+        if (!delta_str_equal(label->name, base_label->name)) {
+            return CMT_FALSE;
+        }
+        base_head = base_head->next;
+    }
+
+    if (map->type == CMT_COUNTER) {
+        if (((struct cmt_counter *) map->parent)->aggregation_type !=
+            ((struct cmt_counter *) base->parent)->aggregation_type) {
+            return CMT_FALSE;
+        }
+    }
+    else if (map->type == CMT_HISTOGRAM) {
+        histogram = map->parent;
+        base_histogram = base->parent;
+
+        if (histogram->buckets == NULL || base_histogram->buckets == NULL ||
+            histogram->buckets->count != base_histogram->buckets->count) {
+            return CMT_FALSE;
+        }
+        for (index = 0 ; index < histogram->buckets->count ; index++) {
+            if (histogram->buckets->upper_bounds[index] !=
+                base_histogram->buckets->upper_bounds[index]) {
+                return CMT_FALSE;
+            }
+        }
+    }
+    else if (map->type == CMT_SUMMARY) {
+        summary = map->parent;
+        base_summary = base->parent;
+
+        if (summary->quantiles_count != base_summary->quantiles_count) {
+            return CMT_FALSE;
+        }
+        for (index = 0 ; index < summary->quantiles_count ; index++) {
+            if (summary->quantiles[index] != base_summary->quantiles[index]) {
+                return CMT_FALSE;
+            }
+        }
+    }
+
+    return CMT_TRUE;
+}
+
+/* compares the values of two series of the same family, not the timestamps */
+static int delta_metric_equal(struct cmt_map *map, struct cmt_metric *a,
+                              struct cmt_metric *b)
+{
+    size_t                index;
+    struct cmt_histogram *histogram;
+    struct cmt_summary   *summary;
+
+    if (map->type == CMT_HISTOGRAM) {
+        histogram = map->parent;
+
+        if (a->hist_count != b->hist_count || a->hist_sum != b->hist_sum) {
+            return CMT_FALSE;
+        }
+        for (index = 0 ; index <= histogram->buckets->count ; index++) {
+            if (cmt_metric_hist_get_value(a, index) !=
+                cmt_metric_hist_get_value(b, index)) {
+                return CMT_FALSE;
+            }
+        }
+
+        return CMT_TRUE;
+    }
+    else if (map->type == CMT_SUMMARY) {
+        summary = map->parent;
+
+        if (a->sum_quantiles_set != b->sum_quantiles_set ||
+            a->sum_count != b->sum_count || a->sum_sum != b->sum_sum) {
+            return CMT_FALSE;
+        }
+        for (index = 0 ; index < summary->quantiles_count ; index++) {
+            if (a->sum_quantiles[index] != b->sum_quantiles[index]) {
+                return CMT_FALSE;
+            }
+        }
+
+        return CMT_TRUE;
+    }
+
+    return a->val == b->val;
+}
+
+/* writes the runs of 'status' entries equal to 'value' as [start, length] pairs */
+static void pack_delta_ranges(mpack_writer_t *writer, char *status, size_t count,
+                              int value)
+{
+    size_t index;
+    size_t start;
+    size_t ranges;
+
+    ranges = 0;
+    for (index = 0 ; index < count ; index++) {
+        if (status[index] == value &&
+            (index == 0 || status[index - 1] != value)) {
+            ranges++;
+        }
+    }
+
+    mpack_start_array(writer, ranges * 2);
+
+    index = 0;
+    while (index < count) {
+        if (status[index] != value) {
+            index++;
+            continue;
+        }
+
+        start = index;
+        while (index < count && status[index] == value) {
+            index++;
+        }
+
+        mpack_write_uint(writer, start);
+        mpack_write_uint(writer, index - start);
+    }
+
+    mpack_finish_array(writer);
+}
+
+static void pack_metric_ref(mpack_writer_t *writer, struct cmt_map *map,
+                            struct cmt_metric *metric, size_t ref)
+{
+    mpack_start_map(writer, 3);
+
+    mpack_write_cstr(writer, "ref");
+    mpack_write_uint(writer, ref);
+
+    mpack_write_cstr(writer, "ts");
+    mpack_write_uint(writer, metric->timestamp);
+
+    pack_metric_value(writer, map, metric);
+
+    mpack_finish_map(writer);
+}
+
+/*
+ * Family update, series of the base family that are not listed in 'keep',
+ * 'touch' or referenced by a 'values' entry are gone:
+ *
+ *   {
+ *       'base'   => INTEGER (family position in the base context),
+ *       'ts'     => INTEGER (timestamp of the 'touch' series),
+ *       'keep'   => [start, length, ...] (unchanged series),
+ *       'touch'  => [start, length, ...] (unchanged values, new timestamp),
+ *       'values' => [ {'ref' => INTEGER, 'ts' => ..., 'value' => ...} |
+ *                     regular value entry (static or new series), ... ]
+ *   }
+ */
+static int pack_delta_type(mpack_writer_t *writer, struct cmt_map *map,
+                           struct cmt_map *base, size_t base_index)
+{
+    int                  found;
+    size_t               index;
+    size_t               count;
+    size_t               base_count;
+    size_t               values_size;
+    uint64_t             touch_ts;
+    char                *status;
+    int64_t             *refs;
+    struct delta_series  key;
+    struct delta_series *match;
+    struct delta_series *series;
+    struct cfl_list     *head;
+    struct cmt_metric   *metric;
+
+    base_count = cfl_list_size(&base->metrics);
+    count = cfl_list_size(&map->metrics);
+
+    series = malloc(sizeof(struct delta_series) * (base_count + 1));
+    status = calloc(1, base_count + 1);
+    refs = malloc(sizeof(int64_t) * (count + 1));
+
+    if (series == NULL || status == NULL || refs == NULL) {
+        free(series);
+        free(status);
+        free(refs);
+        return -1;
+    }
+
+    index = 0;
+    cfl_list_foreach(head, &base->metrics) {
+        metric = cfl_list_entry(head, struct cmt_metric, _head);
+        series[index].hash = metric->hash;
+        series[index].index = index;
+        series[index].metric = metric;
+        index++;
+    }
+    qsort(series, base_count, sizeof(struct delta_series), delta_series_compare);
+
+    /* classify every series: kept or touched (-2), new (-1) or updated (ref) */
+    found = CMT_FALSE;
+    touch_ts = 0;
+    values_size = 0;
+    index = 0;
+    cfl_list_foreach(head, &map->metrics) {
+        metric = cfl_list_entry(head, struct cmt_metric, _head);
+        refs[index] = -1;
+
+        key.hash = metric->hash;
+        match = bsearch(&key, series, base_count, sizeof(struct delta_series),
+                        delta_series_compare);
+
+        if (match != NULL && status[match->index] == DELTA_SERIES_REMOVED &&
+            delta_metric_equal(map, metric, match->metric)) {
+            if (metric->timestamp == match->metric->timestamp) {
+                status[match->index] = DELTA_SERIES_KEEP;
+                refs[index++] = -2;
+                continue;
+            }
+            if (found == CMT_FALSE) {
+                found = CMT_TRUE;
+                touch_ts = metric->timestamp;
+            }
+            if (metric->timestamp == touch_ts) {
+                status[match->index] = DELTA_SERIES_TOUCH;
+                refs[index++] = -2;
+                continue;
+            }
+        }
+
+        if (match != NULL && status[match->index] == DELTA_SERIES_REMOVED) {
+            /* any status but 'removed' so it is not listed twice */
+            status[match->index] = DELTA_SERIES_TOUCH + 1;
+            refs[index] = match->index;
+        }
+        values_size++;
+        index++;
+    }
+
+    if (map->metric_static_set) {
+        values_size++;
+    }
+
+    mpack_start_map(writer, 5);
+
+    mpack_write_cstr(writer, "base");
+    mpack_write_uint(writer, base_index);
+
+    mpack_write_cstr(writer, "ts");
+    mpack_write_uint(writer, touch_ts);
+
+    mpack_write_cstr(writer, "keep");
+    pack_delta_ranges(writer, status, base_count, DELTA_SERIES_KEEP);
+
+    mpack_write_cstr(writer, "touch");
+    pack_delta_ranges(writer, status, base_count, DELTA_SERIES_TOUCH);
+
+    mpack_write_cstr(writer, "values");
+    mpack_start_array(writer, values_size);
+
+    if (map->metric_static_set) {
+        pack_metric(writer, map, &map->metric);
+    }
+
+    index = 0;
+    cfl_list_foreach(head, &map->metrics) {
+        metric = cfl_list_entry(head, struct cmt_metric, _head);
+
+        if (refs[index] >= 0) {
+            pack_metric_ref(writer, map, metric, refs[index]);
+        }
+        else if (refs[index] == -1) {
+            pack_metric(writer, map, metric);
+        }
+        index++;
+    }
+
+    mpack_finish_array(writer);
+    mpack_finish_map(writer);
+
+    free(series);
+    free(status);
+    free(refs);
+
+    return 0;
+}
+
+/* Takes a cmetrics context and serialize it as changes over 'base' */
+int cmt_encode_msgpack_delta_create(struct cmt *cmt, struct cmt *base,
+                                    char **out_buf, size_t *out_size)
+{
+    int               result;
+    char             *data;
+    char             *used;
+    size_t            size;
+    size_t            index;
+    size_t            count;
+    size_t            base_count;
+    size_t            new_count;
+    size_t            base_index;
+    int64_t          *matches;
+    struct cmt_map  **maps;
+    struct cmt_map  **base_maps;
+    mpack_writer_t    writer;
+
+    /*
+     * Delta context schema, 'delta' always comes first so decoders that do
+     * not know about it fail on the first key:
+     *
+     *  {
+     *      'delta'   => INTEGER (version),
+     *      'meta'    => regular context header,
+     *      'metrics' => [ families not found in the base, regular format ],
+     *      'updates' => [ family updates, see pack_delta_type() ]
+     *  }
+     */
+
+    if (base == NULL) {
+        return cmt_encode_msgpack_create(cmt, out_buf, out_size);
+    }
+
+    if (cmt == NULL) {
+        return -1;
+    }
+
+    if (cmt_encode_msgpack_maps(cmt, &maps, &count) != 0) {
+        return -1;
+    }
+
+    if (cmt_encode_msgpack_maps(base, &base_maps, &base_count) != 0) {
+        free(maps);
+        return -1;
+    }
+
+    matches = malloc(sizeof(int64_t) * (count + 1));
+    used = calloc(1, base_count + 1);
+
+    if (matches == NULL || used == NULL) {
+        free(matches);
+        free(used);
+        free(maps);
+        free(base_maps);
+        return -1;
+    }
+
+    /* families usually keep their position, look there first */
+    new_count = 0;
+    for (index = 0 ; index < count ; index++) {
+        matches[index] = -1;
+
+        if (index < base_count && !used[index] &&
+            delta_map_match(maps[index], base_maps[index])) {
+            matches[index] = index;
+        }
+        else {
+            for (base_index = 0 ; base_index < base_count ; base_index++) {
+                if (!used[base_index] &&
+                    delta_map_match(maps[index], base_maps[base_index])) {
+                    matches[index] = base_index;
+                    break;
+                }
+            }
+        }
+
+        if (matches[index] >= 0) {
+            used[matches[index]] = CMT_TRUE;
+        }
+        else {
+            new_count++;
+        }
+    }
+
+    mpack_writer_init_growable(&writer, &data, &size);
+
+    mpack_start_map(&writer, 4);
+
+    mpack_write_cstr(&writer, "delta");
+    mpack_write_uint(&writer, MSGPACK_ENCODER_DELTA_VERSION);
+
+    result = pack_context_header(&writer, cmt);
+
+    if (result == 0) {
+        mpack_write_cstr(&writer, "metrics");
+        mpack_start_array(&writer, new_count);
+        for (index = 0 ; index < count ; index++) {
+            if (matches[index] < 0) {
+                pack_basic_type(&writer, cmt, maps[index]);
+            }
+        }
+        mpack_finish_array(&writer);
+
+        mpack_write_cstr(&writer, "updates");
+        mpack_start_array(&writer, count - new_count);
+        for (index = 0 ; index < count && result == 0 ; index++) {
+            if (matches[index] >= 0) {
+                result = pack_delta_type(&writer, maps[index],
+                                         base_maps[matches[index]],
+                                         matches[index]);
+            }
+        }
+        mpack_finish_array(&writer);
+    }
+
+    mpack_finish_map(&writer);
+
+    free(matches);
+    free(used);
+    free(maps);
+    free(base_maps);
+
+    if (mpack_writer_destroy(&writer) != mpack_ok) {
+        return -1;
+    }
+
+    if (result != 0) {
+        MPACK_FREE(data);
+        return -1;
+    }
+
+    *out_buf = data;
+    *out_size = size;
+
+    return 0;
+}
+
 /* Takes a cmetrics context and serialize it using msgpack */
 int cmt_encode_msgpack_create(struct cmt *cmt, char **out_buf, size_t *out_size)
 {
@@ -1073,34 +1073,32 @@ int pack_complex_type(struct cmt_prometheus_remote_write_context *context,
 }
 
 /* Format all the registered metrics in Prometheus Text format */
-cfl_sds_t cmt_encode_prometheus_remote_write_create(struct cmt *cmt)
+static int pack_remote_write_context(struct cmt_prometheus_remote_write_context *context,
+                                     struct cmt *cmt)
 {
-    struct cmt_histogram                      *histogram;
-    struct cmt_prometheus_remote_write_context context;
-    struct cmt_untyped                        *untyped;
-    struct cmt_counter                        *counter;
-    struct cmt_summary                        *summary;
-    int                                        result;
-    struct cmt_gauge                          *gauge;
-    struct cfl_list                            *head;
-    cfl_sds_t                                  buf;
+    struct cmt_histogram *histogram;
+    struct cmt_untyped   *untyped;
+    struct cmt_counter   *counter;
+    struct cmt_summary   *summary;
+    int                   result;
+    struct cmt_gauge     *gauge;
+    struct cfl_list      *head;
 
     result = CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
-    buf = NULL;
 
-    memset(&context, 0, sizeof(struct cmt_prometheus_remote_write_context));
+    memset(context, 0, sizeof(struct cmt_prometheus_remote_write_context));
 
-    prometheus__write_request__init(&context.write_request);
+    prometheus__write_request__init(&context->write_request);
 
-    context.cmt = cmt;
+    context->cmt = cmt;
 
-    cfl_list_init(&context.time_series_entries);
-    cfl_list_init(&context.metadata_entries);
+    cfl_list_init(&context->time_series_entries);
+    cfl_list_init(&context->metadata_entries);
 
     /* Counters */
     cfl_list_foreach(head, &cmt->counters) {
         counter = cfl_list_entry(head, struct cmt_counter, _head);
-        result = pack_basic_type(&context, counter->map);
+        result = pack_basic_type(context, counter->map);
 
         if (result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_CUTOFF_ERROR) {
             continue;
@@ -1115,7 +1113,7 @@ cfl_sds_t cmt_encode_prometheus_remote_write_create(struct cmt *cmt)
         /* Gauges */
         cfl_list_foreach(head, &cmt->gauges) {
             gauge = cfl_list_entry(head, struct cmt_gauge, _head);
-            result = pack_basic_type(&context, gauge->map);
+            result = pack_basic_type(context, gauge->map);
 
             if (result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_CUTOFF_ERROR) {
                 continue;
@@ -1131,7 +1129,7 @@ cfl_sds_t cmt_encode_prometheus_remote_write_create(struct cmt *cmt)
         /* Untyped */
         cfl_list_foreach(head, &cmt->untypeds) {
             untyped = cfl_list_entry(head, struct cmt_untyped, _head);
-            pack_basic_type(&context, untyped->map);
+            pack_basic_type(context, untyped->map);
 
             if (result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_CUTOFF_ERROR) {
                 continue;
@@ -1143,7 +1141,7 @@ cfl_sds_t cmt_encode_prometheus_remote_write_create(struct cmt *cmt)
         /* Summaries */
         cfl_list_foreach(head, &cmt->summaries) {
             summary = cfl_list_entry(head, struct cmt_summary, _head);
-            result = pack_complex_type(&context, summary->map);
+            result = pack_complex_type(context, summary->map);
 
             if (result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_CUTOFF_ERROR) {
                 continue;
@@ -1159,7 +1157,7 @@ cfl_sds_t cmt_encode_prometheus_remote_write_create(struct cmt *cmt)
         /* Histograms */
         cfl_list_foreach(head, &cmt->histograms) {
             histogram = cfl_list_entry(head, struct cmt_histogram, _head);
-            result = pack_complex_type(&context, histogram->map);
+            result = pack_complex_type(context, histogram->map);
 
             if (result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_CUTOFF_ERROR) {
                 continue;
@@ -1171,6 +1169,19 @@ cfl_sds_t cmt_encode_prometheus_remote_write_create(struct cmt *cmt)
         }
     }
 
+    return result;
+}
+
+cfl_sds_t cmt_encode_prometheus_remote_write_create(struct cmt *cmt)
+{
+    struct cmt_prometheus_remote_write_context context;
+    int                                        result;
+    cfl_sds_t                                  buf;
+
+    buf = NULL;
+
+    result = pack_remote_write_context(&context, cmt);
+
     if (result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS ||
         result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_CUTOFF_ERROR) {
         buf = render_remote_write_context_to_sds(&context);
@@ -1181,6 +1192,44 @@ cfl_sds_t cmt_encode_prometheus_remote_write_create(struct cmt *cmt)
     return buf;
 }
 
+/*
+ * Invoke 'cb' for every time series of the context instead of rendering a
+ * single write request, so callers can split the series into several
+ * requests (e.g: by a hash of the label set). Metadata is not reported.
+ */
+int cmt_encode_prometheus_remote_write_series(struct cmt *cmt,
+                                              int (*cb) (Prometheus__TimeSeries *series,
+                                                         void *data),
+                                              void *data)
+{
+    struct cmt_prometheus_remote_write_context context;
+    struct cmt_prometheus_time_series         *time_series_entry;
+    int                                        result;
+    struct cfl_list                            *head;
+
+    result = pack_remote_write_context(&context, cmt);
+
+    if (result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS ||
+        result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_CUTOFF_ERROR) {
+        result = CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
+
+        cfl_list_foreach(head, &context.time_series_entries) {
+            time_series_entry = cfl_list_entry(head, struct cmt_prometheus_time_series, _head);
+
+            if (cb(&time_series_entry->data, data) != 0) {
+                result = CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_UNEXPECTED_ERROR;
+
+                break;
+            }
+        }
+    }
+
+    cmt_destroy_prometheus_remote_write_context(&context);
+
+    return result;
+}
+
+
 void cmt_encode_prometheus_remote_write_destroy(cfl_sds_t text)
 {
     cfl_sds_destroy(text);
@@ -243,7 +243,7 @@ static int metrics_map_drop_label_value_pairs(struct cmt_map *map,
     }
 
     if (result == CMT_TRUE) {
-        cmt_map_metric_destroy(metric);
+        cmt_map_metric_remove(map, metric);
     }
 
     return result;
@@ -367,6 +367,41 @@ int cmt_histogram_observe(struct cmt_histogram *histogram, uint64_t timestamp,
     return 0;
 }
 
+/*
+ * Add observations aggregated by the caller: 'bucket_counts' holds the
+ * cumulative count of every bucket plus +Inf, same layout than the values
+ * of cmt_histogram_set_default(), 'sum' and 'count' are added as they are.
+ */
+int cmt_histogram_add(struct cmt_histogram *histogram, uint64_t timestamp,
+                      uint64_t *bucket_counts, double sum, uint64_t count,
+                      int labels_count, char **label_vals)
+{
+    int i;
+    struct cmt_metric *metric;
+    struct cmt_histogram_buckets *buckets;
+
+    metric = histogram_get_metric(histogram, labels_count, label_vals);
+    if (!metric) {
+        cmt_log_error(histogram->cmt,
+                      "unable to retrieve metric for histogram %s_%s_%s",
+                      histogram->opts.ns, histogram->opts.subsystem,
+                      histogram->opts.name);
+        return -1;
+    }
+
+    buckets = histogram->buckets;
+    for (i = 0; i <= buckets->count; i++) {
+        if (bucket_counts[i] > 0) {
+            cmt_metric_hist_add(metric, timestamp, i, bucket_counts[i]);
+        }
+    }
+
+    cmt_metric_hist_count_add(metric, timestamp, count);
+    cmt_metric_hist_sum_add(metric, timestamp, sum);
+
+    return 0;
+}
+
 int cmt_histogram_set_default(struct cmt_histogram *histogram,
                               uint64_t timestamp,
                               uint64_t *bucket_defaults,
@@ -47,6 +47,7 @@ struct cmt_map *cmt_map_create(int type, struct cmt_opts *opts, int count, char
     cfl_list_init(&map->label_keys);
     cfl_list_init(&map->metrics);
     cfl_list_init(&map->metric.labels);
+    map->index_tail = &map->metrics;
 
     if (count == 0) {
         map->metric_static_set = 1;
@@ -76,8 +77,140 @@ struct cmt_map *cmt_map_create(int type, struct cmt_opts *opts, int count, char
     return NULL;
 }
 
+#define CMT_MAP_INDEX_INIT_SIZE  16
+
+static inline size_t index_slot(struct cmt_map *map, uint64_t hash)
+{
+    /* mix the upper bits in, the table size is a power of two */
+    return (size_t) (hash ^ (hash >> 32)) & (map->index_size - 1);
+}
+
+/* Insert a series, the first one registered for a hash wins */
+static void index_insert(struct cmt_map *map, struct cmt_metric *metric)
+{
+    size_t slot;
+
+    slot = index_slot(map, metric->hash);
+    while (map->index[slot]) {
+        if (map->index[slot]->hash == metric->hash) {
+            return;
+        }
+        slot = (slot + 1) & (map->index_size - 1);
+    }
+
+    map->index[slot] = metric;
+    map->index_count++;
+}
+
+static int index_resize(struct cmt_map *map, size_t size)
+{
+    size_t i;
+    size_t old_size;
+    struct cmt_metric **old;
+
+    old = map->index;
+    old_size = map->index_size;
+
+    map->index = calloc(size, sizeof(struct cmt_metric *));
+    if (!map->index) {
+        cmt_errno();
+        map->index = old;
+        return -1;
+    }
+    map->index_size = size;
+    map->index_count = 0;
+
+    for (i = 0; i < old_size; i++) {
+        if (old[i]) {
+            index_insert(map, old[i]);
+        }
+    }
+    free(old);
+
+    return 0;
+}
+
+/* Keep the load factor under 3/4 */
+static int index_reserve(struct cmt_map *map)
+{
+    size_t size;
+
+    if (map->index && (map->index_count + 1) * 4 <= map->index_size * 3) {
+        return 0;
+    }
+
+    size = map->index_size ? map->index_size * 2 : CMT_MAP_INDEX_INIT_SIZE;
+    return index_resize(map, size);
+}
+
+static int index_add(struct cmt_map *map, struct cmt_metric *metric)
+{
+    if (index_reserve(map) != 0) {
+        return -1;
+    }
+
+    index_insert(map, metric);
+    map->index_tail = &metric->_head;
+    return 0;
+}
+
+/* Index the series appended to the list since the last lookup */
+static int index_sync(struct cmt_map *map)
+{
+    struct cfl_list *head;
+    struct cmt_metric *metric;
+
+    for (head = map->index_tail->next; head != &map->metrics; head = head->next) {
+        metric = cfl_list_entry(head, struct cmt_metric, _head);
+        if (index_add(map, metric) != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Backward shift deletion, keeps the probe sequences intact */
+static void index_delete(struct cmt_map *map, struct cmt_metric *metric)
+{
+    size_t i;
+    size_t j;
+    size_t home;
+    size_t mask;
+
+    if (!map->index) {
+        return;
+    }
+
+    mask = map->index_size - 1;
+    i = index_slot(map, metric->hash);
+    while (map->index[i] != metric) {
+        if (!map->index[i]) {
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+
+    j = i;
+    while (1) {
+        map->index[i] = NULL;
+        do {
+            j = (j + 1) & mask;
+            if (!map->index[j]) {
+                map->index_count--;
+                return;
+            }
+            home = index_slot(map, map->index[j]->hash);
+        } while (i <= j ? (i < home && home <= j) : (i < home || home <= j));
+
+        map->index[i] = map->index[j];
+        i = j;
+    }
+}
+
 static struct cmt_metric *metric_hash_lookup(struct cmt_map *map, uint64_t hash)
 {
+    size_t slot;
     struct cfl_list *head;
     struct cmt_metric *metric;
 
@@ -85,11 +218,27 @@ static struct cmt_metric *metric_hash_lookup(struct cmt_map *map, uint64_t hash)
         return &map->metric;
     }
 
-    cfl_list_foreach(head, &map->metrics) {
-        metric = cfl_list_entry(head, struct cmt_metric, _head);
+    if (map->index_tail != map->metrics.prev && index_sync(map) != 0) {
+        /* could not grow the index, fallback to a linear scan */
+        cfl_list_foreach(head, &map->metrics) {
+            metric = cfl_list_entry(head, struct cmt_metric, _head);
+            if (metric->hash == hash) {
+                return metric;
+            }
+        }
+        return NULL;
+    }
+
+    if (!map->index) {
+        return NULL;
+    }
+
+    slot = index_slot(map, hash);
+    while ((metric = map->index[slot])) {
         if (metric->hash == hash) {
             return metric;
         }
+        slot = (slot + 1) & (map->index_size - 1);
     }
 
     return NULL;
@@ -160,6 +309,26 @@ void cmt_map_metric_destroy(struct cmt_metric *metric)
     free(metric);
 }
 
+/* Unlink a series from the map and its index, then destroy it */
+void cmt_map_metric_remove(struct cmt_map *map, struct cmt_metric *metric)
+{
+    if (map->index_tail == &metric->_head) {
+        map->index_tail = metric->_head.prev;
+    }
+    index_delete(map, metric);
+    cmt_map_metric_destroy(metric);
+}
+
+void cmt_map_set_cardinality_limit(struct cmt_map *map, size_t limit)
+{
+    map->cardinality_limit = limit;
+}
+
+uint64_t cmt_map_get_cardinality_overflow(struct cmt_map *map)
+{
+    return map->cardinality_overflow;
+}
+
 struct cmt_metric *cmt_map_metric_get(struct cmt_opts *opts, struct cmt_map *map,
                                       int labels_count, char **labels_val,
                                       int write_op)
@@ -228,12 +397,25 @@ struct cmt_metric *cmt_map_metric_get(struct cmt_opts *opts, struct cmt_map *map
         return NULL;
     }
 
+    /* New series are rejected once the limit is reached */
+    if (map->cardinality_limit > 0 &&
+        map->index_count >= map->cardinality_limit) {
+        map->cardinality_overflow++;
+        return NULL;
+    }
+
     /* If the metric has not been found, just create it */
     metric = map_metric_create(hash, labels_count, labels_val);
     if (!metric) {
         return NULL;
     }
     cfl_list_add(&metric->_head, &map->metrics);
+
+    if (index_add(map, metric) != 0) {
+        /* the list stays the source of truth, index it on next lookup */
+        map->index_tail = metric->_head.prev;
+    }
+
     return metric;
 }
 
@@ -289,6 +471,10 @@ void cmt_map_destroy(struct cmt_map *map)
         }
     }
 
+    if (map->index) {
+        free(map->index);
+    }
+
     free(map);
 }
 
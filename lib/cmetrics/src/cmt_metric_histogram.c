@@ -90,6 +90,21 @@ void cmt_metric_hist_inc(struct cmt_metric *metric, uint64_t timestamp,
     while (result == 0);
 }
 
+void cmt_metric_hist_add(struct cmt_metric *metric, uint64_t timestamp,
+                         int bucket_id, uint64_t val)
+{
+    int result;
+    uint64_t old;
+    uint64_t new;
+
+    do {
+        old = cmt_atomic_load(&metric->hist_buckets[bucket_id]);
+        new = old + val;
+        result = metric_hist_exchange(metric, timestamp, bucket_id, new, old);
+    }
+    while (result == 0);
+}
+
 void cmt_metric_hist_count_inc(struct cmt_metric *metric, uint64_t timestamp)
 {
     int result;
@@ -105,6 +120,22 @@ void cmt_metric_hist_count_inc(struct cmt_metric *metric, uint64_t timestamp)
     while (result == 0);
 }
 
+void cmt_metric_hist_count_add(struct cmt_metric *metric, uint64_t timestamp,
+                               uint64_t val)
+{
+    int result;
+    uint64_t old;
+    uint64_t new;
+
+    do {
+        old = cmt_atomic_load(&metric->hist_count);
+        new = old + val;
+
+        result = metric_hist_count_exchange(metric, timestamp, new, old);
+    }
+    while (result == 0);
+}
+
 void cmt_metric_hist_count_set(struct cmt_metric *metric, uint64_t timestamp,
                                uint64_t count)
 {
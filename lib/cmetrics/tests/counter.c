@@ -19,6 +19,7 @@
 
 #include <cmetrics/cmetrics.h>
 #include <cmetrics/cmt_counter.h>
+#include <cmetrics/cmt_map.h>
 #include <cmetrics/cmt_encode_msgpack.h>
 #include <cmetrics/cmt_decode_msgpack.h>
 #include <cmetrics/cmt_encode_prometheus.h>
@@ -254,11 +255,126 @@ void test_labels()
     cmt_destroy(cmt);
 }
 
+void test_high_cardinality()
+{
+    int i;
+    int ret;
+    double val;
+    char id[32];
+    uint64_t ts;
+    struct cmt *cmt;
+    struct cmt_counter *c;
+
+    cmt_initialize();
+
+    cmt = cmt_create();
+    TEST_CHECK(cmt != NULL);
+
+    c = cmt_counter_create(cmt, "kubernetes", "network", "load", "Network load",
+                           2, (char *[]) {"hostname", "app"});
+    TEST_CHECK(c != NULL);
+
+    ts = 0;
+
+    /* every series is written twice, goes through the index growth */
+    for (i = 0; i < 20000; i++) {
+        snprintf(id, sizeof(id) - 1, "host-%i", i);
+        ret = cmt_counter_inc(c, ts, 2, (char *[]) {id, "cmetrics"});
+        TEST_CHECK(ret == 0);
+    }
+    for (i = 0; i < 20000; i++) {
+        snprintf(id, sizeof(id) - 1, "host-%i", i);
+        ret = cmt_counter_add(c, ts, i, 2, (char *[]) {id, "cmetrics"});
+        TEST_CHECK(ret == 0);
+    }
+
+    TEST_CHECK(cfl_list_size(&c->map->metrics) == 20000);
+    TEST_CHECK(c->map->index_count == 20000);
+
+    for (i = 0; i < 20000; i += 997) {
+        snprintf(id, sizeof(id) - 1, "host-%i", i);
+        ret = cmt_counter_get_val(c, 2, (char *[]) {id, "cmetrics"}, &val);
+        TEST_CHECK(ret == 0);
+        TEST_CHECK(val == 1 + i);
+    }
+
+    ret = cmt_counter_get_val(c, 2, (char *[]) {"unknown", "cmetrics"}, &val);
+    TEST_CHECK(ret == -1);
+
+    cmt_destroy(cmt);
+}
+
+void test_cardinality_limit()
+{
+    int i;
+    int ret;
+    double val;
+    char id[32];
+    uint64_t ts;
+    struct cmt *cmt;
+    struct cmt_counter *c;
+    struct cmt_metric *metric;
+
+    cmt_initialize();
+
+    cmt = cmt_create();
+    TEST_CHECK(cmt != NULL);
+
+    c = cmt_counter_create(cmt, "kubernetes", "network", "load", "Network load",
+                           1, (char *[]) {"hostname"});
+    TEST_CHECK(c != NULL);
+
+    cmt_map_set_cardinality_limit(c->map, 100);
+    ts = 0;
+
+    for (i = 0; i < 150; i++) {
+        snprintf(id, sizeof(id) - 1, "host-%i", i);
+        ret = cmt_counter_inc(c, ts, 1, (char *[]) {id});
+        if (i < 100) {
+            TEST_CHECK(ret == 0);
+        }
+        else {
+            TEST_CHECK(ret == -1);
+        }
+    }
+    TEST_CHECK(cfl_list_size(&c->map->metrics) == 100);
+    TEST_CHECK(cmt_map_get_cardinality_overflow(c->map) == 50);
+
+    /* existing series keep being updated */
+    ret = cmt_counter_inc(c, ts, 1, (char *[]) {"host-10"});
+    TEST_CHECK(ret == 0);
+    ret = cmt_counter_get_val(c, 1, (char *[]) {"host-10"}, &val);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(val == 2);
+    TEST_CHECK(cmt_map_get_cardinality_overflow(c->map) == 50);
+
+    /* removing a series makes room for a new one */
+    metric = cfl_list_entry_first(&c->map->metrics, struct cmt_metric, _head);
+    cmt_map_metric_remove(c->map, metric);
+    ret = cmt_counter_get_val(c, 1, (char *[]) {"host-0"}, &val);
+    TEST_CHECK(ret == -1);
+
+    ret = cmt_counter_inc(c, ts, 1, (char *[]) {"host-500"});
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(cfl_list_size(&c->map->metrics) == 100);
+
+    /* every remaining series is still reachable through the index */
+    for (i = 1; i < 100; i++) {
+        snprintf(id, sizeof(id) - 1, "host-%i", i);
+        ret = cmt_counter_get_val(c, 1, (char *[]) {id}, &val);
+        TEST_CHECK(ret == 0);
+    }
+
+    cmt_destroy(cmt);
+}
+
 TEST_LIST = {
     {"basic", test_counter},
     {"labels", test_labels},
     {"msgpack", test_msgpack},
     {"prometheus", test_prometheus},
     {"text", test_text},
+    {"high_cardinality", test_high_cardinality},
+    {"cardinality_limit", test_cardinality_limit},
     { 0 }
 };
@@ -25,6 +25,7 @@
 #include <cmetrics/cmt_counter.h>
 #include <cmetrics/cmt_summary.h>
 #include <cmetrics/cmt_histogram.h>
+#include <cmetrics/cmt_map.h>
 #include <cmetrics/cmt_encode_msgpack.h>
 #include <cmetrics/cmt_decode_msgpack.h>
 #include <cmetrics/cmt_encode_prometheus_remote_write.h>
@@ -578,6 +579,68 @@ void test_prometheus_remote_write_with_outdated_timestamps()
     cmt_destroy(cmt);
 }
 
+static int append_remote_write_series(Prometheus__TimeSeries *series, void *data)
+{
+    size_t     size;
+    size_t     len;
+    uint8_t    header[11];
+    uint8_t   *packed;
+    cfl_sds_t *buf = data;
+
+    /* timeseries = 1, length delimited */
+    header[0] = 0x0a;
+    size = prometheus__time_series__get_packed_size(series);
+    len = 1;
+    do {
+        header[len++] = (size & 0x7f) | (size > 0x7f ? 0x80 : 0);
+        size >>= 7;
+    } while (size > 0);
+    size = prometheus__time_series__get_packed_size(series);
+
+    packed = malloc(size);
+    if (packed == NULL) {
+        return -1;
+    }
+    prometheus__time_series__pack(series, packed);
+
+    cfl_sds_cat_safe(buf, (char *) header, len);
+    cfl_sds_cat_safe(buf, (char *) packed, size);
+    free(packed);
+
+    return 0;
+}
+
+void test_prometheus_remote_write_series()
+{
+    int         ret;
+    struct cmt *cmt;
+    cfl_sds_t   payload;
+    cfl_sds_t   series;
+
+    cmt_initialize();
+
+    cmt = generate_encoder_test_data_with_timestamp(cfl_time_now());
+
+    payload = cmt_encode_prometheus_remote_write_create(cmt);
+    TEST_CHECK(NULL != payload);
+
+    series = cfl_sds_create_size(1024);
+    ret = cmt_encode_prometheus_remote_write_series(cmt,
+                                                    append_remote_write_series,
+                                                    &series);
+    TEST_CHECK(ret == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS);
+
+    /* without metadata the concatenated series are the same write request */
+    TEST_CHECK(cfl_sds_len(series) > 0 &&
+               cfl_sds_len(series) == cfl_sds_len(payload) &&
+               memcmp(series, payload, cfl_sds_len(payload)) == 0);
+
+    cfl_sds_destroy(series);
+    cmt_encode_prometheus_remote_write_destroy(payload);
+
+    cmt_destroy(cmt);
+}
+
 void test_opentelemetry()
 {
     cfl_sds_t payload;
@@ -1163,15 +1226,150 @@ void test_splunk_hec_summary()
     cmt_destroy(cmt);
 }
 
+static void check_delta_state(struct cmt *cmt, struct cmt *base)
+{
+    cfl_sds_t text1;
+    cfl_sds_t text2;
+
+    text1 = cmt_encode_text_create(cmt);
+    text2 = cmt_encode_text_create(base);
+    TEST_CHECK(text1 != NULL && text2 != NULL);
+    TEST_CHECK(strcmp(text1, text2) == 0);
+    TEST_MSG("expected:\n%s\ngot:\n%s", text1, text2);
+
+    cmt_encode_text_destroy(text1);
+    cmt_encode_text_destroy(text2);
+}
+
+/*
+ * CMT -> MSGPACK (full) + N x MSGPACK (delta), applying every delta over the
+ * previous state must give the same result than the source context
+ */
+void test_cmt_to_msgpack_delta()
+{
+    int ret;
+    int delta;
+    size_t offset;
+    char *chunk;
+    size_t chunk_size;
+    char *mp_buf;
+    size_t mp_size;
+    char *full_buf;
+    size_t full_size;
+    struct cmt *cmt;
+    struct cmt *base = NULL;
+    struct cmt *reader = NULL;
+    struct cmt_counter *c;
+    struct cmt_gauge *g;
+    struct cmt_summary *s;
+    struct cmt_histogram *h;
+    struct cmt_metric *metric;
+
+    cmt_initialize();
+
+    cmt = generate_encoder_test_data_with_timestamp(0);
+    c = cfl_list_entry(cmt->counters.next, struct cmt_counter, _head);
+    s = cfl_list_entry(cmt->summaries.next, struct cmt_summary, _head);
+    h = cfl_list_entry(cmt->histograms.next, struct cmt_histogram, _head);
+
+    /* keyframe */
+    ret = cmt_encode_msgpack_delta_create(cmt, NULL, &chunk, &chunk_size);
+    TEST_CHECK(ret == 0);
+
+    offset = 0;
+    ret = cmt_decode_msgpack_delta_apply(&base, chunk, chunk_size, &offset, &delta);
+    TEST_CHECK(ret == CMT_DECODE_MSGPACK_SUCCESS);
+    TEST_CHECK(delta == CMT_FALSE);
+    check_delta_state(cmt, base);
+
+    /* updated, touched and new series, a new family and a removed one */
+    cmt_counter_inc(c, 0, 2, (char *[]) {"localhost", "cmetrics"});
+    cmt_counter_set(c, 5, 1, 2, (char *[]) {"localhost", "test"});
+    cmt_counter_add(c, 0, 3, 2, (char *[]) {"remote", "new"});
+    cmt_histogram_observe(h, 5, 0.5, 1, (char *[]) {"my_val"});
+    g = cmt_gauge_create(cmt, "kubernetes", "network", "queue", "Queue size",
+                         1, (char *[]) {"name"});
+    cmt_gauge_set(g, 7, 42, 1, (char *[]) {"main"});
+    cmt_summary_destroy(s);
+
+    ret = cmt_encode_msgpack_delta_create(cmt, base, &mp_buf, &mp_size);
+    TEST_CHECK(ret == 0);
+
+    ret = cmt_encode_msgpack_create(cmt, &full_buf, &full_size);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(mp_size < full_size);
+    TEST_MSG("delta %zu bytes, full %zu bytes", mp_size, full_size);
+    cmt_encode_msgpack_destroy(full_buf);
+
+    /* delta contexts are rejected by the regular decoder */
+    offset = 0;
+    ret = cmt_decode_msgpack_create(&reader, mp_buf, mp_size, &offset);
+    TEST_CHECK(ret == CMT_DECODE_MSGPACK_DELTA_ERROR);
+
+    offset = 0;
+    ret = cmt_decode_msgpack_delta_apply(&reader, mp_buf, mp_size, &offset, &delta);
+    TEST_CHECK(ret == CMT_DECODE_MSGPACK_DELTA_BASE_ERROR);
+    TEST_CHECK(reader == NULL);
+
+    offset = 0;
+    ret = cmt_decode_msgpack_delta_apply(&base, mp_buf, mp_size, &offset, &delta);
+    TEST_CHECK(ret == CMT_DECODE_MSGPACK_SUCCESS);
+    TEST_CHECK(delta == CMT_TRUE);
+    TEST_CHECK(offset == mp_size);
+    check_delta_state(cmt, base);
+
+    chunk = realloc(chunk, chunk_size + mp_size);
+    memcpy(chunk + chunk_size, mp_buf, mp_size);
+    chunk_size += mp_size;
+    cmt_encode_msgpack_destroy(mp_buf);
+
+    /* removed series and unchanged families */
+    metric = cmt_map_metric_get(&c->opts, c->map, 2,
+                                (char *[]) {"localhost", "cmetrics"}, CMT_FALSE);
+    TEST_CHECK(metric != NULL);
+    cmt_map_metric_remove(c->map, metric);
+
+    ret = cmt_encode_msgpack_delta_create(cmt, base, &mp_buf, &mp_size);
+    TEST_CHECK(ret == 0);
+
+    offset = 0;
+    ret = cmt_decode_msgpack_delta_apply(&base, mp_buf, mp_size, &offset, &delta);
+    TEST_CHECK(ret == CMT_DECODE_MSGPACK_SUCCESS);
+    check_delta_state(cmt, base);
+
+    chunk = realloc(chunk, chunk_size + mp_size);
+    memcpy(chunk + chunk_size, mp_buf, mp_size);
+    chunk_size += mp_size;
+    cmt_encode_msgpack_destroy(mp_buf);
+
+    /* a reader walking the whole chunk ends with the same state */
+    offset = 0;
+    ret = CMT_DECODE_MSGPACK_SUCCESS;
+    while (ret == CMT_DECODE_MSGPACK_SUCCESS) {
+        ret = cmt_decode_msgpack_delta_apply(&reader, chunk, chunk_size,
+                                             &offset, &delta);
+    }
+    TEST_CHECK(ret == CMT_DECODE_MSGPACK_INSUFFICIENT_DATA);
+    TEST_CHECK(offset == chunk_size);
+    check_delta_state(cmt, reader);
+
+    cmt_destroy(reader);
+    cmt_destroy(base);
+    cmt_destroy(cmt);
+    free(chunk);
+}
+
 TEST_LIST = {
     {"cmt_msgpack_cleanup_on_error",   test_cmt_to_msgpack_cleanup_on_error},
     {"cmt_msgpack_partial_processing", test_cmt_msgpack_partial_processing},
     {"prometheus_remote_write",        test_prometheus_remote_write},
     {"prometheus_remote_write_old_cmt",test_prometheus_remote_write_with_outdated_timestamps},
+    {"prometheus_remote_write_series", test_prometheus_remote_write_series},
     {"cmt_msgpack_stability",          test_cmt_to_msgpack_stability},
     {"cmt_msgpack_integrity",          test_cmt_to_msgpack_integrity},
     {"cmt_msgpack_labels",             test_cmt_to_msgpack_labels},
     {"cmt_msgpack",                    test_cmt_to_msgpack},
+    {"cmt_msgpack_delta",              test_cmt_to_msgpack_delta},
     {"opentelemetry",                  test_opentelemetry},
     {"cloudwatch_emf",                 test_cloudwatch_emf},
     {"prometheus",                     test_prometheus},
@@ -205,8 +205,52 @@ void test_set_defaults()
     cmt_destroy(cmt);
 }
 
+void test_add()
+{
+    int i;
+    uint64_t ts;
+    struct cmt *cmt;
+    struct cmt_histogram *h;
+    struct cmt_histogram_buckets *buckets;
+    /* cumulative counts of the last five values, all of them <= 10.0 */
+    uint64_t counts[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 5, 5};
+    double sum = 0;
+
+    cmt_initialize();
+
+    ts = cfl_time_now();
+
+    cmt = cmt_create();
+    TEST_CHECK(cmt != NULL);
+
+    buckets = cmt_histogram_buckets_default_create();
+    TEST_CHECK(buckets != NULL);
+
+    h = cmt_histogram_create(cmt,
+                             "k8s", "network", "load", "Network load",
+                             buckets,
+                             1, (char *[]) {"my_label"});
+    TEST_CHECK(h != NULL);
+
+    /* observe half of the values, add the other half aggregated */
+    for (i = 0; i < 5; i++) {
+        cmt_histogram_observe(h, ts, hist_observe_values[i],
+                              1, (char *[]) {"val"});
+    }
+    for (i = 5; i < 10; i++) {
+        sum += hist_observe_values[i];
+    }
+
+    cmt_histogram_add(h, ts, counts, sum, 5, 1, (char *[]) {"val"});
+    histogram_check(h, 1, (char *[]) {"val"});
+    prometheus_encode_test(cmt);
+
+    cmt_destroy(cmt);
+}
+
 TEST_LIST = {
     {"histogram"   , test_histogram},
     {"set_defaults", test_set_defaults},
+    {"add"         , test_add},
     { 0 }
 };
@@ -33,7 +33,9 @@
 #include <cmetrics/cmt_gauge.h>
 #include <cmetrics/cmt_counter.h>
 #include <cmetrics/cmt_histogram.h>
+#include <cmetrics/cmt_map.h>
 #include <msgpack.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <sys/types.h>
 
@@ -65,6 +67,50 @@ static void delete_rules(struct log_to_metrics_ctx *ctx)
     }
 }
 
+static void series_destroy(struct log_to_metrics_local *local,
+                           struct log_to_metrics_series *series)
+{
+    int i;
+
+    flb_hash_table_del_ptr(local->ht, series->key, flb_sds_len(series->key),
+                           series);
+    mk_list_del(&series->_head);
+
+    if (series->label_values) {
+        for (i = 0; i < series->label_count; i++) {
+            flb_free(series->label_values[i]);
+        }
+        flb_free(series->label_values);
+    }
+    flb_free(series->buckets);
+    flb_sds_destroy(series->key);
+    flb_free(series);
+}
+
+static void delete_locals(struct log_to_metrics_ctx *ctx)
+{
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct mk_list *s_tmp;
+    struct mk_list *s_head;
+    struct log_to_metrics_local *local;
+    struct log_to_metrics_series *series;
+
+    mk_list_foreach_safe(head, tmp, &ctx->locals) {
+        local = mk_list_entry(head, struct log_to_metrics_local, _head);
+
+        mk_list_foreach_safe(s_head, s_tmp, &local->series) {
+            series = mk_list_entry(s_head, struct log_to_metrics_series, _head);
+            series_destroy(local, series);
+        }
+        flb_hash_table_destroy(local->ht);
+        flb_sds_destroy(local->key);
+        pthread_mutex_destroy(&local->lock);
+        mk_list_del(&local->_head);
+        flb_free(local);
+    }
+}
+
 static int log_to_metrics_destroy(struct log_to_metrics_ctx *ctx)
 {
     int i;
@@ -73,12 +119,32 @@ static int log_to_metrics_destroy(struct log_to_metrics_ctx *ctx)
         return 0;
     }
 
+    delete_locals(ctx);
+    if (ctx->local_key_created) {
+        pthread_key_delete(ctx->local_key);
+    }
+    pthread_mutex_destroy(&ctx->merge_lock);
+
     if (ctx->cmt) {
         cmt_destroy(ctx->cmt);
     }
 
     delete_rules(ctx);
 
+    for (i = 0; i < MAX_LABEL_COUNT; i++) {
+        if (ctx->label_ra[i]) {
+            flb_ra_destroy(ctx->label_ra[i]);
+        }
+    }
+    for (i = 0; i < NUMBER_OF_KUBERNETES_LABELS; i++) {
+        if (ctx->kubernetes_ra[i]) {
+            flb_ra_destroy(ctx->kubernetes_ra[i]);
+        }
+    }
+    if (ctx->value_ra) {
+        flb_ra_destroy(ctx->value_ra);
+    }
+
     if (ctx->label_accessors != NULL) {
         for (i = 0; i < MAX_LABEL_COUNT; i++) {
             flb_free(ctx->label_accessors[i]);
@@ -92,6 +158,7 @@ static int log_to_metrics_destroy(struct log_to_metrics_ctx *ctx)
         flb_free(ctx->label_keys);
     }
 
+    flb_free(ctx->cumulative_buckets);
     flb_free(ctx->buckets);
     flb_free(ctx);
     return 0;
@@ -385,69 +452,436 @@ static int set_buckets(struct log_to_metrics_ctx *ctx,
     return 0;
 }
 
-static int fill_labels(struct log_to_metrics_ctx *ctx, char **label_values,
-                       char kubernetes_label_values
-                       [NUMBER_OF_KUBERNETES_LABELS][MAX_LABEL_LENGTH],
-                       char **label_accessors, int label_counter, msgpack_object map)
+/* Thread accumulator of the caller, created on first use */
+static struct log_to_metrics_local *local_get(struct log_to_metrics_ctx *ctx)
 {
-    int label_iterator_start = 0;
-    int i;
-    struct flb_record_accessor *ra = NULL;
-    struct flb_ra_value *rval = NULL;
+    struct log_to_metrics_local *local;
 
-    if (label_counter == 0 && !ctx->kubernetes_mode){
-        return 0;
+    local = pthread_getspecific(ctx->local_key);
+    if (local) {
+        return local;
     }
-    if (MAX_LABEL_COUNT < NUMBER_OF_KUBERNETES_LABELS){
+
+    local = flb_calloc(1, sizeof(struct log_to_metrics_local));
+    if (!local) {
         flb_errno();
+        return NULL;
+    }
+    mk_list_init(&local->series);
+
+    local->ht = flb_hash_table_create(FLB_HASH_TABLE_EVICT_NONE,
+                                      LOG_TO_METRICS_HASH_TABLE_SIZE, 0);
+    if (!local->ht) {
+        flb_free(local);
+        return NULL;
+    }
+
+    local->key = flb_sds_create_size(MAX_LABEL_LENGTH);
+    if (!local->key) {
+        flb_hash_table_destroy(local->ht);
+        flb_free(local);
+        return NULL;
+    }
+    pthread_mutex_init(&local->lock, NULL);
+
+    pthread_mutex_lock(&ctx->merge_lock);
+    mk_list_add(&local->_head, &ctx->locals);
+    pthread_mutex_unlock(&ctx->merge_lock);
+
+    pthread_setspecific(ctx->local_key, local);
+
+    return local;
+}
+
+static int key_append(struct log_to_metrics_local *local, int index,
+                      const char *val, int len)
+{
+    int n;
+    char num[16];
+    flb_sds_t tmp;
+
+    n = snprintf(num, sizeof(num), "%i:", len);
+    tmp = flb_sds_cat(local->key, num, n);
+    if (!tmp) {
         return -1;
     }
+    local->key = tmp;
+    local->label_offsets[index] = flb_sds_len(local->key);
+    local->label_lengths[index] = len;
 
-    if (ctx->kubernetes_mode){
-        for (i = 0; i < NUMBER_OF_KUBERNETES_LABELS; i++){
-            snprintf(label_values[i], MAX_LABEL_LENGTH - 1, "%s", kubernetes_label_values[i]);
+    tmp = flb_sds_cat(local->key, val, len);
+    if (!tmp) {
+        return -1;
+    }
+    local->key = tmp;
+
+    return 0;
+}
+
+/* Render a label value the same way as a string written by the accessor */
+static int key_append_label(struct log_to_metrics_ctx *ctx,
+                            struct log_to_metrics_local *local, int index,
+                            msgpack_object *val)
+{
+    int len;
+    const char *p;
+    char buf[MAX_LABEL_LENGTH];
+
+    if (!val) {
+        /* Set value to empty string, so the value will be dropped in Cmetrics */
+        return key_append(local, index, "", 0);
+    }
+
+    switch (val->type) {
+    case MSGPACK_OBJECT_STR:
+    case MSGPACK_OBJECT_BIN:
+        len = val->via.str.size;
+        if (len > MAX_LABEL_LENGTH - 2) {
+            len = MAX_LABEL_LENGTH - 2;
         }
-        label_iterator_start = NUMBER_OF_KUBERNETES_LABELS;
+        p = memchr(val->via.str.ptr, '\0', len);
+        if (p) {
+            len = p - val->via.str.ptr;
+        }
+        return key_append(local, index, val->via.str.ptr, len);
+    case MSGPACK_OBJECT_FLOAT32:
+    case MSGPACK_OBJECT_FLOAT64:
+        len = snprintf(buf, MAX_LABEL_LENGTH - 1, "%f", val->via.f64);
+        break;
+    case MSGPACK_OBJECT_POSITIVE_INTEGER:
+    case MSGPACK_OBJECT_NEGATIVE_INTEGER:
+        len = snprintf(buf, MAX_LABEL_LENGTH - 1, "%" PRId64,
+                       (int64_t) val->via.i64);
+        break;
+    default:
+        flb_plg_warn(ctx->ins, "cannot convert given value to metric");
+        return key_append(local, index, "", 0);
     }
 
-    for (i = label_iterator_start; i < label_counter; i++){
-        ra = flb_ra_create(label_accessors[i], FLB_TRUE);
-        if (!ra) {
-            flb_warn("invalid record accessor key, aborting");
-            break;
+    if (len > MAX_LABEL_LENGTH - 2) {
+        len = MAX_LABEL_LENGTH - 2;
+    }
+    return key_append(local, index, buf, len);
+}
+
+/*
+ * Records without the kubernetes metadata are usually not rare, report the
+ * first one and keep the others for debugging.
+ */
+#define kubernetes_label_warn(ctx, fmt, ...)                        \
+    do {                                                            \
+        if (!(ctx)->kubernetes_warned) {                            \
+            flb_plg_warn((ctx)->ins, fmt, __VA_ARGS__);             \
+            (ctx)->kubernetes_warned = FLB_TRUE;                    \
+        }                                                           \
+        else {                                                      \
+            flb_plg_debug((ctx)->ins, fmt, __VA_ARGS__);            \
+        }                                                           \
+    } while (0)
+
+/*
+ * Compose the series key of the record in local->key. Returns the number of
+ * labels of the series or -1 on error.
+ */
+static int series_key_build(struct log_to_metrics_ctx *ctx,
+                            struct log_to_metrics_local *local,
+                            msgpack_object map)
+{
+    int i;
+    int ret;
+    int start = 0;
+    int label_count;
+    msgpack_object *start_key;
+    msgpack_object *out_key;
+    msgpack_object *vals[MAX_LABEL_COUNT];
+
+    label_count = ctx->label_counter;
+
+    if (ctx->kubernetes_mode) {
+        for (i = 0; i < NUMBER_OF_KUBERNETES_LABELS; i++) {
+            vals[i] = NULL;
+            ret = flb_ra_get_kv_pair(ctx->kubernetes_ra[i], map,
+                                     &start_key, &out_key, &vals[i]);
+            if (ret != 0 || !vals[i]) {
+                kubernetes_label_warn(ctx, "given value field is empty or not "
+                                      "existent: $kubernetes['%s']. Skipping "
+                                      "labels.", kubernetes_label_keys[i]);
+                label_count = 0;
+                break;
+            }
+            else if (vals[i]->type != MSGPACK_OBJECT_STR) {
+                kubernetes_label_warn(ctx, "cannot access label %s",
+                                      kubernetes_label_keys[i]);
+                label_count = 0;
+                break;
+            }
         }
+        start = NUMBER_OF_KUBERNETES_LABELS;
+    }
 
-        rval = flb_ra_get_value_object(ra, map);
-        if (!rval) {
-        /* Set value to empty string, so the value will be dropped in Cmetrics*/
-        label_values[i][0] = '\0';
+    for (i = start; i < label_count; i++) {
+        vals[i] = NULL;
+        ret = flb_ra_get_kv_pair(ctx->label_ra[i], map,
+                                 &start_key, &out_key, &vals[i]);
+        if (ret != 0) {
+            vals[i] = NULL;
         }
-        else if (rval->type == FLB_RA_STRING) {
-            snprintf(label_values[i], MAX_LABEL_LENGTH - 1, "%s",
-            rval->val.string);
+    }
+
+    flb_sds_len_set(local->key, 0);
+    local->key = flb_sds_printf(&local->key, "%i|", label_count);
+    if (!local->key) {
+        return -1;
+    }
+
+    for (i = 0; i < label_count; i++) {
+        ret = key_append_label(ctx, local, i, vals[i]);
+        if (ret == -1) {
+            return -1;
         }
-        else if (rval->type == FLB_RA_FLOAT) {
-            snprintf(label_values[i], MAX_LABEL_LENGTH - 1, "%f",
-            rval->val.f64);
+    }
+
+    return label_count;
+}
+
+static struct log_to_metrics_series *series_get(struct log_to_metrics_ctx *ctx,
+                                                struct log_to_metrics_local *local,
+                                                int label_count)
+{
+    int i;
+    int ret;
+    struct log_to_metrics_series *series;
+
+    series = flb_hash_table_get_ptr(local->ht, local->key,
+                                    flb_sds_len(local->key));
+    if (series) {
+        return series;
+    }
+
+    series = flb_calloc(1, sizeof(struct log_to_metrics_series));
+    if (!series) {
+        flb_errno();
+        return NULL;
+    }
+    mk_list_add(&series->_head, &local->series);
+
+    series->key = flb_sds_create_len(local->key, flb_sds_len(local->key));
+    if (!series->key) {
+        mk_list_del(&series->_head);
+        flb_free(series);
+        return NULL;
+    }
+
+    if (label_count > 0) {
+        series->label_values = flb_calloc(label_count, sizeof(char *));
+        if (!series->label_values) {
+            flb_errno();
+            series_destroy(local, series);
+            return NULL;
         }
-        else if (rval->type == FLB_RA_INT) {
-            snprintf(label_values[i], MAX_LABEL_LENGTH - 1, "%ld",
-            (long)rval->val.i64);
+        series->label_count = label_count;
+
+        for (i = 0; i < label_count; i++) {
+            series->label_values[i] = flb_strndup(series->key +
+                                                  local->label_offsets[i],
+                                                  local->label_lengths[i]);
+            if (!series->label_values[i]) {
+                series_destroy(local, series);
+                return NULL;
+            }
         }
-        else {
-            flb_warn("cannot convert given value to metric");
-            break;
+    }
+
+    if (ctx->mode == FLB_LOG_TO_METRICS_HISTOGRAM) {
+        series->buckets = flb_calloc(ctx->h->buckets->count + 1,
+                                     sizeof(uint64_t));
+        if (!series->buckets) {
+            flb_errno();
+            series_destroy(local, series);
+            return NULL;
+        }
+    }
+
+    ret = flb_hash_table_add(local->ht, series->key, flb_sds_len(series->key),
+                             series, 0);
+    if (ret == -1) {
+        series_destroy(local, series);
+        return NULL;
+    }
+
+    return series;
+}
+
+/* Numeric value of 'value_field' for gauges and histograms */
+static int value_get(struct log_to_metrics_ctx *ctx, msgpack_object map,
+                     double *value)
+{
+    int ret;
+    size_t len;
+    char buf[64];
+    msgpack_object *start_key;
+    msgpack_object *out_key;
+    msgpack_object *out_val = NULL;
+
+    ret = flb_ra_get_kv_pair(ctx->value_ra, map, &start_key, &out_key, &out_val);
+    if (ret != 0 || !out_val) {
+        flb_plg_warn(ctx->ins, "given value field is empty or not existent");
+        return -1;
+    }
+
+    switch (out_val->type) {
+    case MSGPACK_OBJECT_STR:
+    case MSGPACK_OBJECT_BIN:
+        len = out_val->via.str.size;
+        if (len > sizeof(buf) - 1) {
+            len = sizeof(buf) - 1;
         }
-        if (rval){
-            flb_ra_key_value_destroy(rval);
-            rval = NULL;
+        memcpy(buf, out_val->via.str.ptr, len);
+        buf[len] = '\0';
+        *value = 0;
+        sscanf(buf, "%lf", value);
+        break;
+    case MSGPACK_OBJECT_FLOAT32:
+    case MSGPACK_OBJECT_FLOAT64:
+        *value = out_val->via.f64;
+        break;
+    case MSGPACK_OBJECT_POSITIVE_INTEGER:
+    case MSGPACK_OBJECT_NEGATIVE_INTEGER:
+        *value = (double) out_val->via.i64;
+        break;
+    default:
+        flb_plg_error(ctx->ins, "cannot convert given value to metric");
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Index of the first bucket holding 'val', the +Inf bucket if none */
+static inline int bucket_search(struct cmt_histogram_buckets *buckets,
+                                double val)
+{
+    int mid;
+    int low = 0;
+    int high = buckets->count;
+
+    while (low < high) {
+        mid = (low + high) / 2;
+        if (val <= buckets->upper_bounds[mid]) {
+            high = mid;
         }
-        if (ra){
-            flb_ra_destroy(ra);
-            ra = NULL;
+        else {
+            low = mid + 1;
         }
     }
-    return label_counter;
+
+    return low;
+}
+
+/* Series map of the metric generated by the filter */
+static struct cmt_map *metric_map(struct log_to_metrics_ctx *ctx)
+{
+    switch (ctx->mode) {
+        case FLB_LOG_TO_METRICS_COUNTER:
+            return ctx->c->map;
+        case FLB_LOG_TO_METRICS_GAUGE:
+            return ctx->g->map;
+        default:
+            return ctx->h->map;
+    }
+}
+
+/*
+ * Move what every thread accumulated since the last call into cmetrics, series
+ * without updates in that period are released. Returns the number of series
+ * updated. The caller holds merge_lock.
+ */
+static int log_to_metrics_merge(struct log_to_metrics_ctx *ctx)
+{
+    int i;
+    int ret = 0;
+    int merged = 0;
+    uint64_t ts;
+    uint64_t total;
+    struct mk_list *head;
+    struct mk_list *s_tmp;
+    struct mk_list *s_head;
+    struct log_to_metrics_local *local;
+    struct log_to_metrics_series *series;
+
+    ts = cfl_time_now();
+
+    mk_list_foreach(head, &ctx->locals) {
+        local = mk_list_entry(head, struct log_to_metrics_local, _head);
+
+        pthread_mutex_lock(&local->lock);
+        mk_list_foreach_safe(s_head, s_tmp, &local->series) {
+            series = mk_list_entry(s_head, struct log_to_metrics_series, _head);
+            if (series->updates == 0) {
+                series_destroy(local, series);
+                continue;
+            }
+
+            switch (ctx->mode) {
+                case FLB_LOG_TO_METRICS_COUNTER:
+                    ret = cmt_counter_add(ctx->c, ts, (double) series->updates,
+                                          series->label_count,
+                                          series->label_values);
+                    break;
+                case FLB_LOG_TO_METRICS_GAUGE:
+                    ret = cmt_gauge_set(ctx->g, ts, series->value,
+                                        series->label_count,
+                                        series->label_values);
+                    break;
+                case FLB_LOG_TO_METRICS_HISTOGRAM:
+                    total = 0;
+                    for (i = 0; i <= ctx->h->buckets->count; i++) {
+                        total += series->buckets[i];
+                        ctx->cumulative_buckets[i] = total;
+                        series->buckets[i] = 0;
+                    }
+                    ret = cmt_histogram_add(ctx->h, ts, ctx->cumulative_buckets,
+                                            series->sum, series->updates,
+                                            series->label_count,
+                                            series->label_values);
+                    series->sum = 0;
+                    break;
+            }
+
+            if (ret == -1 && !ctx->cardinality_warned &&
+                cmt_map_get_cardinality_overflow(metric_map(ctx)) > 0) {
+                flb_plg_warn(ctx->ins, "cardinality limit of %i series reached, "
+                             "new label values are dropped",
+                             ctx->cardinality_limit);
+                ctx->cardinality_warned = FLB_TRUE;
+            }
+
+            series->updates = 0;
+            merged++;
+        }
+        pthread_mutex_unlock(&local->lock);
+    }
+
+    return merged;
+}
+
+/*
+ * Merge the updates and append the metrics, the context is encoded before
+ * the lock is released so a concurrent merge cannot modify it meanwhile.
+ * Returns -1 if the metrics could not be appended.
+ */
+static int log_to_metrics_emit(struct log_to_metrics_ctx *ctx)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&ctx->merge_lock);
+    if (log_to_metrics_merge(ctx) > 0) {
+        ret = flb_input_metrics_append(ctx->input_ins, ctx->tag,
+                                       strlen(ctx->tag), ctx->cmt);
+    }
+    pthread_mutex_unlock(&ctx->merge_lock);
+
+    return ret == 0 ? 0 : -1;
 }
 
 /* Timer callback to inject metrics into the pipeline */
@@ -461,12 +895,9 @@ static void cb_send_metric_chunk(struct flb_config *config, void *data)
         return;
     }
     
-    if (ctx->new_data) {
-        ret = flb_input_metrics_append(ctx->input_ins, ctx->tag,
-            strlen(ctx->tag), ctx->cmt);
-        if (ret != 0) {
-            flb_plg_error(ctx->ins, "could not append metrics");
-        }
+    ret = log_to_metrics_emit(ctx);
+    if (ret != 0) {
+        flb_plg_error(ctx->ins, "could not append metrics");
     }
 
     /* Check if we are shutting down. If so, stop our timer */
@@ -476,7 +907,6 @@ static void cb_send_metric_chunk(struct flb_config *config, void *data)
             flb_sched_timer_cb_disable(ctx->timer);
         }
     }
-    ctx->new_data = FLB_FALSE;
 }
 
 static int cb_log_to_metrics_init(struct flb_filter_instance *f_ins,
@@ -490,6 +920,7 @@ static int cb_log_to_metrics_init(struct flb_filter_instance *f_ins,
     char metric_namespace[MAX_METRIC_LENGTH];
     char metric_subsystem[MAX_METRIC_LENGTH];
     char value_field[MAX_METRIC_LENGTH];
+    char fmt[MAX_LABEL_LENGTH];
     struct flb_input_instance *input_ins;
     struct flb_sched *sched;
 
@@ -510,6 +941,16 @@ static int cb_log_to_metrics_init(struct flb_filter_instance *f_ins,
         return -1;
     }
     mk_list_init(&ctx->rules);
+    mk_list_init(&ctx->locals);
+    pthread_mutex_init(&ctx->merge_lock, NULL);
+
+    ret = pthread_key_create(&ctx->local_key, NULL);
+    if (ret != 0) {
+        flb_plg_error(f_ins, "could not create thread local key");
+        log_to_metrics_destroy(ctx);
+        return -1;
+    }
+    ctx->local_key_created = FLB_TRUE;
 
     if (ctx->metric_name == NULL) {
         flb_plg_error(f_ins, "metric_name is not set");
@@ -520,7 +961,7 @@ static int cb_log_to_metrics_init(struct flb_filter_instance *f_ins,
     /* Load rules */
     ret = set_rules(ctx, f_ins);
     if (ret == -1) {
-        flb_free(ctx);
+        log_to_metrics_destroy(ctx);
         return -1;
     }
 
@@ -573,6 +1014,34 @@ static int cb_log_to_metrics_init(struct flb_filter_instance *f_ins,
     }
     ctx->label_counter = ret;
 
+    /* Record accessors of the labels */
+    if (ctx->kubernetes_mode) {
+        for (i = 0; i < NUMBER_OF_KUBERNETES_LABELS; i++) {
+            snprintf(fmt, sizeof(fmt) - 1, "$kubernetes['%s']",
+                     kubernetes_label_keys[i]);
+            ctx->kubernetes_ra[i] = flb_ra_create(fmt, FLB_TRUE);
+            if (!ctx->kubernetes_ra[i]) {
+                flb_plg_error(f_ins, "invalid record accessor key '%s'", fmt);
+                log_to_metrics_destroy(ctx);
+                return -1;
+            }
+        }
+        i = NUMBER_OF_KUBERNETES_LABELS;
+    }
+    else {
+        i = 0;
+    }
+
+    for (; i < ctx->label_counter; i++) {
+        ctx->label_ra[i] = flb_ra_create(ctx->label_accessors[i], FLB_TRUE);
+        if (!ctx->label_ra[i]) {
+            flb_plg_error(f_ins, "invalid record accessor key '%s'",
+                          ctx->label_accessors[i]);
+            log_to_metrics_destroy(ctx);
+            return -1;
+        }
+    }
+
     /* Check metric tag */
     if (ctx->tag == NULL || strlen(ctx->tag) == 0) {
         flb_plg_error(f_ins, "Metric tag is not set");
@@ -648,6 +1117,14 @@ static int cb_log_to_metrics_init(struct flb_filter_instance *f_ins,
         }
         snprintf(value_field, sizeof(value_field) - 1, "%s",
                     ctx->value_field);
+
+        ctx->value_ra = flb_ra_create(value_field, FLB_TRUE);
+        if (!ctx->value_ra) {
+            flb_plg_error(f_ins, "invalid record accessor key '%s'",
+                          value_field);
+            log_to_metrics_destroy(ctx);
+            return -1;
+        }
     }
 
 
@@ -687,6 +1164,21 @@ static int cb_log_to_metrics_init(struct flb_filter_instance *f_ins,
                                           metric_name, metric_description,
                                           ctx->histogram_buckets,
                                           ctx->label_counter, ctx->label_keys);
+
+            if (!ctx->h) {
+                flb_plg_error(f_ins, "could not create histogram");
+                log_to_metrics_destroy(ctx);
+                return -1;
+            }
+
+            /* scratch space to merge the series buckets */
+            ctx->cumulative_buckets = flb_calloc(ctx->h->buckets->count + 1,
+                                                 sizeof(uint64_t));
+            if (!ctx->cumulative_buckets) {
+                flb_errno();
+                log_to_metrics_destroy(ctx);
+                return -1;
+            }
             break;
         default:
             flb_plg_error(f_ins, "unsupported mode");
@@ -694,6 +1186,10 @@ static int cb_log_to_metrics_init(struct flb_filter_instance *f_ins,
             return -1;
     }
 
+    if (ctx->cardinality_limit > 0) {
+        cmt_map_set_cardinality_limit(metric_map(ctx), ctx->cardinality_limit);
+    }
+
     tmp = (char *) flb_filter_get_property("emitter_name", f_ins);
     /* If emitter_name is not set, use the default name */
     if (tmp == NULL) {
@@ -811,28 +1307,28 @@ static int cb_log_to_metrics_filter(const void *data, size_t bytes,
 {
     int ret;
     int filter_ret = FLB_FILTER_NOTOUCH;
+    int records = 0;
+    int label_count;
     msgpack_unpacked result;
     msgpack_object map;
     msgpack_object root;
     size_t off = 0;
-    msgpack_sbuffer tmp_sbuf;
-    msgpack_packer tmp_pck;
-    uint64_t ts;
+    double value = 0;
     struct log_to_metrics_ctx *ctx = context;
-    struct flb_ra_value *rval = NULL;
-    struct flb_record_accessor *ra = NULL;
-    char fmt[MAX_LABEL_LENGTH];
-    char **label_values = NULL;
-    int label_count = 0;
-    int i;
-    double gauge_value = 0;
-    double histogram_value = 0;
-    char kubernetes_label_values
-        [NUMBER_OF_KUBERNETES_LABELS][MAX_LABEL_LENGTH];
+    struct log_to_metrics_local *local;
+    struct log_to_metrics_series *series;
 
-    /* Create temporary msgpack buffer */
-    msgpack_sbuffer_init(&tmp_sbuf);
-    msgpack_packer_init(&tmp_pck, &tmp_sbuf, msgpack_sbuffer_write);
+    local = local_get(ctx);
+    if (!local) {
+        flb_plg_error(ctx->ins, "could not allocate metrics accumulator");
+        return FLB_FILTER_NOTOUCH;
+    }
+
+    /*
+     * Records are accounted in the accumulator of this thread, the lock is
+     * only contended while the metrics are merged into cmetrics.
+     */
+    pthread_mutex_lock(&local->lock);
 
     /* Iterate each item array and apply rules and generate metric values */
     msgpack_unpacked_init(&result);
@@ -847,178 +1343,54 @@ static int cb_log_to_metrics_filter(const void *data, size_t bytes,
         map = root.via.array.ptr[1];
 
         ret = grep_filter_data(map, context);
-        if (ret == GREP_RET_KEEP) {
-            ts = cfl_time_now();
-            if(ctx->kubernetes_mode) {
-                for (i = 0; i < NUMBER_OF_KUBERNETES_LABELS; i++) {
-                    snprintf(fmt, MAX_LABEL_LENGTH - 1, "$kubernetes['%s']",
-                                kubernetes_label_keys[i]);
-                    ra = flb_ra_create(fmt, FLB_TRUE);
-                    if (!ra) {
-                        flb_plg_error(ctx->ins, "invalid record accessor key, aborting");
-                        break;
-                    }
-                    rval = flb_ra_get_value_object(ra, map);
-                    if (!rval) {
-                        flb_plg_error(ctx->ins, "given value field is empty or not "
-                                      "existent: %s. Skipping labels.", fmt);
-                                      ctx->label_counter = 0;
-                    }
-                    else if (rval->type != FLB_RA_STRING) {
-                        flb_plg_error(ctx->ins, "cannot access label %s", kubernetes_label_keys[i]);
-                        break;
-                    }
-                    else {
-                        snprintf(kubernetes_label_values[i],
-                                MAX_LABEL_LENGTH - 1, "%s", rval->val.string);
-                    }
-                    if (rval){
-                        flb_ra_key_value_destroy(rval);
-                        rval = NULL;
-                    }
-                    if (ra){
-                        flb_ra_destroy(ra);
-                        ra = NULL;
-                    }
-                }
-            }
-            if (ctx->label_counter > 0){
-                /* Fill optional labels */
-                label_values = flb_malloc(MAX_LABEL_COUNT * sizeof(char *));
-                for (i = 0; i < MAX_LABEL_COUNT; i++) {
-                    label_values[i] = flb_malloc(MAX_LABEL_LENGTH *
-                                                    sizeof(char));
-                }
-
-                label_count = fill_labels(ctx, label_values,
-                                    kubernetes_label_values, ctx->label_accessors,
-                                    ctx->label_counter, map);
-                if (label_count != ctx->label_counter){
-                    label_count = 0;
-                }
-            }
-
-            /* Calculating and setting metric depending on the mode */
-            switch (ctx->mode) {
-                case FLB_LOG_TO_METRICS_COUNTER:
-                    ret = cmt_counter_inc(ctx->c, ts, label_count,
-                                    label_values);
-                    break;
-
-                case FLB_LOG_TO_METRICS_GAUGE:
-                    ra = flb_ra_create(ctx->value_field, FLB_TRUE);
-                    if (!ra) {
-                        flb_plg_error(ctx->ins, "invalid record accessor key, aborting");
-                        break;
-                    }
-
-                    rval = flb_ra_get_value_object(ra, map);
-
-                    if (!rval) {
-                        flb_warn("given value field is empty or not existent");
-                        break;
-                    }
-                    if (rval->type == FLB_RA_STRING) {
-                        sscanf(rval->val.string, "%lf", &gauge_value);
-                    }
-                    else if (rval->type == FLB_RA_FLOAT) {
-                        gauge_value = rval->val.f64;
-                    }
-                    else if (rval->type == FLB_RA_INT) {
-                        gauge_value = (double)rval->val.i64;
-                    }
-                    else {
-                        flb_plg_error(f_ins,
-                                    "cannot convert given value to metric");
-                        break;
-                    }
-
-                    ret = cmt_gauge_set(ctx->g, ts, gauge_value,
-                                    label_count, label_values);
-                    if (rval) {
-                        flb_ra_key_value_destroy(rval);
-                        rval = NULL;
-                    }
-                    if (ra) {
-                        flb_ra_destroy(ra);
-                        ra = NULL;
-                    }
-                    break;
-
-                case FLB_LOG_TO_METRICS_HISTOGRAM:
-                    ra = flb_ra_create(ctx->value_field, FLB_TRUE);
-                    if (!ra) {
-                        flb_error("invalid record accessor key, aborting");
-                        break;
-                    }
-
-                    rval = flb_ra_get_value_object(ra, map);
-
-                    if (!rval) {
-                        flb_warn("given value field is empty or not existent");
-                        break;
-                    }
-                    if (rval->type == FLB_RA_STRING) {
-                        sscanf(rval->val.string, "%lf", &histogram_value);
-                    }
-                    else if (rval->type == FLB_RA_FLOAT) {
-                        histogram_value = rval->val.f64;
-                    }
-                    else if (rval->type == FLB_RA_INT) {
-                        histogram_value = (double)rval->val.i64;
-                    }
-                    else {
-                        flb_plg_error(f_ins,
-                                    "cannot convert given value to metric");
-                        break;
-                    }
-
-                    ret = cmt_histogram_observe(ctx->h, ts, histogram_value,
-                                    label_count, label_values);
-                    if (rval) {
-                        flb_ra_key_value_destroy(rval);
-                        rval = NULL;
-                    }
-                    if (ra) {
-                        flb_ra_destroy(ra);
-                        ra = NULL;
-                    }
-                    break;
-                default:
-                    flb_plg_error(f_ins, "unsupported mode");
-                    log_to_metrics_destroy(ctx);
-                    return -1;
-            }
+        if (ret == GREP_RET_EXCLUDE) {
+            continue;
+        }
 
-            if (!ctx->timer_mode) {
-                ret = flb_input_metrics_append(ctx->input_ins, ctx->tag,
-                                            strlen(ctx->tag), ctx->cmt);
+        label_count = series_key_build(ctx, local, map);
+        if (label_count == -1) {
+            flb_plg_error(ctx->ins, "could not compose metric labels");
+            continue;
+        }
 
-	            if (ret != 0) {
-                    flb_plg_error(ctx->ins, "could not append metrics. "
-                        "Please consider to use flush_interval_sec and flush_interval_nsec");
-                }
-            }
-            else {
-                ctx->new_data = FLB_TRUE;
+        if (ctx->mode != FLB_LOG_TO_METRICS_COUNTER) {
+            ret = value_get(ctx, map, &value);
+            if (ret == -1) {
+                continue;
             }
+        }
 
-            /* Cleanup */
-            msgpack_unpacked_destroy(&result);
-            if (label_values != NULL){
-                for (i = 0; i < MAX_LABEL_COUNT; i++) {
-                    if (label_values[i] != NULL){
-                        flb_free(label_values[i]);
-                    }
-                }
-                flb_free(label_values);
-            }
+        series = series_get(ctx, local, label_count);
+        if (!series) {
+            flb_plg_error(ctx->ins, "could not allocate metric series");
+            continue;
         }
-        else if (ret == GREP_RET_EXCLUDE) {
-            /* Do nothing */
+
+        /* Calculating and setting metric depending on the mode */
+        switch (ctx->mode) {
+            case FLB_LOG_TO_METRICS_GAUGE:
+                series->value = value;
+                break;
+            case FLB_LOG_TO_METRICS_HISTOGRAM:
+                series->buckets[bucket_search(ctx->h->buckets, value)]++;
+                series->sum += value;
+                break;
         }
+        series->updates++;
+        records++;
     }
 
+    pthread_mutex_unlock(&local->lock);
+
+    /* Without timer the metrics are emitted once per chunk */
+    if (records > 0 && !ctx->timer_mode) {
+        ret = log_to_metrics_emit(ctx);
+        if (ret != 0) {
+            flb_plg_error(ctx->ins, "could not append metrics. "
+                          "Please consider to use flush_interval_sec and "
+                          "flush_interval_nsec");
+        }
+    }
 
     if (ctx->discard_logs) {
         *out_buf = NULL;
@@ -1028,7 +1400,6 @@ static int cb_log_to_metrics_filter(const void *data, size_t bytes,
 
     /* Cleanup */
     msgpack_unpacked_destroy(&result);
-    msgpack_sbuffer_destroy(&tmp_sbuf);
 
     /* this can be FLB_FILTER_NOTOUCH or FLB_FILTER_MODIFIED */
     return filter_ret;
@@ -1137,6 +1508,12 @@ static struct flb_config_map config_map[] = {
       "If flush_interval_sec and flush_interval_nsec are set to 0, the timer is disabled "
       "(default). Final precision is milliseconds."
     },
+    {
+     FLB_CONFIG_MAP_INT, "cardinality_limit", "0",
+     0, FLB_TRUE, offsetof(struct log_to_metrics_ctx, cardinality_limit),
+     "Maximum number of label combinations (series) of the metric, records "
+     "that would create new series are not accounted. Zero means unlimited."
+    },
     {
      FLB_CONFIG_MAP_BOOL, "discard_logs", "false",
      0, FLB_TRUE, offsetof(struct log_to_metrics_ctx, discard_logs),
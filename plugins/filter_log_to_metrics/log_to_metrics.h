@@ -23,6 +23,8 @@
 #include <fluent-bit/flb_info.h>
 #include <fluent-bit/flb_filter_plugin.h>
 #include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_pthread.h>
+#include <fluent-bit/flb_hash_table.h>
 #include <fluent-bit/flb_record_accessor.h>
 
 /* rule types */
@@ -53,6 +55,40 @@
 #define DEFAULT_INTERVAL_SEC  "0"
 #define DEFAULT_INTERVAL_NSEC "0"
 
+/* buckets of the per thread table of series */
+#define LOG_TO_METRICS_HASH_TABLE_SIZE 1024
+
+/*
+ * Series updated by one thread since the last merge into cmetrics. The key
+ * is the list of label values, each one prefixed by its length.
+ */
+struct log_to_metrics_series {
+    flb_sds_t key;
+    int label_count;
+    char **label_values;
+
+    uint64_t updates;   /* counter increments or histogram observations */
+    double value;       /* last gauge value */
+    double sum;         /* sum of histogram observations */
+    uint64_t *buckets;  /* histogram observations per bucket (not cumulative) */
+
+    struct mk_list _head;
+};
+
+/* Per thread accumulator, merged into cmetrics when metrics are emitted */
+struct log_to_metrics_local {
+    pthread_mutex_t lock;
+    struct flb_hash_table *ht;
+    struct mk_list series;
+
+    /* key of the record being processed and the position of its labels */
+    flb_sds_t key;
+    int label_offsets[MAX_LABEL_COUNT];
+    int label_lengths[MAX_LABEL_COUNT];
+
+    struct mk_list _head;
+};
+
 struct log_to_metrics_ctx {
     struct mk_list rules;
     struct flb_filter_instance *ins;
@@ -66,6 +102,18 @@ struct log_to_metrics_ctx {
     int bucket_counter;
     double *buckets;
 
+    /* record accessors, created once */
+    struct flb_record_accessor *label_ra[MAX_LABEL_COUNT];
+    struct flb_record_accessor *kubernetes_ra[NUMBER_OF_KUBERNETES_LABELS];
+    struct flb_record_accessor *value_ra;
+
+    /* per thread accumulators */
+    pthread_key_t local_key;
+    int local_key_created;
+    pthread_mutex_t merge_lock;
+    struct mk_list locals;
+    uint64_t *cumulative_buckets;
+
     struct cmt_counter *c;
     struct cmt_gauge *g;
     struct cmt_histogram *h;
@@ -89,7 +137,9 @@ struct log_to_metrics_ctx {
     int timer_interval;
     int timer_mode;
     struct flb_sched_timer *timer;
-    int new_data;
+    int cardinality_limit;
+    int cardinality_warned;
+    int kubernetes_warned;
 };
 
 struct grep_rule
@@ -31,11 +31,24 @@
 #include <fluent-bit/flb_log_event_encoder.h>
 #include <msgpack.h>
 
+#include <fluent-bit/flb_vm_pool.h>
 #include "fluent-bit/flb_mem.h"
 #include "lua.h"
 #include "lua_config.h"
 #include "mpack/mpack.h"
 
+#ifndef FLB_FILTER_LUA_USE_MPACK
+/* Chunk handed to the pool of Lua states */
+struct lua_pool_call {
+    struct lua_filter *ctx;
+    const char *tag;
+    int tag_len;
+};
+
+static int lua_pool_filter(void *vm, const void *buf, size_t size,
+                           void **out_buf, size_t *out_size, void *data);
+#endif
+
 static int cb_lua_pre_run(struct flb_filter_instance *f_ins,
                           struct flb_config *config, void *data)
 {
@@ -76,64 +89,102 @@ static int cb_lua_pre_run(struct flb_filter_instance *f_ins,
     return ret;
 }
 
-static int cb_lua_init(struct flb_filter_instance *f_ins,
-                       struct flb_config *config,
-                       void *data)
+/* Create a Lua state and load the script on it */
+static struct flb_luajit *lua_vm_create(struct lua_filter *ctx,
+                                        struct flb_config *config)
 {
     int err;
     int ret;
-    (void) data;
-    struct lua_filter *ctx;
     struct flb_luajit *lj;
 
-    /* Create context */
-    ctx = lua_config_create(f_ins, config);
-    if (!ctx) {
-        flb_error("[filter_lua] filter cannot be loaded");
-        return -1;
-    }
-
     /* Create LuaJIT state/vm */
     lj = flb_luajit_create(config);
     if (!lj) {
-        lua_config_destroy(ctx);
-        return -1;
+        return NULL;
     }
-    ctx->lua = lj;
 
     if (ctx->enable_flb_null) {
         flb_lua_enable_flb_null(lj->state);
     }
 
+    if (ctx->lazy_records) {
+        flb_lua_lazy_init(lj->state);
+    }
+
     /* Lua script source code */
     if (ctx->code) {
-        ret = flb_luajit_load_buffer(ctx->lua,
+        ret = flb_luajit_load_buffer(lj,
                                      ctx->code, flb_sds_len(ctx->code),
                                      "fluentbit.lua");
     }
     else {
         /* Load Script / file path*/
-        ret = flb_luajit_load_script(ctx->lua, ctx->script);
+        ret = flb_luajit_load_script(lj, ctx->script);
     }
 
     if (ret == -1) {
-        flb_luajit_destroy(ctx->lua);
-        lua_config_destroy(ctx);
-        return -1;
+        flb_luajit_destroy(lj);
+        return NULL;
     }
 
-    err = lua_pcall(ctx->lua->state, 0, 0, 0);
+    err = lua_pcall(lj->state, 0, 0, 0);
     if (err != 0) {
         flb_error("[luajit] invalid lua content, error=%d: %s",
                   err, lua_tostring(lj->state, -1));
         lua_pop(lj->state, 1);
-        lua_config_destroy(ctx);
-        return -1;
+        flb_luajit_destroy(lj);
+        return NULL;
     }
 
-
-    if (flb_lua_is_valid_func(ctx->lua->state, ctx->call) != FLB_TRUE) {
+    if (flb_lua_is_valid_func(lj->state, ctx->call) != FLB_TRUE) {
         flb_plg_error(ctx->ins, "function %s is not found", ctx->call);
+        flb_luajit_destroy(lj);
+        return NULL;
+    }
+
+    return lj;
+}
+
+static void lua_vms_destroy(struct lua_filter *ctx)
+{
+    int i;
+
+    if (ctx->pool) {
+        flb_vm_pool_destroy(ctx->pool);
+        ctx->pool = NULL;
+    }
+
+    if (!ctx->vms) {
+        return;
+    }
+
+    /* the first one is 'ctx->lua' */
+    for (i = 1; i < ctx->workers; i++) {
+        if (ctx->vms[i]) {
+            flb_luajit_destroy(ctx->vms[i]);
+        }
+    }
+    flb_free(ctx->vms);
+    ctx->vms = NULL;
+}
+
+static int cb_lua_init(struct flb_filter_instance *f_ins,
+                       struct flb_config *config,
+                       void *data)
+{
+    int i;
+    (void) data;
+    struct lua_filter *ctx;
+
+    /* Create context */
+    ctx = lua_config_create(f_ins, config);
+    if (!ctx) {
+        flb_error("[filter_lua] filter cannot be loaded");
+        return -1;
+    }
+
+    ctx->lua = lua_vm_create(ctx, config);
+    if (!ctx->lua) {
         lua_config_destroy(ctx);
         return -1;
     }
@@ -145,6 +196,50 @@ static int cb_lua_init(struct flb_filter_instance *f_ins,
         return -1;
     }
 
+#ifndef FLB_FILTER_LUA_USE_MPACK
+    /* Pool of Lua states processing the chunks in parallel */
+    if (ctx->workers > 1) {
+        if (ctx->workers > FLB_VM_POOL_MAX) {
+            flb_plg_error(ctx->ins, "'workers' cannot be greater than %i",
+                          FLB_VM_POOL_MAX);
+            flb_luajit_destroy(ctx->lua);
+            lua_config_destroy(ctx);
+            return -1;
+        }
+
+        ctx->vms = flb_calloc(ctx->workers, sizeof(struct flb_luajit *));
+        if (!ctx->vms) {
+            flb_errno();
+            flb_luajit_destroy(ctx->lua);
+            lua_config_destroy(ctx);
+            return -1;
+        }
+        ctx->vms[0] = ctx->lua;
+
+        for (i = 1; i < ctx->workers; i++) {
+            ctx->vms[i] = lua_vm_create(ctx, config);
+            if (!ctx->vms[i]) {
+                break;
+            }
+        }
+
+        if (i == ctx->workers) {
+            ctx->pool = flb_vm_pool_create(f_ins, ctx->workers,
+                                           (void **) ctx->vms,
+                                           lua_pool_filter, NULL, NULL, NULL);
+        }
+
+        if (!ctx->pool) {
+            flb_plg_error(ctx->ins, "could not create %i Lua states",
+                          ctx->workers);
+            lua_vms_destroy(ctx);
+            flb_luajit_destroy(ctx->lua);
+            lua_config_destroy(ctx);
+            return -1;
+        }
+    }
+#endif
+
     /* Set context */
     flb_filter_set_context(f_ins, ctx);
 
@@ -478,19 +573,297 @@ static int pack_result (struct lua_filter *ctx, struct flb_time *ts,
     return FLB_FALSE;
 }
 
-static int cb_lua_filter(const void *data, size_t bytes,
-                         const char *tag, int tag_len,
-                         void **out_buf, size_t *out_bytes,
-                         struct flb_filter_instance *f_ins,
-                         struct flb_input_instance *i_ins,
-                         void *filter_context,
-                         struct flb_config *config)
+/* A record decoded from the chunk, valid until the chunk zone is released */
+struct lua_batch_event {
+    struct flb_log_event event;
+    const char *raw;
+    size_t raw_size;
+};
+
+/* Read the timestamp returned for a record, it's on top of the stack */
+static void lua_batch_timestamp(struct lua_filter *ctx, lua_State *l,
+                                int l_code,
+                                struct flb_time *t_orig, struct flb_time *t)
+{
+    *t = *t_orig;
+    if (l_code == 2) {
+        return;
+    }
+
+    if (ctx->time_as_table == FLB_TRUE) {
+        if (lua_type(l, -1) == LUA_TTABLE) {
+            lua_getfield(l, -1, "sec");
+            t->tm.tv_sec = lua_tointeger(l, -1);
+            lua_pop(l, 1);
+
+            lua_getfield(l, -1, "nsec");
+            t->tm.tv_nsec = lua_tointeger(l, -1);
+            lua_pop(l, 1);
+        }
+        else {
+            flb_plg_error(ctx->ins, "invalid lua timestamp type returned");
+        }
+    }
+    else if (lua_type(l, -1) == LUA_TNUMBER) {
+        flb_time_from_double(t, (double) lua_tonumber(l, -1));
+    }
+}
+
+/*
+ * Batch mode: the function is called once per chunk,
+ *
+ *   function cb(tag, timestamps, records)
+ *       return codes, timestamps, records
+ *   end
+ *
+ * 'timestamps' and 'records' are arrays with one entry per record, the
+ * returned 'codes' is either an array of codes or a single code applied to
+ * every record. Codes have the same meaning as in the per record mode.
+ */
+static int lua_filter_batch(struct lua_filter *ctx, lua_State *l,
+                            const void *data, size_t bytes,
+                            const char *tag, int tag_len,
+                            void **out_buf, size_t *out_bytes)
+{
+    int i;
+    int ret;
+    int top;
+    int l_code;
+    int count = 0;
+    int size = 0;
+    size_t off = 0;
+    size_t prev_off;
+    int32_t record_type;
+    msgpack_object root;
+    msgpack_zone zone;
+    msgpack_packer data_pck;
+    msgpack_sbuffer data_sbuf;
+    struct flb_time t;
+    struct lua_batch_event *tmp;
+    struct lua_batch_event *events = NULL;
+    struct flb_log_event_encoder log_encoder;
+    struct flb_log_event_decoder log_decoder;
+
+    /* the decoder only provides the empty metadata map */
+    ret = flb_log_event_decoder_init(&log_decoder, (char *) data, bytes);
+    if (ret != FLB_EVENT_DECODER_SUCCESS) {
+        flb_plg_error(ctx->ins,
+                      "Log event decoder initialization error : %d", ret);
+        return FLB_FILTER_NOTOUCH;
+    }
+
+    if (!msgpack_zone_init(&zone, LUA_BUFFER_CHUNK)) {
+        flb_log_event_decoder_destroy(&log_decoder);
+        return FLB_FILTER_NOTOUCH;
+    }
+
+    /* decode the whole chunk, the objects live in 'zone' */
+    while (off < bytes) {
+        prev_off = off;
+        ret = msgpack_unpack((char *) data, bytes, &off, &zone, &root);
+        if (ret != MSGPACK_UNPACK_SUCCESS &&
+            ret != MSGPACK_UNPACK_EXTRA_BYTES) {
+            count = 0;
+            break;
+        }
+
+        if (count == size) {
+            size = size ? size * 2 : 64;
+            tmp = flb_realloc(events, sizeof(struct lua_batch_event) * size);
+            if (!tmp) {
+                flb_errno();
+                flb_free(events);
+                msgpack_zone_destroy(&zone);
+                flb_log_event_decoder_destroy(&log_decoder);
+                return FLB_FILTER_NOTOUCH;
+            }
+            events = tmp;
+        }
+
+        ret = flb_event_decoder_decode_object(&log_decoder,
+                                              &events[count].event, &root);
+        if (ret != FLB_EVENT_DECODER_SUCCESS) {
+            flb_plg_error(ctx->ins, "invalid record in chunk : %d", ret);
+            count = 0;
+            break;
+        }
+
+        /* group markers are not passed to the script */
+        ret = flb_log_event_decoder_get_record_type(&events[count].event,
+                                                    &record_type);
+        if (ret != 0 || record_type != FLB_LOG_EVENT_NORMAL) {
+            continue;
+        }
+
+        events[count].raw = (const char *) data + prev_off;
+        events[count].raw_size = off - prev_off;
+        count++;
+    }
+
+    if (count == 0) {
+        flb_free(events);
+        msgpack_zone_destroy(&zone);
+        flb_log_event_decoder_destroy(&log_decoder);
+        return FLB_FILTER_NOTOUCH;
+    }
+
+    ret = flb_log_event_encoder_init(&log_encoder,
+                                     FLB_LOG_EVENT_FORMAT_DEFAULT);
+    if (ret != FLB_EVENT_ENCODER_SUCCESS) {
+        flb_plg_error(ctx->ins,
+                      "Log event encoder initialization error : %d", ret);
+        flb_free(events);
+        msgpack_zone_destroy(&zone);
+        flb_log_event_decoder_destroy(&log_decoder);
+        return FLB_FILTER_NOTOUCH;
+    }
+
+    top = lua_gettop(l);
+    lua_checkstack(l, 8);
+
+    lua_getglobal(l, ctx->call);
+    lua_pushlstring(l, tag, tag_len);
+
+    lua_createtable(l, count, 0);
+    for (i = 0; i < count; i++) {
+        if (ctx->time_as_table == FLB_TRUE) {
+            flb_lua_pushtimetable(l, &events[i].event.timestamp);
+        }
+        else {
+            lua_pushnumber(l, flb_time_to_double(&events[i].event.timestamp));
+        }
+        lua_rawseti(l, -2, i + 1);
+    }
+
+    lua_createtable(l, count, 0);
+    for (i = 0; i < count; i++) {
+        if (ctx->lazy_records) {
+            flb_lua_pushmsgpack_lazy(l, events[i].event.body);
+        }
+        else {
+            flb_lua_pushmsgpack(l, events[i].event.body);
+        }
+        lua_rawseti(l, -2, i + 1);
+    }
+
+    if (ctx->protected_mode) {
+        ret = lua_pcall(l, 3, 3, 0);
+        if (ret != 0) {
+            flb_plg_error(ctx->ins, "error code %d: %s",
+                          ret, lua_tostring(l, -1));
+            lua_settop(l, top);
+            if (ctx->lazy_records) {
+                flb_lua_lazy_release_all(l);
+            }
+            flb_log_event_encoder_destroy(&log_encoder);
+            flb_free(events);
+            msgpack_zone_destroy(&zone);
+            flb_log_event_decoder_destroy(&log_decoder);
+            return FLB_FILTER_NOTOUCH;
+        }
+    }
+    else {
+        lua_call(l, 3, 3);
+    }
+
+    /* stack: codes (top + 1), timestamps (top + 2), records (top + 3) */
+    ret = FLB_EVENT_ENCODER_SUCCESS;
+    for (i = 0; i < count && ret == FLB_EVENT_ENCODER_SUCCESS; i++) {
+        if (lua_type(l, top + 1) == LUA_TTABLE) {
+            lua_rawgeti(l, top + 1, i + 1);
+            l_code = (int) lua_tointeger(l, -1);
+            lua_pop(l, 1);
+        }
+        else {
+            l_code = (int) lua_tointeger(l, top + 1);
+        }
+
+        if (l_code == -1) {
+            continue;
+        }
+        else if (l_code != 1 && l_code != 2) {
+            if (l_code != 0) {
+                flb_plg_error(ctx->ins,
+                              "unexpected Lua script return code %i, "
+                              "original record will be kept." , l_code);
+            }
+            ret = flb_log_event_encoder_emit_raw_record(&log_encoder,
+                                                        events[i].raw,
+                                                        events[i].raw_size);
+            continue;
+        }
+
+        /* timestamp */
+        if (lua_type(l, top + 2) == LUA_TTABLE) {
+            lua_rawgeti(l, top + 2, i + 1);
+        }
+        else {
+            lua_pushnil(l);
+        }
+        lua_batch_timestamp(ctx, l, l_code, &events[i].event.timestamp, &t);
+        lua_pop(l, 1);
+
+        /* record */
+        if (lua_type(l, top + 3) != LUA_TTABLE) {
+            flb_plg_error(ctx->ins, "invalid records returned at %s()",
+                          ctx->call);
+            ret = FLB_EVENT_ENCODER_ERROR_INVALID_ARGUMENT;
+            break;
+        }
+
+        msgpack_sbuffer_init(&data_sbuf);
+        msgpack_packer_init(&data_pck, &data_sbuf, msgpack_sbuffer_write);
+
+        lua_rawgeti(l, top + 3, i + 1);
+        flb_lua_tomsgpack(l, &data_pck, 0, &ctx->l2cc);
+        lua_pop(l, 1);
+
+        if (pack_result(ctx, &t, events[i].event.metadata, &log_encoder,
+                        data_sbuf.data, data_sbuf.size) == FLB_FALSE) {
+            flb_plg_error(ctx->ins, "invalid table returned at %s(), %s",
+                          ctx->call, ctx->script);
+            ret = FLB_EVENT_ENCODER_ERROR_INVALID_ARGUMENT;
+        }
+        msgpack_sbuffer_destroy(&data_sbuf);
+    }
+
+    lua_settop(l, top);
+    if (ctx->lazy_records) {
+        flb_lua_lazy_release_all(l);
+    }
+
+    if (ret == FLB_EVENT_ENCODER_SUCCESS) {
+        *out_buf   = log_encoder.output_buffer;
+        *out_bytes = log_encoder.output_length;
+
+        ret = FLB_FILTER_MODIFIED;
+
+        flb_log_event_encoder_claim_internal_buffer_ownership(&log_encoder);
+    }
+    else {
+        flb_plg_error(ctx->ins,
+                      "Log event encoder error : %d", ret);
+
+        ret = FLB_FILTER_NOTOUCH;
+    }
+
+    flb_log_event_encoder_destroy(&log_encoder);
+    flb_free(events);
+    msgpack_zone_destroy(&zone);
+    flb_log_event_decoder_destroy(&log_decoder);
+
+    return ret;
+}
+
+static int lua_filter_records(struct lua_filter *ctx, lua_State *l,
+                              const void *data, size_t bytes,
+                              const char *tag, int tag_len,
+                              void **out_buf, size_t *out_bytes)
 {
     int ret;
     double ts = 0;
     struct flb_time t_orig;
     struct flb_time t;
-    struct lua_filter *ctx = filter_context;
     /* Lua return values */
     int l_code;
     double l_timestamp;
@@ -500,10 +873,6 @@ static int cb_lua_filter(const void *data, size_t bytes,
     struct flb_log_event_decoder log_decoder;
     struct flb_log_event log_event;
 
-    (void) f_ins;
-    (void) i_ins;
-    (void) config;
-
     ret = flb_log_event_decoder_init(&log_decoder, (char *) data, bytes);
 
     if (ret != FLB_EVENT_DECODER_SUCCESS) {
@@ -536,25 +905,35 @@ static int cb_lua_filter(const void *data, size_t bytes,
         flb_time_copy(&t_orig, &log_event.timestamp);
 
         /* Prepare function call, pass 3 arguments, expect 3 return values */
-        lua_getglobal(ctx->lua->state, ctx->call);
-        lua_pushstring(ctx->lua->state, tag);
+        lua_getglobal(l, ctx->call);
+        lua_pushstring(l, tag);
 
         /* Timestamp */
         if (ctx->time_as_table == FLB_TRUE) {
-            flb_lua_pushtimetable(ctx->lua->state, &t);
+            flb_lua_pushtimetable(l, &t);
         }
         else {
             ts = flb_time_to_double(&t);
-            lua_pushnumber(ctx->lua->state, ts);
+            lua_pushnumber(l, ts);
+        }
+
+        if (ctx->lazy_records) {
+            flb_lua_pushmsgpack_lazy(l, log_event.body);
+        }
+        else {
+            flb_lua_pushmsgpack(l, log_event.body);
         }
 
-        flb_lua_pushmsgpack(ctx->lua->state, log_event.body);
         if (ctx->protected_mode) {
-            ret = lua_pcall(ctx->lua->state, 3, 3, 0);
+            ret = lua_pcall(l, 3, 3, 0);
             if (ret != 0) {
                 flb_plg_error(ctx->ins, "error code %d: %s",
-                              ret, lua_tostring(ctx->lua->state, -1));
-                lua_pop(ctx->lua->state, 1);
+                              ret, lua_tostring(l, -1));
+                lua_pop(l, 1);
+
+                if (ctx->lazy_records) {
+                    flb_lua_lazy_release_all(l);
+                }
 
                 msgpack_sbuffer_destroy(&data_sbuf);
                 flb_log_event_decoder_destroy(&log_decoder);
@@ -564,28 +943,32 @@ static int cb_lua_filter(const void *data, size_t bytes,
             }
         }
         else {
-            lua_call(ctx->lua->state, 3, 3);
+            lua_call(l, 3, 3);
         }
 
         /* Initialize Return values */
         l_code = 0;
         l_timestamp = ts;
 
-        flb_lua_tomsgpack(ctx->lua->state, &data_pck, 0, &ctx->l2cc);
-        lua_pop(ctx->lua->state, 1);
+        flb_lua_tomsgpack(l, &data_pck, 0, &ctx->l2cc);
+        lua_pop(l, 1);
+
+        if (ctx->lazy_records) {
+            flb_lua_lazy_release_all(l);
+        }
 
         /* Lua table */
         if (ctx->time_as_table == FLB_TRUE) {
-            if (lua_type(ctx->lua->state, -1) == LUA_TTABLE) {
+            if (lua_type(l, -1) == LUA_TTABLE) {
                 /* Retrieve seconds */
-                lua_getfield(ctx->lua->state, -1, "sec");
-                t.tm.tv_sec = lua_tointeger(ctx->lua->state, -1);
-                lua_pop(ctx->lua->state, 1);
+                lua_getfield(l, -1, "sec");
+                t.tm.tv_sec = lua_tointeger(l, -1);
+                lua_pop(l, 1);
 
                 /* Retrieve nanoseconds */
-                lua_getfield(ctx->lua->state, -1, "nsec");
-                t.tm.tv_nsec = lua_tointeger(ctx->lua->state, -1);
-                lua_pop(ctx->lua->state, 2);
+                lua_getfield(l, -1, "nsec");
+                t.tm.tv_nsec = lua_tointeger(l, -1);
+                lua_pop(l, 2);
             }
             else {
                 flb_plg_error(ctx->ins, "invalid lua timestamp type returned");
@@ -593,12 +976,12 @@ static int cb_lua_filter(const void *data, size_t bytes,
             }
         }
         else {
-            l_timestamp = (double) lua_tonumber(ctx->lua->state, -1);
-            lua_pop(ctx->lua->state, 1);
+            l_timestamp = (double) lua_tonumber(l, -1);
+            lua_pop(l, 1);
         }
 
-        l_code = (int) lua_tointeger(ctx->lua->state, -1);
-        lua_pop(ctx->lua->state, 1);
+        l_code = (int) lua_tointeger(l, -1);
+        lua_pop(l, 1);
 
         if (l_code == -1) { /* Skip record */
             msgpack_sbuffer_destroy(&data_sbuf);
@@ -675,6 +1058,59 @@ static int cb_lua_filter(const void *data, size_t bytes,
 
     return ret;
 }
+
+/* Run a chunk on a Lua state */
+static int lua_filter_chunk(struct lua_filter *ctx, lua_State *l,
+                            const void *data, size_t bytes,
+                            const char *tag, int tag_len,
+                            void **out_buf, size_t *out_bytes)
+{
+    if (ctx->batch_mode) {
+        return lua_filter_batch(ctx, l, data, bytes, tag, tag_len,
+                                out_buf, out_bytes);
+    }
+
+    return lua_filter_records(ctx, l, data, bytes, tag, tag_len,
+                              out_buf, out_bytes);
+}
+
+/* Slice of a chunk processed by one of the states of the pool */
+static int lua_pool_filter(void *vm, const void *buf, size_t size,
+                           void **out_buf, size_t *out_size, void *data)
+{
+    struct flb_luajit *lj = vm;
+    struct lua_pool_call *call = data;
+
+    return lua_filter_chunk(call->ctx, lj->state, buf, size,
+                            call->tag, call->tag_len, out_buf, out_size);
+}
+
+static int cb_lua_filter(const void *data, size_t bytes,
+                         const char *tag, int tag_len,
+                         void **out_buf, size_t *out_bytes,
+                         struct flb_filter_instance *f_ins,
+                         struct flb_input_instance *i_ins,
+                         void *filter_context,
+                         struct flb_config *config)
+{
+    struct lua_pool_call call;
+    struct lua_filter *ctx = filter_context;
+
+    (void) f_ins;
+    (void) i_ins;
+    (void) config;
+
+    if (ctx->pool) {
+        call.ctx = ctx;
+        call.tag = tag;
+        call.tag_len = tag_len;
+        return flb_vm_pool_run(ctx->pool, data, bytes, out_buf, out_bytes,
+                               &call);
+    }
+
+    return lua_filter_chunk(ctx, ctx->lua->state, data, bytes, tag, tag_len,
+                            out_buf, out_bytes);
+}
 #endif
 
 static int cb_lua_exit(void *data, struct flb_config *config)
@@ -682,6 +1118,7 @@ static int cb_lua_exit(void *data, struct flb_config *config)
     struct lua_filter *ctx;
 
     ctx = data;
+    lua_vms_destroy(ctx);
     flb_luajit_destroy(ctx->lua);
     lua_config_destroy(ctx);
 
@@ -735,6 +1172,29 @@ static struct flb_config_map config_map[] = {
      "It is useful to prevent removing key/value "
      "since nil is a special value to remove key value from map in Lua."
     },
+    {
+     FLB_CONFIG_MAP_BOOL, "batch_mode", "false",
+     0, FLB_TRUE, offsetof(struct lua_filter, batch_mode),
+     "If enabled, the function is called once per chunk: it receives the tag, "
+     "an array of timestamps and an array of records and returns an array "
+     "of codes (or a single code), an array of timestamps and an array of "
+     "records."
+    },
+    {
+     FLB_CONFIG_MAP_BOOL, "lazy_records", "false",
+     0, FLB_TRUE, offsetof(struct lua_filter, lazy_records),
+     "If enabled, records are passed as proxies which decode the fields "
+     "when they are accessed, untouched fields are copied as they are. "
+     "Proxies cannot be iterated with pairs() and must not be kept "
+     "across calls."
+    },
+    {
+     FLB_CONFIG_MAP_INT, "workers", "1",
+     0, FLB_TRUE, offsetof(struct lua_filter, workers),
+     "Number of Lua states loaded with the script. When greater than one, "
+     "every chunk is split and its parts are processed in parallel, the "
+     "order of the records is kept."
+    },
 
     {0}
 };
@@ -25,6 +25,7 @@
 #include <fluent-bit/flb_luajit.h>
 #include <fluent-bit/flb_sds.h>
 #include <fluent-bit/flb_lua.h>
+#include <fluent-bit/flb_vm_pool.h>
 
 #define LUA_BUFFER_CHUNK    1024 * 8  /* 8K should be enough to get started */
 
@@ -36,8 +37,13 @@ struct lua_filter {
     int    protected_mode;            /* exec lua function in protected mode */
     int    time_as_table;             /* timestamp as a Lua table */
     int    enable_flb_null;           /* Use flb_null in Lua */
+    int    batch_mode;                /* call the function once per chunk */
+    int    lazy_records;              /* records are decoded on access */
     struct flb_lua_l2c_config l2cc;   /* lua -> C config */
     struct flb_luajit *lua;           /* state context   */
+    int    workers;                   /* number of Lua states */
+    struct flb_luajit **vms;          /* states of the pool, vms[0] = lua */
+    struct flb_vm_pool *pool;         /* parallel execution */
     struct flb_filter_instance *ins;  /* filter instance */
     flb_sds_t packbuf;                /* dynamic buffer used for mpack write */
 };
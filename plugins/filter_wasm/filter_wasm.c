@@ -28,6 +28,7 @@
 #include <fluent-bit/flb_kv.h>
 #include <fluent-bit/flb_log_event_decoder.h>
 #include <fluent-bit/flb_log_event_encoder.h>
+#include <fluent-bit/flb_vm_pool.h>
 #include <msgpack.h>
 
 #include <stdio.h>
@@ -36,14 +37,19 @@
 
 #include "filter_wasm.h"
 
-/* cb_filter callback */
-static int cb_wasm_filter(const void *data, size_t bytes,
-                          const char *tag, int tag_len,
-                          void **out_buf, size_t *out_bytes,
-                          struct flb_filter_instance *f_ins,
-                          struct flb_input_instance *i_ins,
-                          void *filter_context,
-                          struct flb_config *config)
+/* Chunk handed to the pool of WASM instances */
+struct wasm_pool_call {
+    struct flb_filter_wasm *ctx;
+    const char *tag;
+    int tag_len;
+};
+
+/* Run the records of a chunk through a WASM instance */
+static int wasm_filter_chunk(struct flb_filter_wasm *ctx,
+                             struct flb_wasm *wasm,
+                             const void *data, size_t bytes,
+                             const char *tag, int tag_len,
+                             void **out_buf, size_t *out_bytes)
 {
     int ret;
     char *ret_val = NULL;
@@ -55,18 +61,12 @@ static int cb_wasm_filter(const void *data, size_t bytes,
     char *json_buf = NULL;
     size_t json_size;
     int root_type;
-    struct flb_wasm *wasm = NULL;
     size_t buf_size;
 
-    struct flb_filter_wasm *ctx = filter_context;
     struct flb_log_event_encoder log_encoder;
     struct flb_log_event_decoder log_decoder;
     struct flb_log_event log_event;
 
-    (void) f_ins;
-    (void) i_ins;
-    (void) config;
-
     ret = flb_log_event_decoder_init(&log_decoder, (char *) data, bytes);
 
     if (ret != FLB_EVENT_DECODER_SUCCESS) {
@@ -88,13 +88,6 @@ static int cb_wasm_filter(const void *data, size_t bytes,
         return FLB_FILTER_NOTOUCH;
     }
 
-    wasm = flb_wasm_instantiate(config, ctx->wasm_path, ctx->accessible_dir_list,
-                                ctx->wasm_conf);
-    if (wasm == NULL) {
-        flb_plg_debug(ctx->ins, "instantiate wasm [%s] failed", ctx->wasm_path);
-        goto on_error;
-    }
-
     while ((ret = flb_log_event_decoder_next(
                     &log_decoder,
                     &log_event)) == FLB_EVENT_DECODER_SUCCESS) {
@@ -227,9 +220,6 @@ static int cb_wasm_filter(const void *data, size_t bytes,
         }
     }
 
-    /* Teardown WASM context */
-    flb_wasm_destroy(wasm);
-
     *out_buf   = log_encoder.output_buffer;
     *out_bytes = log_encoder.output_length;
 
@@ -244,11 +234,95 @@ on_error:
     flb_log_event_decoder_destroy(&log_decoder);
     flb_log_event_encoder_destroy(&log_encoder);
 
-    if (wasm != NULL) {
-        flb_wasm_destroy(wasm);
+    return FLB_FILTER_NOTOUCH;
+}
+
+/* Slice of a chunk processed by one of the instances of the pool */
+static int wasm_pool_filter(void *vm, const void *buf, size_t size,
+                            void **out_buf, size_t *out_size, void *data)
+{
+    struct wasm_pool_call *call = data;
+
+    return wasm_filter_chunk(call->ctx, vm, buf, size,
+                             call->tag, call->tag_len, out_buf, out_size);
+}
+
+/*
+ * WAMR requires threads not created by the runtime to register, and an
+ * execution environment must be used by the thread which created it: every
+ * worker instantiates the module for itself.
+ */
+static int wasm_pool_thread_init(void **vm, void *context)
+{
+    struct flb_wasm *wasm;
+    struct flb_filter_wasm *ctx = context;
+
+    if (!wasm_runtime_init_thread_env()) {
+        flb_plg_error(ctx->ins, "could not initialize the WASM thread "
+                      "environment");
+        return -1;
     }
 
-    return FLB_FILTER_NOTOUCH;
+    wasm = flb_wasm_instantiate(ctx->ins->config, ctx->wasm_path,
+                                ctx->accessible_dir_list, ctx->wasm_conf);
+    if (!wasm) {
+        flb_plg_error(ctx->ins, "instantiate wasm [%s] failed",
+                      ctx->wasm_path);
+        wasm_runtime_destroy_thread_env();
+        return -1;
+    }
+
+    *vm = wasm;
+    return 0;
+}
+
+static void wasm_pool_thread_exit(void *vm, void *context)
+{
+    (void) context;
+
+    flb_wasm_destroy(vm);
+    wasm_runtime_destroy_thread_env();
+}
+
+/* cb_filter callback */
+static int cb_wasm_filter(const void *data, size_t bytes,
+                          const char *tag, int tag_len,
+                          void **out_buf, size_t *out_bytes,
+                          struct flb_filter_instance *f_ins,
+                          struct flb_input_instance *i_ins,
+                          void *filter_context,
+                          struct flb_config *config)
+{
+    int ret;
+    struct flb_wasm *wasm;
+    struct wasm_pool_call call;
+    struct flb_filter_wasm *ctx = filter_context;
+
+    (void) f_ins;
+    (void) i_ins;
+
+    if (ctx->pool) {
+        call.ctx = ctx;
+        call.tag = tag;
+        call.tag_len = tag_len;
+        return flb_vm_pool_run(ctx->pool, data, bytes, out_buf, out_bytes,
+                               &call);
+    }
+
+    wasm = flb_wasm_instantiate(config, ctx->wasm_path, ctx->accessible_dir_list,
+                                ctx->wasm_conf);
+    if (wasm == NULL) {
+        flb_plg_debug(ctx->ins, "instantiate wasm [%s] failed", ctx->wasm_path);
+        return FLB_FILTER_NOTOUCH;
+    }
+
+    ret = wasm_filter_chunk(ctx, wasm, data, bytes, tag, tag_len,
+                            out_buf, out_bytes);
+
+    /* Teardown WASM context */
+    flb_wasm_destroy(wasm);
+
+    return ret;
 }
 
 /* read config file and*/
@@ -288,6 +362,15 @@ static void delete_wasm_config(struct flb_filter_wasm *ctx)
         return;
     }
 
+    /* the instances are destroyed by their worker */
+    if (ctx->pool) {
+        flb_vm_pool_destroy(ctx->pool);
+    }
+
+    if (ctx->wasm_conf) {
+        flb_wasm_config_destroy(ctx->wasm_conf);
+    }
+
     flb_free(ctx);
 }
 
@@ -378,6 +461,28 @@ static int cb_wasm_init(struct flb_filter_instance *f_ins,
         wasm_conf->stack_size = ctx->wasm_stack_size;
     }
 
+    /*
+     * Pool of instances processing the chunks in parallel, they are kept
+     * for the whole filter life instead of being created for every chunk.
+     * Every instance is created and used by its own worker thread.
+     */
+    if (ctx->workers > 1) {
+        if (ctx->workers > FLB_VM_POOL_MAX) {
+            flb_plg_error(f_ins, "'workers' cannot be greater than %i",
+                          FLB_VM_POOL_MAX);
+            goto init_error;
+        }
+
+        ctx->pool = flb_vm_pool_create(f_ins, ctx->workers, NULL,
+                                       wasm_pool_filter,
+                                       wasm_pool_thread_init,
+                                       wasm_pool_thread_exit,
+                                       ctx);
+        if (!ctx->pool) {
+            goto init_error;
+        }
+    }
+
     /* Set context */
     flb_filter_set_context(f_ins, ctx);
     return 0;
@@ -392,9 +497,8 @@ static int cb_wasm_exit(void *data, struct flb_config *config)
 {
     struct flb_filter_wasm *ctx = data;
 
-    flb_wasm_config_destroy(ctx->wasm_conf);
-    flb_wasm_destroy_all(config);
     delete_wasm_config(ctx);
+    flb_wasm_destroy_all(config);
     return 0;
 }
 
@@ -430,6 +534,13 @@ static struct flb_config_map config_map[] = {
       0, FLB_TRUE, offsetof(struct flb_filter_wasm, wasm_stack_size),
       "Set the stack size of wasm runtime"
     },
+    {
+      FLB_CONFIG_MAP_INT, "workers", "1",
+      0, FLB_TRUE, offsetof(struct flb_filter_wasm, workers),
+      "Number of WASM instances. When greater than one, the instances are "
+      "kept loaded and every chunk is split and its parts are processed in "
+      "parallel, the order of the records is kept."
+    },
     /* EOF */
     {0}
 };
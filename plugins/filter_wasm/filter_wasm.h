@@ -52,6 +52,8 @@ struct flb_filter_wasm {
     struct flb_wasm_config *wasm_conf;
     struct flb_filter_instance *ins;
     struct flb_wasm *wasm;
+    int workers;                          /* number of instances */
+    struct flb_vm_pool *pool;             /* parallel execution */
 };
 
 #endif /* FLB_FILTER_WASM_H */
@@ -89,11 +89,108 @@ static void bytes_to_nodename(unsigned char *data, char *buf, size_t len) {
     }
 }
 
+/*
+ * Network workers: every worker serves its connections with a copy of the
+ * context owning its encoder, list of connections and HTTP server.
+ */
+static int in_elasticsearch_worker_init(struct flb_input_net_worker *worker)
+{
+    int                          ret;
+    struct flb_in_elasticsearch *ctx;
+    struct flb_in_elasticsearch *worker_ctx;
+    struct flb_input_instance   *ins;
+
+    ctx = worker->parent->context;
+    ins = ctx->ins;
+
+    worker_ctx = flb_malloc(sizeof(struct flb_in_elasticsearch));
+    if (!worker_ctx) {
+        flb_errno();
+        return -1;
+    }
+    memcpy(worker_ctx, ctx, sizeof(struct flb_in_elasticsearch));
+
+    worker_ctx->collector_id = -1;
+    worker_ctx->downstream = worker->downstream;
+    worker_ctx->workers = NULL;
+    mk_list_init(&worker_ctx->connections);
+
+    worker_ctx->log_encoder = flb_log_event_encoder_create(FLB_LOG_EVENT_FORMAT_DEFAULT);
+    if (worker_ctx->log_encoder == NULL) {
+        flb_plg_error(ins, "event encoder initialization error");
+        flb_free(worker_ctx);
+        return -1;
+    }
+
+    if (ctx->enable_http2) {
+        ret = flb_http_server_init(&worker_ctx->http_server,
+                                   HTTP_PROTOCOL_AUTODETECT,
+                                   (FLB_HTTP_SERVER_FLAG_KEEPALIVE | FLB_HTTP_SERVER_FLAG_AUTO_INFLATE),
+                                   NULL,
+                                   ins->host.listen,
+                                   ins->host.port,
+                                   ins->tls,
+                                   ins->flags,
+                                   &ins->net_setup,
+                                   worker->evl,
+                                   ins->config,
+                                   (void *) worker_ctx);
+        if (ret == 0) {
+            ret = flb_http_server_start(&worker_ctx->http_server);
+        }
+
+        if (ret != 0) {
+            flb_plg_error(ins, "could not start http server for worker #%i",
+                          worker->id);
+            flb_http_server_destroy(&worker_ctx->http_server);
+            flb_log_event_encoder_destroy(worker_ctx->log_encoder);
+            flb_free(worker_ctx);
+            return -1;
+        }
+
+        worker_ctx->http_server.request_callback = in_elasticsearch_bulk_prot_handle_ng;
+
+        flb_input_net_worker_downstream_set(worker,
+                                            worker_ctx->http_server.downstream);
+    }
+
+    worker->data = worker_ctx;
+    return 0;
+}
+
+static int in_elasticsearch_worker_accept(struct flb_input_net_worker *worker,
+                                          struct flb_connection *connection)
+{
+    struct in_elasticsearch_bulk_conn *conn;
+
+    conn = in_elasticsearch_bulk_conn_add(connection, worker->data);
+    if (conn == NULL) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static void in_elasticsearch_worker_exit(struct flb_input_net_worker *worker)
+{
+    struct flb_in_elasticsearch *worker_ctx = worker->data;
+
+    in_elasticsearch_bulk_conn_release_all(worker_ctx);
+
+    if (worker_ctx->enable_http2) {
+        flb_http_server_destroy(&worker_ctx->http_server);
+    }
+
+    flb_log_event_encoder_destroy(worker_ctx->log_encoder);
+    flb_free(worker_ctx);
+}
+
 static int in_elasticsearch_bulk_init(struct flb_input_instance *ins,
                                       struct flb_config *config, void *data)
 {
     unsigned short int  port;
     int                 ret;
+    int                 workers;
     struct flb_in_elasticsearch    *ctx;
     unsigned char rand[16];
 
@@ -136,6 +233,9 @@ static int in_elasticsearch_bulk_init(struct flb_input_instance *ins,
 
     bytes_to_nodename(rand, ctx->node_name, 12);
 
+    /* the port is shared when extra workers are requested */
+    workers = flb_input_net_workers_count(ins);
+
     if (ctx->enable_http2) {
         ret = flb_http_server_init(&ctx->http_server, 
                                     HTTP_PROTOCOL_AUTODETECT,
@@ -212,6 +312,28 @@ static int in_elasticsearch_bulk_init(struct flb_input_instance *ins,
         ctx->collector_id = ret;        
     }
 
+    /* the input thread accepts too, it's the first worker */
+    if (workers > 1) {
+        ctx->workers = flb_input_net_workers_create(ins, ctx->listen, port,
+                                                    workers - 1,
+                                                    in_elasticsearch_worker_init,
+                                                    ctx->enable_http2 ?
+                                                        NULL : in_elasticsearch_worker_accept,
+                                                    in_elasticsearch_worker_exit,
+                                                    ctx, config);
+        if (!ctx->workers) {
+            in_elasticsearch_config_destroy(ctx);
+            return -1;
+        }
+
+        ret = flb_input_net_workers_start(ctx->workers);
+        if (ret == -1) {
+            flb_plg_error(ctx->ins, "could not start network workers");
+            in_elasticsearch_config_destroy(ctx);
+            return -1;
+        }
+    }
+
     return 0;
 }
 
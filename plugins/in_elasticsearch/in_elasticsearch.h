@@ -25,6 +25,7 @@
 #include <fluent-bit/flb_input.h>
 #include <fluent-bit/flb_utils.h>
 #include <fluent-bit/flb_log_event_encoder.h>
+#include <fluent-bit/flb_input_net_worker.h>
 
 #include <monkey/monkey.h>
 #include <fluent-bit/http_server/flb_http_server.h>
@@ -60,6 +61,8 @@ struct flb_in_elasticsearch {
     struct mk_list connections;        /* linked list of connections */
 
     struct mk_server *server;
+
+    struct flb_input_net_workers *workers;  /* net.accept_workers */
 };
 
 
@@ -73,6 +73,11 @@ struct flb_in_elasticsearch *in_elasticsearch_config_create(struct flb_input_ins
 
 int in_elasticsearch_config_destroy(struct flb_in_elasticsearch *ctx)
 {
+    if (ctx->workers) {
+        flb_input_net_workers_destroy(ctx->workers);
+        ctx->workers = NULL;
+    }
+
     flb_log_event_encoder_destroy(ctx->log_encoder);
 
     /* release all connections */
@@ -247,12 +247,100 @@ static int setup_users(struct flb_in_fw_config *ctx,
     return 0;
 }
 
+/*
+ * Network workers: every worker serves its connections with a copy of the
+ * context owning its encoder, decoder, users and list of connections.
+ */
+static int in_fw_worker_init(struct flb_input_net_worker *worker)
+{
+    int ret;
+    struct flb_in_fw_config *ctx;
+    struct flb_in_fw_config *worker_ctx;
+
+    ctx = worker->parent->context;
+
+    worker_ctx = flb_malloc(sizeof(struct flb_in_fw_config));
+    if (!worker_ctx) {
+        flb_errno();
+        return -1;
+    }
+    memcpy(worker_ctx, ctx, sizeof(struct flb_in_fw_config));
+
+    worker_ctx->coll_fd = -1;
+    worker_ctx->downstream = worker->downstream;
+    worker_ctx->workers = NULL;
+    mk_list_init(&worker_ctx->connections);
+    mk_list_init(&worker_ctx->users);
+
+    worker_ctx->log_encoder = flb_log_event_encoder_create(FLB_LOG_EVENT_FORMAT_DEFAULT);
+    worker_ctx->log_decoder = flb_log_event_decoder_create(NULL, 0);
+    if (!worker_ctx->log_encoder || !worker_ctx->log_decoder) {
+        flb_plg_error(ctx->ins, "could not initialize event encoder/decoder");
+        if (worker_ctx->log_encoder) {
+            flb_log_event_encoder_destroy(worker_ctx->log_encoder);
+        }
+        if (worker_ctx->log_decoder) {
+            flb_log_event_decoder_destroy(worker_ctx->log_decoder);
+        }
+        flb_free(worker_ctx);
+        return -1;
+    }
+
+    ret = setup_users(worker_ctx, ctx->ins);
+    if (ret == -1) {
+        delete_users(worker_ctx);
+        flb_log_event_encoder_destroy(worker_ctx->log_encoder);
+        flb_log_event_decoder_destroy(worker_ctx->log_decoder);
+        flb_free(worker_ctx);
+        return -1;
+    }
+
+    worker->data = worker_ctx;
+    return 0;
+}
+
+static int in_fw_worker_accept(struct flb_input_net_worker *worker,
+                               struct flb_connection *connection)
+{
+    struct fw_conn *conn;
+    struct flb_in_fw_config *ctx = worker->parent->context;
+
+    if (!ctx->ins->config->is_ingestion_active || ctx->is_paused) {
+        return -1;
+    }
+
+    conn = fw_conn_add(connection, worker->data);
+    if (!conn) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* backpressure: the worker closes its connections like the input thread */
+static void in_fw_worker_pause(struct flb_input_net_worker *worker)
+{
+    fw_conn_del_all(worker->data);
+}
+
+static void in_fw_worker_exit(struct flb_input_net_worker *worker)
+{
+    struct flb_in_fw_config *worker_ctx = worker->data;
+
+    fw_conn_del_all(worker_ctx);
+    delete_users(worker_ctx);
+    flb_log_event_encoder_destroy(worker_ctx->log_encoder);
+    flb_log_event_decoder_destroy(worker_ctx->log_decoder);
+    flb_free(worker_ctx);
+}
+
 /* Initialize plugin */
 static int in_fw_init(struct flb_input_instance *ins,
                       struct flb_config *config, void *data)
 {
-    unsigned short int       port;
+    unsigned short int       port = 0;
     int                      ret;
+    int                      workers = 1;
     struct flb_in_fw_config *ctx;
 
     (void) data;
@@ -295,6 +383,9 @@ static int in_fw_init(struct flb_input_instance *ins,
     else {
         port = (unsigned short int) strtoul(ctx->tcp_port, NULL, 10);
 
+        /* the port is shared when extra workers are requested */
+        workers = flb_input_net_workers_count(ins);
+
         ctx->downstream = flb_downstream_create(FLB_TRANSPORT_TCP,
                                                 ctx->ins->flags,
                                                 ctx->listen,
@@ -351,6 +442,31 @@ static int in_fw_init(struct flb_input_instance *ins,
 
     ctx->coll_fd = ret;
 
+    /* the input thread accepts too, it's the first worker */
+    if (workers > 1) {
+        ctx->workers = flb_input_net_workers_create(ins, ctx->listen, port,
+                                                    workers - 1,
+                                                    in_fw_worker_init,
+                                                    in_fw_worker_accept,
+                                                    in_fw_worker_exit,
+                                                    ctx, config);
+        if (!ctx->workers) {
+            delete_users(ctx);
+            fw_config_destroy(ctx);
+            return -1;
+        }
+
+        flb_input_net_workers_pause_cb_set(ctx->workers, in_fw_worker_pause);
+
+        ret = flb_input_net_workers_start(ctx->workers);
+        if (ret == -1) {
+            flb_plg_error(ctx->ins, "could not start network workers");
+            delete_users(ctx);
+            fw_config_destroy(ctx);
+            return -1;
+        }
+    }
+
     return 0;
 }
 
@@ -365,6 +481,9 @@ static void in_fw_pause(void *data, struct flb_config *config)
          * and wait for the ingestion to resume.
          */
         flb_input_collector_pause(ctx->coll_fd, ctx->ins);
+        if (ctx->workers) {
+            flb_input_net_workers_pause(ctx->workers);
+        }
         fw_conn_del_all(ctx);
         ctx->is_paused = FLB_TRUE;
     }
@@ -387,6 +506,9 @@ static void in_fw_resume(void *data, struct flb_config *config) {
     if (config->is_running == FLB_TRUE) {
         ctx->is_paused = FLB_FALSE;
         flb_input_collector_resume(ctx->coll_fd, ctx->ins);
+        if (ctx->workers) {
+            flb_input_net_workers_resume(ctx->workers);
+        }
     }
 }
 
@@ -400,6 +522,11 @@ static int in_fw_exit(void *data, struct flb_config *config)
         return 0;
     }
 
+    if (ctx->workers) {
+        flb_input_net_workers_destroy(ctx->workers);
+        ctx->workers = NULL;
+    }
+
     delete_users(ctx);
     fw_conn_del_all(ctx);
     fw_config_destroy(ctx);
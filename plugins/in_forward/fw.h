@@ -24,6 +24,7 @@
 #include <fluent-bit/flb_input.h>
 #include <fluent-bit/flb_log_event_decoder.h>
 #include <fluent-bit/flb_log_event_encoder.h>
+#include <fluent-bit/flb_input_net_worker.h>
 
 enum {
     FW_HANDSHAKE_HELO        = 1,
@@ -74,6 +75,9 @@ struct flb_in_fw_config {
 
     /* Plugin is paused */
     int is_paused;
+
+    /* Extra accept threads (net.accept_workers) */
+    struct flb_input_net_workers *workers;
 };
 
 #endif
@@ -105,8 +105,14 @@ int fw_conn_event(void *data)
                           bytes, conn->buf_len, conn->buf_len + bytes);
             conn->buf_len += bytes;
 
+            /*
+             * appending records may pause the input, which drops the
+             * connections: this one is only released once processed.
+             */
+            conn->busy = FLB_TRUE;
             ret = fw_prot_process(ctx->ins, conn);
-            if (ret == -1) {
+            conn->busy = FLB_FALSE;
+            if (ret == -1 || conn->close) {
                 fw_conn_del(conn);
                 return -1;
             }
@@ -175,6 +181,10 @@ struct fw_conn *fw_conn_add(struct flb_connection *connection, struct flb_in_fw_
     conn->buf_len = 0;
     conn->rest    = 0;
     conn->status  = FW_NEW;
+    conn->busy    = FLB_FALSE;
+    conn->close   = FLB_FALSE;
+    conn->gz_buf  = NULL;
+    conn->gz_buf_size = 0;
 
     /* Allocate read buffer */
     conn->buf = flb_malloc(ctx->buffer_chunk_size);
@@ -226,6 +236,9 @@ int fw_conn_del(struct fw_conn *conn)
         }
         flb_free(conn->helo);
     }
+    if (conn->gz_buf != NULL) {
+        flb_free(conn->gz_buf);
+    }
     flb_free(conn->buf);
     flb_free(conn);
 
@@ -240,6 +253,10 @@ int fw_conn_del_all(struct flb_in_fw_config *ctx)
 
     mk_list_foreach_safe(head, tmp, &ctx->connections) {
         conn = mk_list_entry(head, struct fw_conn, _head);
+        if (conn->busy) {
+            conn->close = FLB_TRUE;
+            continue;
+        }
         fw_conn_del(conn);
     }
 
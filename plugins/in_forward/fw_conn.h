@@ -41,6 +41,8 @@ struct flb_in_fw_helo;
 struct fw_conn {
     int status;                      /* Connection status                 */
     int handshake_status;            /* handshake status                 */
+    int busy;                        /* processing a read                 */
+    int close;                       /* delete it once the read is done   */
 
     /* Buffer */
     char *buf;                       /* Buffer data                       */
@@ -48,6 +50,10 @@ struct fw_conn {
     int  buf_size;                   /* Buffer size                       */
     size_t rest;                     /* Unpacking offset                  */
 
+    /* Decompressed PackedForward payloads */
+    char *gz_buf;
+    size_t gz_buf_size;
+
     struct flb_in_fw_helo *helo;     /* secure forward HELO phase */
 
     struct flb_input_instance *in;   /* Parent plugin instance            */
@@ -46,6 +46,23 @@
 /* Try parsing rounds up-to 32 bytes */
 #define EACH_RECV_SIZE 32
 
+/* Forward mode scanner results */
+#define FW_SCAN_OK          0
+#define FW_SCAN_INCOMPLETE  1   /* the message is not complete yet     */
+#define FW_SCAN_FALLBACK    2   /* not handled, use the unpacker       */
+
+/* Forward mode message, every pointer references the connection buffer */
+struct fw_scan {
+    const char *tag;
+    size_t tag_len;
+    const char *entries;        /* first entry                          */
+    size_t entries_len;
+    size_t entries_count;
+    const char *options;        /* NULL if not set                      */
+    size_t options_len;
+    size_t size;                /* size of the whole message            */
+};
+
 static int get_chunk_event_type(struct flb_input_instance *ins, msgpack_object options)
 {
     int i;
@@ -884,23 +901,13 @@ static size_t get_options_metadata(msgpack_object *arr, int expected, size_t *id
     return 0;
 }
 
-static size_t get_options_chunk(msgpack_object *arr, int expected, size_t *idx)
+/* Find the 'chunk' entry of the options map, it's used to send the ACK */
+static int get_options_chunk_index(msgpack_object *options, size_t *idx)
 {
     size_t i;
-    msgpack_object *options;
     msgpack_object k;
     msgpack_object v;
 
-    if (arr->type != MSGPACK_OBJECT_ARRAY) {
-        return -1;
-    }
-
-    /* Make sure the 'expected' entry position is valid for the array size */
-    if (expected >= arr->via.array.size) {
-        return 0;
-    }
-
-    options = &arr->via.array.ptr[expected];
     if (options->type == MSGPACK_OBJECT_NIL) {
         /*
          * Old Docker 18.x sends a NULL options parameter, just be friendly and
@@ -944,6 +951,397 @@ static size_t get_options_chunk(msgpack_object *arr, int expected, size_t *idx)
     return 0;
 }
 
+static size_t get_options_chunk(msgpack_object *arr, int expected, size_t *idx)
+{
+    if (arr->type != MSGPACK_OBJECT_ARRAY) {
+        return -1;
+    }
+
+    /* Make sure the 'expected' entry position is valid for the array size */
+    if (expected >= arr->via.array.size) {
+        return 0;
+    }
+
+    return get_options_chunk_index(&arr->via.array.ptr[expected], idx);
+}
+
+/*
+ * Forward mode scanner
+ * --------------------
+ * Forward mode messages, [tag, [[time, record], ...], options], carry their
+ * entries in the same layout used by the chunks, [time, record] or
+ * [[time, metadata], record]. The scanner walks the raw bytes to validate
+ * them without building an object tree, so a whole batch can be appended
+ * with a single write. Anything else goes through the unpacker.
+ */
+
+/*
+ * Read the header of the object at 'off'. 'payload' is the number of bytes
+ * after the header (the type of an extension included) and 'children' the
+ * number of nested objects (keys and values of a map).
+ */
+static int scan_header(const unsigned char *buf, size_t size, size_t *off,
+                       unsigned char *type, uint64_t *payload,
+                       uint64_t *children)
+{
+    int len_bytes = 0;
+    int len_extra = 0;
+    int is_container = FLB_FALSE;
+    int is_map = FLB_FALSE;
+    size_t o = *off;
+    uint64_t len = 0;
+    unsigned char c;
+
+    if (o >= size) {
+        return FW_SCAN_INCOMPLETE;
+    }
+
+    c = buf[o++];
+    *type = c;
+    *payload = 0;
+    *children = 0;
+
+    if (c <= 0x7f || c >= 0xe0) {
+        /* positive and negative fixint */
+    }
+    else if (c <= 0x8f) {
+        *children = (uint64_t) (c & 0x0f) * 2;
+    }
+    else if (c <= 0x9f) {
+        *children = c & 0x0f;
+    }
+    else if (c <= 0xbf) {
+        *payload = c & 0x1f;
+    }
+    else {
+        switch (c) {
+        case 0xc0:                  /* nil, false, true */
+        case 0xc2:
+        case 0xc3:
+            break;
+        case 0xc4:                  /* bin and str */
+        case 0xd9:
+            len_bytes = 1;
+            break;
+        case 0xc5:
+        case 0xda:
+            len_bytes = 2;
+            break;
+        case 0xc6:
+        case 0xdb:
+            len_bytes = 4;
+            break;
+        case 0xc7:                  /* ext */
+            len_bytes = 1;
+            len_extra = 1;
+            break;
+        case 0xc8:
+            len_bytes = 2;
+            len_extra = 1;
+            break;
+        case 0xc9:
+            len_bytes = 4;
+            len_extra = 1;
+            break;
+        case 0xcc:                  /* fixed size numbers */
+        case 0xd0:
+            *payload = 1;
+            break;
+        case 0xcd:
+        case 0xd1:
+            *payload = 2;
+            break;
+        case 0xca:
+        case 0xce:
+        case 0xd2:
+            *payload = 4;
+            break;
+        case 0xcb:
+        case 0xcf:
+        case 0xd3:
+            *payload = 8;
+            break;
+        case 0xd4:                  /* fixext, type + data */
+            *payload = 2;
+            break;
+        case 0xd5:
+            *payload = 3;
+            break;
+        case 0xd6:
+            *payload = 5;
+            break;
+        case 0xd7:
+            *payload = 9;
+            break;
+        case 0xd8:
+            *payload = 17;
+            break;
+        case 0xdc:                  /* array and map */
+            len_bytes = 2;
+            is_container = FLB_TRUE;
+            break;
+        case 0xdd:
+            len_bytes = 4;
+            is_container = FLB_TRUE;
+            break;
+        case 0xde:
+            len_bytes = 2;
+            is_container = FLB_TRUE;
+            is_map = FLB_TRUE;
+            break;
+        case 0xdf:
+            len_bytes = 4;
+            is_container = FLB_TRUE;
+            is_map = FLB_TRUE;
+            break;
+        default:                    /* 0xc1 is never used */
+            return FW_SCAN_FALLBACK;
+        }
+    }
+
+    if (len_bytes > 0) {
+        if (size - o < len_bytes) {
+            return FW_SCAN_INCOMPLETE;
+        }
+
+        if (len_bytes == 1) {
+            len = buf[o];
+        }
+        else if (len_bytes == 2) {
+            len = ((uint64_t) buf[o] << 8) | buf[o + 1];
+        }
+        else {
+            len = ((uint64_t) buf[o] << 24) | ((uint64_t) buf[o + 1] << 16) |
+                  ((uint64_t) buf[o + 2] << 8) | buf[o + 3];
+        }
+        o += len_bytes;
+
+        if (is_map) {
+            *children = len * 2;
+        }
+        else if (is_container) {
+            *children = len;
+        }
+        else {
+            *payload = len + len_extra;
+        }
+    }
+
+    *off = o;
+
+    return FW_SCAN_OK;
+}
+
+/* Skip 'count' objects, nested ones included */
+static int scan_skip(const unsigned char *buf, size_t size, size_t *off,
+                     uint64_t count)
+{
+    int ret;
+    unsigned char type;
+    uint64_t payload;
+    uint64_t children;
+
+    while (count > 0) {
+        ret = scan_header(buf, size, off, &type, &payload, &children);
+        if (ret != FW_SCAN_OK) {
+            return ret;
+        }
+
+        if (size - *off < payload) {
+            return FW_SCAN_INCOMPLETE;
+        }
+        *off += payload;
+
+        count += children;
+        count--;
+    }
+
+    return FW_SCAN_OK;
+}
+
+#define SCAN_IS_ARRAY(c) (((c) & 0xf0) == 0x90 || (c) == 0xdc || (c) == 0xdd)
+#define SCAN_IS_MAP(c)   (((c) & 0xf0) == 0x80 || (c) == 0xde || (c) == 0xdf)
+#define SCAN_IS_STR(c)   (((c) & 0xe0) == 0xa0 || ((c) >= 0xd9 && (c) <= 0xdb))
+
+/* Timestamps: positive integer, float or EventTime (fixext8 of type 0) */
+static int scan_timestamp(const unsigned char *buf, size_t size, size_t *off)
+{
+    int ret;
+    unsigned char type;
+    uint64_t payload;
+    uint64_t children;
+
+    ret = scan_header(buf, size, off, &type, &payload, &children);
+    if (ret != FW_SCAN_OK) {
+        return ret;
+    }
+
+    if (!(type <= 0x7f || (type >= 0xca && type <= 0xcf) || type == 0xd7)) {
+        return FW_SCAN_FALLBACK;
+    }
+
+    if (size - *off < payload) {
+        return FW_SCAN_INCOMPLETE;
+    }
+
+    if (type == 0xd7 && buf[*off] != 0) {
+        return FW_SCAN_FALLBACK;
+    }
+    *off += payload;
+
+    return FW_SCAN_OK;
+}
+
+/* [time, record] or [[time, metadata], record] */
+static int scan_entry(const unsigned char *buf, size_t size, size_t *off)
+{
+    int ret;
+    unsigned char type;
+    uint64_t payload;
+    uint64_t children;
+    size_t header_off;
+
+    ret = scan_header(buf, size, off, &type, &payload, &children);
+    if (ret != FW_SCAN_OK) {
+        return ret;
+    }
+
+    if (!SCAN_IS_ARRAY(type) || children != 2) {
+        return FW_SCAN_FALLBACK;
+    }
+
+    /* event header */
+    header_off = *off;
+    ret = scan_header(buf, size, &header_off, &type, &payload, &children);
+    if (ret != FW_SCAN_OK) {
+        return ret;
+    }
+
+    if (SCAN_IS_ARRAY(type)) {
+        if (children != 2) {
+            return FW_SCAN_FALLBACK;
+        }
+        *off = header_off;
+
+        ret = scan_timestamp(buf, size, off);
+        if (ret != FW_SCAN_OK) {
+            return ret;
+        }
+
+        ret = scan_header(buf, size, off, &type, &payload, &children);
+        if (ret != FW_SCAN_OK) {
+            return ret;
+        }
+
+        if (!SCAN_IS_MAP(type)) {
+            return FW_SCAN_FALLBACK;
+        }
+
+        ret = scan_skip(buf, size, off, children);
+        if (ret != FW_SCAN_OK) {
+            return ret;
+        }
+    }
+    else {
+        ret = scan_timestamp(buf, size, off);
+        if (ret != FW_SCAN_OK) {
+            return ret;
+        }
+    }
+
+    /* record */
+    ret = scan_header(buf, size, off, &type, &payload, &children);
+    if (ret != FW_SCAN_OK) {
+        return ret;
+    }
+
+    if (!SCAN_IS_MAP(type)) {
+        return FW_SCAN_FALLBACK;
+    }
+
+    return scan_skip(buf, size, off, children);
+}
+
+static int fw_scan_forward_mode(const char *data, size_t size,
+                                struct fw_scan *scan)
+{
+    int ret;
+    size_t off = 0;
+    uint64_t i;
+    uint64_t count;
+    uint64_t payload;
+    uint64_t children;
+    unsigned char type;
+    const unsigned char *buf = (const unsigned char *) data;
+
+    /* root array */
+    ret = scan_header(buf, size, &off, &type, &payload, &children);
+    if (ret != FW_SCAN_OK) {
+        return ret;
+    }
+
+    if (!SCAN_IS_ARRAY(type) || (children != 2 && children != 3)) {
+        return FW_SCAN_FALLBACK;
+    }
+    count = children;
+
+    /* tag */
+    ret = scan_header(buf, size, &off, &type, &payload, &children);
+    if (ret != FW_SCAN_OK) {
+        return ret;
+    }
+
+    if (!SCAN_IS_STR(type)) {
+        return FW_SCAN_FALLBACK;
+    }
+
+    if (size - off < payload) {
+        return FW_SCAN_INCOMPLETE;
+    }
+    scan->tag = data + off;
+    scan->tag_len = payload;
+    off += payload;
+
+    /* entries */
+    ret = scan_header(buf, size, &off, &type, &payload, &children);
+    if (ret != FW_SCAN_OK) {
+        return ret;
+    }
+
+    if (!SCAN_IS_ARRAY(type)) {
+        return FW_SCAN_FALLBACK;
+    }
+
+    scan->entries = data + off;
+    scan->entries_count = children;
+
+    for (i = 0; i < scan->entries_count; i++) {
+        ret = scan_entry(buf, size, &off);
+        if (ret != FW_SCAN_OK) {
+            return ret;
+        }
+    }
+    scan->entries_len = (data + off) - scan->entries;
+
+    /* options */
+    scan->options = NULL;
+    scan->options_len = 0;
+
+    if (count == 3) {
+        scan->options = data + off;
+
+        ret = scan_skip(buf, size, &off, 1);
+        if (ret != FW_SCAN_OK) {
+            return ret;
+        }
+        scan->options_len = (data + off) - scan->options;
+    }
+
+    scan->size = off;
+
+    return FW_SCAN_OK;
+}
+
 static int fw_process_forward_mode_entry(
                 struct fw_conn *conn,
                 const char *tag, int tag_len,
@@ -1146,6 +1544,203 @@ static int append_log(struct flb_input_instance *ins, struct fw_conn *conn,
     return 0;
 }
 
+/* Compose the tag of the records, 'out_tag' is reused between messages */
+static void fw_set_tag(struct flb_input_instance *ins,
+                       struct flb_in_fw_config *ctx,
+                       flb_sds_t *out_tag,
+                       const char *stag, int stag_len)
+{
+    /* clear out_tag before using */
+    flb_sds_len_set(*out_tag, 0);
+
+    /* Prefix the incoming record tag with a custom prefix */
+    if (ctx->tag_prefix) {
+        /* prefix */
+        flb_sds_cat_safe(out_tag,
+                         ctx->tag_prefix, flb_sds_len(ctx->tag_prefix));
+        /* record tag */
+        flb_sds_cat_safe(out_tag, stag, stag_len);
+    }
+    else if (ins->tag && !ins->tag_default) {
+        /* if the input plugin instance Tag has been manually set, use it */
+        flb_sds_cat_safe(out_tag, ins->tag, flb_sds_len(ins->tag));
+    }
+    else {
+        /* use the tag from the record */
+        flb_sds_cat_safe(out_tag, stag, stag_len);
+    }
+}
+
+/*
+ * Append the entries of a scanned forward mode message with a single write
+ * and send the ACK if it was requested. Options are unpacked (they are
+ * tiny), if they are not valid the message goes through the unpacker which
+ * reports the error.
+ */
+static int fw_process_forward_mode_scan(struct flb_input_instance *ins,
+                                        struct fw_conn *conn,
+                                        struct fw_scan *scan,
+                                        flb_sds_t *out_tag)
+{
+    int ret;
+    size_t off = 0;
+    size_t chunk_id = -1;
+    msgpack_object chunk;
+    msgpack_unpacked result;
+
+    msgpack_unpacked_init(&result);
+
+    if (scan->options) {
+        ret = msgpack_unpack_next(&result, scan->options, scan->options_len,
+                                  &off);
+        if (ret != MSGPACK_UNPACK_SUCCESS) {
+            msgpack_unpacked_destroy(&result);
+            return FW_SCAN_FALLBACK;
+        }
+
+        ret = get_options_chunk_index(&result.data, &chunk_id);
+        if (ret == -1) {
+            msgpack_unpacked_destroy(&result);
+            return FW_SCAN_FALLBACK;
+        }
+    }
+
+    fw_set_tag(ins, conn->ctx, out_tag, scan->tag, scan->tag_len);
+
+    if (scan->entries_count > 0) {
+        flb_input_log_append_records(conn->in, scan->entries_count,
+                                     *out_tag, flb_sds_len(*out_tag),
+                                     scan->entries, scan->entries_len);
+    }
+
+    if (chunk_id != -1) {
+        chunk = result.data.via.map.ptr[chunk_id].val;
+        send_ack(conn->in, conn, chunk);
+    }
+
+    msgpack_unpacked_destroy(&result);
+
+    return FW_SCAN_OK;
+}
+
+/*
+ * Inflate the gzip members of a PackedForward payload into the buffer of the
+ * connection. Logs are appended with a single write, metrics and traces are
+ * decoded member by member.
+ */
+static int fw_process_packed_gzip(struct flb_input_instance *ins,
+                                  struct fw_conn *conn,
+                                  int event_type, flb_sds_t out_tag,
+                                  const char *data, size_t len)
+{
+    int ret = 0;
+    int single_write;
+    char *tmp;
+    size_t i;
+    size_t count;
+    size_t start;
+    size_t end;
+    size_t size;
+    size_t used;
+    size_t out_len;
+    size_t total = 0;
+    size_t largest = 0;
+    size_t *borders = NULL;
+    struct flb_in_fw_config *ctx = conn->ctx;
+
+    /* members other than the first one start at the reported borders */
+    count = flb_gzip_count(data, len, NULL, 0);
+    flb_plg_debug(ctx->ins, "concatenated gzip payload count is %zd", count);
+
+    if (count > 0) {
+        borders = flb_calloc(count + 1, sizeof(size_t));
+        if (!borders) {
+            flb_errno();
+            return -1;
+        }
+        flb_gzip_count(data, len, &borders, count);
+    }
+
+    start = 0;
+    for (i = 0; i <= count; i++) {
+        end = (count > 0) ? borders[i] : len;
+        size = flb_gzip_uncompressed_size((void *) (data + start), end - start);
+        total += size;
+        if (size > largest) {
+            largest = size;
+        }
+        start = end;
+    }
+
+    single_write = (event_type == FLB_EVENT_TYPE_LOGS &&
+                    total <= FLB_GZIP_MAX_UNCOMPRESSED_SIZE);
+
+    size = single_write ? total : largest;
+    if (size == 0) {
+        size = 1;
+    }
+
+    if (size > conn->gz_buf_size) {
+        tmp = flb_realloc(conn->gz_buf, size);
+        if (!tmp) {
+            flb_errno();
+            flb_free(borders);
+            return -1;
+        }
+        conn->gz_buf = tmp;
+        conn->gz_buf_size = size;
+    }
+
+    start = 0;
+    used = 0;
+    for (i = 0; i <= count; i++) {
+        end = (count > 0) ? borders[i] : len;
+
+        flb_plg_trace(ctx->ins,
+                      "[gzip decompression] member = %zd, len = %zd, original_len = %zd",
+                      i, end - start, len);
+
+        ret = flb_gzip_uncompress_to((void *) (data + start), end - start,
+                                     conn->gz_buf + used,
+                                     conn->gz_buf_size - used,
+                                     &out_len);
+        if (ret == -1) {
+            flb_plg_error(ctx->ins, "gzip uncompress failure");
+            break;
+        }
+
+        if (single_write) {
+            used += out_len;
+        }
+        else {
+            ret = append_log(ins, conn, event_type, out_tag,
+                             conn->gz_buf, out_len);
+            if (ret == -1) {
+                break;
+            }
+        }
+
+        start = end;
+    }
+
+    if (ret == 0 && single_write && used > 0) {
+        ret = append_log(ins, conn, event_type, out_tag, conn->gz_buf, used);
+    }
+
+    /* don't keep large buffers around */
+    if (conn->gz_buf_size > ctx->buffer_max_size) {
+        flb_free(conn->gz_buf);
+        conn->gz_buf = NULL;
+        conn->gz_buf_size = 0;
+    }
+
+    if (borders) {
+        flb_free(borders);
+    }
+
+    return ret;
+}
+
 int fw_prot_secure_forward_handshake_start(struct flb_input_instance *ins,
                                            struct flb_connection *connection,
                                            struct flb_in_fw_helo *helo)
@@ -1222,8 +1817,6 @@ int fw_prot_process(struct flb_input_instance *ins, struct fw_conn *conn)
     flb_sds_t out_tag = NULL;
     size_t bytes;
     size_t recv_len;
-    size_t gz_size;
-    void *gz_data;
     msgpack_object tag;
     msgpack_object entry;
     msgpack_object map;
@@ -1232,6 +1825,7 @@ int fw_prot_process(struct flb_input_instance *ins, struct fw_conn *conn)
     msgpack_unpacked result;
     msgpack_unpacker *unp;
     size_t all_used = 0;
+    struct fw_scan scan;
     struct flb_in_fw_config *ctx = conn->ctx;
 
     /*
@@ -1244,9 +1838,39 @@ int fw_prot_process(struct flb_input_instance *ins, struct fw_conn *conn)
         return -1;
     }
 
+    /*
+     * Forward mode messages are validated and appended in place, the
+     * unpacker takes over from the first message the scanner can't handle.
+     */
+    ret = FW_SCAN_OK;
+    while (all_used < conn->buf_len) {
+        ret = fw_scan_forward_mode(conn->buf + all_used,
+                                   conn->buf_len - all_used, &scan);
+        if (ret == FW_SCAN_OK) {
+            ret = fw_process_forward_mode_scan(ins, conn, &scan, &out_tag);
+        }
+
+        if (ret != FW_SCAN_OK) {
+            break;
+        }
+        all_used += scan.size;
+    }
+
+    if (ret == FW_SCAN_INCOMPLETE || all_used == conn->buf_len) {
+        /* wait for more data */
+        if (all_used > 0) {
+            memmove(conn->buf, conn->buf + all_used,
+                    conn->buf_len - all_used);
+            conn->buf_len -= all_used;
+        }
+        flb_sds_destroy(out_tag);
+
+        return 0;
+    }
+
     unp = msgpack_unpacker_new(1024);
     msgpack_unpacked_init(&result);
-    conn->rest = conn->buf_len;
+    conn->rest = conn->buf_len - all_used;
 
     while (1) {
         recv_len = receiver_to_unpacker(conn, EACH_RECV_SIZE, unp);
@@ -1355,25 +1979,7 @@ int fw_prot_process(struct flb_input_instance *ins, struct fw_conn *conn)
             stag     = tag.via.str.ptr;
             stag_len = tag.via.str.size;
 
-            /* clear out_tag before using */
-            flb_sds_len_set(out_tag, 0);
-
-            /* Prefix the incoming record tag with a custom prefix */
-            if (ctx->tag_prefix) {
-                /* prefix */
-                flb_sds_cat_safe(&out_tag,
-                                 ctx->tag_prefix, flb_sds_len(ctx->tag_prefix));
-                /* record tag */
-                flb_sds_cat_safe(&out_tag, stag, stag_len);
-            }
-            else if (ins->tag && !ins->tag_default) {
-                /* if the input plugin instance Tag has been manually set, use it */
-                flb_sds_cat_safe(&out_tag, ins->tag, flb_sds_len(ins->tag));
-            }
-            else {
-                /* use the tag from the record */
-                flb_sds_cat_safe(&out_tag, stag, stag_len);
-            }
+            fw_set_tag(ins, ctx, &out_tag, stag, stag_len);
 
             entry = root.via.array.ptr[1];
 
@@ -1497,57 +2103,6 @@ int fw_prot_process(struct flb_input_instance *ins, struct fw_conn *conn)
                     }
 
                     if (ret == FLB_TRUE) {
-                        size_t prev_pos = 0;
-                        size_t gzip_payloads_count = 0;
-                        size_t loop = 0;
-                        size_t *gzip_borders = NULL;
-                        const size_t original_len = len;
-
-                        gzip_payloads_count = flb_gzip_count(data, len, NULL, 0);
-                        flb_plg_debug(ctx->ins, "concatenated gzip payload count is %zd",
-                                     gzip_payloads_count);
-                        if (gzip_payloads_count > 0) {
-                            gzip_borders = (size_t *)flb_calloc(1, sizeof(size_t) * (gzip_payloads_count + 1));
-                            if (gzip_borders == NULL) {
-                                flb_errno();
-                                return -1;
-                            }
-                            if (flb_gzip_count(data, len, &gzip_borders, gzip_payloads_count) < 0) {
-                                flb_plg_error(ctx->ins,
-                                             "failed to traverse boundaries of concatenated gzip payloads");
-                                return -1;
-                            }
-                        }
-
-                    retry_uncompress:
-                        if (gzip_payloads_count > 0) {
-                            if (loop == 0) {
-                                len = gzip_borders[loop];
-                            }
-                            else if (gzip_borders[loop] == original_len) {
-                                len = original_len - gzip_borders[loop - 1];
-                            }
-                            else if (loop >= 1) {
-                                len = gzip_borders[loop] - gzip_borders[loop - 1];
-                            }
-                        }
-                        flb_plg_trace(ctx->ins,
-                                      "[gzip decompression] loop = %zd, len = %zd, original_len = %zd",
-                                      loop, len, original_len);
-
-                        ret = flb_gzip_uncompress((void *) (data + prev_pos), len,
-                                                  &gz_data, &gz_size);
-                        if (ret == -1) {
-                            flb_plg_error(ctx->ins, "gzip uncompress failure");
-                            msgpack_unpacked_destroy(&result);
-                            msgpack_unpacker_free(unp);
-                            flb_sds_destroy(out_tag);
-                            if (gzip_borders != NULL) {
-                                flb_free(gzip_borders);
-                            }
-                            return -1;
-                        }
-
                         event_type = FLB_EVENT_TYPE_LOGS;
                         if (contain_options) {
                             ret = get_chunk_event_type(ins, root.via.array.ptr[2]);
@@ -1555,51 +2110,19 @@ int fw_prot_process(struct flb_input_instance *ins, struct fw_conn *conn)
                                 msgpack_unpacked_destroy(&result);
                                 msgpack_unpacker_free(unp);
                                 flb_sds_destroy(out_tag);
-                                flb_free(gz_data);
-                                if (gzip_borders != NULL) {
-                                    flb_free(gzip_borders);
-                                }
                                 return -1;
                             }
                             event_type = ret;
                         }
 
-                        ret = append_log(ins, conn,
-                                         event_type,
-                                         out_tag, gz_data, gz_size);
+                        ret = fw_process_packed_gzip(ins, conn, event_type,
+                                                     out_tag, data, len);
                         if (ret == -1) {
                             msgpack_unpacked_destroy(&result);
                             msgpack_unpacker_free(unp);
                             flb_sds_destroy(out_tag);
-                            flb_free(gz_data);
-                            if (gzip_borders != NULL) {
-                                flb_free(gzip_borders);
-                            }
-
                             return -1;
                         }
-                        flb_free(gz_data);
-
-                        /* a valid payload of gzip is larger than 18 bytes. */
-                        if (gzip_payloads_count > 0) {
-                            if ((gzip_payloads_count - loop) > 0 &&
-                                (original_len - gzip_borders[loop]) >= 18) {
-                                len = original_len - gzip_borders[loop];
-                                flb_plg_debug(ctx->ins, "left unconsumed %zd byte(s)", len);
-                                prev_pos = gzip_borders[loop];
-                                loop++;
-                                goto retry_uncompress;
-                            }
-                            else {
-                                flb_plg_debug(ctx->ins, "left unconsumed %zd byte(s)",
-                                              original_len - gzip_borders[loop]);
-                            }
-                            if (loop == gzip_payloads_count) {
-                                if (gzip_borders != NULL) {
-                                    flb_free(gzip_borders);
-                                }
-                            }
-                        }
                     }
                     else {
                         event_type = FLB_EVENT_TYPE_LOGS;
@@ -1640,7 +2163,7 @@ int fw_prot_process(struct flb_input_instance *ins, struct fw_conn *conn)
                 return -1;
             }
 
-            ret = msgpack_unpacker_next(unp, &result);
+            ret = msgpack_unpacker_next_with_size(unp, &result, &bytes);
         }
     }
 
@@ -25,6 +25,7 @@
 #include <fluent-bit/flb_input.h>
 #include <fluent-bit/flb_utils.h>
 #include <fluent-bit/flb_log_event_encoder.h>
+#include <fluent-bit/flb_input_net_worker.h>
 
 #include <monkey/monkey.h>
 #include <fluent-bit/http_server/flb_http_server.h>
@@ -61,6 +62,9 @@ struct flb_http {
     struct mk_server *server;
 
     int collector_id;
+
+    /* Extra accept threads (net.accept_workers) */
+    struct flb_input_net_workers *workers;
 };
 
 
@@ -126,6 +126,11 @@ struct flb_http *http_config_create(struct flb_input_instance *ins)
 
 int http_config_destroy(struct flb_http *ctx)
 {
+    if (ctx->workers != NULL) {
+        flb_input_net_workers_destroy(ctx->workers);
+        ctx->workers = NULL;
+    }
+
     /* release all connections */
     http_conn_release_all(ctx);
 
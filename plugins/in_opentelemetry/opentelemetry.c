@@ -61,11 +61,100 @@ static int in_opentelemetry_collect(struct flb_input_instance *ins,
     return 0;
 }
 
+/*
+ * Network workers: every worker serves its connections with a copy of the
+ * context owning its list of connections and HTTP server.
+ */
+static int in_opentelemetry_worker_init(struct flb_input_net_worker *worker)
+{
+    int                        ret;
+    struct flb_opentelemetry  *ctx;
+    struct flb_opentelemetry  *worker_ctx;
+    struct flb_input_instance *ins;
+
+    ctx = worker->parent->context;
+    ins = ctx->ins;
+
+    worker_ctx = flb_malloc(sizeof(struct flb_opentelemetry));
+    if (!worker_ctx) {
+        flb_errno();
+        return -1;
+    }
+    memcpy(worker_ctx, ctx, sizeof(struct flb_opentelemetry));
+
+    worker_ctx->collector_id = -1;
+    worker_ctx->downstream = worker->downstream;
+    worker_ctx->workers = NULL;
+    mk_list_init(&worker_ctx->connections);
+
+    if (ctx->enable_http2) {
+        ret = flb_http_server_init(&worker_ctx->http_server,
+                                   HTTP_PROTOCOL_AUTODETECT,
+                                   (FLB_HTTP_SERVER_FLAG_KEEPALIVE | FLB_HTTP_SERVER_FLAG_AUTO_INFLATE),
+                                   NULL,
+                                   ins->host.listen,
+                                   ins->host.port,
+                                   ins->tls,
+                                   ins->flags,
+                                   &ins->net_setup,
+                                   worker->evl,
+                                   ins->config,
+                                   (void *) worker_ctx);
+        if (ret == 0) {
+            ret = flb_http_server_start(&worker_ctx->http_server);
+        }
+
+        if (ret != 0) {
+            flb_plg_error(ins, "could not start http server for worker #%i",
+                          worker->id);
+            flb_http_server_destroy(&worker_ctx->http_server);
+            flb_free(worker_ctx);
+            return -1;
+        }
+
+        worker_ctx->http_server.request_callback = opentelemetry_prot_handle_ng;
+
+        flb_input_net_worker_downstream_set(worker,
+                                            worker_ctx->http_server.downstream);
+    }
+
+    worker->data = worker_ctx;
+    return 0;
+}
+
+static int in_opentelemetry_worker_accept(struct flb_input_net_worker *worker,
+                                          struct flb_connection *connection)
+{
+    struct http_conn *conn;
+
+    conn = opentelemetry_conn_add(connection, worker->data);
+    if (conn == NULL) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static void in_opentelemetry_worker_exit(struct flb_input_net_worker *worker)
+{
+    struct flb_opentelemetry *worker_ctx = worker->data;
+
+    opentelemetry_conn_release_all(worker_ctx);
+
+    if (worker_ctx->enable_http2) {
+        flb_http_server_destroy(&worker_ctx->http_server);
+    }
+
+    /* 'server' and the configuration strings belong to the plugin context */
+    flb_free(worker_ctx);
+}
+
 static int in_opentelemetry_init(struct flb_input_instance *ins,
                                  struct flb_config *config, void *data)
 {
     unsigned short int        port;
     int                       ret;
+    int                       workers;
     struct flb_opentelemetry *ctx;
 
     (void) data;
@@ -90,6 +179,9 @@ static int in_opentelemetry_init(struct flb_input_instance *ins,
 
     port = (unsigned short int) strtoul(ctx->tcp_port, NULL, 10);
 
+    /* the port is shared when extra workers are requested */
+    workers = flb_input_net_workers_count(ins);
+
     if (ctx->enable_http2) {
         ret = flb_http_server_init(&ctx->http_server,
                                     HTTP_PROTOCOL_AUTODETECT,
@@ -165,6 +257,21 @@ static int in_opentelemetry_init(struct flb_input_instance *ins,
         ctx->collector_id = ret;
     }
 
+    /* the input thread accepts too, it's the first worker */
+    if (workers > 1) {
+        ctx->workers = flb_input_net_workers_create(ins, ctx->listen, port,
+                                                    workers - 1,
+                                                    in_opentelemetry_worker_init,
+                                                    ctx->enable_http2 ?
+                                                        NULL : in_opentelemetry_worker_accept,
+                                                    in_opentelemetry_worker_exit,
+                                                    ctx, config);
+        if (!ctx->workers) {
+            opentelemetry_config_destroy(ctx);
+            return -1;
+        }
+    }
+
     flb_plg_info(ctx->ins, "listening on %s:%s", ctx->listen, ctx->tcp_port);
 
     if (ctx->successful_response_code != 200 &&
@@ -175,6 +282,15 @@ static int in_opentelemetry_init(struct flb_input_instance *ins,
         ctx->successful_response_code = 201;
     }
 
+    if (ctx->workers) {
+        ret = flb_input_net_workers_start(ctx->workers);
+        if (ret == -1) {
+            flb_plg_error(ctx->ins, "could not start network workers");
+            opentelemetry_config_destroy(ctx);
+            return -1;
+        }
+    }
+
     return 0;
 }
 
@@ -238,6 +354,12 @@ static struct flb_config_map config_map[] = {
      FLB_CONFIG_MAP_STR, "logs_metadata_key", "otlp",
      0, FLB_TRUE, offsetof(struct flb_opentelemetry, logs_metadata_key),
     },
+    {
+     FLB_CONFIG_MAP_BOOL, "logs_stream_decoder", "true",
+     0, FLB_TRUE, offsetof(struct flb_opentelemetry, logs_stream_decoder),
+     "Decode OTLP/protobuf logs straight from the wire format instead of "
+     "unpacking them with protobuf-c first"
+    },
 
     /* EOF */
     {0}
@@ -23,6 +23,7 @@
 #include <fluent-bit/flb_config.h>
 #include <fluent-bit/flb_input.h>
 #include <fluent-bit/flb_utils.h>
+#include <fluent-bit/flb_input_net_worker.h>
 
 #include <monkey/monkey.h>
 #include <fluent-bit/http_server/flb_http_server.h>
@@ -38,6 +39,7 @@ struct flb_opentelemetry {
     int raw_traces;
     int  tag_from_uri;
     flb_sds_t logs_metadata_key;
+    int logs_stream_decoder;           /* decode logs from the wire format */
 
     struct flb_input_instance *ins;
 
@@ -54,6 +56,8 @@ struct flb_opentelemetry {
     struct mk_list connections;        /* linked list of connections */
 
     struct mk_server *server;
+
+    struct flb_input_net_workers *workers;  /* net.accept_workers */
 };
 
 
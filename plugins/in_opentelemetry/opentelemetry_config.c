@@ -67,6 +67,11 @@ struct flb_opentelemetry *opentelemetry_config_create(struct flb_input_instance
 
 int opentelemetry_config_destroy(struct flb_opentelemetry *ctx)
 {
+    if (ctx->workers) {
+        flb_input_net_workers_destroy(ctx->workers);
+        ctx->workers = NULL;
+    }
+
     /* release all connections */
     opentelemetry_conn_release_all(ctx);
 
@@ -0,0 +1,991 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2024 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/*
+ * Streaming decoder for OTLP/protobuf logs.
+ *
+ * Instead of unpacking the whole ExportLogsServiceRequest into protobuf-c
+ * objects, the payload is walked in place: every message is a slice of the
+ * input buffer, strings and bytes are copied once from the wire into
+ * msgpack and records are packed directly into the log event encoder
+ * metadata and body buffers.
+ *
+ * Field numbers come from opentelemetry/proto/{logs,common,resource}/v1.
+ */
+
+#include <fluent-bit/flb_input_plugin.h>
+#include <fluent-bit/flb_time.h>
+#include <fluent-bit/flb_mp.h>
+#include <fluent-bit/flb_log_event_encoder.h>
+
+#include "opentelemetry.h"
+#include "opentelemetry_logs.h"
+
+/* wire types */
+#define OTLP_WIRE_VARINT                  0
+#define OTLP_WIRE_FIXED64                 1
+#define OTLP_WIRE_LEN                     2
+#define OTLP_WIRE_FIXED32                 5
+
+/* ExportLogsServiceRequest */
+#define OTLP_REQUEST_RESOURCE_LOGS        1
+
+/* ResourceLogs */
+#define OTLP_RESOURCE_LOGS_RESOURCE       1
+#define OTLP_RESOURCE_LOGS_SCOPE_LOGS     2
+#define OTLP_RESOURCE_LOGS_SCHEMA_URL     3
+
+/* Resource */
+#define OTLP_RESOURCE_ATTRIBUTES          1
+#define OTLP_RESOURCE_DROPPED             2
+
+/* ScopeLogs */
+#define OTLP_SCOPE_LOGS_SCOPE             1
+#define OTLP_SCOPE_LOGS_LOG_RECORDS       2
+
+/* InstrumentationScope */
+#define OTLP_SCOPE_NAME                   1
+#define OTLP_SCOPE_VERSION                2
+#define OTLP_SCOPE_ATTRIBUTES             3
+#define OTLP_SCOPE_DROPPED                4
+
+/* LogRecord */
+#define OTLP_LOG_TIME_UNIX_NANO           1
+#define OTLP_LOG_SEVERITY_NUMBER          2
+#define OTLP_LOG_SEVERITY_TEXT            3
+#define OTLP_LOG_BODY                     5
+#define OTLP_LOG_ATTRIBUTES               6
+#define OTLP_LOG_FLAGS                    8
+#define OTLP_LOG_TRACE_ID                 9
+#define OTLP_LOG_SPAN_ID                  10
+#define OTLP_LOG_OBSERVED_TIME_UNIX_NANO  11
+
+/* KeyValue */
+#define OTLP_KEY_VALUE_KEY                1
+#define OTLP_KEY_VALUE_VALUE              2
+
+/* ArrayValue and KeyValueList */
+#define OTLP_LIST_VALUES                  1
+
+/* AnyValue, a oneof: the last value on the wire wins, none means null */
+#define OTLP_ANY_NONE                     0
+#define OTLP_ANY_STRING                   1
+#define OTLP_ANY_BOOL                     2
+#define OTLP_ANY_INT                      3
+#define OTLP_ANY_DOUBLE                   4
+#define OTLP_ANY_ARRAY                    5
+#define OTLP_ANY_KVLIST                   6
+#define OTLP_ANY_BYTES                    7
+
+/* nested AnyValues deeper than this are rejected */
+#define OTLP_MAX_DEPTH                    64
+
+struct otlp_wire {
+    const uint8_t *p;
+    const uint8_t *end;
+};
+
+/* One decoded field, length delimited payloads point into the input */
+struct otlp_field {
+    uint32_t number;
+    int type;
+    uint64_t value;
+    const uint8_t *data;
+    size_t len;
+};
+
+struct otlp_slice {
+    const uint8_t *data;
+    size_t len;
+};
+
+struct otlp_scope {
+    int present;
+    struct otlp_slice msg;
+    struct otlp_slice name;
+    struct otlp_slice version;
+    size_t attributes;
+    uint32_t dropped;
+};
+
+struct otlp_resource {
+    struct otlp_slice msg;
+    size_t attributes;
+    uint32_t dropped;
+    struct otlp_slice schema_url;
+};
+
+struct otlp_log_record {
+    struct otlp_slice msg;
+    uint64_t time_unix_nano;
+    uint64_t observed_time_unix_nano;
+    int32_t severity_number;
+    struct otlp_slice severity_text;
+    int has_body;
+    struct otlp_slice body;
+    size_t attributes;
+    uint32_t flags;
+    struct otlp_slice trace_id;
+    struct otlp_slice span_id;
+};
+
+static int pack_any_value(msgpack_packer *mp_pck,
+                          const uint8_t *data, size_t len, int depth);
+
+static inline void wire_init(struct otlp_wire *w, const uint8_t *data, size_t len)
+{
+    w->p = data;
+    w->end = data + len;
+}
+
+static inline int wire_varint(struct otlp_wire *w, uint64_t *out)
+{
+    int shift;
+    uint8_t byte;
+    uint64_t value = 0;
+
+    for (shift = 0; shift < 64 && w->p < w->end; shift += 7) {
+        byte = *w->p++;
+        value |= ((uint64_t) (byte & 0x7f)) << shift;
+        if ((byte & 0x80) == 0) {
+            *out = value;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+static inline uint64_t wire_le(const uint8_t *p, int bytes)
+{
+    int i;
+    uint64_t value = 0;
+
+    for (i = bytes - 1; i >= 0; i--) {
+        value = (value << 8) | p[i];
+    }
+
+    return value;
+}
+
+/* Returns 1 when a field was read, 0 at the end of the message, -1 on error */
+static inline int wire_next(struct otlp_wire *w, struct otlp_field *f)
+{
+    uint64_t tag;
+    uint64_t len;
+
+    if (w->p >= w->end) {
+        return 0;
+    }
+
+    if (wire_varint(w, &tag) != 0) {
+        return -1;
+    }
+
+    f->number = (uint32_t) (tag >> 3);
+    f->type = tag & 0x07;
+
+    if (f->number == 0 || (tag >> 3) > 0x1fffffff) {
+        return -1;
+    }
+
+    switch (f->type) {
+    case OTLP_WIRE_VARINT:
+        if (wire_varint(w, &f->value) != 0) {
+            return -1;
+        }
+        break;
+    case OTLP_WIRE_FIXED64:
+        if (w->end - w->p < 8) {
+            return -1;
+        }
+        f->value = wire_le(w->p, 8);
+        w->p += 8;
+        break;
+    case OTLP_WIRE_FIXED32:
+        if (w->end - w->p < 4) {
+            return -1;
+        }
+        f->value = wire_le(w->p, 4);
+        w->p += 4;
+        break;
+    case OTLP_WIRE_LEN:
+        if (wire_varint(w, &len) != 0 || len > (uint64_t) (w->end - w->p)) {
+            return -1;
+        }
+        f->data = w->p;
+        f->len = len;
+        w->p += len;
+        break;
+    default:
+        /* groups are not used by OTLP */
+        return -1;
+    }
+
+    return 1;
+}
+
+static inline void slice_set(struct otlp_slice *s, struct otlp_field *f)
+{
+    s->data = f->data;
+    s->len = f->len;
+}
+
+/* Number of 'number' entries of a repeated message field, -1 if malformed */
+static int wire_count(const uint8_t *data, size_t len, uint32_t number)
+{
+    int ret;
+    int count = 0;
+    struct otlp_wire w;
+    struct otlp_field f;
+
+    wire_init(&w, data, len);
+    while ((ret = wire_next(&w, &f)) == 1) {
+        if (f.number != number) {
+            continue;
+        }
+        if (f.type != OTLP_WIRE_LEN) {
+            return -1;
+        }
+        count++;
+    }
+
+    if (ret == -1) {
+        return -1;
+    }
+
+    return count;
+}
+
+static int pack_key_value(msgpack_packer *mp_pck,
+                          const uint8_t *data, size_t len, int depth)
+{
+    int ret;
+    int has_value = FLB_FALSE;
+    struct otlp_wire w;
+    struct otlp_field f;
+    struct otlp_slice key = {0};
+    struct otlp_slice value = {0};
+
+    wire_init(&w, data, len);
+    while ((ret = wire_next(&w, &f)) == 1) {
+        if (f.number == OTLP_KEY_VALUE_KEY || f.number == OTLP_KEY_VALUE_VALUE) {
+            if (f.type != OTLP_WIRE_LEN) {
+                return -1;
+            }
+            if (f.number == OTLP_KEY_VALUE_KEY) {
+                slice_set(&key, &f);
+            }
+            else {
+                slice_set(&value, &f);
+                has_value = FLB_TRUE;
+            }
+        }
+    }
+
+    if (ret == -1) {
+        return -1;
+    }
+
+    msgpack_pack_str_with_body(mp_pck, key.data, key.len);
+
+    /* a key without value is null */
+    if (!has_value) {
+        return msgpack_pack_nil(mp_pck);
+    }
+
+    return pack_any_value(mp_pck, value.data, value.len, depth);
+}
+
+/* Pack the 'count' KeyValue entries stored as field 'number' of a message */
+static int pack_key_values(msgpack_packer *mp_pck,
+                           const uint8_t *data, size_t len,
+                           uint32_t number, size_t count, int depth)
+{
+    int ret;
+    struct otlp_wire w;
+    struct otlp_field f;
+
+    msgpack_pack_map(mp_pck, count);
+
+    wire_init(&w, data, len);
+    while ((ret = wire_next(&w, &f)) == 1) {
+        if (f.number != number) {
+            continue;
+        }
+        ret = pack_key_value(mp_pck, f.data, f.len, depth);
+        if (ret != 0) {
+            return -1;
+        }
+    }
+
+    return ret;
+}
+
+static int pack_array(msgpack_packer *mp_pck,
+                      const uint8_t *data, size_t len, int depth)
+{
+    int ret;
+    int count;
+    struct otlp_wire w;
+    struct otlp_field f;
+
+    count = wire_count(data, len, OTLP_LIST_VALUES);
+    if (count == -1) {
+        return -1;
+    }
+
+    msgpack_pack_array(mp_pck, count);
+
+    wire_init(&w, data, len);
+    while ((ret = wire_next(&w, &f)) == 1) {
+        if (f.number != OTLP_LIST_VALUES) {
+            continue;
+        }
+        ret = pack_any_value(mp_pck, f.data, f.len, depth);
+        if (ret != 0) {
+            return -1;
+        }
+    }
+
+    return ret;
+}
+
+static int pack_kvlist(msgpack_packer *mp_pck,
+                       const uint8_t *data, size_t len, int depth)
+{
+    int count;
+
+    count = wire_count(data, len, OTLP_LIST_VALUES);
+    if (count == -1) {
+        return -1;
+    }
+
+    return pack_key_values(mp_pck, data, len, OTLP_LIST_VALUES, count, depth);
+}
+
+/* Find the value set in an AnyValue, OTLP_ANY_NONE if it has none */
+static int any_value_get(const uint8_t *data, size_t len, struct otlp_field *value)
+{
+    int ret;
+    struct otlp_wire w;
+    struct otlp_field f;
+    static const int types[] = {
+        -1,
+        OTLP_WIRE_LEN,      /* string_value */
+        OTLP_WIRE_VARINT,   /* bool_value   */
+        OTLP_WIRE_VARINT,   /* int_value    */
+        OTLP_WIRE_FIXED64,  /* double_value */
+        OTLP_WIRE_LEN,      /* array_value  */
+        OTLP_WIRE_LEN,      /* kvlist_value */
+        OTLP_WIRE_LEN       /* bytes_value  */
+    };
+
+    value->number = OTLP_ANY_NONE;
+
+    wire_init(&w, data, len);
+    while ((ret = wire_next(&w, &f)) == 1) {
+        if (f.number < OTLP_ANY_STRING || f.number > OTLP_ANY_BYTES) {
+            continue;
+        }
+        if (f.type != types[f.number]) {
+            return -1;
+        }
+        *value = f;
+    }
+
+    return ret;
+}
+
+static int pack_value(msgpack_packer *mp_pck, struct otlp_field *value, int depth)
+{
+    double d;
+
+    switch (value->number) {
+    case OTLP_ANY_NONE:
+        return msgpack_pack_nil(mp_pck);
+    case OTLP_ANY_STRING:
+        /* wire bytes go straight into the msgpack string */
+        return msgpack_pack_str_with_body(mp_pck, value->data, value->len);
+    case OTLP_ANY_BOOL:
+        if (value->value) {
+            return msgpack_pack_true(mp_pck);
+        }
+        return msgpack_pack_false(mp_pck);
+    case OTLP_ANY_INT:
+        return msgpack_pack_int64(mp_pck, (int64_t) value->value);
+    case OTLP_ANY_DOUBLE:
+        memcpy(&d, &value->value, sizeof(double));
+        return msgpack_pack_double(mp_pck, d);
+    case OTLP_ANY_ARRAY:
+        return pack_array(mp_pck, value->data, value->len, depth + 1);
+    case OTLP_ANY_KVLIST:
+        return pack_kvlist(mp_pck, value->data, value->len, depth + 1);
+    case OTLP_ANY_BYTES:
+        return msgpack_pack_bin_with_body(mp_pck, value->data, value->len);
+    }
+
+    return -1;
+}
+
+static int pack_any_value(msgpack_packer *mp_pck,
+                          const uint8_t *data, size_t len, int depth)
+{
+    struct otlp_field value;
+
+    if (depth >= OTLP_MAX_DEPTH || any_value_get(data, len, &value) != 0) {
+        return -1;
+    }
+
+    return pack_value(mp_pck, &value, depth);
+}
+
+static inline void pack_key(msgpack_packer *mp_pck, const char *key, size_t len)
+{
+    msgpack_pack_str(mp_pck, len);
+    msgpack_pack_str_body(mp_pck, key, len);
+}
+
+static int resource_read(struct otlp_resource *resource)
+{
+    int ret;
+    struct otlp_wire w;
+    struct otlp_field f;
+
+    wire_init(&w, resource->msg.data, resource->msg.len);
+    while ((ret = wire_next(&w, &f)) == 1) {
+        if (f.number == OTLP_RESOURCE_ATTRIBUTES) {
+            if (f.type != OTLP_WIRE_LEN) {
+                return -1;
+            }
+            resource->attributes++;
+        }
+        else if (f.number == OTLP_RESOURCE_DROPPED) {
+            if (f.type != OTLP_WIRE_VARINT) {
+                return -1;
+            }
+            resource->dropped = (uint32_t) f.value;
+        }
+    }
+
+    return ret;
+}
+
+static int scope_read(struct otlp_scope *scope)
+{
+    int ret;
+    struct otlp_wire w;
+    struct otlp_field f;
+
+    wire_init(&w, scope->msg.data, scope->msg.len);
+    while ((ret = wire_next(&w, &f)) == 1) {
+        switch (f.number) {
+        case OTLP_SCOPE_NAME:
+        case OTLP_SCOPE_VERSION:
+        case OTLP_SCOPE_ATTRIBUTES:
+            if (f.type != OTLP_WIRE_LEN) {
+                return -1;
+            }
+            if (f.number == OTLP_SCOPE_NAME) {
+                slice_set(&scope->name, &f);
+            }
+            else if (f.number == OTLP_SCOPE_VERSION) {
+                slice_set(&scope->version, &f);
+            }
+            else {
+                scope->attributes++;
+            }
+            break;
+        case OTLP_SCOPE_DROPPED:
+            if (f.type != OTLP_WIRE_VARINT) {
+                return -1;
+            }
+            scope->dropped = (uint32_t) f.value;
+            break;
+        }
+    }
+
+    return ret;
+}
+
+static int log_record_read(struct otlp_log_record *record)
+{
+    int ret;
+    int type;
+    struct otlp_wire w;
+    struct otlp_field f;
+
+    wire_init(&w, record->msg.data, record->msg.len);
+    while ((ret = wire_next(&w, &f)) == 1) {
+        switch (f.number) {
+        case OTLP_LOG_TIME_UNIX_NANO:
+        case OTLP_LOG_OBSERVED_TIME_UNIX_NANO:
+            type = OTLP_WIRE_FIXED64;
+            break;
+        case OTLP_LOG_SEVERITY_NUMBER:
+            type = OTLP_WIRE_VARINT;
+            break;
+        case OTLP_LOG_FLAGS:
+            type = OTLP_WIRE_FIXED32;
+            break;
+        case OTLP_LOG_SEVERITY_TEXT:
+        case OTLP_LOG_BODY:
+        case OTLP_LOG_ATTRIBUTES:
+        case OTLP_LOG_TRACE_ID:
+        case OTLP_LOG_SPAN_ID:
+            type = OTLP_WIRE_LEN;
+            break;
+        default:
+            continue;
+        }
+
+        if (f.type != type) {
+            return -1;
+        }
+
+        switch (f.number) {
+        case OTLP_LOG_TIME_UNIX_NANO:
+            record->time_unix_nano = f.value;
+            break;
+        case OTLP_LOG_OBSERVED_TIME_UNIX_NANO:
+            record->observed_time_unix_nano = f.value;
+            break;
+        case OTLP_LOG_SEVERITY_NUMBER:
+            record->severity_number = (int32_t) f.value;
+            break;
+        case OTLP_LOG_FLAGS:
+            record->flags = (uint32_t) f.value;
+            break;
+        case OTLP_LOG_SEVERITY_TEXT:
+            slice_set(&record->severity_text, &f);
+            break;
+        case OTLP_LOG_BODY:
+            slice_set(&record->body, &f);
+            record->has_body = FLB_TRUE;
+            break;
+        case OTLP_LOG_ATTRIBUTES:
+            record->attributes++;
+            break;
+        case OTLP_LOG_TRACE_ID:
+            slice_set(&record->trace_id, &f);
+            break;
+        case OTLP_LOG_SPAN_ID:
+            slice_set(&record->span_id, &f);
+            break;
+        }
+    }
+
+    return ret;
+}
+
+/* Group header body: resource, schema_url and scope */
+static int pack_group_body(msgpack_packer *mp_pck,
+                           struct otlp_resource *resource,
+                           struct otlp_scope *scope)
+{
+    int ret;
+    struct flb_mp_map_header mh;
+    struct flb_mp_map_header mh_tmp;
+
+    flb_mp_map_header_init(&mh, mp_pck);
+
+    /* Resource */
+    flb_mp_map_header_append(&mh);
+    pack_key(mp_pck, "resource", 8);
+
+    flb_mp_map_header_init(&mh_tmp, mp_pck);
+    if (resource->attributes > 0) {
+        flb_mp_map_header_append(&mh_tmp);
+        pack_key(mp_pck, "attributes", 10);
+        ret = pack_key_values(mp_pck, resource->msg.data, resource->msg.len,
+                              OTLP_RESOURCE_ATTRIBUTES, resource->attributes, 0);
+        if (ret != 0) {
+            return -1;
+        }
+    }
+    if (resource->dropped > 0) {
+        flb_mp_map_header_append(&mh_tmp);
+        pack_key(mp_pck, "dropped_attributes_count", 24);
+        msgpack_pack_uint64(mp_pck, resource->dropped);
+    }
+    flb_mp_map_header_end(&mh_tmp);
+
+    /* an unset string is an empty string on the wire */
+    flb_mp_map_header_append(&mh);
+    pack_key(mp_pck, "schema_url", 10);
+    msgpack_pack_str_with_body(mp_pck, resource->schema_url.data,
+                               resource->schema_url.len);
+
+    /* Scope */
+    flb_mp_map_header_append(&mh);
+    pack_key(mp_pck, "scope", 5);
+
+    flb_mp_map_header_init(&mh_tmp, mp_pck);
+    if (scope->name.len > 0) {
+        flb_mp_map_header_append(&mh_tmp);
+        pack_key(mp_pck, "name", 4);
+        msgpack_pack_str_with_body(mp_pck, scope->name.data, scope->name.len);
+    }
+    if (scope->version.len > 0) {
+        flb_mp_map_header_append(&mh_tmp);
+        pack_key(mp_pck, "version", 7);
+        msgpack_pack_str_with_body(mp_pck, scope->version.data, scope->version.len);
+    }
+    if (scope->attributes > 0) {
+        flb_mp_map_header_append(&mh_tmp);
+        pack_key(mp_pck, "attributes", 10);
+        ret = pack_key_values(mp_pck, scope->msg.data, scope->msg.len,
+                              OTLP_SCOPE_ATTRIBUTES, scope->attributes, 0);
+        if (ret != 0) {
+            return -1;
+        }
+    }
+    if (scope->dropped > 0) {
+        flb_mp_map_header_append(&mh_tmp);
+        pack_key(mp_pck, "dropped_attributes_count", 24);
+        msgpack_pack_uint64(mp_pck, scope->dropped);
+    }
+    flb_mp_map_header_end(&mh_tmp);
+
+    flb_mp_map_header_end(&mh);
+
+    return 0;
+}
+
+/* https://opentelemetry.io/docs/specs/otel/logs/data-model/#log-and-event-record-definition */
+static int pack_log_metadata(struct flb_opentelemetry *ctx,
+                             msgpack_packer *mp_pck,
+                             struct otlp_log_record *record)
+{
+    int ret;
+    struct flb_mp_map_header mh;
+    struct flb_mp_map_header otlp_mh;
+
+    flb_mp_map_header_init(&otlp_mh, mp_pck);
+    flb_mp_map_header_append(&otlp_mh);
+    pack_key(mp_pck, ctx->logs_metadata_key, flb_sds_len(ctx->logs_metadata_key));
+
+    flb_mp_map_header_init(&mh, mp_pck);
+
+    flb_mp_map_header_append(&mh);
+    pack_key(mp_pck, "observed_timestamp", 18);
+    msgpack_pack_uint64(mp_pck, record->observed_time_unix_nano);
+
+    /* Value of 0 indicates unknown or missing timestamp. */
+    if (record->time_unix_nano != 0) {
+        flb_mp_map_header_append(&mh);
+        pack_key(mp_pck, "timestamp", 9);
+        msgpack_pack_uint64(mp_pck, record->time_unix_nano);
+    }
+
+    /* https://opentelemetry.io/docs/specs/otel/logs/data-model/#field-severitynumber */
+    if (record->severity_number >= 1 && record->severity_number <= 24) {
+        flb_mp_map_header_append(&mh);
+        pack_key(mp_pck, "severity_number", 15);
+        msgpack_pack_uint64(mp_pck, record->severity_number);
+    }
+
+    if (record->severity_text.len > 0) {
+        flb_mp_map_header_append(&mh);
+        pack_key(mp_pck, "severity_text", 13);
+        msgpack_pack_str_with_body(mp_pck, record->severity_text.data,
+                                   record->severity_text.len);
+    }
+
+    if (record->attributes > 0) {
+        flb_mp_map_header_append(&mh);
+        pack_key(mp_pck, "attributes", 10);
+        ret = pack_key_values(mp_pck, record->msg.data, record->msg.len,
+                              OTLP_LOG_ATTRIBUTES, record->attributes, 0);
+        if (ret != 0) {
+            return -1;
+        }
+    }
+
+    if (record->trace_id.len > 0) {
+        flb_mp_map_header_append(&mh);
+        pack_key(mp_pck, "trace_id", 8);
+        msgpack_pack_bin_with_body(mp_pck, record->trace_id.data,
+                                   record->trace_id.len);
+    }
+
+    if (record->span_id.len > 0) {
+        flb_mp_map_header_append(&mh);
+        pack_key(mp_pck, "span_id", 7);
+        msgpack_pack_bin_with_body(mp_pck, record->span_id.data,
+                                   record->span_id.len);
+    }
+
+    flb_mp_map_header_append(&mh);
+    pack_key(mp_pck, "trace_flags", 11);
+    msgpack_pack_uint8(mp_pck, (uint8_t) record->flags & 0xff);
+
+    flb_mp_map_header_end(&mh);
+    flb_mp_map_header_end(&otlp_mh);
+
+    return 0;
+}
+
+/*
+ * A kvlist body is the record body, any other value goes under 'message'.
+ * A record without body gets an empty one.
+ */
+static int pack_log_body(msgpack_packer *mp_pck, struct otlp_log_record *record)
+{
+    int ret;
+    struct otlp_field value;
+    struct flb_mp_map_header mh;
+
+    if (!record->has_body) {
+        return msgpack_pack_map(mp_pck, 0);
+    }
+
+    if (any_value_get(record->body.data, record->body.len, &value) != 0) {
+        return -1;
+    }
+
+    if (value.number == OTLP_ANY_KVLIST) {
+        return pack_kvlist(mp_pck, value.data, value.len, 1);
+    }
+
+    flb_mp_map_header_init(&mh, mp_pck);
+    flb_mp_map_header_append(&mh);
+    pack_key(mp_pck, "message", 7);
+    ret = pack_value(mp_pck, &value, 1);
+    flb_mp_map_header_end(&mh);
+
+    return ret;
+}
+
+static int encode_log_record(struct flb_opentelemetry *ctx,
+                             struct flb_log_event_encoder *encoder,
+                             const uint8_t *data, size_t len)
+{
+    int ret;
+    struct flb_time tm;
+    struct otlp_log_record record = {0};
+
+    record.msg.data = data;
+    record.msg.len = len;
+
+    if (log_record_read(&record) != 0) {
+        return -1;
+    }
+
+    /* metadata and body are packed in place, no map scopes are opened */
+    flb_log_event_encoder_reset_record(encoder);
+
+    if (record.time_unix_nano > 0) {
+        flb_time_from_uint64(&tm, record.time_unix_nano);
+        flb_log_event_encoder_set_timestamp(encoder, &tm);
+    }
+    else {
+        flb_log_event_encoder_set_current_timestamp(encoder);
+    }
+
+    ret = pack_log_metadata(ctx, &encoder->metadata.packer, &record);
+    if (ret != 0) {
+        flb_plg_error(ctx->ins, "failed to convert log record");
+        flb_log_event_encoder_reset_record(encoder);
+        return -1;
+    }
+    flb_log_event_encoder_dynamic_field_flush(&encoder->metadata);
+
+    ret = pack_log_body(&encoder->body.packer, &record);
+    if (ret != 0) {
+        flb_plg_error(ctx->ins, "failed to convert log record body");
+        flb_log_event_encoder_reset_record(encoder);
+        return -1;
+    }
+    flb_log_event_encoder_dynamic_field_flush(&encoder->body);
+
+    ret = flb_log_event_encoder_commit_record(encoder);
+    if (ret != FLB_EVENT_ENCODER_SUCCESS) {
+        flb_plg_error(ctx->ins, "marshalling error");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int encode_scope_logs(struct flb_opentelemetry *ctx,
+                             struct flb_log_event_encoder *encoder,
+                             struct otlp_resource *resource,
+                             int resource_id, int scope_id,
+                             const uint8_t *data, size_t len)
+{
+    int ret;
+    int records = 0;
+    struct otlp_wire w;
+    struct otlp_field f;
+    struct otlp_scope scope = {0};
+
+    /* the scope must be known before the first record is packed */
+    wire_init(&w, data, len);
+    while ((ret = wire_next(&w, &f)) == 1) {
+        if (f.number != OTLP_SCOPE_LOGS_SCOPE &&
+            f.number != OTLP_SCOPE_LOGS_LOG_RECORDS) {
+            continue;
+        }
+        if (f.type != OTLP_WIRE_LEN) {
+            return -1;
+        }
+        if (f.number == OTLP_SCOPE_LOGS_SCOPE) {
+            slice_set(&scope.msg, &f);
+            scope.present = FLB_TRUE;
+        }
+        else {
+            records++;
+        }
+    }
+
+    if (ret == -1 || (scope.present && scope_read(&scope) != 0)) {
+        return -1;
+    }
+
+    if (records == 0) {
+        return 0;
+    }
+
+    flb_log_event_encoder_group_init(encoder);
+
+    /* pack schema (internal) */
+    ret = flb_log_event_encoder_append_metadata_values(encoder,
+                                                       FLB_LOG_EVENT_STRING_VALUE("schema", 6),
+                                                       FLB_LOG_EVENT_STRING_VALUE("otlp", 4),
+                                                       FLB_LOG_EVENT_STRING_VALUE("resource_id", 11),
+                                                       FLB_LOG_EVENT_INT64_VALUE(resource_id),
+                                                       FLB_LOG_EVENT_STRING_VALUE("scope_id", 8),
+                                                       FLB_LOG_EVENT_INT64_VALUE(scope_id));
+    if (ret != FLB_EVENT_ENCODER_SUCCESS) {
+        return -1;
+    }
+
+    flb_log_event_encoder_dynamic_field_reset(&encoder->body);
+    ret = pack_group_body(&encoder->body.packer, resource, &scope);
+    if (ret != 0) {
+        flb_plg_error(ctx->ins, "could not set group content metadata");
+        return -1;
+    }
+    flb_log_event_encoder_dynamic_field_flush(&encoder->body);
+    flb_log_event_encoder_group_header_end(encoder);
+
+    wire_init(&w, data, len);
+    while ((ret = wire_next(&w, &f)) == 1) {
+        if (f.number != OTLP_SCOPE_LOGS_LOG_RECORDS) {
+            continue;
+        }
+        ret = encode_log_record(ctx, encoder, f.data, f.len);
+        if (ret != 0) {
+            return -1;
+        }
+    }
+
+    flb_log_event_encoder_group_end(encoder);
+
+    return ret;
+}
+
+static int encode_resource_logs(struct flb_opentelemetry *ctx,
+                                struct flb_log_event_encoder *encoder,
+                                int resource_id,
+                                const uint8_t *data, size_t len)
+{
+    int ret;
+    int scope_id = 0;
+    struct otlp_wire w;
+    struct otlp_field f;
+    struct otlp_resource resource = {0};
+
+    /* resource and schema_url may follow the scope logs on the wire */
+    wire_init(&w, data, len);
+    while ((ret = wire_next(&w, &f)) == 1) {
+        if (f.number < OTLP_RESOURCE_LOGS_RESOURCE ||
+            f.number > OTLP_RESOURCE_LOGS_SCHEMA_URL) {
+            continue;
+        }
+        if (f.type != OTLP_WIRE_LEN) {
+            return -1;
+        }
+        if (f.number == OTLP_RESOURCE_LOGS_RESOURCE) {
+            slice_set(&resource.msg, &f);
+        }
+        else if (f.number == OTLP_RESOURCE_LOGS_SCHEMA_URL) {
+            slice_set(&resource.schema_url, &f);
+        }
+    }
+
+    if (ret == -1 || resource_read(&resource) != 0) {
+        return -1;
+    }
+
+    wire_init(&w, data, len);
+    while ((ret = wire_next(&w, &f)) == 1) {
+        if (f.number != OTLP_RESOURCE_LOGS_SCOPE_LOGS) {
+            continue;
+        }
+        ret = encode_scope_logs(ctx, encoder, &resource,
+                                resource_id, scope_id, f.data, f.len);
+        if (ret != 0) {
+            return -1;
+        }
+        scope_id++;
+    }
+
+    return ret;
+}
+
+int opentelemetry_logs_stream_to_msgpack(struct flb_opentelemetry *ctx,
+                                         struct flb_log_event_encoder *encoder,
+                                         const uint8_t *in_buf,
+                                         size_t in_size)
+{
+    int ret;
+    int resource_id = 0;
+    struct otlp_wire w;
+    struct otlp_field f;
+
+    wire_init(&w, in_buf, in_size);
+    while ((ret = wire_next(&w, &f)) == 1) {
+        if (f.number != OTLP_REQUEST_RESOURCE_LOGS) {
+            continue;
+        }
+        if (f.type != OTLP_WIRE_LEN) {
+            ret = -1;
+            break;
+        }
+        ret = encode_resource_logs(ctx, encoder, resource_id, f.data, f.len);
+        if (ret != 0) {
+            break;
+        }
+        resource_id++;
+    }
+
+    if (ret == -1) {
+        flb_plg_warn(ctx->ins, "failed to decode logs from OpenTelemetry payload");
+        return -1;
+    }
+
+    if (resource_id == 0) {
+        flb_plg_warn(ctx->ins, "no resource logs found");
+        return -1;
+    }
+
+    return 0;
+}
@@ -35,6 +35,7 @@
 
 #include <fluent-otel-proto/fluent-otel.h>
 #include "opentelemetry.h"
+#include "opentelemetry_logs.h"
 #include "http_conn.h"
 
 #define HTTP_CONTENT_JSON  0
@@ -350,6 +351,12 @@ static int otlp_pack_any_value(msgpack_packer *mp_pck,
 {
     int result;
 
+    /* a key without value or an empty AnyValue is null */
+    if (body == NULL ||
+        body->value_case == OPENTELEMETRY__PROTO__COMMON__V1__ANY_VALUE__VALUE__NOT_SET) {
+        return msgpack_pack_nil(mp_pck);
+    }
+
     result = -2;
 
     switch(body->value_case){
@@ -522,6 +529,7 @@ static int binary_payload_to_msgpack(struct flb_opentelemetry *ctx,
     Opentelemetry__Proto__Logs__V1__ResourceLogs **resource_logs;
     Opentelemetry__Proto__Logs__V1__ResourceLogs *resource_log;
     Opentelemetry__Proto__Logs__V1__LogRecord **log_records;
+    Opentelemetry__Proto__Common__V1__AnyValue *body;
     Opentelemetry__Proto__Resource__V1__Resource *resource;
 
     /* initialize msgpack buffers */
@@ -718,16 +726,23 @@ static int binary_payload_to_msgpack(struct flb_opentelemetry *ctx,
                 }
 
                 if (ret == FLB_EVENT_ENCODER_SUCCESS) {
-                    ret = otlp_pack_any_value(
-                            &mp_pck,
-                            log_records[log_record_index]->body);
+                    body = log_records[log_record_index]->body;
+
+                    /* a record without body gets an empty one */
+                    if (body == NULL) {
+                        ret = msgpack_pack_map(&mp_pck, 0);
+                    }
+                    else {
+                        ret = otlp_pack_any_value(&mp_pck, body);
+                    }
 
                     if (ret != 0) {
                         flb_plg_error(ctx->ins, "failed to convert log record body");
                         ret = FLB_EVENT_ENCODER_ERROR_SERIALIZATION_FAILURE;
                     }
                     else {
-                        if (log_records[log_record_index]->body->value_case ==
+                        if (body == NULL ||
+                            body->value_case ==
                             OPENTELEMETRY__PROTO__COMMON__V1__ANY_VALUE__VALUE_KVLIST_VALUE) {
                             ret = flb_log_event_encoder_set_body_from_raw_msgpack(
                                     encoder,
@@ -774,6 +789,19 @@ static int binary_payload_to_msgpack(struct flb_opentelemetry *ctx,
     return 0;
 }
 
+static int protobuf_logs_to_msgpack(struct flb_opentelemetry *ctx,
+                                    struct flb_log_event_encoder *encoder,
+                                    uint8_t *in_buf,
+                                    size_t in_size)
+{
+    if (ctx->logs_stream_decoder) {
+        return opentelemetry_logs_stream_to_msgpack(ctx, encoder,
+                                                    in_buf, in_size);
+    }
+
+    return binary_payload_to_msgpack(ctx, encoder, in_buf, in_size);
+}
+
 static int find_map_entry_by_key(msgpack_object_map *map,
                                  char *key,
                                  size_t match_index,
@@ -1598,7 +1626,7 @@ static int process_payload_logs(struct flb_opentelemetry *ctx, struct http_conn
     else if (strncasecmp(request->content_type.data,
                          "application/x-protobuf",
                          request->content_type.len) == 0) {
-        ret = binary_payload_to_msgpack(ctx, encoder, (uint8_t *) request->data.data, request->data.len);
+        ret = protobuf_logs_to_msgpack(ctx, encoder, (uint8_t *) request->data.data, request->data.len);
     }
     else {
         flb_error("[otel] Unsupported content type %.*s", (int)request->content_type.len, request->content_type.data);
@@ -2365,20 +2393,20 @@ static int process_payload_logs_ng(struct flb_opentelemetry *ctx,
                                       cfl_sds_len(request->body));
     }
     else if (strcasecmp(request->content_type, "application/x-protobuf") == 0) {
-        ret = binary_payload_to_msgpack(ctx,
-                                        encoder,
-                                        (uint8_t *) request->body,
-                                        cfl_sds_len(request->body));
+        ret = protobuf_logs_to_msgpack(ctx,
+                                       encoder,
+                                       (uint8_t *) request->body,
+                                       cfl_sds_len(request->body));
     }
     else if (strcasecmp(request->content_type, "application/grpc") == 0) {
         if (cfl_sds_len(request->body) < 5) {
             return -1;
         }
 
-        ret = binary_payload_to_msgpack(ctx,
-                                        encoder,
-                                        &((uint8_t *) request->body)[5],
-                                        (cfl_sds_len(request->body)) - 5);
+        ret = protobuf_logs_to_msgpack(ctx,
+                                       encoder,
+                                       &((uint8_t *) request->body)[5],
+                                       (cfl_sds_len(request->body)) - 5);
     }
     else {
         flb_plg_error(ctx->ins, "Unsupported content type %s", request->content_type);
@@ -63,11 +63,121 @@ static int in_splunk_collect(struct flb_input_instance *ins,
     return 0;
 }
 
+/*
+ * Network workers: every worker serves its connections with a copy of the
+ * context owning its encoder, tokens, list of connections and HTTP server.
+ */
+static int in_splunk_worker_init(struct flb_input_net_worker *worker)
+{
+    int                        ret;
+    struct flb_splunk         *ctx;
+    struct flb_splunk         *worker_ctx;
+    struct flb_input_instance *ins;
+
+    ctx = worker->parent->context;
+    ins = ctx->ins;
+
+    worker_ctx = flb_malloc(sizeof(struct flb_splunk));
+    if (!worker_ctx) {
+        flb_errno();
+        return -1;
+    }
+    memcpy(worker_ctx, ctx, sizeof(struct flb_splunk));
+
+    worker_ctx->collector_id = -1;
+    worker_ctx->downstream = worker->downstream;
+    worker_ctx->workers = NULL;
+    worker_ctx->ingested_auth_header = NULL;
+    mk_list_init(&worker_ctx->connections);
+    mk_list_init(&worker_ctx->auth_tokens);
+
+    ret = splunk_config_setup_hec_tokens(worker_ctx);
+    if (ret != 0) {
+        splunk_config_delete_hec_tokens(worker_ctx);
+        flb_free(worker_ctx);
+        return -1;
+    }
+
+    ret = flb_log_event_encoder_init(&worker_ctx->log_encoder,
+                                     FLB_LOG_EVENT_FORMAT_DEFAULT);
+    if (ret != FLB_EVENT_ENCODER_SUCCESS) {
+        flb_plg_error(ins, "error initializing event encoder : %d", ret);
+        splunk_config_delete_hec_tokens(worker_ctx);
+        flb_free(worker_ctx);
+        return -1;
+    }
+
+    if (ctx->enable_http2) {
+        ret = flb_http_server_init(&worker_ctx->http_server,
+                                   HTTP_PROTOCOL_AUTODETECT,
+                                   (FLB_HTTP_SERVER_FLAG_KEEPALIVE | FLB_HTTP_SERVER_FLAG_AUTO_INFLATE),
+                                   NULL,
+                                   ins->host.listen,
+                                   ins->host.port,
+                                   ins->tls,
+                                   ins->flags,
+                                   &ins->net_setup,
+                                   worker->evl,
+                                   ins->config,
+                                   (void *) worker_ctx);
+        if (ret == 0) {
+            ret = flb_http_server_start(&worker_ctx->http_server);
+        }
+
+        if (ret != 0) {
+            flb_plg_error(ins, "could not start http server for worker #%i",
+                          worker->id);
+            flb_http_server_destroy(&worker_ctx->http_server);
+            flb_log_event_encoder_destroy(&worker_ctx->log_encoder);
+            splunk_config_delete_hec_tokens(worker_ctx);
+            flb_free(worker_ctx);
+            return -1;
+        }
+
+        worker_ctx->http_server.request_callback = splunk_prot_handle_ng;
+
+        flb_input_net_worker_downstream_set(worker,
+                                            worker_ctx->http_server.downstream);
+    }
+
+    worker->data = worker_ctx;
+    return 0;
+}
+
+static int in_splunk_worker_accept(struct flb_input_net_worker *worker,
+                                   struct flb_connection *connection)
+{
+    struct splunk_conn *conn;
+
+    conn = splunk_conn_add(connection, worker->data);
+    if (conn == NULL) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static void in_splunk_worker_exit(struct flb_input_net_worker *worker)
+{
+    struct flb_splunk *worker_ctx = worker->data;
+
+    splunk_conn_release_all(worker_ctx);
+
+    if (worker_ctx->enable_http2) {
+        flb_http_server_destroy(&worker_ctx->http_server);
+    }
+
+    flb_log_event_encoder_destroy(&worker_ctx->log_encoder);
+    splunk_config_delete_hec_tokens(worker_ctx);
+    flb_free(worker_ctx);
+}
+
 static int in_splunk_init(struct flb_input_instance *ins,
                           struct flb_config *config, void *data)
 {
     unsigned short int  port;
     int                 ret;
+    int                 workers;
     struct flb_splunk    *ctx;
 
     (void) data;
@@ -93,6 +203,8 @@ static int in_splunk_init(struct flb_input_instance *ins,
 
     port = (unsigned short int) strtoul(ctx->tcp_port, NULL, 10);
 
+    /* the port is shared when extra workers are requested */
+    workers = flb_input_net_workers_count(ins);
 
     if (ctx->enable_http2) {
         ret = flb_http_server_init(&ctx->http_server, 
@@ -170,6 +282,28 @@ static int in_splunk_init(struct flb_input_instance *ins,
         ctx->collector_id = ret;
     }
 
+    /* the input thread accepts too, it's the first worker */
+    if (workers > 1) {
+        ctx->workers = flb_input_net_workers_create(ins, ctx->listen, port,
+                                                    workers - 1,
+                                                    in_splunk_worker_init,
+                                                    ctx->enable_http2 ?
+                                                        NULL : in_splunk_worker_accept,
+                                                    in_splunk_worker_exit,
+                                                    ctx, config);
+        if (!ctx->workers) {
+            splunk_config_destroy(ctx);
+            return -1;
+        }
+
+        ret = flb_input_net_workers_start(ctx->workers);
+        if (ret == -1) {
+            flb_plg_error(ctx->ins, "could not start network workers");
+            splunk_config_destroy(ctx);
+            return -1;
+        }
+    }
+
     return 0;
 }
 
@@ -194,7 +328,9 @@ static void in_splunk_pause(void *data, struct flb_config *config)
     struct flb_splunk *ctx = data;
 
     flb_input_collector_pause(ctx->collector_id, ctx->ins);
-
+    if (ctx->workers) {
+        flb_input_net_workers_pause(ctx->workers);
+    }
 }
 
 static void in_splunk_resume(void *data, struct flb_config *config)
@@ -202,6 +338,9 @@ static void in_splunk_resume(void *data, struct flb_config *config)
     struct flb_splunk *ctx = data;
 
     flb_input_collector_resume(ctx->collector_id, ctx->ins);
+    if (ctx->workers) {
+        flb_input_net_workers_resume(ctx->workers);
+    }
 }
 
 /* Configuration properties map */
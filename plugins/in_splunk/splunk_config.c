@@ -24,7 +24,7 @@
 #include "splunk_conn.h"
 #include "splunk_config.h"
 
-static void delete_hec_tokens(struct flb_splunk *ctx)
+void splunk_config_delete_hec_tokens(struct flb_splunk *ctx)
 {
     struct mk_list *tmp;
     struct mk_list *head;
@@ -38,7 +38,7 @@ static void delete_hec_tokens(struct flb_splunk *ctx)
     }
 }
 
-static int setup_hec_tokens(struct flb_splunk *ctx)
+int splunk_config_setup_hec_tokens(struct flb_splunk *ctx)
 {
     int         ret;
     const char *raw_token;
@@ -146,7 +146,7 @@ struct flb_splunk *splunk_config_create(struct flb_input_instance *ins)
 
     ctx->ingested_auth_header = NULL;
 
-    ret = setup_hec_tokens(ctx);
+    ret = splunk_config_setup_hec_tokens(ctx);
     if (ret != 0) {
         splunk_config_destroy(ctx);
         return NULL;
@@ -234,6 +234,11 @@ struct flb_splunk *splunk_config_create(struct flb_input_instance *ins)
 
 int splunk_config_destroy(struct flb_splunk *ctx)
 {
+    if (ctx->workers != NULL) {
+        flb_input_net_workers_destroy(ctx->workers);
+        ctx->workers = NULL;
+    }
+
     /* release all connections */
     splunk_conn_release_all(ctx);
 
@@ -261,7 +266,7 @@ int splunk_config_destroy(struct flb_splunk *ctx)
         flb_sds_destroy(ctx->success_headers_str);
     }
 
-    delete_hec_tokens(ctx);
+    splunk_config_delete_hec_tokens(ctx);
 
     flb_free(ctx->listen);
     flb_free(ctx->tcp_port);
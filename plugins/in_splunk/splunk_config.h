@@ -26,4 +26,7 @@
 struct flb_splunk *splunk_config_create(struct flb_input_instance *ins);
 int splunk_config_destroy(struct flb_splunk *ctx);
 
+int splunk_config_setup_hec_tokens(struct flb_splunk *ctx);
+void splunk_config_delete_hec_tokens(struct flb_splunk *ctx);
+
 #endif
@@ -22,6 +22,8 @@
 #include <fluent-bit/flb_utils.h>
 #include <fluent-bit/flb_socket.h>
 #include <fluent-bit/flb_pack.h>
+#include <fluent-bit/flb_net_dgram.h>
+#include <fluent-bit/flb_input_dgram.h>
 
 #define MAX_PACKET_SIZE 65536
 #define DEFAULT_LISTEN "0.0.0.0"
@@ -39,6 +41,9 @@ struct flb_statsd {
     int  metrics;                      /* Import as metrics */
     flb_sockfd_t server_fd;            /* server socket */
     flb_pipefd_t coll_fd;              /* server handler */
+    struct flb_net_dgram_reader *reader;  /* batched datagram reader */
+    struct flb_input_dgram *receivers;    /* extra receiver threads */
+    struct cmt_counter *cmt_kernel_drops;
     struct flb_input_instance *ins;    /* input instance */
     struct flb_log_event_encoder *log_encoder;
 };
@@ -79,21 +84,22 @@ static int is_incremental(char *str)
 }
 
 static int statsd_process_message(struct flb_statsd *ctx,
+                                  struct flb_log_event_encoder *log_encoder,
                                   struct statsd_message *m)
 {
     int ret;
 
-    ret = flb_log_event_encoder_begin_record(ctx->log_encoder);
+    ret = flb_log_event_encoder_begin_record(log_encoder);
 
     if (ret == FLB_EVENT_ENCODER_SUCCESS) {
-        ret = flb_log_event_encoder_set_current_timestamp(ctx->log_encoder);
+        ret = flb_log_event_encoder_set_current_timestamp(log_encoder);
     }
 
     if (ret == FLB_EVENT_ENCODER_SUCCESS) {
         switch (m->type) {
         case STATSD_TYPE_COUNTER:
             ret = flb_log_event_encoder_append_body_values(
-                    ctx->log_encoder,
+                    log_encoder,
 
                     FLB_LOG_EVENT_CSTRING_VALUE("type"),
                     FLB_LOG_EVENT_CSTRING_VALUE("counter"),
@@ -107,7 +113,7 @@ static int statsd_process_message(struct flb_statsd *ctx,
             break;
         case STATSD_TYPE_GAUGE:
             ret = flb_log_event_encoder_append_body_values(
-                    ctx->log_encoder,
+                    log_encoder,
 
                     FLB_LOG_EVENT_CSTRING_VALUE("type"),
                     FLB_LOG_EVENT_CSTRING_VALUE("gauge"),
@@ -120,7 +126,7 @@ static int statsd_process_message(struct flb_statsd *ctx,
             break;
         case STATSD_TYPE_TIMER:
             ret = flb_log_event_encoder_append_body_values(
-                    ctx->log_encoder,
+                    log_encoder,
 
                     FLB_LOG_EVENT_CSTRING_VALUE("type"),
                     FLB_LOG_EVENT_CSTRING_VALUE("timer"),
@@ -133,7 +139,7 @@ static int statsd_process_message(struct flb_statsd *ctx,
 
         case STATSD_TYPE_SET:
             ret = flb_log_event_encoder_append_body_values(
-                    ctx->log_encoder,
+                    log_encoder,
 
                     FLB_LOG_EVENT_CSTRING_VALUE("type"),
                     FLB_LOG_EVENT_CSTRING_VALUE("set"),
@@ -146,13 +152,15 @@ static int statsd_process_message(struct flb_statsd *ctx,
     }
 
     if (ret == FLB_EVENT_ENCODER_SUCCESS) {
-        ret = flb_log_event_encoder_commit_record(ctx->log_encoder);
+        ret = flb_log_event_encoder_commit_record(log_encoder);
     }
 
     return ret;
 }
 
-static int statsd_process_line(struct flb_statsd *ctx, char *line)
+static int statsd_process_line(struct flb_statsd *ctx,
+                               struct flb_log_event_encoder *log_encoder,
+                               char *line)
 {
     char *colon, *bar, *atmark;
     struct statsd_message m;
@@ -199,16 +207,21 @@ static int statsd_process_line(struct flb_statsd *ctx, char *line)
         m.sample_rate = atof(atmark + 2);
     }
 
-    return statsd_process_message(ctx, &m);
+    return statsd_process_message(ctx, log_encoder, &m);
 }
 
 
-static int cb_statsd_receive(struct flb_input_instance *ins,
-                             struct flb_config *config, void *data)
+/*
+ * Process a NULL terminated datagram. Log records are encoded into
+ * 'log_encoder' and appended by the caller; metrics are appended right away,
+ * or handed over to the input thread when running in a receiver ('worker').
+ */
+static int statsd_process_dgram(struct flb_statsd *ctx,
+                                struct flb_input_dgram_worker *worker,
+                                struct flb_log_event_encoder *log_encoder,
+                                char *buf, size_t len)
 {
     int ret;
-    int len;
-    struct flb_statsd *ctx = data;
     struct cfl_list *head = NULL;
     struct cfl_list *kvs = NULL;
     struct cfl_split_entry *cur = NULL;
@@ -217,75 +230,175 @@ static int cb_statsd_receive(struct flb_input_instance *ins,
     int cmt_flags = 0;
 #endif
 
-    /* Receive a UDP datagram */
-    len = recv(ctx->server_fd, ctx->buf, MAX_PACKET_SIZE - 1, 0);
-    if (len < 0) {
-        flb_errno();
-        return -1;
-    }
-    ctx->buf[len] = '\0';
-
 #ifdef FLB_HAVE_METRICS
     if (ctx->metrics == FLB_TRUE) {
         cmt_flags |= CMT_DECODE_STATSD_GAUGE_OBSERVER;
-        flb_plg_trace(ctx->ins, "received a buf: '%s'", ctx->buf);
-        ret = cmt_decode_statsd_create(&cmt, ctx->buf, len, cmt_flags);
+        flb_plg_trace(ctx->ins, "received a buf: '%s'", buf);
+        ret = cmt_decode_statsd_create(&cmt, buf, len, cmt_flags);
         if (ret != CMT_DECODE_STATSD_SUCCESS) {
-            flb_plg_error(ctx->ins, "failed to process buf: '%s'", ctx->buf);
+            flb_plg_error(ctx->ins, "failed to process buf: '%s'", buf);
             return -1;
         }
 
         /* Append the updated metrics */
-        ret = flb_input_metrics_append(ins, NULL, 0, cmt);
+        if (worker != NULL) {
+            return flb_input_dgram_metrics_append(worker, cmt);
+        }
+
+        ret = flb_input_metrics_append(ctx->ins, NULL, 0, cmt);
         if (ret != 0) {
-            flb_plg_error(ins, "could not append metrics");
+            flb_plg_error(ctx->ins, "could not append metrics");
         }
 
         cmt_destroy(cmt);
     }
     else {
 #endif
-        ret = FLB_EVENT_ENCODER_SUCCESS;
-        kvs = cfl_utils_split(ctx->buf, '\n', -1 );
+        kvs = cfl_utils_split(buf, '\n', -1 );
         if (kvs == NULL) {
-            goto split_error;
+            return -1;
         }
 
         cfl_list_foreach(head, kvs) {
             cur = cfl_list_entry(head, struct cfl_split_entry, _head);
             flb_plg_trace(ctx->ins, "received a line: '%s'", cur->value);
 
-            ret = statsd_process_line(ctx, cur->value);
+            ret = statsd_process_line(ctx, log_encoder, cur->value);
 
             if (ret != FLB_EVENT_ENCODER_SUCCESS) {
                 flb_plg_error(ctx->ins, "failed to process line: '%s'", cur->value);
+                flb_log_event_encoder_rollback_record(log_encoder);
 
                 break;
             }
         }
 
-        if (kvs != NULL) {
-            cfl_utils_split_free(kvs);
-        }
+        cfl_utils_split_free(kvs);
+#ifdef FLB_HAVE_METRICS
+    }
+#endif
 
-        if (ctx->log_encoder->output_length > 0) {
-            flb_input_log_append(ctx->ins, NULL, 0,
-                                 ctx->log_encoder->output_buffer,
-                                 ctx->log_encoder->output_length);
-        }
-        else {
-            flb_plg_error(ctx->ins, "log event encoding error : %d", ret);
+    return 0;
+}
+
+/* Datagram read by an extra receiver thread, 'data' is its own buffer */
+static int statsd_receiver_event(struct flb_input_dgram_worker *worker,
+                                 char *buf, size_t size)
+{
+    char *tmp = worker->data;
+    struct flb_statsd *ctx = worker->parent->ins->context;
+
+    if (size > MAX_PACKET_SIZE - 1) {
+        size = MAX_PACKET_SIZE - 1;
+    }
+    memcpy(tmp, buf, size);
+    tmp[size] = '\0';
+
+    return statsd_process_dgram(ctx, worker, worker->log_encoder, tmp, size);
+}
+
+static int cb_statsd_receive(struct flb_input_instance *ins,
+                             struct flb_config *config, void *data)
+{
+    int ret;
+    char *buf;
+    size_t len;
+    uint64_t drops;
+    struct sockaddr_storage *address;
+    struct flb_statsd *ctx = data;
+
+    /* Receive a batch of UDP datagrams */
+    ret = flb_net_dgram_read(ctx->reader);
+    if (ret == -1) {
+        return -1;
+    }
+
+    while (flb_net_dgram_next(ctx->reader, &buf, &len, &address)) {
+        if (len > MAX_PACKET_SIZE - 1) {
+            len = MAX_PACKET_SIZE - 1;
         }
+        memcpy(ctx->buf, buf, len);
+        ctx->buf[len] = '\0';
 
-        flb_log_event_encoder_reset(ctx->log_encoder);
-#ifdef FLB_HAVE_METRICS
+        statsd_process_dgram(ctx, NULL, ctx->log_encoder, ctx->buf, len);
+    }
+
+    if (ctx->log_encoder->output_length > 0) {
+        flb_input_log_append(ctx->ins, NULL, 0,
+                             ctx->log_encoder->output_buffer,
+                             ctx->log_encoder->output_length);
+    }
+    flb_log_event_encoder_reset(ctx->log_encoder);
+
+    drops = flb_net_dgram_drops(ctx->reader);
+    if (drops > 0) {
+        flb_input_dgram_drops_report(ctx->ins, ctx->cmt_kernel_drops, drops);
     }
-#endif
 
     return 0;
+}
 
-split_error:
-    return -1;
+/* Batches encoded by the extra receivers */
+static int cb_statsd_collect_receivers(struct flb_input_instance *ins,
+                                       struct flb_config *config, void *data)
+{
+    struct flb_statsd *ctx = data;
+
+    return flb_input_dgram_collect(ctx->receivers);
+}
+
+static void statsd_receivers_destroy(struct flb_statsd *ctx)
+{
+    int i;
+
+    if (ctx->receivers == NULL) {
+        return;
+    }
+
+    flb_input_dgram_stop(ctx->receivers);
+
+    for (i = 0; i < ctx->receivers->count; i++) {
+        flb_free(ctx->receivers->workers[i].data);
+    }
+
+    flb_input_dgram_destroy(ctx->receivers);
+    ctx->receivers = NULL;
+}
+
+static int statsd_receivers_create(struct flb_statsd *ctx, int count,
+                                   struct flb_config *config)
+{
+    int i;
+    unsigned short int port;
+    struct flb_input_dgram_worker *worker;
+
+    port = (unsigned short int) strtoul(ctx->port, NULL, 10);
+
+    ctx->receivers = flb_input_dgram_create(ctx->ins, ctx->listen, port,
+                                            count, MAX_PACKET_SIZE,
+                                            statsd_receiver_event, config);
+    if (ctx->receivers == NULL) {
+        return -1;
+    }
+    ctx->receivers->cmt_drops = ctx->cmt_kernel_drops;
+
+    for (i = 0; i < ctx->receivers->count; i++) {
+        worker = &ctx->receivers->workers[i];
+        worker->data = flb_malloc(MAX_PACKET_SIZE);
+        if (worker->data == NULL) {
+            flb_errno();
+            statsd_receivers_destroy(ctx);
+            return -1;
+        }
+    }
+
+    if (flb_input_dgram_start(ctx->receivers,
+                              cb_statsd_collect_receivers, config) == -1) {
+        statsd_receivers_destroy(ctx);
+        return -1;
+    }
+
+    return 0;
 }
 
 static int cb_statsd_init(struct flb_input_instance *ins,
@@ -295,6 +408,7 @@ static int cb_statsd_init(struct flb_input_instance *ins,
     char *listen;
     int port;
     int ret;
+    int receivers;
 
     ctx = flb_calloc(1, sizeof(struct flb_statsd));
     if (!ctx) {
@@ -350,6 +464,9 @@ static int cb_statsd_init(struct flb_input_instance *ins,
     /* Export plugin context */
     flb_input_set_context(ins, ctx);
 
+    /* the port is shared when extra receivers are requested */
+    receivers = flb_input_dgram_receivers(ins);
+
     /* Accepts metrics from UDP connections. */
     ctx->server_fd = flb_net_server_udp(ctx->port, ctx->listen, ins->net_setup.share_port);
     if (ctx->server_fd == -1) {
@@ -360,18 +477,48 @@ static int cb_statsd_init(struct flb_input_instance *ins,
         return -1;
     }
 
+    ctx->reader = flb_net_dgram_reader_create(ctx->server_fd,
+                                              ins->net_setup.udp_batch_size,
+                                              MAX_PACKET_SIZE,
+                                              ins->net_setup.udp_gro);
+    if (ctx->reader == NULL) {
+        flb_plg_error(ctx->ins, "could not create datagram reader");
+        flb_log_event_encoder_destroy(ctx->log_encoder);
+        flb_socket_close(ctx->server_fd);
+        flb_free(ctx->buf);
+        flb_free(ctx);
+        return -1;
+    }
+    ctx->cmt_kernel_drops = flb_input_dgram_drops_counter(ins);
+
     /* Set up the UDP connection callback */
     ctx->coll_fd = flb_input_set_collector_socket(ins, cb_statsd_receive,
                                                   ctx->server_fd, config);
     if (ctx->coll_fd == -1) {
         flb_plg_error(ctx->ins, "cannot set up connection callback ");
         flb_log_event_encoder_destroy(ctx->log_encoder);
+        flb_net_dgram_reader_destroy(ctx->reader);
         flb_socket_close(ctx->server_fd);
         flb_free(ctx->buf);
         flb_free(ctx);
         return -1;
     }
 
+    /* the collector above is the first receiver */
+    if (receivers > 1) {
+        ret = statsd_receivers_create(ctx, receivers - 1, config);
+        if (ret == -1) {
+            flb_plg_error(ctx->ins, "could not start UDP receivers");
+            flb_input_collector_delete(ctx->coll_fd, ins);
+            flb_log_event_encoder_destroy(ctx->log_encoder);
+            flb_net_dgram_reader_destroy(ctx->reader);
+            flb_socket_close(ctx->server_fd);
+            flb_free(ctx->buf);
+            flb_free(ctx);
+            return -1;
+        }
+    }
+
     flb_plg_info(ctx->ins, "start UDP server on %s:%s", ctx->listen, ctx->port);
     return 0;
 }
@@ -380,22 +527,31 @@ static void cb_statsd_pause(void *data, struct flb_config *config)
 {
     struct flb_statsd *ctx = data;
     flb_input_collector_pause(ctx->coll_fd, ctx->ins);
+    if (ctx->receivers != NULL) {
+        flb_input_collector_pause(ctx->receivers->coll_id, ctx->ins);
+    }
 }
 
 static void cb_statsd_resume(void *data, struct flb_config *config)
 {
     struct flb_statsd *ctx = data;
     flb_input_collector_resume(ctx->coll_fd, ctx->ins);
+    if (ctx->receivers != NULL) {
+        flb_input_collector_resume(ctx->receivers->coll_id, ctx->ins);
+    }
 }
 
 static int cb_statsd_exit(void *data, struct flb_config *config)
 {
     struct flb_statsd *ctx = data;
 
+    statsd_receivers_destroy(ctx);
+
     if (ctx->log_encoder != NULL) {
         flb_log_event_encoder_destroy(ctx->log_encoder);
     }
 
+    flb_net_dgram_reader_destroy(ctx->reader);
     flb_socket_close(ctx->server_fd);
     flb_free(ctx->buf);
     flb_free(ctx);
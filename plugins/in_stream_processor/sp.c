@@ -20,6 +20,12 @@
 #include <fluent-bit/flb_input_plugin.h>
 #include <fluent-bit/flb_sds.h>
 
+#ifdef FLB_SYSTEM_WINDOWS
+#include <monkey/mk_core/external/winpthreads.h>
+#else
+#include <pthread.h>
+#endif
+
 struct sp_chunk {
     char *buf_data;
     size_t buf_size;
@@ -30,6 +36,7 @@ struct sp_ctx {
     int coll_fd;                    /* collector file descriptor to flush queue */
     flb_sds_t tag;                  /* outgoing Tag name */
     struct mk_list chunks;          /* linked list with data chunks to ingest */
+    pthread_mutex_t lock;           /* chunks are added by the SP workers */
     struct flb_input_instance *ins;
 };
 
@@ -54,7 +61,10 @@ int in_stream_processor_add_chunk(char *buf_data, size_t buf_size,
 
     chunk->buf_data = buf_data;
     chunk->buf_size = buf_size;
+
+    pthread_mutex_lock(&ctx->lock);
     mk_list_add(&chunk->_head, &ctx->chunks);
+    pthread_mutex_unlock(&ctx->lock);
 
     return 0;
 }
@@ -67,9 +77,19 @@ static int cb_chunks_append(struct flb_input_instance *in,
     struct mk_list *head;
     struct sp_chunk *chunk;
     struct sp_ctx *ctx = in_context;
+    struct mk_list chunks;
     (void) config;
 
-    mk_list_foreach_safe(head, tmp, &ctx->chunks) {
+    /* take the pending chunks, workers keep adding to an empty list */
+    mk_list_init(&chunks);
+    pthread_mutex_lock(&ctx->lock);
+    if (mk_list_is_empty(&ctx->chunks) != 0) {
+        mk_list_cat(&ctx->chunks, &chunks);
+        mk_list_init(&ctx->chunks);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+
+    mk_list_foreach_safe(head, tmp, &chunks) {
         chunk = mk_list_entry(head, struct sp_chunk, _head);
         flb_input_log_append(in,
                                    ctx->tag, flb_sds_len(ctx->tag),
@@ -96,6 +116,7 @@ static int cb_sp_init(struct flb_input_instance *in,
     }
     ctx->ins = in;
     mk_list_init(&ctx->chunks);
+    pthread_mutex_init(&ctx->lock, NULL);
 
     /* Register context */
     flb_input_set_context(in, ctx);
@@ -149,6 +170,7 @@ static int cb_sp_exit(void *data, struct flb_config *config)
 
     /* Upon exit, put in the queue all pending chunks */
     cb_chunks_append(ctx->ins, config, ctx);
+    pthread_mutex_destroy(&ctx->lock);
     flb_sds_destroy(ctx->tag);
     flb_free(ctx);
 
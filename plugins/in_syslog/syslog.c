@@ -93,11 +93,66 @@ static int in_syslog_collect_udp(struct flb_input_instance *i_ins,
     return syslog_dgram_conn_event(ctx->dummy_conn->connection);
 }
 
+/* Batches encoded by the extra UDP receivers */
+static int in_syslog_collect_receivers(struct flb_input_instance *i_ins,
+                                       struct flb_config *config,
+                                       void *in_context)
+{
+    struct flb_syslog *ctx;
+
+    (void) i_ins;
+
+    ctx = in_context;
+
+    return flb_input_dgram_collect(ctx->receivers);
+}
+
+static int receivers_create(struct flb_syslog *ctx, int count,
+                            struct flb_config *config)
+{
+    int i;
+    unsigned short int port;
+    struct syslog_conn *conn;
+    struct flb_input_dgram_worker *worker;
+
+    port = (unsigned short int) strtoul(ctx->port, NULL, 10);
+
+    ctx->receivers = flb_input_dgram_create(ctx->ins, ctx->listen, port,
+                                            count, ctx->buffer_chunk_size,
+                                            syslog_dgram_receiver_event,
+                                            config);
+    if (ctx->receivers == NULL) {
+        return -1;
+    }
+    ctx->receivers->cmt_drops = ctx->cmt_kernel_drops;
+
+    for (i = 0; i < ctx->receivers->count; i++) {
+        worker = &ctx->receivers->workers[i];
+
+        if (ctx->receive_buffer_size) {
+            flb_net_socket_rcv_buffer(worker->downstream->server_fd,
+                                      ctx->receive_buffer_size);
+        }
+
+        /* released with the other connections by syslog_conn_exit() */
+        conn = syslog_conn_add(worker->connection, ctx);
+        if (conn == NULL) {
+            return -1;
+        }
+        conn->log_encoder = worker->log_encoder;
+        worker->data = conn;
+    }
+
+    return flb_input_dgram_start(ctx->receivers,
+                                 in_syslog_collect_receivers, config);
+}
+
 /* Initialize plugin */
 static int in_syslog_init(struct flb_input_instance *in,
                           struct flb_config *config, void *data)
 {
     int ret;
+    int receivers = 1;
     struct flb_syslog *ctx;
     struct flb_connection *connection;
 
@@ -109,6 +164,11 @@ static int in_syslog_init(struct flb_input_instance *in,
     }
     ctx->collector_id = -1;
 
+    /* the port is shared when extra receivers are requested */
+    if (ctx->mode == FLB_SYSLOG_UDP) {
+        receivers = flb_input_dgram_receivers(in);
+    }
+
     if ((ctx->mode == FLB_SYSLOG_UNIX_TCP || ctx->mode == FLB_SYSLOG_UNIX_UDP)
         && !ctx->unix_path) {
         flb_plg_error(ctx->ins, "Unix path not defined");
@@ -147,6 +207,20 @@ static int in_syslog_init(struct flb_input_instance *in,
 
             return -1;
         }
+
+        ctx->reader = flb_net_dgram_reader_create(ctx->downstream->server_fd,
+                                                  in->net_setup.udp_batch_size,
+                                                  ctx->buffer_chunk_size,
+                                                  in->net_setup.udp_gro);
+        if (ctx->reader == NULL) {
+            flb_plg_error(ctx->ins, "could not create datagram reader");
+
+            syslog_conf_destroy(ctx);
+
+            return -1;
+        }
+
+        ctx->cmt_kernel_drops = flb_input_dgram_drops_counter(in);
     }
 
     /* Set context */
@@ -184,6 +258,21 @@ static int in_syslog_init(struct flb_input_instance *in,
         return -1;
     }
 
+    /* the collector above is the first receiver */
+    if (receivers > 1) {
+        ret = receivers_create(ctx, receivers - 1, config);
+        if (ret == -1) {
+            flb_plg_error(ctx->ins, "could not start UDP receivers");
+            if (ctx->receivers != NULL) {
+                flb_input_dgram_stop(ctx->receivers);
+            }
+            syslog_conn_exit(ctx);
+            syslog_conf_destroy(ctx);
+
+            return -1;
+        }
+    }
+
     return 0;
 }
 
@@ -192,6 +281,11 @@ static int in_syslog_exit(void *data, struct flb_config *config)
     struct flb_syslog *ctx = data;
     (void) config;
 
+    /* receivers use their connections until they are stopped */
+    if (ctx->receivers != NULL) {
+        flb_input_dgram_stop(ctx->receivers);
+    }
+
     syslog_conn_exit(ctx);
     syslog_conf_destroy(ctx);
 
@@ -23,6 +23,8 @@
 #include <fluent-bit/flb_info.h>
 #include <fluent-bit/flb_input.h>
 #include <fluent-bit/flb_log_event_encoder.h>
+#include <fluent-bit/flb_net_dgram.h>
+#include <fluent-bit/flb_input_dgram.h>
 
 /* Syslog modes */
 #define FLB_SYSLOG_UNIX_TCP  1
@@ -72,6 +74,9 @@ struct flb_syslog {
     struct mk_event *collector_event;
     struct flb_downstream *downstream;
     struct syslog_conn *dummy_conn;
+    struct flb_net_dgram_reader *reader;
+    struct flb_input_dgram *receivers;
+    struct cmt_counter *cmt_kernel_drops;
 
     /* List for connections and event loop */
     struct mk_list connections;
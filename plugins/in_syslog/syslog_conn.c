@@ -125,33 +125,53 @@ int syslog_stream_conn_event(void *data)
 
 int syslog_dgram_conn_event(void *data)
 {
+    int                    ret;
+    char                  *buf;
+    size_t                 size;
+    uint64_t               drops;
+    struct sockaddr_storage *address;
     struct flb_connection *connection;
-    int                    bytes;
     struct syslog_conn    *conn;
+    struct flb_syslog     *ctx;
 
     connection = (struct flb_connection *) data;
 
     conn = connection->user_data;
+    ctx = conn->ctx;
 
-    bytes = flb_io_net_read(connection,
-                            (void *) &conn->buf_data[conn->buf_len],
-                            conn->buf_size - 1);
-
-    if (bytes > 0) {
-        conn->buf_data[bytes] = '\0';
-        conn->buf_len = bytes;
+    /* Read a batch of datagrams, one message each */
+    ret = flb_net_dgram_read(ctx->reader);
+    if (ret == -1) {
+        return 0;
+    }
 
-        syslog_prot_process_udp(conn);
+    while (flb_net_dgram_next(ctx->reader, &buf, &size, &address)) {
+        flb_connection_set_remote_host(connection, (struct sockaddr *) address);
+        syslog_prot_process_udp(conn, buf, size);
     }
-    else {
-        flb_errno();
+
+    if (conn->log_encoder->output_length > 0) {
+        flb_input_log_append(ctx->ins, NULL, 0,
+                             conn->log_encoder->output_buffer,
+                             conn->log_encoder->output_length);
     }
+    flb_log_event_encoder_reset(conn->log_encoder);
 
-    conn->buf_len = 0;
+    drops = flb_net_dgram_drops(ctx->reader);
+    if (drops > 0) {
+        flb_input_dgram_drops_report(ctx->ins, ctx->cmt_kernel_drops, drops);
+    }
 
     return 0;
 }
 
+/* Datagram read by an extra receiver thread */
+int syslog_dgram_receiver_event(struct flb_input_dgram_worker *worker,
+                                char *buf, size_t size)
+{
+    return syslog_prot_process_udp(worker->data, buf, size);
+}
+
 /* Create a new mqtt request instance */
 struct syslog_conn *syslog_conn_add(struct flb_connection *connection,
                                     struct flb_syslog *ctx)
@@ -176,6 +196,7 @@ struct syslog_conn *syslog_conn_add(struct flb_connection *connection,
     /* Connection info */
     conn->ctx     = ctx;
     conn->ins     = ctx->ins;
+    conn->log_encoder = ctx->log_encoder;
     conn->buf_len = 0;
     conn->buf_parsed = 0;
 
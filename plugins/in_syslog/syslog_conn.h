@@ -38,6 +38,7 @@ struct syslog_conn {
     struct flb_input_instance *ins;  /* Parent plugin instance            */
     struct flb_syslog *ctx;          /* Plugin configuration context      */
     struct flb_connection *connection;
+    struct flb_log_event_encoder *log_encoder;
 
     struct mk_list _head;
 };
@@ -45,6 +46,8 @@ struct syslog_conn {
 int syslog_conn_event(void *data);
 int syslog_stream_conn_event(void *data);
 int syslog_dgram_conn_event(void *data);
+int syslog_dgram_receiver_event(struct flb_input_dgram_worker *worker,
+                                char *buf, size_t size);
 struct syslog_conn *syslog_conn_add(struct flb_connection *connection,
                                     struct flb_syslog *ctx);
 int syslog_conn_del(struct syslog_conn *conn);
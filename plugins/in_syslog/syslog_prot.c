@@ -96,6 +96,7 @@ static int append_message_to_record_data(char **result_buffer,
 }
 
 static inline int pack_line(struct flb_syslog *ctx,
+                            struct flb_log_event_encoder *log_encoder,
                             struct flb_time *time,
                             struct flb_connection *connection,
                             char *data, size_t data_size,
@@ -157,45 +158,41 @@ static inline int pack_line(struct flb_syslog *ctx,
         }
     }
 
-    result = flb_log_event_encoder_begin_record(ctx->log_encoder);
+    result = flb_log_event_encoder_begin_record(log_encoder);
 
     if (result == FLB_EVENT_ENCODER_SUCCESS) {
-        result = flb_log_event_encoder_set_timestamp(ctx->log_encoder, time);
+        result = flb_log_event_encoder_set_timestamp(log_encoder, time);
     }
 
     if (result == FLB_EVENT_ENCODER_SUCCESS) {
         if (appended_address_buffer != NULL) {
             result = flb_log_event_encoder_set_body_from_raw_msgpack(
-                    ctx->log_encoder, appended_address_buffer, appended_address_size);
+                    log_encoder, appended_address_buffer, appended_address_size);
         }
         else if (modified_data_buffer != NULL) {
             result = flb_log_event_encoder_set_body_from_raw_msgpack(
-                    ctx->log_encoder, modified_data_buffer, modified_data_size);
+                    log_encoder, modified_data_buffer, modified_data_size);
         }
         else {
             result = flb_log_event_encoder_set_body_from_raw_msgpack(
-                        ctx->log_encoder, data, data_size);
+                        log_encoder, data, data_size);
         }
     }
 
     if (result == FLB_EVENT_ENCODER_SUCCESS) {
-        result = flb_log_event_encoder_commit_record(ctx->log_encoder);
+        result = flb_log_event_encoder_commit_record(log_encoder);
     }
 
     if (result == FLB_EVENT_ENCODER_SUCCESS) {
-        flb_input_log_append(ctx->ins, NULL, 0,
-                             ctx->log_encoder->output_buffer,
-                             ctx->log_encoder->output_length);
         result = 0;
     }
     else {
         flb_plg_error(ctx->ins, "log event encoding error : %d", result);
+        flb_log_event_encoder_rollback_record(log_encoder);
 
         result = -1;
     }
 
-    flb_log_event_encoder_reset(ctx->log_encoder);
-
     if (modified_data_buffer != NULL) {
         flb_free(modified_data_buffer);
     }
@@ -257,7 +254,7 @@ int syslog_prot_process(struct syslog_conn *conn)
             if (flb_time_to_nanosec(&out_time) == 0L) {
                 flb_time_get(&out_time);
             }
-            pack_line(ctx, &out_time,
+            pack_line(ctx, conn->log_encoder, &out_time,
                       conn->connection,
                       out_buf, out_size,
                       p, len);
@@ -274,6 +271,13 @@ int syslog_prot_process(struct syslog_conn *conn)
         eof = conn->buf_data + conn->buf_parsed;
     }
 
+    if (conn->log_encoder->output_length > 0) {
+        flb_input_log_append(ctx->ins, NULL, 0,
+                             conn->log_encoder->output_buffer,
+                             conn->log_encoder->output_length);
+    }
+    flb_log_event_encoder_reset(conn->log_encoder);
+
     if (conn->buf_parsed > 0) {
         consume_bytes(conn->buf_data, conn->buf_parsed, conn->buf_len);
         conn->buf_len -= conn->buf_parsed;
@@ -284,19 +288,19 @@ int syslog_prot_process(struct syslog_conn *conn)
     return 0;
 }
 
-int syslog_prot_process_udp(struct syslog_conn *conn)
+/*
+ * Process one datagram, the record is encoded into 'conn->log_encoder' and
+ * appended by the caller with the rest of the batch.
+ */
+int syslog_prot_process_udp(struct syslog_conn *conn, char *buf, size_t size)
 {
     int ret;
     void *out_buf;
     size_t out_size;
     struct flb_time out_time = {0};
-    char *buf;
-    size_t size;
     struct flb_syslog *ctx;
     struct flb_connection *connection;
 
-    buf = conn->buf_data;
-    size = conn->buf_len;
     ctx = conn->ctx;
     connection = conn->connection;
 
@@ -306,7 +310,7 @@ int syslog_prot_process_udp(struct syslog_conn *conn)
         if (flb_time_to_double(&out_time) == 0) {
             flb_time_get(&out_time);
         }
-        pack_line(ctx, &out_time,
+        pack_line(ctx, conn->log_encoder, &out_time,
                   connection,
                   out_buf, out_size,
                   buf, size);
@@ -30,6 +30,6 @@
 #define FLB_MAP_EXPANSION_INVALID_VALUE_TYPE -3
 
 int syslog_prot_process(struct syslog_conn *conn);
-int syslog_prot_process_udp(struct syslog_conn *conn);
+int syslog_prot_process_udp(struct syslog_conn *conn, char *buf, size_t size);
 
 #endif
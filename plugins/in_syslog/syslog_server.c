@@ -216,6 +216,18 @@ int syslog_server_destroy(struct flb_syslog *ctx)
         ctx->collector_id = -1;
     }
 
+    if (ctx->receivers != NULL) {
+        flb_input_dgram_destroy(ctx->receivers);
+
+        ctx->receivers = NULL;
+    }
+
+    if (ctx->reader != NULL) {
+        flb_net_dgram_reader_destroy(ctx->reader);
+
+        ctx->reader = NULL;
+    }
+
     if (ctx->downstream != NULL) {
         flb_downstream_destroy(ctx->downstream);
 
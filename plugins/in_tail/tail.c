@@ -416,7 +416,12 @@ static int in_tail_init(struct flb_input_instance *in,
     }
     ctx->coll_fd_static = ret;
 
-    /* Register re-scan: time managed by 'refresh_interval' property */
+    /*
+     * Register re-scan: time managed by 'refresh_interval' property. When
+     * directory watches discover the new files of every pattern, the
+     * re-scan is only a safety net for missed events, see
+     * flb_tail_scan_callback().
+     */
     ret = flb_input_set_collector_time(in, flb_tail_scan_callback,
                                        ctx->refresh_interval_sec,
                                        ctx->refresh_interval_nsec,
@@ -705,6 +710,21 @@ static struct flb_config_map config_map[] = {
      0, FLB_TRUE, offsetof(struct flb_tail_config, skip_empty_lines),
      "Allows to skip empty lines."
     },
+    {
+     FLB_CONFIG_MAP_BOOL, "high_throughput", "false",
+     0, FLB_TRUE, offsetof(struct flb_tail_config, high_throughput),
+     "enable the high throughput read path for busy files: the file buffer "
+     "grows up to 'high_throughput.buffer_size' as a read-ahead window that "
+     "is only compacted when full, lines are split and encoded in batches "
+     "and the kernel is advised of the sequential access."
+    },
+    {
+     FLB_CONFIG_MAP_SIZE, "high_throughput.buffer_size", FLB_TAIL_HT_BUFFER,
+     0, FLB_TRUE, offsetof(struct flb_tail_config, high_throughput_buf_size),
+     "maximum size of the read-ahead buffer of a file in high throughput "
+     "mode, it's never lower than 'buffer_max_size'. Lines longer than "
+     "'buffer_max_size' are still handled as long lines."
+    },
 #ifdef __linux__
     {
      FLB_CONFIG_MAP_BOOL, "file_cache_advise", "true",
@@ -718,6 +738,20 @@ static struct flb_config_map config_map[] = {
      0, FLB_TRUE, offsetof(struct flb_tail_config, inotify_watcher),
      "set to false to use file stat watcher instead of inotify."
     },
+    {
+     FLB_CONFIG_MAP_BOOL, "inotify_watch_dirs", "false",
+     0, FLB_TRUE, offsetof(struct flb_tail_config, inotify_watch_dirs),
+     "discover new files through inotify watches on their parent directories. "
+     "When every path pattern could be watched, they are fully re-scanned "
+     "only every 'inotify_watch_dirs.refresh_interval', otherwise every "
+     "'refresh_interval'."
+    },
+    {
+     FLB_CONFIG_MAP_TIME, "inotify_watch_dirs.refresh_interval", "600",
+     0, FLB_TRUE, offsetof(struct flb_tail_config, inotify_watch_dirs_refresh),
+     "interval of the safety full re-scan of the path patterns when "
+     "'inotify_watch_dirs' is enabled."
+    },
 #endif
 #ifdef FLB_HAVE_REGEX
     {
@@ -765,6 +799,13 @@ static struct flb_config_map config_map[] = {
      "'true' verifies both the inode and filename, while 'false' checks only "
      "the inode (default)."
     },
+    {
+     FLB_CONFIG_MAP_TIME, "db.checkpoint_interval", "0",
+     0, FLB_TRUE, offsetof(struct flb_tail_config, db_checkpoint_interval),
+     "keep the file offsets in memory and commit them to the database in a "
+     "single transaction every interval, from a background thread. The "
+     "default (0) updates the database on every offset change."
+    },
 #endif
 
     /* Multiline Options */
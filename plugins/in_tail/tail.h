@@ -35,6 +35,7 @@
 
 /* Config */
 #define FLB_TAIL_CHUNK              "32768"   /* buffer chunk = 32KB      */
+#define FLB_TAIL_HT_BUFFER          "4M"      /* high throughput buffer   */
 #define FLB_TAIL_REFRESH                 60   /* refresh every 60 seconds */
 #define FLB_TAIL_ROTATE_WAIT             "5"  /* time to monitor after rotation */
 #define FLB_TAIL_STATIC_BATCH_SIZE      "50M" /* static batch size */
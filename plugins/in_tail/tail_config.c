@@ -205,6 +205,15 @@ struct flb_tail_config *flb_tail_config_create(struct flb_input_instance *ins,
         return NULL;
     }
 
+    /*
+     * The high throughput read-ahead buffer grows from buffer_chunk_size,
+     * it must hold at least a line of buffer_max_size bytes.
+     */
+    if (ctx->high_throughput == FLB_TRUE &&
+        ctx->high_throughput_buf_size < ctx->buf_max_size) {
+        ctx->high_throughput_buf_size = ctx->buf_max_size;
+    }
+
 #ifdef FLB_HAVE_REGEX
     /* Parser / Format */
     tmp = flb_input_get_property("parser", ins);
@@ -219,6 +228,23 @@ struct flb_tail_config *flb_tail_config_create(struct flb_input_instance *ins,
     mk_list_init(&ctx->files_static);
     mk_list_init(&ctx->files_event);
     mk_list_init(&ctx->files_rotated);
+#ifdef FLB_HAVE_INOTIFY
+    mk_list_init(&ctx->dir_patterns);
+    mk_list_init(&ctx->dirs);
+
+    if (ctx->inotify_watch_dirs && !ctx->inotify_watcher) {
+        flb_plg_warn(ctx->ins, "'inotify_watch_dirs' requires 'inotify_watcher', "
+                     "directory watches disabled");
+        ctx->inotify_watch_dirs = FLB_FALSE;
+    }
+
+    if (ctx->inotify_watch_dirs && ctx->inotify_watch_dirs_refresh <= 0) {
+        flb_plg_error(ctx->ins, "invalid 'inotify_watch_dirs.refresh_interval' "
+                      "config value");
+        flb_tail_config_destroy(ctx);
+        return NULL;
+    }
+#endif
 
     /* hash table for files lookups */
     ctx->static_hash = flb_hash_table_create(FLB_HASH_TABLE_EVICT_NONE, 1000, 0);
@@ -371,6 +397,16 @@ struct flb_tail_config *flb_tail_config_create(struct flb_input_instance *ins,
             return NULL;
         }
 
+        /* Offsets checkpoint thread */
+        if (ctx->db_checkpoint_interval > 0) {
+            ret = flb_tail_db_checkpoint_start(ctx);
+            if (ret == -1) {
+                flb_plg_error(ctx->ins, "could not start db checkpoint thread");
+                flb_tail_config_destroy(ctx);
+                return NULL;
+            }
+        }
+
     }
 #endif
 
@@ -414,6 +450,18 @@ struct flb_tail_config *flb_tail_config_create(struct flb_input_instance *ins,
                                                 "Total number of rotated files",
                                                 1, (char *[]) {"name"});
 
+    ctx->cmt_scans = cmt_counter_create(ins->cmt,
+                                        "fluentbit", "input",
+                                        "files_scans_total",
+                                        "Total number of path scans",
+                                        1, (char *[]) {"name"});
+
+    ctx->cmt_scan_duration = cmt_gauge_create(ins->cmt,
+                                              "fluentbit", "input",
+                                              "files_scan_duration_seconds",
+                                              "Duration of the last path scan",
+                                              1, (char *[]) {"name"});
+
     /* OLD metrics */
     flb_metrics_add(FLB_TAIL_METRIC_F_OPENED,
                     "files_opened", ctx->ins->metrics);
@@ -451,6 +499,9 @@ int flb_tail_config_destroy(struct flb_tail_config *config)
 
 #ifdef FLB_HAVE_SQLDB
     if (config->db != NULL) {
+        /* commit the pending offsets before releasing the statements */
+        flb_tail_db_checkpoint_stop(config);
+
         sqlite3_finalize(config->stmt_get_file);
         sqlite3_finalize(config->stmt_insert_file);
         sqlite3_finalize(config->stmt_delete_file);
@@ -97,11 +97,22 @@ struct flb_tail_config {
     int   file_cache_advise;   /* Use posix_fadvise for file access */
 #endif
 
+    /* Config: high throughput read path */
+    int    high_throughput;            /* enabled ?                    */
+    size_t high_throughput_buf_size;   /* read-ahead buffer per file   */
+
     int progress_check_interval;      /* watcher interval             */
     int progress_check_interval_nsec; /* watcher interval             */
 
 #ifdef FLB_HAVE_INOTIFY
     int   inotify_watcher;     /* enable/disable inotify monitor */
+    int   inotify_watch_dirs;  /* discover files through directory watches */
+    int   inotify_watch_dirs_refresh; /* full re-scan interval (seconds)  */
+    int   inotify_dirs_watched;       /* every pattern is fully watched   */
+    time_t inotify_dirs_scan;         /* last full scan                   */
+    struct mk_list dir_patterns;      /* path patterns split by level     */
+    struct mk_list dirs;              /* watched directories              */
+    struct flb_hash_table *dir_hash;  /* watch descriptor -> directory    */
 #endif
     flb_sds_t offset_key;      /* key name of file offset      */
 
@@ -112,6 +123,8 @@ struct flb_tail_config {
     int db_locking;
     int compare_filename;
     flb_sds_t db_journal_mode;
+    int db_checkpoint_interval;
+    struct flb_tail_db_checkpoint *db_checkpoint;
     sqlite3_stmt *stmt_get_file;
     sqlite3_stmt *stmt_insert_file;
     sqlite3_stmt *stmt_delete_file;
@@ -157,6 +170,8 @@ struct flb_tail_config {
     struct cmt_counter *cmt_files_opened;
     struct cmt_counter *cmt_files_closed;
     struct cmt_counter *cmt_files_rotated;
+    struct cmt_counter *cmt_scans;
+    struct cmt_gauge   *cmt_scan_duration;
 
     /* Hash: hash tables for quick acess to registered files */
     struct flb_hash_table *static_hash;
@@ -31,6 +31,292 @@ struct query_status {
     int64_t offset;
 };
 
+/*
+ * With an offsets checkpoint thread, the database handle is shared: every
+ * access from the collectors is serialized with the commits.
+ */
+static inline void db_lock(struct flb_tail_config *ctx)
+{
+    if (ctx->db_checkpoint) {
+        pthread_mutex_lock(&ctx->db_checkpoint->db_lock);
+    }
+}
+
+static inline void db_unlock(struct flb_tail_config *ctx)
+{
+    if (ctx->db_checkpoint) {
+        pthread_mutex_unlock(&ctx->db_checkpoint->db_lock);
+    }
+}
+
+static inline int checkpoint_key(char *buf, size_t size, uint64_t id)
+{
+    return snprintf(buf, size - 1, "%" PRIu64, id);
+}
+
+/* Store the latest offset of a file, it replaces any pending one */
+static int checkpoint_set(struct flb_tail_db_checkpoint *ckpt,
+                          uint64_t id, int64_t offset)
+{
+    int ret;
+    int len;
+    char key[32];
+    struct flb_tail_db_checkpoint_entry *entry;
+
+    len = checkpoint_key(key, sizeof(key), id);
+
+    pthread_mutex_lock(&ckpt->lock);
+
+    entry = flb_hash_table_get_ptr(ckpt->ht, key, len);
+    if (entry) {
+        entry->offset = offset;
+        pthread_mutex_unlock(&ckpt->lock);
+        return 0;
+    }
+
+    entry = flb_malloc(sizeof(struct flb_tail_db_checkpoint_entry));
+    if (!entry) {
+        flb_errno();
+        pthread_mutex_unlock(&ckpt->lock);
+        return -1;
+    }
+    entry->id = id;
+    entry->offset = offset;
+
+    ret = flb_hash_table_add(ckpt->ht, key, len, entry, 0);
+    if (ret == -1) {
+        flb_free(entry);
+        pthread_mutex_unlock(&ckpt->lock);
+        return -1;
+    }
+    mk_list_add(&entry->_head, &ckpt->entries);
+
+    pthread_mutex_unlock(&ckpt->lock);
+    return 0;
+}
+
+/* Get the pending offset of a file, returns FLB_TRUE if found */
+static int checkpoint_get(struct flb_tail_db_checkpoint *ckpt,
+                          uint64_t id, int64_t *offset)
+{
+    int len;
+    int found = FLB_FALSE;
+    char key[32];
+    struct flb_tail_db_checkpoint_entry *entry;
+
+    len = checkpoint_key(key, sizeof(key), id);
+
+    pthread_mutex_lock(&ckpt->lock);
+    entry = flb_hash_table_get_ptr(ckpt->ht, key, len);
+    if (entry) {
+        *offset = entry->offset;
+        found = FLB_TRUE;
+    }
+    pthread_mutex_unlock(&ckpt->lock);
+
+    return found;
+}
+
+/*
+ * Drop the pending offset of a deleted entry: the database can reuse the
+ * same id for the next inserted file.
+ */
+static void checkpoint_del(struct flb_tail_db_checkpoint *ckpt, uint64_t id)
+{
+    int len;
+    char key[32];
+    struct flb_tail_db_checkpoint_entry *entry;
+
+    len = checkpoint_key(key, sizeof(key), id);
+
+    pthread_mutex_lock(&ckpt->lock);
+    entry = flb_hash_table_get_ptr(ckpt->ht, key, len);
+    if (entry) {
+        flb_hash_table_del(ckpt->ht, key);
+        mk_list_del(&entry->_head);
+        flb_free(entry);
+    }
+    pthread_mutex_unlock(&ckpt->lock);
+}
+
+/* Commit all the pending offsets in a single transaction */
+static int checkpoint_commit(struct flb_tail_db_checkpoint *ckpt)
+{
+    int ret;
+    int count = 0;
+    int errors = 0;
+    uint64_t ts;
+    char key[32];
+    struct mk_list tmp_list;
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct flb_tail_db_checkpoint_entry *entry;
+    struct flb_tail_config *ctx = ckpt->ctx;
+
+    mk_list_init(&tmp_list);
+
+    /*
+     * Hold the database lock while taking the entries, so a file deleted
+     * meanwhile (and its id reused) never gets a stale offset.
+     */
+    pthread_mutex_lock(&ckpt->db_lock);
+
+    pthread_mutex_lock(&ckpt->lock);
+    mk_list_foreach_safe(head, tmp, &ckpt->entries) {
+        entry = mk_list_entry(head, struct flb_tail_db_checkpoint_entry, _head);
+        checkpoint_key(key, sizeof(key), entry->id);
+        flb_hash_table_del(ckpt->ht, key);
+        mk_list_del(&entry->_head);
+        mk_list_add(&entry->_head, &tmp_list);
+    }
+    pthread_mutex_unlock(&ckpt->lock);
+
+    if (mk_list_is_empty(&tmp_list) == 0) {
+        pthread_mutex_unlock(&ckpt->db_lock);
+        return 0;
+    }
+
+    ts = cfl_time_now();
+
+    ret = flb_sqldb_query(ctx->db, "BEGIN;", NULL, NULL);
+    if (ret != FLB_OK) {
+        flb_plg_error(ctx->ins, "db: could not begin offsets checkpoint");
+    }
+
+    mk_list_foreach_safe(head, tmp, &tmp_list) {
+        entry = mk_list_entry(head, struct flb_tail_db_checkpoint_entry, _head);
+
+        sqlite3_bind_int64(ctx->stmt_offset, 1, entry->offset);
+        sqlite3_bind_int64(ctx->stmt_offset, 2, entry->id);
+
+        ret = sqlite3_step(ctx->stmt_offset);
+        if (ret != SQLITE_DONE) {
+            errors++;
+        }
+
+        sqlite3_clear_bindings(ctx->stmt_offset);
+        sqlite3_reset(ctx->stmt_offset);
+
+        mk_list_del(&entry->_head);
+        flb_free(entry);
+        count++;
+    }
+
+    ret = flb_sqldb_query(ctx->db, "COMMIT;", NULL, NULL);
+
+    pthread_mutex_unlock(&ckpt->db_lock);
+
+    if (ret != FLB_OK || errors > 0) {
+        flb_plg_error(ctx->ins, "db: offsets checkpoint failed, "
+                      "entries=%i errors=%i", count, errors);
+        return -1;
+    }
+
+#ifdef FLB_HAVE_METRICS
+    cmt_histogram_observe(ckpt->cmt_commit, ts,
+                          (double) (cfl_time_now() - ts) / 1000000000.0,
+                          1, (char *[]) {(char *) flb_input_name(ctx->ins)});
+#endif
+
+    flb_plg_trace(ctx->ins, "db: offsets checkpoint committed, entries=%i",
+                  count);
+    return 0;
+}
+
+static void *checkpoint_worker(void *data)
+{
+    struct timespec ts;
+    struct flb_tail_db_checkpoint *ckpt = data;
+
+    pthread_mutex_lock(&ckpt->lock);
+    while (!ckpt->exit) {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += ckpt->interval;
+        pthread_cond_timedwait(&ckpt->cond, &ckpt->lock, &ts);
+        if (ckpt->exit) {
+            break;
+        }
+
+        pthread_mutex_unlock(&ckpt->lock);
+        checkpoint_commit(ckpt);
+        pthread_mutex_lock(&ckpt->lock);
+    }
+    pthread_mutex_unlock(&ckpt->lock);
+
+    return NULL;
+}
+
+int flb_tail_db_checkpoint_start(struct flb_tail_config *ctx)
+{
+    int ret;
+    struct flb_tail_db_checkpoint *ckpt;
+
+    ckpt = flb_calloc(1, sizeof(struct flb_tail_db_checkpoint));
+    if (!ckpt) {
+        flb_errno();
+        return -1;
+    }
+    ckpt->ctx = ctx;
+    ckpt->interval = ctx->db_checkpoint_interval;
+    mk_list_init(&ckpt->entries);
+    pthread_mutex_init(&ckpt->db_lock, NULL);
+    pthread_mutex_init(&ckpt->lock, NULL);
+    pthread_cond_init(&ckpt->cond, NULL);
+
+    ckpt->ht = flb_hash_table_create(FLB_HASH_TABLE_EVICT_NONE, 1000, 0);
+    if (!ckpt->ht) {
+        flb_free(ckpt);
+        return -1;
+    }
+
+#ifdef FLB_HAVE_METRICS
+    ckpt->cmt_commit = cmt_histogram_create(ctx->ins->cmt,
+                                            "fluentbit", "input",
+                                            "db_checkpoint_duration_seconds",
+                                            "Duration of the offsets "
+                                            "checkpoint commits",
+                                            cmt_histogram_buckets_default_create(),
+                                            1, (char *[]) {"name"});
+#endif
+
+    ret = pthread_create(&ckpt->tid, NULL, checkpoint_worker, ckpt);
+    if (ret != 0) {
+        flb_hash_table_destroy(ckpt->ht);
+        flb_free(ckpt);
+        return -1;
+    }
+
+    ctx->db_checkpoint = ckpt;
+    flb_plg_info(ctx->ins, "db: offsets checkpoint every %i seconds",
+                 ckpt->interval);
+    return 0;
+}
+
+/* Stop the thread and commit what is still pending */
+void flb_tail_db_checkpoint_stop(struct flb_tail_config *ctx)
+{
+    struct flb_tail_db_checkpoint *ckpt = ctx->db_checkpoint;
+
+    if (!ckpt) {
+        return;
+    }
+
+    pthread_mutex_lock(&ckpt->lock);
+    ckpt->exit = FLB_TRUE;
+    pthread_cond_signal(&ckpt->cond);
+    pthread_mutex_unlock(&ckpt->lock);
+    pthread_join(ckpt->tid, NULL);
+
+    checkpoint_commit(ckpt);
+
+    ctx->db_checkpoint = NULL;
+    flb_hash_table_destroy(ckpt->ht);
+    pthread_cond_destroy(&ckpt->cond);
+    pthread_mutex_destroy(&ckpt->lock);
+    pthread_mutex_destroy(&ckpt->db_lock);
+    flb_free(ckpt);
+}
+
 /* Open or create database required by tail plugin */
 struct flb_sqldb *flb_tail_db_open(const char *path,
                                    struct flb_input_instance *in,
@@ -112,6 +398,10 @@ static int flb_tail_db_file_delete_by_id(struct flb_tail_config *ctx,
     sqlite3_clear_bindings(ctx->stmt_delete_file);
     sqlite3_reset(ctx->stmt_delete_file);
 
+    if (ctx->db_checkpoint) {
+        checkpoint_del(ctx->db_checkpoint, id);
+    }
+
     if (ret != SQLITE_DONE) {
         flb_plg_error(ctx->ins, "db: error deleting stale entry from database:"
                       " id=%"PRIu64, id);
@@ -253,12 +543,13 @@ static int stmt_add_param_concat(struct flb_tail_config *ctx,
     return 0;
 }
 
-int flb_tail_db_file_set(struct flb_tail_file *file,
-                         struct flb_tail_config *ctx)
+static int db_file_set(struct flb_tail_file *file,
+                       struct flb_tail_config *ctx)
 {
     int ret;
     uint64_t id = 0;
     off_t offset = 0;
+    int64_t pending;
     uint64_t inode = 0;
 
     /* Check if the file exists */
@@ -281,17 +572,40 @@ int flb_tail_db_file_set(struct flb_tail_file *file,
     else {
         file->db_id = id;
         file->offset = offset;
+
+        /* an offset not committed yet is the latest one */
+        if (ctx->db_checkpoint &&
+            checkpoint_get(ctx->db_checkpoint, id, &pending) == FLB_TRUE) {
+            file->offset = pending;
+        }
     }
 
     return 0;
 }
 
+int flb_tail_db_file_set(struct flb_tail_file *file,
+                         struct flb_tail_config *ctx)
+{
+    int ret;
+
+    db_lock(ctx);
+    ret = db_file_set(file, ctx);
+    db_unlock(ctx);
+
+    return ret;
+}
+
 /* Update Offset v2 */
 int flb_tail_db_file_offset(struct flb_tail_file *file,
                             struct flb_tail_config *ctx)
 {
     int ret;
 
+    /* committed later by the checkpoint thread */
+    if (ctx->db_checkpoint) {
+        return checkpoint_set(ctx->db_checkpoint, file->db_id, file->offset);
+    }
+
     /* Bind parameters */
     sqlite3_bind_int64(ctx->stmt_offset, 1, file->offset);
     sqlite3_bind_int64(ctx->stmt_offset, 2, file->db_id);
@@ -327,6 +641,8 @@ int flb_tail_db_file_rotate(const char *new_name,
 {
     int ret;
 
+    db_lock(ctx);
+
     /* Bind parameters */
     sqlite3_bind_text(ctx->stmt_rotate_file, 1, new_name, -1, 0);
     sqlite3_bind_int64(ctx->stmt_rotate_file, 2, file->db_id);
@@ -336,6 +652,8 @@ int flb_tail_db_file_rotate(const char *new_name,
     sqlite3_clear_bindings(ctx->stmt_rotate_file);
     sqlite3_reset(ctx->stmt_rotate_file);
 
+    db_unlock(ctx);
+
     if (ret != SQLITE_DONE) {
         return -1;
     }
@@ -349,6 +667,8 @@ int flb_tail_db_file_delete(struct flb_tail_file *file,
 {
     int ret;
 
+    db_lock(ctx);
+
     /* Bind parameters */
     sqlite3_bind_int64(ctx->stmt_delete_file, 1, file->db_id);
     ret = sqlite3_step(ctx->stmt_delete_file);
@@ -356,6 +676,12 @@ int flb_tail_db_file_delete(struct flb_tail_file *file,
     sqlite3_clear_bindings(ctx->stmt_delete_file);
     sqlite3_reset(ctx->stmt_delete_file);
 
+    if (ctx->db_checkpoint) {
+        checkpoint_del(ctx->db_checkpoint, file->db_id);
+    }
+
+    db_unlock(ctx);
+
     if (ret != SQLITE_DONE) {
         flb_plg_error(ctx->ins, "db: error deleting entry from database: %s",
                       file->name);
@@ -369,9 +695,7 @@ int flb_tail_db_file_delete(struct flb_tail_file *file,
 /*
  * Delete stale file from database
  */
-int flb_tail_db_stale_file_delete(struct flb_input_instance *ins,
-                                  struct flb_config *config,
-                                  struct flb_tail_config *ctx)
+static int db_stale_file_delete(struct flb_tail_config *ctx)
 {
     int ret = -1;
     size_t sql_size;
@@ -490,3 +814,20 @@ int flb_tail_db_stale_file_delete(struct flb_input_instance *ins,
 
     return 0;
 }
+
+int flb_tail_db_stale_file_delete(struct flb_input_instance *ins,
+                                  struct flb_config *config,
+                                  struct flb_tail_config *ctx)
+{
+    int ret;
+
+    if (!ctx->db) {
+        return 0;
+    }
+
+    db_lock(ctx);
+    ret = db_stale_file_delete(ctx);
+    db_unlock(ctx);
+
+    return ret;
+}
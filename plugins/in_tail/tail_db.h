@@ -25,6 +25,31 @@
 
 #include "tail_file.h"
 
+#include <pthread.h>
+
+/*
+ * Offsets checkpoint: the offsets updates are kept in memory and a background
+ * thread commits them in a single transaction every 'db.checkpoint_interval'.
+ */
+struct flb_tail_db_checkpoint_entry {
+    uint64_t id;
+    int64_t offset;
+    struct mk_list _head;
+};
+
+struct flb_tail_db_checkpoint {
+    int exit;
+    int interval;
+    pthread_t tid;
+    pthread_mutex_t db_lock;       /* database handle and statements */
+    pthread_mutex_t lock;          /* pending offsets                */
+    pthread_cond_t cond;
+    struct mk_list entries;
+    struct flb_hash_table *ht;     /* database id -> pending entry   */
+    struct cmt_histogram *cmt_commit;
+    struct flb_tail_config *ctx;
+};
+
 struct flb_sqldb *flb_tail_db_open(const char *path,
                                    struct flb_input_instance *in,
                                    struct flb_tail_config *ctx,
@@ -43,4 +68,7 @@ int flb_tail_db_file_delete(struct flb_tail_file *file,
 int flb_tail_db_stale_file_delete(struct flb_input_instance *ins,
                                   struct flb_config *config,
                                   struct flb_tail_config *ctx);
+
+int flb_tail_db_checkpoint_start(struct flb_tail_config *ctx);
+void flb_tail_db_checkpoint_stop(struct flb_tail_config *ctx);
 #endif
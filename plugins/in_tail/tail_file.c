@@ -421,7 +421,144 @@ static int ml_stream_buffer_flush(struct flb_tail_config *ctx, struct flb_tail_f
     return 0;
 }
 
-static int process_content(struct flb_tail_file *file, size_t *bytes)
+/*
+ * High throughput path for raw lines: the line breaks are located first for
+ * a batch of lines (memchr is vectorized by the C library), then the whole
+ * batch is encoded with a single timestamp.
+ */
+#define FLB_TAIL_LINE_BATCH     256
+
+struct tail_line_span {
+    size_t offset;              /* line position in the buffer            */
+    size_t length;              /* line length without the line break     */
+};
+
+/*
+ * A line reached buffer_max_size: it's skipped if skip_long_lines is set,
+ * otherwise the file can not be processed. Returns -1 in that case.
+ */
+static int tail_file_long_line(struct flb_tail_file *file)
+{
+    struct flb_tail_config *ctx = file->config;
+
+    if (ctx->skip_long_lines == FLB_FALSE) {
+        flb_plg_error(ctx->ins, "file=%s requires a larger buffer size, "
+                      "lines are too long. Skipping file.", file->name);
+        return -1;
+    }
+
+    /* Warn the user */
+    if (file->skip_warn == FLB_FALSE) {
+        flb_plg_warn(ctx->ins, "file=%s have long lines. "
+                     "Skipping long lines.", file->name);
+        file->skip_warn = FLB_TRUE;
+    }
+
+    return 0;
+}
+
+static int process_content_lines(struct flb_tail_file *file,
+                                 char *buf, size_t buf_len, size_t *bytes)
+{
+    int i;
+    int count;
+    int lines = 0;
+    int ret = 0;
+    size_t len;
+    size_t offset = 0;
+    char *line;
+    char *p;
+    struct tail_line_span spans[FLB_TAIL_LINE_BATCH];
+    struct flb_tail_config *ctx = file->config;
+
+    /* reset last processed bytes */
+    file->last_processed_bytes = 0;
+
+    /* Skip null characters from the head (sometimes introduced by copy-truncate log rotation) */
+    while (offset < buf_len && buf[offset] == '\0') {
+        offset++;
+    }
+
+    /* drop the remaining of a long line */
+    if (file->skip_next == FLB_TRUE) {
+        p = memchr(buf + offset, '\n', buf_len - offset);
+        if (!p) {
+            file->parsed = buf_len;
+            *bytes = buf_len;
+            return 0;
+        }
+        offset = (p - buf) + 1;
+        file->skip_next = FLB_FALSE;
+    }
+
+    do {
+        count = 0;
+        while (count < FLB_TAIL_LINE_BATCH && offset < buf_len &&
+               (p = memchr(buf + offset, '\n', buf_len - offset))) {
+            spans[count].offset = offset;
+            spans[count].length = p - (buf + offset);
+            offset += spans[count].length + 1;
+            count++;
+        }
+
+        for (i = 0; i < count; i++) {
+            line = buf + spans[i].offset;
+            len = spans[i].length;
+
+            if (ctx->skip_empty_lines) {
+                if (len == 0 || (len == 1 && line[0] == '\r')) {
+                    continue;
+                }
+            }
+
+            /*
+             * The read-ahead buffer can hold lines over buffer_max_size,
+             * they are handled as they are in the regular read path.
+             */
+            if (len >= ctx->buf_max_size) {
+                ret = tail_file_long_line(file);
+                if (ret == -1) {
+                    break;
+                }
+                continue;
+            }
+
+            /* Process '\r\n' */
+            if (len >= 2 && line[len - 1] == '\r') {
+                len--;
+            }
+
+            /* every record takes its own ingestion time */
+            flb_tail_file_pack_line(NULL, line, len, file, spans[i].offset);
+            lines++;
+        }
+    } while (count == FLB_TAIL_LINE_BATCH && ret == 0);
+
+    if (ret == -1) {
+        flb_log_event_encoder_reset(file->sl_log_event_encoder);
+        return -1;
+    }
+
+    file->parsed = buf_len;
+    file->last_processed_bytes = offset;
+    *bytes = offset;
+
+    if (lines > 0 && file->sl_log_event_encoder->output_length > 0) {
+        flb_input_log_append_records(ctx->ins,
+                                     lines,
+                                     file->tag_buf,
+                                     file->tag_len,
+                                     file->sl_log_event_encoder->output_buffer,
+                                     file->sl_log_event_encoder->output_length);
+
+        flb_log_event_encoder_reset(file->sl_log_event_encoder);
+    }
+
+    return lines;
+}
+
+static int process_content(struct flb_tail_file *file,
+                           char *buf, size_t buf_len, size_t *bytes)
 {
     size_t len;
     int lines = 0;
@@ -443,9 +580,15 @@ static int process_content(struct flb_tail_file *file, size_t *bytes)
 
     ctx = (struct flb_tail_config *) file->config;
 
+    /* raw lines, nothing to parse or to join */
+    if (ctx->high_throughput && !ctx->ml_ctx && !ctx->docker_mode &&
+        !ctx->parser && !ctx->multiline) {
+        return process_content_lines(file, buf, buf_len, bytes);
+    }
+
     /* Parse the data content */
-    data = file->buf_data;
-    end = data + file->buf_len;
+    data = buf;
+    end = data + buf_len;
 
     /* reset last processed bytes */
     file->last_processed_bytes = 0;
@@ -466,6 +609,16 @@ static int process_content(struct flb_tail_file *file, size_t *bytes)
             continue;
         }
 
+        /* the high throughput buffer can hold lines over buffer_max_size */
+        if (ctx->high_throughput && len >= ctx->buf_max_size) {
+            if (tail_file_long_line(file) == -1) {
+                return -1;
+            }
+            data += len + 1;
+            processed_bytes += len + 1;
+            continue;
+        }
+
         /*
          * Empty line (just breakline)
          * ---------------------------
@@ -602,7 +755,7 @@ static int process_content(struct flb_tail_file *file, size_t *bytes)
         file->parsed = 0;
         file->last_processed_bytes += processed_bytes;
     }
-    file->parsed = file->buf_len;
+    file->parsed = buf_len;
 
     if (lines > 0) {
         /* Append buffer content to a chunk */
@@ -620,7 +773,7 @@ static int process_content(struct flb_tail_file *file, size_t *bytes)
         }
     }
     else if (file->skip_next) {
-        *bytes = file->buf_len;
+        *bytes = buf_len;
     }
     else {
         *bytes = processed_bytes;
@@ -960,6 +1113,13 @@ int flb_tail_file_append(char *path, struct stat *st, int mode,
         return -1;
     }
 
+#ifdef __linux__
+    if (ctx->high_throughput) {
+        /* tell the kernel the file is read once, front to back */
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+#endif
+
     file = flb_calloc(1, sizeof(struct flb_tail_file));
     if (!file) {
         flb_errno();
@@ -998,6 +1158,7 @@ int flb_tail_file_append(char *path, struct stat *st, int mode,
     file->inode     = st->st_ino;
     file->offset    = 0;
     file->size      = st->st_size;
+    file->buf_start = 0;
     file->buf_len   = 0;
     file->parsed    = 0;
     file->config    = ctx;
@@ -1351,6 +1512,7 @@ static int adjust_counters(struct flb_tail_config *ctx, struct flb_tail_file *fi
         flb_plg_debug(ctx->ins, "inode=%"PRIu64" file truncated %s",
                       file->inode, file->name);
         file->offset = offset;
+        file->buf_start = 0;
         file->buf_len = 0;
 
         /* Update offset in the database file */
@@ -1368,6 +1530,47 @@ static int adjust_counters(struct flb_tail_config *ctx, struct flb_tail_file *fi
     return FLB_TAIL_OK;
 }
 
+/*
+ * High throughput: a read that filled the buffer means the file is busy, grow
+ * the buffer so the next reads are larger. Pages already copied are dropped
+ * from the cache one range at a time.
+ */
+static void tail_file_read_ahead(struct flb_tail_file *file,
+                                 ssize_t raw_data_length, int buffer_full)
+{
+    size_t size;
+    char *tmp;
+    struct flb_tail_config *ctx = file->config;
+
+#ifdef __linux__
+    if (ctx->file_cache_advise && raw_data_length > 0) {
+        posix_fadvise(file->fd, file->offset - raw_data_length,
+                      raw_data_length, POSIX_FADV_DONTNEED);
+    }
+#endif
+
+    if (!buffer_full || file->buf_size >= ctx->high_throughput_buf_size) {
+        return;
+    }
+
+    size = file->buf_size * 2;
+    if (size > ctx->high_throughput_buf_size) {
+        size = ctx->high_throughput_buf_size;
+    }
+
+    tmp = flb_realloc(file->buf_data, size);
+    if (!tmp) {
+        /* not fatal, keep the current buffer */
+        flb_errno();
+        return;
+    }
+
+    flb_plg_trace(ctx->ins, "file=%s increase read-ahead buffer size "
+                  "%lu => %lu bytes", file->name, file->buf_size, size);
+    file->buf_data = tmp;
+    file->buf_size = size;
+}
+
 int flb_tail_file_chunk(struct flb_tail_file *file)
 {
     size_t                  decompression_buffer_capacity;
@@ -1378,6 +1581,7 @@ int flb_tail_file_chunk(struct flb_tail_file *file)
     size_t                  processed_bytes;
     uint8_t                *read_buffer;
     size_t                  read_size;
+    size_t                  buf_max_size;
     size_t                  size;
     char                   *tmp;
     int                     ret;
@@ -1390,6 +1594,27 @@ int flb_tail_file_chunk(struct flb_tail_file *file)
         return FLB_TAIL_BUSY;
     }
 
+    /*
+     * High throughput: the buffer is a sliding window over the file, the
+     * pending bytes of a partial line are moved to the beginning only when
+     * there is no room left for a new read.
+     */
+    if (ctx->high_throughput && file->buf_start > 0 &&
+        (file->buf_size - file->buf_len - 1) < ctx->buf_chunk_size) {
+        consume_bytes(file->buf_data, file->buf_start, file->buf_len);
+        file->buf_len -= file->buf_start;
+        file->buf_start = 0;
+    }
+
+    /*
+     * In high throughput mode the buffer may grow beyond buffer_max_size to
+     * read ahead, lines over buffer_max_size are dropped when split.
+     */
+    buf_max_size = ctx->buf_max_size;
+    if (ctx->high_throughput) {
+        buf_max_size = ctx->high_throughput_buf_size;
+    }
+
     file_buffer_capacity = (file->buf_size - file->buf_len) - 1;
     stream_data_length = 0;
 
@@ -1398,28 +1623,20 @@ int flb_tail_file_chunk(struct flb_tail_file *file)
          * If there is no more room for more data, try to increase the
          * buffer under the limit of buffer_max_size.
          */
-        if (file->buf_size >= ctx->buf_max_size) {
-            if (ctx->skip_long_lines == FLB_FALSE) {
-                flb_plg_error(ctx->ins, "file=%s requires a larger buffer size, "
-                          "lines are too long. Skipping file.", file->name);
+        if (file->buf_size >= buf_max_size) {
+            if (tail_file_long_line(file) == -1) {
                 return FLB_TAIL_ERROR;
             }
 
-            /* Warn the user */
-            if (file->skip_warn == FLB_FALSE) {
-                flb_plg_warn(ctx->ins, "file=%s have long lines. "
-                             "Skipping long lines.", file->name);
-                file->skip_warn = FLB_TRUE;
-            }
-
             /* Do buffer adjustments */
+            file->buf_start = 0;
             file->buf_len = 0;
             file->skip_next = FLB_TRUE;
         }
         else {
             size = file->buf_size + ctx->buf_chunk_size;
-            if (size > ctx->buf_max_size) {
-                size = ctx->buf_max_size;
+            if (size > buf_max_size) {
+                size = buf_max_size;
             }
 
             /* Increase the buffer size */
@@ -1443,7 +1660,7 @@ int flb_tail_file_chunk(struct flb_tail_file *file)
     }
 
     #ifdef __linux__
-    if (ctx->file_cache_advise) {
+    if (ctx->file_cache_advise && !ctx->high_throughput) {
         if (posix_fadvise(file->fd, 0, 0, POSIX_FADV_DONTNEED) == -1) {
             flb_errno();
             flb_plg_error(ctx->ins, "error during posix_fadvise");
@@ -1545,6 +1762,11 @@ int flb_tail_file_chunk(struct flb_tail_file *file)
         file->buf_len += stream_data_length;
         file->buf_data[file->buf_len] = '\0';
 
+        if (ctx->high_throughput) {
+            tail_file_read_ahead(file, raw_data_length,
+                                 stream_data_length == file_buffer_capacity);
+        }
+
         /* Now that we have some data in the buffer, call the data processor
          * which aims to cut lines and register the entries into the engine.
          *
@@ -1552,7 +1774,10 @@ int flb_tail_file_chunk(struct flb_tail_file *file)
          * now. It may need to get back a few bytes at the beginning of a new
          * line.
          */
-        ret = process_content(file, &processed_bytes);
+        ret = process_content(file,
+                              file->buf_data + file->buf_start,
+                              file->buf_len - file->buf_start,
+                              &processed_bytes);
         if (ret < 0) {
             flb_plg_debug(ctx->ins, "inode=%"PRIu64" file=%s process content ERROR",
                           file->inode, file->name);
@@ -1561,8 +1786,18 @@ int flb_tail_file_chunk(struct flb_tail_file *file)
 
         /* Adjust the file offset and buffer */
         file->stream_offset += processed_bytes;
-        consume_bytes(file->buf_data, processed_bytes, file->buf_len);
-        file->buf_len -= processed_bytes;
+
+        if (ctx->high_throughput) {
+            file->buf_start += processed_bytes;
+            if (file->buf_start == file->buf_len) {
+                file->buf_start = 0;
+                file->buf_len = 0;
+            }
+        }
+        else {
+            consume_bytes(file->buf_data, processed_bytes, file->buf_len);
+            file->buf_len -= processed_bytes;
+        }
         file->buf_data[file->buf_len] = '\0';
 
 #ifdef FLB_HAVE_SQLDB
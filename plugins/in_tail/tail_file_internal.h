@@ -87,6 +87,7 @@ struct flb_tail_file {
 
     /* content parsing, positions and buffer */
     size_t parsed;
+    size_t buf_start;           /* first pending byte (high throughput)  */
     size_t buf_len;
     size_t buf_size;
     char *buf_data;
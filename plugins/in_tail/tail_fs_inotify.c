@@ -32,11 +32,16 @@
 #include "tail_file.h"
 #include "tail_db.h"
 #include "tail_signal.h"
+#include "tail_scan.h"
+#include "tail_fs_inotify.h"
 
 #include <limits.h>
 #include <fcntl.h>
+#include <glob.h>
+#include <fnmatch.h>
 
 #include <sys/ioctl.h>
+#include <dirent.h>
 
 static int debug_event_mask(struct flb_tail_config *ctx,
                             struct flb_tail_file *file,
@@ -163,28 +168,396 @@ static int flb_tail_fs_add_rotated(struct flb_tail_file *file)
     return tail_fs_add(file, FLB_FALSE);
 }
 
-static int tail_fs_event(struct flb_input_instance *ins,
-                         struct flb_config *config, void *in_context)
+/* Directory watches: discover new files without re-scanning the paths */
+#define FLB_TAIL_DIR_MASK   (IN_CREATE | IN_MOVED_TO | IN_ONLYDIR)
+#define FLB_TAIL_DIR_FNM    (FNM_PATHNAME | FNM_PERIOD)
+
+static flb_sds_t dir_path_join(const char *dir, const char *name)
+{
+    size_t len;
+    flb_sds_t path;
+
+    len = strlen(dir);
+    path = flb_sds_create_size(len + strlen(name) + 2);
+    if (!path) {
+        return NULL;
+    }
+
+    flb_sds_cat_safe(&path, dir, len);
+    if (len == 0 || dir[len - 1] != '/') {
+        flb_sds_cat_safe(&path, "/", 1);
+    }
+    flb_sds_cat_safe(&path, name, strlen(name));
+
+    return path;
+}
+
+static void dir_pattern_destroy(struct flb_tail_dir_pattern *dp)
+{
+    int i;
+
+    for (i = 0; i < dp->levels; i++) {
+        if (dp->comps && dp->comps[i]) {
+            flb_sds_destroy(dp->comps[i]);
+        }
+        if (dp->prefix && dp->prefix[i]) {
+            flb_sds_destroy(dp->prefix[i]);
+        }
+    }
+    flb_free(dp->comps);
+    flb_free(dp->prefix);
+
+    if (dp->path) {
+        flb_sds_destroy(dp->path);
+    }
+    if (dp->pattern) {
+        flb_sds_destroy(dp->pattern);
+    }
+    flb_free(dp);
+}
+
+/*
+ * Split an absolute path pattern at its first component with wildcards: for
+ * a Kubernetes pattern like '/var/log/pods/<ns_pod>/<container>/<n>.log' with
+ * wildcards on the three last components, '/var/log/pods' is watched and so
+ * are the matching directories of the two following levels.
+ */
+static struct flb_tail_dir_pattern *dir_pattern_create(const char *path)
+{
+    int i;
+    int count = 0;
+    int first = -1;
+    size_t len;
+    const char *p;
+    const char *end;
+    const char **tokens;
+    size_t *tokens_len;
+    flb_sds_t base;
+    struct flb_tail_dir_pattern *dp;
+
+    if (path[0] != '/') {
+        return NULL;
+    }
+
+    /* count the path components */
+    for (p = path; *p; p = end) {
+        while (*p == '/') {
+            p++;
+        }
+        if (*p == '\0') {
+            break;
+        }
+        end = strchr(p, '/');
+        if (!end) {
+            end = p + strlen(p);
+        }
+        count++;
+    }
+
+    if (count == 0) {
+        return NULL;
+    }
+
+    tokens = flb_calloc(count, sizeof(char *));
+    tokens_len = flb_calloc(count, sizeof(size_t));
+    dp = flb_calloc(1, sizeof(struct flb_tail_dir_pattern));
+    if (!tokens || !tokens_len || !dp) {
+        flb_errno();
+        flb_free(tokens);
+        flb_free(tokens_len);
+        flb_free(dp);
+        return NULL;
+    }
+
+    i = 0;
+    for (p = path; *p; p = end) {
+        while (*p == '/') {
+            p++;
+        }
+        if (*p == '\0') {
+            break;
+        }
+        end = strchr(p, '/');
+        if (!end) {
+            end = p + strlen(p);
+        }
+        len = end - p;
+        tokens[i] = p;
+        tokens_len[i] = len;
+
+        if (first == -1 &&
+            (memchr(p, '*', len) || memchr(p, '?', len) || memchr(p, '[', len))) {
+            first = i;
+        }
+        i++;
+    }
+
+    /* no wildcards: watch the parent directory of the file */
+    if (first == -1) {
+        first = count - 1;
+    }
+
+    dp->levels = count - first;
+    dp->path = flb_sds_create(path);
+    dp->comps = flb_calloc(dp->levels, sizeof(flb_sds_t));
+    dp->prefix = flb_calloc(dp->levels, sizeof(flb_sds_t));
+    if (!dp->path || !dp->comps || !dp->prefix) {
+        flb_errno();
+        goto error;
+    }
+
+    base = flb_sds_create_size(strlen(path) + 1);
+    if (!base) {
+        goto error;
+    }
+    if (first == 0) {
+        flb_sds_cat_safe(&base, "/", 1);
+    }
+    for (i = 0; i < first; i++) {
+        flb_sds_cat_safe(&base, "/", 1);
+        flb_sds_cat_safe(&base, tokens[i], tokens_len[i]);
+    }
+    dp->prefix[0] = base;
+
+    for (i = 0; i < dp->levels; i++) {
+        dp->comps[i] = flb_sds_create_len(tokens[first + i],
+                                          tokens_len[first + i]);
+        if (!dp->comps[i]) {
+            goto error;
+        }
+
+        if (i > 0) {
+            dp->prefix[i] = dir_path_join(dp->prefix[i - 1], dp->comps[i - 1]);
+            if (!dp->prefix[i]) {
+                goto error;
+            }
+        }
+    }
+
+    dp->pattern = dir_path_join(dp->prefix[dp->levels - 1],
+                                dp->comps[dp->levels - 1]);
+    if (!dp->pattern) {
+        goto error;
+    }
+
+    flb_free(tokens);
+    flb_free(tokens_len);
+    return dp;
+
+error:
+    flb_free(tokens);
+    flb_free(tokens_len);
+    dir_pattern_destroy(dp);
+    return NULL;
+}
+
+static struct flb_tail_dir *tail_fs_dir_get(struct flb_tail_config *ctx, int wd)
+{
+    int len;
+    char key[32];
+
+    len = snprintf(key, sizeof(key) - 1, "%i", wd);
+    return flb_hash_table_get_ptr(ctx->dir_hash, key, len);
+}
+
+static void tail_fs_dir_destroy(struct flb_tail_config *ctx,
+                                struct flb_tail_dir *dir)
+{
+    char key[32];
+
+    snprintf(key, sizeof(key) - 1, "%i", dir->wd);
+    flb_hash_table_del(ctx->dir_hash, key);
+    mk_list_del(&dir->_head);
+    flb_sds_destroy(dir->path);
+    flb_free(dir);
+}
+
+static int tail_fs_dir_add(struct flb_tail_config *ctx, const char *path)
+{
+    int wd;
+    int len;
+    int ret;
+    char key[32];
+    struct flb_tail_dir *dir;
+
+    /* an existing watch returns the same descriptor */
+    wd = inotify_add_watch(ctx->fd_notify, path, FLB_TAIL_DIR_MASK);
+    if (wd == -1) {
+        if (errno == ENOSPC) {
+            flb_plg_error(ctx->ins, "inotify: the user limit on the total "
+                          "number of inotify watches was reached (ENOSPC)");
+        }
+        else {
+            flb_plg_debug(ctx->ins, "cannot watch directory %s", path);
+        }
+        return -1;
+    }
+
+    if (tail_fs_dir_get(ctx, wd)) {
+        return 0;
+    }
+
+    dir = flb_calloc(1, sizeof(struct flb_tail_dir));
+    if (!dir) {
+        flb_errno();
+        inotify_rm_watch(ctx->fd_notify, wd);
+        return -1;
+    }
+    dir->wd = wd;
+    dir->path = flb_sds_create(path);
+    if (!dir->path) {
+        flb_free(dir);
+        inotify_rm_watch(ctx->fd_notify, wd);
+        return -1;
+    }
+
+    len = snprintf(key, sizeof(key) - 1, "%i", wd);
+    ret = flb_hash_table_add(ctx->dir_hash, key, len, dir, 0);
+    if (ret == -1) {
+        flb_sds_destroy(dir->path);
+        flb_free(dir);
+        inotify_rm_watch(ctx->fd_notify, wd);
+        return -1;
+    }
+    mk_list_add(&dir->_head, &ctx->dirs);
+
+    flb_plg_debug(ctx->ins, "inotify_dir_add(): watch_fd=%i dir=%s", wd, path);
+    return 0;
+}
+
+/*
+ * Watch the directory 'path' at 'level' of the pattern and the matching
+ * directories below it. With 'scan_files', the files found at the last level
+ * are registered too (used for directories created after the last scan).
+ * Returns -1 if any of the directories could not be watched.
+ */
+static int tail_fs_dir_walk(struct flb_tail_config *ctx,
+                            struct flb_tail_dir_pattern *dp,
+                            const char *path, int level, int scan_files)
+{
+    int ret = 0;
+    int last;
+    DIR *d;
+    struct dirent *ent;
+    struct stat st;
+    flb_sds_t child;
+
+    if (tail_fs_dir_add(ctx, path) == -1) {
+        return -1;
+    }
+
+    last = (level == dp->levels - 1);
+    if (last && !scan_files) {
+        return 0;
+    }
+
+    d = opendir(path);
+    if (!d) {
+        return -1;
+    }
+
+    while ((ent = readdir(d)) != NULL) {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+            continue;
+        }
+
+        if (fnmatch(dp->comps[level], ent->d_name, FNM_PERIOD) != 0) {
+            continue;
+        }
+
+        child = dir_path_join(path, ent->d_name);
+        if (!child) {
+            break;
+        }
+
+        if (last) {
+            flb_tail_scan_file(child, ctx);
+        }
+        else if (stat(child, &st) == 0 && S_ISDIR(st.st_mode)) {
+            if (tail_fs_dir_walk(ctx, dp, child, level + 1, scan_files) == -1) {
+                ret = -1;
+            }
+        }
+        flb_sds_destroy(child);
+    }
+    closedir(d);
+
+    return ret;
+}
+
+static int tail_fs_dir_event(struct flb_tail_config *ctx,
+                             struct flb_tail_dir *dir,
+                             struct inotify_event *ev)
+{
+    int i;
+    int ret;
+    struct stat st;
+    struct mk_list *head;
+    struct flb_tail_dir_pattern *dp;
+    flb_sds_t path;
+
+    /* the directory was removed */
+    if (ev->mask & IN_IGNORED) {
+        flb_plg_debug(ctx->ins, "inotify_dir_remove(): watch_fd=%i dir=%s",
+                      dir->wd, dir->path);
+        tail_fs_dir_destroy(ctx, dir);
+        return 0;
+    }
+
+    if (!(ev->mask & (IN_CREATE | IN_MOVED_TO)) || ev->len == 0) {
+        return 0;
+    }
+
+    path = dir_path_join(dir->path, ev->name);
+    if (!path) {
+        return -1;
+    }
+
+    ret = stat(path, &st);
+    if (ret == -1) {
+        flb_sds_destroy(path);
+        return 0;
+    }
+
+    mk_list_foreach(head, &ctx->dir_patterns) {
+        dp = mk_list_entry(head, struct flb_tail_dir_pattern, _head);
+
+        if (S_ISDIR(st.st_mode)) {
+            for (i = 1; i < dp->levels; i++) {
+                if (fnmatch(dp->prefix[i], path, FLB_TAIL_DIR_FNM) == 0 &&
+                    tail_fs_dir_walk(ctx, dp, path, i, FLB_TRUE) == -1) {
+                    /* the next refresh does a full scan */
+                    ctx->inotify_dirs_watched = FLB_FALSE;
+                }
+            }
+        }
+        else if (fnmatch(dp->pattern, path, FLB_TAIL_DIR_FNM) == 0) {
+            /* known inodes are dismissed by the file lookup */
+            flb_tail_scan_file(path, ctx);
+            break;
+        }
+    }
+
+    flb_sds_destroy(path);
+    return 0;
+}
+
+static int tail_fs_file_event(struct flb_input_instance *ins,
+                              struct flb_config *config,
+                              struct flb_tail_config *ctx,
+                              struct inotify_event *ev)
 {
     int ret;
     int64_t offset;
     struct mk_list *head;
     struct mk_list *tmp;
-    struct flb_tail_config *ctx = in_context;
     struct flb_tail_file *file = NULL;
-    struct inotify_event ev;
     struct stat st;
 
-    /* Read the event */
-    ret = read(ctx->fd_notify, &ev, sizeof(struct inotify_event));
-    if (ret < 1) {
-        return -1;
-    }
-
     /* Lookup watched file */
     mk_list_foreach_safe(head, tmp, &ctx->files_event) {
         file = mk_list_entry(head, struct flb_tail_file, _head);
-        if (file->watch_fd != ev.wd) {
+        if (file->watch_fd != ev->wd) {
             file = NULL;
             continue;
         }
@@ -196,16 +569,16 @@ static int tail_fs_event(struct flb_input_instance *ins,
     }
 
     /* Debug event */
-    debug_event_mask(ctx, file, ev.mask);
+    debug_event_mask(ctx, file, ev->mask);
 
-    if (ev.mask & IN_IGNORED) {
+    if (ev->mask & IN_IGNORED) {
         flb_plg_debug(ctx->ins, "inode=%"PRIu64" watch_fd=%i IN_IGNORED",
-                      file->inode, ev.wd);
+                      file->inode, ev->wd);
         return -1;
     }
 
     /* Check file rotation (only if it has not been rotated before) */
-    if (ev.mask & IN_MOVE_SELF && file->rotated == 0) {
+    if (ev->mask & IN_MOVE_SELF && file->rotated == 0) {
         flb_plg_debug(ins, "inode=%"PRIu64" rotated IN_MOVE SELF '%s'",
                       file->inode, file->name);
 
@@ -226,7 +599,7 @@ static int tail_fs_event(struct flb_input_instance *ins,
     file->pending_bytes = (file->size - file->offset);
 
     /* File was removed ? */
-    if (ev.mask & IN_ATTRIB) {
+    if (ev->mask & IN_ATTRIB) {
         /* Check if the file have been deleted */
         if (st.st_nlink == 0) {
             flb_plg_debug(ins, "inode=%"PRIu64" file has been deleted: %s",
@@ -244,7 +617,7 @@ static int tail_fs_event(struct flb_input_instance *ins,
         }
     }
 
-    if (ev.mask & IN_MODIFY) {
+    if (ev->mask & IN_MODIFY) {
         /*
          * The file was modified, check how many new bytes do
          * we have.
@@ -262,6 +635,7 @@ static int tail_fs_event(struct flb_input_instance *ins,
                           file->inode, file->name);
             file->offset = offset;
             file->buf_len = 0;
+            file->buf_start = 0;
 
             /* Update offset in the database file */
 #ifdef FLB_HAVE_SQLDB
@@ -298,6 +672,51 @@ static int tail_fs_event(struct flb_input_instance *ins,
     return 0;
 }
 
+/*
+ * Events are read in batches; the events of watched directories carry the
+ * name of the new entry after the fixed size header.
+ */
+static int tail_fs_event(struct flb_input_instance *ins,
+                         struct flb_config *config, void *in_context)
+{
+    ssize_t bytes;
+    char *p;
+    char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    struct flb_tail_dir *dir;
+    struct flb_tail_config *ctx = in_context;
+    struct inotify_event *ev;
+
+    bytes = read(ctx->fd_notify, buf, sizeof(buf));
+    if (bytes < (ssize_t) sizeof(struct inotify_event)) {
+        return -1;
+    }
+
+    for (p = buf; p < buf + bytes; p += sizeof(struct inotify_event) + ev->len) {
+        ev = (struct inotify_event *) p;
+
+        /* events were dropped by the kernel, look for missed files */
+        if (ev->wd == -1) {
+            if (ev->mask & IN_Q_OVERFLOW) {
+                flb_plg_warn(ctx->ins, "inotify queue overflow, re-scanning paths");
+                flb_tail_scan(ctx->path_list, ctx);
+            }
+            continue;
+        }
+
+        if (ctx->dir_hash) {
+            dir = tail_fs_dir_get(ctx, ev->wd);
+            if (dir) {
+                tail_fs_dir_event(ctx, dir, ev);
+                continue;
+            }
+        }
+
+        tail_fs_file_event(ins, config, ctx, ev);
+    }
+
+    return 0;
+}
+
 static int in_tail_progress_check_callback(struct flb_input_instance *ins,
                                            struct flb_config *config, void *context)
 {
@@ -351,6 +770,9 @@ int flb_tail_fs_inotify_init(struct flb_input_instance *in,
 {
     int fd;
     int ret;
+    struct mk_list *head;
+    struct flb_slist_entry *pattern;
+    struct flb_tail_dir_pattern *dp;
 
     flb_plg_debug(ctx->ins, "flb_tail_fs_inotify_init() initializing inotify tail input");
 
@@ -363,6 +785,25 @@ int flb_tail_fs_inotify_init(struct flb_input_instance *in,
     flb_plg_debug(ctx->ins, "inotify watch fd=%i", fd);
     ctx->fd_notify = fd;
 
+    if (ctx->inotify_watch_dirs) {
+        ctx->dir_hash = flb_hash_table_create(FLB_HASH_TABLE_EVICT_NONE, 256, 0);
+        if (!ctx->dir_hash) {
+            close(fd);
+            return -1;
+        }
+
+        mk_list_foreach(head, ctx->path_list) {
+            pattern = mk_list_entry(head, struct flb_slist_entry, _head);
+            dp = dir_pattern_create(pattern->str);
+            if (!dp) {
+                flb_plg_warn(ctx->ins, "cannot watch the directories of path "
+                             "'%s', relying on re-scans", pattern->str);
+                continue;
+            }
+            mk_list_add(&dp->_head, &ctx->dir_patterns);
+        }
+    }
+
     /* This backend use Fluent Bit event-loop to trigger notifications */
     ret = flb_input_set_collector_event(in, tail_fs_event,
                                         ctx->fd_notify, config);
@@ -427,7 +868,47 @@ int flb_tail_fs_inotify_remove(struct flb_tail_file *file)
     return 0;
 }
 
+/*
+ * Watch the directories of a path pattern, returns -1 if the pattern cannot
+ * be fully watched so its new files are only discovered by the re-scans.
+ */
+int flb_tail_fs_inotify_watch_dirs(struct flb_tail_config *ctx,
+                                   const char *pattern)
+{
+    struct mk_list *head;
+    struct flb_tail_dir_pattern *dp;
+
+    mk_list_foreach(head, &ctx->dir_patterns) {
+        dp = mk_list_entry(head, struct flb_tail_dir_pattern, _head);
+        if (strcmp(dp->path, pattern) == 0) {
+            return tail_fs_dir_walk(ctx, dp, dp->prefix[0], 0, FLB_FALSE);
+        }
+    }
+
+    return -1;
+}
+
 int flb_tail_fs_inotify_exit(struct flb_tail_config *ctx)
 {
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct flb_tail_dir *dir;
+    struct flb_tail_dir_pattern *dp;
+
+    if (ctx->dir_hash) {
+        mk_list_foreach_safe(head, tmp, &ctx->dirs) {
+            dir = mk_list_entry(head, struct flb_tail_dir, _head);
+            tail_fs_dir_destroy(ctx, dir);
+        }
+        flb_hash_table_destroy(ctx->dir_hash);
+        ctx->dir_hash = NULL;
+    }
+
+    mk_list_foreach_safe(head, tmp, &ctx->dir_patterns) {
+        dp = mk_list_entry(head, struct flb_tail_dir_pattern, _head);
+        mk_list_del(&dp->_head);
+        dir_pattern_destroy(dp);
+    }
+
     return close(ctx->fd_notify);
 }
@@ -26,6 +26,28 @@
 #include "tail_config.h"
 #include "tail_file_internal.h"
 
+/*
+ * A path pattern split for directory watches: 'base' is the longest leading
+ * directory without wildcards, 'comps' the remaining components where the
+ * last one matches the files. 'prefix[i]' is the pattern of the directories
+ * at level 'i' (prefix[0] == base).
+ */
+struct flb_tail_dir_pattern {
+    int levels;
+    flb_sds_t path;          /* pattern as configured */
+    flb_sds_t pattern;       /* normalized pattern    */
+    flb_sds_t *comps;
+    flb_sds_t *prefix;
+    struct mk_list _head;
+};
+
+/* A directory watched for new entries */
+struct flb_tail_dir {
+    int wd;
+    flb_sds_t path;
+    struct mk_list _head;
+};
+
 int flb_tail_fs_inotify_init(struct flb_input_instance *in,
                           struct flb_tail_config *ctx, struct flb_config *config);
 int flb_tail_fs_inotify_add(struct flb_tail_file *file);
@@ -33,5 +55,7 @@ int flb_tail_fs_inotify_remove(struct flb_tail_file *file);
 int flb_tail_fs_inotify_exit(struct flb_tail_config *ctx);
 void flb_tail_fs_inotify_pause(struct flb_tail_config *ctx);
 void flb_tail_fs_inotify_resume(struct flb_tail_config *ctx);
+int flb_tail_fs_inotify_watch_dirs(struct flb_tail_config *ctx,
+                                   const char *pattern);
 
 #endif
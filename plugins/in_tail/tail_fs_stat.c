@@ -130,6 +130,7 @@ static int tail_fs_check(struct flb_input_instance *ins,
             flb_plg_debug(ctx->ins, "file truncated %s", file->name);
             file->offset = offset;
             file->buf_len = 0;
+            file->buf_start = 0;
             memcpy(&fst->st, &st, sizeof(struct stat));
 
 #ifdef FLB_HAVE_SQLDB
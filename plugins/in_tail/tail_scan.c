@@ -20,6 +20,7 @@
 #include <fluent-bit/flb_input_plugin.h>
 #include "tail.h"
 #include "tail_config.h"
+#include "tail_fs.h"
 
 /*
  * Include proper scan backend
@@ -33,11 +34,27 @@
 int flb_tail_scan(struct mk_list *path_list, struct flb_tail_config *ctx)
 {
     int ret;
+    uint64_t ts;
     struct mk_list *head;
     struct flb_slist_entry *pattern;
+    char *name;
+#ifdef FLB_HAVE_INOTIFY
+    int watched = FLB_TRUE;
+#endif
+
+    ts = cfl_time_now();
 
     mk_list_foreach(head, path_list) {
         pattern = mk_list_entry(head, struct flb_slist_entry, _head);
+
+#ifdef FLB_HAVE_INOTIFY
+        /* watch the directories first, so no file is missed in between */
+        if (ctx->inotify_watch_dirs &&
+            flb_tail_fs_inotify_watch_dirs(ctx, pattern->str) == -1) {
+            watched = FLB_FALSE;
+        }
+#endif
+
         ret = tail_scan_path(pattern->str, ctx);
         if (ret == -1) {
             flb_plg_warn(ctx->ins, "error scanning path: %s", pattern->str);
@@ -48,6 +65,21 @@ int flb_tail_scan(struct mk_list *path_list, struct flb_tail_config *ctx)
         }
     }
 
+#ifdef FLB_HAVE_INOTIFY
+    if (ctx->inotify_watch_dirs) {
+        ctx->inotify_dirs_watched = watched;
+        ctx->inotify_dirs_scan = time(NULL);
+    }
+#endif
+
+#ifdef FLB_HAVE_METRICS
+    name = (char *) flb_input_name(ctx->ins);
+    cmt_counter_inc(ctx->cmt_scans, ts, 1, (char *[]) {name});
+    cmt_gauge_set(ctx->cmt_scan_duration, ts,
+                  (double) (cfl_time_now() - ts) / 1000000000.0,
+                  1, (char *[]) {name});
+#endif
+
     return 0;
 }
 
@@ -62,6 +94,14 @@ int flb_tail_scan_callback(struct flb_input_instance *ins,
     struct flb_tail_config *ctx = context;
     (void) config;
 
+#ifdef FLB_HAVE_INOTIFY
+    /* new files are reported by the directory watches */
+    if (ctx->inotify_watch_dirs && ctx->inotify_dirs_watched &&
+        time(NULL) - ctx->inotify_dirs_scan < ctx->inotify_watch_dirs_refresh) {
+        return 0;
+    }
+#endif
+
     ret = flb_tail_scan(ctx->path_list, ctx);
     if (ret > 0) {
         flb_plg_debug(ins, "%i new files found", ret);
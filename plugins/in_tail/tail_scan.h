@@ -25,5 +25,6 @@
 int flb_tail_scan(struct mk_list *path, struct flb_tail_config *ctx);
 int flb_tail_scan_callback(struct flb_input_instance *ins,
                            struct flb_config *config, void *context);
+int flb_tail_scan_file(const char *path, struct flb_tail_config *ctx);
 
 #endif
@@ -183,6 +183,52 @@ static inline int do_glob(const char *pattern, int flags,
     return ret;
 }
 
+/*
+ * Register a single file if it is a regular file which is not excluded, it
+ * returns 1 if the file was added.
+ */
+static int tail_scan_entry(const char *path, time_t now,
+                           struct flb_tail_config *ctx)
+{
+    int ret;
+    int64_t mtime;
+    struct stat st;
+
+    ret = stat(path, &st);
+    if (ret != 0 || !S_ISREG(st.st_mode)) {
+        flb_plg_debug(ctx->ins, "skip (invalid) entry=%s", path);
+        return 0;
+    }
+
+    /* Check if this file is blacklisted */
+    if (tail_is_excluded((char *) path, ctx) == FLB_TRUE) {
+        flb_plg_debug(ctx->ins, "excluded=%s", path);
+        return 0;
+    }
+
+    if (ctx->ignore_older > 0) {
+        mtime = flb_tail_stat_mtime(&st);
+        if (mtime > 0) {
+            if ((now - ctx->ignore_older) > mtime) {
+                flb_plg_debug(ctx->ins, "excluded=%s (ignore_older)", path);
+                return 0;
+            }
+        }
+    }
+
+    /* Append file to list */
+    ret = flb_tail_file_append((char *) path, &st, FLB_TAIL_STATIC, ctx);
+    if (ret == 0) {
+        flb_plg_debug(ctx->ins, "scan_glob add(): %s, inode %" PRIu64,
+                      path, (uint64_t) st.st_ino);
+        return 1;
+    }
+
+    flb_plg_debug(ctx->ins, "scan_blog add(): dismissed: %s, inode %" PRIu64,
+                  path, (uint64_t) st.st_ino);
+    return 0;
+}
+
 /* Scan a path, register the entries and return how many */
 static int tail_scan_path(const char *path, struct flb_tail_config *ctx)
 {
@@ -191,7 +237,6 @@ static int tail_scan_path(const char *path, struct flb_tail_config *ctx)
     int count = 0;
     glob_t globbuf;
     time_t now;
-    int64_t mtime;
     struct stat st;
 
     flb_plg_debug(ctx->ins, "scanning path %s", path);
@@ -231,42 +276,7 @@ static int tail_scan_path(const char *path, struct flb_tail_config *ctx)
     /* For every entry found, generate an output list */
     now = time(NULL);
     for (i = 0; i < globbuf.gl_pathc; i++) {
-        ret = stat(globbuf.gl_pathv[i], &st);
-        if (ret == 0 && S_ISREG(st.st_mode)) {
-            /* Check if this file is blacklisted */
-            if (tail_is_excluded(globbuf.gl_pathv[i], ctx) == FLB_TRUE) {
-                flb_plg_debug(ctx->ins, "excluded=%s", globbuf.gl_pathv[i]);
-                continue;
-            }
-
-            if (ctx->ignore_older > 0) {
-                mtime = flb_tail_stat_mtime(&st);
-                if (mtime > 0) {
-                    if ((now - ctx->ignore_older) > mtime) {
-                        flb_plg_debug(ctx->ins, "excluded=%s (ignore_older)",
-                                      globbuf.gl_pathv[i]);
-                        continue;
-                    }
-                }
-            }
-
-            /* Append file to list */
-            ret = flb_tail_file_append(globbuf.gl_pathv[i], &st,
-                                       FLB_TAIL_STATIC, ctx);
-            if (ret == 0) {
-                flb_plg_debug(ctx->ins, "scan_glob add(): %s, inode %" PRIu64,
-                              globbuf.gl_pathv[i], (uint64_t) st.st_ino);
-                count++;
-            }
-            else {
-                flb_plg_debug(ctx->ins, "scan_blog add(): dismissed: %s, inode %" PRIu64,
-                              globbuf.gl_pathv[i], (uint64_t) st.st_ino);
-            }
-        }
-        else {
-            flb_plg_debug(ctx->ins, "skip (invalid) entry=%s",
-                          globbuf.gl_pathv[i]);
-        }
+        count += tail_scan_entry(globbuf.gl_pathv[i], now, ctx);
     }
 
     if (count > 0) {
@@ -276,3 +286,16 @@ static int tail_scan_path(const char *path, struct flb_tail_config *ctx)
     globfree(&globbuf);
     return count;
 }
+
+/* Register a file reported by a directory watch */
+int flb_tail_scan_file(const char *path, struct flb_tail_config *ctx)
+{
+    int ret;
+
+    ret = tail_scan_entry(path, time(NULL), ctx);
+    if (ret > 0) {
+        tail_signal_manager(ctx);
+    }
+
+    return ret;
+}
@@ -62,12 +62,76 @@ static int in_tcp_collect(struct flb_input_instance *in,
     return 0;
 }
 
+/*
+ * Network workers: every worker serves its connections with a copy of the
+ * context owning its encoder and list of connections.
+ */
+static int in_tcp_worker_init(struct flb_input_net_worker *worker)
+{
+    struct flb_in_tcp_config *ctx;
+    struct flb_in_tcp_config *worker_ctx;
+
+    ctx = worker->parent->context;
+
+    worker_ctx = flb_malloc(sizeof(struct flb_in_tcp_config));
+    if (!worker_ctx) {
+        flb_errno();
+        return -1;
+    }
+    memcpy(worker_ctx, ctx, sizeof(struct flb_in_tcp_config));
+
+    worker_ctx->collector_id = -1;
+    worker_ctx->downstream = worker->downstream;
+    worker_ctx->workers = NULL;
+    mk_list_init(&worker_ctx->connections);
+
+    worker_ctx->log_encoder = flb_log_event_encoder_create(FLB_LOG_EVENT_FORMAT_DEFAULT);
+    if (!worker_ctx->log_encoder) {
+        flb_plg_error(ctx->ins, "could not initialize event encoder");
+        flb_free(worker_ctx);
+        return -1;
+    }
+
+    worker->data = worker_ctx;
+    return 0;
+}
+
+static int in_tcp_worker_accept(struct flb_input_net_worker *worker,
+                                struct flb_connection *connection)
+{
+    struct tcp_conn *conn;
+
+    conn = tcp_conn_add(connection, worker->data);
+    if (conn == NULL) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static void in_tcp_worker_exit(struct flb_input_net_worker *worker)
+{
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct tcp_conn *conn;
+    struct flb_in_tcp_config *worker_ctx = worker->data;
+
+    mk_list_foreach_safe(head, tmp, &worker_ctx->connections) {
+        conn = mk_list_entry(head, struct tcp_conn, _head);
+        tcp_conn_del(conn);
+    }
+
+    flb_log_event_encoder_destroy(worker_ctx->log_encoder);
+    flb_free(worker_ctx);
+}
+
 /* Initialize plugin */
 static int in_tcp_init(struct flb_input_instance *in,
                       struct flb_config *config, void *data)
 {
     unsigned short int        port;
     int                       ret;
+    int                       workers;
     struct flb_in_tcp_config *ctx;
 
     (void) data;
@@ -86,6 +150,9 @@ static int in_tcp_init(struct flb_input_instance *in,
 
     port = (unsigned short int) strtoul(ctx->tcp_port, NULL, 10);
 
+    /* the port is shared when extra workers are requested */
+    workers = flb_input_net_workers_count(in);
+
     ctx->downstream = flb_downstream_create(FLB_TRANSPORT_TCP,
                                             in->flags,
                                             ctx->listen,
@@ -120,6 +187,27 @@ static int in_tcp_init(struct flb_input_instance *in,
 
     ctx->collector_id = ret;
 
+    /* the input thread accepts too, it's the first worker */
+    if (workers > 1) {
+        ctx->workers = flb_input_net_workers_create(in, ctx->listen, port,
+                                                    workers - 1,
+                                                    in_tcp_worker_init,
+                                                    in_tcp_worker_accept,
+                                                    in_tcp_worker_exit,
+                                                    ctx, config);
+        if (!ctx->workers) {
+            tcp_config_destroy(ctx);
+            return -1;
+        }
+
+        ret = flb_input_net_workers_start(ctx->workers);
+        if (ret == -1) {
+            flb_plg_error(ctx->ins, "could not start network workers");
+            tcp_config_destroy(ctx);
+            return -1;
+        }
+    }
+
     return 0;
 }
 
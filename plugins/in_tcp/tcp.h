@@ -27,6 +27,7 @@
 #include <fluent-bit/flb_input.h>
 #include <fluent-bit/flb_sds.h>
 #include <fluent-bit/flb_log_event_encoder.h>
+#include <fluent-bit/flb_input_net_worker.h>
 #include <msgpack.h>
 
 struct flb_in_tcp_config {
@@ -46,6 +47,7 @@ struct flb_in_tcp_config {
     struct mk_list connections;        /* List of active connections  */
     struct flb_input_instance *ins;    /* Input plugin instace        */
     struct flb_log_event_encoder *log_encoder;
+    struct flb_input_net_workers *workers; /* Extra accept threads    */
 };
 
 #endif
@@ -133,6 +133,11 @@ struct flb_in_tcp_config *tcp_config_init(struct flb_input_instance *ins)
 
 int tcp_config_destroy(struct flb_in_tcp_config *ctx)
 {
+    if (ctx->workers != NULL) {
+        flb_input_net_workers_destroy(ctx->workers);
+        ctx->workers = NULL;
+    }
+
     if (ctx->log_encoder != NULL) {
         flb_log_event_encoder_destroy(ctx->log_encoder);
     }
@@ -45,6 +45,76 @@ static int in_udp_collect(struct flb_input_instance *in,
     return udp_conn_event(connection);
 }
 
+/* Batches encoded by the extra receivers */
+static int in_udp_collect_receivers(struct flb_input_instance *in,
+                                    struct flb_config *config,
+                                    void *in_context)
+{
+    struct flb_in_udp_config *ctx;
+
+    ctx = in_context;
+
+    return flb_input_dgram_collect(ctx->receivers);
+}
+
+static void receivers_destroy(struct flb_in_udp_config *ctx)
+{
+    int i;
+
+    if (ctx->receivers == NULL) {
+        return;
+    }
+
+    flb_input_dgram_stop(ctx->receivers);
+
+    for (i = 0; i < ctx->receivers->count; i++) {
+        if (ctx->receivers->workers[i].data != NULL) {
+            udp_conn_del(ctx->receivers->workers[i].data);
+        }
+    }
+
+    flb_input_dgram_destroy(ctx->receivers);
+    ctx->receivers = NULL;
+}
+
+static int receivers_create(struct flb_in_udp_config *ctx, int count,
+                            unsigned short int port,
+                            struct flb_config *config)
+{
+    int i;
+    struct udp_conn *conn;
+    struct flb_input_dgram_worker *worker;
+
+    ctx->receivers = flb_input_dgram_create(ctx->ins, ctx->listen, port,
+                                            count, ctx->chunk_size,
+                                            udp_conn_receiver_event,
+                                            config);
+    if (ctx->receivers == NULL) {
+        return -1;
+    }
+    ctx->receivers->cmt_drops = ctx->cmt_kernel_drops;
+
+    for (i = 0; i < ctx->receivers->count; i++) {
+        worker = &ctx->receivers->workers[i];
+
+        conn = udp_conn_add(worker->connection, ctx);
+        if (conn == NULL) {
+            receivers_destroy(ctx);
+            return -1;
+        }
+        conn->log_encoder = worker->log_encoder;
+        worker->data = conn;
+    }
+
+    if (flb_input_dgram_start(ctx->receivers,
+                              in_udp_collect_receivers, config) == -1) {
+        receivers_destroy(ctx);
+        return -1;
+    }
+
+    return 0;
+}
+
 /* Initialize plugin */
 static int in_udp_init(struct flb_input_instance *in,
                        struct flb_config *config, void *data)
@@ -52,6 +122,7 @@ static int in_udp_init(struct flb_input_instance *in,
     struct flb_connection    *connection;
     unsigned short int        port;
     int                       ret;
+    int                       receivers;
     struct flb_in_udp_config *ctx;
 
     (void) data;
@@ -71,6 +142,9 @@ static int in_udp_init(struct flb_input_instance *in,
 
     port = (unsigned short int) strtoul(ctx->port, NULL, 10);
 
+    /* the port is shared when extra receivers are requested */
+    receivers = flb_input_dgram_receivers(in);
+
     ctx->downstream = flb_downstream_create(FLB_TRANSPORT_UDP,
                                             in->flags,
                                             ctx->listen,
@@ -111,6 +185,20 @@ static int in_udp_init(struct flb_input_instance *in,
         return -1;
     }
 
+    ctx->reader = flb_net_dgram_reader_create(ctx->downstream->server_fd,
+                                              in->net_setup.udp_batch_size,
+                                              ctx->chunk_size,
+                                              in->net_setup.udp_gro);
+    if (ctx->reader == NULL) {
+        flb_plg_error(ctx->ins, "could not create datagram reader");
+
+        udp_config_destroy(ctx);
+
+        return -1;
+    }
+
+    ctx->cmt_kernel_drops = flb_input_dgram_drops_counter(in);
+
     /* Collect upon data available on the standard input */
     ret = flb_input_set_collector_socket(in,
                                          in_udp_collect,
@@ -133,6 +221,17 @@ static int in_udp_init(struct flb_input_instance *in,
         return -1;
     }
 
+    /* the collector above is the first receiver */
+    if (receivers > 1) {
+        ret = receivers_create(ctx, receivers - 1, port, config);
+        if (ret == -1) {
+            flb_plg_error(ctx->ins, "could not start UDP receivers");
+            udp_config_destroy(ctx);
+
+            return -1;
+        }
+    }
+
     return 0;
 }
 
@@ -144,6 +243,8 @@ static int in_udp_exit(void *data, struct flb_config *config)
 
     ctx = data;
 
+    receivers_destroy(ctx);
+
     if (ctx->dummy_conn != NULL) {
         udp_conn_del(ctx->dummy_conn);
     }
@@ -27,6 +27,8 @@
 #include <fluent-bit/flb_input.h>
 #include <fluent-bit/flb_sds.h>
 #include <fluent-bit/flb_log_event_encoder.h>
+#include <fluent-bit/flb_net_dgram.h>
+#include <fluent-bit/flb_input_dgram.h>
 #include <msgpack.h>
 
 struct udp_conn;
@@ -47,6 +49,9 @@ struct flb_in_udp_config {
     int collector_id;                  /* Listener collector id       */
     struct flb_downstream *downstream; /* Client manager              */
     struct udp_conn *dummy_conn;       /* Datagram dummy connection   */
+    struct flb_net_dgram_reader *reader;  /* Batched datagram reader  */
+    struct flb_input_dgram *receivers;    /* Extra receiver threads   */
+    struct cmt_counter *cmt_kernel_drops;
     struct flb_input_instance *ins;    /* Input plugin instace        */
     struct flb_log_event_encoder *log_encoder;
 };
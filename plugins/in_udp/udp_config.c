@@ -147,6 +147,10 @@ int udp_config_destroy(struct flb_in_udp_config *ctx)
         flb_downstream_destroy(ctx->downstream);
     }
 
+    if (ctx->reader != NULL) {
+        flb_net_dgram_reader_destroy(ctx->reader);
+    }
+
     flb_sds_destroy(ctx->separator);
     flb_free(ctx->port);
     flb_free(ctx);
@@ -112,8 +112,6 @@ static inline int process_pack(struct udp_conn *conn,
 
     ctx = conn->ctx;
 
-    flb_log_event_encoder_reset(ctx->log_encoder);
-
     /* First pack the results, iterate concatenated messages */
     msgpack_unpacked_init(&result);
     while (msgpack_unpack_next(&result, pack, size, &off) == MSGPACK_UNPACK_SUCCESS) {
@@ -122,10 +120,10 @@ static inline int process_pack(struct udp_conn *conn,
         appended_address_buffer = NULL;
         source_address = NULL;
 
-        ret = flb_log_event_encoder_begin_record(ctx->log_encoder);
+        ret = flb_log_event_encoder_begin_record(conn->log_encoder);
 
         if (ret == FLB_EVENT_ENCODER_SUCCESS) {
-            ret = flb_log_event_encoder_set_current_timestamp(ctx->log_encoder);
+            ret = flb_log_event_encoder_set_current_timestamp(conn->log_encoder);
         }
 
         if (ctx->source_address_key != NULL) {
@@ -163,17 +161,17 @@ static inline int process_pack(struct udp_conn *conn,
 
                 if (appended_address_buffer != NULL) {
                     ret = flb_log_event_encoder_set_body_from_raw_msgpack(
-                            ctx->log_encoder, appended_address_buffer, appended_address_size);
+                            conn->log_encoder, appended_address_buffer, appended_address_size);
                 }
                 else {
                     ret = flb_log_event_encoder_set_body_from_msgpack_object(
-                            ctx->log_encoder, &entry);
+                            conn->log_encoder, &entry);
                 }
             }
             else if (entry.type == MSGPACK_OBJECT_ARRAY) {
                 if (source_address != NULL) {
                     ret = flb_log_event_encoder_append_body_values(
-                        ctx->log_encoder,
+                        conn->log_encoder,
                         FLB_LOG_EVENT_CSTRING_VALUE("msg"),
                         FLB_LOG_EVENT_MSGPACK_OBJECT_VALUE(&entry),
                         FLB_LOG_EVENT_CSTRING_VALUE(ctx->source_address_key),
@@ -181,7 +179,7 @@ static inline int process_pack(struct udp_conn *conn,
                 }
                 else {
                     ret = flb_log_event_encoder_append_body_values(
-                        ctx->log_encoder,
+                        conn->log_encoder,
                         FLB_LOG_EVENT_CSTRING_VALUE("msg"),
                         FLB_LOG_EVENT_MSGPACK_OBJECT_VALUE(&entry));
                 }
@@ -191,7 +189,7 @@ static inline int process_pack(struct udp_conn *conn,
             }
 
             if (ret == FLB_EVENT_ENCODER_SUCCESS) {
-                ret = flb_log_event_encoder_commit_record(ctx->log_encoder);
+                ret = flb_log_event_encoder_commit_record(conn->log_encoder);
             }
 
             if (appended_address_buffer != NULL) {
@@ -207,13 +205,11 @@ static inline int process_pack(struct udp_conn *conn,
     msgpack_unpacked_destroy(&result);
 
     if (ret == FLB_EVENT_ENCODER_SUCCESS) {
-        flb_input_log_append(conn->ins, NULL, 0,
-                             ctx->log_encoder->output_buffer,
-                             ctx->log_encoder->output_length);
         ret = 0;
     }
     else {
         flb_plg_error(ctx->ins, "log event encoding error : %d", ret);
+        flb_log_event_encoder_rollback_record(conn->log_encoder);
 
         ret = -1;
     }
@@ -274,29 +270,27 @@ static ssize_t parse_payload_none(struct udp_conn *conn)
     buf = conn->buf_data;
     ret = FLB_EVENT_ENCODER_SUCCESS;
 
-    flb_log_event_encoder_reset(ctx->log_encoder);
-
     while ((s = strstr(buf, separator))) {
         len = (s - buf);
         if (len == 0) {
             break;
         }
         else if (len > 0) {
-            ret = flb_log_event_encoder_begin_record(ctx->log_encoder);
+            ret = flb_log_event_encoder_begin_record(conn->log_encoder);
 
             if (ret == FLB_EVENT_ENCODER_SUCCESS) {
-                ret = flb_log_event_encoder_set_current_timestamp(ctx->log_encoder);
+                ret = flb_log_event_encoder_set_current_timestamp(conn->log_encoder);
             }
 
             if (ret == FLB_EVENT_ENCODER_SUCCESS) {
                 ret = flb_log_event_encoder_append_body_values(
-                        ctx->log_encoder,
+                        conn->log_encoder,
                         FLB_LOG_EVENT_CSTRING_VALUE("log"),
                         FLB_LOG_EVENT_STRING_VALUE(buf, len));
             }
 
             if (ret == FLB_EVENT_ENCODER_SUCCESS) {
-                ret = flb_log_event_encoder_commit_record(ctx->log_encoder);
+                ret = flb_log_event_encoder_commit_record(conn->log_encoder);
             }
 
             if (ret != FLB_EVENT_ENCODER_SUCCESS) {
@@ -311,34 +305,20 @@ static ssize_t parse_payload_none(struct udp_conn *conn)
         }
     }
 
-    if (ret == FLB_EVENT_ENCODER_SUCCESS) {
-        flb_input_log_append(conn->ins, NULL, 0,
-                             ctx->log_encoder->output_buffer,
-                             ctx->log_encoder->output_length);
-    }
-    else {
+    if (ret != FLB_EVENT_ENCODER_SUCCESS) {
         flb_plg_error(ctx->ins, "log event encoding error : %d", ret);
+        flb_log_event_encoder_rollback_record(conn->log_encoder);
     }
 
     return consumed;
 }
 
-/* Callback invoked every time an event is triggered for a connection */
-int udp_conn_event(void *data)
+/* Process one datagram, the records are encoded into 'conn->log_encoder' */
+static int udp_conn_process(struct udp_conn *conn, char *buf, size_t size)
 {
-    int bytes;
-    int available;
-    int size;
     ssize_t ret_payload = -1;
-    char *tmp;
-    struct udp_conn *conn;
-    struct flb_connection *connection;
     struct flb_in_udp_config *ctx;
 
-    connection = (struct flb_connection *) data;
-
-    conn = connection->user_data;
-
     ctx = conn->ctx;
 
     if (ctx->format == FLB_UDP_FMT_JSON &&
@@ -349,45 +329,17 @@ int udp_conn_event(void *data)
         conn->pack_state.multiple = FLB_TRUE;
     }
 
-    conn->buf_len = 0;
-
-    available = (conn->buf_size - conn->buf_len) - 1;
-    if (available < 1) {
-        if (conn->buf_size + ctx->chunk_size > ctx->buffer_size) {
-            flb_plg_trace(ctx->ins,
-                          "fd=%i incoming data exceed limit (%zu KB)",
-                          connection->fd, (ctx->buffer_size / 1024));
-            return -1;
-        }
-
-        size = conn->buf_size + ctx->chunk_size;
-        tmp = flb_realloc(conn->buf_data, size);
-        if (!tmp) {
-            flb_errno();
-            return -1;
-        }
-        flb_plg_trace(ctx->ins, "fd=%i buffer realloc %i -> %i",
-                      connection->fd, conn->buf_size, size);
-
-        conn->buf_data = tmp;
-        conn->buf_size = size;
-        available = (conn->buf_size - conn->buf_len) - 1;
-    }
-
-    /* Read data */
-    bytes = flb_io_net_read(connection,
-                            (void *) &conn->buf_data[conn->buf_len],
-                            available);
-
-    if (bytes <= 0) {
-        return -1;
+    /* Oversized datagrams are truncated, like a short read on the socket */
+    if (size > conn->buf_size) {
+        size = conn->buf_size;
     }
 
-    flb_plg_trace(ctx->ins, "read()=%i pre_len=%i now_len=%i",
-                  bytes, conn->buf_len, conn->buf_len + bytes);
-    conn->buf_len += bytes;
+    memcpy(conn->buf_data, buf, size);
+    conn->buf_len = size;
     conn->buf_data[conn->buf_len] = '\0';
 
+    flb_plg_trace(ctx->ins, "datagram size=%zu", size);
+
     /* Strip CR or LF if found at first byte */
     if (conn->buf_data[0] == '\r' || conn->buf_data[0] == '\n') {
         /* Skip message with one byte with CR or LF */
@@ -434,9 +386,69 @@ int udp_conn_event(void *data)
         conn->pack_state.buf_len = 0;
     }
 
+    return size;
+}
+
+/* Callback invoked every time an event is triggered for a connection */
+int udp_conn_event(void *data)
+{
+    int ret;
+    int bytes = 0;
+    char *buf;
+    size_t size;
+    uint64_t drops;
+    struct sockaddr_storage *address;
+    struct udp_conn *conn;
+    struct flb_connection *connection;
+    struct flb_in_udp_config *ctx;
+
+    connection = (struct flb_connection *) data;
+
+    conn = connection->user_data;
+
+    ctx = conn->ctx;
+
+    /* Read a batch of datagrams */
+    ret = flb_net_dgram_read(ctx->reader);
+    if (ret <= 0) {
+        return -1;
+    }
+
+    while (flb_net_dgram_next(ctx->reader, &buf, &size, &address)) {
+        flb_connection_set_remote_host(connection, (struct sockaddr *) address);
+
+        if (udp_conn_process(conn, buf, size) > 0) {
+            bytes += size;
+        }
+    }
+
+    /* Append the records of the whole batch at once */
+    if (conn->log_encoder->output_length > 0) {
+        flb_input_log_append(conn->ins, NULL, 0,
+                             conn->log_encoder->output_buffer,
+                             conn->log_encoder->output_length);
+    }
+    flb_log_event_encoder_reset(conn->log_encoder);
+
+    drops = flb_net_dgram_drops(ctx->reader);
+    if (drops > 0) {
+        flb_input_dgram_drops_report(ctx->ins, ctx->cmt_kernel_drops, drops);
+    }
+
+    if (bytes == 0) {
+        return -1;
+    }
+
     return bytes;
 }
 
+/* Datagram read by an extra receiver thread */
+int udp_conn_receiver_event(struct flb_input_dgram_worker *worker,
+                            char *buf, size_t size)
+{
+    return udp_conn_process(worker->data, buf, size);
+}
+
 struct udp_conn *udp_conn_add(struct flb_connection *connection,
                               struct flb_in_udp_config *ctx)
 {
@@ -462,7 +474,8 @@ struct udp_conn *udp_conn_add(struct flb_connection *connection,
     conn->ctx     = ctx;
     conn->buf_len = 0;
 
-    conn->buf_data = flb_malloc(ctx->chunk_size);
+    /* room for a full datagram plus the string terminator */
+    conn->buf_data = flb_malloc(ctx->chunk_size + 1);
     if (!conn->buf_data) {
         flb_errno();
 
@@ -473,6 +486,7 @@ struct udp_conn *udp_conn_add(struct flb_connection *connection,
     }
     conn->buf_size = ctx->chunk_size;
     conn->ins      = ctx->ins;
+    conn->log_encoder = ctx->log_encoder;
 
     /* Initialize JSON parser */
     if (ctx->format == FLB_UDP_FMT_JSON) {
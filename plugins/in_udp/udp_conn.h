@@ -22,6 +22,7 @@
 
 #include <fluent-bit/flb_pack.h>
 #include <fluent-bit/flb_connection.h>
+#include <fluent-bit/flb_input_dgram.h>
 
 #define FLB_IN_UDP_CHUNK "32768"
 
@@ -46,6 +47,7 @@ struct udp_conn {
     struct flb_in_udp_config *ctx;    /* Plugin configuration context      */
     struct flb_pack_state pack_state; /* Internal JSON parser              */
     struct flb_connection *connection;
+    struct flb_log_event_encoder *log_encoder; /* Records of the batch  */
 
     struct mk_list _head;
 };
@@ -53,5 +55,7 @@ struct udp_conn {
 struct udp_conn *udp_conn_add(struct flb_connection *connection, struct flb_in_udp_config *ctx);
 int udp_conn_del(struct udp_conn *conn);
 int udp_conn_event(void *data);
+int udp_conn_receiver_event(struct flb_input_dgram_worker *worker,
+                            char *buf, size_t size);
 
 #endif
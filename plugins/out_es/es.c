@@ -29,6 +29,8 @@
 #include <fluent-bit/flb_record_accessor.h>
 #include <fluent-bit/flb_ra_key.h>
 #include <fluent-bit/flb_log_event_decoder.h>
+#include <fluent-bit/flb_random.h>
+#include <fluent-bit/flb_scheduler.h>
 #include <msgpack.h>
 
 #include <time.h>
@@ -272,50 +274,398 @@ static int compose_index_header(struct flb_elasticsearch *ctx,
     return 0;
 }
 
+/* Get the key name as it's written by the JSON encoder */
+static inline void es_key_get(msgpack_object *k, const char **ptr, size_t *len)
+{
+    if (k->type == MSGPACK_OBJECT_STR) {
+        *ptr = k->via.str.ptr;
+        *len = k->via.str.size;
+    }
+    else if (k->type == MSGPACK_OBJECT_BIN) {
+        *ptr = k->via.bin.ptr;
+        *len = k->via.bin.size;
+    }
+    else {
+        *ptr = "";
+        *len = 0;
+    }
+}
+
+/*
+ * Check if a key name exists in the map starting from the entry 'offset'.
+ * Record keys are compared once sanitized (replace_dots), as they are
+ * written, 'sanitize' tells if the same applies to the name we look for.
+ */
+static int es_map_has_key(struct flb_elasticsearch *ctx,
+                          msgpack_object *map, int offset,
+                          const char *name, size_t name_len, int sanitize)
+{
+    int i;
+    size_t j;
+    char a;
+    char b;
+    size_t len;
+    const char *ptr;
+
+    for (i = offset; i < map->via.map.size; i++) {
+        es_key_get(&map->via.map.ptr[i].key, &ptr, &len);
+        if (len != name_len) {
+            continue;
+        }
+
+        if (ctx->replace_dots == FLB_FALSE) {
+            if (memcmp(ptr, name, len) == 0) {
+                return FLB_TRUE;
+            }
+            continue;
+        }
+
+        for (j = 0; j < len; j++) {
+            a = (ptr[j] == '.') ? '_' : ptr[j];
+            b = (sanitize && name[j] == '.') ? '_' : name[j];
+            if (a != b) {
+                break;
+            }
+        }
+        if (j == len) {
+            return FLB_TRUE;
+        }
+    }
+
+    return FLB_FALSE;
+}
+
+/* Write a key name followed by the ':' separator */
+static int es_write_key(struct flb_elasticsearch *ctx, struct es_bulk *bulk,
+                        const char *name, size_t len, int sanitize)
+{
+    int ret;
+    char *p;
+    char *end;
+    uint32_t start;
+    msgpack_object key;
+
+    key.type = MSGPACK_OBJECT_STR;
+    key.via.str.ptr = name;
+    key.via.str.size = len;
+
+    start = bulk->len;
+    ret = es_bulk_write_object(bulk, &key);
+    if (ret == -1) {
+        return -1;
+    }
+
+    /*
+     * Sanitize key name, Elastic Search 2.x don't allow dots
+     * in field names:
+     *
+     *   https://goo.gl/R5NMTr
+     */
+    if (sanitize && ctx->replace_dots == FLB_TRUE) {
+        p = bulk->ptr + start;
+        end = bulk->ptr + bulk->len;
+        while (p != end) {
+            if (*p == '.') *p = '_';
+            p++;
+        }
+    }
+
+    return es_bulk_write(bulk, ":", 1);
+}
+
+static int es_write_value(struct flb_elasticsearch *ctx, struct es_bulk *bulk,
+                          msgpack_object *o);
+
+/*
+ * Write the map entries, when a key is duplicated only the last one is
+ * written (same behavior of the msgpack to JSON encoder).
+ */
+static int es_write_map_content(struct flb_elasticsearch *ctx,
+                                struct es_bulk *bulk,
+                                msgpack_object *map, int *packed)
+{
+    int i;
+    int ret;
+    size_t len;
+    const char *ptr;
+
+    for (i = 0; i < map->via.map.size; i++) {
+        es_key_get(&map->via.map.ptr[i].key, &ptr, &len);
+        if (es_map_has_key(ctx, map, i + 1, ptr, len, FLB_TRUE)) {
+            continue;
+        }
+
+        if (*packed > 0) {
+            ret = es_bulk_write(bulk, ",", 1);
+            if (ret == -1) {
+                return -1;
+            }
+        }
+
+        ret = es_write_key(ctx, bulk, ptr, len, FLB_TRUE);
+        if (ret == -1) {
+            return -1;
+        }
+
+        ret = es_write_value(ctx, bulk, &map->via.map.ptr[i].val);
+        if (ret == -1) {
+            return -1;
+        }
+        (*packed)++;
+    }
+
+    return 0;
+}
+
+static int es_write_value(struct flb_elasticsearch *ctx, struct es_bulk *bulk,
+                          msgpack_object *o)
+{
+    int i;
+    int ret;
+    int packed = 0;
+
+    /* Keys are only found in maps, let the JSON encoder handle the rest */
+    if (o->type != MSGPACK_OBJECT_MAP && o->type != MSGPACK_OBJECT_ARRAY) {
+        return es_bulk_write_object(bulk, o);
+    }
+
+    if (o->type == MSGPACK_OBJECT_MAP) {
+        ret = es_bulk_write(bulk, "{", 1);
+        if (ret == -1) {
+            return -1;
+        }
+        ret = es_write_map_content(ctx, bulk, o, &packed);
+        if (ret == -1) {
+            return -1;
+        }
+        return es_bulk_write(bulk, "}", 1);
+    }
+
+    ret = es_bulk_write(bulk, "[", 1);
+    if (ret == -1) {
+        return -1;
+    }
+    for (i = 0; i < o->via.array.size; i++) {
+        if (i > 0) {
+            ret = es_bulk_write(bulk, ",", 1);
+            if (ret == -1) {
+                return -1;
+            }
+        }
+        ret = es_write_value(ctx, bulk, &o->via.array.ptr[i]);
+        if (ret == -1) {
+            return -1;
+        }
+    }
+    return es_bulk_write(bulk, "]", 1);
+}
+
+/*
+ * Write the document line of a record: the time key, the optional tag key
+ * and the record content. It's encoded straight from the record into the
+ * bulk buffer.
+ */
+static int es_write_document(struct flb_elasticsearch *ctx,
+                             struct es_bulk *bulk,
+                             const char *tag, int tag_len,
+                             char *time_str, size_t time_len,
+                             msgpack_object *map)
+{
+    int ret;
+    int packed = 0;
+    size_t time_key_len;
+    size_t tag_key_len;
+    msgpack_object val;
+
+    time_key_len = flb_sds_len(ctx->time_key);
+    tag_key_len = flb_sds_len(ctx->tag_key);
+
+    if (ctx->write_op == FLB_ES_OP_UPDATE) {
+        ret = es_bulk_write(bulk, ES_BULK_UPDATE_OP_BODY,
+                            sizeof(ES_BULK_UPDATE_OP_BODY) - 1);
+    }
+    else if (ctx->write_op == FLB_ES_OP_UPSERT) {
+        ret = es_bulk_write(bulk, ES_BULK_UPSERT_OP_BODY,
+                            sizeof(ES_BULK_UPSERT_OP_BODY) - 1);
+    }
+    else {
+        ret = 0;
+    }
+    if (ret == -1) {
+        return -1;
+    }
+
+    ret = es_bulk_write(bulk, "{", 1);
+    if (ret == -1) {
+        return -1;
+    }
+
+    /* The time key is skipped if it's overridden by the tag key or record */
+    if (!(ctx->include_tag_key == FLB_TRUE && tag_key_len == time_key_len &&
+          memcmp(ctx->tag_key, ctx->time_key, time_key_len) == 0) &&
+        !es_map_has_key(ctx, map, 0, ctx->time_key, time_key_len, FLB_FALSE)) {
+        val.type = MSGPACK_OBJECT_STR;
+        val.via.str.ptr = time_str;
+        val.via.str.size = time_len;
+
+        ret = es_write_key(ctx, bulk, ctx->time_key, time_key_len, FLB_FALSE);
+        if (ret == -1 || es_bulk_write_object(bulk, &val) == -1) {
+            return -1;
+        }
+        packed++;
+    }
+
+    /* Tag Key */
+    if (ctx->include_tag_key == FLB_TRUE &&
+        !es_map_has_key(ctx, map, 0, ctx->tag_key, tag_key_len, FLB_FALSE)) {
+        if (packed > 0 && es_bulk_write(bulk, ",", 1) == -1) {
+            return -1;
+        }
+
+        val.type = MSGPACK_OBJECT_STR;
+        val.via.str.ptr = tag;
+        val.via.str.size = tag_len;
+
+        ret = es_write_key(ctx, bulk, ctx->tag_key, tag_key_len, FLB_FALSE);
+        if (ret == -1 || es_bulk_write_object(bulk, &val) == -1) {
+            return -1;
+        }
+        packed++;
+    }
+
+    /*
+     * Elasticsearch have a restriction that key names cannot contain
+     * a dot; if some dot is found, it's replaced with an underscore.
+     */
+    ret = es_write_map_content(ctx, bulk, map, &packed);
+    if (ret == -1) {
+        return -1;
+    }
+
+    if (ctx->write_op == FLB_ES_OP_UPDATE ||
+        ctx->write_op == FLB_ES_OP_UPSERT) {
+        ret = es_bulk_write(bulk, "}}\n", 3);
+    }
+    else {
+        ret = es_bulk_write(bulk, "}\n", 2);
+    }
+
+    return ret;
+}
+
+/*
+ * Compose the unique _id of a record: it's the hash of the record packed
+ * with the time and tag keys, as it was done since the option exists, so
+ * the same record gets the same _id across versions.
+ */
+static int es_generate_id(struct flb_elasticsearch *ctx,
+                          const char *tag, int tag_len,
+                          char *time_str, size_t time_len,
+                          msgpack_object *map,
+                          char *es_uuid, size_t size)
+{
+    int ret;
+    int map_size;
+    uint16_t hash[8];
+    msgpack_sbuffer tmp_sbuf;
+    msgpack_packer tmp_pck;
+
+    map_size = map->via.map.size;
+    if (ctx->include_tag_key == FLB_TRUE) {
+        map_size++;
+    }
+
+    msgpack_sbuffer_init(&tmp_sbuf);
+    msgpack_packer_init(&tmp_pck, &tmp_sbuf, msgpack_sbuffer_write);
+
+    msgpack_pack_map(&tmp_pck, map_size + 1);
+
+    msgpack_pack_str(&tmp_pck, flb_sds_len(ctx->time_key));
+    msgpack_pack_str_body(&tmp_pck, ctx->time_key, flb_sds_len(ctx->time_key));
+    msgpack_pack_str(&tmp_pck, time_len);
+    msgpack_pack_str_body(&tmp_pck, time_str, time_len);
+
+    if (ctx->include_tag_key == FLB_TRUE) {
+        msgpack_pack_str(&tmp_pck, flb_sds_len(ctx->tag_key));
+        msgpack_pack_str_body(&tmp_pck, ctx->tag_key, flb_sds_len(ctx->tag_key));
+        msgpack_pack_str(&tmp_pck, tag_len);
+        msgpack_pack_str_body(&tmp_pck, tag, tag_len);
+    }
+
+    ret = es_pack_map_content(&tmp_pck, *map, ctx);
+    if (ret == -1) {
+        msgpack_sbuffer_destroy(&tmp_sbuf);
+        return -1;
+    }
+
+    MurmurHash3_x64_128(tmp_sbuf.data, tmp_sbuf.size, 42, hash);
+    snprintf(es_uuid, size,
+             "%04x%04x-%04x-%04x-%04x-%04x%04x%04x",
+             hash[0], hash[1], hash[2], hash[3],
+             hash[4], hash[5], hash[6], hash[7]);
+    msgpack_sbuffer_destroy(&tmp_sbuf);
+
+    return 0;
+}
+
+static int es_compose_index_line(struct flb_elasticsearch *ctx,
+                                 flb_sds_t *buf, char *es_index, char *id)
+{
+    if (id == NULL && ctx->suppress_type_name) {
+        return flb_sds_snprintf(buf, flb_sds_alloc(*buf),
+                                ES_BULK_INDEX_FMT_WITHOUT_TYPE,
+                                ctx->es_action, es_index);
+    }
+    else if (id == NULL) {
+        return flb_sds_snprintf(buf, flb_sds_alloc(*buf),
+                                ES_BULK_INDEX_FMT,
+                                ctx->es_action, es_index, ctx->type);
+    }
+    else if (ctx->suppress_type_name) {
+        return flb_sds_snprintf(buf, flb_sds_alloc(*buf),
+                                ES_BULK_INDEX_FMT_ID_WITHOUT_TYPE,
+                                ctx->es_action, es_index, id);
+    }
+
+    return flb_sds_snprintf(buf, flb_sds_alloc(*buf),
+                            ES_BULK_INDEX_FMT_ID,
+                            ctx->es_action, es_index, ctx->type, id);
+}
+
 /*
  * Convert the internal Fluent Bit data representation to the required
  * one by Elasticsearch.
  *
- * 'Sadly' this process involves to convert from Msgpack to JSON.
+ * Every record is converted from msgpack to JSON straight into the bulk
+ * buffer. The index line is composed only when the index changes.
  */
-static int elasticsearch_format(struct flb_config *config,
-                                struct flb_input_instance *ins,
-                                void *plugin_context,
-                                void *flush_ctx,
-                                int event_type,
-                                const char *tag, int tag_len,
-                                const void *data, size_t bytes,
-                                void **out_data, size_t *out_size)
+static int elasticsearch_format_bulk(struct flb_elasticsearch *ctx,
+                                     const char *tag, int tag_len,
+                                     const void *data, size_t bytes,
+                                     struct es_bulk **out_bulk)
 {
     int ret;
     int len;
-    int map_size;
     int index_len = 0;
+    int id_index_len = 0;
     size_t s = 0;
-    size_t off = 0;
-    size_t off_prev = 0;
+    size_t time_prefix_len = 0;
+    time_t time_sec = -1;
     char *es_index;
     char logstash_index[256];
+    char index_cache[256];
     char time_formatted[256];
     char index_formatted[256];
     char es_uuid[37];
-    flb_sds_t out_buf;
-    size_t out_buf_len = 0;
-    flb_sds_t tmp_buf;
+    char *id;
     flb_sds_t id_key_str = NULL;
-    // msgpack_unpacked result;
-    // msgpack_object root;
     msgpack_object map;
-    // msgpack_object *obj;
     flb_sds_t j_index;
+    flb_sds_t j_id_index;
     struct es_bulk *bulk;
     struct tm tm;
     struct flb_time tms;
-    msgpack_sbuffer tmp_sbuf;
-    msgpack_packer tmp_pck;
-    uint16_t hash[8];
     int es_index_custom_len;
-    struct flb_elasticsearch *ctx = plugin_context;
     struct flb_log_event_decoder log_decoder;
     struct flb_log_event log_event;
 
@@ -325,12 +675,20 @@ static int elasticsearch_format(struct flb_config *config,
         return -1;
     }
 
+    j_id_index = flb_sds_create_size(ES_BULK_HEADER);
+    if (j_id_index == NULL) {
+        flb_errno();
+        flb_sds_destroy(j_index);
+        return -1;
+    }
+
     ret = flb_log_event_decoder_init(&log_decoder, (char *) data, bytes);
 
     if (ret != FLB_EVENT_DECODER_SUCCESS) {
         flb_plg_error(ctx->ins,
                       "Log event decoder initialization error : %d", ret);
         flb_sds_destroy(j_index);
+        flb_sds_destroy(j_id_index);
 
         return -1;
     }
@@ -340,6 +698,7 @@ static int elasticsearch_format(struct flb_config *config,
     if (!bulk) {
         flb_log_event_decoder_destroy(&log_decoder);
         flb_sds_destroy(j_index);
+        flb_sds_destroy(j_id_index);
         return -1;
     }
 
@@ -348,34 +707,21 @@ static int elasticsearch_format(struct flb_config *config,
         strncpy(logstash_index, ctx->logstash_prefix, sizeof(logstash_index));
         logstash_index[sizeof(logstash_index) - 1] = '\0';
     }
+    index_cache[0] = '\0';
 
     /*
-     * If logstash format and id generation are disabled, pre-generate
-     * the index line for all records.
+     * If logstash format is disabled, pre-generate the index line for all
+     * records.
      *
      * The header stored in 'j_index' will be used for the all records on
-     * this payload.
+     * this payload that don't get an _id.
      */
-    if (ctx->logstash_format == FLB_FALSE && ctx->generate_id == FLB_FALSE) {
+    if (ctx->logstash_format == FLB_FALSE) {
         flb_time_get(&tms);
         gmtime_r(&tms.tm.tv_sec, &tm);
         strftime(index_formatted, sizeof(index_formatted) - 1,
                  ctx->index, &tm);
-        es_index = index_formatted;
-        if (ctx->suppress_type_name) {
-            index_len = flb_sds_snprintf(&j_index,
-                                         flb_sds_alloc(j_index),
-                                         ES_BULK_INDEX_FMT_WITHOUT_TYPE,
-                                         ctx->es_action,
-                                         es_index);
-        }
-        else {
-            index_len = flb_sds_snprintf(&j_index,
-                                         flb_sds_alloc(j_index),
-                                         ES_BULK_INDEX_FMT,
-                                         ctx->es_action,
-                                         es_index, ctx->type);
-        }
+        index_len = es_compose_index_line(ctx, &j_index, index_formatted, NULL);
     }
 
     /*
@@ -399,7 +745,6 @@ static int elasticsearch_format(struct flb_config *config,
         }
 
         map   = *log_event.body;
-        map_size = map.via.map.size;
 
         es_index_custom_len = 0;
         if (ctx->logstash_prefix_key) {
@@ -420,25 +765,15 @@ static int elasticsearch_format(struct flb_config *config,
             }
         }
 
-        /* Create temporary msgpack buffer */
-        msgpack_sbuffer_init(&tmp_sbuf);
-        msgpack_packer_init(&tmp_pck, &tmp_sbuf, msgpack_sbuffer_write);
-
-        if (ctx->include_tag_key == FLB_TRUE) {
-            map_size++;
+        /* Format the time, the date part only changes every second */
+        if (tms.tm.tv_sec != time_sec) {
+            gmtime_r(&tms.tm.tv_sec, &tm);
+            time_prefix_len = strftime(time_formatted,
+                                       sizeof(time_formatted) - 1,
+                                       ctx->time_key_format, &tm);
+            time_sec = tms.tm.tv_sec;
         }
-
-        /* Set the new map size */
-        msgpack_pack_map(&tmp_pck, map_size + 1);
-
-        /* Append the time key */
-        msgpack_pack_str(&tmp_pck, flb_sds_len(ctx->time_key));
-        msgpack_pack_str_body(&tmp_pck, ctx->time_key, flb_sds_len(ctx->time_key));
-
-        /* Format the time */
-        gmtime_r(&tms.tm.tv_sec, &tm);
-        s = strftime(time_formatted, sizeof(time_formatted) - 1,
-                     ctx->time_key_format, &tm);
+        s = time_prefix_len;
         if (ctx->time_key_nanos) {
             len = snprintf(time_formatted + s, sizeof(time_formatted) - 1 - s,
                            ".%09" PRIu64 "Z", (uint64_t) tms.tm.tv_nsec);
@@ -447,10 +782,7 @@ static int elasticsearch_format(struct flb_config *config,
                            ".%03" PRIu64 "Z",
                            (uint64_t) tms.tm.tv_nsec / 1000000);
         }
-
         s += len;
-        msgpack_pack_str(&tmp_pck, s);
-        msgpack_pack_str_body(&tmp_pck, time_formatted, s);
 
         es_index = ctx->index;
         if (ctx->logstash_format == FLB_TRUE) {
@@ -465,21 +797,11 @@ static int elasticsearch_format(struct flb_config *config,
             }
 
             es_index = logstash_index;
-            if (ctx->generate_id == FLB_FALSE) {
-                if (ctx->suppress_type_name) {
-                    index_len = flb_sds_snprintf(&j_index,
-                                                 flb_sds_alloc(j_index),
-                                                 ES_BULK_INDEX_FMT_WITHOUT_TYPE,
-                                                 ctx->es_action,
-                                                 es_index);
-                }
-                else {
-                    index_len = flb_sds_snprintf(&j_index,
-                                                 flb_sds_alloc(j_index),
-                                                 ES_BULK_INDEX_FMT,
-                                                 ctx->es_action,
-                                                 es_index, ctx->type);
-                }
+
+            /* the index line is only composed when the index changes */
+            if (strcmp(index_cache, es_index) != 0) {
+                index_len = es_compose_index_line(ctx, &j_index, es_index, NULL);
+                strcpy(index_cache, es_index);
             }
         }
         else if (ctx->current_time_index == FLB_TRUE) {
@@ -489,114 +811,89 @@ static int elasticsearch_format(struct flb_config *config,
             es_index = index_formatted;
         }
 
-        /* Tag Key */
-        if (ctx->include_tag_key == FLB_TRUE) {
-            msgpack_pack_str(&tmp_pck, flb_sds_len(ctx->tag_key));
-            msgpack_pack_str_body(&tmp_pck, ctx->tag_key, flb_sds_len(ctx->tag_key));
-            msgpack_pack_str(&tmp_pck, tag_len);
-            msgpack_pack_str_body(&tmp_pck, tag, tag_len);
-        }
-
-        /*
-         * The map_content routine iterate over each Key/Value pair found in
-         * the map and do some sanitization for the key names.
-         *
-         * Elasticsearch have a restriction that key names cannot contain
-         * a dot; if some dot is found, it's replaced with an underscore.
-         */
-        ret = es_pack_map_content(&tmp_pck, map, ctx);
-        if (ret == -1) {
-            flb_log_event_decoder_destroy(&log_decoder);
-            msgpack_sbuffer_destroy(&tmp_sbuf);
-            es_bulk_destroy(bulk);
-            flb_sds_destroy(j_index);
-            return -1;
-        }
-
+        id = NULL;
         if (ctx->generate_id == FLB_TRUE) {
-            MurmurHash3_x64_128(tmp_sbuf.data, tmp_sbuf.size, 42, hash);
-            snprintf(es_uuid, sizeof(es_uuid),
-                     "%04x%04x-%04x-%04x-%04x-%04x%04x%04x",
-                     hash[0], hash[1], hash[2], hash[3],
-                     hash[4], hash[5], hash[6], hash[7]);
-            if (ctx->suppress_type_name) {
-                index_len = flb_sds_snprintf(&j_index,
-                                             flb_sds_alloc(j_index),
-                                             ES_BULK_INDEX_FMT_ID_WITHOUT_TYPE,
-                                             ctx->es_action,
-                                             es_index,  es_uuid);
-            }
-            else {
-                index_len = flb_sds_snprintf(&j_index,
-                                             flb_sds_alloc(j_index),
-                                             ES_BULK_INDEX_FMT_ID,
-                                             ctx->es_action,
-                                             es_index, ctx->type, es_uuid);
+            ret = es_generate_id(ctx, tag, tag_len, time_formatted, s,
+                                 &map, es_uuid, sizeof(es_uuid));
+            if (ret == -1) {
+                flb_log_event_decoder_destroy(&log_decoder);
+                es_bulk_destroy(bulk);
+                flb_sds_destroy(j_index);
+                flb_sds_destroy(j_id_index);
+                return -1;
             }
+            id = es_uuid;
         }
         if (ctx->ra_id_key) {
             id_key_str = es_get_id_value(ctx ,&map);
             if (id_key_str) {
-                if (ctx->suppress_type_name) {
-                    index_len = flb_sds_snprintf(&j_index,
-                                                 flb_sds_alloc(j_index),
-                                                 ES_BULK_INDEX_FMT_ID_WITHOUT_TYPE,
-                                                 ctx->es_action,
-                                                 es_index,  id_key_str);
-                }
-                else {
-                    index_len = flb_sds_snprintf(&j_index,
-                                                 flb_sds_alloc(j_index),
-                                                 ES_BULK_INDEX_FMT_ID,
-                                                 ctx->es_action,
-                                                 es_index, ctx->type, id_key_str);
-                }
-                flb_sds_destroy(id_key_str);
-                id_key_str = NULL;
+                id = id_key_str;
             }
         }
 
-        /* Convert msgpack to JSON */
-        out_buf = flb_msgpack_raw_to_json_sds(tmp_sbuf.data, tmp_sbuf.size);
-        msgpack_sbuffer_destroy(&tmp_sbuf);
-        if (!out_buf) {
-            flb_log_event_decoder_destroy(&log_decoder);
-            es_bulk_destroy(bulk);
-            flb_sds_destroy(j_index);
-            return -1;
+        ret = es_bulk_item_begin(bulk);
+        if (ret == 0) {
+            if (id) {
+                id_index_len = es_compose_index_line(ctx, &j_id_index,
+                                                     es_index, id);
+                ret = es_bulk_write(bulk, j_id_index, id_index_len);
+            }
+            else {
+                ret = es_bulk_write(bulk, j_index, index_len);
+            }
         }
 
-        out_buf_len = flb_sds_len(out_buf);
-        if (strcasecmp(ctx->write_operation, FLB_ES_WRITE_OP_UPDATE) == 0) {
-            tmp_buf = out_buf;
-            out_buf = flb_sds_create_len(NULL, out_buf_len = out_buf_len + sizeof(ES_BULK_UPDATE_OP_BODY) - 2);
-            out_buf_len = snprintf(out_buf, out_buf_len, ES_BULK_UPDATE_OP_BODY, tmp_buf);
-            flb_sds_destroy(tmp_buf);
-        }
-        else if (strcasecmp(ctx->write_operation, FLB_ES_WRITE_OP_UPSERT) == 0) {
-            tmp_buf = out_buf;
-            out_buf = flb_sds_create_len(NULL, out_buf_len = out_buf_len + sizeof(ES_BULK_UPSERT_OP_BODY) - 2);
-            out_buf_len = snprintf(out_buf, out_buf_len, ES_BULK_UPSERT_OP_BODY, tmp_buf);
-            flb_sds_destroy(tmp_buf);
+        if (id_key_str) {
+            flb_sds_destroy(id_key_str);
+            id_key_str = NULL;
         }
 
-        ret = es_bulk_append(bulk, j_index, index_len,
-                             out_buf, out_buf_len,
-                             bytes, off_prev);
-        flb_sds_destroy(out_buf);
+        if (ret == 0) {
+            ret = es_write_document(ctx, bulk, tag, tag_len,
+                                    time_formatted, s, &map);
+        }
 
-        off_prev = off;
         if (ret == -1) {
             /* We likely ran out of memory, abort here */
             flb_log_event_decoder_destroy(&log_decoder);
-            *out_size = 0;
             es_bulk_destroy(bulk);
             flb_sds_destroy(j_index);
+            flb_sds_destroy(j_id_index);
             return -1;
         }
     }
     flb_log_event_decoder_destroy(&log_decoder);
 
+    if (ctx->trace_output) {
+        fwrite(bulk->ptr, 1, bulk->len, stdout);
+        fflush(stdout);
+    }
+    flb_sds_destroy(j_index);
+    flb_sds_destroy(j_id_index);
+
+    *out_bulk = bulk;
+    return 0;
+}
+
+static int elasticsearch_format(struct flb_config *config,
+                                struct flb_input_instance *ins,
+                                void *plugin_context,
+                                void *flush_ctx,
+                                int event_type,
+                                const char *tag, int tag_len,
+                                const void *data, size_t bytes,
+                                void **out_data, size_t *out_size)
+{
+    int ret;
+    struct es_bulk *bulk;
+    struct flb_elasticsearch *ctx = plugin_context;
+
+    ret = elasticsearch_format_bulk(ctx, tag, tag_len, data, bytes, &bulk);
+    if (ret != 0) {
+        *out_size = 0;
+        return -1;
+    }
+
     /* Set outgoing data */
     *out_data = bulk->ptr;
     *out_size = bulk->len;
@@ -606,12 +903,8 @@ static int elasticsearch_format(struct flb_config *config,
      * buffer with the data. Instead we just release the bulk context and
      * return the bulk->ptr buffer
      */
+    flb_free(bulk->items);
     flb_free(bulk);
-    if (ctx->trace_output) {
-        fwrite(*out_data, 1, *out_size, stdout);
-        fflush(stdout);
-    }
-    flb_sds_destroy(j_index);
     return 0;
 }
 
@@ -642,8 +935,14 @@ static int cb_es_init(struct flb_output_instance *ins,
     return 0;
 }
 
+/*
+ * Check the Bulk API response. If 'items_status' is set, the HTTP status
+ * reported for every item is stored on it (up to 'items_count' entries)
+ * following the same order of the items in the request.
+ */
 static int elasticsearch_error_check(struct flb_elasticsearch *ctx,
-                                     struct flb_http_client *c)
+                                     struct flb_http_client *c,
+                                     int *items_status, int items_count)
 {
     int i, j, k;
     int ret;
@@ -781,12 +1080,16 @@ static int elasticsearch_error_check(struct flb_elasticsearch *ctx,
                             check |= FLB_ES_STATUS_BAD_TYPE;
                             goto done;
                         }
+                        if (items_status && j < items_count) {
+                            items_status[j] = item_val.via.i64;
+                        }
+
                         /* Check for success responses */
                         if (item_val.via.i64 == 200 || item_val.via.i64 == 201) {
                             check |= FLB_ES_STATUS_SUCCESS;
                         }
                         /* Check for errors other than version conflict (document already exists) */
-                        if (item_val.via.i64 != 409) {
+                        else if (item_val.via.i64 != 409) {
                             check |= FLB_ES_STATUS_ERROR;
                         }
                     }
@@ -801,43 +1104,128 @@ static int elasticsearch_error_check(struct flb_elasticsearch *ctx,
     return check;
 }
 
-static void cb_es_flush(struct flb_event_chunk *event_chunk,
-                        struct flb_output_flush *out_flush,
-                        struct flb_input_instance *ins, void *out_context,
-                        struct flb_config *config)
+#ifdef FLB_HAVE_METRICS
+/* Account the bulk items per HTTP status reported by Elasticsearch */
+static void es_metrics_items(struct flb_elasticsearch *ctx,
+                             int *items_status, int items_count)
+{
+    int i;
+    int count = 0;
+    int status = 0;
+    uint64_t ts;
+    char tmp[32];
+    char *name = (char *) flb_output_name(ctx->ins);
+
+    ts = cfl_time_now();
+
+    /* group consecutive items with the same status */
+    for (i = 0; i <= items_count; i++) {
+        if (i < items_count && items_status[i] == status) {
+            count++;
+            continue;
+        }
+
+        if (count > 0 && status > 0) {
+            snprintf(tmp, sizeof(tmp) - 1, "%i", status);
+            cmt_counter_add(ctx->cmt_bulk_items, ts, count,
+                            2, (char *[]) {tmp, name});
+        }
+
+        if (i < items_count) {
+            status = items_status[i];
+            count = 1;
+        }
+    }
+}
+#endif
+
+/*
+ * Items rejected because of back-pressure (408, 429) or server side errors
+ * are worth to be sent again, mapping or parsing errors will fail again.
+ * Items without a status were not reported back, e.g: truncated response.
+ */
+static int es_item_is_retryable(int status)
 {
+    if (status == 0 || status == 408 || status == 429 || status >= 500) {
+        return FLB_TRUE;
+    }
+    return FLB_FALSE;
+}
+
+/*
+ * Compose a new bulk with the items that can be retried. Returns NULL if
+ * there is nothing to retry or on memory errors, in the latter case
+ * 'err' is set.
+ */
+static struct es_bulk *es_bulk_failed_items(struct flb_elasticsearch *ctx,
+                                            struct es_bulk *bulk,
+                                            int *items_status, int *err)
+{
+    int i;
     int ret;
+    int dropped = 0;
+    struct es_bulk *failed = NULL;
+
+    *err = FLB_FALSE;
+
+    for (i = 0; i < bulk->items_count; i++) {
+        if (items_status[i] == 200 || items_status[i] == 201 ||
+            items_status[i] == 409) {
+            continue;
+        }
+
+        if (es_item_is_retryable(items_status[i]) == FLB_FALSE) {
+            dropped++;
+            continue;
+        }
+
+        if (!failed) {
+            failed = es_bulk_create(ES_BULK_CHUNK);
+            if (!failed) {
+                *err = FLB_TRUE;
+                return NULL;
+            }
+        }
+
+        ret = es_bulk_append_item(failed, bulk, i);
+        if (ret == -1) {
+            es_bulk_destroy(failed);
+            *err = FLB_TRUE;
+            return NULL;
+        }
+    }
+
+    if (dropped > 0) {
+        flb_plg_warn(ctx->ins, "%i bulk items were rejected by Elasticsearch "
+                     "and will not be retried", dropped);
+    }
+
+    return failed;
+}
+
+/*
+ * Send a bulk request. It returns FLB_OK or FLB_RETRY, the result of the
+ * response check is set in 'check'.
+ */
+static int es_bulk_send(struct flb_elasticsearch *ctx,
+                        struct flb_connection *u_conn,
+                        struct es_bulk *bulk,
+                        int *items_status, int *check)
+{
+    int ret;
+    int result = FLB_RETRY;
     size_t pack_size;
     char *pack;
     void *out_buf;
     size_t out_size;
     size_t b_sent;
-    struct flb_elasticsearch *ctx = out_context;
-    struct flb_connection *u_conn;
     struct flb_http_client *c;
     flb_sds_t signature = NULL;
     int compressed = FLB_FALSE;
 
-    /* Get upstream connection */
-    u_conn = flb_upstream_conn_get(ctx->u);
-    if (!u_conn) {
-        FLB_OUTPUT_RETURN(FLB_RETRY);
-    }
-
-    /* Convert format */
-    ret = elasticsearch_format(config, ins,
-                               ctx, NULL,
-                               event_chunk->type,
-                               event_chunk->tag, flb_sds_len(event_chunk->tag),
-                               event_chunk->data, event_chunk->size,
-                               &out_buf, &out_size);
-    if (ret != 0) {
-        flb_upstream_conn_release(u_conn);
-        FLB_OUTPUT_RETURN(FLB_ERROR);
-    }
-
-    pack = (char *) out_buf;
-    pack_size = out_size;
+    *check = 0;
+    pack = bulk->ptr;
+    pack_size = bulk->len;
 
     /* Should we compress the payload ? */
     if (ctx->compress_gzip == FLB_TRUE) {
@@ -849,22 +1237,17 @@ static void cb_es_flush(struct flb_event_chunk *event_chunk,
         }
         else {
             compressed = FLB_TRUE;
+            pack = (char *) out_buf;
+            pack_size = out_size;
         }
-
-        /*
-         * The payload buffer is different than pack, means we must be free it.
-         */
-        if (out_buf != pack) {
-            flb_free(pack);
-        }
-
-        pack = (char *) out_buf;
-        pack_size = out_size;
     }
 
     /* Compose HTTP Client request */
     c = flb_http_client(u_conn, FLB_HTTP_POST, ctx->uri,
                         pack, pack_size, NULL, 0, NULL, 0);
+    if (!c) {
+        goto cleanup;
+    }
 
     flb_http_buffer_size(c, ctx->buffer_size);
 
@@ -885,7 +1268,7 @@ static void cb_es_flush(struct flb_event_chunk *event_chunk,
     if (ctx->has_aws_auth == FLB_TRUE) {
         signature = add_aws_auth(c, ctx);
         if (!signature) {
-            goto retry;
+            goto cleanup;
         }
     }
     else {
@@ -904,85 +1287,249 @@ static void cb_es_flush(struct flb_event_chunk *event_chunk,
     ret = flb_http_do(c, &b_sent);
     if (ret != 0) {
         flb_plg_warn(ctx->ins, "http_do=%i URI=%s", ret, ctx->uri);
-        goto retry;
+        goto cleanup;
     }
-    else {
-        /* The request was issued successfully, validate the 'error' field */
-        flb_plg_debug(ctx->ins, "HTTP Status=%i URI=%s", c->resp.status, ctx->uri);
-        if (c->resp.status != 200 && c->resp.status != 201) {
-            if (c->resp.payload_size > 0) {
-                flb_plg_error(ctx->ins, "HTTP status=%i URI=%s, response:\n%s\n",
-                              c->resp.status, ctx->uri, c->resp.payload);
-            }
-            else {
-                flb_plg_error(ctx->ins, "HTTP status=%i URI=%s",
-                              c->resp.status, ctx->uri);
-            }
-            goto retry;
-        }
 
+    /* The request was issued successfully, validate the 'error' field */
+    flb_plg_debug(ctx->ins, "HTTP Status=%i URI=%s", c->resp.status, ctx->uri);
+    if (c->resp.status != 200 && c->resp.status != 201) {
         if (c->resp.payload_size > 0) {
-            /*
-             * Elasticsearch payload should be JSON, we convert it to msgpack
-             * and lookup the 'error' field.
-             */
-            ret = elasticsearch_error_check(ctx, c);
-            if (ret & FLB_ES_STATUS_SUCCESS) {
-                flb_plg_debug(ctx->ins, "Elasticsearch response\n%s",
-                              c->resp.payload);
-            }
-            else {
-                /* we got an error */
-                if (ctx->trace_error) {
-                    /*
-                     * If trace_error is set, trace the actual
-                     * response from Elasticsearch explaining the problem.
-                     * Trace_Output can be used to see the request. 
-                     */
-                    if (pack_size < 4000) {
-                        flb_plg_debug(ctx->ins, "error caused by: Input\n%.*s\n",
-                                      (int) pack_size, pack);
-                    }
-                    if (c->resp.payload_size < 4000) {
-                        flb_plg_error(ctx->ins, "error: Output\n%s",
-                                      c->resp.payload);
-                    } else {
-                        /*
-                        * We must use fwrite since the flb_log functions
-                        * will truncate data at 4KB
-                        */
-                        fwrite(c->resp.payload, 1, c->resp.payload_size, stderr);
-                        fflush(stderr);
-                    }
-                }
-                goto retry;
-            }
+            flb_plg_error(ctx->ins, "HTTP status=%i URI=%s, response:\n%s\n",
+                          c->resp.status, ctx->uri, c->resp.payload);
         }
         else {
-            goto retry;
+            flb_plg_error(ctx->ins, "HTTP status=%i URI=%s",
+                          c->resp.status, ctx->uri);
         }
+        goto cleanup;
+    }
+
+    if (c->resp.payload_size <= 0) {
+        goto cleanup;
     }
 
-    /* Cleanup */
-    flb_http_client_destroy(c);
-    flb_free(pack);
-    flb_upstream_conn_release(u_conn);
+    /*
+     * Elasticsearch payload should be JSON, we convert it to msgpack
+     * and lookup the 'error' field.
+     */
+    *check = elasticsearch_error_check(ctx, c, items_status,
+                                       bulk->items_count);
+    if (*check & FLB_ES_STATUS_SUCCESS) {
+        flb_plg_debug(ctx->ins, "Elasticsearch response\n%s",
+                      c->resp.payload);
+        result = FLB_OK;
+    }
+
+    /* we got an error */
+    if ((*check & FLB_ES_STATUS_ERROR || result != FLB_OK) && ctx->trace_error) {
+        /*
+         * If trace_error is set, trace the actual
+         * response from Elasticsearch explaining the problem.
+         * Trace_Output can be used to see the request.
+         */
+        if (bulk->len < 4000) {
+            flb_plg_debug(ctx->ins, "error caused by: Input\n%.*s\n",
+                          (int) bulk->len, bulk->ptr);
+        }
+        if (c->resp.payload_size < 4000) {
+            flb_plg_error(ctx->ins, "error: Output\n%s",
+                          c->resp.payload);
+        } else {
+            /*
+            * We must use fwrite since the flb_log functions
+            * will truncate data at 4KB
+            */
+            fwrite(c->resp.payload, 1, c->resp.payload_size, stderr);
+            fflush(stderr);
+        }
+    }
+
+ cleanup:
+    if (c) {
+        flb_http_client_destroy(c);
+    }
+    if (compressed == FLB_TRUE) {
+        flb_free(pack);
+    }
     if (signature) {
         flb_sds_destroy(signature);
     }
-    FLB_OUTPUT_RETURN(FLB_OK);
 
-    /* Issue a retry */
- retry:
-    flb_http_client_destroy(c);
-    flb_free(pack);
+    return result;
+}
+
+static void cb_es_retry_timer(struct flb_config *config, void *data)
+{
+    (void) config;
+
+    flb_coro_resume((struct flb_coro *) data);
+}
+
+/*
+ * Wait before a partial retry using a capped exponential backoff with full
+ * jitter. The flush coroutine is suspended until a one-shot timer fires, so
+ * the event loop keeps serving other flushes. Returns -1 if the wait cannot
+ * be scheduled, the caller then leaves the backoff to the engine.
+ */
+static int es_retry_wait(struct flb_elasticsearch *ctx, int attempt)
+{
+    int ret;
+    int cap;
+    int seconds;
+    unsigned int val;
+    struct flb_coro *coro;
+    struct flb_sched *sched;
+
+    if (attempt > 5) {
+        attempt = 5;
+    }
+
+    cap = FLB_ES_RETRY_BACKOFF_BASE * (1 << attempt);
+    if (cap > FLB_ES_RETRY_BACKOFF_CAP) {
+        cap = FLB_ES_RETRY_BACKOFF_CAP;
+    }
+
+    seconds = cap;
+    if (flb_random_bytes((unsigned char *) &val, sizeof(val)) == 0) {
+        seconds = FLB_ES_RETRY_BACKOFF_BASE +
+                  (val % (cap - FLB_ES_RETRY_BACKOFF_BASE + 1));
+    }
+
+    coro = flb_coro_get();
+    sched = flb_sched_ctx_get();
+    if (!coro || !sched) {
+        return -1;
+    }
+
+    ret = flb_sched_timer_cb_create(sched, FLB_SCHED_TIMER_CB_ONESHOT,
+                                    seconds * 1000, cb_es_retry_timer,
+                                    coro, NULL);
+    if (ret != 0) {
+        return -1;
+    }
+
+    flb_plg_debug(ctx->ins, "waiting %i seconds before retrying bulk items",
+                  seconds);
+    flb_coro_yield(coro, FLB_FALSE);
 
-    if (out_buf != pack) {
-        flb_free(out_buf);
+    return 0;
+}
+
+static void cb_es_flush(struct flb_event_chunk *event_chunk,
+                        struct flb_output_flush *out_flush,
+                        struct flb_input_instance *ins, void *out_context,
+                        struct flb_config *config)
+{
+    int ret;
+    int err;
+    int check;
+    int attempts = 0;
+    int total;
+    int *items_status = NULL;
+    struct es_bulk *bulk;
+    struct es_bulk *failed;
+    struct flb_elasticsearch *ctx = out_context;
+    struct flb_connection *u_conn;
+
+    /* Convert format */
+    ret = elasticsearch_format_bulk(ctx,
+                                    event_chunk->tag,
+                                    flb_sds_len(event_chunk->tag),
+                                    event_chunk->data, event_chunk->size,
+                                    &bulk);
+    if (ret != 0) {
+        FLB_OUTPUT_RETURN(FLB_ERROR);
     }
 
-    flb_upstream_conn_release(u_conn);
-    FLB_OUTPUT_RETURN(FLB_RETRY);
+    if (bulk->items_count == 0) {
+        es_bulk_destroy(bulk);
+        FLB_OUTPUT_RETURN(FLB_OK);
+    }
+    total = bulk->items_count;
+
+    while (1) {
+        /* Get upstream connection */
+        u_conn = flb_upstream_conn_get(ctx->u);
+        if (!u_conn) {
+            ret = FLB_RETRY;
+            break;
+        }
+
+        /* keep track of the status of every item of the request */
+        items_status = flb_calloc(bulk->items_count, sizeof(int));
+        if (!items_status) {
+            flb_errno();
+        }
+
+        ret = es_bulk_send(ctx, u_conn, bulk, items_status, &check);
+        flb_upstream_conn_release(u_conn);
+
+#ifdef FLB_HAVE_METRICS
+        if (items_status) {
+            es_metrics_items(ctx, items_status, bulk->items_count);
+        }
+#endif
+
+        /*
+         * Keep the previous behavior unless partial retries are enabled and
+         * Elasticsearch reported back a status for the items.
+         */
+        if (ctx->retry_failed_items <= 0 || !items_status ||
+            !(check & FLB_ES_STATUS_ERROR)) {
+            break;
+        }
+
+        failed = es_bulk_failed_items(ctx, bulk, items_status, &err);
+        if (err == FLB_TRUE) {
+            ret = FLB_RETRY;
+            break;
+        }
+        else if (!failed) {
+            /* nothing else to retry */
+            ret = FLB_OK;
+            break;
+        }
+
+        /*
+         * Retry the whole chunk when the partial retries are exhausted, the
+         * engine applies Retry_Limit and the storage backlog. Items already
+         * indexed may be sent again, as without partial retries.
+         */
+        if (attempts >= ctx->retry_failed_items) {
+            flb_plg_warn(ctx->ins, "%i of %i bulk items still failing after "
+                         "%i partial retries, retrying the chunk",
+                         failed->items_count, total, attempts);
+            es_bulk_destroy(failed);
+            ret = FLB_RETRY;
+            break;
+        }
+
+        flb_free(items_status);
+        items_status = NULL;
+        es_bulk_destroy(bulk);
+        bulk = failed;
+
+        if (es_retry_wait(ctx, attempts) != 0) {
+            ret = FLB_RETRY;
+            break;
+        }
+
+        attempts++;
+        flb_plg_debug(ctx->ins, "retrying %i of %i bulk items (attempt %i)",
+                      bulk->items_count, total, attempts);
+#ifdef FLB_HAVE_METRICS
+        cmt_counter_add(ctx->cmt_bulk_items_retried, cfl_time_now(),
+                        bulk->items_count,
+                        1, (char *[]) {(char *) flb_output_name(ctx->ins)});
+#endif
+    }
+
+    if (items_status) {
+        flb_free(items_status);
+    }
+    es_bulk_destroy(bulk);
+
+    FLB_OUTPUT_RETURN(ret);
 }
 
 static int cb_es_exit(void *data, struct flb_config *config)
@@ -1029,6 +1576,12 @@ static struct flb_config_map config_map[] = {
      0, FLB_FALSE, 0,
      "Set payload compression mechanism. Option available is 'gzip'"
     },
+    {
+     FLB_CONFIG_MAP_BOOL, "http2", "false",
+     0, FLB_TRUE, offsetof(struct flb_elasticsearch, http2),
+     "Send requests over HTTP/2, multiplexing concurrent flushes over "
+     "shared connections"
+    },
 
     /* Cloud Authentication */
     {
@@ -1200,6 +1753,16 @@ static struct flb_config_map config_map[] = {
      "Use current time for index generation instead of message record"
     },
 
+    {
+     FLB_CONFIG_MAP_INT, "retry_failed_items", "0",
+     0, FLB_TRUE, offsetof(struct flb_elasticsearch, retry_failed_items),
+     "When a bulk request is partially rejected, re-send only the failed items "
+     "(HTTP status 408, 429 and 5xx) up to this number of times, waiting with "
+     "an exponential backoff between attempts. If items still fail afterwards "
+     "the whole chunk is retried, which may index some documents twice. Items "
+     "rejected with any other error are not retried. Set to 0 to disable"
+    },
+
     /* Trace */
     {
      FLB_CONFIG_MAP_BOOL, "trace_output", "false",
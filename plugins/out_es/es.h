@@ -36,6 +36,12 @@
 #define FLB_ES_WRITE_OP_UPDATE    "update"
 #define FLB_ES_WRITE_OP_UPSERT    "upsert"
 
+/* Write operations */
+#define FLB_ES_OP_INDEX           0
+#define FLB_ES_OP_CREATE          1
+#define FLB_ES_OP_UPDATE          2
+#define FLB_ES_OP_UPSERT          3
+
 #define FLB_ES_STATUS_SUCCESS          (1 << 0)
 #define FLB_ES_STATUS_IMCOMPLETE       (1 << 1)
 #define FLB_ES_STATUS_ERROR_UNPACK     (1 << 2)
@@ -45,6 +51,10 @@
 #define FLB_ES_STATUS_DUPLICATES       (1 << 6)
 #define FLB_ES_STATUS_ERROR            (1 << 7)
 
+/* Backoff (seconds) between partial retries of failed bulk items */
+#define FLB_ES_RETRY_BACKOFF_BASE      1
+#define FLB_ES_RETRY_BACKOFF_CAP       30
+
 struct flb_elasticsearch {
     /* Elasticsearch index (database) and type (table) */
     char *index;
@@ -88,6 +98,9 @@ struct flb_elasticsearch {
     int trace_output;
     int trace_error;
 
+    /* Number of times failed bulk items are re-sent on their own */
+    int retry_failed_items;
+
     /*
      * Logstash compatibility options
      * ==============================
@@ -122,6 +135,7 @@ struct flb_elasticsearch {
     flb_sds_t write_operation;
     /* write operation elasticsearch operation */
     flb_sds_t es_action;
+    int write_op;
 
     /* id_key */
     flb_sds_t id_key;
@@ -139,9 +153,17 @@ struct flb_elasticsearch {
     /* Compression mode (gzip) */
     int compress_gzip;
 
+    /* Use HTTP/2 */
+    int http2;
+
     /* Upstream connection to the backend server */
     struct flb_upstream *u;
 
+#ifdef FLB_HAVE_METRICS
+    struct cmt_counter *cmt_bulk_items;
+    struct cmt_counter *cmt_bulk_items_retried;
+#endif
+
     /* Plugin output instance reference */
     struct flb_output_instance *ins;
 };
@@ -20,9 +20,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <math.h>
 
 #include <fluent-bit.h>
+#include <fluent-bit/flb_pack.h>
 #include "es_bulk.h"
 
 struct es_bulk *es_bulk_create(size_t estimated_size)
@@ -48,6 +48,16 @@ struct es_bulk *es_bulk_create(size_t estimated_size)
     b->size = estimated_size;
     b->len  = 0;
 
+    b->items = flb_malloc(sizeof(uint32_t) * ES_BULK_ITEMS);
+    if (!b->items) {
+        perror("malloc");
+        flb_free(b->ptr);
+        flb_free(b);
+        return NULL;
+    }
+    b->items_size = ES_BULK_ITEMS;
+    b->items_count = 0;
+
     return b;
 }
 
@@ -56,58 +66,141 @@ void es_bulk_destroy(struct es_bulk *bulk)
     if (bulk->size > 0) {
         flb_free(bulk->ptr);
     }
+    flb_free(bulk->items);
     flb_free(bulk);
 }
 
-int es_bulk_append(struct es_bulk *bulk, char *index, int i_len,
-                   char *json, size_t j_len,
-                   size_t whole_size, size_t converted_size)
+/* Register the offset where a new item starts */
+static int bulk_item_register(struct es_bulk *bulk)
 {
-    int available;
-    int append_size;
-    int required;
-    int remaining_size;
-    char *ptr;
+    uint32_t size;
+    uint32_t *tmp;
 
-    required = i_len + j_len + ES_BULK_HEADER + 1;
-    available = (bulk->size - bulk->len);
-
-    if (available < required) {
-        /*
-         *  estimate a converted size of json
-         *  calculate
-         *    1. rest of msgpack data size
-         *    2. ratio from bulk json size and processed msgpack size.
-         */
-        append_size = required - available;
-        if (converted_size == 0) {
-            /* converted_size = 0 causes div/0 */
-            flb_debug("[out_es] converted_size is 0");
-        } else {
-            remaining_size = ceil((whole_size - converted_size) /* rest of size to convert */
-                * ((double)bulk->size / converted_size));       /* = json size / msgpack size */
-            append_size = fmax(append_size, remaining_size);
-        }
-        if (append_size < ES_BULK_CHUNK) {
-            /* append at least ES_BULK_CHUNK size */
-            append_size = ES_BULK_CHUNK;
-        }
-        ptr = flb_realloc(bulk->ptr, bulk->size + append_size);
-        if (!ptr) {
+    if (bulk->items_count == bulk->items_size) {
+        size = bulk->items_size * 2;
+        tmp = flb_realloc(bulk->items, sizeof(uint32_t) * size);
+        if (!tmp) {
             flb_errno();
             return -1;
         }
-        bulk->ptr  = ptr;
-        bulk->size += append_size;
+        bulk->items = tmp;
+        bulk->items_size = size;
+    }
+
+    bulk->items[bulk->items_count++] = bulk->len;
+    return 0;
+}
+
+/* Make sure the bulk buffer has room for at least 'size' more bytes */
+static int bulk_reserve(struct es_bulk *bulk, size_t size)
+{
+    size_t append_size;
+    char *ptr;
+
+    if (bulk->size - bulk->len >= size) {
+        return 0;
+    }
+
+    /* grow by half of the current size, at least ES_BULK_CHUNK */
+    append_size = bulk->size / 2;
+    if (append_size < size) {
+        append_size = size;
+    }
+    if (append_size < ES_BULK_CHUNK) {
+        append_size = ES_BULK_CHUNK;
+    }
+
+    ptr = flb_realloc(bulk->ptr, bulk->size + append_size);
+    if (!ptr) {
+        flb_errno();
+        return -1;
+    }
+    bulk->ptr  = ptr;
+    bulk->size += append_size;
+
+    return 0;
+}
+
+/*
+ * Copy the item number 'item' (action and document lines) from the 'src'
+ * bulk into 'bulk'. It's used to compose a reduced bulk request that only
+ * contains the items that failed on a previous request.
+ */
+int es_bulk_append_item(struct es_bulk *bulk, struct es_bulk *src, int item)
+{
+    uint32_t start;
+    uint32_t end;
+    uint32_t len;
+
+    if (item < 0 || item >= src->items_count) {
+        return -1;
     }
 
-    memcpy(bulk->ptr + bulk->len, index, i_len);
-    bulk->len += i_len;
+    start = src->items[item];
+    if (item + 1 < src->items_count) {
+        end = src->items[item + 1];
+    }
+    else {
+        end = src->len;
+    }
+    len = end - start;
+
+    if (bulk_reserve(bulk, len) == -1) {
+        return -1;
+    }
 
-    memcpy(bulk->ptr + bulk->len, json, j_len);
-    bulk->len += j_len;
-    bulk->ptr[bulk->len] = '\n';
-    bulk->len++;
+    if (bulk_item_register(bulk) == -1) {
+        return -1;
+    }
+
+    memcpy(bulk->ptr + bulk->len, src->ptr + start, len);
+    bulk->len += len;
 
     return 0;
-};
+}
+
+/* Mark the beginning of a new item (action line + document line) */
+int es_bulk_item_begin(struct es_bulk *bulk)
+{
+    return bulk_item_register(bulk);
+}
+
+int es_bulk_write(struct es_bulk *bulk, const char *buf, size_t len)
+{
+    if (bulk_reserve(bulk, len) == -1) {
+        return -1;
+    }
+
+    memcpy(bulk->ptr + bulk->len, buf, len);
+    bulk->len += len;
+
+    return 0;
+}
+
+/*
+ * Write the JSON representation of a msgpack object straight into the
+ * bulk buffer, the buffer is expanded until the object fits.
+ */
+int es_bulk_write_object(struct es_bulk *bulk, const msgpack_object *o)
+{
+    int ret;
+    size_t available;
+
+    /* the JSON encoder needs room for the NULL byte */
+    if (bulk_reserve(bulk, 2) == -1) {
+        return -1;
+    }
+
+    while (1) {
+        available = bulk->size - bulk->len;
+        ret = flb_msgpack_to_json(bulk->ptr + bulk->len, available, o);
+        if (ret > 0) {
+            bulk->len += ret;
+            return 0;
+        }
+
+        if (bulk_reserve(bulk, available * 2) == -1) {
+            return -1;
+        }
+    }
+}
@@ -21,6 +21,7 @@
 #define FLB_OUT_ES_BULK_H
 
 #include <inttypes.h>
+#include <msgpack.h>
 
 #define ES_BULK_CHUNK      4096  /* Size of buffer chunks    */
 #define ES_BULK_HEADER      165  /* ES Bulk API prefix line  */
@@ -28,19 +29,31 @@
 #define ES_BULK_INDEX_FMT_ID "{\"%s\":{\"_index\":\"%s\",\"_type\":\"%s\",\"_id\":\"%s\"}}\n"
 #define ES_BULK_INDEX_FMT_WITHOUT_TYPE  "{\"%s\":{\"_index\":\"%s\"}}\n"
 #define ES_BULK_INDEX_FMT_ID_WITHOUT_TYPE "{\"%s\":{\"_index\":\"%s\",\"_id\":\"%s\"}}\n"
-#define ES_BULK_UPDATE_OP_BODY "{\"doc\":%s}"
-#define ES_BULK_UPSERT_OP_BODY "{\"doc_as_upsert\":true,\"doc\":%s}"
+#define ES_BULK_UPDATE_OP_BODY "{\"doc\":"
+#define ES_BULK_UPSERT_OP_BODY "{\"doc_as_upsert\":true,\"doc\":"
+
+#define ES_BULK_ITEMS      64    /* Initial item offsets slots */
 
 struct es_bulk {
     char *ptr;
     uint32_t len;
     uint32_t size;
+
+    /*
+     * Offset where every bulk item (action line + document line) starts,
+     * items are stored in the same order Elasticsearch reports them back
+     * in the 'items' array of the response.
+     */
+    uint32_t *items;
+    uint32_t items_count;
+    uint32_t items_size;
 };
 
 struct es_bulk *es_bulk_create(size_t estimated_size);
-int es_bulk_append(struct es_bulk *bulk, char *index, int i_len,
-                   char *json, size_t j_len,
-                   size_t whole_size, size_t curr_size);
+int es_bulk_item_begin(struct es_bulk *bulk);
+int es_bulk_write(struct es_bulk *bulk, const char *buf, size_t len);
+int es_bulk_write_object(struct es_bulk *bulk, const msgpack_object *o);
+int es_bulk_append_item(struct es_bulk *bulk, struct es_bulk *src, int item);
 void es_bulk_destroy(struct es_bulk *bulk);
 
 #endif
@@ -21,6 +21,7 @@
 #include <fluent-bit/flb_mem.h>
 #include <fluent-bit/flb_utils.h>
 #include <fluent-bit/flb_http_client.h>
+#include <fluent-bit/flb_http_client_http2.h>
 #include <fluent-bit/flb_record_accessor.h>
 #include <fluent-bit/flb_signv4.h>
 #include <fluent-bit/flb_aws_credentials.h>
@@ -261,6 +262,11 @@ struct flb_elasticsearch *flb_es_conf_create(struct flb_output_instance *ins,
     /* Set instance flags into upstream */
     flb_output_upstream_set(ctx->u, ins);
 
+    /* HTTP/2 */
+    if (ctx->http2 == FLB_TRUE) {
+        flb_http2_client_upstream_setup(ctx->u, ins->tls, NULL);
+    }
+
     /* Set manual Index and Type */
     if (f_index) {
         ctx->index = flb_strdup(f_index->value); /* FIXME */
@@ -304,13 +310,19 @@ struct flb_elasticsearch *flb_es_conf_create(struct flb_output_instance *ins,
     if (ctx->write_operation) {
         if (strcasecmp(ctx->write_operation, FLB_ES_WRITE_OP_INDEX) == 0) {
             ctx->es_action = flb_strdup(FLB_ES_WRITE_OP_INDEX);
+            ctx->write_op = FLB_ES_OP_INDEX;
         }
         else if (strcasecmp(ctx->write_operation, FLB_ES_WRITE_OP_CREATE) == 0) {
             ctx->es_action = flb_strdup(FLB_ES_WRITE_OP_CREATE);
+            ctx->write_op = FLB_ES_OP_CREATE;
+        }
+        else if (strcasecmp(ctx->write_operation, FLB_ES_WRITE_OP_UPDATE) == 0) {
+            ctx->es_action = flb_strdup(FLB_ES_WRITE_OP_UPDATE);
+            ctx->write_op = FLB_ES_OP_UPDATE;
         }
-        else if (strcasecmp(ctx->write_operation, FLB_ES_WRITE_OP_UPDATE) == 0
-            || strcasecmp(ctx->write_operation, FLB_ES_WRITE_OP_UPSERT) == 0) {
+        else if (strcasecmp(ctx->write_operation, FLB_ES_WRITE_OP_UPSERT) == 0) {
             ctx->es_action = flb_strdup(FLB_ES_WRITE_OP_UPDATE);
+            ctx->write_op = FLB_ES_OP_UPSERT;
         }
         else {
             flb_plg_error(ins, "wrong Write_Operation (should be one of index, create, update, upsert)");
@@ -352,6 +364,25 @@ struct flb_elasticsearch *flb_es_conf_create(struct flb_output_instance *ins,
         }
     }
 
+    /* Register metrics */
+#ifdef FLB_HAVE_METRICS
+    ctx->cmt_bulk_items = cmt_counter_create(ins->cmt,
+                                             "fluentbit",
+                                             "es",
+                                             "bulk_items_total",
+                                             "Total number of bulk items by "
+                                             "response status.",
+                                             2, (char *[]) {"status", "name"});
+
+    ctx->cmt_bulk_items_retried = cmt_counter_create(ins->cmt,
+                                                     "fluentbit",
+                                                     "es",
+                                                     "bulk_items_retried_total",
+                                                     "Total number of failed bulk "
+                                                     "items sent again.",
+                                                     1, (char *[]) {"name"});
+#endif
+
 #ifdef FLB_HAVE_AWS
     /* AWS Auth Unsigned Headers */
     ctx->aws_unsigned_headers = flb_malloc(sizeof(struct mk_list));
@@ -699,6 +699,12 @@ static struct flb_config_map config_map[] = {
      0, FLB_FALSE, 0,
      "Set payload compression mechanism. Option available is 'gzip'"
     },
+    {
+     FLB_CONFIG_MAP_BOOL, "http2", "false",
+     0, FLB_TRUE, offsetof(struct flb_out_http, http2),
+     "Send requests over HTTP/2, multiplexing concurrent flushes over "
+     "shared connections"
+    },
     {
      FLB_CONFIG_MAP_SLIST_1, "header", NULL,
      FLB_CONFIG_MAP_MULT, FLB_TRUE, offsetof(struct flb_out_http, headers),
@@ -86,6 +86,9 @@ struct flb_out_http {
     /* Compression mode (gzip) */
     int compress_gzip;
 
+    /* Use HTTP/2 */
+    int http2;
+
     /* Allow duplicated headers */
     int allow_dup_headers;
 
@@ -23,6 +23,7 @@
 #include <fluent-bit/flb_sds.h>
 #include <fluent-bit/flb_kv.h>
 #include <fluent-bit/flb_record_accessor.h>
+#include <fluent-bit/flb_http_client_http2.h>
 #ifdef FLB_HAVE_SIGNV4
 #ifdef FLB_HAVE_AWS
 #include <fluent-bit/flb_aws_credentials.h>
@@ -268,6 +269,11 @@ struct flb_out_http *flb_http_conf_create(struct flb_output_instance *ins,
     /* Set instance flags into upstream */
     flb_output_upstream_set(ctx->u, ins);
 
+    /* HTTP/2 */
+    if (ctx->http2 == FLB_TRUE) {
+        flb_http2_client_upstream_setup(ctx->u, ins->tls, ctx->proxy);
+    }
+
     return ctx;
 }
 
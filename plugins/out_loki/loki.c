@@ -23,6 +23,7 @@
 #include <fluent-bit/flb_utils.h>
 #include <fluent-bit/flb_time.h>
 #include <fluent-bit/flb_http_client.h>
+#include <fluent-bit/flb_http_client_http2.h>
 #include <fluent-bit/flb_ra_key.h>
 #include <fluent-bit/flb_thread_storage.h>
 #include <fluent-bit/record_accessor/flb_ra_parser.h>
@@ -1076,6 +1077,10 @@ static struct flb_loki *loki_config_create(struct flb_output_instance *ins,
     }
     ctx->u = upstream;
     flb_output_upstream_set(ctx->u, ins);
+
+    if (ctx->http2 == FLB_TRUE) {
+        flb_http2_client_upstream_setup(ctx->u, ins->tls, NULL);
+    }
     ctx->tcp_port = ins->host.port;
     ctx->tcp_host = ins->host.name;
 
@@ -1984,6 +1989,13 @@ static struct flb_config_map config_map[] = {
      "Set payload compression in network transfer. Option available is 'gzip'"
     },
 
+    {
+     FLB_CONFIG_MAP_BOOL, "http2", "false",
+     0, FLB_TRUE, offsetof(struct flb_loki, http2),
+     "Send requests over HTTP/2, multiplexing concurrent flushes over "
+     "shared connections"
+    },
+
     /* EOF */
     {0}
 };
@@ -66,6 +66,7 @@ struct flb_loki {
     flb_sds_t tenant_id;
     flb_sds_t tenant_id_key_config;
     int compress_gzip;
+    int http2;
 
     /* HTTP Auth */
     flb_sds_t http_user;
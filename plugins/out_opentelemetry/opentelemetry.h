@@ -147,6 +147,9 @@ struct opentelemetry_context {
     /* Compression mode (gzip) */
     int compress_gzip;
 
+    /* Use HTTP/2 */
+    int http2;
+
     /* FLB/OTLP Record accessor patterns */
     struct flb_record_accessor *ra_meta_schema;
     struct flb_record_accessor *ra_meta_resource_id;
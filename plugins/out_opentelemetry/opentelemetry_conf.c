@@ -23,6 +23,7 @@
 #include <fluent-bit/flb_sds.h>
 #include <fluent-bit/flb_kv.h>
 #include <fluent-bit/flb_record_accessor.h>
+#include <fluent-bit/flb_http_client_http2.h>
 
 #include "opentelemetry.h"
 #include "opentelemetry_conf.h"
@@ -387,6 +388,11 @@ struct opentelemetry_context *flb_opentelemetry_context_create(struct flb_output
     /* Set instance flags into upstream */
     flb_output_upstream_set(ctx->u, ins);
 
+    /* HTTP/2 */
+    if (ctx->http2 == FLB_TRUE) {
+        flb_http2_client_upstream_setup(ctx->u, ins->tls, ctx->proxy);
+    }
+
     tmp = flb_output_get_property("compress", ins);
     ctx->compress_gzip = FLB_FALSE;
     if (tmp) {
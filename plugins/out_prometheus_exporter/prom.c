@@ -125,14 +125,27 @@ static void append_labels(struct prom_exporter *ctx, struct cmt *cmt)
     }
 }
 
+/*
+ * Store the metrics of an input instance, returns 1 if they are the same
+ * than the ones reported previously so the HTTP server is not updated.
+ */
 static int hash_store(struct prom_exporter *ctx, struct flb_input_instance *ins,
                       cfl_sds_t buf)
 {
     int ret;
     int len;
+    void *prev;
+    size_t prev_size;
 
     len = strlen(ins->name);
 
+    ret = flb_hash_table_get(ctx->ht_metrics, ins->name, len,
+                             &prev, &prev_size);
+    if (ret >= 0 && prev_size == cfl_sds_len(buf) &&
+        memcmp(prev, buf, prev_size) == 0) {
+        return 1;
+    }
+
     /* store/override the content into the hash table */
     ret = flb_hash_table_add(ctx->ht_metrics, ins->name, len,
                              buf, cfl_sds_len(buf));
@@ -143,29 +156,6 @@ static int hash_store(struct prom_exporter *ctx, struct flb_input_instance *ins,
     return 0;
 }
 
-static flb_sds_t hash_format_metrics(struct prom_exporter *ctx)
-{
-    int size = 2048;
-    flb_sds_t buf;
-
-    struct mk_list *head;
-    struct flb_hash_table_entry *entry;
-
-
-    buf = flb_sds_create_size(size);
-    if (!buf) {
-        return NULL;
-    }
-
-    /* Take every hash entry and compose one buffer with the whole content */
-    mk_list_foreach(head, &ctx->ht_metrics->entries) {
-        entry = mk_list_entry(head, struct flb_hash_table_entry, _head_parent);
-        flb_sds_cat_safe(&buf, entry->val, entry->val_size);
-    }
-
-    return buf;
-}
-
 static void cb_prom_flush(struct flb_event_chunk *event_chunk,
                           struct flb_output_flush *out_flush,
                           struct flb_input_instance *ins, void *out_context,
@@ -174,7 +164,6 @@ static void cb_prom_flush(struct flb_event_chunk *event_chunk,
     int ret;
     int add_ts;
     size_t off = 0;
-    flb_sds_t metrics;
     cfl_sds_t text = NULL;
     cfl_sds_t tmp = NULL;
     struct cmt *cmt;
@@ -241,23 +230,18 @@ static void cb_prom_flush(struct flb_event_chunk *event_chunk,
         flb_plg_error(ctx->ins, "could not store metrics coming from: %s",
                       flb_input_name(ins));
         flb_sds_destroy(text);
-        cmt_destroy(cmt);
         FLB_OUTPUT_RETURN(FLB_ERROR);
     }
-    flb_sds_destroy(text);
-
-    /* retrieve a full copy of all metrics */
-    metrics = hash_format_metrics(ctx);
-    if (!metrics) {
-        flb_plg_error(ctx->ins, "could not retrieve metrics");
-        FLB_OUTPUT_RETURN(FLB_ERROR);
+    else if (ret == 1) {
+        /* unchanged, the HTTP server keeps serving the cached content */
+        flb_sds_destroy(text);
+        FLB_OUTPUT_RETURN(FLB_OK);
     }
 
-    /* push new (full) metrics payload */
-    ret = prom_http_server_mq_push_metrics(ctx->http,
-                                           (char *) metrics,
-                                           flb_sds_len(metrics));
-    flb_sds_destroy(metrics);
+    /* push the metrics of this input, the other inputs are untouched */
+    ret = prom_http_server_mq_push_metrics(ctx->http, ins->name,
+                                           text, flb_sds_len(text));
+    flb_sds_destroy(text);
 
     if (ret != 0) {
         FLB_OUTPUT_RETURN(FLB_ERROR);
@@ -294,6 +278,20 @@ static struct flb_config_map config_map[] = {
      "Add timestamp to every metric honoring collection time."
     },
 
+    {
+     FLB_CONFIG_MAP_BOOL, "gzip", "true",
+     0, FLB_TRUE, offsetof(struct prom_exporter, gzip),
+     "Compress the scrape responses with gzip when the client accepts it."
+    },
+
+    {
+     FLB_CONFIG_MAP_BOOL, "openmetrics", "false",
+     0, FLB_TRUE, offsetof(struct prom_exporter, openmetrics),
+     "Serve the OpenMetrics format to clients that rank it at least as high "
+     "as the text format in their Accept header. When disabled the text "
+     "format is always served."
+    },
+
     {
      FLB_CONFIG_MAP_SLIST_1, "add_label", NULL,
      FLB_CONFIG_MAP_MULT, FLB_TRUE, offsetof(struct prom_exporter, add_labels),
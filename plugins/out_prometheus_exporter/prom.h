@@ -33,6 +33,12 @@ struct prom_exporter {
     /* add timestamp to every metric */
     int add_timestamp;
 
+    /* gzip scrape responses when the client accepts it */
+    int gzip;
+
+    /* serve OpenMetrics to clients that prefer it */
+    int openmetrics;
+
     /* config reader for 'add_label' */
     struct mk_list *add_labels;
 
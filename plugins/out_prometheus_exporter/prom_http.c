@@ -19,56 +19,109 @@
 
 #include <fluent-bit/flb_output_plugin.h>
 #include <fluent-bit/flb_http_server.h>
+#include <fluent-bit/flb_gzip.h>
 #include "prom.h"
 #include "prom_http.h"
 
 pthread_key_t ph_metrics_key;
 
-/* Return the newest storage metrics buffer */
-static struct prom_http_buf *metrics_get_latest()
+static struct prom_http_state *state_get()
+{
+    struct prom_http_state *st;
+
+    st = pthread_getspecific(ph_metrics_key);
+    if (st) {
+        return st;
+    }
+
+    st = flb_calloc(1, sizeof(struct prom_http_state));
+    if (!st) {
+        flb_errno();
+        return NULL;
+    }
+    mk_list_init(&st->fragments);
+    mk_list_init(&st->snapshots);
+    pthread_setspecific(ph_metrics_key, st);
+
+    return st;
+}
+
+static void fragment_release(struct prom_http_fragment *frag)
 {
+    frag->users--;
+    if (frag->users > 0) {
+        return;
+    }
+
+    flb_sds_destroy(frag->name);
+    flb_free(frag->data);
+    flb_free(frag);
+}
+
+static void snapshot_destroy(struct prom_http_buf *buf)
+{
+    int i;
+
+    for (i = 0; i < buf->count; i++) {
+        fragment_release(buf->fragments[i]);
+    }
+    for (i = 0; i < 4; i++) {
+        if (buf->bodies[i].data) {
+            flb_free(buf->bodies[i].data);
+        }
+    }
+
+    mk_list_del(&buf->_head);
+    flb_free(buf->fragments);
+    flb_free(buf);
+}
+
+/* Reference the current fragments, nothing is copied */
+static struct prom_http_buf *snapshot_create(struct prom_http_state *st)
+{
+    int i = 0;
+    struct mk_list *head;
     struct prom_http_buf *buf;
-    struct mk_list *metrics_list;
+    struct prom_http_fragment *frag;
 
-    metrics_list = pthread_getspecific(ph_metrics_key);
-    if (!metrics_list) {
+    buf = flb_calloc(1, sizeof(struct prom_http_buf));
+    if (!buf) {
+        flb_errno();
         return NULL;
     }
 
-    if (mk_list_size(metrics_list) == 0) {
+    buf->fragments = flb_calloc(mk_list_size(&st->fragments) + 1,
+                                sizeof(struct prom_http_fragment *));
+    if (!buf->fragments) {
+        flb_errno();
+        flb_free(buf);
         return NULL;
     }
 
-    buf = mk_list_entry_last(metrics_list, struct prom_http_buf, _head);
+    mk_list_foreach(head, &st->fragments) {
+        frag = mk_list_entry(head, struct prom_http_fragment, _head);
+        frag->users++;
+        buf->fragments[i++] = frag;
+        buf->size += frag->size;
+    }
+    buf->count = i;
+
+    mk_list_add(&buf->_head, &st->snapshots);
     return buf;
 }
 
-/* Delete unused metrics, note that we only care about the latest node */
-static int cleanup_metrics()
+static int cleanup_metrics(struct prom_http_state *st,
+                           struct prom_http_buf *last)
 {
     int c = 0;
     struct mk_list *tmp;
     struct mk_list *head;
-    struct mk_list *metrics_list;
-    struct prom_http_buf *last;
     struct prom_http_buf *entry;
 
-    metrics_list = pthread_getspecific(ph_metrics_key);
-    if (!metrics_list) {
-        return -1;
-    }
-
-    last = metrics_get_latest();
-    if (!last) {
-        return -1;
-    }
-
-    mk_list_foreach_safe(head, tmp, metrics_list) {
+    mk_list_foreach_safe(head, tmp, &st->snapshots) {
         entry = mk_list_entry(head, struct prom_http_buf, _head);
         if (entry != last && entry->users == 0) {
-            mk_list_del(&entry->_head);
-            flb_free(entry->buf_data);
-            flb_free(entry);
+            snapshot_destroy(entry);
             c++;
         }
     }
@@ -76,73 +129,123 @@ static int cleanup_metrics()
     return c;
 }
 
-/* destructor callback */
+static struct prom_http_buf *metrics_get_latest()
+{
+    struct prom_http_buf *buf;
+    struct prom_http_state *st;
+
+    st = pthread_getspecific(ph_metrics_key);
+    if (!st || mk_list_size(&st->fragments) == 0) {
+        return NULL;
+    }
+
+    /* new snapshot only if some input reported different metrics */
+    if (!st->dirty && mk_list_size(&st->snapshots) > 0) {
+        return mk_list_entry_last(&st->snapshots, struct prom_http_buf, _head);
+    }
+
+    buf = snapshot_create(st);
+    if (!buf) {
+        return NULL;
+    }
+    st->dirty = FLB_FALSE;
+    cleanup_metrics(st, buf);
+
+    return buf;
+}
+
 static void destruct_metrics(void *data)
 {
     struct mk_list *tmp;
     struct mk_list *head;
-    struct mk_list *metrics_list = (struct mk_list*)data;
+    struct prom_http_state *st = data;
     struct prom_http_buf *entry;
+    struct prom_http_fragment *frag;
 
-    if (!metrics_list) {
+    if (!st) {
         return;
     }
 
-    mk_list_foreach_safe(head, tmp, metrics_list) {
+    mk_list_foreach_safe(head, tmp, &st->snapshots) {
         entry = mk_list_entry(head, struct prom_http_buf, _head);
-        mk_list_del(&entry->_head);
-        flb_free(entry->buf_data);
-        flb_free(entry);
+        snapshot_destroy(entry);
     }
 
-    flb_free(metrics_list);
+    mk_list_foreach_safe(head, tmp, &st->fragments) {
+        frag = mk_list_entry(head, struct prom_http_fragment, _head);
+        mk_list_del(&frag->_head);
+        fragment_release(frag);
+    }
+
+    flb_free(st);
 }
 
 /*
- * Callback invoked every time a new payload of Metrics is received from
- * Fluent Bit engine through Message Queue channel.
- *
- * This function runs in a Monkey HTTP thread worker and it purpose is
- * to take the metrics data and store it locally for every thread, so then
- * it can be available on 'cb_metrics()' to serve it as a response.
+ * A message carries the metrics of one input: its name, a NULL byte and
+ * the encoded text. The fragment of the input is replaced in place so
+ * the inputs keep the order in which they first reported.
  */
 static void cb_mq_metrics(mk_mq_t *queue, void *data, size_t size)
 {
-    struct prom_http_buf *buf;
-    struct mk_list *metrics_list = NULL;
+    size_t len;
+    struct mk_list *head;
+    struct prom_http_state *st;
+    struct prom_http_fragment *frag;
+    struct prom_http_fragment *old = NULL;
 
-    metrics_list = pthread_getspecific(ph_metrics_key);
-    if (!metrics_list) {
-        metrics_list = flb_malloc(sizeof(struct mk_list));
-        if (!metrics_list) {
-            flb_errno();
-            return;
-        }
-        mk_list_init(metrics_list);
-        pthread_setspecific(ph_metrics_key, metrics_list);
+    st = state_get();
+    if (!st) {
+        return;
     }
 
-    /* FIXME: convert data ? */
-    buf = flb_malloc(sizeof(struct prom_http_buf));
-    if (!buf) {
+    len = strnlen(data, size);
+    if (len == size) {
+        return;
+    }
+
+    frag = flb_calloc(1, sizeof(struct prom_http_fragment));
+    if (!frag) {
         flb_errno();
         return;
     }
-    buf->users = 0;
-    buf->buf_data = flb_malloc(size);
-    if (!buf->buf_data) {
+    frag->users = 1;
+    frag->name = flb_sds_create_len(data, len);
+    if (!frag->name) {
+        flb_free(frag);
+        return;
+    }
+
+    frag->size = size - len - 1;
+    frag->data = flb_malloc(frag->size + 1);
+    if (!frag->data) {
         flb_errno();
-        flb_free(buf);
+        flb_sds_destroy(frag->name);
+        flb_free(frag);
         return;
     }
-    memcpy(buf->buf_data, data, size);
-    buf->buf_size = size;
+    memcpy(frag->data, (char *) data + len + 1, frag->size);
+    frag->data[frag->size] = '\0';
+
+    mk_list_foreach(head, &st->fragments) {
+        old = mk_list_entry(head, struct prom_http_fragment, _head);
+        if (strcmp(old->name, frag->name) == 0) {
+            break;
+        }
+        old = NULL;
+    }
+
+    if (old) {
+        mk_list_add_after(&frag->_head, &old->_head, &st->fragments);
+        mk_list_del(&old->_head);
+        fragment_release(old);
+    }
+    else {
+        mk_list_add(&frag->_head, &st->fragments);
+    }
 
-    mk_list_add(&buf->_head, metrics_list);
-    cleanup_metrics();
+    st->dirty = FLB_TRUE;
 }
 
-/* Create message queue to receive Metrics payload from the engine */
 static int http_server_mq_create(struct prom_http *ph)
 {
     int ret;
@@ -157,11 +260,314 @@ static int http_server_mq_create(struct prom_http *ph)
     return 0;
 }
 
-/* HTTP endpoint: /metrics */
+/* Find the '}' closing a label set, label values may contain it */
+static const char *labels_end(const char *p, const char *end)
+{
+    int quoted = FLB_FALSE;
+
+    for (; p < end; p++) {
+        if (quoted) {
+            if (*p == '\\' && p + 1 < end) {
+                p++;
+            }
+            else if (*p == '"') {
+                quoted = FLB_FALSE;
+            }
+        }
+        else if (*p == '"') {
+            quoted = FLB_TRUE;
+        }
+        else if (*p == '}') {
+            return p;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Convert the Prometheus text exposition into OpenMetrics: counter
+ * families lose the '_total' suffix which moves to the samples, untyped
+ * becomes unknown, timestamps are given in seconds and the exposition
+ * is terminated by '# EOF'.
+ */
+flb_sds_t prom_http_openmetrics_convert(const char *data, size_t size)
+{
+    int counter = FLB_FALSE;
+    size_t len;
+    size_t name_len;
+    size_t fam_len = 0;
+    const char *p;
+    const char *end;
+    const char *eol;
+    const char *name;
+    const char *sp;
+    const char *next;
+    const char *type;
+    const char *family = NULL;
+    char ts[32];
+    long long ms;
+    flb_sds_t out;
+
+    out = flb_sds_create_size(size + size / 8 + 16);
+    if (!out) {
+        return NULL;
+    }
+
+    p = data;
+    end = data + size;
+    while (p < end) {
+        eol = memchr(p, '\n', end - p);
+        if (!eol) {
+            eol = end;
+        }
+        len = eol - p;
+
+        if (len > 7 && (strncmp(p, "# HELP ", 7) == 0 ||
+                        strncmp(p, "# TYPE ", 7) == 0)) {
+            name = p + 7;
+            sp = memchr(name, ' ', eol - name);
+            name_len = sp ? sp - name : eol - name;
+
+            /* the banner is HELP + TYPE, look for the type of the family */
+            type = NULL;
+            if (p[2] == 'H') {
+                next = eol < end ? eol + 1 : end;
+                if (end - next > 7 + (long) name_len &&
+                    strncmp(next, "# TYPE ", 7) == 0 &&
+                    strncmp(next + 7, name, name_len) == 0) {
+                    type = next + 7 + name_len + 1;
+                }
+            }
+            else if (sp) {
+                type = sp + 1;
+            }
+            counter = (type && end - type >= 7 && strncmp(type, "counter", 7) == 0);
+
+            family = name;
+            fam_len = name_len;
+            if (counter && name_len > 6 &&
+                strncmp(name + name_len - 6, "_total", 6) == 0) {
+                fam_len -= 6;
+            }
+
+            flb_sds_cat_safe(&out, p, 7);
+            flb_sds_cat_safe(&out, name, fam_len);
+            if (p[2] == 'T' && sp && eol - sp == 8 &&
+                strncmp(sp, " untyped", 8) == 0) {
+                flb_sds_cat_safe(&out, " unknown", 8);
+            }
+            else if (sp) {
+                flb_sds_cat_safe(&out, sp, eol - sp);
+            }
+            flb_sds_cat_safe(&out, "\n", 1);
+        }
+        else if (len > 0 && p[0] != '#') {
+            /* sample: name[{labels}] value [timestamp] */
+            name_len = strcspn(p, "{ \n");
+            if (name_len > len) {
+                name_len = len;
+            }
+            flb_sds_cat_safe(&out, p, name_len);
+            if (counter && family && name_len == fam_len &&
+                strncmp(p, family, fam_len) == 0) {
+                flb_sds_cat_safe(&out, "_total", 6);
+            }
+
+            /* the timestamp, if any, is the third field */
+            sp = p + name_len;
+            if (*sp == '{') {
+                sp = labels_end(sp + 1, eol);
+                if (!sp) {
+                    sp = eol;
+                }
+            }
+            sp = memchr(sp, ' ', eol - sp);
+            next = sp ? memchr(sp + 1, ' ', eol - sp - 1) : NULL;
+
+            if (next) {
+                flb_sds_cat_safe(&out, p + name_len, next - (p + name_len));
+                ms = strtoll(next + 1, NULL, 10);
+                len = snprintf(ts, sizeof(ts) - 1, " %lld.%03lld",
+                               ms / 1000, ms % 1000);
+                flb_sds_cat_safe(&out, ts, len);
+            }
+            else {
+                flb_sds_cat_safe(&out, p + name_len, eol - (p + name_len));
+            }
+            flb_sds_cat_safe(&out, "\n", 1);
+        }
+
+        p = eol + 1;
+    }
+
+    flb_sds_cat_safe(&out, "# EOF\n", 6);
+    return out;
+}
+
+/* Concatenate the fragments and render the requested body once */
+static struct prom_http_body *metrics_body(struct prom_http_buf *buf,
+                                           int format, int gzip)
+{
+    int i;
+    int ret;
+    flb_sds_t text;
+    flb_sds_t tmp;
+    struct prom_http_body *body;
+
+    body = &buf->bodies[format * 2 + gzip];
+    if (body->data) {
+        return body;
+    }
+
+    text = flb_sds_create_size(buf->size + 1);
+    if (!text) {
+        return NULL;
+    }
+    for (i = 0; i < buf->count; i++) {
+        flb_sds_cat_safe(&text, buf->fragments[i]->data,
+                         buf->fragments[i]->size);
+    }
+
+    if (format == PROM_HTTP_FMT_OPENMETRICS) {
+        tmp = prom_http_openmetrics_convert(text, flb_sds_len(text));
+        flb_sds_destroy(text);
+        if (!tmp) {
+            return NULL;
+        }
+        text = tmp;
+    }
+
+    if (gzip) {
+        ret = flb_gzip_compress(text, flb_sds_len(text),
+                                &body->data, &body->size);
+        flb_sds_destroy(text);
+        if (ret != 0) {
+            body->data = NULL;
+            return NULL;
+        }
+        return body;
+    }
+
+    body->data = flb_malloc(flb_sds_len(text));
+    if (!body->data) {
+        flb_errno();
+        flb_sds_destroy(text);
+        return NULL;
+    }
+    memcpy(body->data, text, flb_sds_len(text));
+    body->size = flb_sds_len(text);
+    flb_sds_destroy(text);
+
+    return body;
+}
+
+static int header_contains(mk_request_t *request, int name, char *str)
+{
+    struct mk_http_header *header;
+
+    header = mk_http_header_get(name, request, NULL, 0);
+    if (!header || !header->val.data || header->val.len == 0) {
+        return FLB_FALSE;
+    }
+
+    if (mk_string_search_n(header->val.data, str, MK_STR_INSENSITIVE,
+                           header->val.len) >= 0) {
+        return FLB_TRUE;
+    }
+    return FLB_FALSE;
+}
+
+/* Match a media range of the Accept header, parameters excluded */
+static int media_range_is(const char *p, size_t len, char *type)
+{
+    return len == strlen(type) && strncasecmp(p, type, len) == 0;
+}
+
+/*
+ * Pick OpenMetrics when the client ranks it at least as high as the text
+ * format, honouring the q-values of the Accept header.
+ */
+static int accept_openmetrics(mk_request_t *request)
+{
+    size_t len;
+    double q;
+    double q_om = 0.0;
+    double q_text = 0.0;
+    char tmp[16];
+    const char *p;
+    const char *end;
+    const char *range_end;
+    const char *param;
+    struct mk_http_header *header;
+
+    header = mk_http_header_get(MK_HEADER_ACCEPT, request, NULL, 0);
+    if (!header || !header->val.data || header->val.len == 0) {
+        return FLB_FALSE;
+    }
+
+    p = header->val.data;
+    end = p + header->val.len;
+    while (p < end) {
+        range_end = memchr(p, ',', end - p);
+        if (!range_end) {
+            range_end = end;
+        }
+
+        while (p < range_end && (*p == ' ' || *p == '\t')) {
+            p++;
+        }
+        len = 0;
+        while (p + len < range_end && p[len] != ';' &&
+               p[len] != ' ' && p[len] != '\t') {
+            len++;
+        }
+
+        /* look for the q parameter, it defaults to 1 */
+        q = 1.0;
+        param = memchr(p, ';', range_end - p);
+        while (param) {
+            param++;
+            while (param < range_end && (*param == ' ' || *param == '\t')) {
+                param++;
+            }
+            if (range_end - param > 2 && (*param == 'q' || *param == 'Q') &&
+                param[1] == '=') {
+                snprintf(tmp, sizeof(tmp), "%.*s",
+                         (int) (range_end - param - 2), param + 2);
+                q = strtod(tmp, NULL);
+            }
+            param = memchr(param, ';', range_end - param);
+        }
+
+        if (media_range_is(p, len, "application/openmetrics-text")) {
+            if (q > q_om) {
+                q_om = q;
+            }
+        }
+        else if (media_range_is(p, len, "text/plain") ||
+                 media_range_is(p, len, "text/*") ||
+                 media_range_is(p, len, "*/*")) {
+            if (q > q_text) {
+                q_text = q;
+            }
+        }
+
+        p = range_end + 1;
+    }
+
+    return q_om > 0.0 && q_om >= q_text;
+}
+
 static void cb_metrics(mk_request_t *request, void *data)
 {
+    int i;
+    int gzip = FLB_FALSE;
+    int format = PROM_HTTP_FMT_TEXT;
+    struct prom_http *ph = data;
     struct prom_http_buf *buf;
-    (void) data;
+    struct prom_http_body *body = NULL;
+    struct prom_http_fragment *frag;
 
     buf = metrics_get_latest();
     if (!buf) {
@@ -170,17 +576,61 @@ static void cb_metrics(mk_request_t *request, void *data)
         return;
     }
 
+    /* content negotiation */
+    if (ph->openmetrics && accept_openmetrics(request)) {
+        format = PROM_HTTP_FMT_OPENMETRICS;
+    }
+    if (ph->gzip && header_contains(request, MK_HEADER_ACCEPT_ENCODING, "gzip")) {
+        gzip = FLB_TRUE;
+    }
+
     buf->users++;
 
+    if (format != PROM_HTTP_FMT_TEXT || gzip) {
+        body = metrics_body(buf, format, gzip);
+        if (!body) {
+            buf->users--;
+            mk_http_status(request, 500);
+            mk_http_done(request);
+            return;
+        }
+    }
+
     mk_http_status(request, 200);
-    flb_hs_add_content_type_to_req(request, FLB_HS_CONTENT_TYPE_PROMETHEUS);
-    mk_http_send(request, buf->buf_data, buf->buf_size, NULL);
+    if (format == PROM_HTTP_FMT_OPENMETRICS) {
+        mk_http_header(request,
+                       FLB_HS_CONTENT_TYPE_KEY_STR, FLB_HS_CONTENT_TYPE_KEY_LEN,
+                       PROM_HTTP_CONTENT_TYPE_OPENMETRICS,
+                       sizeof(PROM_HTTP_CONTENT_TYPE_OPENMETRICS) - 1);
+    }
+    else {
+        flb_hs_add_content_type_to_req(request, FLB_HS_CONTENT_TYPE_PROMETHEUS);
+    }
+    if (gzip) {
+        mk_http_header(request, "Content-Encoding", 16, "gzip", 4);
+    }
+    /* caches must keep the compressed and the plain responses apart */
+    if (ph->gzip) {
+        mk_http_header(request, "Vary", 4, "Accept-Encoding", 15);
+    }
+
+    if (body) {
+        mk_http_send(request, body->data, body->size, NULL);
+    }
+    else {
+        /* plain text: stream the fragments as they are */
+        for (i = 0; i < buf->count; i++) {
+            frag = buf->fragments[i];
+            if (frag->size > 0) {
+                mk_http_send(request, frag->data, frag->size, NULL);
+            }
+        }
+    }
     mk_http_done(request);
 
     buf->users--;
 }
 
-/* HTTP endpoint: / (root) */
 static void cb_root(mk_request_t *request, void *data)
 {
     (void) data;
@@ -206,6 +656,8 @@ struct prom_http *prom_http_server_create(struct prom_exporter *ctx,
         return NULL;
     }
     ph->config = config;
+    ph->gzip = ctx->gzip;
+    ph->openmetrics = ctx->openmetrics;
 
     /* HTTP Server context */
     ph->ctx = mk_create();
@@ -226,7 +678,7 @@ struct prom_http *prom_http_server_create(struct prom_exporter *ctx,
     ph->vid = vid;
 
     /* Set HTTP URI callbacks */
-    mk_vhost_handler(ph->ctx, vid, "/metrics", cb_metrics, NULL);
+    mk_vhost_handler(ph->ctx, vid, "/metrics", cb_metrics, ph);
     mk_vhost_handler(ph->ctx, vid, "/", cb_root, NULL);
 
     /* Create a Message Queue to push 'metrics' to HTTP workers */
@@ -262,7 +714,25 @@ int prom_http_server_stop(struct prom_http *ph)
 }
 
 int prom_http_server_mq_push_metrics(struct prom_http *ph,
+                                     const char *name,
                                      void *data, size_t size)
 {
-    return mk_mq_send(ph->ctx, ph->qid_metrics, data, size);
+    int ret;
+    size_t len;
+    char *msg;
+
+    /* input name, NULL byte, metrics */
+    len = strlen(name);
+    msg = flb_malloc(len + 1 + size);
+    if (!msg) {
+        flb_errno();
+        return -1;
+    }
+    memcpy(msg, name, len + 1);
+    memcpy(msg + len + 1, data, size);
+
+    ret = mk_mq_send(ph->ctx, ph->qid_metrics, msg, len + 1 + size);
+    flb_free(msg);
+
+    return ret;
 }
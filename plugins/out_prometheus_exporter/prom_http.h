@@ -25,19 +25,57 @@
 
 #include "prom.h"
 
-/* HTTP response payload received through a Message Queue */
+/* Response formats */
+#define PROM_HTTP_FMT_TEXT          0
+#define PROM_HTTP_FMT_OPENMETRICS   1
+
+#define PROM_HTTP_CONTENT_TYPE_OPENMETRICS \
+    "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+/* Encoded metrics of one input instance, shared by the snapshots */
+struct prom_http_fragment {
+    int users;
+    flb_sds_t name;               /* input instance name */
+    char *data;
+    size_t size;
+    struct mk_list _head;         /* link to the current set */
+};
+
+/* A rendered response body */
+struct prom_http_body {
+    void *data;
+    size_t size;
+};
+
+/*
+ * Immutable view of the metrics served to scrapers: references the
+ * fragments at the time it was taken. Bodies other than plain text are
+ * rendered on first request and kept while the snapshot is the latest.
+ */
 struct prom_http_buf {
     int users;
-    char *buf_data;
-    size_t buf_size;
+    int count;
+    struct prom_http_fragment **fragments;
+    size_t size;                  /* sum of the fragments size */
+
+    /* indexed by (format * 2 + gzip), plain text is streamed */
+    struct prom_http_body bodies[4];
     struct mk_list _head;
 };
 
-/* Prom HTTP Server context */
+/* Metrics state owned by the HTTP worker thread */
+struct prom_http_state {
+    int dirty;                    /* fragments changed since last snapshot */
+    struct mk_list fragments;
+    struct mk_list snapshots;
+};
+
 struct prom_http {
     mk_ctx_t *ctx;                /* Monkey HTTP Context */
     int vid;                      /* Virtual host ID */
     int qid_metrics;              /* Queue ID for Metrics buffer */
+    int gzip;                     /* compress responses if accepted */
+    int openmetrics;              /* negotiate OpenMetrics responses */
     struct flb_config *config;    /* Fluent Bit context */
 };
 
@@ -51,6 +89,9 @@ int prom_http_server_start(struct prom_http *ph);
 int prom_http_server_stop(struct prom_http *ph);
 
 int prom_http_server_mq_push_metrics(struct prom_http *ph,
+                                     const char *name,
                                      void *data, size_t size);
 
+flb_sds_t prom_http_openmetrics_convert(const char *data, size_t size);
+
 #endif
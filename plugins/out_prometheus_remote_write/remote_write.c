@@ -32,17 +32,21 @@
 
 #include "remote_write.h"
 #include "remote_write_conf.h"
+#include "remote_write_shards.h"
 
-static int http_post(struct prometheus_remote_write_context *ctx,
-                     const void *body, size_t body_len,
-                     const char *tag, int tag_len)
+/*
+ * Send an already compressed write request through the upstream 'u', the
+ * flush callback uses the instance upstream while every shard sender owns
+ * a synchronous one.
+ */
+int flb_prometheus_remote_write_http_do(struct prometheus_remote_write_context *ctx,
+                                        struct flb_upstream *u,
+                                        const void *payload_buf,
+                                        size_t payload_size)
 {
     int ret;
     int out_ret = FLB_OK;
     size_t b_sent;
-    void *payload_buf = NULL;
-    size_t payload_size = 0;
-    struct flb_upstream *u;
     struct flb_connection *u_conn;
     struct flb_http_client *c;
     struct mk_list *head;
@@ -51,8 +55,7 @@ static int http_post(struct prometheus_remote_write_context *ctx,
     struct flb_slist_entry *val = NULL;
     flb_sds_t signature = NULL;
 
-    /* Get upstream context and connection */
-    u = ctx->u;
+    /* Get upstream connection */
     u_conn = flb_upstream_conn_get(u);
     if (!u_conn) {
         flb_plg_error(ctx->ins, "no upstream connections available to %s:%i",
@@ -60,33 +63,6 @@ static int http_post(struct prometheus_remote_write_context *ctx,
         return FLB_RETRY;
     }
 
-    /* Map payload */
-
-    if (strcasecmp(ctx->compression, "snappy") == 0) {
-        ret = flb_snappy_compress((void *) body, body_len,
-                                  (char **) &payload_buf,
-                                  &payload_size);
-    }
-    else if (strcasecmp(ctx->compression, "gzip") == 0) {
-        ret = flb_gzip_compress((void *) body, body_len,
-                                &payload_buf, &payload_size);
-    }
-    else {
-        payload_buf = (void *) body;
-        payload_size = body_len;
-
-        ret = 0;
-    }
-
-    if (ret != 0) {
-        flb_upstream_conn_release(u_conn);
-
-        flb_plg_error(ctx->ins,
-                      "cannot compress payload, aborting");
-
-        return FLB_ERROR;
-    }
-
     /* Create HTTP client context */
     c = flb_http_client(u_conn, FLB_HTTP_POST, ctx->uri,
                         payload_buf, payload_size,
@@ -238,6 +214,51 @@ static int http_post(struct prometheus_remote_write_context *ctx,
     }
 
 cleanup:
+    /* Destroy HTTP client context */
+    flb_http_client_destroy(c);
+
+    /* Release the TCP connection */
+    flb_upstream_conn_release(u_conn);
+
+    return out_ret;
+}
+
+static int http_post(struct prometheus_remote_write_context *ctx,
+                     const void *body, size_t body_len,
+                     const char *tag, int tag_len)
+{
+    int ret;
+    void *payload_buf = NULL;
+    size_t payload_size = 0;
+
+    /* Map payload */
+
+    if (strcasecmp(ctx->compression, "snappy") == 0) {
+        ret = flb_snappy_compress((void *) body, body_len,
+                                  (char **) &payload_buf,
+                                  &payload_size);
+    }
+    else if (strcasecmp(ctx->compression, "gzip") == 0) {
+        ret = flb_gzip_compress((void *) body, body_len,
+                                &payload_buf, &payload_size);
+    }
+    else {
+        payload_buf = (void *) body;
+        payload_size = body_len;
+
+        ret = 0;
+    }
+
+    if (ret != 0) {
+        flb_plg_error(ctx->ins,
+                      "cannot compress payload, aborting");
+
+        return FLB_ERROR;
+    }
+
+    ret = flb_prometheus_remote_write_http_do(ctx, ctx->u,
+                                              payload_buf, payload_size);
+
     /*
      * If the payload buffer is different than incoming records in body, means
      * we generated a different payload and must be freed.
@@ -246,13 +267,7 @@ cleanup:
         flb_free(payload_buf);
     }
 
-    /* Destroy HTTP client context */
-    flb_http_client_destroy(c);
-
-    /* Release the TCP connection */
-    flb_upstream_conn_release(u_conn);
-
-    return out_ret;
+    return ret;
 }
 
 static int cb_prom_init(struct flb_output_instance *ins,
@@ -283,6 +298,61 @@ static void append_labels(struct prometheus_remote_write_context *ctx,
     }
 }
 
+/*
+ * Sharded flush: the series of every context are hashed into the shard
+ * batches, the shard senders post them in parallel while we wait.
+ */
+static int flush_shards(struct prometheus_remote_write_context *ctx,
+                        struct flb_event_chunk *event_chunk)
+{
+    int c = 0;
+    int ret;
+    int result;
+    size_t off = 0;
+    struct cmt *cmt = NULL;
+    struct prom_rw_flush flush;
+
+    ret = prom_rw_flush_init(ctx->shards, &flush);
+    if (ret == -1) {
+        return FLB_RETRY;
+    }
+
+    while ((ret = cmt_decode_msgpack_delta_apply(&cmt,
+                                                 (char *) event_chunk->data,
+                                                 event_chunk->size, &off,
+                                                 NULL)) == CMT_DECODE_MSGPACK_SUCCESS) {
+        /* append labels set by config */
+        append_labels(ctx, cmt);
+
+        ret = prom_rw_flush_append(&flush, cmt);
+        if (ret == -1) {
+            flb_plg_error(ctx->ins,
+                          "Error encoding context as prometheus remote write");
+            break;
+        }
+        c++;
+    }
+
+    if (ret == CMT_DECODE_MSGPACK_INSUFFICIENT_DATA && c > 0) {
+        result = prom_rw_flush_wait(&flush, FLB_FALSE);
+    }
+    else {
+        if (ret != -1) {
+            flb_plg_error(ctx->ins, "Error decoding msgpack encoded context");
+        }
+
+        /* batches already queued are still sent, the chunk is dropped */
+        prom_rw_flush_wait(&flush, FLB_TRUE);
+        result = FLB_ERROR;
+    }
+
+    if (cmt) {
+        cmt_destroy(cmt);
+    }
+
+    return result;
+}
+
 static void cb_prom_flush(struct flb_event_chunk *event_chunk,
                           struct flb_output_flush *out_flush,
                           struct flb_input_instance *ins, void *out_context,
@@ -296,7 +366,7 @@ static void cb_prom_flush(struct flb_event_chunk *event_chunk,
     flb_sds_t buf = NULL;
     size_t diff = 0;
     size_t off = 0;
-    struct cmt *cmt;
+    struct cmt *cmt = NULL;
     struct prometheus_remote_write_context *ctx = out_context;
 
     /* Initialize vars */
@@ -304,6 +374,11 @@ static void cb_prom_flush(struct flb_event_chunk *event_chunk,
     ok = CMT_DECODE_MSGPACK_SUCCESS;
     result = FLB_OK;
 
+    if (ctx->shards) {
+        result = flush_shards(ctx, event_chunk);
+        FLB_OUTPUT_RETURN(result);
+    }
+
     /* Buffer to concatenate multiple metrics contexts */
     buf = flb_sds_create_size(event_chunk->size);
     if (!buf) {
@@ -314,11 +389,16 @@ static void cb_prom_flush(struct flb_event_chunk *event_chunk,
     flb_plg_debug(ctx->ins, "cmetrics msgpack size: %lu",
                   event_chunk->size);
 
-    /* Decode and encode every CMetric context */
+    /*
+     * Decode and encode every CMetric context, delta encoded contexts
+     * (metrics.delta) are applied over the previous one. The static labels
+     * added below are replaced by the next context header.
+     */
     diff = 0;
-    while ((ret = cmt_decode_msgpack_create(&cmt,
-                                            (char *) event_chunk->data,
-                                            event_chunk->size, &off)) == ok) {
+    while ((ret = cmt_decode_msgpack_delta_apply(&cmt,
+                                                 (char *) event_chunk->data,
+                                                 event_chunk->size, &off,
+                                                 NULL)) == ok) {
         /* append labels set by config */
         append_labels(ctx, cmt);
 
@@ -341,7 +421,6 @@ static void cb_prom_flush(struct flb_event_chunk *event_chunk,
 
         /* release */
         cmt_encode_prometheus_remote_write_destroy(encoded_chunk);
-        cmt_destroy(cmt);
     }
 
     if (ret == CMT_DECODE_MSGPACK_INSUFFICIENT_DATA && c > 0) {
@@ -371,6 +450,9 @@ static void cb_prom_flush(struct flb_event_chunk *event_chunk,
     }
 
 exit:
+    if (cmt) {
+        cmt_destroy(cmt);
+    }
     if (buf) {
         flb_sds_destroy(buf);
     }
@@ -443,6 +525,25 @@ static struct flb_config_map config_map[] = {
      0, FLB_TRUE, offsetof(struct prometheus_remote_write_context, uri),
      "Specify an optional HTTP URI for the target web server, e.g: /something"
     },
+    {
+     FLB_CONFIG_MAP_INT, "max_samples_per_send",
+     FLB_PROMETHEUS_REMOTE_WRITE_MAX_SAMPLES_PER_SEND,
+     0, FLB_TRUE, offsetof(struct prometheus_remote_write_context, max_samples_per_send),
+     "Maximum number of samples per request when series sharding is enabled"
+    },
+    {
+     FLB_CONFIG_MAP_INT, "min_shards", FLB_PROMETHEUS_REMOTE_WRITE_MIN_SHARDS,
+     0, FLB_TRUE, offsetof(struct prometheus_remote_write_context, min_shards),
+     "Minimum number of shards sending series in parallel"
+    },
+    {
+     FLB_CONFIG_MAP_INT, "max_shards", FLB_PROMETHEUS_REMOTE_WRITE_MAX_SHARDS,
+     0, FLB_TRUE, offsetof(struct prometheus_remote_write_context, max_shards),
+     "Maximum number of shards, each one has its own queue and sender thread. "
+     "The series are hashed into the shards and sent in batches of "
+     "'max_samples_per_send' samples, the shard count follows the backlog. "
+     "If set to 0 (default) every flush is sent as a single request"
+    },
     {
      FLB_CONFIG_MAP_BOOL, "log_response_payload", "true",
      0, FLB_TRUE, offsetof(struct prometheus_remote_write_context, log_response_payload),
@@ -462,5 +563,5 @@ struct flb_output_plugin out_prometheus_remote_write_plugin = {
     .config_map  = config_map,
     .event_type  = FLB_OUTPUT_METRICS,
     .workers     = 2,
-    .flags       = FLB_OUTPUT_NET | FLB_IO_OPT_TLS,
+    .flags       = FLB_OUTPUT_NET | FLB_IO_OPT_TLS | FLB_OUTPUT_METRICS_DELTA,
 };
@@ -32,6 +32,13 @@
 #endif
 #endif
 
+/* Sharding defaults, 'max_shards 0' keeps one request per flush */
+#define FLB_PROMETHEUS_REMOTE_WRITE_MAX_SAMPLES_PER_SEND "2000"
+#define FLB_PROMETHEUS_REMOTE_WRITE_MIN_SHARDS           "1"
+#define FLB_PROMETHEUS_REMOTE_WRITE_MAX_SHARDS           "0"
+
+struct prom_rw_shards;
+
 /* Plugin context */
 struct prometheus_remote_write_context {
     /* HTTP Auth */
@@ -75,9 +82,21 @@ struct prometheus_remote_write_context {
     /* Arbitrary HTTP headers */
     struct mk_list *headers;
 
+    /* Series sharding: batch size and bounds of the shard count */
+    int max_samples_per_send;
+    int min_shards;
+    int max_shards;
+
+    /* Shard queues and sender threads, NULL when sharding is disabled */
+    struct prom_rw_shards *shards;
 
     /* instance context */
     struct flb_output_instance *ins;
 };
 
+int flb_prometheus_remote_write_http_do(struct prometheus_remote_write_context *ctx,
+                                        struct flb_upstream *u,
+                                        const void *payload_buf,
+                                        size_t payload_size);
+
 #endif
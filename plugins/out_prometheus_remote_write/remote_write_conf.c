@@ -29,6 +29,7 @@
 #endif
 #include "remote_write.h"
 #include "remote_write_conf.h"
+#include "remote_write_shards.h"
 
 static int config_add_labels(struct flb_output_instance *ins,
                              struct prometheus_remote_write_context *ctx)
@@ -224,6 +225,26 @@ struct prometheus_remote_write_context *flb_prometheus_remote_write_context_crea
     /* Set instance flags into upstream */
     flb_output_upstream_set(ctx->u, ins);
 
+    /* Series sharding */
+    if (ctx->max_shards > 0) {
+        if (ctx->max_samples_per_send < 1) {
+            flb_plg_error(ins, "'max_samples_per_send' must be greater than 0");
+            flb_prometheus_remote_write_context_destroy(ctx);
+            return NULL;
+        }
+        if (ctx->min_shards < 1 || ctx->min_shards > ctx->max_shards) {
+            flb_plg_error(ins, "'min_shards' must be between 1 and 'max_shards'");
+            flb_prometheus_remote_write_context_destroy(ctx);
+            return NULL;
+        }
+
+        ctx->shards = prom_rw_shards_create(ctx, config);
+        if (!ctx->shards) {
+            flb_prometheus_remote_write_context_destroy(ctx);
+            return NULL;
+        }
+    }
+
     return ctx;
 }
 
@@ -236,6 +257,10 @@ void flb_prometheus_remote_write_context_destroy(
 
     flb_kv_release(&ctx->kv_labels);
 
+    if (ctx->shards) {
+        prom_rw_shards_destroy(ctx->shards);
+    }
+
     if (ctx->u) {
         flb_upstream_destroy(ctx->u);
     }
@@ -0,0 +1,755 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2024 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fluent-bit/flb_output_plugin.h>
+#include <fluent-bit/flb_upstream.h>
+#include <fluent-bit/flb_engine.h>
+#include <fluent-bit/flb_thread_pool.h>
+#include <fluent-bit/flb_gzip.h>
+#include <cmetrics/cmt_encode_prometheus_remote_write.h>
+#include <cfl/cfl_hash.h>
+#include <math.h>
+
+#include "remote_write.h"
+#include "remote_write_shards.h"
+
+/*
+ * Series sharding
+ * ===============
+ *
+ * Like the Prometheus agent, every time series is hashed by its label set
+ * into one of the active shards. Each shard owns a FIFO queue of batches of
+ * at most 'max_samples_per_send' samples and a sender thread with its own
+ * connection, so shards post in parallel while the samples of one series
+ * keep their order.
+ *
+ * The flush callback builds the batches, queues them and waits until all
+ * of them got a response: the chunk is only acknowledged (or retried) once
+ * the backend answered, as in the single request mode. While waiting the
+ * flush coroutine yields, so the output thread keeps serving other flushes.
+ *
+ * A batch is a serialized WriteRequest: the concatenation of its
+ * 'timeseries' fields, which lets series be appended without building an
+ * intermediate request.
+ */
+
+static flb_sds_t pool_get(struct prom_rw_shards *shards)
+{
+    flb_sds_t buf = NULL;
+
+    pthread_mutex_lock(&shards->pool_mutex);
+    if (shards->pool_count > 0) {
+        buf = shards->pool[--shards->pool_count];
+    }
+    pthread_mutex_unlock(&shards->pool_mutex);
+
+    if (buf) {
+        flb_sds_len_set(buf, 0);
+        return buf;
+    }
+
+    return flb_sds_create_size(shards->ctx->max_samples_per_send *
+                               PROM_RW_SHARDS_SAMPLE_SIZE);
+}
+
+static void pool_put(struct prom_rw_shards *shards, flb_sds_t buf)
+{
+    pthread_mutex_lock(&shards->pool_mutex);
+    if (shards->pool_count < shards->pool_size) {
+        shards->pool[shards->pool_count++] = buf;
+        buf = NULL;
+    }
+    pthread_mutex_unlock(&shards->pool_mutex);
+
+    if (buf) {
+        flb_sds_destroy(buf);
+    }
+}
+
+static struct prom_rw_batch *batch_create(struct prom_rw_flush *flush)
+{
+    struct prom_rw_batch *batch;
+
+    batch = flb_calloc(1, sizeof(struct prom_rw_batch));
+    if (!batch) {
+        flb_errno();
+        return NULL;
+    }
+
+    batch->payload = pool_get(flush->parent);
+    if (!batch->payload) {
+        flb_free(batch);
+        return NULL;
+    }
+    batch->flush = flush;
+
+    return batch;
+}
+
+static void batch_destroy(struct prom_rw_shards *shards,
+                          struct prom_rw_batch *batch)
+{
+    pool_put(shards, batch->payload);
+    flb_free(batch);
+}
+
+static int batch_append(struct prom_rw_batch *batch,
+                        Prometheus__TimeSeries *series)
+{
+    size_t len;
+    size_t size;
+    size_t need;
+    size_t grow;
+    uint8_t *p;
+    flb_sds_t tmp;
+
+    size = prometheus__time_series__get_packed_size(series);
+
+    /* field tag, length as a varint and the packed time series */
+    need = 1 + 10 + size;
+    if (flb_sds_avail(batch->payload) < need) {
+        grow = flb_sds_alloc(batch->payload);
+        if (grow < need) {
+            grow = need;
+        }
+
+        tmp = flb_sds_increase(batch->payload, grow);
+        if (!tmp) {
+            return -1;
+        }
+        batch->payload = tmp;
+    }
+
+    len = flb_sds_len(batch->payload);
+    p = (uint8_t *) batch->payload + len;
+
+    /* WriteRequest.timeseries = 1, length delimited */
+    *p++ = 0x0a;
+    len = size;
+    do {
+        *p++ = (len & 0x7f) | (len > 0x7f ? 0x80 : 0);
+        len >>= 7;
+    } while (len > 0);
+
+    prometheus__time_series__pack(series, p);
+    p += size;
+
+    flb_sds_len_set(batch->payload, (char *) p - batch->payload);
+    batch->samples += series->n_samples;
+
+    return 0;
+}
+
+static uint64_t series_hash(Prometheus__TimeSeries *series)
+{
+    size_t i;
+    Prometheus__Label *label;
+    cfl_hash_state_t state;
+
+    cfl_hash_64bits_reset(&state);
+
+    for (i = 0; i < series->n_labels; i++) {
+        label = series->labels[i];
+
+        /* the terminator keeps 'ab'='c' and 'a'='bc' apart */
+        cfl_hash_64bits_update(&state, label->name, strlen(label->name) + 1);
+        cfl_hash_64bits_update(&state, label->value, strlen(label->value) + 1);
+    }
+
+    return cfl_hash_64bits_digest(&state);
+}
+
+static void shard_enqueue(struct prom_rw_shard *shard,
+                          struct prom_rw_batch *batch)
+{
+    struct prom_rw_flush *flush = batch->flush;
+
+    pthread_mutex_lock(&flush->mutex);
+    flush->pending++;
+    flush->samples += batch->samples;
+    pthread_mutex_unlock(&flush->mutex);
+
+    pthread_mutex_lock(&shard->mutex);
+    mk_list_add(&batch->_head, &shard->queue);
+    shard->queued += batch->samples;
+    pthread_cond_signal(&shard->cond);
+    pthread_mutex_unlock(&shard->mutex);
+}
+
+/* Compress the batch into the shard buffer and post it */
+static int shard_send(struct prom_rw_shard *shard, struct prom_rw_batch *batch)
+{
+    int ret;
+    char *buf;
+    size_t size;
+    size_t len = flb_sds_len(batch->payload);
+    struct prometheus_remote_write_context *ctx = shard->parent->ctx;
+
+    if (strcasecmp(ctx->compression, "snappy") == 0) {
+        size = snappy_max_compressed_length(len);
+        if (shard->zbuf_size < size) {
+            buf = flb_realloc(shard->zbuf, size);
+            if (!buf) {
+                flb_errno();
+                return FLB_RETRY;
+            }
+            shard->zbuf = buf;
+            shard->zbuf_size = size;
+        }
+
+        ret = snappy_compress(&shard->snappy_env, batch->payload, len,
+                              shard->zbuf, &size);
+        if (ret != 0) {
+            flb_plg_error(ctx->ins, "cannot compress payload, aborting");
+            return FLB_ERROR;
+        }
+
+        return flb_prometheus_remote_write_http_do(ctx, shard->u,
+                                                   shard->zbuf, size);
+    }
+    else if (strcasecmp(ctx->compression, "gzip") == 0) {
+        ret = flb_gzip_compress(batch->payload, len, (void **) &buf, &size);
+        if (ret != 0) {
+            flb_plg_error(ctx->ins, "cannot compress payload, aborting");
+            return FLB_ERROR;
+        }
+
+        ret = flb_prometheus_remote_write_http_do(ctx, shard->u, buf, size);
+        flb_free(buf);
+
+        return ret;
+    }
+
+    return flb_prometheus_remote_write_http_do(ctx, shard->u,
+                                               batch->payload, len);
+}
+
+/*
+ * The shard upstream is not linked to the engine, sweep its connections
+ * like an output worker does: dropped keepalive connections, timeouts and
+ * pending destroys.
+ */
+static void shard_sweep(struct prom_rw_shard *shard)
+{
+    struct mk_event *event;
+
+    mk_event_wait_2(shard->evl, 0);
+    mk_event_foreach(event, shard->evl) {
+        if (event->type == FLB_ENGINE_EV_CUSTOM) {
+            event->handler(event);
+        }
+    }
+
+    flb_upstream_conn_timeouts(&shard->upstreams);
+    flb_upstream_conn_pending_destroy_list(&shard->upstreams);
+}
+
+/* Wake up the flush coroutine, called with the flush mutex held */
+static void flush_notify(struct prom_rw_flush *flush)
+{
+    int ret;
+    uint64_t val = 1;
+
+    ret = flb_pipe_w(flush->ch[1], &val, sizeof(val));
+    if (ret == -1) {
+        flb_errno();
+    }
+}
+
+static void shard_worker(void *data)
+{
+    int ret;
+    char tmp[64];
+    struct timespec ts;
+    struct prom_rw_batch *batch;
+    struct prom_rw_flush *flush;
+    struct prom_rw_shard *shard = data;
+
+    snprintf(tmp, sizeof(tmp) - 1, "flb-out-%s-s%i",
+             shard->parent->ctx->ins->name, shard->id);
+    mk_utils_worker_rename(tmp);
+
+    flb_engine_evl_set(shard->evl);
+
+    while (1) {
+        pthread_mutex_lock(&shard->mutex);
+        while (mk_list_is_empty(&shard->queue) == 0 && !shard->exit) {
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_sec += PROM_RW_SHARDS_SWEEP_INTERVAL;
+
+            ret = pthread_cond_timedwait(&shard->cond, &shard->mutex, &ts);
+            if (ret == ETIMEDOUT) {
+                pthread_mutex_unlock(&shard->mutex);
+                shard_sweep(shard);
+                pthread_mutex_lock(&shard->mutex);
+            }
+        }
+
+        if (mk_list_is_empty(&shard->queue) == 0) {
+            pthread_mutex_unlock(&shard->mutex);
+            break;
+        }
+
+        batch = mk_list_entry_first(&shard->queue, struct prom_rw_batch, _head);
+        mk_list_del(&batch->_head);
+        shard->queued -= batch->samples;
+        pthread_mutex_unlock(&shard->mutex);
+
+        ret = shard_send(shard, batch);
+        if (ret != FLB_OK) {
+            flb_plg_debug(shard->parent->ctx->ins,
+                          "shard=%i batch of %zu samples failed (ret=%i)",
+                          shard->id, batch->samples, ret);
+        }
+
+        /* RETRY wins over ERROR: the whole chunk goes back to the engine */
+        flush = batch->flush;
+        batch_destroy(shard->parent, batch);
+
+        pthread_mutex_lock(&flush->mutex);
+        if (ret == FLB_RETRY ||
+            (ret == FLB_ERROR && flush->result == FLB_OK)) {
+            flush->result = ret;
+        }
+        flush->pending--;
+        if (flush->pending == 0) {
+            if (flush->waiting) {
+                flush_notify(flush);
+            }
+            else {
+                pthread_cond_signal(&flush->cond);
+            }
+        }
+        pthread_mutex_unlock(&flush->mutex);
+
+        shard_sweep(shard);
+    }
+
+    flb_engine_evl_set(NULL);
+}
+
+static int shard_init(struct prom_rw_shards *shards, struct prom_rw_shard *shard,
+                      int id, struct flb_config *config)
+{
+    int port;
+    char *host;
+    struct prometheus_remote_write_context *ctx = shards->ctx;
+    struct flb_output_instance *ins = ctx->ins;
+
+    shard->id = id;
+    shard->parent = shards;
+    mk_list_init(&shard->queue);
+    mk_list_init(&shard->upstreams);
+    pthread_mutex_init(&shard->mutex, NULL);
+    pthread_cond_init(&shard->cond, NULL);
+
+    if (snappy_init_env(&shard->snappy_env) != 0) {
+        flb_plg_error(ins, "could not initialize snappy for shard %i", id);
+        return -1;
+    }
+
+    if (ctx->proxy) {
+        host = ctx->proxy_host;
+        port = ctx->proxy_port;
+    }
+    else {
+        host = ins->host.name;
+        port = ins->host.port;
+    }
+
+    shard->evl = mk_event_loop_create(8);
+    if (!shard->evl) {
+        flb_plg_error(ins, "could not create event loop for shard %i", id);
+        return -1;
+    }
+
+    /*
+     * Senders do blocking I/O, the event loop is never polled and only
+     * tracks the idle keepalive connections. The upstream is locked since
+     * the engine still sweeps its timeouts.
+     */
+    shard->u = flb_upstream_create(config, host, port,
+                                   flb_stream_get_flags(&ctx->u->base),
+                                   ins->tls);
+    if (!shard->u) {
+        return -1;
+    }
+    flb_stream_disable_async_mode(&shard->u->base);
+    flb_upstream_thread_safe(shard->u);
+    mk_list_add(&shard->u->base._head, &shard->upstreams);
+    memcpy(&shard->u->base.net, &ins->net_setup, sizeof(struct flb_net_setup));
+
+    shard->th = flb_tp_thread_create(shards->tp, shard_worker, shard, config);
+    if (!shard->th) {
+        return -1;
+    }
+
+    return 0;
+}
+
+struct prom_rw_shards *prom_rw_shards_create(struct prometheus_remote_write_context *ctx,
+                                             struct flb_config *config)
+{
+    int i;
+    int ret;
+    struct prom_rw_shards *shards;
+
+    shards = flb_calloc(1, sizeof(struct prom_rw_shards));
+    if (!shards) {
+        flb_errno();
+        return NULL;
+    }
+    shards->ctx = ctx;
+    shards->active = ctx->min_shards;
+    pthread_mutex_init(&shards->mutex, NULL);
+    pthread_mutex_init(&shards->pool_mutex, NULL);
+
+    /* enough buffers for two batches in flight per shard */
+    shards->pool_size = ctx->max_shards * 2;
+    shards->pool = flb_calloc(shards->pool_size, sizeof(flb_sds_t));
+    if (!shards->pool) {
+        flb_errno();
+        prom_rw_shards_destroy(shards);
+        return NULL;
+    }
+
+    shards->tp = flb_tp_create(config);
+    if (!shards->tp) {
+        prom_rw_shards_destroy(shards);
+        return NULL;
+    }
+
+    shards->shard = flb_calloc(ctx->max_shards, sizeof(struct prom_rw_shard));
+    if (!shards->shard) {
+        flb_errno();
+        prom_rw_shards_destroy(shards);
+        return NULL;
+    }
+
+    for (i = 0; i < ctx->max_shards; i++) {
+        shards->count++;
+        ret = shard_init(shards, &shards->shard[i], i, config);
+        if (ret == -1) {
+            prom_rw_shards_destroy(shards);
+            return NULL;
+        }
+    }
+
+    for (i = 0; i < shards->count; i++) {
+        ret = flb_tp_thread_start(shards->tp, shards->shard[i].th);
+        if (ret == -1) {
+            flb_plg_error(ctx->ins, "could not start sender for shard %i", i);
+            prom_rw_shards_destroy(shards);
+            return NULL;
+        }
+    }
+
+    flb_plg_info(ctx->ins, "series sharding: %i-%i shards, "
+                 "max_samples_per_send=%i", ctx->min_shards, ctx->max_shards,
+                 ctx->max_samples_per_send);
+
+    return shards;
+}
+
+void prom_rw_shards_destroy(struct prom_rw_shards *shards)
+{
+    int i;
+    struct prom_rw_shard *shard;
+
+    if (!shards) {
+        return;
+    }
+
+    for (i = 0; i < shards->count; i++) {
+        shard = &shards->shard[i];
+
+        if (shard->th && shard->th->status == FLB_THREAD_POOL_RUNNING) {
+            pthread_mutex_lock(&shard->mutex);
+            shard->exit = FLB_TRUE;
+            pthread_cond_signal(&shard->cond);
+            pthread_mutex_unlock(&shard->mutex);
+
+            pthread_join(shard->th->tid, NULL);
+        }
+
+        if (shard->u) {
+            flb_upstream_destroy(shard->u);
+        }
+        if (shard->evl) {
+            mk_event_loop_destroy(shard->evl);
+        }
+        if (shard->zbuf) {
+            flb_free(shard->zbuf);
+        }
+        snappy_free_env(&shard->snappy_env);
+        pthread_mutex_destroy(&shard->mutex);
+        pthread_cond_destroy(&shard->cond);
+    }
+
+    if (shards->tp) {
+        flb_tp_destroy(shards->tp);
+    }
+    if (shards->pool) {
+        for (i = 0; i < shards->pool_count; i++) {
+            flb_sds_destroy(shards->pool[i]);
+        }
+        flb_free(shards->pool);
+    }
+
+    pthread_mutex_destroy(&shards->mutex);
+    pthread_mutex_destroy(&shards->pool_mutex);
+    flb_free(shards->shard);
+    flb_free(shards);
+}
+
+/*
+ * The shard count follows the backlog: the average samples per flush plus
+ * the samples still queued, in batches of 'max_samples_per_send'. As in
+ * Prometheus, small changes are ignored so the series do not move between
+ * shards on every flush.
+ */
+static int shards_desired(struct prom_rw_shards *shards)
+{
+    int i;
+    int desired;
+    size_t backlog = 0;
+    struct prometheus_remote_write_context *ctx = shards->ctx;
+
+    for (i = 0; i < shards->count; i++) {
+        pthread_mutex_lock(&shards->shard[i].mutex);
+        backlog += shards->shard[i].queued;
+        pthread_mutex_unlock(&shards->shard[i].mutex);
+    }
+
+    desired = (int) ceil((shards->samples_in + backlog) /
+                         ctx->max_samples_per_send);
+    if (desired < ctx->min_shards) {
+        desired = ctx->min_shards;
+    }
+    else if (desired > ctx->max_shards) {
+        desired = ctx->max_shards;
+    }
+
+    if (desired > shards->active * (1 - PROM_RW_SHARDS_TOLERANCE) &&
+        desired < shards->active * (1 + PROM_RW_SHARDS_TOLERANCE)) {
+        return shards->active;
+    }
+
+    flb_plg_debug(ctx->ins, "resharding from %i to %i shards (backlog=%zu "
+                  "samples)", shards->active, desired, backlog);
+
+    return desired;
+}
+
+int prom_rw_flush_init(struct prom_rw_shards *shards, struct prom_rw_flush *flush)
+{
+    memset(flush, 0, sizeof(struct prom_rw_flush));
+
+    flush->open = flb_calloc(shards->count, sizeof(struct prom_rw_batch *));
+    if (!flush->open) {
+        flb_errno();
+        return -1;
+    }
+    flush->parent = shards;
+    flush->result = FLB_OK;
+    pthread_mutex_init(&flush->mutex, NULL);
+    pthread_cond_init(&flush->cond, NULL);
+
+    pthread_mutex_lock(&shards->mutex);
+    shards->active = shards_desired(shards);
+    flush->shards = shards->active;
+    pthread_mutex_unlock(&shards->mutex);
+
+    return 0;
+}
+
+static int flush_series(Prometheus__TimeSeries *series, void *data)
+{
+    int id;
+    struct prom_rw_batch *batch;
+    struct prom_rw_flush *flush = data;
+    struct prom_rw_shards *shards = flush->parent;
+
+    id = series_hash(series) % flush->shards;
+
+    batch = flush->open[id];
+    if (!batch) {
+        batch = batch_create(flush);
+        if (!batch) {
+            return -1;
+        }
+        flush->open[id] = batch;
+    }
+
+    if (batch_append(batch, series) == -1) {
+        return -1;
+    }
+
+    if (batch->samples >= shards->ctx->max_samples_per_send) {
+        shard_enqueue(&shards->shard[id], batch);
+        flush->open[id] = NULL;
+    }
+
+    return 0;
+}
+
+/* Split the series of a metrics context into the shard batches */
+int prom_rw_flush_append(struct prom_rw_flush *flush, struct cmt *cmt)
+{
+    int ret;
+
+    ret = cmt_encode_prometheus_remote_write_series(cmt, flush_series, flush);
+    if (ret != CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* The last batch was sent: resume the flush coroutine */
+static int flush_event(void *data)
+{
+    int ret;
+    uint64_t val;
+    struct mk_event *event = data;
+    struct prom_rw_flush *flush = event->data;
+
+    ret = flb_pipe_r(flush->ch[0], &val, sizeof(val));
+    if (ret <= 0) {
+        flb_errno();
+    }
+
+    flb_coro_resume(flush->coro);
+
+    return 0;
+}
+
+/* Register the wake up channel on the event loop of this thread */
+static int flush_event_register(struct prom_rw_flush *flush,
+                                struct mk_event_loop *evl)
+{
+    int ret;
+
+    ret = flb_pipe_create(flush->ch);
+    if (ret == -1) {
+        flb_errno();
+        return -1;
+    }
+
+    MK_EVENT_ZERO(&flush->event);
+    flush->event.data = flush;
+    flush->event.handler = flush_event;
+
+    ret = mk_event_add(evl, flush->ch[0], FLB_ENGINE_EV_CUSTOM,
+                       MK_EVENT_READ, &flush->event);
+    if (ret == -1) {
+        flb_pipe_destroy(flush->ch);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Wait for the senders. Inside a flush coroutine it yields so the thread
+ * keeps serving its event loop, the sender of the last batch resumes it.
+ */
+static void flush_pending_wait(struct prom_rw_flush *flush)
+{
+    int ret;
+    struct mk_event_loop *evl;
+
+    flush->coro = flb_coro_get();
+    evl = flb_engine_evl_get();
+
+    pthread_mutex_lock(&flush->mutex);
+    if (flush->pending > 0 && flush->coro && evl) {
+        ret = flush_event_register(flush, evl);
+        if (ret == 0) {
+            flush->waiting = FLB_TRUE;
+            while (flush->pending > 0) {
+                pthread_mutex_unlock(&flush->mutex);
+                flb_coro_yield(flush->coro, FLB_FALSE);
+                pthread_mutex_lock(&flush->mutex);
+            }
+            flush->waiting = FLB_FALSE;
+
+            mk_event_del(evl, &flush->event);
+            flb_pipe_destroy(flush->ch);
+        }
+    }
+
+    while (flush->pending > 0) {
+        pthread_cond_wait(&flush->cond, &flush->mutex);
+    }
+    pthread_mutex_unlock(&flush->mutex);
+}
+
+/*
+ * Queue the partial batches (or drop them if 'abort' is set) and wait for
+ * every batch of this flush, returns the worst result.
+ */
+int prom_rw_flush_wait(struct prom_rw_flush *flush, int abort)
+{
+    int i;
+    int result;
+    size_t samples;
+    struct prom_rw_batch *batch;
+    struct prom_rw_shards *shards = flush->parent;
+
+    for (i = 0; i < flush->shards; i++) {
+        batch = flush->open[i];
+        if (!batch) {
+            continue;
+        }
+
+        if (abort || batch->samples == 0) {
+            batch_destroy(shards, batch);
+        }
+        else {
+            shard_enqueue(&shards->shard[i], batch);
+        }
+    }
+    flb_free(flush->open);
+
+    flush_pending_wait(flush);
+
+    pthread_mutex_lock(&flush->mutex);
+    result = flush->result;
+    samples = flush->samples;
+    pthread_mutex_unlock(&flush->mutex);
+
+    pthread_mutex_destroy(&flush->mutex);
+    pthread_cond_destroy(&flush->cond);
+
+    pthread_mutex_lock(&shards->mutex);
+    if (shards->samples_in == 0) {
+        shards->samples_in = samples;
+    }
+    else {
+        shards->samples_in = shards->samples_in * (1 - PROM_RW_SHARDS_EWMA_WEIGHT) +
+                             samples * PROM_RW_SHARDS_EWMA_WEIGHT;
+    }
+    pthread_mutex_unlock(&shards->mutex);
+
+    flb_plg_debug(shards->ctx->ins, "flushed %zu samples over %i shards (ret=%i)",
+                  samples, flush->shards, result);
+
+    return result;
+}
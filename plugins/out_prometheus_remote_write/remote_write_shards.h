@@ -0,0 +1,125 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2024 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_PROMETHEUS_REMOTE_WRITE_SHARDS_H
+#define FLB_PROMETHEUS_REMOTE_WRITE_SHARDS_H
+
+#include <fluent-bit/flb_output_plugin.h>
+#include <fluent-bit/flb_coro.h>
+#include <fluent-bit/flb_pipe.h>
+#include <fluent-bit/flb_thread_pool.h>
+#include <cmetrics/cmetrics.h>
+#include <snappy.h>
+
+#include "remote_write.h"
+
+/* weight of the last flush in the samples-per-flush average */
+#define PROM_RW_SHARDS_EWMA_WEIGHT    0.2
+
+/* relative change of the desired shard count needed to reshard */
+#define PROM_RW_SHARDS_TOLERANCE      0.3
+
+/* seconds between idle shard wake ups to sweep connection timeouts */
+#define PROM_RW_SHARDS_SWEEP_INTERVAL 1
+
+/* estimated size of a packed sample, used to size pooled buffers */
+#define PROM_RW_SHARDS_SAMPLE_SIZE    64
+
+struct prom_rw_shards;
+
+/* A write request being built or waiting in a shard queue */
+struct prom_rw_batch {
+    flb_sds_t payload;              /* packed time series (uncompressed)   */
+    size_t samples;
+    struct prom_rw_flush *flush;    /* flush waiting for this batch        */
+    struct mk_list _head;           /* link to prom_rw_shard->queue        */
+};
+
+/*
+ * One sender per shard: a FIFO queue served by its own thread and its own
+ * synchronous upstream, so samples of a series are always sent in order.
+ */
+struct prom_rw_shard {
+    int id;
+    int exit;
+    size_t queued;                  /* samples waiting in the queue        */
+    struct mk_list queue;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+
+    /* compression buffer, reused by every request of this shard */
+    char *zbuf;
+    size_t zbuf_size;
+    struct snappy_env snappy_env;
+
+    /* keepalive connections are registered on the shard event loop */
+    struct mk_event_loop *evl;
+    struct flb_upstream *u;
+    struct mk_list upstreams;       /* timeouts swept by the shard thread  */
+    struct flb_tp_thread *th;
+    struct prom_rw_shards *parent;
+};
+
+struct prom_rw_shards {
+    int active;                     /* shards receiving new series         */
+    double samples_in;              /* average samples per flush           */
+    pthread_mutex_t mutex;
+
+    /* recycled batch buffers */
+    int pool_size;
+    int pool_count;
+    flb_sds_t *pool;
+    pthread_mutex_t pool_mutex;
+
+    int count;                      /* 'max_shards' senders                */
+    struct prom_rw_shard *shard;
+    struct flb_tp *tp;
+    struct prometheus_remote_write_context *ctx;
+};
+
+/*
+ * State of one flush callback, it waits until every batch is sent. The flush
+ * coroutine yields meanwhile: the sender of the last batch writes to 'ch',
+ * which is registered on the event loop of the thread running the flush.
+ */
+struct prom_rw_flush {
+    int result;
+    int pending;
+    int shards;                     /* active shards for this flush        */
+    size_t samples;
+    struct prom_rw_batch **open;    /* batch being filled for each shard   */
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;            /* used when not running in a coroutine */
+
+    int waiting;                    /* coroutine waiting on 'ch'           */
+    flb_pipefd_t ch[2];
+    struct mk_event event;
+    struct flb_coro *coro;
+    struct prom_rw_shards *parent;
+};
+
+struct prom_rw_shards *prom_rw_shards_create(struct prometheus_remote_write_context *ctx,
+                                             struct flb_config *config);
+void prom_rw_shards_destroy(struct prom_rw_shards *shards);
+
+int prom_rw_flush_init(struct prom_rw_shards *shards, struct prom_rw_flush *flush);
+int prom_rw_flush_append(struct prom_rw_flush *flush, struct cmt *cmt);
+int prom_rw_flush_wait(struct prom_rw_flush *flush, int abort);
+
+#endif
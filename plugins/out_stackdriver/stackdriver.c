@@ -19,6 +19,7 @@
 
 #include <fluent-bit/flb_output_plugin.h>
 #include <fluent-bit/flb_http_client.h>
+#include <fluent-bit/flb_http_client_http2.h>
 #include <fluent-bit/flb_pack.h>
 #include <fluent-bit/flb_utils.h>
 #include <fluent-bit/flb_time.h>
@@ -1262,6 +1263,10 @@ static int cb_stackdriver_init(struct flb_output_instance *ins,
     }
     flb_output_upstream_set(ctx->u, ins);
 
+    if (ctx->http2 == FLB_TRUE) {
+        flb_http2_client_upstream_setup(ctx->u, ins->tls, NULL);
+    }
+
     /* Metadata Upstream Sync flags */
     flb_stream_disable_async_mode(&ctx->metadata_u->base);
 
@@ -3197,6 +3202,12 @@ static struct flb_config_map config_map[] = {
       0, FLB_FALSE, 0,
       "Set log payload compression method. Option available is 'gzip'"
     },
+    {
+      FLB_CONFIG_MAP_BOOL, "http2", "false",
+      0, FLB_TRUE, offsetof(struct flb_stackdriver, http2),
+      "Send requests over HTTP/2, multiplexing concurrent flushes over "
+      "shared connections"
+    },
     {
       FLB_CONFIG_MAP_CLIST, "labels", NULL,
       0, FLB_TRUE, offsetof(struct flb_stackdriver, labels),
@@ -172,6 +172,9 @@ struct flb_stackdriver {
     /* Internal variable to reduce string comparisons */
     int compress_gzip;
 
+    /* use HTTP/2 for the logging API */
+    int http2;
+
     /* other */
     flb_sds_t export_to_project_id;
     flb_sds_t project_id_key;
@@ -22,10 +22,7 @@
 
 #include "sql.h"
 #include "sql_config.h"
-
-/* String type to numerical conversion */
-#define SQL_STR_INT   1
-#define SQL_STR_FLOAT 2
+#include "sql_columnar.h"
 
 static int cb_init(struct flb_processor_instance *ins,
                    void *source_plugin_instance,
@@ -77,7 +74,7 @@ void sql_expression_val_free(struct sql_expression_val *v)
  * - if output number is a float, 'd' is set and returns FLB_STR_FLOAT
  * - if no conversion is possible (not a number), returns -1
  */
-static int string_to_number(const char *str, int len, int64_t *i, double *d)
+int sql_string_to_number(const char *str, int len, int64_t *i, double *d)
 {
     int c;
     int dots = 0;
@@ -145,7 +142,7 @@ static void exp_string_to_number(struct sql_expression_val *val)
     len = flb_sds_len(val->val.string);
     str = val->val.string;
 
-    ret = string_to_number(str, len, &i, &d);
+    ret = sql_string_to_number(str, len, &i, &d);
     if (ret == -1) {
         return;
     }
@@ -427,7 +424,9 @@ static int sql_key_to_value(char *name, struct flb_mp_chunk_record *record, stru
 
     if (var->type == CFL_VARIANT_STRING) {
         val->type = SQL_EXP_STRING;
-        val->val.string = cfl_sds_create(kvpair->val->data.as_string);
+        /* strings decoded from msgpack reference the chunk, no NULL byte */
+        val->val.string = cfl_sds_create_len(var->data.as_string,
+                                             cfl_variant_size_get(var));
     }
     else if (var->type == CFL_VARIANT_INT) {
         val->type = SQL_EXP_INT;
@@ -661,14 +660,32 @@ static int cb_process_logs(struct flb_processor_instance *ins,
     struct sql_ctx *ctx;
     struct flb_mp_chunk_cobj *chunk_cobj = (struct flb_mp_chunk_cobj *) chunk_data;
     struct flb_mp_chunk_record *record;
+    struct flb_mp_chunk_record *prev;
     ctx = ins->context;
 
+    if (ctx->columnar_plan) {
+        sql_columnar_process(ctx->columnar_plan, chunk_cobj);
+        return FLB_PROCESSOR_SUCCESS;
+    }
+
     /* Iterate records */
     while (flb_mp_chunk_cobj_record_next(chunk_cobj, &record) == FLB_MP_CHUNK_RECORD_OK) {
         ret = process_record(ctx, ctx->query, record);
         if (ret == -1) {
-          /* remove the record from the chunk */
-          flb_mp_chunk_cobj_record_destroy(chunk_cobj, record);
+            prev = NULL;
+            if (record->_head.prev != &chunk_cobj->records) {
+                prev = cfl_list_entry(record->_head.prev,
+                                      struct flb_mp_chunk_record, _head);
+            }
+
+            /* remove the record from the chunk */
+            flb_mp_chunk_cobj_record_destroy(chunk_cobj, record);
+
+            /*
+             * the removal resets the iterator, resume after the previous
+             * record instead of visiting the processed records again
+             */
+            chunk_cobj->record_pos = prev;
         }
     }
 
@@ -682,6 +699,12 @@ static struct flb_config_map config_map[] = {
         0, FLB_TRUE, offsetof(struct sql_ctx, query_str),
         "SQL query for data selection."
     },
+    {
+        FLB_CONFIG_MAP_BOOL, "columnar", "true",
+        0, FLB_TRUE, offsetof(struct sql_ctx, columnar),
+        "Evaluate the query over batches of records stored as columns, "
+        "queries not supported by the columnar executor run record by record."
+    },
 
     /* EOF */
     {0}
@@ -26,6 +26,10 @@
 #define SQL_SP_OK            0
 #define SQL_SP_ERROR        -1
 
+/* String type to numerical conversion */
+#define SQL_STR_INT   1
+#define SQL_STR_FLOAT 2
+
 /* Expression type */
 enum sql_expressions {
     SQL_LOGICAL_OP = 0,
@@ -127,11 +131,17 @@ struct sql_query {
     struct mk_list *tmp_subkeys;
 };
 
+struct sql_columnar;
+
 struct sql_ctx {
+    int columnar;
     struct sql_query *query;
+    struct sql_columnar *columnar_plan;   /* NULL: row by row execution */
 
     cfl_sds_t query_str;
     struct flb_processor_instance *ins;
 };
 
+int sql_string_to_number(const char *str, int len, int64_t *i, double *d);
+
 #endif
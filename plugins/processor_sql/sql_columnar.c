@@ -0,0 +1,751 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2024 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fluent-bit/flb_processor_plugin.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_mp_chunk.h>
+
+#include "sql.h"
+#include "sql_columnar.h"
+
+/*
+ * Columnar executor: the records of a chunk are processed in batches, the
+ * keys referenced by the WHERE condition are loaded once per record in
+ * column vectors and every node of the condition produces a selection
+ * vector for the whole batch. Comparisons against numbers run as plain
+ * loops over typed arrays the compiler can vectorize, the less common
+ * cases (strings converted to numbers, mixed types) are fixed per row
+ * with the same rules of the row by row executor.
+ */
+
+static int column_get(struct sql_columnar *plan, cfl_sds_t name)
+{
+    int i;
+    struct sql_column *col;
+
+    for (i = 0; i < plan->columns_size; i++) {
+        col = &plan->columns[i];
+        if (col->name_len == cfl_sds_len(name) &&
+            memcmp(col->name, name, col->name_len) == 0) {
+            return i;
+        }
+    }
+
+    if (plan->columns_size == SQL_COLUMNS_MAX) {
+        return -1;
+    }
+
+    col = &plan->columns[plan->columns_size];
+    col->name = name;
+    col->name_len = cfl_sds_len(name);
+
+    return plan->columns_size++;
+}
+
+static int is_value(struct sql_expression *exp)
+{
+    switch (exp->type) {
+    case SQL_EXP_BOOL:
+    case SQL_EXP_INT:
+    case SQL_EXP_FLOAT:
+    case SQL_EXP_STRING:
+    case SQL_EXP_NULL:
+        return FLB_TRUE;
+    }
+
+    return FLB_FALSE;
+}
+
+static void vnode_destroy(struct sql_vnode *node)
+{
+    if (!node) {
+        return;
+    }
+
+    vnode_destroy(node->left);
+    vnode_destroy(node->right);
+    flb_free(node);
+}
+
+static struct sql_vnode *vnode_compile(struct sql_columnar *plan,
+                                       struct sql_expression *exp);
+
+/* operand of a logical operation, see logical_operation() */
+static struct sql_vnode *vnode_operand(struct sql_columnar *plan,
+                                       struct sql_expression *exp)
+{
+    struct sql_vnode *node;
+
+    if (exp && exp->type == SQL_LOGICAL_OP) {
+        return vnode_compile(plan, exp);
+    }
+
+    node = flb_calloc(1, sizeof(struct sql_vnode));
+    if (!node) {
+        flb_errno();
+        return NULL;
+    }
+
+    if (!exp) {
+        node->type = SQL_VNODE_FALSE;
+    }
+    else if (exp->type == SQL_EXP_KEY) {
+        node->type = SQL_VNODE_TRUTH;
+        node->column = column_get(plan,
+                                  ((struct sql_expression_key *) exp)->name);
+        if (node->column == -1) {
+            flb_free(node);
+            return NULL;
+        }
+    }
+    else if (is_value(exp)) {
+        node->type = SQL_VNODE_CONST;
+        node->val = (struct sql_expression_val *) exp;
+    }
+    else {
+        flb_free(node);
+        return NULL;
+    }
+
+    return node;
+}
+
+/* Returns NULL if the expression is not supported */
+static struct sql_vnode *vnode_compile(struct sql_columnar *plan,
+                                       struct sql_expression *exp)
+{
+    int op;
+    struct sql_vnode *node;
+    struct sql_expression_op *exp_op;
+
+    if (exp->type != SQL_LOGICAL_OP) {
+        return NULL;
+    }
+
+    exp_op = (struct sql_expression_op *) exp;
+    op = exp_op->operation;
+
+    node = flb_calloc(1, sizeof(struct sql_vnode));
+    if (!node) {
+        flb_errno();
+        return NULL;
+    }
+    node->op = op;
+
+    switch (op) {
+    case SQL_EXP_EQ:
+    case SQL_EXP_LT:
+    case SQL_EXP_LTE:
+    case SQL_EXP_GT:
+    case SQL_EXP_GTE:
+        if (!exp_op->left || exp_op->left->type != SQL_EXP_KEY ||
+            !exp_op->right || !is_value(exp_op->right)) {
+            flb_free(node);
+            return NULL;
+        }
+        node->type = SQL_VNODE_CMP;
+        node->val = (struct sql_expression_val *) exp_op->right;
+        node->column = column_get(plan,
+                                  ((struct sql_expression_key *) exp_op->left)->name);
+        if (node->column == -1) {
+            flb_free(node);
+            return NULL;
+        }
+        return node;
+    case SQL_EXP_PAR:
+        node->type = SQL_VNODE_PAR;
+        if (!exp_op->left) {
+            node->type = SQL_VNODE_FALSE;
+            return node;
+        }
+        node->left = vnode_compile(plan, exp_op->left);
+        break;
+    case SQL_EXP_NOT:
+        node->type = SQL_VNODE_NOT;
+        node->left = vnode_operand(plan, exp_op->left);
+        break;
+    case SQL_EXP_AND:
+    case SQL_EXP_OR:
+        node->type = (op == SQL_EXP_AND) ? SQL_VNODE_AND : SQL_VNODE_OR;
+        node->left = vnode_operand(plan, exp_op->left);
+        node->right = vnode_operand(plan, exp_op->right);
+        if (!node->right) {
+            vnode_destroy(node);
+            return NULL;
+        }
+        break;
+    default:
+        flb_free(node);
+        return NULL;
+    }
+
+    if (!node->left) {
+        vnode_destroy(node);
+        return NULL;
+    }
+
+    return node;
+}
+
+static int value_to_bool(struct sql_expression_val *val)
+{
+    switch (val->type) {
+    case SQL_EXP_BOOL:
+        return val->val.boolean;
+    case SQL_EXP_INT:
+        return val->val.i64 > 0;
+    case SQL_EXP_FLOAT:
+        return val->val.f64 > 0;
+    case SQL_EXP_STRING:
+        return FLB_TRUE;
+    }
+
+    return FLB_FALSE;
+}
+
+/* Load the condition keys of the batch records in the columns */
+static void batch_load(struct sql_columnar *plan, int n)
+{
+    int i;
+    int c;
+    int len;
+    int type;
+    uint32_t seen;
+    uint32_t all;
+    struct cfl_list *head;
+    struct cfl_kvlist *kvlist;
+    struct cfl_kvpair *kvpair;
+    struct cfl_variant *var;
+    struct sql_column *col;
+
+    all = (plan->columns_size == 32) ? 0xffffffff :
+          ((1U << plan->columns_size) - 1);
+
+    for (c = 0; c < plan->columns_size; c++) {
+        plan->columns[c].types = 0;
+    }
+
+    for (i = 0; i < n; i++) {
+        for (c = 0; c < plan->columns_size; c++) {
+            plan->columns[c].type[i] = SQL_COL_MISSING;
+        }
+
+        /* the first key matching a column wins */
+        seen = 0;
+        kvlist = plan->records[i]->cobj_record->variant->data.as_kvlist;
+        cfl_list_foreach(head, &kvlist->list) {
+            kvpair = cfl_list_entry(head, struct cfl_kvpair, _head);
+            len = cfl_sds_len(kvpair->key);
+
+            for (c = 0; c < plan->columns_size; c++) {
+                col = &plan->columns[c];
+                if ((seen & (1U << c)) || col->name_len != len ||
+                    memcmp(col->name, kvpair->key, len) != 0) {
+                    continue;
+                }
+                seen |= (1U << c);
+
+                var = kvpair->val;
+                switch (var->type) {
+                case CFL_VARIANT_STRING:
+                    col->type[i] = SQL_EXP_STRING;
+                    col->str[i] = var->data.as_string;
+                    col->str_len[i] = cfl_variant_size_get(var);
+                    break;
+                case CFL_VARIANT_INT:
+                    col->type[i] = SQL_EXP_INT;
+                    col->i64[i] = var->data.as_int64;
+                    break;
+                case CFL_VARIANT_UINT:
+                    col->type[i] = SQL_EXP_INT;
+                    col->i64[i] = var->data.as_uint64;
+                    break;
+                case CFL_VARIANT_DOUBLE:
+                    col->type[i] = SQL_EXP_FLOAT;
+                    col->f64[i] = var->data.as_double;
+                    break;
+                case CFL_VARIANT_BOOL:
+                    col->type[i] = SQL_EXP_BOOL;
+                    col->i64[i] = var->data.as_bool;
+                    break;
+                case CFL_VARIANT_NULL:
+                    col->type[i] = SQL_EXP_NULL;
+                    break;
+                }
+                break;
+            }
+
+            if (seen == all) {
+                break;
+            }
+        }
+
+        for (c = 0; c < plan->columns_size; c++) {
+            type = plan->columns[c].type[i];
+            plan->columns[c].types |= (1 << type);
+        }
+    }
+}
+
+/* Compare a single row, same rules as numerical_comp() */
+static int row_compare(struct sql_column *col, int i, int op,
+                       struct sql_expression_val *val)
+{
+    int ret;
+    int ltype;
+    int rtype;
+    int llen = 0;
+    int64_t li = 0;
+    double lf = 0.0;
+    const char *ls = NULL;
+    char num[64];
+    cfl_sds_t tmp;
+    sql_val r;
+
+    ltype = col->type[i];
+    if (ltype == SQL_COL_MISSING) {
+        return FLB_FALSE;
+    }
+
+    switch (ltype) {
+    case SQL_EXP_STRING:
+        ls = col->str[i];
+        llen = col->str_len[i];
+        break;
+    case SQL_EXP_FLOAT:
+        lf = col->f64[i];
+        break;
+    default:
+        li = col->i64[i];
+        break;
+    }
+
+    rtype = val->type;
+    r = val->val;
+
+    /* strings reference the chunk data, the conversion needs a NULL byte */
+    if (ltype == SQL_EXP_STRING && rtype != SQL_EXP_STRING) {
+        if (llen < sizeof(num)) {
+            memcpy(num, ls, llen);
+            num[llen] = '\0';
+            ret = sql_string_to_number(num, llen, &li, &lf);
+        }
+        else {
+            tmp = cfl_sds_create_len(ls, llen);
+            if (!tmp) {
+                return FLB_FALSE;
+            }
+            ret = sql_string_to_number(tmp, llen, &li, &lf);
+            cfl_sds_destroy(tmp);
+        }
+
+        if (ret == SQL_STR_INT) {
+            ltype = SQL_EXP_INT;
+        }
+        else if (ret == SQL_STR_FLOAT) {
+            ltype = SQL_EXP_FLOAT;
+        }
+    }
+
+    if (ltype == SQL_EXP_INT && rtype == SQL_EXP_FLOAT) {
+        ltype = SQL_EXP_FLOAT;
+        lf = (double) li;
+    }
+    else if (ltype == SQL_EXP_FLOAT && rtype == SQL_EXP_INT) {
+        rtype = SQL_EXP_FLOAT;
+        r.f64 = (double) r.i64;
+    }
+
+    if (ltype != rtype) {
+        return FLB_FALSE;
+    }
+
+    if (op == SQL_EXP_EQ) {
+        switch (ltype) {
+        case SQL_EXP_NULL:
+            return FLB_TRUE;
+        case SQL_EXP_BOOL:
+            return li == r.boolean;
+        case SQL_EXP_INT:
+            return li == r.i64;
+        case SQL_EXP_FLOAT:
+            return lf == r.f64;
+        case SQL_EXP_STRING:
+            return llen == cfl_sds_len(r.string) &&
+                   memcmp(ls, r.string, llen) == 0;
+        }
+        return FLB_FALSE;
+    }
+
+    switch (ltype) {
+    case SQL_EXP_INT:
+        ret = (li > r.i64) - (li < r.i64);
+        break;
+    case SQL_EXP_FLOAT:
+        ret = (lf > r.f64) - (lf < r.f64);
+        if (ret == 0 && lf != r.f64) {
+            return FLB_FALSE;                  /* NaN */
+        }
+        break;
+    case SQL_EXP_STRING:
+        ret = strncmp(ls, r.string, llen);
+        break;
+    default:
+        return FLB_FALSE;
+    }
+
+    switch (op) {
+    case SQL_EXP_LT:
+        return ret < 0;
+    case SQL_EXP_LTE:
+        return ret <= 0;
+    case SQL_EXP_GT:
+        return ret > 0;
+    case SQL_EXP_GTE:
+        return ret >= 0;
+    }
+
+    return FLB_FALSE;
+}
+
+#define SQL_VCMP(sel, n, expr)                 \
+    for (i = 0; i < n; i++) {                  \
+        sel[i] |= (expr);                      \
+    }
+
+#define SQL_VCMP_OPS(sel, n, t, type, l, r)                         \
+    switch (op) {                                                   \
+    case SQL_EXP_EQ:  SQL_VCMP(sel, n, (t[i] == type) & (l == r)); break; \
+    case SQL_EXP_LT:  SQL_VCMP(sel, n, (t[i] == type) & (l <  r)); break; \
+    case SQL_EXP_LTE: SQL_VCMP(sel, n, (t[i] == type) & (l <= r)); break; \
+    case SQL_EXP_GT:  SQL_VCMP(sel, n, (t[i] == type) & (l >  r)); break; \
+    case SQL_EXP_GTE: SQL_VCMP(sel, n, (t[i] == type) & (l >= r)); break; \
+    }
+
+static void vnode_cmp(struct sql_vnode *node, struct sql_column *col, int n)
+{
+    int i;
+    int op = node->op;
+    int rtype = node->val->type;
+    int64_t ci;
+    double cf;
+    uint8_t *sel = node->sel;
+    const uint8_t *t = col->type;
+    const int64_t *i64 = col->i64;
+    const double *f64 = col->f64;
+
+    memset(sel, 0, n);
+
+    if (rtype == SQL_EXP_INT || rtype == SQL_EXP_FLOAT) {
+        ci = node->val->val.i64;
+        cf = (rtype == SQL_EXP_INT) ? (double) ci : node->val->val.f64;
+
+        if (col->types & (1 << SQL_EXP_INT)) {
+            if (rtype == SQL_EXP_INT) {
+                SQL_VCMP_OPS(sel, n, t, SQL_EXP_INT, i64[i], ci);
+            }
+            else {
+                SQL_VCMP_OPS(sel, n, t, SQL_EXP_INT, (double) i64[i], cf);
+            }
+        }
+        if (col->types & (1 << SQL_EXP_FLOAT)) {
+            SQL_VCMP_OPS(sel, n, t, SQL_EXP_FLOAT, f64[i], cf);
+        }
+
+        /* strings holding numbers */
+        if (col->types & (1 << SQL_EXP_STRING)) {
+            for (i = 0; i < n; i++) {
+                if (t[i] == SQL_EXP_STRING) {
+                    sel[i] = row_compare(col, i, op, node->val);
+                }
+            }
+        }
+        return;
+    }
+
+    if (rtype == SQL_EXP_NULL) {
+        if (op == SQL_EXP_EQ && (col->types & (1 << SQL_EXP_NULL))) {
+            SQL_VCMP(sel, n, t[i] == SQL_EXP_NULL);
+        }
+        return;
+    }
+
+    for (i = 0; i < n; i++) {
+        sel[i] = row_compare(col, i, op, node->val);
+    }
+}
+
+static void vnode_truth(struct sql_vnode *node, struct sql_column *col, int n)
+{
+    int i;
+    uint8_t *sel = node->sel;
+    const uint8_t *t = col->type;
+    const int64_t *i64 = col->i64;
+    const double *f64 = col->f64;
+
+    memset(sel, 0, n);
+
+    if (col->types & (1 << SQL_EXP_BOOL)) {
+        SQL_VCMP(sel, n, (t[i] == SQL_EXP_BOOL) & (i64[i] != 0));
+    }
+    if (col->types & (1 << SQL_EXP_INT)) {
+        SQL_VCMP(sel, n, (t[i] == SQL_EXP_INT) & (i64[i] > 0));
+    }
+    if (col->types & (1 << SQL_EXP_FLOAT)) {
+        SQL_VCMP(sel, n, (t[i] == SQL_EXP_FLOAT) & (f64[i] > 0));
+    }
+    if (col->types & (1 << SQL_EXP_STRING)) {
+        SQL_VCMP(sel, n, t[i] == SQL_EXP_STRING);
+    }
+}
+
+static void vnode_eval(struct sql_columnar *plan, struct sql_vnode *node,
+                       int n)
+{
+    int i;
+    uint8_t *sel = node->sel;
+    uint8_t *l;
+    uint8_t *r;
+
+    switch (node->type) {
+    case SQL_VNODE_FALSE:
+        memset(sel, 0, n);
+        break;
+    case SQL_VNODE_CONST:
+        memset(sel, value_to_bool(node->val), n);
+        break;
+    case SQL_VNODE_TRUTH:
+        vnode_truth(node, &plan->columns[node->column], n);
+        break;
+    case SQL_VNODE_CMP:
+        vnode_cmp(node, &plan->columns[node->column], n);
+        break;
+    case SQL_VNODE_PAR:
+        vnode_eval(plan, node->left, n);
+        memcpy(sel, node->left->sel, n);
+        break;
+    case SQL_VNODE_NOT:
+        vnode_eval(plan, node->left, n);
+        l = node->left->sel;
+        for (i = 0; i < n; i++) {
+            sel[i] = l[i] ^ 1;
+        }
+        break;
+    case SQL_VNODE_AND:
+        vnode_eval(plan, node->left, n);
+        vnode_eval(plan, node->right, n);
+        l = node->left->sel;
+        r = node->right->sel;
+        for (i = 0; i < n; i++) {
+            sel[i] = l[i] & r[i];
+        }
+        break;
+    case SQL_VNODE_OR:
+        vnode_eval(plan, node->left, n);
+        vnode_eval(plan, node->right, n);
+        l = node->left->sel;
+        r = node->right->sel;
+        for (i = 0; i < n; i++) {
+            sel[i] = l[i] | r[i];
+        }
+        break;
+    }
+}
+
+/* Remove the keys not selected by the query and apply the aliases */
+static void record_project(struct sql_columnar *plan,
+                           struct flb_mp_chunk_record *record)
+{
+    int i;
+    int len;
+    struct cfl_list *tmp;
+    struct cfl_list *head;
+    struct cfl_kvlist *kvlist;
+    struct cfl_kvpair *kvpair;
+    struct sql_select_key *key;
+    struct sql_select_key wildcard = {0};
+
+    if (plan->wildcard) {
+        if (!plan->wildcard_alias) {
+            return;
+        }
+        wildcard.alias = plan->wildcard_alias;
+    }
+
+    kvlist = record->cobj_record->variant->data.as_kvlist;
+    cfl_list_foreach_safe(head, tmp, &kvlist->list) {
+        kvpair = cfl_list_entry(head, struct cfl_kvpair, _head);
+
+        key = NULL;
+        if (plan->wildcard) {
+            key = &wildcard;
+        }
+        else {
+            len = cfl_sds_len(kvpair->key);
+            for (i = 0; i < plan->keys_size; i++) {
+                if (plan->keys[i].name_len == len &&
+                    memcmp(plan->keys[i].name, kvpair->key, len) == 0) {
+                    key = &plan->keys[i];
+                    break;
+                }
+            }
+        }
+
+        if (!key) {
+            cfl_kvpair_destroy(kvpair);
+        }
+        else if (key->alias) {
+            cfl_sds_destroy(kvpair->key);
+            kvpair->key = cfl_sds_create(key->alias);
+        }
+    }
+}
+
+static void batch_process(struct sql_columnar *plan,
+                          struct flb_mp_chunk_cobj *chunk_cobj, int n)
+{
+    int i;
+    uint8_t *sel = NULL;
+
+    if (plan->condition) {
+        batch_load(plan, n);
+        vnode_eval(plan, plan->condition, n);
+        sel = plan->condition->sel;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (sel && !sel[i]) {
+            flb_mp_chunk_cobj_record_destroy(chunk_cobj, plan->records[i]);
+        }
+        else {
+            record_project(plan, plan->records[i]);
+        }
+    }
+}
+
+int sql_columnar_process(struct sql_columnar *plan,
+                         struct flb_mp_chunk_cobj *chunk_cobj)
+{
+    int n = 0;
+    int ret;
+    struct cfl_list *tmp;
+    struct cfl_list *head;
+    struct flb_mp_chunk_record *record;
+    struct flb_log_event_decoder *decoder;
+
+    /* records already decoded by a previous processor */
+    cfl_list_foreach_safe(head, tmp, &chunk_cobj->records) {
+        record = cfl_list_entry(head, struct flb_mp_chunk_record, _head);
+        plan->records[n++] = record;
+        if (n == SQL_BATCH_SIZE) {
+            batch_process(plan, chunk_cobj, n);
+            n = 0;
+        }
+    }
+
+    /*
+     * decode the rest one batch at a time so the records are still in
+     * cache when the batch is evaluated
+     */
+    decoder = chunk_cobj->log_decoder;
+    while (decoder->offset < decoder->length) {
+        ret = flb_mp_chunk_cobj_record_next(chunk_cobj, &record);
+        if (ret != FLB_MP_CHUNK_RECORD_OK) {
+            break;
+        }
+
+        plan->records[n++] = record;
+        if (n == SQL_BATCH_SIZE) {
+            batch_process(plan, chunk_cobj, n);
+            n = 0;
+        }
+    }
+
+    if (n > 0) {
+        batch_process(plan, chunk_cobj, n);
+    }
+
+    return 0;
+}
+
+struct sql_columnar *sql_columnar_create(struct sql_query *query)
+{
+    int i = 0;
+    struct cfl_list *head;
+    struct sql_key *key;
+    struct sql_columnar *plan;
+
+    plan = flb_calloc(1, sizeof(struct sql_columnar));
+    if (!plan) {
+        flb_errno();
+        return NULL;
+    }
+
+    plan->columns = flb_calloc(SQL_COLUMNS_MAX, sizeof(struct sql_column));
+    if (!plan->columns) {
+        flb_errno();
+        flb_free(plan);
+        return NULL;
+    }
+
+    if (query->condition) {
+        plan->condition = vnode_compile(plan, query->condition);
+        if (!plan->condition) {
+            sql_columnar_destroy(plan);
+            return NULL;
+        }
+    }
+
+    /* a wildcard is always the only key */
+    if (cfl_list_size(&query->keys) > 0) {
+        key = cfl_list_entry_first(&query->keys, struct sql_key, _head);
+        if (key->name == NULL) {
+            plan->wildcard = FLB_TRUE;
+            plan->wildcard_alias = key->alias;
+            return plan;
+        }
+    }
+
+    plan->keys = flb_calloc(cfl_list_size(&query->keys) + 1,
+                            sizeof(struct sql_select_key));
+    if (!plan->keys) {
+        flb_errno();
+        sql_columnar_destroy(plan);
+        return NULL;
+    }
+
+    cfl_list_foreach(head, &query->keys) {
+        key = cfl_list_entry(head, struct sql_key, _head);
+        plan->keys[i].name = key->name;
+        plan->keys[i].name_len = cfl_sds_len(key->name);
+        plan->keys[i].alias = key->alias;
+        i++;
+    }
+    plan->keys_size = i;
+
+    return plan;
+}
+
+void sql_columnar_destroy(struct sql_columnar *plan)
+{
+    vnode_destroy(plan->condition);
+    flb_free(plan->columns);
+    flb_free(plan->keys);
+    flb_free(plan);
+}
@@ -0,0 +1,101 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2024 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_PROCESSOR_SQL_COLUMNAR_H
+#define FLB_PROCESSOR_SQL_COLUMNAR_H
+
+#include <fluent-bit/flb_processor_plugin.h>
+#include <fluent-bit/flb_mp_chunk.h>
+
+#include "sql.h"
+
+/* Records evaluated at once */
+#define SQL_BATCH_SIZE        1024
+
+/* Upper bound of distinct keys referenced by a WHERE condition */
+#define SQL_COLUMNS_MAX       32
+
+/* Column value type, otherwise one of the SQL_EXP_ value types */
+#define SQL_COL_MISSING       0
+
+/*
+ * Values of one record key for the records of a batch, the row type
+ * tells which array holds the value. Strings point to the record data.
+ */
+struct sql_column {
+    cfl_sds_t name;
+    int name_len;
+    int types;                             /* types found in the batch */
+    uint8_t type[SQL_BATCH_SIZE];
+    int64_t i64[SQL_BATCH_SIZE];           /* SQL_EXP_INT and _BOOL   */
+    double f64[SQL_BATCH_SIZE];
+    const char *str[SQL_BATCH_SIZE];
+    int str_len[SQL_BATCH_SIZE];
+};
+
+/* Node types of a compiled condition */
+enum sql_vnode_types {
+    SQL_VNODE_FALSE = 0,                   /* missing operand          */
+    SQL_VNODE_CONST,                       /* truth of a constant      */
+    SQL_VNODE_TRUTH,                       /* truth of a column        */
+    SQL_VNODE_CMP,                         /* column <op> constant     */
+    SQL_VNODE_NOT,
+    SQL_VNODE_AND,
+    SQL_VNODE_OR,
+    SQL_VNODE_PAR
+};
+
+/* A condition node, evaluated as a selection vector over a batch */
+struct sql_vnode {
+    int type;
+    int op;
+    int column;
+    struct sql_expression_val *val;
+    struct sql_vnode *left;
+    struct sql_vnode *right;
+    uint8_t sel[SQL_BATCH_SIZE];
+};
+
+struct sql_select_key {
+    const char *name;
+    int name_len;
+    cfl_sds_t alias;
+};
+
+struct sql_columnar {
+    struct sql_vnode *condition;           /* NULL: every record      */
+
+    int columns_size;
+    struct sql_column *columns;
+
+    /* projection */
+    int wildcard;
+    cfl_sds_t wildcard_alias;
+    int keys_size;
+    struct sql_select_key *keys;
+
+    struct flb_mp_chunk_record *records[SQL_BATCH_SIZE];
+};
+
+struct sql_columnar *sql_columnar_create(struct sql_query *query);
+void sql_columnar_destroy(struct sql_columnar *plan);
+int sql_columnar_process(struct sql_columnar *plan,
+                         struct flb_mp_chunk_cobj *chunk_cobj);
+
+#endif
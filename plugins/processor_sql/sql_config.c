@@ -21,6 +21,7 @@
 #include <fluent-bit/flb_mem.h>
 
 #include "sql.h"
+#include "sql_columnar.h"
 #include "parser/sql_parser.h"
 
 struct sql_ctx *sql_config_create(struct flb_processor_instance *ins,
@@ -57,11 +58,23 @@ struct sql_ctx *sql_config_create(struct flb_processor_instance *ins,
         return NULL;
     }
 
+    if (ctx->columnar) {
+        ctx->columnar_plan = sql_columnar_create(ctx->query);
+        if (!ctx->columnar_plan) {
+            flb_plg_debug(ctx->ins, "query not supported by the columnar "
+                          "executor, records are processed one by one");
+        }
+    }
+
     return ctx;
 }
 
 void sql_config_destroy(struct sql_ctx *ctx)
 {
+    if (ctx->columnar_plan) {
+        sql_columnar_destroy(ctx->columnar_plan);
+    }
+
     if (ctx->query) {
         sql_parser_query_destroy(ctx->query);
     }
@@ -175,6 +175,9 @@ struct flb_service_config service_configs[] = {
     {FLB_CONF_STR_STREAMS_STR_CONV,
      FLB_CONF_TYPE_BOOL,
      offsetof(struct flb_config, stream_processor_str_conv)},
+    {FLB_CONF_STR_STREAMS_WORKERS,
+     FLB_CONF_TYPE_INT,
+     offsetof(struct flb_config, stream_processor_workers)},
 #endif
 
 #ifdef FLB_HAVE_CHUNK_TRACE
@@ -299,6 +302,7 @@ struct flb_config *flb_config_init()
 #ifdef FLB_HAVE_STREAM_PROCESSOR
     flb_slist_create(&config->stream_processor_tasks);
     config->stream_processor_str_conv = FLB_TRUE;
+    config->stream_processor_workers = 0;
 #endif
 
     flb_slist_create(&config->external_plugins);
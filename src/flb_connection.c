@@ -78,6 +78,13 @@ void flb_connection_destroy(struct flb_connection *connection)
 {
     assert(connection != NULL);
 
+    if (connection->protocol_session != NULL &&
+        connection->protocol_session_destroy != NULL) {
+        connection->protocol_session_destroy(connection->protocol_session);
+
+        connection->protocol_session = NULL;
+    }
+
     if (connection->dynamically_allocated) {
         flb_free(connection);
     }
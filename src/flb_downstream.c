@@ -66,6 +66,33 @@ struct flb_config_map downstream_net[] = {
      "Enable or disable Keepalive support"
     },
 
+    {
+     FLB_CONFIG_MAP_INT, "net.udp_batch_size", "32",
+     0, FLB_TRUE, offsetof(struct flb_net_setup, udp_batch_size),
+     "Maximum number of datagrams read from the socket in a single system call"
+    },
+
+    {
+     FLB_CONFIG_MAP_BOOL, "net.udp_gro", "false",
+     0, FLB_TRUE, offsetof(struct flb_net_setup, udp_gro),
+     "Enable UDP generic receive offload (GRO), the kernel coalesces datagrams "
+     "of the same flow so they can be read with fewer system calls"
+    },
+
+    {
+     FLB_CONFIG_MAP_INT, "net.udp_receivers", "1",
+     0, FLB_TRUE, offsetof(struct flb_net_setup, udp_receivers),
+     "Number of sockets bound to the UDP port with SO_REUSEPORT, each extra "
+     "socket is read and encoded by its own thread"
+    },
+
+    {
+     FLB_CONFIG_MAP_INT, "net.accept_workers", "1",
+     0, FLB_TRUE, offsetof(struct flb_net_setup, accept_workers),
+     "Number of listeners bound to the TCP port with SO_REUSEPORT, each extra "
+     "listener accepts and serves its connections in its own thread"
+    },
+
     /* EOF */
     {0}
 };
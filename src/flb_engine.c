@@ -179,6 +179,15 @@ static void cb_engine_sched_timer(struct flb_config *ctx, void *data)
     flb_downstream_conn_timeouts(&ctx->downstreams);
 }
 
+/* Establish warm upstream connections, it runs in a coroutine context */
+static void cb_engine_upstream_warmup(struct flb_config *ctx, void *data)
+{
+    (void) data;
+
+    flb_upstream_conn_warmup(&ctx->upstreams);
+    flb_sched_timer_cb_coro_return();
+}
+
 static inline int handle_input_event(flb_pipefd_t fd, uint64_t ts,
                                      struct flb_config *config)
 {
@@ -285,6 +294,12 @@ static inline int handle_output_event(uint64_t ts,
             flb_output_task_singleplex_flush_next(ins->singleplex_queue);
         }
     }
+    else if (ins->limiter) {
+        /* Adaptive concurrency: feed the result, start waiting tasks */
+        if (ret == FLB_OK || ret == FLB_RETRY || ret == FLB_ERROR) {
+            flb_output_limiter_done(ins, task, ret);
+        }
+    }
 
     /* A task has finished, delete it */
     if (ret == FLB_OK) {
@@ -915,6 +930,18 @@ int flb_engine_start(struct flb_config *config)
         return -1;
     }
 
+    /* Keep the warm upstream connections requested by 'net.warm_connections' */
+    if (flb_upstream_conn_warmup_enabled(&config->upstreams)) {
+        ret = flb_sched_timer_coro_cb_create(config->sched,
+                                             FLB_SCHED_TIMER_CB_PERM,
+                                             1500, cb_engine_upstream_warmup,
+                                             config, NULL);
+        if (ret == -1) {
+            flb_error("[engine] could not schedule upstream warm up callback");
+            return -1;
+        }
+    }
+
     /* DEV/TEST change only */
     int rb_ms;
     char *rb_env;
@@ -1039,6 +1066,10 @@ int flb_engine_start(struct flb_config *config)
                 /* Event type registered by the Scheduler */
                 flb_sched_event_handler(config, event);
             }
+            else if (event->type == FLB_ENGINE_EV_SCHED_CORO) {
+                /* A scheduler timer coroutine returned */
+                flb_sched_event_handler(config, event);
+            }
             else if (event->type == FLB_ENGINE_EV_THREAD_ENGINE) {
                 struct flb_output_flush *output_flush;
 
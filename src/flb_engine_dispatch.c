@@ -87,6 +87,13 @@ int flb_engine_dispatch_retry(struct flb_task_retry *retry,
             return -1;
         }
     }
+    else if (retry->o_ins->limiter) {
+        /* adaptive concurrency: deletes retry context on enqueue failure */
+        ret = flb_output_limiter_enqueue(retry->o_ins, retry, task, config);
+        if (ret == -1) {
+            return -1;
+        }
+    }
     else {
         ret = flb_output_task_flush(task, retry->o_ins, config);
         if (ret == -1) {
@@ -206,6 +213,13 @@ static int tasks_start(struct flb_input_instance *in,
                 flb_output_task_singleplex_enqueue(route->out->singleplex_queue, NULL,
                                                    task, route->out, config);
             }
+            else if (out->limiter) {
+                /*
+                 * Adaptive concurrency: the task starts now or as soon as the
+                 * output has a free slot.
+                 */
+                flb_output_limiter_enqueue(route->out, NULL, task, config);
+            }
             else {
                 /*
                  * We have the Task and the Route, created a thread context for the
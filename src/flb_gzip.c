@@ -241,21 +241,19 @@ int flb_gzip_compress(void *in_data, size_t in_len,
     return 0;
 }
 
-/* Uncompress (inflate) GZip data */
-int flb_gzip_uncompress(void *in_data, size_t in_len,
-                        void **out_data, size_t *out_len)
+/*
+ * Validate the GZip header and trailer, set the beginning of the deflate
+ * stream and the size and CRC32 of the original data.
+ */
+static int gzip_uncompress_prepare(void *in_data, size_t in_len,
+                                   const unsigned char **out_start,
+                                   unsigned int *out_dlen,
+                                   unsigned int *out_crc)
 {
-    int status;
     uint8_t *p;
-    void *out_buf;
-    size_t out_size = 0;
-    void *zip_data;
-    size_t zip_len;
     unsigned char flg;
     unsigned int xlen, hcrc;
     unsigned int dlen, crc;
-    mz_ulong crc_out;
-    mz_stream stream;
     const unsigned char *start;
 
     /* Minimal length: header + crc32 */
@@ -338,7 +336,7 @@ int flb_gzip_uncompress(void *in_data, size_t in_len,
     dlen = read_le32(&p[in_len - 4]);
 
     /* Limit decompressed length to 100MB */
-    if (dlen > 100000000) {
+    if (dlen > FLB_GZIP_MAX_UNCOMPRESSED_SIZE) {
         flb_error("[gzip] maximum decompression size is 100MB");
         return -1;
     }
@@ -352,20 +350,33 @@ int flb_gzip_uncompress(void *in_data, size_t in_len,
         return -1;
     }
 
-    /* Allocate outgoing buffer */
-    out_buf = flb_malloc(dlen);
-    if (!out_buf) {
-        flb_errno();
-        return -1;
-    }
-    out_size = dlen;
-
     /* Ensure size is above 0 */
     if (((p + in_len) - start - 8) <= 0) {
-        flb_free(out_buf);
         return -1;
     }
 
+    *out_start = start;
+    *out_dlen = dlen;
+    *out_crc = crc;
+
+    return 0;
+}
+
+/* Inflate the deflate stream of a GZip payload into 'out_buf' */
+static int gzip_uncompress_inflate(void *in_data, size_t in_len,
+                                   const unsigned char *start,
+                                   unsigned int dlen, unsigned int crc,
+                                   void *out_buf)
+{
+    int status;
+    uint8_t *p;
+    void *zip_data;
+    size_t zip_len;
+    mz_ulong crc_out;
+    mz_stream stream;
+
+    p = in_data;
+
     /* Map zip content */
     zip_data = (uint8_t *) start;
     zip_len = (p + in_len) - start - 8;
@@ -374,24 +385,21 @@ int flb_gzip_uncompress(void *in_data, size_t in_len,
     stream.next_in = zip_data;
     stream.avail_in = zip_len;
     stream.next_out = out_buf;
-    stream.avail_out = out_size;
+    stream.avail_out = dlen;
 
     status = mz_inflateInit2(&stream, -Z_DEFAULT_WINDOW_BITS);
     if (status != MZ_OK) {
-        flb_free(out_buf);
         return -1;
     }
 
     status = mz_inflate(&stream, MZ_FINISH);
     if (status != MZ_STREAM_END) {
         mz_inflateEnd(&stream);
-        flb_free(out_buf);
         return -1;
     }
 
     if (stream.total_out != dlen) {
         mz_inflateEnd(&stream);
-        flb_free(out_buf);
         flb_error("[gzip] invalid gzip data size");
         return -1;
     }
@@ -402,11 +410,41 @@ int flb_gzip_uncompress(void *in_data, size_t in_len,
     /* Validate message CRC vs inflated data CRC */
     crc_out = mz_crc32(MZ_CRC32_INIT, out_buf, dlen);
     if (crc_out != crc) {
-        flb_free(out_buf);
         flb_error("[gzip] invalid GZip checksum (CRC32)");
         return -1;
     }
 
+    return 0;
+}
+
+/* Uncompress (inflate) GZip data */
+int flb_gzip_uncompress(void *in_data, size_t in_len,
+                        void **out_data, size_t *out_len)
+{
+    int ret;
+    void *out_buf;
+    unsigned int dlen;
+    unsigned int crc;
+    const unsigned char *start;
+
+    ret = gzip_uncompress_prepare(in_data, in_len, &start, &dlen, &crc);
+    if (ret != 0) {
+        return -1;
+    }
+
+    /* Allocate outgoing buffer */
+    out_buf = flb_malloc(dlen);
+    if (!out_buf) {
+        flb_errno();
+        return -1;
+    }
+
+    ret = gzip_uncompress_inflate(in_data, in_len, start, dlen, crc, out_buf);
+    if (ret != 0) {
+        flb_free(out_buf);
+        return -1;
+    }
+
     /* set the uncompressed data */
     *out_len = dlen;
     *out_data = out_buf;
@@ -414,6 +452,59 @@ int flb_gzip_uncompress(void *in_data, size_t in_len,
     return 0;
 }
 
+/*
+ * Size of the original data as stated by the GZip trailer, it returns zero
+ * if the payload cannot be a GZip member or it's above the decompression
+ * limit. The value is validated once the data is inflated.
+ */
+size_t flb_gzip_uncompressed_size(void *in_data, size_t in_len)
+{
+    size_t dlen;
+
+    if (in_len < 18) {
+        return 0;
+    }
+
+    dlen = read_le32((uint8_t *) in_data + in_len - 4);
+    if (dlen > FLB_GZIP_MAX_UNCOMPRESSED_SIZE) {
+        return 0;
+    }
+
+    return dlen;
+}
+
+/*
+ * Uncompress (inflate) GZip data into a buffer owned by the caller, it must
+ * have room for flb_gzip_uncompressed_size() bytes.
+ */
+int flb_gzip_uncompress_to(void *in_data, size_t in_len,
+                           void *out_buf, size_t out_size, size_t *out_len)
+{
+    int ret;
+    unsigned int dlen;
+    unsigned int crc;
+    const unsigned char *start;
+
+    ret = gzip_uncompress_prepare(in_data, in_len, &start, &dlen, &crc);
+    if (ret != 0) {
+        return -1;
+    }
+
+    if (dlen > out_size) {
+        flb_error("[gzip] output buffer too small (%zu < %u)", out_size, dlen);
+        return -1;
+    }
+
+    ret = gzip_uncompress_inflate(in_data, in_len, start, dlen, crc, out_buf);
+    if (ret != 0) {
+        return -1;
+    }
+
+    *out_len = dlen;
+
+    return 0;
+}
+
 
 /* Stateful gzip decompressor */
 
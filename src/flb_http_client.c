@@ -39,6 +39,7 @@
 #include <fluent-bit/flb_mem.h>
 #include <fluent-bit/flb_http_client.h>
 #include <fluent-bit/flb_http_client_debug.h>
+#include <fluent-bit/flb_http_client_http2.h>
 #include <fluent-bit/flb_utils.h>
 #include <fluent-bit/flb_base64.h>
 
@@ -1332,8 +1333,12 @@ int flb_http_get_response_data(struct flb_http_client *c, size_t bytes_consumed)
             }
         }
 
-        /* Always append a NULL byte */
-        if (r_bytes >= 0) {
+        /*
+         * Always append a NULL byte. A synchronous read returns zero when the
+         * peer closed the connection before a full response: that is a broken
+         * connection, not an empty read to retry.
+         */
+        if (r_bytes > 0) {
             c->resp.data_len += r_bytes;
             c->resp.data[c->resp.data_len] = '\0';
 
@@ -1362,6 +1367,12 @@ int flb_http_do(struct flb_http_client *c, size_t *bytes)
 {
     int ret;
 
+    /* HTTP/2 upstreams multiplex the request over a shared connection */
+    if (flb_stream_is_http2(&c->u_conn->upstream->base) &&
+        flb_http2_client_negotiated(c->u_conn)) {
+        return flb_http2_client_do(c, bytes);
+    }
+
     ret = flb_http_do_request(c, bytes);
     if (ret != 0) {
         return ret;
@@ -0,0 +1,833 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2024 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/*
+ * HTTP/2 transport for the HTTP client: requests composed with the regular
+ * flb_http_client() interface are sent as HTTP/2 streams when the upstream
+ * has the FLB_IO_HTTP2 flag. Several flush coroutines can multiplex their
+ * requests over the same upstream connection; the response is exposed
+ * through the same 'c->resp' fields used by HTTP/1.x so callers don't need
+ * to care about the protocol in use.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_kv.h>
+#include <fluent-bit/flb_io.h>
+#include <fluent-bit/flb_coro.h>
+#include <fluent-bit/flb_upstream.h>
+#include <fluent-bit/flb_connection.h>
+#include <fluent-bit/flb_http_client.h>
+#include <fluent-bit/flb_http_client_http2.h>
+#include <fluent-bit/tls/flb_tls.h>
+
+#include <ctype.h>
+
+static void http2_session_fail(struct flb_http2_client_session *session,
+                               const char *reason)
+{
+    struct flb_connection *connection;
+
+    connection = session->connection;
+
+    if (session->failed == FLB_FALSE) {
+        flb_error("[http2_client] connection #%i to %s:%i failed: %s",
+                  connection->fd,
+                  connection->upstream->tcp_host,
+                  connection->upstream->tcp_port,
+                  reason);
+    }
+
+    session->failed = FLB_TRUE;
+
+    /* no more streams over this connection */
+    connection->stream_limit = 0;
+    flb_upstream_conn_recycle(connection, FLB_FALSE);
+}
+
+static void http2_session_limit_update(struct flb_http2_client_session *session)
+{
+    uint32_t limit;
+
+    if (session->failed) {
+        return;
+    }
+
+    limit = nghttp2_session_get_remote_settings(session->inner_session,
+                                      NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS);
+    if (limit > FLB_HTTP2_CLIENT_MAX_STREAMS) {
+        limit = FLB_HTTP2_CLIENT_MAX_STREAMS;
+    }
+
+    session->connection->stream_limit = limit;
+}
+
+static int http2_response_append(struct flb_http_client *c,
+                                 const char *buf, size_t len)
+{
+    char *tmp;
+    size_t size;
+
+    if (c->resp.data_len + len + 1 > c->resp.data_size) {
+        size = c->resp.data_len + len + 1 + FLB_HTTP_DATA_CHUNK;
+
+        if (c->resp.data_size_max != 0 && size > c->resp.data_size_max) {
+            if (c->resp.data_len + len + 1 > c->resp.data_size_max) {
+                flb_warn("[http2_client] cannot increase buffer: current=%zu "
+                         "requested=%zu max=%zu", c->resp.data_size,
+                         c->resp.data_len + len + 1, c->resp.data_size_max);
+                return -1;
+            }
+            size = c->resp.data_size_max;
+        }
+
+        tmp = flb_realloc(c->resp.data, size);
+        if (!tmp) {
+            flb_errno();
+            return -1;
+        }
+        c->resp.data = tmp;
+        c->resp.data_size = size;
+    }
+
+    memcpy(c->resp.data + c->resp.data_len, buf, len);
+    c->resp.data_len += len;
+    c->resp.data[c->resp.data_len] = '\0';
+
+    return 0;
+}
+
+static struct flb_http2_client_stream *http2_stream_get(nghttp2_session *inner,
+                                                        int32_t stream_id)
+{
+    struct flb_http2_client_stream *stream;
+
+    stream = nghttp2_session_get_stream_user_data(inner, stream_id);
+    if (!stream || stream->error) {
+        return NULL;
+    }
+
+    return stream;
+}
+
+static void http2_stream_abort(nghttp2_session *inner,
+                               struct flb_http2_client_stream *stream)
+{
+    stream->error = FLB_TRUE;
+    nghttp2_submit_rst_stream(inner, NGHTTP2_FLAG_NONE,
+                              stream->id, NGHTTP2_CANCEL);
+}
+
+/* nghttp2 callbacks */
+static ssize_t http2_send_callback(nghttp2_session *inner,
+                                   const uint8_t *data, size_t length,
+                                   int flags, void *user_data)
+{
+    int ret;
+    struct flb_http2_client_session *session;
+
+    session = (struct flb_http2_client_session *) user_data;
+
+    ret = flb_sds_cat_safe(&session->outgoing, (const char *) data, length);
+    if (ret == -1) {
+        return NGHTTP2_ERR_CALLBACK_FAILURE;
+    }
+
+    return length;
+}
+
+static int http2_header_callback(nghttp2_session *inner,
+                                 const nghttp2_frame *frame,
+                                 const uint8_t *name, size_t namelen,
+                                 const uint8_t *value, size_t valuelen,
+                                 uint8_t flags, void *user_data)
+{
+    int len;
+    int ret;
+    char tmp[32];
+    struct flb_http_client *c;
+    struct flb_http2_client_stream *stream;
+
+    if (frame->hd.type != NGHTTP2_HEADERS) {
+        return 0;
+    }
+
+    stream = http2_stream_get(inner, frame->hd.stream_id);
+    if (!stream || stream->headers_end > 0) {
+        /* unknown stream or trailers */
+        return 0;
+    }
+    c = stream->client;
+
+    if (namelen == 7 && strncmp((const char *) name, ":status", 7) == 0) {
+        len = valuelen < sizeof(tmp) - 1 ? valuelen : sizeof(tmp) - 1;
+        memcpy(tmp, value, len);
+        tmp[len] = '\0';
+        c->resp.status = atoi(tmp);
+
+        /* informational responses (1xx) are discarded */
+        c->resp.data_len = 0;
+        len = snprintf(tmp, sizeof(tmp) - 1, "HTTP/2.0 %i\r\n", c->resp.status);
+        ret = http2_response_append(c, tmp, len);
+    }
+    else {
+        ret = http2_response_append(c, (const char *) name, namelen);
+        if (ret == 0) {
+            ret = http2_response_append(c, ": ", 2);
+        }
+        if (ret == 0) {
+            ret = http2_response_append(c, (const char *) value, valuelen);
+        }
+        if (ret == 0) {
+            ret = http2_response_append(c, "\r\n", 2);
+        }
+    }
+
+    if (ret == -1) {
+        http2_stream_abort(inner, stream);
+    }
+
+    return 0;
+}
+
+static int http2_frame_recv_callback(nghttp2_session *inner,
+                                     const nghttp2_frame *frame,
+                                     void *user_data)
+{
+    int ret;
+    struct flb_http_client *c;
+    struct flb_http2_client_stream *stream;
+    struct flb_http2_client_session *session;
+
+    session = (struct flb_http2_client_session *) user_data;
+
+    if (frame->hd.type == NGHTTP2_GOAWAY) {
+        /* streams in flight complete normally, new ones go elsewhere */
+        session->connection->stream_limit = 0;
+        flb_upstream_conn_recycle(session->connection, FLB_FALSE);
+        return 0;
+    }
+
+    if (frame->hd.type != NGHTTP2_HEADERS ||
+        (frame->hd.flags & NGHTTP2_FLAG_END_HEADERS) == 0) {
+        return 0;
+    }
+
+    stream = http2_stream_get(inner, frame->hd.stream_id);
+    if (!stream || stream->headers_end > 0) {
+        return 0;
+    }
+    c = stream->client;
+
+    if (c->resp.status < 200) {
+        return 0;
+    }
+
+    ret = http2_response_append(c, "\r\n", 2);
+    if (ret == -1) {
+        http2_stream_abort(inner, stream);
+        return 0;
+    }
+    stream->headers_end = c->resp.data_len;
+
+    return 0;
+}
+
+static int http2_data_chunk_recv_callback(nghttp2_session *inner,
+                                          uint8_t flags, int32_t stream_id,
+                                          const uint8_t *data, size_t len,
+                                          void *user_data)
+{
+    int ret;
+    struct flb_http2_client_stream *stream;
+
+    stream = http2_stream_get(inner, stream_id);
+    if (!stream) {
+        return 0;
+    }
+
+    ret = http2_response_append(stream->client, (const char *) data, len);
+    if (ret == -1) {
+        http2_stream_abort(inner, stream);
+    }
+
+    return 0;
+}
+
+static int http2_stream_close_callback(nghttp2_session *inner,
+                                       int32_t stream_id,
+                                       uint32_t error_code,
+                                       void *user_data)
+{
+    struct flb_http2_client_stream *stream;
+
+    stream = nghttp2_session_get_stream_user_data(inner, stream_id);
+    if (!stream) {
+        return 0;
+    }
+
+    if (error_code != NGHTTP2_NO_ERROR) {
+        flb_debug("[http2_client] stream %i closed: %s",
+                  stream_id, nghttp2_http2_strerror(error_code));
+        stream->error = FLB_TRUE;
+    }
+    stream->done = FLB_TRUE;
+
+    return 0;
+}
+
+static ssize_t http2_data_source_read_callback(nghttp2_session *inner,
+                                               int32_t stream_id,
+                                               uint8_t *buf, size_t length,
+                                               uint32_t *data_flags,
+                                               nghttp2_data_source *source,
+                                               void *user_data)
+{
+    size_t size;
+    struct flb_http_client *c;
+    struct flb_http2_client_stream *stream;
+
+    stream = (struct flb_http2_client_stream *) source->ptr;
+    c = stream->client;
+
+    size = c->body_len - stream->body_offset;
+    if (size > length) {
+        size = length;
+    }
+
+    memcpy(buf, c->body_buf + stream->body_offset, size);
+    stream->body_offset += size;
+
+    if (stream->body_offset >= c->body_len) {
+        *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+    }
+
+    return size;
+}
+
+static void http2_session_destroy(void *data)
+{
+    struct flb_http2_client_session *session;
+
+    session = (struct flb_http2_client_session *) data;
+
+    if (session->inner_session) {
+        nghttp2_session_del(session->inner_session);
+    }
+    if (session->outgoing) {
+        flb_sds_destroy(session->outgoing);
+    }
+    if (session->sending) {
+        flb_sds_destroy(session->sending);
+    }
+    flb_free(session);
+}
+
+static struct flb_http2_client_session *http2_session_get(
+                                        struct flb_connection *connection)
+{
+    int ret;
+    nghttp2_settings_entry settings[1];
+    nghttp2_session_callbacks *callbacks;
+    struct flb_http2_client_session *session;
+
+    if (connection->protocol_session) {
+        return connection->protocol_session;
+    }
+
+    session = flb_calloc(1, sizeof(struct flb_http2_client_session));
+    if (!session) {
+        flb_errno();
+        return NULL;
+    }
+    session->connection = connection;
+    mk_list_init(&session->streams);
+
+    session->outgoing = flb_sds_create_size(FLB_HTTP2_CLIENT_READ_SIZE);
+    session->sending = flb_sds_create_size(FLB_HTTP2_CLIENT_READ_SIZE);
+    if (!session->outgoing || !session->sending) {
+        http2_session_destroy(session);
+        return NULL;
+    }
+
+    ret = nghttp2_session_callbacks_new(&callbacks);
+    if (ret != 0) {
+        http2_session_destroy(session);
+        return NULL;
+    }
+
+    nghttp2_session_callbacks_set_send_callback(callbacks,
+                                                http2_send_callback);
+    nghttp2_session_callbacks_set_on_header_callback(callbacks,
+                                                     http2_header_callback);
+    nghttp2_session_callbacks_set_on_frame_recv_callback(callbacks,
+                                                  http2_frame_recv_callback);
+    nghttp2_session_callbacks_set_on_data_chunk_recv_callback(callbacks,
+                                             http2_data_chunk_recv_callback);
+    nghttp2_session_callbacks_set_on_stream_close_callback(callbacks,
+                                                http2_stream_close_callback);
+
+    ret = nghttp2_session_client_new(&session->inner_session,
+                                     callbacks, session);
+    nghttp2_session_callbacks_del(callbacks);
+
+    if (ret != 0) {
+        session->inner_session = NULL;
+        http2_session_destroy(session);
+        return NULL;
+    }
+
+    /* we never accept server push */
+    settings[0].settings_id = NGHTTP2_SETTINGS_ENABLE_PUSH;
+    settings[0].value = 0;
+
+    ret = nghttp2_submit_settings(session->inner_session, NGHTTP2_FLAG_NONE,
+                                  settings, 1);
+    if (ret != 0) {
+        http2_session_destroy(session);
+        return NULL;
+    }
+
+    connection->protocol_session = session;
+    connection->protocol_session_destroy = http2_session_destroy;
+
+    http2_session_limit_update(session);
+
+    return session;
+}
+
+/* Resume a waiting stream coroutine, then get back to the current one */
+static void http2_stream_resume(struct flb_http2_client_stream *stream)
+{
+    struct flb_coro *self;
+
+    self = flb_coro_get();
+
+    stream->waiting = FLB_FALSE;
+    flb_coro_resume(stream->coro);
+
+    flb_coro_set(self);
+}
+
+/*
+ * Resume every waiting stream that completed (or every waiting stream if the
+ * session failed). If 'handoff' is set and nobody is doing I/O, the first
+ * pending stream is resumed too so it takes over the socket.
+ */
+static void http2_session_wake(struct flb_http2_client_session *session,
+                               int handoff)
+{
+    struct mk_list *head;
+    struct flb_http2_client_stream *stream;
+    struct flb_http2_client_stream *next;
+
+again:
+    next = NULL;
+
+    mk_list_foreach(head, &session->streams) {
+        stream = mk_list_entry(head, struct flb_http2_client_stream, _head);
+        if (stream->waiting == FLB_FALSE) {
+            continue;
+        }
+
+        if (stream->done || session->failed) {
+            /* the resumed coroutine unlinks its stream: restart */
+            http2_stream_resume(stream);
+            goto again;
+        }
+
+        if (next == NULL) {
+            next = stream;
+        }
+    }
+
+    if (handoff && next != NULL &&
+        session->reading == FLB_FALSE && session->writing == FLB_FALSE) {
+        http2_stream_resume(next);
+    }
+}
+
+/*
+ * Serialize the pending frames and write them. Frames queued by other
+ * coroutines while this one waits for the socket are picked up by the
+ * same loop.
+ */
+static int http2_session_flush(struct flb_http2_client_session *session)
+{
+    int ret;
+    size_t sent;
+    flb_sds_t data;
+    struct flb_connection *connection;
+
+    connection = session->connection;
+
+    session->writing = FLB_TRUE;
+    ret = 0;
+
+    while (session->failed == FLB_FALSE) {
+        ret = nghttp2_session_send(session->inner_session);
+        if (ret != 0) {
+            http2_session_fail(session, nghttp2_strerror(ret));
+            ret = -1;
+            break;
+        }
+
+        if (flb_sds_len(session->outgoing) == 0) {
+            break;
+        }
+
+        data = session->outgoing;
+        session->outgoing = session->sending;
+        session->sending = data;
+
+        ret = flb_io_net_write(connection, data, flb_sds_len(data), &sent);
+        flb_sds_len_set(data, 0);
+
+        /*
+         * If the write had to wait, the I/O layer released the connection
+         * event: hand it back to the coroutine waiting for incoming data.
+         */
+        if (session->reading) {
+            connection->coroutine = session->reader;
+        }
+
+        if (ret == -1) {
+            http2_session_fail(session, "write error");
+            break;
+        }
+        ret = 0;
+    }
+
+    session->writing = FLB_FALSE;
+
+    return ret;
+}
+
+static int http2_session_read(struct flb_http2_client_session *session)
+{
+    ssize_t ret;
+    ssize_t bytes;
+
+    session->reading = FLB_TRUE;
+    session->reader = flb_coro_get();
+
+    bytes = flb_io_net_read(session->connection,
+                            session->read_buf, sizeof(session->read_buf));
+
+    session->reading = FLB_FALSE;
+    session->reader = NULL;
+
+    if (bytes <= 0) {
+        http2_session_fail(session, "connection closed");
+        return -1;
+    }
+
+    ret = nghttp2_session_mem_recv(session->inner_session,
+                                   (const uint8_t *) session->read_buf, bytes);
+    if (ret < 0) {
+        http2_session_fail(session, nghttp2_strerror(ret));
+        return -1;
+    }
+
+    http2_session_limit_update(session);
+
+    /* let streams completed by this read return to their callers */
+    http2_session_wake(session, FLB_FALSE);
+
+    return 0;
+}
+
+static int http2_stream_submit(struct flb_http2_client_session *session,
+                               struct flb_http2_client_stream *stream)
+{
+    int i;
+    int ret;
+    int count;
+    size_t names_size;
+    char *method;
+    char *names;
+    char *p;
+    nghttp2_nv *nva;
+    nghttp2_data_provider provider;
+    struct mk_list *head;
+    struct flb_kv *kv;
+    struct flb_http_client *c;
+
+    c = stream->client;
+
+    switch (c->method) {
+    case FLB_HTTP_GET:
+        method = "GET";
+        break;
+    case FLB_HTTP_POST:
+        method = "POST";
+        break;
+    case FLB_HTTP_PUT:
+        method = "PUT";
+        break;
+    case FLB_HTTP_DELETE:
+        method = "DELETE";
+        break;
+    case FLB_HTTP_HEAD:
+        method = "HEAD";
+        break;
+    case FLB_HTTP_PATCH:
+        method = "PATCH";
+        break;
+    default:
+        flb_error("[http2_client] unsupported request method");
+        return -1;
+    };
+
+    /* HTTP/2 header names are lowercase: keep a lowercase copy of them */
+    count = mk_list_size(&c->headers) + 4;
+    names_size = 0;
+    mk_list_foreach(head, &c->headers) {
+        kv = mk_list_entry(head, struct flb_kv, _head);
+        names_size += flb_sds_len(kv->key);
+    }
+
+    nva = flb_calloc(count, sizeof(nghttp2_nv));
+    if (!nva) {
+        flb_errno();
+        return -1;
+    }
+
+    names = flb_malloc(names_size + 1);
+    if (!names) {
+        flb_errno();
+        flb_free(nva);
+        return -1;
+    }
+
+#define HTTP2_NV(n, nlen, v, vlen)                                      \
+    nva[i].name = (uint8_t *) (n);                                      \
+    nva[i].namelen = (nlen);                                            \
+    nva[i].value = (uint8_t *) (v);                                     \
+    nva[i].valuelen = (vlen);                                           \
+    nva[i].flags = NGHTTP2_NV_FLAG_NONE;                                \
+    i++;
+
+    i = 0;
+    HTTP2_NV(":method", 7, method, strlen(method));
+    if (flb_stream_is_secure(&c->u_conn->upstream->base)) {
+        HTTP2_NV(":scheme", 7, "https", 5);
+    }
+    else {
+        HTTP2_NV(":scheme", 7, "http", 4);
+    }
+    HTTP2_NV(":path", 5, c->uri, strlen(c->uri));
+
+    p = names;
+    mk_list_foreach(head, &c->headers) {
+        kv = mk_list_entry(head, struct flb_kv, _head);
+
+        if (flb_sds_casecmp(kv->key, "Host", 4) == 0) {
+            HTTP2_NV(":authority", 10, kv->val, flb_sds_len(kv->val));
+            continue;
+        }
+
+        /* connection specific headers are not allowed in HTTP/2 */
+        if (flb_sds_casecmp(kv->key, "Connection", 10) == 0 ||
+            flb_sds_casecmp(kv->key, "Keep-Alive", 10) == 0 ||
+            flb_sds_casecmp(kv->key, "Proxy-Connection", 16) == 0 ||
+            flb_sds_casecmp(kv->key, "Transfer-Encoding", 17) == 0 ||
+            flb_sds_casecmp(kv->key, "Upgrade", 7) == 0) {
+            continue;
+        }
+
+        for (ret = 0; ret < flb_sds_len(kv->key); ret++) {
+            p[ret] = tolower((unsigned char) kv->key[ret]);
+        }
+        HTTP2_NV(p, flb_sds_len(kv->key), kv->val, flb_sds_len(kv->val));
+        p += flb_sds_len(kv->key);
+    }
+
+#undef HTTP2_NV
+
+    provider.source.ptr = stream;
+    provider.read_callback = http2_data_source_read_callback;
+
+    ret = nghttp2_submit_request(session->inner_session, NULL, nva, i,
+                                 c->body_len > 0 ? &provider : NULL,
+                                 stream);
+    flb_free(names);
+    flb_free(nva);
+
+    if (ret < 0) {
+        flb_error("[http2_client] cannot submit request: %s",
+                  nghttp2_strerror(ret));
+        return -1;
+    }
+    stream->id = ret;
+
+    return 0;
+}
+
+/*
+ * Drive the session until the stream completes: write pending frames and
+ * read responses if no other coroutine is doing it already, otherwise wait
+ * to be resumed by the coroutine owning the socket.
+ */
+static void http2_stream_wait(struct flb_http2_client_session *session,
+                              struct flb_http2_client_stream *stream)
+{
+    while (stream->done == FLB_FALSE && session->failed == FLB_FALSE) {
+        if (session->writing == FLB_FALSE) {
+            http2_session_flush(session);
+            if (stream->done || session->failed) {
+                break;
+            }
+        }
+
+        if (session->reading == FLB_FALSE && session->writing == FLB_FALSE) {
+            http2_session_read(session);
+            continue;
+        }
+
+        if (stream->coro == NULL) {
+            /* synchronous caller, cannot wait on other coroutines */
+            http2_session_fail(session, "concurrent use of synchronous session");
+            break;
+        }
+
+        stream->waiting = FLB_TRUE;
+        flb_coro_yield(stream->coro, FLB_FALSE);
+        stream->waiting = FLB_FALSE;
+    }
+}
+
+int flb_http2_client_do(struct flb_http_client *c, size_t *bytes)
+{
+    int ret;
+    struct flb_http2_client_stream stream;
+    struct flb_http2_client_session *session;
+
+    session = http2_session_get(c->u_conn);
+    if (!session) {
+        flb_error("[http2_client] cannot create session");
+        return FLB_HTTP_ERROR;
+    }
+
+    if (session->failed) {
+        return FLB_HTTP_ERROR;
+    }
+
+    memset(&stream, 0, sizeof(stream));
+    stream.coro = flb_coro_get();
+    stream.client = c;
+
+    c->resp.status = 0;
+    c->resp.data_len = 0;
+    c->resp.data[0] = '\0';
+
+    ret = http2_stream_submit(session, &stream);
+    if (ret == -1) {
+        return FLB_HTTP_ERROR;
+    }
+
+    mk_list_add(&stream._head, &session->streams);
+    http2_stream_wait(session, &stream);
+    mk_list_del(&stream._head);
+
+    if (stream.done == FLB_FALSE) {
+        /* the stream outlives this call, detach it from the context */
+        nghttp2_session_set_stream_user_data(session->inner_session,
+                                             stream.id, NULL);
+    }
+
+    /* give the socket to the next waiting stream, if any */
+    http2_session_wake(session, FLB_TRUE);
+
+    if (stream.done == FLB_FALSE || stream.error || stream.headers_end == 0) {
+        flb_debug("[http2_client] request on stream %i to %s:%i failed",
+                  stream.id, c->u_conn->upstream->tcp_host,
+                  c->u_conn->upstream->tcp_port);
+        return FLB_HTTP_ERROR;
+    }
+
+    c->resp.headers_end = c->resp.data + stream.headers_end;
+    c->resp.payload = c->resp.headers_end;
+    c->resp.payload_size = c->resp.data_len - stream.headers_end;
+    c->resp.content_length = c->resp.payload_size;
+    c->resp.connection_close = FLB_FALSE;
+
+    *bytes = c->body_len;
+
+    return 0;
+}
+
+/*
+ * Check if a connection speaks HTTP/2: TLS connections must have negotiated
+ * 'h2' through ALPN, otherwise the request goes out as HTTP/1.1.
+ */
+int flb_http2_client_negotiated(struct flb_connection *connection)
+{
+    if (connection->protocol_session) {
+        return FLB_TRUE;
+    }
+
+#ifdef FLB_HAVE_TLS
+    if (connection->tls_session &&
+        flb_tls_session_alpn_match(connection->tls_session, "h2") == FLB_FALSE) {
+        flb_debug("[http2_client] connection #%i to %s:%i did not negotiate "
+                  "'h2', using HTTP/1.1",
+                  connection->fd,
+                  connection->upstream->tcp_host,
+                  connection->upstream->tcp_port);
+        return FLB_FALSE;
+    }
+#endif
+
+    return FLB_TRUE;
+}
+
+/*
+ * Enable HTTP/2 for an upstream: TLS connections negotiate 'h2' through
+ * ALPN, plain text connections use prior knowledge (h2c). 'proxy' is the
+ * proxy configured by the plugin, if any.
+ */
+int flb_http2_client_upstream_setup(struct flb_upstream *u, struct flb_tls *tls,
+                                    const char *proxy)
+{
+    int ret;
+
+    if (proxy || u->proxied_host) {
+        flb_warn("[http2_client] HTTP/2 is not supported through a proxy, "
+                 "using HTTP/1.1");
+        return -1;
+    }
+
+#ifdef FLB_HAVE_TLS
+    if (tls) {
+        ret = flb_tls_set_alpn(tls, "h2,http/1.1");
+        if (ret != 0) {
+            flb_error("[http2_client] cannot set ALPN protocol");
+            return -1;
+        }
+    }
+#else
+    (void) ret;
+#endif
+
+    flb_stream_enable_http2(&u->base);
+
+    return 0;
+}
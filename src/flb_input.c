@@ -285,6 +285,8 @@ struct flb_input_instance *flb_input_new(struct flb_config *config,
             }
         }
 
+        pthread_mutex_init(&instance->rb_lock, NULL);
+
 /* initialize lock for access to chunk trace context. */
 #ifdef FLB_HAVE_CHUNK_TRACE
         pthread_mutex_init(&instance->chunk_trace_lock, &attr);
@@ -624,6 +626,14 @@ int flb_input_set_property(struct flb_input_instance *ins,
         }
         ins->storage_pause_on_chunks_overlimit = ret;
     }
+    else if (prop_key_check("metrics.delta", k, len) == 0 && tmp) {
+        ret = flb_utils_bool(tmp);
+        flb_sds_destroy(tmp);
+        if (ret == -1) {
+            return -1;
+        }
+        ins->metrics_delta = ret;
+    }
     else {
         /*
          * Create the property, we don't pass the value since we will
@@ -803,6 +813,7 @@ void flb_input_instance_destroy(struct flb_input_instance *ins)
         flb_input_chunk_ring_buffer_cleanup(ins);
         flb_ring_buffer_destroy(ins->rb);
     }
+    pthread_mutex_destroy(&ins->rb_lock);
 
     /* processor */
     if (ins->processor) {
@@ -2025,6 +2036,33 @@ int flb_input_downstream_set(struct flb_downstream *stream,
     return 0;
 }
 
+/*
+ * Let other threads than the instance one append records: they go through
+ * the ring buffer, which is drained by the engine event loop.
+ */
+int flb_input_ring_buffer_share(struct flb_input_instance *ins)
+{
+    int ret;
+
+    if (ins->rb_shared) {
+        return 0;
+    }
+
+    /* threaded instances registered their ring buffer already */
+    if (!flb_input_is_threaded(ins) && ins->rb->event_loop == NULL) {
+        ret = flb_ring_buffer_add_event_loop(ins->rb, ins->config->evl,
+                                             FLB_INPUT_RING_BUFFER_WINDOW);
+        if (ret != 0) {
+            flb_error("failed while registering ring buffer events on input %s",
+                      ins->name);
+            return -1;
+        }
+    }
+
+    ins->rb_shared = FLB_TRUE;
+    return 0;
+}
+
 int flb_input_handle_notification(struct flb_input_instance *ins)
 {
     return 0;
@@ -32,12 +32,16 @@
 #include <fluent-bit/flb_time.h>
 #include <fluent-bit/flb_router.h>
 #include <fluent-bit/flb_task.h>
+#include <fluent-bit/flb_engine.h>
 #include <fluent-bit/flb_routes_mask.h>
 #include <fluent-bit/flb_metrics.h>
 #include <fluent-bit/stream_processor/flb_sp.h>
 #include <fluent-bit/flb_ring_buffer.h>
 #include <chunkio/chunkio.h>
 #include <monkey/mk_core.h>
+#include <cmetrics/cmetrics.h>
+#include <cmetrics/cmt_encode_msgpack.h>
+#include <cmetrics/cmt_decode_msgpack.h>
 
 
 #ifdef FLB_HAVE_CHUNK_TRACE
@@ -991,6 +995,10 @@ int flb_input_chunk_destroy_corrupted(struct flb_input_chunk *ic,
     }
 #endif /* FLB_HAVE_CHUNK_TRACE */
 
+    if (ic->metrics_base) {
+        cmt_destroy(ic->metrics_base);
+    }
+
     cio_chunk_close(ic->chunk, del);
     mk_list_del(&ic->_head);
     flb_free(ic);
@@ -1441,6 +1449,109 @@ static int memrb_input_chunk_release_space(struct flb_input_instance *ins,
 }
 
 /* Append a RAW MessagPack buffer to the input instance */
+/*
+ * metrics.delta: encode the metrics contexts in 'buf' as deltas over the state
+ * described by the chunk content. The first context of a chunk is always a
+ * full one so every chunk can be decoded on its own; a context is kept as is
+ * when its delta is not smaller. On error the caller writes 'buf' unchanged.
+ */
+static int input_chunk_metrics_delta(struct flb_input_chunk *ic,
+                                     const void *buf, size_t buf_size,
+                                     void **out_buf, size_t *out_size)
+{
+    int ret;
+    int delta = FLB_FALSE;
+    char *c_data;
+    size_t c_size;
+    size_t offset;
+    size_t start;
+    size_t mp_offset;
+    char *mp_buf;
+    size_t mp_size;
+    struct cmt *cmt;
+    struct cmt *base;
+    msgpack_sbuffer mp_sbuf;
+
+    base = ic->metrics_base;
+    ic->metrics_base = NULL;
+
+    if (!base) {
+        ret = cio_chunk_get_content(ic->chunk, &c_data, &c_size);
+        if (ret == -1) {
+            return -1;
+        }
+
+        offset = 0;
+        do {
+            ret = cmt_decode_msgpack_delta_apply(&base, c_data, c_size,
+                                                 &offset, NULL);
+        } while (ret == CMT_DECODE_MSGPACK_SUCCESS);
+
+        if (ret != CMT_DECODE_MSGPACK_INSUFFICIENT_DATA || !base) {
+            if (base) {
+                cmt_destroy(base);
+            }
+            return -1;
+        }
+    }
+
+    msgpack_sbuffer_init(&mp_sbuf);
+
+    offset = 0;
+    start = 0;
+    while ((ret = cmt_decode_msgpack_create(&cmt, (char *) buf, buf_size,
+                                            &offset)) ==
+           CMT_DECODE_MSGPACK_SUCCESS) {
+        ret = cmt_encode_msgpack_delta_create(cmt, base, &mp_buf, &mp_size);
+        if (ret != 0) {
+            cmt_destroy(cmt);
+            break;
+        }
+
+        if (mp_size < offset - start) {
+            /* keep the base exactly as readers will rebuild it */
+            mp_offset = 0;
+            ret = cmt_decode_msgpack_delta_apply(&base, mp_buf, mp_size,
+                                                 &mp_offset, NULL);
+            if (ret == CMT_DECODE_MSGPACK_SUCCESS) {
+                msgpack_sbuffer_write(&mp_sbuf, mp_buf, mp_size);
+                delta = FLB_TRUE;
+            }
+            cmt_destroy(cmt);
+        }
+        else {
+            msgpack_sbuffer_write(&mp_sbuf, (char *) buf + start,
+                                  offset - start);
+            cmt_destroy(base);
+            base = cmt;
+        }
+        cmt_encode_msgpack_destroy(mp_buf);
+
+        if (ret != CMT_DECODE_MSGPACK_SUCCESS) {
+            break;
+        }
+        start = offset;
+    }
+
+    if (ret != CMT_DECODE_MSGPACK_INSUFFICIENT_DATA || offset != buf_size) {
+        if (base) {
+            cmt_destroy(base);
+        }
+        msgpack_sbuffer_destroy(&mp_sbuf);
+        return -1;
+    }
+
+    ic->metrics_base = base;
+    if (delta == FLB_TRUE) {
+        ic->metrics_delta = FLB_TRUE;
+    }
+
+    *out_buf = mp_sbuf.data;
+    *out_size = mp_sbuf.size;
+
+    return 0;
+}
+
 static int input_chunk_append_raw(struct flb_input_instance *in,
                                   int event_type,
                                   size_t n_records,
@@ -1595,6 +1706,18 @@ static int input_chunk_append_raw(struct flb_input_instance *in,
         final_data_buffer = filtered_data_buffer;
         final_data_size = filtered_data_size;
     }
+    else if (event_type == FLB_INPUT_METRICS &&
+             in->metrics_delta == FLB_TRUE &&
+             in->storage_type != FLB_STORAGE_FS &&
+             new_chunk == FLB_FALSE) {
+        ret = input_chunk_metrics_delta(ic, buf, buf_size,
+                                        &filtered_data_buffer,
+                                        &filtered_data_size);
+        if (ret == 0) {
+            final_data_buffer = filtered_data_buffer;
+            final_data_size = filtered_data_size;
+        }
+    }
 
     if (final_data_size > 0){
         ret = flb_input_chunk_write(ic,
@@ -1644,6 +1767,12 @@ static int input_chunk_append_raw(struct flb_input_instance *in,
                   in->name);
         cio_chunk_tx_rollback(ic->chunk);
 
+        /* the base no longer matches the content, rebuild it if needed */
+        if (ic->metrics_base) {
+            cmt_destroy(ic->metrics_base);
+            ic->metrics_base = NULL;
+        }
+
         return -1;
     }
 
@@ -1832,7 +1961,15 @@ retry:
     }
 
     /* append chunk raw context to the ring buffer */
-    ret = flb_ring_buffer_write(ins->rb, (void *) &cr, sizeof(cr));
+    if (ins->rb_shared) {
+        pthread_mutex_lock(&ins->rb_lock);
+        ret = flb_ring_buffer_write(ins->rb, (void *) &cr, sizeof(cr));
+        pthread_mutex_unlock(&ins->rb_lock);
+    }
+    else {
+        ret = flb_ring_buffer_write(ins->rb, (void *) &cr, sizeof(cr));
+    }
+
     if (ret == -1) {
         flb_plg_debug(ins, "failed buffer write, retries=%i\n",
                       retries);
@@ -1918,9 +2055,12 @@ int flb_input_chunk_append_raw(struct flb_input_instance *in,
 
     /*
      * If the plugin instance registering the data runs in a separate thread, we must
-     * add the data reference to the ring buffer.
+     * add the data reference to the ring buffer. The same applies when
+     * network workers share the instance, except for the engine thread itself:
+     * it is the one draining the ring buffer, so it could never make room.
      */
-    if (flb_input_is_threaded(in)) {
+    if (flb_input_is_threaded(in) ||
+        (in->rb_shared && flb_engine_evl_get() != in->config->evl)) {
         ret = append_to_ring_buffer(in, event_type, records,
                                     tag, tag_len,
                                     buf, buf_size);
@@ -1979,6 +2119,12 @@ const void *flb_input_chunk_flush(struct flb_input_chunk *ic, size_t *size)
     /* Set it busy as it likely it's a reference for an outgoing task */
     ic->busy = FLB_TRUE;
 
+    /* no more contexts are appended to a locked chunk */
+    if (ic->metrics_base) {
+        cmt_destroy(ic->metrics_base);
+        ic->metrics_base = NULL;
+    }
+
     post_size = flb_input_chunk_get_real_size(ic);
     if (post_size != pre_size) {
         diff_size = post_size - pre_size;
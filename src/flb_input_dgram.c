@@ -0,0 +1,459 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2024 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_pipe.h>
+#include <fluent-bit/flb_input.h>
+#include <fluent-bit/flb_input_plugin.h>
+#include <fluent-bit/flb_downstream.h>
+#include <fluent-bit/flb_connection.h>
+#include <fluent-bit/flb_input_dgram.h>
+
+#include <cfl/cfl_time.h>
+#include <cmetrics/cmetrics.h>
+#include <cmetrics/cmt_counter.h>
+
+#ifndef FLB_SYSTEM_WINDOWS
+#include <poll.h>
+#endif
+
+/* milliseconds a receiver waits for data before checking if it must stop */
+#define DGRAM_POLL_TIMEOUT  200
+
+/* A batch handed over from a receiver to the input event loop */
+struct dgram_batch {
+    char *buf;              /* encoded log records */
+    size_t size;
+    struct cmt *cmt;        /* or a metrics context */
+    uint64_t drops;         /* kernel drops noticed by the receiver */
+};
+
+/*
+ * Number of sockets that must receive on the input port. When more than one
+ * is requested the port must be shared, so this must be called before the
+ * plugin creates its own server socket.
+ */
+int flb_input_dgram_receivers(struct flb_input_instance *ins)
+{
+    int count;
+
+    count = ins->net_setup.udp_receivers;
+    if (count < 1) {
+        count = 1;
+    }
+    else if (count > FLB_INPUT_DGRAM_RECEIVERS_MAX) {
+        count = FLB_INPUT_DGRAM_RECEIVERS_MAX;
+    }
+
+    if (count > 1) {
+        ins->net_setup.share_port = FLB_TRUE;
+    }
+
+    return count;
+}
+
+static int worker_running(struct flb_input_dgram_worker *worker)
+{
+    int running;
+
+    pthread_mutex_lock(&worker->parent->lock);
+    running = worker->running;
+    pthread_mutex_unlock(&worker->parent->lock);
+
+    return running;
+}
+
+static void worker_set_running(struct flb_input_dgram_worker *worker,
+                               int running)
+{
+    pthread_mutex_lock(&worker->parent->lock);
+    worker->running = running;
+    pthread_mutex_unlock(&worker->parent->lock);
+}
+
+static int batch_send(struct flb_input_dgram_worker *worker,
+                      struct dgram_batch *batch)
+{
+    ssize_t ret;
+#ifndef FLB_SYSTEM_WINDOWS
+    struct pollfd pfd;
+
+    pfd.fd = worker->parent->ch[1];
+    pfd.events = POLLOUT;
+#endif
+
+    while (1) {
+        ret = flb_pipe_w(worker->parent->ch[1], &batch, sizeof(batch));
+        if (ret == sizeof(batch)) {
+            return 0;
+        }
+
+#ifndef FLB_SYSTEM_WINDOWS
+        /*
+         * The input is not keeping up: sleep until the channel is writable
+         * again, the kernel queues (or drops) datagrams meanwhile.
+         */
+        if (ret == -1 && FLB_PIPE_WOULDBLOCK() && worker_running(worker)) {
+            poll(&pfd, 1, DGRAM_POLL_TIMEOUT);
+            continue;
+        }
+#endif
+
+        if (worker_running(worker)) {
+            flb_plg_warn(worker->parent->ins, "UDP receiver #%i could not "
+                         "hand over a batch, dropping it", worker->id);
+        }
+
+        return -1;
+    }
+}
+
+static int batch_flush(struct flb_input_dgram_worker *worker)
+{
+    uint64_t drops;
+    struct dgram_batch *batch;
+    struct flb_log_event_encoder *encoder;
+
+    encoder = worker->log_encoder;
+    drops = flb_net_dgram_drops(worker->reader);
+
+    if (encoder->output_length == 0 && drops == 0) {
+        return 0;
+    }
+
+    batch = flb_calloc(1, sizeof(struct dgram_batch));
+    if (!batch) {
+        flb_errno();
+        flb_log_event_encoder_reset(encoder);
+        return -1;
+    }
+    batch->drops = drops;
+
+    if (encoder->output_length > 0) {
+        /* take the encoder buffer, it allocates a new one on reset */
+        flb_log_event_encoder_claim_internal_buffer_ownership(encoder);
+        batch->buf = encoder->output_buffer;
+        batch->size = encoder->output_length;
+    }
+    flb_log_event_encoder_reset(encoder);
+
+    if (batch_send(worker, batch) == -1) {
+        flb_free(batch->buf);
+        flb_free(batch);
+        return -1;
+    }
+
+    return 0;
+}
+
+int flb_input_dgram_metrics_append(struct flb_input_dgram_worker *worker,
+                                   struct cmt *cmt)
+{
+    struct dgram_batch *batch;
+
+    batch = flb_calloc(1, sizeof(struct dgram_batch));
+    if (!batch) {
+        flb_errno();
+        cmt_destroy(cmt);
+        return -1;
+    }
+    batch->cmt = cmt;
+
+    if (batch_send(worker, batch) == -1) {
+        cmt_destroy(cmt);
+        flb_free(batch);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void *worker_run(void *data)
+{
+    int ret;
+    char *buf;
+    size_t size;
+    struct sockaddr_storage *address;
+    struct flb_input_dgram_worker *worker = data;
+    struct flb_input_dgram *dgram = worker->parent;
+#ifndef FLB_SYSTEM_WINDOWS
+    struct pollfd pfd;
+
+    pfd.fd = worker->reader->fd;
+    pfd.events = POLLIN;
+#endif
+
+    while (worker_running(worker)) {
+#ifndef FLB_SYSTEM_WINDOWS
+        ret = poll(&pfd, 1, DGRAM_POLL_TIMEOUT);
+        if (ret <= 0) {
+            continue;
+        }
+#endif
+
+        ret = flb_net_dgram_read(worker->reader);
+        if (ret <= 0) {
+            continue;
+        }
+
+        while (flb_net_dgram_next(worker->reader, &buf, &size, &address)) {
+            flb_connection_set_remote_host(worker->connection,
+                                           (struct sockaddr *) address);
+            dgram->cb_datagram(worker, buf, size);
+        }
+
+        batch_flush(worker);
+    }
+
+    return NULL;
+}
+
+struct flb_input_dgram *flb_input_dgram_create(struct flb_input_instance *ins,
+                                               const char *listen,
+                                               unsigned short int port,
+                                               int count,
+                                               size_t dgram_size,
+                                               flb_input_dgram_cb cb_datagram,
+                                               struct flb_config *config)
+{
+    int i;
+    int ret;
+    struct flb_input_dgram *dgram;
+    struct flb_input_dgram_worker *worker;
+
+    dgram = flb_calloc(1, sizeof(struct flb_input_dgram));
+    if (!dgram) {
+        flb_errno();
+        return NULL;
+    }
+    dgram->ins = ins;
+    dgram->coll_id = -1;
+    dgram->cb_datagram = cb_datagram;
+    dgram->ch[0] = -1;
+    dgram->ch[1] = -1;
+    pthread_mutex_init(&dgram->lock, NULL);
+
+    ret = flb_pipe_create(dgram->ch);
+    if (ret == -1) {
+        flb_errno();
+        pthread_mutex_destroy(&dgram->lock);
+        flb_free(dgram);
+        return NULL;
+    }
+    flb_pipe_set_nonblocking(dgram->ch[0]);
+    flb_pipe_set_nonblocking(dgram->ch[1]);
+
+    dgram->workers = flb_calloc(count, sizeof(struct flb_input_dgram_worker));
+    if (!dgram->workers) {
+        flb_errno();
+        flb_input_dgram_destroy(dgram);
+        return NULL;
+    }
+
+    for (i = 0; i < count; i++) {
+        worker = &dgram->workers[i];
+        worker->id = i;
+        worker->parent = dgram;
+
+        worker->downstream = flb_downstream_create(FLB_TRANSPORT_UDP,
+                                                   ins->flags,
+                                                   listen, port,
+                                                   NULL, config,
+                                                   &ins->net_setup);
+        if (!worker->downstream) {
+            flb_plg_error(ins, "could not create UDP receiver #%i on %s:%u",
+                          i, listen, port);
+            flb_input_dgram_destroy(dgram);
+            return NULL;
+        }
+        dgram->count++;
+
+        worker->connection = flb_downstream_conn_get(worker->downstream);
+        worker->reader = flb_net_dgram_reader_create(worker->downstream->server_fd,
+                                                     ins->net_setup.udp_batch_size,
+                                                     dgram_size,
+                                                     ins->net_setup.udp_gro);
+        worker->log_encoder = flb_log_event_encoder_create(FLB_LOG_EVENT_FORMAT_DEFAULT);
+        if (!worker->connection || !worker->reader || !worker->log_encoder) {
+            flb_plg_error(ins, "could not initialize UDP receiver #%i", i);
+            flb_input_dgram_destroy(dgram);
+            return NULL;
+        }
+    }
+
+    return dgram;
+}
+
+/* Register the batches channel in the input event loop and spawn receivers */
+int flb_input_dgram_start(struct flb_input_dgram *dgram,
+                          int (*cb_collect) (struct flb_input_instance *,
+                                             struct flb_config *, void *),
+                          struct flb_config *config)
+{
+    int i;
+    int ret;
+    struct flb_input_dgram_worker *worker;
+
+    ret = flb_input_set_collector_event(dgram->ins, cb_collect,
+                                        dgram->ch[0], config);
+    if (ret == -1) {
+        flb_plg_error(dgram->ins, "could not set UDP receivers collector");
+        return -1;
+    }
+    dgram->coll_id = ret;
+
+    for (i = 0; i < dgram->count; i++) {
+        worker = &dgram->workers[i];
+        worker_set_running(worker, FLB_TRUE);
+
+        ret = pthread_create(&worker->tid, NULL, worker_run, worker);
+        if (ret != 0) {
+            flb_errno();
+            worker_set_running(worker, FLB_FALSE);
+            flb_input_dgram_stop(dgram);
+            return -1;
+        }
+    }
+
+    flb_plg_info(dgram->ins, "%i extra UDP receivers started", dgram->count);
+    return 0;
+}
+
+/* Collector callback: append the batches encoded by the receivers */
+int flb_input_dgram_collect(struct flb_input_dgram *dgram)
+{
+    int ret;
+    struct dgram_batch *batch;
+
+    while (1) {
+        ret = flb_pipe_r(dgram->ch[0], &batch, sizeof(batch));
+        if (ret != sizeof(batch)) {
+            break;
+        }
+
+        if (batch->buf) {
+            ret = flb_input_log_append(dgram->ins, NULL, 0,
+                                       batch->buf, batch->size);
+            if (ret != 0) {
+                flb_plg_warn(dgram->ins, "could not append a batch of "
+                             "%zu bytes, dropping it", batch->size);
+            }
+            flb_free(batch->buf);
+        }
+        if (batch->cmt) {
+            ret = flb_input_metrics_append(dgram->ins, NULL, 0, batch->cmt);
+            if (ret != 0) {
+                flb_plg_error(dgram->ins, "could not append metrics");
+            }
+            cmt_destroy(batch->cmt);
+        }
+        if (batch->drops > 0) {
+            flb_input_dgram_drops_report(dgram->ins, dgram->cmt_drops,
+                                         batch->drops);
+        }
+        flb_free(batch);
+    }
+
+    return 0;
+}
+
+/* Stop and join the receivers, their plugin data can be released after it */
+void flb_input_dgram_stop(struct flb_input_dgram *dgram)
+{
+    int i;
+    struct flb_input_dgram_worker *worker;
+
+    for (i = 0; i < dgram->count; i++) {
+        worker = &dgram->workers[i];
+        if (worker_running(worker)) {
+            worker_set_running(worker, FLB_FALSE);
+            pthread_join(worker->tid, NULL);
+        }
+    }
+}
+
+void flb_input_dgram_destroy(struct flb_input_dgram *dgram)
+{
+    int i;
+    struct dgram_batch *batch;
+    struct flb_input_dgram_worker *worker;
+
+    flb_input_dgram_stop(dgram);
+
+    if (dgram->coll_id != -1) {
+        flb_input_collector_delete(dgram->coll_id, dgram->ins);
+    }
+
+    /* discard batches not collected */
+    if (dgram->ch[0] != -1) {
+        while (flb_pipe_r(dgram->ch[0], &batch, sizeof(batch)) == sizeof(batch)) {
+            if (batch->cmt) {
+                cmt_destroy(batch->cmt);
+            }
+            flb_free(batch->buf);
+            flb_free(batch);
+        }
+        flb_pipe_destroy(dgram->ch);
+    }
+
+    for (i = 0; i < dgram->count; i++) {
+        worker = &dgram->workers[i];
+
+        if (worker->log_encoder) {
+            flb_log_event_encoder_destroy(worker->log_encoder);
+        }
+        flb_net_dgram_reader_destroy(worker->reader);
+        if (worker->downstream) {
+            flb_downstream_destroy(worker->downstream);
+        }
+    }
+
+    pthread_mutex_destroy(&dgram->lock);
+    flb_free(dgram->workers);
+    flb_free(dgram);
+}
+
+struct cmt_counter *flb_input_dgram_drops_counter(struct flb_input_instance *ins)
+{
+#ifdef FLB_HAVE_METRICS
+    return cmt_counter_create(ins->cmt,
+                              "fluentbit", "input", "kernel_drops_total",
+                              "Number of datagrams dropped by the kernel "
+                              "because the socket receive queue was full",
+                              1, (char *[]) {"name"});
+#else
+    return NULL;
+#endif
+}
+
+void flb_input_dgram_drops_report(struct flb_input_instance *ins,
+                                  struct cmt_counter *counter,
+                                  uint64_t drops)
+{
+    flb_plg_debug(ins, "%" PRIu64 " datagrams dropped by the kernel", drops);
+
+#ifdef FLB_HAVE_METRICS
+    if (counter) {
+        cmt_counter_add(counter, cfl_time_now(), drops,
+                        1, (char *[]) {(char *) flb_input_name(ins)});
+    }
+#endif
+}
@@ -0,0 +1,495 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2024 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_pipe.h>
+#include <fluent-bit/flb_coro.h>
+#include <fluent-bit/flb_engine.h>
+#include <fluent-bit/flb_event_loop.h>
+#include <fluent-bit/flb_bucket_queue.h>
+#include <fluent-bit/flb_scheduler.h>
+#include <fluent-bit/flb_input.h>
+#include <fluent-bit/flb_input_plugin.h>
+#include <fluent-bit/flb_downstream.h>
+#include <fluent-bit/flb_connection.h>
+#include <fluent-bit/flb_input_net_worker.h>
+
+/*
+ * Number of threads that must accept connections on the input port,
+ * including the input thread. When more than one is requested the port
+ * must be shared, so this must be called before the plugin creates its
+ * own listener.
+ */
+int flb_input_net_workers_count(struct flb_input_instance *ins)
+{
+    int count;
+
+    count = ins->net_setup.accept_workers;
+    if (count < 1) {
+        count = 1;
+    }
+    else if (count > FLB_INPUT_NET_WORKERS_MAX) {
+        count = FLB_INPUT_NET_WORKERS_MAX;
+    }
+
+    if (count > 1) {
+        ins->net_setup.share_port = FLB_TRUE;
+    }
+
+    return count;
+}
+
+/* Serve the downstreams registered by the worker from its own thread */
+int flb_input_net_worker_downstream_set(struct flb_input_net_worker *worker,
+                                        struct flb_downstream *stream)
+{
+    if (stream == NULL) {
+        return -1;
+    }
+
+    /* unlinks the stream from the engine list of downstreams */
+    flb_stream_enable_thread_safety(&stream->base);
+
+    mk_list_add(&stream->base._head, &worker->downstreams);
+
+    return 0;
+}
+
+/* Cleanup function that runs every 1.5 second */
+static void cb_worker_timer(struct flb_config *config, void *data)
+{
+    struct flb_input_net_worker *worker = data;
+
+    (void) config;
+
+    flb_downstream_conn_timeouts(&worker->downstreams);
+}
+
+/* A new connection is waiting on the worker listener */
+static int worker_accept(void *data)
+{
+    int ret;
+    struct mk_event *event = data;
+    struct flb_connection *connection;
+    struct flb_input_net_worker *worker = event->data;
+    struct flb_input_net_workers *nw = worker->parent;
+
+    connection = flb_downstream_conn_get(worker->downstream);
+    if (connection == NULL) {
+        flb_plg_error(nw->ins, "worker #%i could not accept new connection",
+                      worker->id);
+        return -1;
+    }
+
+    flb_plg_trace(nw->ins, "worker #%i: new connection arrived FD=%i",
+                  worker->id, connection->fd);
+
+    ret = nw->cb_accept(worker, connection);
+    if (ret == -1) {
+        flb_plg_error(nw->ins, "worker #%i could not accept new connection",
+                      worker->id);
+        flb_downstream_conn_release(connection);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Stop (or restart) reading from the connections served by the worker: their
+ * events are removed from the event loop and registered again on resume.
+ * Connections waiting on I/O from a coroutine are left alone.
+ */
+static void worker_connections_pause(struct flb_input_net_worker *worker,
+                                     int pause)
+{
+    struct mk_list *head;
+    struct mk_list *c_head;
+    struct flb_stream *stream;
+    struct flb_downstream *downstream;
+    struct flb_connection *connection;
+
+    mk_list_foreach(head, &worker->downstreams) {
+        stream = mk_list_entry(head, struct flb_stream, _head);
+        downstream = (struct flb_downstream *) stream;
+
+        mk_list_foreach(c_head, &downstream->busy_queue) {
+            connection = mk_list_entry(c_head, struct flb_connection, _head);
+
+            if (connection->event.type != FLB_ENGINE_EV_CUSTOM) {
+                continue;
+            }
+
+            if (pause && MK_EVENT_IS_REGISTERED((&connection->event))) {
+                mk_event_del(worker->evl, &connection->event);
+            }
+            else if (!pause && !MK_EVENT_IS_REGISTERED((&connection->event))) {
+                mk_event_add(worker->evl, connection->fd,
+                             FLB_ENGINE_EV_CUSTOM, MK_EVENT_READ,
+                             &connection->event);
+            }
+        }
+    }
+}
+
+/* Messages from the input thread */
+static int worker_control(void *data)
+{
+    int ret;
+    uint64_t message;
+    struct mk_event *event = data;
+    struct flb_input_net_worker *worker = event->data;
+    struct flb_input_net_workers *nw = worker->parent;
+
+    ret = flb_pipe_r(worker->ch[0], &message, sizeof(message));
+    if (ret <= 0) {
+        flb_errno();
+        return -1;
+    }
+
+    if (message == FLB_INPUT_NET_WORKER_PAUSE) {
+        if (worker->downstream != NULL &&
+            MK_EVENT_IS_REGISTERED((&worker->listener))) {
+            mk_event_del(worker->evl, &worker->listener);
+        }
+        if (nw->cb_pause) {
+            nw->cb_pause(worker);
+        }
+        worker_connections_pause(worker, FLB_TRUE);
+    }
+    else if (message == FLB_INPUT_NET_WORKER_RESUME) {
+        if (worker->downstream != NULL &&
+            !MK_EVENT_IS_REGISTERED((&worker->listener))) {
+            mk_event_add(worker->evl, worker->downstream->server_fd,
+                         FLB_ENGINE_EV_CUSTOM, MK_EVENT_READ,
+                         &worker->listener);
+        }
+        worker_connections_pause(worker, FLB_FALSE);
+    }
+    else if (message == FLB_INPUT_NET_WORKER_EXIT) {
+        worker->stop = FLB_TRUE;
+    }
+
+    return 0;
+}
+
+static void *worker_run(void *data)
+{
+    int ret;
+    char name[64];
+    struct mk_event *event;
+    struct flb_sched *sched;
+    struct flb_connection *connection;
+    struct flb_bucket_queue *evl_bktq;
+    struct flb_input_net_worker *worker = data;
+    struct flb_input_net_workers *nw = worker->parent;
+
+    flb_engine_evl_set(worker->evl);
+
+    sched = flb_sched_create(nw->config, worker->evl);
+    if (!sched) {
+        flb_plg_error(nw->ins, "worker #%i could not create scheduler",
+                      worker->id);
+        return NULL;
+    }
+    flb_sched_ctx_set(sched);
+
+    ret = flb_sched_timer_cb_create(sched, FLB_SCHED_TIMER_CB_PERM,
+                                    1500, cb_worker_timer, worker, NULL);
+    if (ret == -1) {
+        flb_plg_error(nw->ins, "worker #%i could not schedule permanent "
+                      "callback", worker->id);
+        flb_sched_destroy(sched);
+        return NULL;
+    }
+
+    evl_bktq = flb_bucket_queue_create(FLB_ENGINE_PRIORITY_COUNT);
+    if (!evl_bktq) {
+        flb_sched_destroy(sched);
+        return NULL;
+    }
+
+    flb_coro_thread_init();
+
+    snprintf(name, sizeof(name) - 1, "flb-in-%s-n%i", nw->ins->name, worker->id);
+    mk_utils_worker_rename(name);
+
+    while (!worker->stop) {
+        mk_event_wait(worker->evl);
+        flb_event_priority_live_foreach(event, evl_bktq, worker->evl,
+                                        FLB_ENGINE_LOOP_MAX_ITER) {
+            if (event->type == FLB_ENGINE_EV_CUSTOM) {
+                event->handler(event);
+            }
+            else if (event->type & FLB_ENGINE_EV_SCHED) {
+                flb_sched_event_handler(nw->config, event);
+            }
+            else if (event->type == FLB_ENGINE_EV_THREAD) {
+                connection = (struct flb_connection *) event;
+
+                if (connection->coroutine != NULL) {
+                    flb_coro_resume(connection->coroutine);
+                }
+            }
+        }
+
+        flb_downstream_conn_pending_destroy_list(&worker->downstreams);
+    }
+
+    /* connections are released by the thread owning them */
+    if (nw->cb_exit) {
+        nw->cb_exit(worker);
+    }
+    flb_downstream_conn_pending_destroy_list(&worker->downstreams);
+
+    flb_bucket_queue_destroy(evl_bktq);
+    flb_sched_destroy(sched);
+
+    return NULL;
+}
+
+static int worker_message(struct flb_input_net_worker *worker, uint64_t message)
+{
+    int ret;
+
+    ret = flb_pipe_w(worker->ch[1], &message, sizeof(message));
+    if (ret != sizeof(message)) {
+        flb_errno();
+        return -1;
+    }
+
+    return 0;
+}
+
+static int worker_init(struct flb_input_net_workers *nw,
+                       struct flb_input_net_worker *worker,
+                       const char *listen, unsigned short int port)
+{
+    int ret;
+    struct flb_input_instance *ins = nw->ins;
+
+    worker->evl = mk_event_loop_create(256);
+    if (!worker->evl) {
+        return -1;
+    }
+
+    ret = flb_pipe_create(worker->ch);
+    if (ret == -1) {
+        flb_errno();
+        return -1;
+    }
+
+    MK_EVENT_ZERO(&worker->event);
+    worker->event.data = worker;
+    worker->event.handler = worker_control;
+
+    ret = mk_event_add(worker->evl, worker->ch[0],
+                       FLB_ENGINE_EV_CUSTOM, MK_EVENT_READ, &worker->event);
+    if (ret == -1) {
+        return -1;
+    }
+
+    /* plugins without an accept callback set up their own listener */
+    if (nw->cb_accept) {
+        worker->downstream = flb_downstream_create(FLB_TRANSPORT_TCP,
+                                                   ins->flags,
+                                                   listen, port,
+                                                   ins->tls,
+                                                   nw->config,
+                                                   &ins->net_setup);
+        if (!worker->downstream) {
+            flb_plg_error(ins, "could not create listener for worker #%i "
+                          "on %s:%u", worker->id, listen, port);
+            return -1;
+        }
+        flb_input_net_worker_downstream_set(worker, worker->downstream);
+
+        MK_EVENT_ZERO(&worker->listener);
+        worker->listener.data = worker;
+        worker->listener.handler = worker_accept;
+
+        ret = mk_event_add(worker->evl, worker->downstream->server_fd,
+                           FLB_ENGINE_EV_CUSTOM, MK_EVENT_READ,
+                           &worker->listener);
+        if (ret == -1) {
+            return -1;
+        }
+    }
+
+    ret = nw->cb_init(worker);
+    if (ret == -1) {
+        return -1;
+    }
+    worker->ready = FLB_TRUE;
+
+    return 0;
+}
+
+struct flb_input_net_workers *flb_input_net_workers_create(
+                                  struct flb_input_instance *ins,
+                                  const char *listen,
+                                  unsigned short int port,
+                                  int count,
+                                  flb_input_net_worker_init_cb cb_init,
+                                  flb_input_net_worker_accept_cb cb_accept,
+                                  flb_input_net_worker_exit_cb cb_exit,
+                                  void *context,
+                                  struct flb_config *config)
+{
+    int i;
+    int ret;
+    struct flb_input_net_workers *nw;
+    struct flb_input_net_worker *worker;
+
+    /* records of the workers are appended through the ring buffer */
+    ret = flb_input_ring_buffer_share(ins);
+    if (ret == -1) {
+        return NULL;
+    }
+
+    nw = flb_calloc(1, sizeof(struct flb_input_net_workers));
+    if (!nw) {
+        flb_errno();
+        return NULL;
+    }
+    nw->ins = ins;
+    nw->config = config;
+    nw->context = context;
+    nw->cb_init = cb_init;
+    nw->cb_accept = cb_accept;
+    nw->cb_exit = cb_exit;
+
+    nw->workers = flb_calloc(count, sizeof(struct flb_input_net_worker));
+    if (!nw->workers) {
+        flb_errno();
+        flb_free(nw);
+        return NULL;
+    }
+
+    for (i = 0; i < count; i++) {
+        worker = &nw->workers[i];
+
+        /* worker #0 is the input thread */
+        worker->id = i + 1;
+        worker->parent = nw;
+        worker->ch[0] = -1;
+        worker->ch[1] = -1;
+        mk_list_init(&worker->downstreams);
+        nw->count++;
+
+        ret = worker_init(nw, worker, listen, port);
+        if (ret == -1) {
+            flb_plg_error(ins, "could not initialize network worker #%i",
+                          worker->id);
+            flb_input_net_workers_destroy(nw);
+            return NULL;
+        }
+    }
+
+    return nw;
+}
+
+int flb_input_net_workers_start(struct flb_input_net_workers *nw)
+{
+    int i;
+    int ret;
+    struct flb_input_net_worker *worker;
+
+    for (i = 0; i < nw->count; i++) {
+        worker = &nw->workers[i];
+
+        ret = pthread_create(&worker->tid, NULL, worker_run, worker);
+        if (ret != 0) {
+            flb_errno();
+            return -1;
+        }
+        worker->running = FLB_TRUE;
+    }
+
+    flb_plg_info(nw->ins, "%i extra network workers started", nw->count);
+    return 0;
+}
+
+/* Set the plugin callback that runs in every worker when the input pauses */
+void flb_input_net_workers_pause_cb_set(struct flb_input_net_workers *nw,
+                                        flb_input_net_worker_pause_cb cb_pause)
+{
+    nw->cb_pause = cb_pause;
+}
+
+/* Stop (or restart) accepting connections and reading in the workers */
+void flb_input_net_workers_pause(struct flb_input_net_workers *nw)
+{
+    int i;
+
+    for (i = 0; i < nw->count; i++) {
+        if (nw->workers[i].running) {
+            worker_message(&nw->workers[i], FLB_INPUT_NET_WORKER_PAUSE);
+        }
+    }
+}
+
+void flb_input_net_workers_resume(struct flb_input_net_workers *nw)
+{
+    int i;
+
+    for (i = 0; i < nw->count; i++) {
+        if (nw->workers[i].running) {
+            worker_message(&nw->workers[i], FLB_INPUT_NET_WORKER_RESUME);
+        }
+    }
+}
+
+void flb_input_net_workers_destroy(struct flb_input_net_workers *nw)
+{
+    int i;
+    struct flb_input_net_worker *worker;
+
+    for (i = 0; i < nw->count; i++) {
+        worker = &nw->workers[i];
+
+        if (worker->running) {
+            worker_message(worker, FLB_INPUT_NET_WORKER_EXIT);
+            pthread_join(worker->tid, NULL);
+            worker->running = FLB_FALSE;
+        }
+        else if (worker->ready && nw->cb_exit) {
+            nw->cb_exit(worker);
+        }
+    }
+
+    for (i = 0; i < nw->count; i++) {
+        worker = &nw->workers[i];
+
+        if (worker->downstream) {
+            flb_downstream_destroy(worker->downstream);
+        }
+        if (worker->ch[0] != -1) {
+            flb_pipe_destroy(worker->ch);
+        }
+        if (worker->evl) {
+            mk_event_loop_destroy(worker->evl);
+        }
+    }
+
+    flb_free(nw->workers);
+    flb_free(nw);
+}
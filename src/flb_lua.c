@@ -245,6 +245,195 @@ void flb_lua_pushmsgpack(lua_State *l, msgpack_object *o)
     }
 }
 
+/*
+ * Lazy records
+ * ============
+ * A lazy record is a userdata standing for a msgpack map: fields are only
+ * converted to Lua values when the script reads them. Reads and writes are
+ * kept in the userdata environment table (a removed field is stored as the
+ * 'lazy_deleted' sentinel) and, when the record is converted back, the
+ * fields never touched by the script are copied from the original msgpack
+ * buffer. The msgpack buffer belongs to the caller, it must call
+ * flb_lua_lazy_release_all() before releasing it.
+ */
+static char lazy_deleted;
+
+struct flb_lua_lazy_record {
+    msgpack_object *obj;     /* source map, NULL once released */
+};
+
+static msgpack_object *lazy_lookup(msgpack_object *map,
+                                   const char *key, size_t key_len)
+{
+    uint32_t i;
+    msgpack_object_kv *kv;
+
+    for (i = 0; i < map->via.map.size; i++) {
+        kv = &map->via.map.ptr[i];
+        if (kv->key.type == MSGPACK_OBJECT_STR &&
+            kv->key.via.str.size == key_len &&
+            memcmp(kv->key.via.str.ptr, key, key_len) == 0) {
+            return &kv->val;
+        }
+    }
+
+    return NULL;
+}
+
+static int lazy_index(lua_State *l)
+{
+    size_t len;
+    const char *key;
+    msgpack_object *val;
+    struct flb_lua_lazy_record *rec;
+
+    rec = luaL_checkudata(l, 1, FLB_LUA_LAZY_RECORD);
+
+    /* fields already read or written by the script */
+    lua_getfenv(l, 1);
+    lua_pushvalue(l, 2);
+    lua_rawget(l, -2);
+    if (!lua_isnil(l, -1)) {
+        if (lua_touserdata(l, -1) == &lazy_deleted) {
+            lua_pushnil(l);
+        }
+        return 1;
+    }
+    lua_pop(l, 1);
+
+    if (!rec->obj || lua_type(l, 2) != LUA_TSTRING) {
+        lua_pushnil(l);
+        return 1;
+    }
+
+    key = lua_tolstring(l, 2, &len);
+    val = lazy_lookup(rec->obj, key, len);
+    if (!val) {
+        lua_pushnil(l);
+        return 1;
+    }
+
+    /* cache it, nested tables can be modified in place */
+    flb_lua_pushmsgpack(l, val);
+    lua_pushvalue(l, 2);
+    lua_pushvalue(l, -2);
+    lua_rawset(l, -4);
+
+    return 1;
+}
+
+static int lazy_newindex(lua_State *l)
+{
+    luaL_checkudata(l, 1, FLB_LUA_LAZY_RECORD);
+
+    lua_getfenv(l, 1);
+    lua_pushvalue(l, 2);
+    if (lua_isnil(l, 3)) {
+        lua_pushlightuserdata(l, &lazy_deleted);
+    }
+    else {
+        lua_pushvalue(l, 3);
+    }
+    lua_rawset(l, -3);
+
+    return 0;
+}
+
+int flb_lua_lazy_init(lua_State *l)
+{
+    if (luaL_newmetatable(l, FLB_LUA_LAZY_RECORD) == 0) {
+        /* already registered */
+        lua_pop(l, 1);
+        return 0;
+    }
+
+    lua_pushcfunction(l, lazy_index);
+    lua_setfield(l, -2, "__index");
+    lua_pushcfunction(l, lazy_newindex);
+    lua_setfield(l, -2, "__newindex");
+    lua_pop(l, 1);
+
+    /* records to release once the caller is done with the buffer */
+    lua_newtable(l);
+    lua_setfield(l, LUA_REGISTRYINDEX, FLB_LUA_LAZY_RECORD ".live");
+
+    return 0;
+}
+
+void flb_lua_pushmsgpack_lazy(lua_State *l, msgpack_object *o)
+{
+    int len;
+    struct flb_lua_lazy_record *rec;
+
+    if (o->type != MSGPACK_OBJECT_MAP) {
+        flb_lua_pushmsgpack(l, o);
+        return;
+    }
+
+    lua_checkstack(l, 3);
+
+    rec = lua_newuserdata(l, sizeof(struct flb_lua_lazy_record));
+    rec->obj = o;
+    luaL_getmetatable(l, FLB_LUA_LAZY_RECORD);
+    lua_setmetatable(l, -2);
+    lua_newtable(l);
+    lua_setfenv(l, -2);
+
+    lua_getfield(l, LUA_REGISTRYINDEX, FLB_LUA_LAZY_RECORD ".live");
+    len = lua_objlen(l, -1);
+    lua_pushvalue(l, -2);
+    lua_rawseti(l, -2, len + 1);
+    lua_pop(l, 1);
+}
+
+void flb_lua_lazy_release_all(lua_State *l)
+{
+    int i;
+    int len;
+    struct flb_lua_lazy_record *rec;
+
+    lua_getfield(l, LUA_REGISTRYINDEX, FLB_LUA_LAZY_RECORD ".live");
+    if (!lua_istable(l, -1)) {
+        lua_pop(l, 1);
+        return;
+    }
+
+    len = lua_objlen(l, -1);
+    if (len == 0) {
+        lua_pop(l, 1);
+        return;
+    }
+
+    for (i = 1; i <= len; i++) {
+        lua_rawgeti(l, -1, i);
+        rec = lua_touserdata(l, -1);
+        if (rec) {
+            rec->obj = NULL;
+        }
+        lua_pop(l, 1);
+    }
+    lua_pop(l, 1);
+
+    lua_newtable(l);
+    lua_setfield(l, LUA_REGISTRYINDEX, FLB_LUA_LAZY_RECORD ".live");
+}
+
+static struct flb_lua_lazy_record *lazy_get(lua_State *l, int index)
+{
+    int equal;
+    void *rec;
+
+    rec = lua_touserdata(l, index);
+    if (!rec || !lua_getmetatable(l, index)) {
+        return NULL;
+    }
+    luaL_getmetatable(l, FLB_LUA_LAZY_RECORD);
+    equal = lua_rawequal(l, -1, -2);
+    lua_pop(l, 2);
+
+    return equal ? rec : NULL;
+}
+
 static int lua_isinteger(lua_State *L, int index)
 {
     lua_Number n;
@@ -668,6 +857,126 @@ static inline void lua_tomap_msgpack(lua_State *l,
     }
 }
 
+/* Pack a lazy record: untouched fields are copied from the source map */
+static void lazy_tomsgpack(lua_State *l,
+                           msgpack_packer *pck,
+                           int index,
+                           struct flb_lua_l2c_config *l2cc)
+{
+    int len = 0;
+    int keep_nil;
+    int shadow;
+    uint32_t i;
+    size_t key_len;
+    const char *key;
+    msgpack_object_kv *kv;
+    msgpack_object *map;
+    struct flb_lua_lazy_record *rec;
+
+    rec = lua_touserdata(l, index);
+    map = rec->obj;
+
+    lua_getglobal(l, FLB_LUA_VAR_FLB_NULL);
+    keep_nil = !lua_isnil(l, -1);
+    lua_pop(l, 1);
+
+    lua_getfenv(l, index);
+    shadow = lua_gettop(l);
+
+    /* count the resulting fields */
+    for (i = 0; map && i < map->via.map.size; i++) {
+        kv = &map->via.map.ptr[i];
+        if (kv->key.type == MSGPACK_OBJECT_STR) {
+            lua_pushlstring(l, kv->key.via.str.ptr, kv->key.via.str.size);
+            lua_rawget(l, shadow);
+            if (lua_touserdata(l, -1) == &lazy_deleted) {
+                lua_pop(l, 1);
+                continue;
+            }
+            if (!lua_isnil(l, -1)) {
+                len++;
+                lua_pop(l, 1);
+                continue;
+            }
+            lua_pop(l, 1);
+        }
+        if (kv->val.type != MSGPACK_OBJECT_NIL || keep_nil) {
+            len++;
+        }
+    }
+
+    lua_pushnil(l);
+    while (lua_next(l, shadow) != 0) {
+        if (lua_touserdata(l, -1) != &lazy_deleted) {
+            if (lua_type(l, -2) != LUA_TSTRING || !map) {
+                len++;
+            }
+            else {
+                key = lua_tolstring(l, -2, &key_len);
+                if (!lazy_lookup(map, key, key_len)) {
+                    len++;
+                }
+            }
+        }
+        lua_pop(l, 1);
+    }
+
+    msgpack_pack_map(pck, len);
+
+    /* original fields, in their order */
+    for (i = 0; map && i < map->via.map.size; i++) {
+        kv = &map->via.map.ptr[i];
+        if (kv->key.type == MSGPACK_OBJECT_STR) {
+            lua_pushlstring(l, kv->key.via.str.ptr, kv->key.via.str.size);
+            lua_pushvalue(l, -1);
+            lua_rawget(l, shadow);
+            if (lua_touserdata(l, -1) == &lazy_deleted) {
+                lua_pop(l, 2);
+                continue;
+            }
+            if (!lua_isnil(l, -1)) {
+                if (l2cc->l2c_types_num > 0) {
+                    try_to_convert_data_type(l, pck, l2cc);
+                }
+                else {
+                    flb_lua_tomsgpack(l, pck, -1, l2cc);
+                    flb_lua_tomsgpack(l, pck, 0, l2cc);
+                }
+                lua_pop(l, 2);
+                continue;
+            }
+            lua_pop(l, 2);
+        }
+        if (kv->val.type != MSGPACK_OBJECT_NIL || keep_nil) {
+            msgpack_pack_object(pck, kv->key);
+            msgpack_pack_object(pck, kv->val);
+        }
+    }
+
+    /* new fields */
+    lua_pushnil(l);
+    while (lua_next(l, shadow) != 0) {
+        if (lua_touserdata(l, -1) != &lazy_deleted) {
+            key = NULL;
+            if (lua_type(l, -2) == LUA_TSTRING && map) {
+                key = lua_tolstring(l, -2, &key_len);
+            }
+            if (!key || !lazy_lookup(map, key, key_len)) {
+                if (l2cc->l2c_types_num > 0) {
+                    try_to_convert_data_type(l, pck, l2cc);
+                }
+                else {
+                    flb_lua_tomsgpack(l, pck, -1, l2cc);
+                    flb_lua_tomsgpack(l, pck, 0, l2cc);
+                }
+            }
+        }
+        lua_pop(l, 1);
+    }
+
+    lua_pop(l, 1);
+}
+
 void flb_lua_tomsgpack(lua_State *l,
                        msgpack_packer *pck,
                        int index,
@@ -748,8 +1057,12 @@ void flb_lua_tomsgpack(lua_State *l,
                 msgpack_pack_nil(pck);
                 break;
             }
-         case LUA_TFUNCTION:
          case LUA_TUSERDATA:
+            if (lazy_get(l, -1 + index)) {
+                lazy_tomsgpack(l, pck, flb_lua_absindex(l, -1 + index), l2cc);
+                break;
+            }
+         case LUA_TFUNCTION:
          case LUA_TTHREAD:
            /* cannot serialize */
            break;
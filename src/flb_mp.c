@@ -78,15 +78,19 @@ int flb_mp_validate_metric_chunk(const void *data, size_t bytes,
     int count = 0;
     size_t off = 0;
     size_t pre_off = 0;
-    struct cmt *cmt;
+    struct cmt *cmt = NULL;
 
-    while ((ret = cmt_decode_msgpack_create(&cmt,
-                                            (char *) data, bytes, &off)) == ok) {
-        cmt_destroy(cmt);
+    /* chunks might carry delta encoded contexts (metrics.delta) */
+    while ((ret = cmt_decode_msgpack_delta_apply(&cmt, (char *) data, bytes,
+                                                 &off, NULL)) == ok) {
         count++;
         pre_off = off;
     }
 
+    if (cmt) {
+        cmt_destroy(cmt);
+    }
+
     switch (ret) {
         case CMT_DECODE_MSGPACK_INVALID_ARGUMENT_ERROR:
         case CMT_DECODE_MSGPACK_CORRUPT_INPUT_DATA_ERROR:
@@ -98,6 +102,8 @@ int flb_mp_validate_metric_chunk(const void *data, size_t bytes,
         case CMT_DECODE_MSGPACK_UNEXPECTED_DATA_TYPE_ERROR:
         case CMT_DECODE_MSGPACK_DICTIONARY_LOOKUP_ERROR:
         case CMT_DECODE_MSGPACK_VERSION_ERROR:
+        case CMT_DECODE_MSGPACK_DELTA_ERROR:
+        case CMT_DECODE_MSGPACK_DELTA_BASE_ERROR:
             goto error;
     }
 
@@ -114,6 +120,57 @@ error:
     return -1;
 }
 
+/*
+ * Expand a metrics chunk that holds delta encoded contexts (metrics.delta)
+ * into full contexts for consumers that decode every context on its own.
+ */
+int flb_mp_metrics_delta_expand(const void *data, size_t bytes,
+                                char **out_buf, size_t *out_size)
+{
+    int ret;
+    int delta;
+    size_t off = 0;
+    size_t pre_off = 0;
+    char *mp_buf;
+    size_t mp_size;
+    struct cmt *cmt = NULL;
+    msgpack_sbuffer mp_sbuf;
+
+    msgpack_sbuffer_init(&mp_sbuf);
+
+    while ((ret = cmt_decode_msgpack_delta_apply(&cmt, (char *) data, bytes,
+                                                 &off, &delta)) ==
+           CMT_DECODE_MSGPACK_SUCCESS) {
+        if (delta == FLB_FALSE) {
+            msgpack_sbuffer_write(&mp_sbuf, (char *) data + pre_off,
+                                  off - pre_off);
+        }
+        else {
+            ret = cmt_encode_msgpack_create(cmt, &mp_buf, &mp_size);
+            if (ret != 0) {
+                break;
+            }
+            msgpack_sbuffer_write(&mp_sbuf, mp_buf, mp_size);
+            cmt_encode_msgpack_destroy(mp_buf);
+        }
+        pre_off = off;
+    }
+
+    if (cmt) {
+        cmt_destroy(cmt);
+    }
+
+    if (ret != CMT_DECODE_MSGPACK_INSUFFICIENT_DATA || off != bytes) {
+        msgpack_sbuffer_destroy(&mp_sbuf);
+        return -1;
+    }
+
+    *out_buf = mp_sbuf.data;
+    *out_size = mp_sbuf.size;
+
+    return 0;
+}
+
 int flb_mp_validate_log_chunk(const void *data, size_t bytes,
                               int *out_records, size_t *processed_bytes)
 {
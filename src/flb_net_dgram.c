@@ -0,0 +1,332 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2024 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_compat.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_socket.h>
+#include <fluent-bit/flb_net_dgram.h>
+
+#include <inttypes.h>
+
+#ifndef FLB_SYSTEM_WINDOWS
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#endif
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+
+static void dgram_socket_setup(struct flb_net_dgram_reader *reader, int gro)
+{
+    int on = 1;
+    int ret;
+
+    (void) on;
+    (void) ret;
+
+#ifdef SO_RXQ_OVFL
+    ret = setsockopt(reader->fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on));
+    if (ret == 0) {
+        reader->rxq_ovfl = FLB_TRUE;
+    }
+#endif
+
+#if defined(UDP_GRO) && defined(FLB_HAVE_RECVMMSG)
+    if (gro) {
+        ret = setsockopt(reader->fd, SOL_UDP, UDP_GRO, &on, sizeof(on));
+        if (ret == 0) {
+            reader->gro = FLB_TRUE;
+        }
+        else {
+            flb_debug("[net] UDP GRO not available on fd=%i", reader->fd);
+        }
+    }
+#else
+    if (gro) {
+        flb_debug("[net] UDP GRO is not supported on this platform");
+    }
+#endif
+}
+
+struct flb_net_dgram_reader *flb_net_dgram_reader_create(flb_sockfd_t fd,
+                                                         int slots,
+                                                         size_t slot_size,
+                                                         int gro)
+{
+    struct flb_net_dgram_reader *reader;
+
+    if (slots < 1) {
+        slots = 1;
+    }
+    else if (slots > FLB_NET_DGRAM_BATCH_MAX) {
+        slots = FLB_NET_DGRAM_BATCH_MAX;
+    }
+
+    reader = flb_calloc(1, sizeof(struct flb_net_dgram_reader));
+    if (!reader) {
+        flb_errno();
+        return NULL;
+    }
+    reader->fd = fd;
+    reader->slots = slots;
+
+    dgram_socket_setup(reader, gro);
+
+    /* coalesced datagrams can use up to the maximum UDP payload */
+    if (reader->gro && slot_size < FLB_NET_DGRAM_GRO_SIZE) {
+        slot_size = FLB_NET_DGRAM_GRO_SIZE;
+    }
+    reader->slot_size = slot_size;
+
+    reader->buffers = flb_malloc(slots * slot_size);
+    reader->lengths = flb_calloc(slots, sizeof(size_t));
+    reader->segments = flb_calloc(slots, sizeof(size_t));
+    reader->addresses = flb_calloc(slots, sizeof(struct sockaddr_storage));
+    if (!reader->buffers || !reader->lengths || !reader->segments ||
+        !reader->addresses) {
+        flb_errno();
+        flb_net_dgram_reader_destroy(reader);
+        return NULL;
+    }
+
+#ifdef FLB_HAVE_RECVMMSG
+    reader->control_size = CMSG_SPACE(sizeof(uint32_t)) + CMSG_SPACE(sizeof(int));
+    reader->msgs = flb_calloc(slots, sizeof(struct mmsghdr));
+    reader->iovecs = flb_calloc(slots, sizeof(struct iovec));
+    reader->controls = flb_calloc(slots, reader->control_size);
+    if (!reader->msgs || !reader->iovecs || !reader->controls) {
+        flb_errno();
+        flb_net_dgram_reader_destroy(reader);
+        return NULL;
+    }
+#endif
+
+    return reader;
+}
+
+void flb_net_dgram_reader_destroy(struct flb_net_dgram_reader *reader)
+{
+    if (!reader) {
+        return;
+    }
+
+#ifdef FLB_HAVE_RECVMMSG
+    flb_free(reader->msgs);
+    flb_free(reader->iovecs);
+    flb_free(reader->controls);
+#endif
+    flb_free(reader->buffers);
+    flb_free(reader->lengths);
+    flb_free(reader->segments);
+    flb_free(reader->addresses);
+    flb_free(reader);
+}
+
+#ifdef FLB_HAVE_RECVMMSG
+static void dgram_control_parse(struct flb_net_dgram_reader *reader,
+                                int slot, struct msghdr *msg)
+{
+    uint32_t drops;
+    struct cmsghdr *cmsg;
+
+    for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+#ifdef SO_RXQ_OVFL
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+            memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+            /* the kernel reports a running total for the socket */
+            reader->drops += (uint32_t) (drops - reader->drops_seen);
+            reader->drops_seen = drops;
+        }
+#endif
+#ifdef UDP_GRO
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+            int segment;
+
+            memcpy(&segment, CMSG_DATA(cmsg), sizeof(segment));
+            if (segment > 0) {
+                reader->segments[slot] = segment;
+            }
+        }
+#endif
+    }
+}
+
+static int dgram_read(struct flb_net_dgram_reader *reader)
+{
+    int i;
+    int ret;
+
+    for (i = 0; i < reader->slots; i++) {
+        reader->iovecs[i].iov_base = reader->buffers + (i * reader->slot_size);
+        reader->iovecs[i].iov_len = reader->slot_size;
+
+        reader->msgs[i].msg_hdr.msg_iov = &reader->iovecs[i];
+        reader->msgs[i].msg_hdr.msg_iovlen = 1;
+        reader->msgs[i].msg_hdr.msg_name = &reader->addresses[i];
+        reader->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+        reader->msgs[i].msg_hdr.msg_control = reader->controls +
+                                              (i * reader->control_size);
+        reader->msgs[i].msg_hdr.msg_controllen = reader->control_size;
+        reader->msgs[i].msg_hdr.msg_flags = 0;
+    }
+
+    ret = recvmmsg(reader->fd, reader->msgs, reader->slots, MSG_DONTWAIT, NULL);
+    if (ret == -1) {
+        return -1;
+    }
+
+    for (i = 0; i < ret; i++) {
+        reader->lengths[i] = reader->msgs[i].msg_len;
+        reader->segments[i] = 0;
+        dgram_control_parse(reader, i, &reader->msgs[i].msg_hdr);
+
+        /* the datagram did not fit in the slot, skip it */
+        if (reader->msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+            reader->lengths[i] = 0;
+            reader->truncated++;
+        }
+    }
+
+    return ret;
+}
+#else
+static int dgram_read(struct flb_net_dgram_reader *reader)
+{
+    int i;
+    int flags = 0;
+    ssize_t ret;
+    socklen_t address_size;
+
+#ifdef MSG_DONTWAIT
+    flags = MSG_DONTWAIT;
+#else
+    /* without non-blocking reads, only the datagram we got notified for */
+    reader->slots = 1;
+#endif
+
+    for (i = 0; i < reader->slots; i++) {
+        address_size = sizeof(struct sockaddr_storage);
+        ret = recvfrom(reader->fd,
+                       reader->buffers + (i * reader->slot_size),
+                       reader->slot_size, flags,
+                       (struct sockaddr *) &reader->addresses[i],
+                       &address_size);
+        if (ret == -1) {
+            if (i == 0) {
+                return -1;
+            }
+            break;
+        }
+        reader->lengths[i] = ret;
+        reader->segments[i] = 0;
+    }
+
+    return i;
+}
+#endif
+
+/*
+ * Read the datagrams available on the socket (at most 'slots'). Returns the
+ * number of receive slots filled, 0 if nothing was pending or -1 on error.
+ */
+int flb_net_dgram_read(struct flb_net_dgram_reader *reader)
+{
+    int ret;
+
+    reader->received = 0;
+    reader->current = 0;
+    reader->offset = 0;
+
+    ret = dgram_read(reader);
+    if (ret == -1) {
+        if (FLB_WOULDBLOCK()) {
+            return 0;
+        }
+        flb_errno();
+        return -1;
+    }
+
+    reader->received = ret;
+
+    if (reader->truncated > 0) {
+        flb_warn("[net] fd=%i dropped %" PRIu64 " datagrams larger than "
+                 "the receive buffer (%zu bytes)",
+                 reader->fd, reader->truncated, reader->slot_size);
+        reader->truncated = 0;
+    }
+
+    return ret;
+}
+
+/* Iterate the datagrams of the last read, GRO slots are split back */
+int flb_net_dgram_next(struct flb_net_dgram_reader *reader,
+                       char **buf, size_t *size,
+                       struct sockaddr_storage **address)
+{
+    size_t len;
+    size_t segment;
+    char *slot;
+
+    while (reader->current < reader->received) {
+        len = reader->lengths[reader->current];
+        segment = reader->segments[reader->current];
+        slot = reader->buffers + (reader->current * reader->slot_size);
+
+        if (reader->offset >= len) {
+            reader->current++;
+            reader->offset = 0;
+            continue;
+        }
+
+        *buf = slot + reader->offset;
+        *address = &reader->addresses[reader->current];
+
+        if (segment > 0 && len - reader->offset > segment) {
+            *size = segment;
+            reader->offset += segment;
+        }
+        else {
+            *size = len - reader->offset;
+            reader->current++;
+            reader->offset = 0;
+        }
+
+        return FLB_TRUE;
+    }
+
+    return FLB_FALSE;
+}
+
+/* Datagrams dropped by the kernel since the previous call */
+uint64_t flb_net_dgram_drops(struct flb_net_dgram_reader *reader)
+{
+    uint64_t drops;
+
+    drops = reader->drops;
+    reader->drops = 0;
+
+    return drops;
+}
@@ -120,6 +120,11 @@ void flb_net_setup_init(struct flb_net_setup *net)
     net->connect_timeout = 10;
     net->io_timeout = 0; /* Infinite time */
     net->source_address = NULL;
+    net->warm_connections = 0;
+    net->udp_batch_size = 32;
+    net->udp_gro = FLB_FALSE;
+    net->udp_receivers = 1;
+    net->accept_workers = 1;
 }
 
 int flb_net_host_set(const char *plugin_name, struct flb_net_host *host, const char *address)
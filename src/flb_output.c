@@ -439,6 +439,11 @@ int flb_output_instance_destroy(struct flb_output_instance *ins)
         flb_task_queue_destroy(ins->singleplex_queue);
     }
 
+    /* adaptive concurrency limiter */
+    if (ins->limiter) {
+        flb_output_limiter_destroy(ins->limiter);
+    }
+
     mk_list_del(&ins->_head);
 
     /* processor */
@@ -660,6 +665,10 @@ struct flb_output_instance *flb_output_new(struct flb_config *config,
     instance->match_regex = NULL;
 #endif
     instance->retry_limit = 1;
+    instance->concurrency_adaptive = FLB_FALSE;
+    instance->concurrency_min = FLB_OUTPUT_LIMITER_MIN;
+    instance->concurrency_max = FLB_OUTPUT_LIMITER_MAX;
+    instance->limiter = NULL;
     instance->host.name   = NULL;
     instance->host.address = NULL;
     instance->net_config_map = NULL;
@@ -935,6 +944,30 @@ int flb_output_set_property(struct flb_output_instance *ins,
         ins->tp_workers = atoi(tmp);
         flb_sds_destroy(tmp);
     }
+    else if (prop_key_check("concurrency.adaptive", k, len) == 0 && tmp) {
+        ret = flb_utils_bool(tmp);
+        flb_sds_destroy(tmp);
+        if (ret == -1) {
+            return -1;
+        }
+        ins->concurrency_adaptive = ret;
+    }
+    else if (prop_key_check("concurrency.min", k, len) == 0 && tmp) {
+        ins->concurrency_min = atoi(tmp);
+        flb_sds_destroy(tmp);
+        if (ins->concurrency_min <= 0) {
+            flb_error("[config] invalid concurrency.min for %s", ins->name);
+            return -1;
+        }
+    }
+    else if (prop_key_check("concurrency.max", k, len) == 0 && tmp) {
+        ins->concurrency_max = atoi(tmp);
+        flb_sds_destroy(tmp);
+        if (ins->concurrency_max <= 0) {
+            flb_error("[config] invalid concurrency.max for %s", ins->name);
+            return -1;
+        }
+    }
     else {
         /*
          * Create the property, we don't pass the value since we will
@@ -1076,6 +1109,7 @@ int flb_output_init_all(struct flb_config *config)
     int ret;
 #ifdef FLB_HAVE_METRICS
     char *name;
+    struct cmt_histogram_buckets *buckets;
 #endif
     struct mk_list *tmp;
     struct mk_list *head;
@@ -1211,6 +1245,29 @@ int flb_output_init_all(struct flb_config *config)
                       0,
                       1, (char *[]) {name});
 
+        /* output_upstream_tls_handshakes_total */
+        ins->cmt_upstream_tls_handshakes = cmt_counter_create(ins->cmt,
+                                             "fluentbit",
+                                             "output",
+                                             "upstream_tls_handshakes_total",
+                                             "Number of TLS handshakes of upstream "
+                                             "connections.",
+                                             2, (char *[]) {"name", "resumed"});
+
+        /* output_upstream_tls_handshake_seconds */
+        buckets = cmt_histogram_buckets_create(8, 0.005, 0.01, 0.025, 0.05,
+                                               0.1, 0.25, 0.5, 1.0);
+        if (buckets) {
+            ins->cmt_upstream_tls_handshake_seconds = cmt_histogram_create(ins->cmt,
+                                             "fluentbit",
+                                             "output",
+                                             "upstream_tls_handshake_seconds",
+                                             "Duration of TLS handshakes of upstream "
+                                             "connections.",
+                                             buckets,
+                                             1, (char *[]) {"name"});
+        }
+
         /* output_chunk_available_capacity_percent */
         ins->cmt_chunk_available_capacity_percent = cmt_gauge_create(ins->cmt,
                                                         "fluentbit",
@@ -1223,6 +1280,16 @@ int flb_output_init_all(struct flb_config *config)
                       100.0,
                       1, (char *[]) {name});
 
+        /* output_concurrency_limit */
+        if (ins->concurrency_adaptive == FLB_TRUE) {
+            ins->cmt_concurrency_limit = cmt_gauge_create(ins->cmt,
+                                                          "fluentbit",
+                                                          "output",
+                                                          "concurrency_limit",
+                                                          "Adaptive limit of in-flight flushes",
+                                                          1, (char *[]) {"name"});
+        }
+
         /* old API */
         ins->metrics = flb_metrics_create(name);
         if (ins->metrics) {
@@ -1320,6 +1387,30 @@ int flb_output_init_all(struct flb_config *config)
 
         ins->notification_channel = config->notification_channels[1];
 
+        /*
+         * Adaptive concurrency: synchronous plugins already run one flush at
+         * a time, so the limiter only applies to the other ones.
+         */
+        if (ins->concurrency_adaptive == FLB_TRUE) {
+            if (ins->flags & FLB_OUTPUT_SYNCHRONOUS) {
+                flb_warn("[output] %s runs flushes synchronously, "
+                         "ignoring concurrency.adaptive", flb_output_name(ins));
+            }
+            else {
+                ins->limiter = flb_output_limiter_create(ins->concurrency_min,
+                                                         ins->concurrency_max);
+                if (!ins->limiter) {
+                    flb_output_instance_destroy(ins);
+                    return -1;
+                }
+#ifdef FLB_HAVE_METRICS
+                cmt_gauge_set(ins->cmt_concurrency_limit, cfl_time_now(),
+                              (int) ins->limiter->limit,
+                              1, (char *[]) {(char *) flb_output_name(ins)});
+#endif
+            }
+        }
+
         /* Multi-threading enabled if configured */
         ret = flb_output_enable_multi_threading(ins, config);
         if (ret == -1) {
@@ -1427,6 +1518,11 @@ int flb_output_upstream_set(struct flb_upstream *u, struct flb_output_instance *
     flb_upstream_set_busy_connections_gauge(u,
                                             ins->cmt_upstream_busy_connections);
 
+    flb_upstream_set_tls_handshake_metrics(u,
+                                           flb_output_name(ins),
+                                           ins->cmt_upstream_tls_handshakes,
+                                           ins->cmt_upstream_tls_handshake_seconds);
+
     /*
      * If the output plugin flush callbacks will run in multiple threads, enable
      * the thread safe mode for the Upstream context.
@@ -0,0 +1,243 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2024 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_task.h>
+#include <fluent-bit/flb_output.h>
+#include <fluent-bit/flb_output_limiter.h>
+
+#include <cfl/cfl_time.h>
+
+struct flb_output_limiter *flb_output_limiter_create(int min, int max)
+{
+    struct flb_output_limiter *limiter;
+
+    if (min < 1) {
+        min = 1;
+    }
+    if (max < min) {
+        max = min;
+    }
+
+    limiter = flb_calloc(1, sizeof(struct flb_output_limiter));
+    if (!limiter) {
+        flb_errno();
+        return NULL;
+    }
+
+    limiter->queue = flb_task_queue_create();
+    if (!limiter->queue) {
+        flb_free(limiter);
+        return NULL;
+    }
+
+    limiter->min = min;
+    limiter->max = max;
+    limiter->limit = FLB_OUTPUT_LIMITER_INITIAL;
+    if (limiter->limit < min) {
+        limiter->limit = min;
+    }
+    else if (limiter->limit > max) {
+        limiter->limit = max;
+    }
+
+    return limiter;
+}
+
+void flb_output_limiter_destroy(struct flb_output_limiter *limiter)
+{
+    if (!limiter) {
+        return;
+    }
+
+    flb_task_queue_destroy(limiter->queue);
+    flb_free(limiter);
+}
+
+void flb_output_limiter_update(struct flb_output_limiter *limiter,
+                               uint64_t now, uint64_t latency, int ret)
+{
+    int saturated;
+    int congested;
+
+    /* smoothed latency (EWMA, alpha = 0.2) */
+    if (limiter->latency_avg == 0) {
+        limiter->latency_avg = latency;
+    }
+    else {
+        limiter->latency_avg += (latency - limiter->latency_avg) * 0.2;
+    }
+
+    /*
+     * The baseline follows the best latency seen, drifting up slowly so a
+     * backend that became permanently slower is not seen as congested forever.
+     */
+    if (limiter->latency_base == 0 || latency < limiter->latency_base) {
+        limiter->latency_base = latency;
+    }
+    else {
+        limiter->latency_base += (latency - limiter->latency_base) * 0.01;
+    }
+
+    /* the flush that just completed is still accounted as in-flight */
+    saturated = (limiter->in_flight >= (int) limiter->limit);
+
+    congested = (ret == FLB_RETRY ||
+                 (limiter->latency_avg >
+                  limiter->latency_base * FLB_OUTPUT_LIMITER_TOLERANCE &&
+                  limiter->latency_avg - limiter->latency_base >
+                  FLB_OUTPUT_LIMITER_SLACK));
+
+    if (congested) {
+        /* decrease at most once per round trip: results in flight still
+         * reflect the previous limit */
+        if (now - limiter->ts_last_decrease >= (uint64_t) limiter->latency_avg) {
+            limiter->limit *= FLB_OUTPUT_LIMITER_BACKOFF;
+            limiter->ts_last_decrease = now;
+        }
+    }
+    else if (saturated) {
+        limiter->limit += 1.0 / limiter->limit;
+    }
+
+    if (limiter->limit < limiter->min) {
+        limiter->limit = limiter->min;
+    }
+    else if (limiter->limit > limiter->max) {
+        limiter->limit = limiter->max;
+    }
+}
+
+static void limiter_metrics_update(struct flb_output_instance *ins)
+{
+#ifdef FLB_HAVE_METRICS
+    char *name;
+
+    if (ins->cmt_concurrency_limit) {
+        name = (char *) flb_output_name(ins);
+        cmt_gauge_set(ins->cmt_concurrency_limit, cfl_time_now(),
+                      (int) ins->limiter->limit, 1, (char *[]) {name});
+    }
+#endif
+}
+
+/* Start queued tasks while there are free slots */
+static void limiter_flush_pending(struct flb_output_instance *ins)
+{
+    int ret;
+    struct flb_task_enqueued *queued_task;
+    struct flb_output_limiter *limiter;
+
+    limiter = ins->limiter;
+
+    while (limiter->in_flight < (int) limiter->limit &&
+           mk_list_is_empty(&limiter->queue->pending) != 0) {
+        queued_task = mk_list_entry_first(&limiter->queue->pending,
+                                          struct flb_task_enqueued, _head);
+        mk_list_del(&queued_task->_head);
+        mk_list_add(&queued_task->_head, &limiter->queue->in_progress);
+
+        queued_task->ts_start = cfl_time_now();
+        limiter->in_flight++;
+
+        /* the flush takes its own user reference if it succeeds */
+        flb_task_users_dec(queued_task->task, FLB_FALSE);
+        ret = flb_output_task_flush(queued_task->task, ins,
+                                    queued_task->config);
+        if (ret == -1) {
+            if (queued_task->retry) {
+                flb_task_retry_destroy(queued_task->retry);
+            }
+            mk_list_del(&queued_task->_head);
+            flb_free(queued_task);
+            limiter->in_flight--;
+        }
+    }
+}
+
+/*
+ * Queue a task for the output instance and start it if the concurrency
+ * limit allows it. Deletes the retry context if enqueue fails.
+ */
+int flb_output_limiter_enqueue(struct flb_output_instance *ins,
+                               struct flb_task_retry *retry,
+                               struct flb_task *task,
+                               struct flb_config *config)
+{
+    struct flb_task_enqueued *queued_task;
+
+    queued_task = flb_calloc(1, sizeof(struct flb_task_enqueued));
+    if (!queued_task) {
+        flb_errno();
+        if (retry) {
+            flb_task_retry_destroy(retry);
+        }
+        return -1;
+    }
+    queued_task->retry = retry;
+    queued_task->out_instance = ins;
+    queued_task->task = task;
+    queued_task->config = config;
+
+    /* temporary user: keep the task alive while it waits in the queue */
+    flb_task_users_inc(task);
+
+    mk_list_add(&queued_task->_head, &ins->limiter->queue->pending);
+
+    limiter_flush_pending(ins);
+
+    return 0;
+}
+
+/* A flush finished with 'ret': adapt the limit and start waiting tasks */
+void flb_output_limiter_done(struct flb_output_instance *ins,
+                             struct flb_task *task, int ret)
+{
+    uint64_t now;
+    struct mk_list *head;
+    struct flb_task_enqueued *queued_task;
+    struct flb_output_limiter *limiter;
+
+    limiter = ins->limiter;
+
+    mk_list_foreach(head, &limiter->queue->in_progress) {
+        queued_task = mk_list_entry(head, struct flb_task_enqueued, _head);
+        if (queued_task->task != task) {
+            continue;
+        }
+
+        now = cfl_time_now();
+        flb_output_limiter_update(limiter, now, now - queued_task->ts_start, ret);
+
+        mk_list_del(&queued_task->_head);
+        flb_free(queued_task);
+        limiter->in_flight--;
+
+        flb_debug("[output] %s concurrency limit=%.2f in_flight=%i "
+                  "latency=%.2fms",
+                  flb_output_name(ins), limiter->limit, limiter->in_flight,
+                  limiter->latency_avg / 1000000.0);
+        limiter_metrics_update(ins);
+        break;
+    }
+
+    limiter_flush_pending(ins);
+}
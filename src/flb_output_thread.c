@@ -59,6 +59,17 @@ static void cb_thread_sched_timer(struct flb_config *ctx, void *data)
     flb_upstream_conn_timeouts(&ins->upstreams);
 }
 
+/* Establish warm upstream connections, it runs in a coroutine context */
+static void cb_thread_upstream_warmup(struct flb_config *ctx, void *data)
+{
+    (void) ctx;
+    struct flb_output_instance *ins;
+
+    ins = (struct flb_output_instance *) data;
+    flb_upstream_conn_warmup(&ins->upstreams);
+    flb_sched_timer_cb_coro_return();
+}
+
 static inline int handle_output_event(struct flb_config *config,
                                       int ch_parent, flb_pipefd_t fd)
 {
@@ -229,6 +240,18 @@ static void output_thread(void *data)
         return;
     }
 
+    /* Keep the warm upstream connections requested by 'net.warm_connections' */
+    if (flb_upstream_conn_warmup_enabled(&ins->upstreams)) {
+        ret = flb_sched_timer_coro_cb_create(sched,
+                                             FLB_SCHED_TIMER_CB_PERM,
+                                             1500, cb_thread_upstream_warmup,
+                                             ins, NULL);
+        if (ret == -1) {
+            flb_plg_error(ins, "could not schedule upstream warm up callback");
+            return;
+        }
+    }
+
     snprintf(tmp, sizeof(tmp) - 1, "flb-out-%s-w%i", ins->name, thread_id);
     mk_utils_worker_rename(tmp);
 
@@ -112,6 +112,12 @@ int flb_parser_logfmt_do(struct flb_parser *parser,
                          void **out_buf, size_t *out_size,
                          struct flb_time *out_time);
 
+int flb_parser_syslog_format(struct flb_parser *parser);
+int flb_parser_syslog_do(struct flb_parser *parser,
+                         const char *buf, size_t length,
+                         void **out_buf, size_t *out_size,
+                         struct flb_time *out_time);
+
 /*
  * This function is used to free all aspects of a parser
  * which is provided by the caller of flb_create_parser.
@@ -344,6 +350,10 @@ struct flb_parser *flb_parser_create(const char *name, const char *format,
     p->logfmt_no_bare_keys = logfmt_no_bare_keys;
     p->types = types;
     p->types_len = types_len;
+
+    /* stock syslog patterns get a native decoder */
+    p->syslog_format = flb_parser_syslog_format(p);
+
     return p;
 }
 
@@ -991,7 +1001,17 @@ int flb_parser_do(struct flb_parser *parser, const char *buf, size_t length,
                   void **out_buf, size_t *out_size, struct flb_time *out_time)
 {
 
+    int ret;
+
     if (parser->type == FLB_PARSER_REGEX) {
+        if (parser->syslog_format != FLB_PARSER_SYSLOG_NONE) {
+            ret = flb_parser_syslog_do(parser, buf, length,
+                                       out_buf, out_size, out_time);
+            if (ret >= 0) {
+                return ret;
+            }
+            /* malformed or unusual message, let the regex handle it */
+        }
         return flb_parser_regex_do(parser, buf, length,
                                    out_buf, out_size, out_time);
     }
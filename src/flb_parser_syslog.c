@@ -0,0 +1,602 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2024 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <time.h>
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_parser.h>
+
+#include <msgpack.h>
+
+/*
+ * Native decoders for the syslog parsers shipped in conf/parsers.conf. They
+ * produce exactly the same record and timestamp than the regex engine for
+ * well formed messages and give up (-1) on anything else, so the caller can
+ * fallback to the regex which handles all the corner cases.
+ */
+
+#define SYSLOG_RFC5424_REGEX                                              \
+    "^\\<(?<pri>[0-9]{1,5})\\>1 (?<time>[^ ]+) (?<host>[^ ]+) "           \
+    "(?<ident>[^ ]+) (?<pid>[-0-9]+) (?<msgid>[^ ]+) "                    \
+    "(?<extradata>(\\[(.*?)\\]|-)) (?<message>.+)$"
+#define SYSLOG_RFC5424_TIME    "%Y-%m-%dT%H:%M:%S.%L%z"
+
+#define SYSLOG_RFC3164_LOCAL_REGEX                                        \
+    "^\\<(?<pri>[0-9]+)\\>(?<time>[^ ]* {1,2}[^ ]* [^ ]*) "               \
+    "(?<ident>[a-zA-Z0-9_\\/\\.\\-]*)(?:\\[(?<pid>[0-9]+)\\])?"           \
+    "(?:[^\\:]*\\:)? *(?<message>.*)$"
+
+#define SYSLOG_RFC3164_REGEX                                              \
+    "/^\\<(?<pri>[0-9]+)\\>(?<time>[^ ]* {1,2}[^ ]* [^ ]*) (?<host>[^ ]*) " \
+    "(?<ident>[a-zA-Z0-9_\\/\\.\\-]*)(?:\\[(?<pid>[0-9]+)\\])?"           \
+    "(?:[^\\:]*\\:)? *(?<message>.*)$/"
+#define SYSLOG_RFC3164_TIME    "%b %d %H:%M:%S"
+
+/* Record fields, in the order the regex reports them */
+enum {
+    SYSLOG_PRI = 0,
+    SYSLOG_TIME,
+    SYSLOG_HOST,
+    SYSLOG_IDENT,
+    SYSLOG_PID,
+    SYSLOG_MSGID,
+    SYSLOG_EXTRADATA,
+    SYSLOG_MESSAGE,
+    SYSLOG_FIELDS
+};
+
+static const char *syslog_field_names[SYSLOG_FIELDS] = {
+    "pri", "time", "host", "ident", "pid", "msgid", "extradata", "message"
+};
+
+struct syslog_field {
+    int set;
+    const char *ptr;
+    size_t len;
+};
+
+static const char *syslog_months[12] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+int flb_parser_syslog_format(struct flb_parser *parser)
+{
+    int format;
+    const char *time_fmt;
+
+    if (parser->type != FLB_PARSER_REGEX || parser->p_regex == NULL) {
+        return FLB_PARSER_SYSLOG_NONE;
+    }
+
+    if (strcmp(parser->p_regex, SYSLOG_RFC5424_REGEX) == 0) {
+        format = FLB_PARSER_SYSLOG_RFC5424;
+        time_fmt = SYSLOG_RFC5424_TIME;
+    }
+    else if (strcmp(parser->p_regex, SYSLOG_RFC3164_REGEX) == 0) {
+        format = FLB_PARSER_SYSLOG_RFC3164;
+        time_fmt = SYSLOG_RFC3164_TIME;
+    }
+    else if (strcmp(parser->p_regex, SYSLOG_RFC3164_LOCAL_REGEX) == 0) {
+        format = FLB_PARSER_SYSLOG_RFC3164_LOCAL;
+        time_fmt = SYSLOG_RFC3164_TIME;
+    }
+    else {
+        return FLB_PARSER_SYSLOG_NONE;
+    }
+
+    /* the record layout and time handling must be the stock ones */
+    if (parser->time_fmt_full == NULL ||
+        strcmp(parser->time_fmt_full, time_fmt) != 0 ||
+        parser->time_key == NULL ||
+        strcmp(parser->time_key, "time") != 0 ||
+        parser->types_len != 0 ||
+        parser->decoders != NULL) {
+        return FLB_PARSER_SYSLOG_NONE;
+    }
+
+    return format;
+}
+
+static inline int is_digit(char c)
+{
+    return (c >= '0' && c <= '9');
+}
+
+/* Read exactly 'n' digits */
+static inline int read_num(const char *p, int n, int *out)
+{
+    int i;
+    int val = 0;
+
+    for (i = 0; i < n; i++) {
+        if (!is_digit(p[i])) {
+            return -1;
+        }
+        val = (val * 10) + (p[i] - '0');
+    }
+
+    *out = val;
+    return 0;
+}
+
+/* Read 'hh:mm:ss' */
+static int read_clock(const char *p, const char *end, struct flb_tm *tm)
+{
+    if (end - p < 8 || p[2] != ':' || p[5] != ':') {
+        return -1;
+    }
+
+    if (read_num(p, 2, &tm->tm.tm_hour) == -1 ||
+        read_num(p + 3, 2, &tm->tm.tm_min) == -1 ||
+        read_num(p + 6, 2, &tm->tm.tm_sec) == -1) {
+        return -1;
+    }
+
+    if (tm->tm.tm_hour > 23 || tm->tm.tm_min > 59 || tm->tm.tm_sec > 60) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* RFC5424 timestamp: 2003-10-11T22:14:15.003Z or 2003-08-24T05:14:15.000003-07:00 */
+static int time_rfc5424(struct flb_parser *parser, const char *p, size_t len,
+                        struct flb_time *out_time)
+{
+    int n;
+    int hour;
+    int min;
+    int offset;
+    double frac;
+    uint64_t digits;
+    uint64_t scale;
+    const char *end = p + len;
+    struct flb_tm tm = {0};
+
+    if (len < 21 || p[4] != '-' || p[7] != '-' || p[10] != 'T' || p[19] != '.') {
+        return -1;
+    }
+
+    if (read_num(p, 4, &n) == -1) {
+        return -1;
+    }
+    tm.tm.tm_year = n - 1900;
+
+    if (read_num(p + 5, 2, &n) == -1 || n < 1 || n > 12) {
+        return -1;
+    }
+    tm.tm.tm_mon = n - 1;
+
+    if (read_num(p + 8, 2, &tm.tm.tm_mday) == -1 ||
+        tm.tm.tm_mday < 1 || tm.tm.tm_mday > 31) {
+        return -1;
+    }
+
+    if (read_clock(p + 11, end, &tm) == -1) {
+        return -1;
+    }
+
+    /* fractional seconds, up to nanoseconds */
+    p += 20;
+    digits = 0;
+    scale = 1;
+    for (n = 0; p < end && is_digit(*p); n++, p++) {
+        if (n == 9) {
+            return -1;
+        }
+        digits = (digits * 10) + (*p - '0');
+        scale *= 10;
+    }
+    if (n == 0) {
+        return -1;
+    }
+    frac = (double) digits / (double) scale;
+
+    /* zone */
+    if (end - p == 1 && *p == 'Z') {
+        offset = 0;
+    }
+    else if ((end - p == 6 && p[3] == ':') || end - p == 5) {
+        if (*p != '+' && *p != '-') {
+            return -1;
+        }
+        if (read_num(p + 1, 2, &hour) == -1 ||
+            read_num(end - 2, 2, &min) == -1) {
+            return -1;
+        }
+        offset = (hour * 3600) + (min * 60);
+        if (*p == '-') {
+            offset = -offset;
+        }
+    }
+    else {
+        return -1;
+    }
+
+    flb_tm_gmtoff(&tm) = offset;
+
+    out_time->tm.tv_sec = flb_parser_tm2time(&tm, parser->time_system_timezone);
+    out_time->tm.tv_nsec = (frac * 1000000000);
+
+    return 0;
+}
+
+/* RFC3164 timestamp: 'Oct 11 22:14:15' or 'Oct  1 22:14:15', the year is now */
+static int time_rfc3164(struct flb_parser *parser, const char *p, size_t len,
+                        struct flb_time *out_time)
+{
+    int i;
+    time_t now;
+    struct tm tm_now;
+    const char *end = p + len;
+    struct flb_tm tm = {0};
+
+    if (len < 14) {
+        return -1;
+    }
+
+    for (i = 0; i < 12; i++) {
+        if (memcmp(p, syslog_months[i], 3) == 0) {
+            break;
+        }
+    }
+    if (i == 12 || p[3] != ' ') {
+        return -1;
+    }
+    tm.tm.tm_mon = i;
+    p += 4;
+
+    if (*p == ' ') {
+        p++;
+    }
+
+    if (is_digit(p[0]) && is_digit(p[1])) {
+        read_num(p, 2, &tm.tm.tm_mday);
+        p += 2;
+    }
+    else if (is_digit(p[0])) {
+        read_num(p, 1, &tm.tm.tm_mday);
+        p++;
+    }
+    else {
+        return -1;
+    }
+
+    if (tm.tm.tm_mday < 1 || tm.tm.tm_mday > 31 || *p != ' ') {
+        return -1;
+    }
+    p++;
+
+    if (end - p != 8 || read_clock(p, end, &tm) == -1) {
+        return -1;
+    }
+
+    now = time(NULL);
+    gmtime_r(&now, &tm_now);
+    tm.tm.tm_year = tm_now.tm_year;
+
+    flb_tm_gmtoff(&tm) = parser->time_offset;
+
+    out_time->tm.tv_sec = flb_parser_tm2time(&tm, parser->time_system_timezone);
+    out_time->tm.tv_nsec = 0;
+
+    return 0;
+}
+
+/* Read a run of bytes other than space, returns its end */
+static inline const char *token_end(const char *p, const char *end)
+{
+    while (p < end && *p != ' ') {
+        p++;
+    }
+    return p;
+}
+
+static inline void field_set(struct syslog_field *f, const char *start,
+                             const char *end)
+{
+    f->set = FLB_TRUE;
+    f->ptr = start;
+    f->len = end - start;
+}
+
+static inline int is_ident_char(char c)
+{
+    return ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+            is_digit(c) || c == '_' || c == '/' || c == '.' || c == '-');
+}
+
+static int decode_rfc5424(const char *buf, size_t length,
+                          struct syslog_field *fields, const char **header_end)
+{
+    int i;
+    const char *p = buf;
+    const char *q;
+    const char *end = buf + length;
+
+    /* <pri>1 */
+    if (p >= end || *p != '<') {
+        return -1;
+    }
+    q = ++p;
+    while (p < end && is_digit(*p) && p - q < 5) {
+        p++;
+    }
+    if (p == q || end - p < 3 || p[0] != '>' || p[1] != '1' || p[2] != ' ') {
+        return -1;
+    }
+    field_set(&fields[SYSLOG_PRI], q, p);
+    p += 3;
+
+    /* time, host, ident */
+    for (i = SYSLOG_TIME; i <= SYSLOG_IDENT; i++) {
+        q = p;
+        p = token_end(p, end);
+        if (p == q || p == end) {
+            return -1;
+        }
+        field_set(&fields[i], q, p);
+        p++;
+    }
+
+    /* pid */
+    q = p;
+    while (p < end && (is_digit(*p) || *p == '-')) {
+        p++;
+    }
+    if (p == q || p == end || *p != ' ') {
+        return -1;
+    }
+    field_set(&fields[SYSLOG_PID], q, p);
+    p++;
+
+    /* msgid */
+    q = p;
+    p = token_end(p, end);
+    if (p == q || p == end) {
+        return -1;
+    }
+    field_set(&fields[SYSLOG_MSGID], q, p);
+    p++;
+
+    /*
+     * structured data: the shortest '[...]' followed by a space and a non
+     * empty message, or a nil value '-'.
+     */
+    q = p;
+    if (p < end && *p == '[') {
+        p++;
+        while (p < end && !(p[0] == ']' && end - p > 2 && p[1] == ' ')) {
+            p++;
+        }
+        if (p == end) {
+            return -1;
+        }
+        p++;
+    }
+    else if (end - p > 2 && p[0] == '-' && p[1] == ' ') {
+        p++;
+    }
+    else {
+        return -1;
+    }
+    field_set(&fields[SYSLOG_EXTRADATA], q, p);
+    p++;
+
+    field_set(&fields[SYSLOG_MESSAGE], p, end);
+    *header_end = p;
+
+    return 0;
+}
+
+static int decode_rfc3164(const char *buf, size_t length, int with_host,
+                          struct syslog_field *fields, const char **header_end)
+{
+    const char *p = buf;
+    const char *q;
+    const char *end = buf + length;
+
+    /* <pri> */
+    if (p >= end || *p != '<') {
+        return -1;
+    }
+    q = ++p;
+    while (p < end && is_digit(*p)) {
+        p++;
+    }
+    if (p == q || p == end || *p != '>') {
+        return -1;
+    }
+    field_set(&fields[SYSLOG_PRI], q, p);
+    p++;
+
+    /* time: three space separated tokens, the first gap can be two spaces */
+    q = p;
+    p = token_end(p, end);
+    if (p == end) {
+        return -1;
+    }
+    p++;
+    if (p < end && *p == ' ') {
+        p++;
+    }
+    p = token_end(p, end);
+    if (p == end) {
+        return -1;
+    }
+    p = token_end(p + 1, end);
+    if (p == end) {
+        return -1;
+    }
+    field_set(&fields[SYSLOG_TIME], q, p);
+    p++;
+
+    /* host */
+    if (with_host) {
+        q = p;
+        p = token_end(p, end);
+        if (p == end) {
+            return -1;
+        }
+        field_set(&fields[SYSLOG_HOST], q, p);
+        p++;
+    }
+
+    /* ident */
+    q = p;
+    while (p < end && is_ident_char(*p)) {
+        p++;
+    }
+    field_set(&fields[SYSLOG_IDENT], q, p);
+
+    /* optional [pid], reported empty when missing */
+    field_set(&fields[SYSLOG_PID], p, p);
+    if (p < end && *p == '[') {
+        q = p + 1;
+        while (q < end && is_digit(*q)) {
+            q++;
+        }
+        if (q > p + 1 && q < end && *q == ']') {
+            field_set(&fields[SYSLOG_PID], p + 1, q);
+            p = q + 1;
+        }
+    }
+
+    /* optional text up to the first colon */
+    for (q = p; q < end && *q != ':'; q++) {
+        if ((unsigned char) *q >= 0x80) {
+            return -1;
+        }
+    }
+    if (q < end) {
+        p = q + 1;
+    }
+
+    while (p < end && *p == ' ') {
+        p++;
+    }
+
+    field_set(&fields[SYSLOG_MESSAGE], p, end);
+    *header_end = p;
+
+    return 0;
+}
+
+int flb_parser_syslog_do(struct flb_parser *parser,
+                         const char *buf, size_t length,
+                         void **out_buf, size_t *out_size,
+                         struct flb_time *out_time)
+{
+    int i;
+    int ret;
+    int count;
+    size_t size;
+    const char *p;
+    const char *header_end;
+    struct syslog_field fields[SYSLOG_FIELDS] = {{0}};
+    struct syslog_field *f;
+    msgpack_sbuffer mp_sbuf;
+    msgpack_packer mp_pck;
+
+    /* the regex stops at the first line break */
+    if (memchr(buf, '\n', length) != NULL) {
+        return -1;
+    }
+
+    if (parser->syslog_format == FLB_PARSER_SYSLOG_RFC5424) {
+        ret = decode_rfc5424(buf, length, fields, &header_end);
+    }
+    else {
+        ret = decode_rfc3164(buf, length,
+                             parser->syslog_format == FLB_PARSER_SYSLOG_RFC3164,
+                             fields, &header_end);
+    }
+    if (ret == -1) {
+        return -1;
+    }
+
+    /*
+     * Multibyte sequences can change how the regex splits the header, only
+     * the message is allowed to carry them.
+     */
+    for (p = buf; p < header_end; p++) {
+        if ((unsigned char) *p >= 0x80) {
+            return -1;
+        }
+    }
+
+    f = &fields[SYSLOG_TIME];
+    if (parser->syslog_format == FLB_PARSER_SYSLOG_RFC5424) {
+        ret = time_rfc5424(parser, f->ptr, f->len, out_time);
+    }
+    else {
+        ret = time_rfc3164(parser, f->ptr, f->len, out_time);
+    }
+    if (ret == -1) {
+        return -1;
+    }
+
+    if (parser->time_keep == FLB_FALSE) {
+        f->set = FLB_FALSE;
+    }
+
+    /* size the buffer for the whole record */
+    count = 0;
+    size = 5;
+    for (i = 0; i < SYSLOG_FIELDS; i++) {
+        f = &fields[i];
+        if (f->set && f->len == 0 && parser->skip_empty) {
+            f->set = FLB_FALSE;
+        }
+        if (f->set) {
+            count++;
+            size += 1 + strlen(syslog_field_names[i]) + 5 + f->len;
+        }
+    }
+
+    mp_sbuf.data = flb_malloc(size);
+    if (!mp_sbuf.data) {
+        flb_errno();
+        return -1;
+    }
+    mp_sbuf.size = 0;
+    mp_sbuf.alloc = size;
+    msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
+
+    msgpack_pack_map(&mp_pck, count);
+    for (i = 0; i < SYSLOG_FIELDS; i++) {
+        f = &fields[i];
+        if (!f->set) {
+            continue;
+        }
+        size = strlen(syslog_field_names[i]);
+        msgpack_pack_str(&mp_pck, size);
+        msgpack_pack_str_body(&mp_pck, syslog_field_names[i], size);
+        msgpack_pack_str(&mp_pck, f->len);
+        msgpack_pack_str_body(&mp_pck, f->ptr, f->len);
+    }
+
+    *out_buf = mp_sbuf.data;
+    *out_size = mp_sbuf.size;
+
+    return length;
+}
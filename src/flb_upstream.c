@@ -107,7 +107,17 @@ struct flb_config_map upstream_net[] = {
     {
      FLB_CONFIG_MAP_INT, "net.max_worker_connections", "0",
      0, FLB_TRUE, offsetof(struct flb_net_setup, max_worker_connections),
-     "Set the maximum number of active TCP connections that can be used per worker thread."
+     "Set the maximum number of active TCP connections that can be used per worker thread. "
+     "With HTTP/2 it limits the number of concurrent requests multiplexed over them."
+    },
+
+    {
+     FLB_CONFIG_MAP_INT, "net.warm_connections", "0",
+     0, FLB_TRUE, offsetof(struct flb_net_setup, warm_connections),
+     "Set the number of idle keepalive connections that are established ahead "
+     "of time and kept open per worker thread, so flushes do not wait for "
+     "connect and TLS handshakes. It is capped by net.max_worker_connections. "
+     "Zero disables it."
     },
 
     /* EOF */
@@ -189,6 +199,7 @@ void flb_upstream_queue_init(struct flb_upstream_queue *uq)
     mk_list_init(&uq->av_queue);
     mk_list_init(&uq->busy_queue);
     mk_list_init(&uq->destroy_queue);
+    uq->warming = 0;
 }
 
 struct flb_upstream_queue *flb_upstream_queue_get(struct flb_upstream *u)
@@ -634,6 +645,10 @@ int flb_upstream_destroy(struct flb_upstream *u)
         destroy_conn(u_conn);
     }
 
+#ifdef FLB_HAVE_TLS
+    flb_tls_session_cache_destroy(u->base.tls_context, &u->tls_session_cache);
+#endif
+
     flb_free(u->tcp_host);
     flb_free(u->proxied_host);
     flb_free(u->proxy_username);
@@ -654,9 +669,93 @@ int flb_upstream_conn_recycle(struct flb_connection *conn, int val)
     return -1;
 }
 
+/*
+ * Number of warm connections to keep for an upstream, it never goes beyond
+ * 'net.max_worker_connections' when that limit is set.
+ */
+static int upstream_warm_connections(struct flb_upstream *u)
+{
+    int max;
+    int warm;
+
+    warm = u->base.net.warm_connections;
+    max = u->base.net.max_worker_connections;
+
+    if (max > 0 && warm > max) {
+        return max;
+    }
+
+    return warm;
+}
+
+/*
+ * Look for a busy connection that still accepts more concurrent streams,
+ * the protocol layer sets 'stream_limit' once the session is established.
+ *
+ * When 'net.max_worker_connections' is set it bounds the number of
+ * concurrent requests (streams) of the worker, not only its sockets, so
+ * multiplexing cannot be used to bypass it: 'limited' is set if the limit
+ * was reached.
+ */
+static struct flb_connection *upstream_conn_shared_get(struct flb_upstream *u,
+                                                       struct flb_upstream_queue *uq,
+                                                       int *limited)
+{
+    int streams;
+    struct mk_list *head;
+    struct flb_connection *conn;
+    struct flb_connection *found;
+
+    found = NULL;
+    streams = 0;
+    *limited = FLB_FALSE;
+
+    flb_stream_acquire_lock(&u->base, FLB_TRUE);
+
+    mk_list_foreach(head, &uq->busy_queue) {
+        conn = mk_list_entry(head, struct flb_connection, _head);
+
+        if (conn->stream_count > 1) {
+            streams += conn->stream_count;
+        }
+        else {
+            streams++;
+        }
+
+        if (found == NULL &&
+            conn->fd > -1 &&
+            conn->net_error == -1 &&
+            conn->recycle == FLB_TRUE &&
+            conn->stream_count > 0 &&
+            conn->stream_count < conn->stream_limit) {
+            found = conn;
+        }
+    }
+
+    if (u->base.net.max_worker_connections > 0 &&
+        streams >= u->base.net.max_worker_connections) {
+        *limited = FLB_TRUE;
+        found = NULL;
+    }
+    else if (found != NULL) {
+        found->stream_count++;
+    }
+
+    flb_stream_release_lock(&u->base);
+
+    if (found != NULL) {
+        flb_trace("[upstream] connection #%i to %s:%i shared (%i/%i streams)",
+                  found->fd, u->tcp_host, u->tcp_port,
+                  found->stream_count, found->stream_limit);
+    }
+
+    return found;
+}
+
 struct flb_connection *flb_upstream_conn_get(struct flb_upstream *u)
 {
     int err;
+    int limited;
     int total_connections = 0;
     struct mk_list *tmp;
     struct mk_list *head;
@@ -679,6 +778,26 @@ struct flb_connection *flb_upstream_conn_get(struct flb_upstream *u)
               u->base.net.max_worker_connections);
 
 
+    /*
+     * Multiplexed connections (HTTP/2) stay in the busy queue while they are
+     * in use, but they can still serve more streams: share one of them before
+     * checking limits or creating a new connection.
+     */
+    if (flb_stream_is_http2(&u->base) && u->base.net.keepalive) {
+        conn = upstream_conn_shared_get(u, uq, &limited);
+        if (conn != NULL) {
+            flb_connection_reset_io_timeout(conn);
+            return conn;
+        }
+        else if (limited == FLB_TRUE) {
+            flb_debug("[upstream] max worker connections=%i reached to: %s:%i, "
+                      "no stream available",
+                      u->base.net.max_worker_connections,
+                      u->tcp_host, u->tcp_port);
+            return NULL;
+        }
+    }
+
     /* If the upstream is limited by max connections, check current state */
     if (u->base.net.max_worker_connections > 0) {
         /*
@@ -774,6 +893,7 @@ struct flb_connection *flb_upstream_conn_get(struct flb_upstream *u)
     }
 
     if (conn != NULL) {
+        conn->stream_count = 1;
         flb_connection_reset_io_timeout(conn);
         flb_upstream_increment_busy_connections_count(u);
     }
@@ -803,6 +923,16 @@ int flb_upstream_conn_release(struct flb_connection *conn)
     struct flb_upstream *u = conn->upstream;
     struct flb_upstream_queue *uq;
 
+    /* Shared connection: only the last user hands it back */
+    flb_stream_acquire_lock(&u->base, FLB_TRUE);
+    if (conn->stream_count > 1) {
+        conn->stream_count--;
+        flb_stream_release_lock(&u->base);
+        return 0;
+    }
+    conn->stream_count = 0;
+    flb_stream_release_lock(&u->base);
+
     flb_upstream_decrement_busy_connections_count(u);
 
     uq = flb_upstream_queue_get(u);
@@ -873,6 +1003,7 @@ int flb_upstream_conn_timeouts(struct mk_list *list)
 {
     time_t now;
     int drop;
+    int idle;
     const char *reason;
     struct mk_list *head;
     struct mk_list *u_head;
@@ -986,10 +1117,17 @@ int flb_upstream_conn_timeouts(struct mk_list *list)
         }
 
         /* Check every available Keepalive connection */
+        idle = mk_list_size(&uq->av_queue);
         mk_list_foreach_safe(u_head, tmp, &uq->av_queue) {
             u_conn = mk_list_entry(u_head, struct flb_connection, _head);
 
+            /* warm connections are kept regardless of the idle time */
+            if (idle <= upstream_warm_connections(u)) {
+                break;
+            }
+
             if ((now - u_conn->ts_available) >= u->base.net.keepalive_idle_timeout) {
+                idle--;
                 prepare_destroy_conn(u_conn);
                 flb_debug("[upstream] drop keepalive connection #%i to %s:%i "
                           "(keepalive idle timeout)",
@@ -1003,6 +1141,90 @@ int flb_upstream_conn_timeouts(struct mk_list *list)
     return 0;
 }
 
+/* Check if any upstream of the list requests warm connections */
+int flb_upstream_conn_warmup_enabled(struct mk_list *list)
+{
+    struct mk_list *head;
+    struct flb_upstream *u;
+
+    mk_list_foreach(head, list) {
+        u = mk_list_entry(head, struct flb_upstream, base._head);
+        if (u->base.net.warm_connections > 0 &&
+            u->base.net.keepalive == FLB_TRUE) {
+            return FLB_TRUE;
+        }
+    }
+
+    return FLB_FALSE;
+}
+
+/*
+ * Establish keepalive connections ahead of time so every upstream of the list
+ * has 'net.warm_connections' of them available in the calling worker. It must
+ * run in a coroutine context since connects and TLS handshakes yield.
+ */
+int flb_upstream_conn_warmup(struct mk_list *list)
+{
+    int room;
+    int missing;
+    struct mk_list *head;
+    struct flb_upstream *u;
+    struct flb_connection *conn;
+    struct flb_upstream_queue *uq;
+
+    mk_list_foreach(head, list) {
+        u = mk_list_entry(head, struct flb_upstream, base._head);
+
+        if (u->base.net.warm_connections <= 0 ||
+            u->base.net.keepalive == FLB_FALSE ||
+            !flb_upstream_is_async(u)) {
+            continue;
+        }
+
+        uq = flb_upstream_queue_get(u);
+        if (!uq) {
+            continue;
+        }
+
+        /* connections being established by a previous run count as warm */
+        flb_stream_acquire_lock(&u->base, FLB_TRUE);
+        missing = upstream_warm_connections(u) -
+                  mk_list_size(&uq->av_queue) - uq->warming;
+
+        /* busy connections also count against the worker limit */
+        if (u->base.net.max_worker_connections > 0) {
+            room = u->base.net.max_worker_connections -
+                   mk_list_size(&uq->busy_queue) -
+                   mk_list_size(&uq->av_queue) - uq->warming;
+            if (room < missing) {
+                missing = room;
+            }
+        }
+        flb_stream_release_lock(&u->base);
+
+        while (missing > 0 && !flb_upstream_is_shutting_down(u)) {
+            uq->warming++;
+            conn = create_conn(u);
+            uq->warming--;
+
+            if (!conn) {
+                break;
+            }
+            missing--;
+
+            flb_debug("[upstream] warm connection #%i to %s:%i is ready",
+                      conn->fd, u->tcp_host, u->tcp_port);
+
+            /* hand it over to the available queue */
+            conn->stream_count = 1;
+            flb_upstream_increment_busy_connections_count(u);
+            flb_upstream_conn_release(conn);
+        }
+    }
+
+    return 0;
+}
+
 int flb_upstream_conn_pending_destroy(struct flb_upstream *u)
 {
     struct mk_list *tmp;
@@ -1211,3 +1433,44 @@ static void flb_upstream_decrement_busy_connections_count(
         }
     }
 }
+
+void flb_upstream_set_tls_handshake_metrics(
+        struct flb_upstream *stream,
+        const char *label_value,
+        struct cmt_counter *counter_instance,
+        struct cmt_histogram *histogram_instance)
+{
+    stream->cmt_tls_handshakes_label = label_value;
+    stream->cmt_tls_handshakes = counter_instance;
+    stream->cmt_tls_handshake_seconds = histogram_instance;
+}
+
+/* Account a completed TLS handshake of a connection of this upstream */
+void flb_upstream_tls_handshake_report(struct flb_upstream *stream,
+                                       uint64_t elapsed_ns, int resumed)
+{
+    uint64_t ts;
+    char *label;
+
+    if (stream->parent_upstream != NULL) {
+        stream = (struct flb_upstream *) stream->parent_upstream;
+    }
+
+    label = (char *) stream->cmt_tls_handshakes_label;
+    if (label == NULL) {
+        label = "";
+    }
+
+    ts = cfl_time_now();
+
+    if (stream->cmt_tls_handshakes != NULL) {
+        cmt_counter_inc(stream->cmt_tls_handshakes, ts,
+                        2, (char *[]) {label, resumed ? "true" : "false"});
+    }
+
+    if (stream->cmt_tls_handshake_seconds != NULL) {
+        cmt_histogram_observe(stream->cmt_tls_handshake_seconds, ts,
+                              elapsed_ns / 1000000000.0,
+                              1, (char *[]) {label});
+    }
+}
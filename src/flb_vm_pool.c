@@ -0,0 +1,405 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2024 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_filter.h>
+#include <fluent-bit/flb_vm_pool.h>
+
+#include <cmetrics/cmetrics.h>
+#include <cmetrics/cmt_counter.h>
+#include <cfl/cfl_time.h>
+
+#include <mpack/mpack.h>
+#include <time.h>
+
+/* CPU time consumed by the calling thread */
+static uint64_t thread_cpu_ns()
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0) {
+        return (uint64_t) ts.tv_sec * 1000000000L + ts.tv_nsec;
+    }
+#endif
+    return 0;
+}
+
+static void worker_process(struct flb_vm_pool_worker *w)
+{
+    uint64_t start;
+
+    start = thread_cpu_ns();
+    w->out_buf = NULL;
+    w->out_size = 0;
+    w->ret = w->pool->cb(w->vm, w->buf, w->size,
+                         &w->out_buf, &w->out_size, w->pool->data);
+    w->cpu_ns += thread_cpu_ns() - start;
+}
+
+static void *worker_run(void *data)
+{
+    int ret = 0;
+    struct flb_vm_pool_worker *w = data;
+    struct flb_vm_pool *pool = w->pool;
+
+    if (pool->cb_thread_init) {
+        ret = pool->cb_thread_init(&w->vm, pool->context);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    w->ready = (ret == 0) ? 1 : -1;
+    pthread_cond_broadcast(&pool->cond_done);
+    if (ret != 0) {
+        pthread_mutex_unlock(&pool->lock);
+        return NULL;
+    }
+
+    while (1) {
+        while (!pool->exit && !w->pending) {
+            pthread_cond_wait(&pool->cond_job, &pool->lock);
+        }
+        if (pool->exit) {
+            break;
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        worker_process(w);
+
+        pthread_mutex_lock(&pool->lock);
+        w->pending = FLB_FALSE;
+        pool->running--;
+        if (pool->running == 0) {
+            pthread_cond_signal(&pool->cond_done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (pool->cb_thread_exit) {
+        pool->cb_thread_exit(w->vm, pool->context);
+    }
+
+    return NULL;
+}
+
+struct flb_vm_pool *flb_vm_pool_create(struct flb_filter_instance *ins,
+                                       int size, void **vms,
+                                       flb_vm_pool_cb cb,
+                                       flb_vm_pool_thread_init_cb cb_thread_init,
+                                       flb_vm_pool_thread_exit_cb cb_thread_exit,
+                                       void *context)
+{
+    int i;
+    int ret;
+    int failed = FLB_FALSE;
+    struct flb_vm_pool *pool;
+    struct flb_vm_pool_worker *w;
+
+    if (size < 1 || size > FLB_VM_POOL_MAX) {
+        flb_error("[vm_pool] invalid pool size %i (max %i)",
+                  size, FLB_VM_POOL_MAX);
+        return NULL;
+    }
+
+    pool = flb_calloc(1, sizeof(struct flb_vm_pool));
+    if (!pool) {
+        flb_errno();
+        return NULL;
+    }
+    pool->size = size;
+    pool->cb = cb;
+    pool->cb_thread_init = cb_thread_init;
+    pool->cb_thread_exit = cb_thread_exit;
+    pool->context = context;
+    pool->ins = ins;
+
+    /* without VMs, every VM is created and used by its own thread */
+    pool->first = (vms != NULL) ? 1 : 0;
+
+    pool->workers = flb_calloc(size, sizeof(struct flb_vm_pool_worker));
+    if (!pool->workers) {
+        flb_errno();
+        flb_free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->run_lock, NULL);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond_job, NULL);
+    pthread_cond_init(&pool->cond_done, NULL);
+
+#ifdef FLB_HAVE_METRICS
+    pool->cmt_cpu = cmt_counter_create(ins->cmt,
+                                       "fluentbit", "filter",
+                                       "vm_cpu_seconds_total",
+                                       "CPU time spent by every VM of the filter",
+                                       2, (char *[]) {"name", "vm"});
+#endif
+
+    for (i = 0; i < size; i++) {
+        w = &pool->workers[i];
+        w->id = i;
+        w->vm = vms ? vms[i] : NULL;
+        w->pool = pool;
+    }
+
+    /* the first VM may belong to the calling thread */
+    for (i = pool->first; i < size; i++) {
+        w = &pool->workers[i];
+        ret = pthread_create(&w->tid, NULL, worker_run, w);
+        if (ret != 0) {
+            flb_error("[vm_pool] could not start worker #%i", i);
+            flb_vm_pool_destroy(pool);
+            return NULL;
+        }
+        w->running = FLB_TRUE;
+    }
+
+    /* wait for the workers to set up their VM */
+    pthread_mutex_lock(&pool->lock);
+    for (i = pool->first; i < size; i++) {
+        w = &pool->workers[i];
+        while (w->ready == 0) {
+            pthread_cond_wait(&pool->cond_done, &pool->lock);
+        }
+        if (w->ready == -1) {
+            failed = FLB_TRUE;
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (failed) {
+        flb_error("[vm_pool] could not set up the VMs of the workers");
+        flb_vm_pool_destroy(pool);
+        return NULL;
+    }
+
+    return pool;
+}
+
+#ifdef FLB_HAVE_METRICS
+static void update_metrics(struct flb_vm_pool *pool)
+{
+    int i;
+    char id[16];
+    uint64_t ts;
+    char *name;
+
+    if (!pool->cmt_cpu) {
+        return;
+    }
+
+    ts = cfl_time_now();
+    name = (char *) flb_filter_name(pool->ins);
+    for (i = 0; i < pool->size; i++) {
+        snprintf(id, sizeof(id) - 1, "%i", i);
+        cmt_counter_set(pool->cmt_cpu, ts,
+                        pool->workers[i].cpu_ns / 1000000000.0,
+                        2, (char *[]) {name, id});
+    }
+}
+#endif
+
+/* Split 'data' in up to 'pool->size' slices of whole records */
+static int split_slices(struct flb_vm_pool *pool,
+                        const char *data, size_t bytes)
+{
+    int n = 0;
+    size_t off = 0;
+    size_t start = 0;
+    size_t target;
+    mpack_reader_t reader;
+
+    if (pool->size == 1 || bytes < FLB_VM_POOL_MIN_SLICE) {
+        pool->workers[0].buf = data;
+        pool->workers[0].size = bytes;
+        return 1;
+    }
+
+    target = bytes / pool->size;
+    if (target < FLB_VM_POOL_MIN_SLICE / 2) {
+        target = FLB_VM_POOL_MIN_SLICE / 2;
+    }
+
+    mpack_reader_init_data(&reader, data, bytes);
+    while (mpack_reader_remaining(&reader, NULL) > 0) {
+        mpack_discard(&reader);
+        if (mpack_reader_error(&reader) != mpack_ok) {
+            break;
+        }
+        off = bytes - mpack_reader_remaining(&reader, NULL);
+
+        if (off - start >= target && n < pool->size - 1) {
+            pool->workers[n].buf = data + start;
+            pool->workers[n].size = off - start;
+            start = off;
+            n++;
+        }
+    }
+    mpack_reader_destroy(&reader);
+
+    /* tail, including anything the reader could not parse */
+    if (start < bytes) {
+        pool->workers[n].buf = data + start;
+        pool->workers[n].size = bytes - start;
+        n++;
+    }
+
+    return n;
+}
+
+int flb_vm_pool_run(struct flb_vm_pool *pool,
+                    const void *data, size_t bytes,
+                    void **out_buf, size_t *out_bytes,
+                    void *cb_data)
+{
+    int i;
+    int n;
+    int ret = FLB_FILTER_NOTOUCH;
+    char *buf;
+    size_t size = 0;
+    struct flb_vm_pool_worker *w;
+
+    pthread_mutex_lock(&pool->run_lock);
+
+    pool->data = cb_data;
+    n = split_slices(pool, data, bytes);
+
+    /* hand the slices to the workers */
+    if (n > pool->first) {
+        pthread_mutex_lock(&pool->lock);
+        for (i = pool->first; i < n; i++) {
+            pool->workers[i].pending = FLB_TRUE;
+        }
+        pool->running = n - pool->first;
+        pthread_cond_broadcast(&pool->cond_job);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    if (pool->first == 1) {
+        worker_process(&pool->workers[0]);
+    }
+
+    if (n > pool->first) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->running > 0) {
+            pthread_cond_wait(&pool->cond_done, &pool->lock);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+#ifdef FLB_HAVE_METRICS
+    update_metrics(pool);
+#endif
+
+    /* a single slice, give its result back as it is */
+    if (n == 1) {
+        w = &pool->workers[0];
+        ret = w->ret;
+        if (ret == FLB_FILTER_MODIFIED) {
+            *out_buf = w->out_buf;
+            *out_bytes = w->out_size;
+        }
+        pthread_mutex_unlock(&pool->run_lock);
+        return ret;
+    }
+
+    for (i = 0; i < n; i++) {
+        w = &pool->workers[i];
+        if (w->ret == FLB_FILTER_MODIFIED) {
+            ret = FLB_FILTER_MODIFIED;
+            size += w->out_size;
+        }
+        else {
+            size += w->size;
+        }
+    }
+
+    if (ret == FLB_FILTER_MODIFIED) {
+        buf = NULL;
+        if (size > 0) {
+            buf = flb_malloc(size);
+            if (!buf) {
+                flb_errno();
+                ret = FLB_FILTER_NOTOUCH;
+            }
+        }
+
+        if (ret == FLB_FILTER_MODIFIED) {
+            size = 0;
+            for (i = 0; i < n; i++) {
+                w = &pool->workers[i];
+                if (w->ret == FLB_FILTER_MODIFIED) {
+                    if (w->out_size > 0) {
+                        memcpy(buf + size, w->out_buf, w->out_size);
+                    }
+                    size += w->out_size;
+                }
+                else {
+                    memcpy(buf + size, w->buf, w->size);
+                    size += w->size;
+                }
+            }
+            *out_buf = buf;
+            *out_bytes = size;
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        w = &pool->workers[i];
+        if (w->ret == FLB_FILTER_MODIFIED && w->out_buf) {
+            flb_free(w->out_buf);
+        }
+        w->out_buf = NULL;
+    }
+
+    pthread_mutex_unlock(&pool->run_lock);
+
+    return ret;
+}
+
+void flb_vm_pool_destroy(struct flb_vm_pool *pool)
+{
+    int i;
+
+    if (!pool) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->exit = FLB_TRUE;
+    pthread_cond_broadcast(&pool->cond_job);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->size; i++) {
+        if (pool->workers[i].running) {
+            pthread_join(pool->workers[i].tid, NULL);
+        }
+    }
+
+    pthread_cond_destroy(&pool->cond_job);
+    pthread_cond_destroy(&pool->cond_done);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_mutex_destroy(&pool->run_lock);
+
+    flb_free(pool->workers);
+    flb_free(pool);
+}
@@ -92,6 +92,12 @@ int flb_ml_rule_create(struct flb_ml_parser *ml_parser,
         return -1;
     }
 
+    ret = flb_ml_rule_filter_create(rule, regex_pattern);
+    if (ret == -1) {
+        flb_ml_rule_destroy(rule);
+        return -1;
+    }
+
     /* to_state */
     if (to_state) {
         rule->to_state = flb_sds_create(to_state);
@@ -298,6 +304,17 @@ int flb_ml_rule_init(struct flb_ml_parser *ml_parser)
     return 0;
 }
 
+/* Run the rule regex unless its prefilter discards the content */
+static inline int rule_match(struct flb_ml_rule *rule,
+                             char *buf_data, size_t buf_size)
+{
+    if (!flb_ml_rule_filter_check(&rule->filter, buf_data, buf_size)) {
+        return FLB_FALSE;
+    }
+
+    return flb_regex_match(rule->regex, (unsigned char *) buf_data, buf_size);
+}
+
 /* Search any 'start_state' matching the incoming 'buf_data' */
 static struct flb_ml_rule *try_start_state(struct flb_ml_parser *ml_parser,
                                            char *buf_data, size_t buf_size)
@@ -316,7 +333,7 @@ static struct flb_ml_rule *try_start_state(struct flb_ml_parser *ml_parser,
         }
 
         /* Matched a start_state. Check if we have a regex match */
-        ret = flb_regex_match(rule->regex, (unsigned char *) buf_data, buf_size);
+        ret = rule_match(rule, buf_data, buf_size);
         if (ret) {
             return rule;
         }
@@ -366,8 +383,7 @@ int flb_ml_rule_process(struct flb_ml_parser *ml_parser,
             }
 
             /* Try regex match */
-            ret = flb_regex_match(st->rule->regex,
-                                  (unsigned char *) buf_data, buf_size);
+            ret = rule_match(st->rule, buf_data, buf_size);
             if (ret) {
                 /* Regex matched */
                 len = flb_sds_len(group->buf);
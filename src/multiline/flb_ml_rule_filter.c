@@ -0,0 +1,690 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2024 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/*
+ * Rule prefilters
+ * ===============
+ * Most of the lines processed by a multiline parser do not match any rule,
+ * yet every rule regex runs on every line. When a rule is created we walk
+ * its pattern once and collect two conservative facts:
+ *
+ *  - for patterns anchored with '^': the set of bytes a matching line can
+ *    start with.
+ *  - a set of literal strings, one of them must be present in any match.
+ *
+ * The analysis only understands a safe subset of the Ruby syntax used by
+ * flb_regex (literals, escapes, classes, groups, alternations and
+ * quantifiers). Any other construct (options, look-arounds, back
+ * references, ...) disables the filter, the regex engine is always the one
+ * taking the final decision, a filter can only skip lines that would never
+ * match.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/multiline/flb_ml.h>
+#include <fluent-bit/multiline/flb_ml_rule.h>
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FILTER_MAX_DEPTH   16
+
+struct filter_parser {
+    const char *p;
+    const char *end;
+    int depth;
+    int error;                     /* unsupported construct found */
+};
+
+/* Facts about a (sub)expression */
+struct filter_node {
+    uint8_t first[256];            /* bytes a match can start with     */
+    int nullable;                  /* can match an empty string        */
+    int eol;                       /* '$' reachable from the beginning */
+
+    int count;                     /* required literals, 0: unknown    */
+    int len[FLB_ML_FILTER_LITERALS];
+    char lit[FLB_ML_FILTER_LITERALS][FLB_ML_FILTER_LITERAL_LEN];
+};
+
+static void parse_alt(struct filter_parser *fp, struct filter_node *node);
+
+static void node_init(struct filter_node *node)
+{
+    memset(node->first, 0, sizeof(node->first));
+    node->nullable = FLB_TRUE;
+    node->eol = FLB_FALSE;
+    node->count = 0;
+}
+
+static void set_range(uint8_t *set, int lo, int hi)
+{
+    int c;
+
+    for (c = lo; c <= hi; c++) {
+        set[c] = 1;
+    }
+}
+
+/* Ruby class escapes; multibyte characters might be part of any class */
+static int set_class_escape(uint8_t *set, int c)
+{
+    int i;
+    uint8_t tmp[256];
+
+    memset(tmp, 0, sizeof(tmp));
+
+    switch (tolower(c)) {
+    case 's':
+        tmp[' '] = tmp['\t'] = tmp['\n'] = tmp['\v'] = tmp['\f'] = tmp['\r'] = 1;
+        break;
+    case 'd':
+        set_range(tmp, '0', '9');
+        break;
+    case 'w':
+        set_range(tmp, '0', '9');
+        set_range(tmp, 'a', 'z');
+        set_range(tmp, 'A', 'Z');
+        tmp['_'] = 1;
+        break;
+    case 'h':
+        set_range(tmp, '0', '9');
+        set_range(tmp, 'a', 'f');
+        set_range(tmp, 'A', 'F');
+        break;
+    default:
+        return FLB_FALSE;
+    }
+
+    for (i = 0; i < 256; i++) {
+        if (i >= 0x80 || (isupper(c) ? !tmp[i] : tmp[i])) {
+            set[i] = 1;
+        }
+    }
+
+    return FLB_TRUE;
+}
+
+/* Single byte escapes, returns -1 if 'c' is not one of them */
+static int escape_byte(int c)
+{
+    switch (c) {
+    case 't':
+        return '\t';
+    case 'n':
+        return '\n';
+    case 'r':
+        return '\r';
+    case 'f':
+        return '\f';
+    case 'v':
+        return '\v';
+    case 'a':
+        return '\a';
+    case 'e':
+        return 0x1b;
+    }
+
+    if (c < 0x80 && !isalnum(c)) {
+        return c;
+    }
+
+    return -1;
+}
+
+/* Keep the literal set of 'src' in 'dst' if it is more selective */
+static void literal_candidate(struct filter_node *dst, int count,
+                              int *len, char (*lit)[FLB_ML_FILTER_LITERAL_LEN])
+{
+    int i;
+    int score = -1;
+    int dst_score = -1;
+
+    if (count <= 0) {
+        return;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (score == -1 || len[i] < score) {
+            score = len[i];
+        }
+    }
+    for (i = 0; i < dst->count; i++) {
+        if (dst_score == -1 || dst->len[i] < dst_score) {
+            dst_score = dst->len[i];
+        }
+    }
+
+    if (dst->count > 0 &&
+        (score < dst_score || (score == dst_score && count >= dst->count))) {
+        return;
+    }
+
+    for (i = 0; i < count; i++) {
+        dst->len[i] = len[i];
+        memcpy(dst->lit[i], lit[i], len[i]);
+    }
+    dst->count = count;
+}
+
+/* Bracket expression, 'fp->p' is right after the '[' */
+static void parse_bracket(struct filter_parser *fp, uint8_t *set)
+{
+    int i;
+    int c;
+    int lo;
+    int hi;
+    int first = FLB_TRUE;
+    int closed = FLB_FALSE;
+    int negate = FLB_FALSE;
+    uint8_t tmp[256];
+
+    memset(tmp, 0, sizeof(tmp));
+
+    if (fp->p < fp->end && *fp->p == '^') {
+        negate = FLB_TRUE;
+        fp->p++;
+    }
+
+    while (fp->p < fp->end) {
+        c = (unsigned char) *fp->p;
+        if (c == ']' && !first) {
+            fp->p++;
+            closed = FLB_TRUE;
+            break;
+        }
+        first = FLB_FALSE;
+
+        if (c == '[' || c >= 0x80 ||
+            (c == '&' && fp->p + 1 < fp->end && fp->p[1] == '&')) {
+            /* nested classes, intersections and multibyte characters */
+            fp->error = FLB_TRUE;
+            return;
+        }
+
+        fp->p++;
+        if (c == '\\') {
+            if (fp->p >= fp->end) {
+                fp->error = FLB_TRUE;
+                return;
+            }
+            c = (unsigned char) *fp->p++;
+            if (set_class_escape(tmp, c)) {
+                continue;
+            }
+            c = escape_byte(c);
+            if (c == -1) {
+                fp->error = FLB_TRUE;
+                return;
+            }
+        }
+        lo = c;
+
+        /* range */
+        if (fp->p + 1 < fp->end && fp->p[0] == '-' && fp->p[1] != ']') {
+            fp->p++;
+            hi = (unsigned char) *fp->p++;
+            if (hi == '\\') {
+                if (fp->p >= fp->end) {
+                    fp->error = FLB_TRUE;
+                    return;
+                }
+                hi = escape_byte((unsigned char) *fp->p++);
+            }
+            if (hi == -1 || hi == '[' || hi >= 0x80 || hi < lo) {
+                fp->error = FLB_TRUE;
+                return;
+            }
+            set_range(tmp, lo, hi);
+        }
+        else {
+            tmp[lo] = 1;
+        }
+    }
+
+    if (!closed) {
+        fp->error = FLB_TRUE;
+        return;
+    }
+
+    /* a negated class also matches any multibyte character */
+    for (i = 0; i < 256; i++) {
+        if (negate ? (!tmp[i] || i >= 0x80) : tmp[i]) {
+            set[i] = 1;
+        }
+    }
+}
+
+/* Parse quantifiers after an atom, returns the minimum repetitions */
+static int parse_quantifier(struct filter_parser *fp, int *quantified)
+{
+    int min = 1;
+    int n;
+    const char *p;
+
+    *quantified = FLB_FALSE;
+
+    while (fp->p < fp->end) {
+        if (*fp->p == '*' || *fp->p == '?') {
+            min = 0;
+            fp->p++;
+        }
+        else if (*fp->p == '+') {
+            fp->p++;
+        }
+        else if (*fp->p == '{') {
+            /* {n}, {n,}, {,m} and {n,m}, anything else is a literal '{' */
+            p = fp->p + 1;
+            n = 0;
+            while (p < fp->end && isdigit((unsigned char) *p)) {
+                n = 1;
+                p++;
+            }
+            if (n == 1 && atoi(fp->p + 1) == 0) {
+                n = 0;
+            }
+            if (p < fp->end && *p == ',') {
+                p++;
+                while (p < fp->end && isdigit((unsigned char) *p)) {
+                    p++;
+                }
+            }
+            if (p >= fp->end || *p != '}' || p == fp->p + 1) {
+                break;
+            }
+            if (n == 0) {
+                min = 0;
+            }
+            fp->p = p + 1;
+        }
+        else {
+            break;
+        }
+        *quantified = FLB_TRUE;
+    }
+
+    return min;
+}
+
+/* Sequence of atoms until '|', ')' or the end of the pattern */
+static void parse_seq(struct filter_parser *fp, struct filter_node *node)
+{
+    int i;
+    int c;
+    int min;
+    int quantified;
+    int lit_len;
+    int run_len = 0;
+    int zero_width;
+    char lit[4];
+    char run[1][FLB_ML_FILTER_LITERAL_LEN];
+    struct filter_node *group = NULL;
+    struct filter_node atom;
+
+    node_init(node);
+
+    while (!fp->error && fp->p < fp->end && *fp->p != '|' && *fp->p != ')') {
+        memset(atom.first, 0, sizeof(atom.first));
+        atom.nullable = FLB_FALSE;
+        atom.eol = FLB_FALSE;
+        atom.count = 0;
+        lit_len = 0;
+        zero_width = FLB_FALSE;
+
+        c = (unsigned char) *fp->p++;
+        switch (c) {
+        case '.':
+            set_range(atom.first, 0, 255);
+            break;
+        case '[':
+            parse_bracket(fp, atom.first);
+            break;
+        case '^':
+            zero_width = FLB_TRUE;
+            break;
+        case '$':
+            atom.first['\n'] = 1;
+            atom.eol = FLB_TRUE;
+            break;
+        case '(':
+            if (fp->p < fp->end && *fp->p == '?') {
+                if (fp->p + 1 < fp->end &&
+                    (fp->p[1] == ':' || fp->p[1] == '>')) {
+                    fp->p += 2;
+                }
+                else if (fp->p + 2 < fp->end &&
+                         (fp->p[1] == '<' || fp->p[1] == '\'') &&
+                         fp->p[2] != '=' && fp->p[2] != '!') {
+                    /* named group */
+                    c = (fp->p[1] == '<') ? '>' : '\'';
+                    fp->p += 2;
+                    while (fp->p < fp->end && *fp->p != c) {
+                        fp->p++;
+                    }
+                    fp->p++;
+                }
+                else {
+                    /* options, look-arounds, comments, conditionals... */
+                    fp->error = FLB_TRUE;
+                    break;
+                }
+            }
+            if (fp->depth >= FILTER_MAX_DEPTH) {
+                fp->error = FLB_TRUE;
+                break;
+            }
+            group = flb_malloc(sizeof(struct filter_node));
+            if (!group) {
+                flb_errno();
+                fp->error = FLB_TRUE;
+                break;
+            }
+            fp->depth++;
+            parse_alt(fp, group);
+            fp->depth--;
+            if (fp->p >= fp->end || *fp->p != ')') {
+                fp->error = FLB_TRUE;
+            }
+            else {
+                fp->p++;
+            }
+            memcpy(&atom, group, sizeof(atom));
+            flb_free(group);
+            break;
+        case '\\':
+            if (fp->p >= fp->end) {
+                fp->error = FLB_TRUE;
+                break;
+            }
+            c = (unsigned char) *fp->p++;
+            if (set_class_escape(atom.first, c)) {
+                break;
+            }
+            if (c == 'b' || c == 'B' || c == 'A' ||
+                c == 'z' || c == 'Z' || c == 'G') {
+                zero_width = FLB_TRUE;
+                break;
+            }
+            c = escape_byte(c);
+            if (c == -1) {
+                fp->error = FLB_TRUE;
+                break;
+            }
+            lit[lit_len++] = c;
+            atom.first[c] = 1;
+            break;
+        case '*':
+        case '+':
+        case '?':
+            fp->error = FLB_TRUE;
+            break;
+        default:
+            lit[lit_len++] = c;
+            atom.first[c] = 1;
+
+            /* a multibyte character is a single atom */
+            while (c >= 0xc0 && lit_len < 4 && fp->p < fp->end &&
+                   ((unsigned char) *fp->p & 0xc0) == 0x80) {
+                lit[lit_len++] = *fp->p++;
+            }
+            break;
+        }
+
+        if (fp->error) {
+            return;
+        }
+
+        min = parse_quantifier(fp, &quantified);
+        if (zero_width || min == 0) {
+            atom.nullable = FLB_TRUE;
+        }
+
+        /* bytes the sequence can start with */
+        if (node->nullable && !zero_width) {
+            for (i = 0; i < 256; i++) {
+                node->first[i] |= atom.first[i];
+            }
+            node->eol |= atom.eol;
+            if (!atom.nullable) {
+                node->nullable = FLB_FALSE;
+            }
+        }
+
+        /* required literals: runs of mandatory literal characters */
+        if (lit_len > 0 && min > 0) {
+            for (i = 0; i < lit_len && run_len < FLB_ML_FILTER_LITERAL_LEN; i++) {
+                run[0][run_len++] = lit[i];
+            }
+            if (!quantified) {
+                continue;
+            }
+        }
+
+        if (run_len > 0) {
+            literal_candidate(node, 1, &run_len, run);
+            run_len = 0;
+        }
+        if (lit_len == 0 && min > 0 && atom.count > 0) {
+            literal_candidate(node, atom.count, atom.len, atom.lit);
+        }
+    }
+
+    if (run_len > 0) {
+        literal_candidate(node, 1, &run_len, run);
+    }
+}
+
+/* Merge an alternative: the literal sets of every branch are joined */
+static void merge_alternative(struct filter_node *dst, struct filter_node *src)
+{
+    int i;
+
+    for (i = 0; i < 256; i++) {
+        dst->first[i] |= src->first[i];
+    }
+    dst->nullable |= src->nullable;
+    dst->eol |= src->eol;
+
+    if (dst->count <= 0 || src->count <= 0 ||
+        dst->count + src->count > FLB_ML_FILTER_LITERALS) {
+        dst->count = 0;
+        return;
+    }
+
+    for (i = 0; i < src->count; i++) {
+        dst->len[dst->count] = src->len[i];
+        memcpy(dst->lit[dst->count], src->lit[i], src->len[i]);
+        dst->count++;
+    }
+}
+
+static void parse_alt(struct filter_parser *fp, struct filter_node *node)
+{
+    struct filter_node *alt;
+
+    parse_seq(fp, node);
+    if (fp->error || fp->p >= fp->end || *fp->p != '|') {
+        return;
+    }
+
+    alt = flb_malloc(sizeof(struct filter_node));
+    if (!alt) {
+        flb_errno();
+        fp->error = FLB_TRUE;
+        return;
+    }
+
+    while (!fp->error && fp->p < fp->end && *fp->p == '|') {
+        fp->p++;
+        parse_seq(fp, alt);
+        merge_alternative(node, alt);
+    }
+
+    flb_free(alt);
+}
+
+int flb_ml_rule_filter_create(struct flb_ml_rule *rule, const char *pattern)
+{
+    int i;
+    int anchored = FLB_TRUE;
+    size_t len;
+    struct filter_parser fp;
+    struct filter_node *node;
+    struct filter_node *alt;
+    struct flb_ml_rule_filter *filter = &rule->filter;
+
+    memset(filter, 0, sizeof(struct flb_ml_rule_filter));
+
+    len = strlen(pattern);
+    fp.p = pattern;
+    fp.end = pattern + len;
+    fp.depth = 0;
+    fp.error = FLB_FALSE;
+
+    /* '/pattern/' form; trailing options change the semantics, skip them */
+    if (len > 0 && pattern[0] == '/') {
+        if (len < 2 || pattern[len - 1] != '/') {
+            return 0;
+        }
+        fp.p++;
+        fp.end--;
+    }
+
+    node = flb_malloc(sizeof(struct filter_node) * 2);
+    if (!node) {
+        flb_errno();
+        return -1;
+    }
+    alt = node + 1;
+
+    /* top level alternatives, each one must be anchored */
+    if (fp.p < fp.end && *fp.p == '^') {
+        fp.p++;
+    }
+    else {
+        anchored = FLB_FALSE;
+    }
+    parse_seq(&fp, node);
+    if (node->nullable) {
+        anchored = FLB_FALSE;
+    }
+
+    while (!fp.error && fp.p < fp.end && *fp.p == '|') {
+        fp.p++;
+        if (fp.p < fp.end && *fp.p == '^') {
+            fp.p++;
+        }
+        else {
+            anchored = FLB_FALSE;
+        }
+        parse_seq(&fp, alt);
+        if (alt->nullable) {
+            anchored = FLB_FALSE;
+        }
+        merge_alternative(node, alt);
+    }
+
+    if (fp.error || fp.p != fp.end) {
+        flb_free(node);
+        return 0;
+    }
+
+    if (anchored) {
+        for (i = 0; i < 256; i++) {
+            if (!node->first[i]) {
+                break;
+            }
+        }
+        if (i < 256) {
+            filter->anchored = FLB_TRUE;
+            filter->empty = node->eol;
+            memcpy(filter->first, node->first, sizeof(filter->first));
+        }
+    }
+
+    /* single characters are not worth a scan */
+    for (i = 0; i < node->count; i++) {
+        if (node->len[i] < 2) {
+            break;
+        }
+    }
+    if (node->count > 0 && i == node->count) {
+        filter->literals = node->count;
+        for (i = 0; i < node->count; i++) {
+            filter->literal_len[i] = node->len[i];
+            memcpy(filter->literal[i], node->lit[i], node->len[i]);
+        }
+    }
+
+    flb_free(node);
+    return 0;
+}
+
+static inline int find_literal(const char *buf, size_t size,
+                               const char *lit, int len)
+{
+    const char *p = buf;
+    const char *end = buf + size;
+
+    while ((size_t) (end - p) >= (size_t) len) {
+        p = memchr(p, lit[0], (end - p) - len + 1);
+        if (!p) {
+            return FLB_FALSE;
+        }
+        if (memcmp(p + 1, lit + 1, len - 1) == 0) {
+            return FLB_TRUE;
+        }
+        p++;
+    }
+
+    return FLB_FALSE;
+}
+
+/* Returns FLB_FALSE if the rule regex cannot match 'buf' */
+int flb_ml_rule_filter_check(struct flb_ml_rule_filter *filter,
+                             const char *buf, size_t size)
+{
+    int i;
+
+    if (filter->anchored) {
+        if (size == 0) {
+            if (!filter->empty) {
+                return FLB_FALSE;
+            }
+        }
+        else if (!filter->first[(unsigned char) buf[0]] &&
+                 !memchr(buf, '\n', size)) {
+            /* '^' also matches after a new line */
+            return FLB_FALSE;
+        }
+    }
+
+    if (filter->literals > 0) {
+        for (i = 0; i < filter->literals; i++) {
+            if (find_literal(buf, size, filter->literal[i],
+                             filter->literal_len[i])) {
+                return FLB_TRUE;
+            }
+        }
+        return FLB_FALSE;
+    }
+
+    return FLB_TRUE;
+}
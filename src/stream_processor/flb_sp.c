@@ -30,6 +30,7 @@
 #include <fluent-bit/flb_config_format.h>
 #include <fluent-bit/stream_processor/flb_sp.h>
 #include <fluent-bit/stream_processor/flb_sp_key.h>
+#include <fluent-bit/stream_processor/flb_sp_program.h>
 #include <fluent-bit/stream_processor/flb_sp_stream.h>
 #include <fluent-bit/stream_processor/flb_sp_snapshot.h>
 #include <fluent-bit/stream_processor/flb_sp_parser.h>
@@ -38,6 +39,7 @@
 #include <fluent-bit/stream_processor/flb_sp_aggregate_func.h>
 #include <fluent-bit/stream_processor/flb_sp_window.h>
 #include <fluent-bit/stream_processor/flb_sp_groupby.h>
+#include <fluent-bit/stream_processor/flb_sp_worker.h>
 
 #include <stdlib.h>
 #include <sys/types.h>
@@ -50,10 +52,6 @@
 #define pack_uint16(buf, d) _msgpack_store16(buf, (uint16_t) d)
 #define pack_uint32(buf, d) _msgpack_store32(buf, (uint32_t) d)
 
-/* String type to numerical conversion */
-#define FLB_STR_INT   1
-#define FLB_STR_FLOAT 2
-
 /* Read and process file system configuration file */
 static int sp_config_file(struct flb_config *config, struct flb_sp *sp,
                           const char *file)
@@ -286,7 +284,7 @@ static int sp_cmd_aggregated_keys(struct flb_sp_cmd *cmd)
  * - if output number is a float, 'd' is set and returns FLB_STR_FLOAT
  * - if no conversion is possible (not a number), returns -1
  */
-static int string_to_number(const char *str, int len, int64_t *i, double *d)
+int flb_sp_string_to_number(const char *str, int len, int64_t *i, double *d)
 {
     int c;
     int dots = 0;
@@ -376,7 +374,7 @@ static int object_to_number(msgpack_object obj, int64_t *i, double *d,
         memcpy(str_num, obj.via.str.ptr, obj.via.str.size);
         str_num[obj.via.str.size] = '\0';
 
-        ret = string_to_number(str_num, obj.via.str.size,
+        ret = flb_sp_string_to_number(str_num, obj.via.str.size,
                                &i_out, &d_out);
         if (ret == FLB_STR_FLOAT) {
             *d = d_out;
@@ -475,17 +473,26 @@ struct flb_sp_task *flb_sp_task_create(struct flb_sp *sp, const char *name,
     task->cmd = cmd;
     mk_list_add(&task->_head, &sp->tasks);
 
+    /* Compile the condition, otherwise it is interpreted for every record */
+    if (cmd->condition) {
+        task->condition = flb_sp_program_create(cmd->condition);
+        if (!task->condition) {
+            flb_debug("[sp] task '%s': condition cannot be compiled, "
+                      "it will be interpreted", name);
+        }
+    }
+
     /*
      * Assume no aggregated keys exists, if so, a different strategy is
      * required to process the records.
      */
     task->aggregate_keys = FLB_FALSE;
 
-    mk_list_init(&task->window.data);
-    mk_list_init(&task->window.aggregate_list);
-    rb_tree_new(&task->window.aggregate_tree, flb_sp_groupby_compare);
-
-    mk_list_init(&task->window.hopping_slot);
+    ret = flb_sp_window_init(task);
+    if (ret == -1) {
+        flb_sp_task_destroy(task);
+        return NULL;
+    }
 
     /* Check and validate aggregated keys */
     ret = sp_cmd_aggregated_keys(task->cmd);
@@ -568,25 +575,20 @@ struct flb_sp_task *flb_sp_task_create(struct flb_sp *sp, const char *name,
      * access it when processing data.
      */
     sp_task_to_instance(task, sp);
-    return task;
-}
-
-void groupby_nums_destroy(struct aggregate_num *groupby_nums, int size)
-{
-    int i;
 
-    for (i = 0; i < size; i++) {
-        if (groupby_nums[i].type == FLB_SP_STRING) {
-            flb_sds_destroy(groupby_nums[i].string);
-          }
+    ret = flb_sp_worker_task_init(sp, task);
+    if (ret == -1) {
+        flb_error("[sp] could not partition task '%s'", name);
+        flb_sp_task_destroy(task);
+        return NULL;
     }
 
-    flb_free(groupby_nums);
+    return task;
 }
 
 /*
  * Destroy aggregation node context: before to use this function make sure
- * to unlink from the linked list.
+ * to unlink from the linked list and the GROUP BY table.
  */
 void flb_sp_aggregate_node_destroy(struct flb_sp_cmd *cmd,
                               struct aggregate_node *aggr_node)
@@ -604,7 +606,12 @@ void flb_sp_aggregate_node_destroy(struct flb_sp_cmd *cmd,
         }
     }
 
-    groupby_nums_destroy(aggr_node->groupby_nums, aggr_node->groupby_keys);
+    for (i = 0; i < aggr_node->groupby_keys; i++) {
+        num = &aggr_node->groupby_nums[i];
+        if (num->type == FLB_SP_STRING) {
+            flb_sds_destroy(num->string);
+        }
+    }
 
     key_id = 0;
     mk_list_foreach(head, &cmd->keys) {
@@ -619,57 +626,29 @@ void flb_sp_aggregate_node_destroy(struct flb_sp_cmd *cmd,
         key_id++;
     }
 
-    flb_free(aggr_node->nums);
-    flb_free(aggr_node->aggregate_data);
-    flb_free(aggr_node);
+    flb_sp_groupby_arena_free(aggr_node->arena, aggr_node);
 }
 
-void flb_sp_window_destroy(struct flb_sp_task *task)
+void flb_sp_hopping_slot_destroy(struct flb_sp_cmd *cmd,
+                                 struct flb_sp_hopping_slot *hs)
 {
-    struct flb_sp_window_data *data;
-    struct aggregate_node *aggr_node;
-    struct flb_sp_hopping_slot *hs;
-    struct mk_list *head;
     struct mk_list *tmp;
-    struct mk_list *head_hs;
-    struct mk_list *tmp_hs;
-
-    mk_list_foreach_safe(head, tmp, &task->window.data) {
-        data = mk_list_entry(head, struct flb_sp_window_data, _head);
-        flb_free(data->buf_data);
-        mk_list_del(&data->_head);
-        flb_free(data);
-    }
+    struct mk_list *head;
+    struct aggregate_node *aggr_node;
 
-    mk_list_foreach_safe(head, tmp, &task->window.aggregate_list) {
+    mk_list_foreach_safe(head, tmp, &hs->aggregate_list) {
         aggr_node = mk_list_entry(head, struct aggregate_node, _head);
         mk_list_del(&aggr_node->_head);
-        flb_sp_aggregate_node_destroy(task->cmd, aggr_node);
+        flb_sp_aggregate_node_destroy(cmd, aggr_node);
     }
-
-    mk_list_foreach_safe(head, tmp, &task->window.hopping_slot) {
-        hs = mk_list_entry(head, struct flb_sp_hopping_slot, _head);
-        mk_list_foreach_safe(head_hs, tmp_hs, &hs->aggregate_list) {
-            aggr_node = mk_list_entry(head_hs, struct aggregate_node, _head);
-            mk_list_del(&aggr_node->_head);
-            flb_sp_aggregate_node_destroy(task->cmd, aggr_node);
-        }
-        rb_tree_destroy(&hs->aggregate_tree);
-        flb_free(hs);
-    }
-
-    if (task->window.fd > 0) {
-        mk_event_timeout_destroy(task->sp->config->evl, &task->window.event);
-        mk_event_closesocket(task->window.fd);
-    }
-
-    rb_tree_destroy(&task->window.aggregate_tree);
+    flb_free(hs);
 }
 
 void flb_sp_task_destroy(struct flb_sp_task *task)
 {
     flb_sds_destroy(task->name);
     flb_sds_destroy(task->query);
+    flb_sp_worker_task_destroy(task);
     flb_sp_window_destroy(task);
     flb_sp_snapshot_destroy(task->snapshot);
 
@@ -679,6 +658,7 @@ void flb_sp_task_destroy(struct flb_sp_task *task)
         flb_sp_stream_destroy(task->stream, task->sp);
     }
 
+    flb_sp_program_destroy(task->condition);
     flb_sp_cmd_destroy(task->cmd);
     flb_free(task);
 }
@@ -701,8 +681,17 @@ struct flb_sp *flb_sp_create(struct flb_config *config)
         return NULL;
     }
     sp->config = config;
+    sp->workers_size = 0;
+    sp->workers = NULL;
     mk_list_init(&sp->tasks);
 
+    /* Workers must exist before the tasks are partitioned */
+    ret = flb_sp_workers_create(sp, config->stream_processor_workers);
+    if (ret == -1) {
+        flb_free(sp);
+        return NULL;
+    }
+
     /* Check for pre-configured Tasks (command line) */
     mk_list_foreach(head, &config->stream_processor_tasks) {
         e = mk_list_entry(head, struct flb_slist_entry, _head);
@@ -765,7 +754,7 @@ static void exp_string_to_number(struct flb_exp_val *val)
     len = flb_sds_len(val->val.string);
     str = val->val.string;
 
-    ret = string_to_number(str, len, &i, &d);
+    ret = flb_sp_string_to_number(str, len, &i, &d);
     if (ret == -1) {
         return;
     }
@@ -1115,6 +1104,30 @@ static struct flb_exp_val *reduce_expression(struct flb_exp *expression,
 }
 
 
+/* Returns FLB_TRUE if the record matches the task condition */
+static int condition_match(struct flb_sp_task *task,
+                           const char *tag, int tag_len,
+                           struct flb_time *tms, msgpack_object *map)
+{
+    int ret;
+    struct flb_exp_val *condition;
+
+    if (task->condition) {
+        return flb_sp_program_eval(task->condition, tms, map);
+    }
+
+    condition = reduce_expression(task->cmd->condition,
+                                  tag, tag_len, tms, map);
+    if (!condition) {
+        return FLB_FALSE;
+    }
+
+    ret = condition->val.boolean ? FLB_TRUE : FLB_FALSE;
+    flb_free(condition);
+
+    return ret;
+}
+
 void package_results(const char *tag, int tag_len,
                      char **out_buf, size_t *out_size,
                      struct flb_sp_task *task)
@@ -1235,6 +1248,56 @@ next:
     *out_size = mp_sbuf.size;
 }
 
+static struct aggregate_node *aggregate_node_create(struct flb_sp_task *task)
+{
+    int map_entries;
+    struct aggregate_node *aggr_node;
+
+    aggr_node = flb_sp_groupby_arena_alloc(&task->window.arena);
+    if (!aggr_node) {
+        return NULL;
+    }
+
+    map_entries = mk_list_size(&task->cmd->keys);
+    aggr_node->arena = &task->window.arena;
+    aggr_node->nums_size = map_entries;
+    aggr_node->nums = (struct aggregate_num *) (aggr_node + 1);
+    aggr_node->aggregate_data =
+        (struct aggregate_data **) (aggr_node->nums + map_entries);
+    aggr_node->groupby_nums =
+        (struct aggregate_num *) (aggr_node->aggregate_data + map_entries);
+
+    return aggr_node;
+}
+
+/* Copy the GROUP BY values of the current record into a new node */
+static int groupby_values_copy(struct aggregate_node *aggr_node,
+                               struct flb_sp_groupby_value *values,
+                               int size)
+{
+    int i;
+    struct aggregate_num *num;
+
+    for (i = 0; i < size; i++) {
+        num = &aggr_node->groupby_nums[i];
+        num->type = values[i].type;
+        num->i64 = values[i].i64;
+        num->f64 = values[i].f64;
+
+        if (values[i].type == FLB_SP_STRING) {
+            num->string = flb_sds_create_len(values[i].str,
+                                             values[i].str_len);
+            if (!num->string) {
+                aggr_node->groupby_keys = i;
+                return -1;
+            }
+        }
+    }
+    aggr_node->groupby_keys = size;
+
+    return 0;
+}
+
 static struct aggregate_node * sp_process_aggregate_data(struct flb_sp_task *task,
                                                          msgpack_object map,
                                                          int convert_str_to_num)
@@ -1243,38 +1306,36 @@ static struct aggregate_node * sp_process_aggregate_data(struct flb_sp_task *tas
     int ret;
     int map_size;
     int key_id;
-    int map_entries;
     int gb_entries;
     int values_found;
     int64_t ival;
     double dval;
-    struct flb_sp_value *sval;
-    struct aggregate_num *gb_nums;
+    uint64_t hash;
+    struct flb_sp_groupby_value *values;
     struct aggregate_node *aggr_node;
     struct flb_sp_cmd *cmd;
     struct flb_sp_cmd_gb_key *gb_key;
     struct mk_list *head;
-    struct rb_tree_node *rb_result;
     msgpack_object key;
+    msgpack_object val;
 
     aggr_node = NULL;
     cmd = task->cmd;
     map_size = map.via.map.size;
     values_found = 0;
 
-    /* Number of expected output entries in the map */
-    map_entries = mk_list_size(&cmd->keys);
     gb_entries = mk_list_size(&cmd->gb_keys);
 
     if (gb_entries > 0) {
-        gb_nums = flb_calloc(1, sizeof(struct aggregate_num) * gb_entries);
-        if (!gb_nums) {
-            return NULL;
-        }
+        values = task->window.groupby_values;
+        memset(values, 0, sizeof(struct flb_sp_groupby_value) * gb_entries);
 
         /* extract GROUP BY values */
         for (i = 0; i < map_size; i++) { /* extract group-by values */
             key = map.via.map.ptr[i].key;
+            if (key.type != MSGPACK_OBJECT_STR) {
+                continue;
+            }
 
             key_id = 0;
             mk_list_foreach(head, &cmd->gb_keys) {
@@ -1286,9 +1347,12 @@ static struct aggregate_node * sp_process_aggregate_data(struct flb_sp_task *tas
                     continue;
                 }
 
-                sval = flb_sp_key_to_value(gb_key->name, map, gb_key->subkeys);
-                if (!sval) {
-                    /* If evaluation fails/sub-key doesn't exist */
+                ret = flb_sp_key_to_object(map.via.map.ptr[i].val,
+                                           gb_key->subkeys, &val);
+                if (ret == -1 || val.type == MSGPACK_OBJECT_ARRAY ||
+                    val.type == MSGPACK_OBJECT_BIN ||
+                    val.type == MSGPACK_OBJECT_EXT) {
+                    /* missing sub-key, or a value that cannot be grouped */
                     key_id++;
                     continue;
                 }
@@ -1296,85 +1360,81 @@ static struct aggregate_node * sp_process_aggregate_data(struct flb_sp_task *tas
                 values_found++;
 
                 /* Convert string to number if that is possible */
-                ret = object_to_number(sval->o, &ival, &dval, convert_str_to_num);
+                ret = object_to_number(val, &ival, &dval, convert_str_to_num);
                 if (ret == -1) {
-                    if (sval->o.type == MSGPACK_OBJECT_STR) {
-                        gb_nums[key_id].type = FLB_SP_STRING;
-                        gb_nums[key_id].string =
-                            flb_sds_create_len(sval->o.via.str.ptr,
-                                               sval->o.via.str.size);
+                    if (val.type == MSGPACK_OBJECT_STR) {
+                        values[key_id].type = FLB_SP_STRING;
+                        values[key_id].str = val.via.str.ptr;
+                        values[key_id].str_len = val.via.str.size;
                     }
-                    else if (sval->o.type == MSGPACK_OBJECT_BOOLEAN) {
-                        gb_nums[key_id].type = FLB_SP_NUM_I64;
-                        gb_nums[key_id].i64 = sval->o.via.boolean;
+                    else if (val.type == MSGPACK_OBJECT_BOOLEAN) {
+                        values[key_id].type = FLB_SP_NUM_I64;
+                        values[key_id].i64 = val.via.boolean;
                     }
                 }
                 else if (ret == FLB_STR_INT) {
-                    gb_nums[key_id].type = FLB_SP_NUM_I64;
-                    gb_nums[key_id].i64 = ival;
+                    values[key_id].type = FLB_SP_NUM_I64;
+                    values[key_id].i64 = ival;
                 }
                 else if (ret == FLB_STR_FLOAT) {
-                    gb_nums[key_id].type = FLB_SP_NUM_F64;
-                    gb_nums[key_id].f64 = dval;
+                    values[key_id].type = FLB_SP_NUM_F64;
+                    values[key_id].f64 = dval;
                 }
 
                 key_id++;
-                flb_sp_key_value_destroy(sval);
             }
         }
 
         /* if some GROUP BY keys are not found in the record */
         if (values_found < gb_entries) {
-            groupby_nums_destroy(gb_nums, gb_entries);
             return NULL;
         }
 
-        aggr_node = (struct aggregate_node *) flb_calloc(1, sizeof(struct aggregate_node));
-        if (!aggr_node) {
-            flb_errno();
-            groupby_nums_destroy(gb_nums, gb_entries);
+        hash = flb_sp_groupby_hash(values, gb_entries);
+
+        /* the group belongs to another partition of the task */
+        if (task->window.partitions > 1 &&
+            hash % task->window.partitions != task->window.partition) {
             return NULL;
         }
 
-        aggr_node->groupby_keys = gb_entries;
-        aggr_node->groupby_nums = gb_nums;
+        aggr_node = flb_sp_groupby_table_get(&task->window.aggregate_table,
+                                             hash, values, gb_entries);
+        if (aggr_node) {
+            aggr_node->records++;
+            return aggr_node;
+        }
 
-        rb_tree_find_or_insert(&task->window.aggregate_tree, aggr_node, &aggr_node->_rb_head, &rb_result);
-        if (&aggr_node->_rb_head != rb_result) {
-            /* We don't need aggr_node anymore */
-            flb_sp_aggregate_node_destroy(cmd, aggr_node);
+        aggr_node = aggregate_node_create(task);
+        if (!aggr_node) {
+            return NULL;
+        }
+        aggr_node->hash = hash;
 
-            aggr_node = container_of(rb_result, struct aggregate_node, _rb_head);
-            container_of(rb_result, struct aggregate_node, _rb_head)->records++;
+        ret = groupby_values_copy(aggr_node, values, gb_entries);
+        if (ret == -1) {
+            flb_sp_aggregate_node_destroy(cmd, aggr_node);
+            return NULL;
         }
-        else {
-            aggr_node->nums = flb_calloc(1, sizeof(struct aggregate_num) * map_entries);
-            if (!aggr_node->nums) {
-                flb_sp_aggregate_node_destroy(cmd, aggr_node);
-                return NULL;
-            }
-            aggr_node->records = 1;
-            aggr_node->nums_size = map_entries;
-            aggr_node->aggregate_data = (struct aggregate_data **) flb_calloc(1, sizeof(struct aggregate_data *) * map_entries);
-            mk_list_add(&aggr_node->_head, &task->window.aggregate_list);
+
+        ret = flb_sp_groupby_table_add(&task->window.aggregate_table,
+                                       aggr_node);
+        if (ret == -1) {
+            flb_sp_aggregate_node_destroy(cmd, aggr_node);
+            return NULL;
         }
+
+        aggr_node->records = 1;
+        mk_list_add(&aggr_node->_head, &task->window.aggregate_list);
     }
     else { /* If query doesn't have GROUP BY */
         if (!mk_list_size(&task->window.aggregate_list)) {
-            aggr_node = flb_calloc(1, sizeof(struct aggregate_node));
+            aggr_node = aggregate_node_create(task);
             if (!aggr_node) {
-                flb_errno();
-                return NULL;
-            }
-            aggr_node->nums = flb_calloc(1, sizeof(struct aggregate_num) * map_entries);
-            if (!aggr_node->nums) {
-                flb_sp_aggregate_node_destroy(cmd, aggr_node);
                 return NULL;
             }
 
-            aggr_node->nums_size = map_entries;
             aggr_node->records = 1;
-            aggr_node->aggregate_data = (struct aggregate_data **) flb_calloc(1, sizeof(struct aggregate_data *) * map_entries);
             mk_list_add(&aggr_node->_head, &task->window.aggregate_list);
         }
         else {
@@ -1386,6 +1446,67 @@ static struct aggregate_node * sp_process_aggregate_data(struct flb_sp_task *tas
     return aggr_node;
 }
 
+/*
+ * Hopping windows: return the node collecting the records of 'aggr_node'
+ * since the last hop, the one subtracted when the slot expires.
+ */
+static struct aggregate_node *hopping_slot_node(struct flb_sp_task *task,
+                                                struct aggregate_node *aggr_node)
+{
+    struct flb_sp_hopping_slot *hs;
+    struct aggregate_node *slot_node;
+
+    hs = task->window.open_slot;
+    if (!hs) {
+        hs = flb_calloc(1, sizeof(struct flb_sp_hopping_slot));
+        if (!hs) {
+            flb_errno();
+            return NULL;
+        }
+        mk_list_init(&hs->aggregate_list);
+        task->window.open_slot = hs;
+    }
+    hs->records++;
+
+    if (aggr_node->slot_node && aggr_node->slot_id == task->window.slot_id) {
+        aggr_node->slot_node->records++;
+        return aggr_node->slot_node;
+    }
+
+    slot_node = aggregate_node_create(task);
+    if (!slot_node) {
+        hs->records--;
+        return NULL;
+    }
+    slot_node->owner = aggr_node;
+    slot_node->records = 1;
+    mk_list_add(&slot_node->_head, &hs->aggregate_list);
+
+    aggr_node->slot_node = slot_node;
+    aggr_node->slot_id = task->window.slot_id;
+
+    return slot_node;
+}
+
+static void aggregate_value_add(struct aggregate_node *aggr_node,
+                                struct flb_sp_cmd_key *ckey, int key_id,
+                                struct flb_time *tms,
+                                int64_t ival, double dval)
+{
+    struct aggregate_num *nums = aggr_node->nums;
+
+    /*
+     * If a floating pointer number exists, we use the same data
+     * type for the output.
+     */
+    if (dval != 0.0 && nums[key_id].type == FLB_SP_NUM_I64) {
+        nums[key_id].type = FLB_SP_NUM_F64;
+        nums[key_id].f64 = (double) nums[key_id].i64;
+    }
+
+    aggregate_func_add[ckey->aggr_func - 1](aggr_node, ckey, key_id, tms, ival, dval);
+}
+
 /*
  * Process data, task and it defined command involves the call of aggregation
  * functions (AVG, SUM, COUNT, MIN, MAX).
@@ -1414,9 +1535,9 @@ int sp_process_data_aggr(const char *buf_data, size_t buf_size,
     struct flb_time tms;
     struct flb_sp_cmd *cmd = task->cmd;
     struct flb_sp_cmd_key *ckey;
-    struct flb_sp_value *sval;
-    struct flb_exp_val *condition;
+    msgpack_object val;
     struct aggregate_node *aggr_node;
+    struct aggregate_node *slot_node;
 
     /* Number of expected output entries in the map */
     off = 0;
@@ -1437,19 +1558,9 @@ int sp_process_data_aggr(const char *buf_data, size_t buf_size,
         map_size = map.via.map.size;
 
         /* Evaluate condition */
-        if (cmd->condition) {
-            condition = reduce_expression(cmd->condition,
-                                          tag, tag_len, &tms, &map);
-            if (!condition) {
-                continue;
-            }
-            else if (!condition->val.boolean) {
-                flb_free(condition);
-                continue;
-            }
-            else {
-                flb_free(condition);
-            }
+        if (cmd->condition &&
+            !condition_match(task, tag, tag_len, &tms, &map)) {
+            continue;
         }
 
         aggr_node = sp_process_aggregate_data(task, map, convert_str_to_num);
@@ -1460,6 +1571,11 @@ int sp_process_data_aggr(const char *buf_data, size_t buf_size,
 
         task->window.records++;
 
+        slot_node = NULL;
+        if (task->window.type == FLB_SP_WINDOW_HOPPING) {
+            slot_node = hopping_slot_node(task, aggr_node);
+        }
+
         nums = aggr_node->nums;
 
         /* Iterate each map key and see if it matches any command key */
@@ -1491,9 +1607,10 @@ int sp_process_data_aggr(const char *buf_data, size_t buf_size,
                     continue;
                 }
 
-                /* convert the value if it string */
-                sval = flb_sp_key_to_value(ckey->name, map, ckey->subkeys);
-                if (!sval) {
+                /* resolve the value, sub-keys included */
+                ret = flb_sp_key_to_object(map.via.map.ptr[i].val,
+                                           ckey->subkeys, &val);
+                if (ret == -1) {
                     key_id++;
                     continue;
                 }
@@ -1505,52 +1622,45 @@ int sp_process_data_aggr(const char *buf_data, size_t buf_size,
                 ival = 0;
                 dval = 0.0;
                 if (ckey->aggr_func != FLB_SP_NOP) {
-                    ret = object_to_number(sval->o, &ival, &dval, convert_str_to_num);
+                    ret = object_to_number(val, &ival, &dval, convert_str_to_num);
                     if (ret == -1) {
                         /* Value cannot be represented as a number */
                         key_id++;
-                        flb_sp_key_value_destroy(sval);
                         continue;
                     }
 
-                    /*
-                     * If a floating pointer number exists, we use the same data
-                     * type for the output.
-                     */
-                    if (dval != 0.0 && nums[key_id].type == FLB_SP_NUM_I64) {
-                        nums[key_id].type = FLB_SP_NUM_F64;
-                        nums[key_id].f64 = (double) nums[key_id].i64;
+                    aggregate_value_add(aggr_node, ckey, key_id, &tms, ival, dval);
+                    if (slot_node) {
+                        aggregate_value_add(slot_node, ckey, key_id, &tms,
+                                            ival, dval);
                     }
-
-                    aggregate_func_add[ckey->aggr_func - 1](aggr_node, ckey, key_id, &tms, ival, dval);
                 }
                 else {
-                    if (sval->o.type == MSGPACK_OBJECT_BOOLEAN) {
+                    if (val.type == MSGPACK_OBJECT_BOOLEAN) {
                         nums[key_id].type = FLB_SP_BOOLEAN;
-                        nums[key_id].boolean = sval->o.via.boolean;
+                        nums[key_id].boolean = val.via.boolean;
                     }
-                    if (sval->o.type == MSGPACK_OBJECT_POSITIVE_INTEGER ||
-                        sval->o.type == MSGPACK_OBJECT_NEGATIVE_INTEGER) {
+                    if (val.type == MSGPACK_OBJECT_POSITIVE_INTEGER ||
+                        val.type == MSGPACK_OBJECT_NEGATIVE_INTEGER) {
                         nums[key_id].type = FLB_SP_NUM_I64;
-                        nums[key_id].i64 = sval->o.via.i64;
+                        nums[key_id].i64 = val.via.i64;
                     }
-                    else if (sval->o.type == MSGPACK_OBJECT_FLOAT32 ||
-                             sval->o.type == MSGPACK_OBJECT_FLOAT) {
+                    else if (val.type == MSGPACK_OBJECT_FLOAT32 ||
+                             val.type == MSGPACK_OBJECT_FLOAT) {
                         nums[key_id].type = FLB_SP_NUM_F64;
-                        nums[key_id].f64 = sval->o.via.f64;
+                        nums[key_id].f64 = val.via.f64;
                     }
-                    else if (sval->o.type == MSGPACK_OBJECT_STR) {
+                    else if (val.type == MSGPACK_OBJECT_STR) {
                         nums[key_id].type = FLB_SP_STRING;
                         if (nums[key_id].string == NULL) {
                             nums[key_id].string =
-                                flb_sds_create_len(sval->o.via.str.ptr,
-                                                   sval->o.via.str.size);
+                                flb_sds_create_len(val.via.str.ptr,
+                                                   val.via.str.size);
                         }
                     }
                 }
 
                 key_id++;
-                flb_sp_key_value_destroy(sval);
             }
         }
     }
@@ -1594,8 +1704,6 @@ int sp_process_data(const char *tag, int tag_len,
     struct mk_list *head;
     struct flb_sp_cmd *cmd;
     struct flb_sp_cmd_key *cmd_key;
-    struct flb_exp_val *condition;
-    struct flb_sp_value *sval;
 
     /* Vars initialization */
     off = 0;
@@ -1629,19 +1737,9 @@ int sp_process_data(const char *tag, int tag_len,
         map_size = map.via.map.size;
 
         /* Evaluate condition */
-        if (cmd->condition) {
-            condition = reduce_expression(cmd->condition,
-                                          tag, tag_len, &tms, &map);
-            if (!condition) {
-                continue;
-            }
-            else if (!condition->val.boolean) {
-                flb_free(condition);
-                continue;
-            }
-            else {
-                flb_free(condition);
-            }
+        if (cmd->condition &&
+            !condition_match(task, tag, tag_len, &tms, &map)) {
+            continue;
         }
 
         records++;
@@ -1726,6 +1824,12 @@ int sp_process_data(const char *tag, int tag_len,
                     continue;
                 }
 
+                /* Resolve the value before packing the key */
+                ret = flb_sp_key_to_object(val, cmd_key->subkeys, &val);
+                if (ret == -1) {
+                    continue;
+                }
+
                 /*
                  * Package key name:
                  *
@@ -1743,12 +1847,7 @@ int sp_process_data(const char *tag, int tag_len,
                 }
 
                 /* Package value */
-                sval = flb_sp_key_to_value(cmd_key->name, map,
-                                           cmd_key->subkeys);
-                if (sval) {
-                    msgpack_pack_object(&mp_pck, sval->o);
-                    flb_sp_key_value_destroy(sval);
-                }
+                msgpack_pack_object(&mp_pck, val);
 
                 map_entries++;
             }
@@ -1807,156 +1906,29 @@ int sp_process_data(const char *tag, int tag_len,
     return records;
 }
 
+/*
+ * Close the open hopping slot: the records received since the last hop
+ * are already aggregated per group in it.
+ */
 int sp_process_hopping_slot(const char *tag, int tag_len,
                             struct flb_sp_task *task)
 {
-    int i;
-    int key_id;
-    int map_entries;
-    int gb_entries;
-    struct flb_sp_cmd *cmd = task->cmd;
-    struct mk_list *head;
-    struct mk_list *head_hs;
-    struct aggregate_node *aggr_node;
-    struct aggregate_node *aggr_node_hs;
-    struct aggregate_node *aggr_node_prev;
     struct flb_sp_hopping_slot *hs;
-    struct flb_sp_hopping_slot *hs_;
-    struct rb_tree_node *rb_result;
-    struct flb_sp_cmd_key *ckey;
-    rb_result_t result;
 
-    map_entries = mk_list_size(&cmd->keys);
-    gb_entries = mk_list_size(&cmd->gb_keys);
-
-    /* Initialize a hoping slot */
-    hs = flb_calloc(1, sizeof(struct flb_sp_hopping_slot));
+    hs = task->window.open_slot;
     if (!hs) {
-        flb_errno();
-        return -1;
-    }
-
-    mk_list_init(&hs->aggregate_list);
-    rb_tree_new(&hs->aggregate_tree, flb_sp_groupby_compare);
-
-    /* Loop over aggregation nodes on window */
-    mk_list_foreach(head, &task->window.aggregate_list) {
-        /* Window aggregation node */
-        aggr_node = mk_list_entry(head, struct aggregate_node, _head);
-
-        /* Create a hopping slot aggregation node */
-        aggr_node_hs = flb_calloc(1, sizeof(struct aggregate_node));
-        if (!aggr_node_hs) {
-            flb_errno();
-            flb_free(hs);
-            return -1;
-        }
-
-        aggr_node_hs->nums = malloc(sizeof(struct aggregate_node) * map_entries);
-        if (!aggr_node_hs->nums) {
+        /* no records since the last hop, the slot is still accounted */
+        hs = flb_calloc(1, sizeof(struct flb_sp_hopping_slot));
+        if (!hs) {
             flb_errno();
-            flb_free(hs);
-            flb_free(aggr_node_hs);
             return -1;
         }
-
-        memcpy(aggr_node_hs->nums, aggr_node->nums, sizeof(struct aggregate_num) * map_entries);
-        aggr_node_hs->records = aggr_node->records;
-
-        /* Clone aggregate data */
-        key_id = 0;
-        mk_list_foreach(head_hs, &cmd->keys) {
-            ckey = mk_list_entry(head_hs, struct flb_sp_cmd_key, _head);
-
-            if (ckey->aggr_func) {
-                if (!aggr_node_hs->aggregate_data) {
-                    aggr_node_hs->aggregate_data = (struct aggregate_data **)
-                                       flb_calloc(1, sizeof(struct aggregate_data *) * map_entries);
-                    if (!aggr_node_hs->aggregate_data) {
-                        flb_errno();
-                        flb_free(hs);
-                        flb_free(aggr_node_hs->nums);
-                        flb_free(aggr_node_hs);
-                        return -1;
-                    }
-                }
-
-                if (aggregate_func_clone[ckey->aggr_func - 1](aggr_node_hs, aggr_node, ckey, key_id) == -1) {
-                    flb_errno();
-                    flb_free(aggr_node_hs->nums);
-                    flb_free(aggr_node_hs->aggregate_data);
-                    flb_free(aggr_node_hs);
-                    flb_free(hs);
-                    return -1;
-                }
-            }
-
-            key_id++;
-        }
-
-        /* Traverse over previous slots to calculate values/record numbers */
-        mk_list_foreach(head_hs, &task->window.hopping_slot) {
-            hs_ = mk_list_entry(head_hs, struct flb_sp_hopping_slot, _head);
-            result = rb_tree_find(&hs_->aggregate_tree, aggr_node, &rb_result);
-            /* If corresponding aggregation node exists in previous hopping slot,
-             * calculate aggregation values
-             */
-            if (result == RB_OK) {
-                aggr_node_prev = mk_list_entry(rb_result, struct aggregate_node,
-                                               _rb_head);
-                aggr_node_hs->records -= aggr_node_prev->records;
-
-                key_id = 0;
-                ckey = mk_list_entry_first(&cmd->keys, struct flb_sp_cmd_key,
-                                           _head);
-                for (i = 0; i < map_entries; i++) {
-                    if (ckey->aggr_func) {
-                        aggregate_func_remove[ckey->aggr_func - 1](aggr_node_hs, aggr_node_prev, i);
-                    }
-
-                    ckey = mk_list_entry_next(&ckey->_head, struct flb_sp_cmd_key,
-                                              _head, &cmd->keys);
-                }
-            }
-        }
-
-        if (aggr_node_hs->records > 0) {
-            aggr_node_hs->groupby_nums =
-                flb_calloc(1, sizeof(struct aggregate_node) * gb_entries);
-            if (gb_entries > 0 && !aggr_node_hs->groupby_nums) {
-                flb_errno();
-                flb_free(hs);
-                flb_free(aggr_node_hs->nums);
-                flb_free(aggr_node_hs->aggregate_data);
-                flb_free(aggr_node_hs);
-                return -1;
-            }
-
-            if (aggr_node_hs->groupby_nums != NULL) {
-                memcpy(aggr_node_hs->groupby_nums, aggr_node->groupby_nums,
-                       sizeof(struct aggregate_num) * gb_entries);
-            }
-
-            aggr_node_hs->nums_size = aggr_node->nums_size;
-            aggr_node_hs->groupby_keys = aggr_node->groupby_keys;
-
-            rb_tree_insert(&hs->aggregate_tree, aggr_node_hs, &aggr_node_hs->_rb_head);
-            mk_list_add(&aggr_node_hs->_head, &hs->aggregate_list);
-        }
-        else {
-            flb_free(aggr_node_hs->nums);
-            flb_free(aggr_node_hs->aggregate_data);
-            flb_free(aggr_node_hs);
-        }
-    }
-
-    hs->records = task->window.records;
-    mk_list_foreach(head_hs, &task->window.hopping_slot) {
-        hs_ = mk_list_entry(head_hs, struct flb_sp_hopping_slot, _head);
-        hs->records -= hs_->records;
+        mk_list_init(&hs->aggregate_list);
     }
 
     mk_list_add(&hs->_head, &task->window.hopping_slot);
+    task->window.open_slot = NULL;
+    task->window.slot_id++;
 
     return 0;
 }
@@ -1973,6 +1945,7 @@ int flb_sp_do(struct flb_sp *sp, struct flb_input_instance *in,
     struct mk_list *head;
     struct flb_sp_task *task;
     struct flb_sp_cmd *cmd;
+    struct flb_sp_worker_chunk *chunk = NULL;
 
     /* Lookup tasks that match the incoming instance data */
     mk_list_foreach(head, &sp->tasks) {
@@ -1992,6 +1965,22 @@ int flb_sp_do(struct flb_sp *sp, struct flb_input_instance *in,
         }
 
         /* We found a task that matches the stream rule */
+        if (task->partitions_size > 0) {
+            /* the caller owns the buffer, workers share a single copy */
+            if (!chunk) {
+                chunk = flb_sp_worker_chunk_create(tag, tag_len,
+                                                   buf_data, buf_size,
+                                                   in->config->stream_processor_str_conv);
+                if (!chunk) {
+                    flb_error("[sp] could not queue records for '%s'",
+                              task->name);
+                    continue;
+                }
+            }
+            flb_sp_worker_push_data(sp, task, chunk);
+            continue;
+        }
+
         if (task->aggregate_keys == FLB_TRUE) {
             ret = sp_process_data_aggr(buf_data, buf_size,
                                        tag, tag_len,
@@ -2053,6 +2042,10 @@ int flb_sp_do(struct flb_sp *sp, struct flb_input_instance *in,
         }
     }
 
+    if (chunk) {
+        flb_sp_worker_chunk_release(chunk);
+    }
+
     return -1;
 }
 
@@ -2092,21 +2085,26 @@ int flb_sp_fd_event(int fd, struct flb_sp *sp)
                 in = NULL;
             }
 
-            if (task->window.records > 0) {
-                /* find input tag from task source */
-                package_results(tag, tag_len, &out_buf, &out_size, task);
-                if (task->stream) {
-                    flb_sp_stream_append_data(out_buf, out_size, task->stream);
-                }
-                else {
-                    flb_pack_print(out_buf, out_size);
-                    flb_free(out_buf);
+            if (task->partitions_size > 0) {
+                flb_sp_worker_push_event(sp, task, FLB_SP_JOB_WINDOW,
+                                         tag, tag_len);
+            }
+            else {
+                if (task->window.records > 0) {
+                    /* find input tag from task source */
+                    package_results(tag, tag_len, &out_buf, &out_size, task);
+                    if (task->stream) {
+                        flb_sp_stream_append_data(out_buf, out_size,
+                                                  task->stream);
+                    }
+                    else {
+                        flb_pack_print(out_buf, out_size);
+                        flb_free(out_buf);
+                    }
                 }
-
+                flb_sp_window_prune(task);
             }
 
-            flb_sp_window_prune(task);
-
             flb_utils_timer_consume(fd);
 
             if (update_timer_event && in) {
@@ -2138,7 +2136,13 @@ int flb_sp_fd_event(int fd, struct flb_sp *sp)
                     tag_len = strlen(in->name);
                 }
             }
-            sp_process_hopping_slot(tag, tag_len, task);
+            if (task->partitions_size > 0) {
+                flb_sp_worker_push_event(sp, task, FLB_SP_JOB_HOP,
+                                         tag, tag_len);
+            }
+            else {
+                sp_process_hopping_slot(tag, tag_len, task);
+            }
             flb_utils_timer_consume(fd);
         }
     }
@@ -2152,6 +2156,9 @@ void flb_sp_destroy(struct flb_sp *sp)
     struct mk_list *head;
     struct flb_sp_task *task;
 
+    /* pending jobs are completed before the tasks go away */
+    flb_sp_workers_destroy(sp);
+
     /* destroy tasks */
     mk_list_foreach_safe(head, tmp, &sp->tasks) {
         task = mk_list_entry(head, struct flb_sp_task, _head);
@@ -211,7 +211,13 @@ void aggregate_func_remove_sum(struct aggregate_node *aggr_node,
         aggr_node->nums[key_id].i64 -= aggr_node_prev->nums[key_id].i64;
     }
     else if (aggr_node->nums[key_id].type == FLB_SP_NUM_F64) {
-        aggr_node->nums[key_id].f64 -= aggr_node_prev->nums[key_id].f64;
+        /* the previous node might not have seen any float value */
+        if (aggr_node_prev->nums[key_id].type == FLB_SP_NUM_F64) {
+            aggr_node->nums[key_id].f64 -= aggr_node_prev->nums[key_id].f64;
+        }
+        else {
+            aggr_node->nums[key_id].f64 -= (double) aggr_node_prev->nums[key_id].i64;
+        }
     }
 }
 
@@ -240,7 +246,14 @@ void aggregate_func_add_timeseries_forecast(struct aggregate_node *aggr_node,
     }
 
     if (!forecast->offset) {
-        forecast->offset = flb_time_to_double(tms);
+        /* a hopping slot node measures time from its window node origin */
+        if (aggr_node->owner && aggr_node->owner->aggregate_data[key_id]) {
+            forecast->offset = ((struct timeseries_forecast *)
+                                aggr_node->owner->aggregate_data[key_id])->offset;
+        }
+        else {
+            forecast->offset = flb_time_to_double(tms);
+        }
     }
 
     x = flb_time_to_double(tms) - forecast->offset;
@@ -18,65 +18,300 @@
  */
 
 #include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
 #include <fluent-bit/stream_processor/flb_sp.h>
+#include <fluent-bit/stream_processor/flb_sp_groupby.h>
 
-int flb_sp_groupby_compare(const void *lhs, const void *rhs)
+#include <cfl/cfl_hash.h>
+
+struct arena_chunk {
+    struct mk_list _head;
+};
+
+void flb_sp_groupby_arena_init(struct flb_sp_groupby_arena *arena,
+                               size_t block_size)
+{
+    /* blocks keep the alignment of the structures they hold */
+    arena->block_size = (block_size + 7) & ~((size_t) 7);
+    if (arena->block_size < sizeof(void *)) {
+        arena->block_size = sizeof(void *);
+    }
+    arena->free_list = NULL;
+    mk_list_init(&arena->chunks);
+}
+
+static int arena_grow(struct flb_sp_groupby_arena *arena)
 {
     int i;
-    int strcmp_result;
-    struct aggregate_node *left = (struct aggregate_node *) lhs;
-    struct aggregate_node *right = (struct aggregate_node *) rhs;
-    struct aggregate_num *lval;
-    struct aggregate_num *rval;
-
-    for (i = 0; i < left->groupby_keys; i++) {
-        lval = &left->groupby_nums[i];
-        rval = &right->groupby_nums[i];
-
-        /* Convert integer to double if a float value appears on one side */
-        if (lval->type == FLB_SP_NUM_I64 && rval->type == FLB_SP_NUM_F64) {
-            lval->type = FLB_SP_NUM_F64;
-            lval->f64 = (double) lval->i64;
-        }
-        else if (lval->type == FLB_SP_NUM_F64 && rval->type == FLB_SP_NUM_I64) {
-            rval->type = FLB_SP_NUM_F64;
-            rval->f64 = (double) rval->i64;
-        }
+    char *block;
+    struct arena_chunk *chunk;
 
-        /* Comparison */
-        if (lval->type == FLB_SP_BOOLEAN && rval->type == FLB_SP_BOOLEAN) {
-            if (lval->boolean != rval->boolean) {
-                return 1;
-            }
+    chunk = flb_malloc(sizeof(struct arena_chunk) +
+                       arena->block_size * FLB_SP_GROUPBY_ARENA_BLOCKS);
+    if (!chunk) {
+        flb_errno();
+        return -1;
+    }
+    mk_list_add(&chunk->_head, &arena->chunks);
+
+    block = (char *) (chunk + 1);
+    for (i = 0; i < FLB_SP_GROUPBY_ARENA_BLOCKS; i++) {
+        *(void **) block = arena->free_list;
+        arena->free_list = block;
+        block += arena->block_size;
+    }
+
+    return 0;
+}
+
+/* Returns a zeroed block */
+void *flb_sp_groupby_arena_alloc(struct flb_sp_groupby_arena *arena)
+{
+    void *block;
+
+    if (!arena->free_list && arena_grow(arena) == -1) {
+        return NULL;
+    }
+
+    block = arena->free_list;
+    arena->free_list = *(void **) block;
+    memset(block, 0, arena->block_size);
+
+    return block;
+}
+
+void flb_sp_groupby_arena_free(struct flb_sp_groupby_arena *arena, void *ptr)
+{
+    *(void **) ptr = arena->free_list;
+    arena->free_list = ptr;
+}
+
+void flb_sp_groupby_arena_destroy(struct flb_sp_groupby_arena *arena)
+{
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct arena_chunk *chunk;
+
+    mk_list_foreach_safe(head, tmp, &arena->chunks) {
+        chunk = mk_list_entry(head, struct arena_chunk, _head);
+        mk_list_del(&chunk->_head);
+        flb_free(chunk);
+    }
+    arena->free_list = NULL;
+}
+
+/*
+ * Integers and floats holding the same number belong to the same group,
+ * numbers are hashed by their double representation.
+ */
+uint64_t flb_sp_groupby_hash(struct flb_sp_groupby_value *values, int size)
+{
+    int i;
+    double d;
+    uint64_t h;
+    uint64_t hash = 0;
+    struct flb_sp_groupby_value *val;
+
+    for (i = 0; i < size; i++) {
+        val = &values[i];
+        if (val->type == FLB_SP_STRING) {
+            h = cfl_hash_64bits(val->str, val->str_len);
         }
-        else if (lval->type == FLB_SP_NUM_I64 && rval->type == FLB_SP_NUM_I64) {
-            if (lval->i64 > rval->i64) {
-                return 1;
+        else {
+            if (val->type == FLB_SP_NUM_F64) {
+                d = val->f64;
             }
-
-            if (lval->i64 < rval->i64) {
-                return -1;
+            else {
+                d = (double) val->i64;
             }
-        }
-        else if (lval->type == FLB_SP_NUM_F64 &&  rval->type == FLB_SP_NUM_F64) {
-            if (lval->f64 > rval->f64) {
-                return 1;
+            if (d == 0.0) {
+                d = 0.0;
             }
+            h = cfl_hash_64bits(&d, sizeof(d));
+        }
+        hash ^= h + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+    }
 
-            if (lval->f64 < rval->f64) {
-                return -1;
-            }
+    return hash;
+}
+
+static int value_equal(struct aggregate_num *num,
+                       struct flb_sp_groupby_value *val)
+{
+    if (num->type == FLB_SP_STRING || val->type == FLB_SP_STRING) {
+        if (num->type != val->type) {
+            return FLB_FALSE;
+        }
+        if (flb_sds_len(num->string) != val->str_len) {
+            return FLB_FALSE;
         }
-        else if (lval->type == FLB_SP_STRING && rval->type == FLB_SP_STRING) {
-            strcmp_result = strcmp((const char *) lval->string, (const char *) rval->string);
-            if (strcmp_result != 0) {
-              return strcmp_result;
+        return memcmp(num->string, val->str, val->str_len) == 0;
+    }
+
+    if (num->type == FLB_SP_NUM_I64 && val->type == FLB_SP_NUM_I64) {
+        return num->i64 == val->i64;
+    }
+
+    /* a float value on one side, compare both as floats */
+    if (num->type == FLB_SP_NUM_F64 && val->type == FLB_SP_NUM_F64) {
+        return num->f64 == val->f64;
+    }
+    else if (num->type == FLB_SP_NUM_F64) {
+        return num->f64 == (double) val->i64;
+    }
+    else if (val->type == FLB_SP_NUM_F64) {
+        return (double) num->i64 == val->f64;
+    }
+
+    return FLB_FALSE;
+}
+
+struct aggregate_node *flb_sp_groupby_table_get(struct flb_sp_groupby_table *table,
+                                                uint64_t hash,
+                                                struct flb_sp_groupby_value *values,
+                                                int size)
+{
+    int i;
+    size_t idx;
+    size_t mask;
+    struct flb_sp_groupby_entry *entry;
+
+    if (table->count == 0) {
+        return NULL;
+    }
+
+    mask = table->size - 1;
+    idx = hash & mask;
+    while ((entry = &table->entries[idx])->node != NULL) {
+        if (entry->hash == hash) {
+            for (i = 0; i < size; i++) {
+                if (!value_equal(&entry->node->groupby_nums[i], &values[i])) {
+                    break;
+                }
+            }
+            if (i == size) {
+                return entry->node;
             }
         }
-        else { /* Sides have different types */
+        idx = (idx + 1) & mask;
+    }
+
+    return NULL;
+}
+
+static void table_insert(struct flb_sp_groupby_entry *entries, size_t size,
+                         uint64_t hash, struct aggregate_node *aggr_node)
+{
+    size_t idx;
+
+    idx = hash & (size - 1);
+    while (entries[idx].node) {
+        idx = (idx + 1) & (size - 1);
+    }
+    entries[idx].hash = hash;
+    entries[idx].node = aggr_node;
+}
+
+static int table_resize(struct flb_sp_groupby_table *table, size_t size)
+{
+    size_t i;
+    struct flb_sp_groupby_entry *entries;
+
+    entries = flb_calloc(size, sizeof(struct flb_sp_groupby_entry));
+    if (!entries) {
+        flb_errno();
+        return -1;
+    }
+
+    for (i = 0; i < table->size; i++) {
+        if (table->entries[i].node) {
+            table_insert(entries, size,
+                         table->entries[i].hash, table->entries[i].node);
+        }
+    }
+
+    flb_free(table->entries);
+    table->entries = entries;
+    table->size = size;
+
+    return 0;
+}
+
+/* The node hash must be set, the caller makes sure it is not registered */
+int flb_sp_groupby_table_add(struct flb_sp_groupby_table *table,
+                             struct aggregate_node *aggr_node)
+{
+    size_t size;
+
+    /* keep the load factor under 3/4 */
+    if ((table->count + 1) * 4 > table->size * 3) {
+        size = table->size ? table->size * 2 : FLB_SP_GROUPBY_TABLE_SIZE;
+        if (table_resize(table, size) == -1) {
             return -1;
         }
     }
 
+    table_insert(table->entries, table->size, aggr_node->hash, aggr_node);
+    table->count++;
+
     return 0;
 }
+
+void flb_sp_groupby_table_del(struct flb_sp_groupby_table *table,
+                              struct aggregate_node *aggr_node)
+{
+    size_t i;
+    size_t j;
+    size_t k;
+    size_t mask;
+    struct flb_sp_groupby_entry *entries = table->entries;
+
+    if (table->count == 0) {
+        return;
+    }
+
+    mask = table->size - 1;
+    i = aggr_node->hash & mask;
+    while (entries[i].node != aggr_node) {
+        if (!entries[i].node) {
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+
+    /* backward shift, no tombstones */
+    j = i;
+    while (1) {
+        j = (j + 1) & mask;
+        if (!entries[j].node) {
+            break;
+        }
+        k = entries[j].hash & mask;
+        if ((j > i && (k <= i || k > j)) ||
+            (j < i && (k <= i && k > j))) {
+            entries[i] = entries[j];
+            i = j;
+        }
+    }
+    entries[i].node = NULL;
+    table->count--;
+}
+
+/* Unregister all the nodes, the table keeps its size */
+void flb_sp_groupby_table_reset(struct flb_sp_groupby_table *table)
+{
+    if (table->entries) {
+        memset(table->entries, 0,
+               sizeof(struct flb_sp_groupby_entry) * table->size);
+    }
+    table->count = 0;
+}
+
+void flb_sp_groupby_table_destroy(struct flb_sp_groupby_table *table)
+{
+    flb_free(table->entries);
+    table->entries = NULL;
+    table->size = 0;
+    table->count = 0;
+}
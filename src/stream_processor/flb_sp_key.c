@@ -222,6 +222,51 @@ struct flb_sp_value *flb_sp_key_to_value(flb_sds_t ckey,
     return NULL;
 }
 
+/*
+ * Resolve the value 'val' of a key found in a record applying the sub-keys
+ * selection, same rules than flb_sp_key_to_value() but without allocating
+ * memory. Values of any type are returned so arrays, binaries and extensions
+ * can be packed as they are. Returns 0 and sets 'out', or -1 if there is no
+ * value.
+ */
+int flb_sp_key_to_object(msgpack_object val, struct mk_list *subkeys,
+                         msgpack_object *out)
+{
+    int i;
+    msgpack_object key;
+    struct mk_list *head;
+    struct flb_slist_entry *entry;
+
+    if (val.type == MSGPACK_OBJECT_MAP && subkeys != NULL) {
+        if (mk_list_size(subkeys) == 0) {
+            return -1;
+        }
+
+        mk_list_foreach(head, subkeys) {
+            entry = mk_list_entry(head, struct flb_slist_entry, _head);
+            if (val.type != MSGPACK_OBJECT_MAP) {
+                return -1;
+            }
+
+            for (i = 0; i < val.via.map.size; i++) {
+                key = val.via.map.ptr[i].key;
+                if (key.type == MSGPACK_OBJECT_STR &&
+                    flb_sds_cmp(entry->str, key.via.str.ptr,
+                                key.via.str.size) == 0) {
+                    break;
+                }
+            }
+            if (i == val.via.map.size) {
+                return -1;
+            }
+            val = val.via.map.ptr[i].val;
+        }
+    }
+
+    *out = val;
+    return 0;
+}
+
 void flb_sp_key_value_destroy(struct flb_sp_value *v)
 {
     if (v->type == FLB_EXP_STRING) {
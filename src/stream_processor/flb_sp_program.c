@@ -0,0 +1,553 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2024 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_slist.h>
+
+#include <fluent-bit/stream_processor/flb_sp.h>
+#include <fluent-bit/stream_processor/flb_sp_parser.h>
+#include <fluent-bit/stream_processor/flb_sp_program.h>
+
+/* Value type for missing keys, unknown values and NULL sub-expressions */
+#define SP_VAL_NONE  -1
+
+/* Stack value, strings reference the record or the literal */
+struct sp_val {
+    int type;
+    sp_val val;
+    const char *str;
+    size_t len;
+};
+
+/* Emit the instructions of an expression in postfix order */
+static int exp_compile(struct flb_sp_program *prog, struct flb_exp *exp,
+                       int *depth, int *max_depth)
+{
+    int i;
+    int ret;
+    int op;
+    struct flb_exp_key *key;
+    struct flb_exp_func *func;
+    struct flb_sp_instruction *ins;
+
+    if (!exp) {
+        ins = &prog->ins[prog->size++];
+        ins->opcode = FLB_SP_OP_NONE;
+        goto push;
+    }
+
+    switch (exp->type) {
+    case FLB_EXP_NULL:
+    case FLB_EXP_BOOL:
+    case FLB_EXP_INT:
+    case FLB_EXP_FLOAT:
+    case FLB_EXP_STRING:
+        ins = &prog->ins[prog->size++];
+        ins->opcode = FLB_SP_OP_CONST;
+        ins->val = (struct flb_exp_val *) exp;
+        goto push;
+    case FLB_EXP_KEY:
+        key = (struct flb_exp_key *) exp;
+        for (i = 0; i < prog->slots; i++) {
+            if (flb_sds_cmp(prog->slot_names[i], key->name,
+                            flb_sds_len(key->name)) == 0) {
+                break;
+            }
+        }
+        if (i == prog->slots) {
+            if (prog->slots == FLB_SP_PROGRAM_SLOTS_MAX) {
+                return -1;
+            }
+            prog->slot_names[prog->slots++] = key->name;
+        }
+        ins = &prog->ins[prog->size++];
+        ins->opcode = FLB_SP_OP_KEY;
+        ins->arg = i;
+        ins->subkeys = key->subkeys;
+        goto push;
+    case FLB_EXP_FUNC:
+        func = (struct flb_exp_func *) exp;
+        if (strncmp(func->name, "contains", 8) == 0) {
+            op = FLB_SP_OP_CONTAINS;
+        }
+        else if (strncmp(func->name, "time", 4) == 0) {
+            op = FLB_SP_OP_TIME;
+        }
+        else {
+            return -1;
+        }
+
+        ret = exp_compile(prog, func->param, depth, max_depth);
+        if (ret == -1) {
+            return -1;
+        }
+        ins = &prog->ins[prog->size++];
+        ins->opcode = op;
+        return 0;
+    case FLB_LOGICAL_OP:
+        ret = exp_compile(prog, exp->left, depth, max_depth);
+        if (ret == -1) {
+            return -1;
+        }
+        ret = exp_compile(prog, exp->right, depth, max_depth);
+        if (ret == -1) {
+            return -1;
+        }
+
+        op = ((struct flb_exp_op *) exp)->operation;
+        ins = &prog->ins[prog->size++];
+        switch (op) {
+        case FLB_EXP_PAR:
+            ins->opcode = FLB_SP_OP_PAR;
+            break;
+        case FLB_EXP_NOT:
+            ins->opcode = FLB_SP_OP_NOT;
+            break;
+        case FLB_EXP_AND:
+            ins->opcode = FLB_SP_OP_AND;
+            break;
+        case FLB_EXP_OR:
+            ins->opcode = FLB_SP_OP_OR;
+            break;
+        default:
+            ins->opcode = FLB_SP_OP_CMP;
+            ins->arg = op;
+            break;
+        }
+
+        /* two operands are replaced by the result */
+        (*depth)--;
+        return 0;
+    default:
+        return -1;
+    }
+
+push:
+    (*depth)++;
+    if (*depth > *max_depth) {
+        *max_depth = *depth;
+    }
+    return 0;
+}
+
+static int exp_count(struct flb_exp *exp)
+{
+    if (!exp) {
+        return 1;
+    }
+
+    if (exp->type == FLB_EXP_FUNC) {
+        return 1 + exp_count(((struct flb_exp_func *) exp)->param);
+    }
+    else if (exp->type == FLB_LOGICAL_OP) {
+        return 1 + exp_count(exp->left) + exp_count(exp->right);
+    }
+
+    return 1;
+}
+
+/*
+ * Compile a WHERE condition. Returns NULL if the expression uses something
+ * the program does not support, the caller keeps interpreting the AST.
+ */
+struct flb_sp_program *flb_sp_program_create(struct flb_exp *exp)
+{
+    int ret;
+    int depth = 0;
+    int max_depth = 0;
+    struct flb_sp_program *prog;
+
+    prog = flb_calloc(1, sizeof(struct flb_sp_program));
+    if (!prog) {
+        flb_errno();
+        return NULL;
+    }
+
+    prog->ins = flb_calloc(exp_count(exp), sizeof(struct flb_sp_instruction));
+    if (!prog->ins) {
+        flb_errno();
+        flb_free(prog);
+        return NULL;
+    }
+
+    ret = exp_compile(prog, exp, &depth, &max_depth);
+    if (ret == -1 || depth != 1 || max_depth > FLB_SP_PROGRAM_STACK_MAX) {
+        flb_sp_program_destroy(prog);
+        return NULL;
+    }
+
+    return prog;
+}
+
+void flb_sp_program_destroy(struct flb_sp_program *prog)
+{
+    if (!prog) {
+        return;
+    }
+
+    flb_free(prog->ins);
+    flb_free(prog);
+}
+
+/* Same conversion rules than flb_sp_key_to_value() */
+static void object_to_val(msgpack_object *o, struct sp_val *v)
+{
+    switch (o->type) {
+    case MSGPACK_OBJECT_BOOLEAN:
+        v->type = FLB_EXP_BOOL;
+        v->val.boolean = o->via.boolean;
+        break;
+    case MSGPACK_OBJECT_POSITIVE_INTEGER:
+    case MSGPACK_OBJECT_NEGATIVE_INTEGER:
+        v->type = FLB_EXP_INT;
+        v->val.i64 = o->via.i64;
+        break;
+    case MSGPACK_OBJECT_FLOAT32:
+    case MSGPACK_OBJECT_FLOAT:
+        v->type = FLB_EXP_FLOAT;
+        v->val.f64 = o->via.f64;
+        break;
+    case MSGPACK_OBJECT_STR:
+        v->type = FLB_EXP_STRING;
+        v->val.i64 = 0;
+        v->str = o->via.str.ptr;
+        v->len = o->via.str.size;
+        break;
+    case MSGPACK_OBJECT_MAP:
+        /* denotes the existence of the key */
+        v->type = FLB_EXP_BOOL;
+        v->val.boolean = true;
+        break;
+    case MSGPACK_OBJECT_NIL:
+        v->type = FLB_EXP_NULL;
+        break;
+    default:
+        v->type = SP_VAL_NONE;
+        break;
+    }
+}
+
+/* Follow the sub-keys path, every level must be matched */
+static void subkeys_to_val(msgpack_object *o, struct mk_list *subkeys,
+                           struct sp_val *v)
+{
+    int i;
+    msgpack_object cur;
+    msgpack_object key;
+    struct mk_list *head;
+    struct flb_slist_entry *entry;
+
+    v->type = SP_VAL_NONE;
+    if (mk_list_size(subkeys) == 0) {
+        return;
+    }
+
+    cur = *o;
+    mk_list_foreach(head, subkeys) {
+        entry = mk_list_entry(head, struct flb_slist_entry, _head);
+        if (cur.type != MSGPACK_OBJECT_MAP) {
+            return;
+        }
+
+        for (i = 0; i < cur.via.map.size; i++) {
+            key = cur.via.map.ptr[i].key;
+            if (key.type == MSGPACK_OBJECT_STR &&
+                flb_sds_cmp(entry->str, key.via.str.ptr,
+                            key.via.str.size) == 0) {
+                break;
+            }
+        }
+        if (i == cur.via.map.size) {
+            return;
+        }
+        cur = cur.via.map.ptr[i].val;
+    }
+
+    object_to_val(&cur, v);
+}
+
+static void val_to_number(struct sp_val *v)
+{
+    int ret;
+    int64_t i = 0;
+    double d = 0.0;
+    char tmp[64];
+    char *str;
+
+    if (v->len < sizeof(tmp)) {
+        str = tmp;
+    }
+    else {
+        str = flb_malloc(v->len + 1);
+        if (!str) {
+            flb_errno();
+            return;
+        }
+    }
+    memcpy(str, v->str, v->len);
+    str[v->len] = '\0';
+
+    ret = flb_sp_string_to_number(str, v->len, &i, &d);
+    if (str != tmp) {
+        flb_free(str);
+    }
+
+    if (ret == FLB_STR_FLOAT) {
+        v->type = FLB_EXP_FLOAT;
+        v->val.f64 = d;
+    }
+    else if (ret == FLB_STR_INT) {
+        v->type = FLB_EXP_INT;
+        v->val.i64 = i;
+    }
+}
+
+/* strncmp() limited by the left string length, as the interpreter does */
+static int val_strncmp(struct sp_val *l, struct sp_val *r)
+{
+    size_t i;
+    unsigned char lc;
+    unsigned char rc;
+
+    for (i = 0; i < l->len; i++) {
+        lc = l->str[i];
+        rc = i < r->len ? r->str[i] : '\0';
+        if (lc != rc) {
+            return lc - rc;
+        }
+        if (lc == '\0') {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+static bool val_compare(struct sp_val *l, struct sp_val *r, int op)
+{
+    int cmp;
+
+    if (l->type == SP_VAL_NONE || r->type == SP_VAL_NONE) {
+        return false;
+    }
+
+    if (l->type == FLB_EXP_STRING && r->type != FLB_EXP_STRING) {
+        val_to_number(l);
+    }
+
+    if (l->type == FLB_EXP_INT && r->type == FLB_EXP_FLOAT) {
+        l->type = FLB_EXP_FLOAT;
+        l->val.f64 = (double) l->val.i64;
+    }
+    else if (l->type == FLB_EXP_FLOAT && r->type == FLB_EXP_INT) {
+        r->type = FLB_EXP_FLOAT;
+        r->val.f64 = (double) r->val.i64;
+    }
+
+    if (l->type != r->type) {
+        return false;
+    }
+
+    if (op == FLB_EXP_EQ) {
+        switch (l->type) {
+        case FLB_EXP_NULL:
+            return true;
+        case FLB_EXP_BOOL:
+            return l->val.boolean == r->val.boolean;
+        case FLB_EXP_INT:
+            return l->val.i64 == r->val.i64;
+        case FLB_EXP_FLOAT:
+            return l->val.f64 == r->val.f64;
+        case FLB_EXP_STRING:
+            return l->len == r->len && memcmp(l->str, r->str, l->len) == 0;
+        default:
+            return false;
+        }
+    }
+
+    switch (l->type) {
+    case FLB_EXP_INT:
+        cmp = (l->val.i64 > r->val.i64) - (l->val.i64 < r->val.i64);
+        break;
+    case FLB_EXP_FLOAT:
+        cmp = (l->val.f64 > r->val.f64) - (l->val.f64 < r->val.f64);
+        break;
+    case FLB_EXP_STRING:
+        cmp = val_strncmp(l, r);
+        break;
+    default:
+        return false;
+    }
+
+    switch (op) {
+    case FLB_EXP_LT:
+        return cmp < 0;
+    case FLB_EXP_LTE:
+        return cmp <= 0;
+    case FLB_EXP_GT:
+        return cmp > 0;
+    case FLB_EXP_GTE:
+        return cmp >= 0;
+    }
+
+    return false;
+}
+
+/* NULL and missing values are false in a logical operation */
+static bool val_to_bool(struct sp_val *v)
+{
+    switch (v->type) {
+    case FLB_EXP_BOOL:
+        return v->val.boolean;
+    case FLB_EXP_INT:
+        return v->val.i64 > 0;
+    case FLB_EXP_FLOAT:
+        return v->val.f64 > 0;
+    case FLB_EXP_STRING:
+        return true;
+    }
+
+    return false;
+}
+
+/* Returns FLB_TRUE if the record matches the condition */
+int flb_sp_program_eval(struct flb_sp_program *prog,
+                        struct flb_time *tms, msgpack_object *map)
+{
+    int i;
+    int s;
+    int sp = 0;
+    int pending;
+    bool b;
+    msgpack_object key;
+    msgpack_object objs[FLB_SP_PROGRAM_SLOTS_MAX];
+    char found[FLB_SP_PROGRAM_SLOTS_MAX];
+    struct sp_val stack[FLB_SP_PROGRAM_STACK_MAX];
+    struct sp_val *l;
+    struct sp_val *r;
+    struct flb_exp_val *cval;
+    struct flb_sp_instruction *ins;
+
+    /* resolve the slots, the first key matching a name wins */
+    pending = prog->slots;
+    if (pending > 0) {
+        memset(found, 0, prog->slots);
+        for (i = 0; i < map->via.map.size && pending > 0; i++) {
+            key = map->via.map.ptr[i].key;
+            if (key.type != MSGPACK_OBJECT_STR) {
+                continue;
+            }
+            for (s = 0; s < prog->slots; s++) {
+                if (!found[s] &&
+                    flb_sds_cmp(prog->slot_names[s], key.via.str.ptr,
+                                key.via.str.size) == 0) {
+                    objs[s] = map->via.map.ptr[i].val;
+                    found[s] = FLB_TRUE;
+                    pending--;
+                }
+            }
+        }
+    }
+
+    for (i = 0; i < prog->size; i++) {
+        ins = &prog->ins[i];
+
+        switch (ins->opcode) {
+        case FLB_SP_OP_NONE:
+            stack[sp++].type = SP_VAL_NONE;
+            break;
+        case FLB_SP_OP_CONST:
+            cval = ins->val;
+            r = &stack[sp++];
+            r->type = cval->type;
+            r->val = cval->val;
+            if (cval->type == FLB_EXP_STRING) {
+                r->val.i64 = 0;
+                r->str = cval->val.string;
+                r->len = flb_sds_len(cval->val.string);
+            }
+            break;
+        case FLB_SP_OP_KEY:
+            r = &stack[sp++];
+            if (!found[ins->arg]) {
+                r->type = SP_VAL_NONE;
+            }
+            else if (objs[ins->arg].type == MSGPACK_OBJECT_MAP && ins->subkeys) {
+                subkeys_to_val(&objs[ins->arg], ins->subkeys, r);
+            }
+            else {
+                object_to_val(&objs[ins->arg], r);
+                if (r->type == SP_VAL_NONE) {
+                    flb_error("[sp key] cannot process key value");
+                }
+            }
+            break;
+        case FLB_SP_OP_CONTAINS:
+            r = &stack[sp - 1];
+            if (r->type != SP_VAL_NONE) {
+                r->type = FLB_EXP_BOOL;
+                r->val.boolean = true;
+            }
+            break;
+        case FLB_SP_OP_TIME:
+            r = &stack[sp - 1];
+            r->type = FLB_EXP_FLOAT;
+            r->val.f64 = flb_time_to_double(tms);
+            break;
+        default:
+            /* binary operations, the result replaces the left operand */
+            r = &stack[--sp];
+            l = &stack[sp - 1];
+
+            switch (ins->opcode) {
+            case FLB_SP_OP_CMP:
+                b = val_compare(l, r, ins->arg);
+                break;
+            case FLB_SP_OP_PAR:
+                b = l->type == SP_VAL_NONE ? false : l->val.boolean;
+                break;
+            case FLB_SP_OP_NOT:
+                b = !val_to_bool(l);
+                break;
+            case FLB_SP_OP_AND:
+                b = val_to_bool(l) & val_to_bool(r);
+                break;
+            case FLB_SP_OP_OR:
+                b = val_to_bool(l) | val_to_bool(r);
+                break;
+            default:
+                b = false;
+                break;
+            }
+            l->type = FLB_EXP_BOOL;
+            l->val.boolean = b;
+            break;
+        }
+    }
+
+    if (sp != 1 || stack[0].type != FLB_EXP_BOOL) {
+        return FLB_FALSE;
+    }
+
+    return stack[0].val.boolean ? FLB_TRUE : FLB_FALSE;
+}
@@ -17,23 +17,58 @@
  *  limitations under the License.
  */
 
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
 #include <fluent-bit/stream_processor/flb_sp.h>
 #include <fluent-bit/stream_processor/flb_sp_window.h>
 #include <fluent-bit/stream_processor/flb_sp_parser.h>
 #include <fluent-bit/stream_processor/flb_sp_groupby.h>
 #include <fluent-bit/stream_processor/flb_sp_aggregate_func.h>
 
+int flb_sp_window_init(struct flb_sp_task *task)
+{
+    int map_entries;
+    int gb_entries;
+    struct flb_sp_cmd *cmd = task->cmd;
+
+    mk_list_init(&task->window.data);
+    mk_list_init(&task->window.aggregate_list);
+    mk_list_init(&task->window.hopping_slot);
+    task->window.slot_id = 1;
+
+    /*
+     * Aggregation nodes and their arrays are allocated as a single block:
+     * node, nums, aggregate_data and groupby_nums.
+     */
+    map_entries = mk_list_size(&cmd->keys);
+    gb_entries = mk_list_size(&cmd->gb_keys);
+    flb_sp_groupby_arena_init(&task->window.arena,
+                              sizeof(struct aggregate_node) +
+                              sizeof(struct aggregate_num) * map_entries +
+                              sizeof(struct aggregate_data *) * map_entries +
+                              sizeof(struct aggregate_num) * gb_entries);
+
+    if (gb_entries > 0) {
+        task->window.groupby_values =
+            flb_calloc(gb_entries, sizeof(struct flb_sp_groupby_value));
+        if (!task->window.groupby_values) {
+            flb_errno();
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
 void flb_sp_window_prune(struct flb_sp_task *task)
 {
     int i;
     int map_entries;
-    rb_result_t result;
     struct aggregate_node *aggr_node;
     struct aggregate_node *aggr_node_hs;
     struct mk_list *tmp;
     struct mk_list *head;
     struct flb_sp_hopping_slot *hs;
-    struct rb_tree_node *rb_result;
     struct flb_sp_cmd_key *ckey;
     struct flb_sp_cmd *cmd = task->cmd;
 
@@ -47,9 +82,8 @@ void flb_sp_window_prune(struct flb_sp_task *task)
                 flb_sp_aggregate_node_destroy(cmd, aggr_node);
             }
 
-            rb_tree_destroy(&task->window.aggregate_tree);
+            flb_sp_groupby_table_reset(&task->window.aggregate_table);
             mk_list_init(&task->window.aggregate_list);
-            rb_tree_new(&task->window.aggregate_tree, flb_sp_groupby_compare);
             task->window.records = 0;
         }
         break;
@@ -58,47 +92,46 @@ void flb_sp_window_prune(struct flb_sp_task *task)
             return;
         }
 
+        /*
+         * Subtract the oldest slot: every slot node references the window
+         * node it was aggregated into.
+         */
         hs = mk_list_entry_first(&task->window.hopping_slot,
                                  struct flb_sp_hopping_slot, _head);
-        mk_list_foreach_safe(head, tmp, &task->window.aggregate_list) {
-            aggr_node = mk_list_entry(head, struct aggregate_node, _head);
-            result = rb_tree_find(&hs->aggregate_tree, aggr_node, &rb_result);
-            if (result == RB_OK) {
-                aggr_node_hs = mk_list_entry(rb_result, struct aggregate_node, _rb_head);
-                if (aggr_node_hs->records == aggr_node->records) {
-                    rb_tree_remove(&task->window.aggregate_tree, &aggr_node->_rb_head);
-                    mk_list_del(&aggr_node->_head);
-                    // Destroy aggregation node
-                    flb_sp_aggregate_node_destroy(cmd, aggr_node);
+        map_entries = mk_list_size(&cmd->keys);
+        mk_list_foreach(head, &hs->aggregate_list) {
+            aggr_node_hs = mk_list_entry(head, struct aggregate_node, _head);
+            aggr_node = aggr_node_hs->owner;
+
+            if (aggr_node_hs->records == aggr_node->records) {
+                /* no records of the group in newer slots */
+                if (aggr_node->groupby_keys > 0) {
+                    flb_sp_groupby_table_del(&task->window.aggregate_table,
+                                             aggr_node);
                 }
-                else {
-                    aggr_node->records -= aggr_node_hs->records;
-                    map_entries = mk_list_size(&cmd->keys);
-
-                    ckey = mk_list_entry_first(&cmd->keys,
-                                               struct flb_sp_cmd_key, _head);
-                    for (i = 0; i < map_entries; i++) {
-                        if (ckey->aggr_func) {
-                            aggregate_func_remove[ckey->aggr_func - 1](aggr_node, aggr_node_hs, i);
-                        }
-
-                        ckey = mk_list_entry_next(&ckey->_head, struct flb_sp_cmd_key,
-                                                  _head, &cmd->keys);
-                    }
+                mk_list_del(&aggr_node->_head);
+                flb_sp_aggregate_node_destroy(cmd, aggr_node);
+                continue;
+            }
+
+            aggr_node->records -= aggr_node_hs->records;
+
+            ckey = mk_list_entry_first(&cmd->keys,
+                                       struct flb_sp_cmd_key, _head);
+            for (i = 0; i < map_entries; i++) {
+                if (ckey->aggr_func) {
+                    aggregate_func_remove[ckey->aggr_func - 1](aggr_node, aggr_node_hs, i);
                 }
+
+                ckey = mk_list_entry_next(&ckey->_head, struct flb_sp_cmd_key,
+                                          _head, &cmd->keys);
             }
         }
         task->window.records -= hs->records;
 
         /* Destroy hopping slot */
-        mk_list_foreach_safe(head, tmp, &hs->aggregate_list) {
-            aggr_node_hs = mk_list_entry(head, struct aggregate_node, _head);
-            mk_list_del(&aggr_node_hs->_head);
-            flb_sp_aggregate_node_destroy(cmd, aggr_node_hs);
-        }
-        rb_tree_destroy(&hs->aggregate_tree);
         mk_list_del(&hs->_head);
-        flb_free(hs);
+        flb_sp_hopping_slot_destroy(cmd, hs);
 
         break;
     }
@@ -120,3 +153,45 @@ int flb_sp_window_populate(struct flb_sp_task *task, const char *buf_data,
 
     return 0;
 }
+
+void flb_sp_window_destroy(struct flb_sp_task *task)
+{
+    struct flb_sp_window_data *data;
+    struct aggregate_node *aggr_node;
+    struct flb_sp_hopping_slot *hs;
+    struct mk_list *head;
+    struct mk_list *tmp;
+
+    mk_list_foreach_safe(head, tmp, &task->window.data) {
+        data = mk_list_entry(head, struct flb_sp_window_data, _head);
+        flb_free(data->buf_data);
+        mk_list_del(&data->_head);
+        flb_free(data);
+    }
+
+    mk_list_foreach_safe(head, tmp, &task->window.aggregate_list) {
+        aggr_node = mk_list_entry(head, struct aggregate_node, _head);
+        mk_list_del(&aggr_node->_head);
+        flb_sp_aggregate_node_destroy(task->cmd, aggr_node);
+    }
+
+    mk_list_foreach_safe(head, tmp, &task->window.hopping_slot) {
+        hs = mk_list_entry(head, struct flb_sp_hopping_slot, _head);
+        mk_list_del(&hs->_head);
+        flb_sp_hopping_slot_destroy(task->cmd, hs);
+    }
+
+    if (task->window.open_slot) {
+        flb_sp_hopping_slot_destroy(task->cmd, task->window.open_slot);
+        task->window.open_slot = NULL;
+    }
+
+    if (task->window.fd > 0) {
+        mk_event_timeout_destroy(task->sp->config->evl, &task->window.event);
+        mk_event_closesocket(task->window.fd);
+    }
+
+    flb_sp_groupby_table_destroy(&task->window.aggregate_table);
+    flb_sp_groupby_arena_destroy(&task->window.arena);
+    flb_free(task->window.groupby_values);
+}
@@ -0,0 +1,528 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2024 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_pack.h>
+#include <fluent-bit/stream_processor/flb_sp.h>
+#include <fluent-bit/stream_processor/flb_sp_parser.h>
+#include <fluent-bit/stream_processor/flb_sp_stream.h>
+#include <fluent-bit/stream_processor/flb_sp_window.h>
+#include <fluent-bit/stream_processor/flb_sp_worker.h>
+
+static struct flb_sp_worker_emit *emit_create(struct flb_sp_task *task,
+                                              const char *tag, int tag_len,
+                                              int pending)
+{
+    struct flb_sp_worker_emit *emit;
+
+    emit = flb_calloc(1, sizeof(struct flb_sp_worker_emit));
+    if (!emit) {
+        flb_errno();
+        return NULL;
+    }
+    emit->task = task;
+    emit->pending = pending;
+    if (tag) {
+        emit->tag = flb_sds_create_len(tag, tag_len);
+        if (!emit->tag) {
+            flb_free(emit);
+            return NULL;
+        }
+    }
+    pthread_mutex_init(&emit->lock, NULL);
+
+    return emit;
+}
+
+static void emit_deliver(struct flb_sp_worker_emit *emit)
+{
+    struct flb_sp_task *task = emit->task;
+
+    if (emit->size > 0) {
+        if (task->stream) {
+            flb_sp_stream_append_data(emit->buf, emit->size, task->stream);
+        }
+        else {
+            flb_pack_print(emit->buf, emit->size);
+            flb_free(emit->buf);
+        }
+    }
+    else {
+        flb_free(emit->buf);
+    }
+
+    pthread_mutex_destroy(&emit->lock);
+    if (emit->tag) {
+        flb_sds_destroy(emit->tag);
+    }
+    flb_free(emit);
+}
+
+/* Add the results of a partition, the buffer is owned by the emitter */
+static void emit_add(struct flb_sp_worker_emit *emit, char *buf, size_t size)
+{
+    int last;
+    char *tmp;
+
+    pthread_mutex_lock(&emit->lock);
+    if (buf && size > 0) {
+        if (!emit->buf) {
+            emit->buf = buf;
+            emit->size = size;
+            buf = NULL;
+        }
+        else {
+            tmp = flb_realloc(emit->buf, emit->size + size);
+            if (!tmp) {
+                flb_errno();
+            }
+            else {
+                memcpy(tmp + emit->size, buf, size);
+                emit->buf = tmp;
+                emit->size += size;
+            }
+        }
+    }
+    emit->pending--;
+    last = (emit->pending == 0);
+    pthread_mutex_unlock(&emit->lock);
+
+    if (buf) {
+        flb_free(buf);
+    }
+
+    if (last) {
+        emit_deliver(emit);
+    }
+}
+
+struct flb_sp_worker_chunk *flb_sp_worker_chunk_create(const char *tag,
+                                                       int tag_len,
+                                                       const char *buf,
+                                                       size_t size,
+                                                       int str_conv)
+{
+    struct flb_sp_worker_chunk *chunk;
+
+    chunk = flb_calloc(1, sizeof(struct flb_sp_worker_chunk));
+    if (!chunk) {
+        flb_errno();
+        return NULL;
+    }
+
+    chunk->buf = flb_malloc(size);
+    if (!chunk->buf) {
+        flb_errno();
+        flb_free(chunk);
+        return NULL;
+    }
+    memcpy(chunk->buf, buf, size);
+    chunk->size = size;
+
+    chunk->tag = flb_sds_create_len(tag, tag_len);
+    if (!chunk->tag) {
+        flb_free(chunk->buf);
+        flb_free(chunk);
+        return NULL;
+    }
+
+    chunk->users = 1;
+    chunk->str_conv = str_conv;
+    pthread_mutex_init(&chunk->lock, NULL);
+
+    return chunk;
+}
+
+static void chunk_retain(struct flb_sp_worker_chunk *chunk)
+{
+    pthread_mutex_lock(&chunk->lock);
+    chunk->users++;
+    pthread_mutex_unlock(&chunk->lock);
+}
+
+void flb_sp_worker_chunk_release(struct flb_sp_worker_chunk *chunk)
+{
+    int users;
+
+    pthread_mutex_lock(&chunk->lock);
+    users = --chunk->users;
+    pthread_mutex_unlock(&chunk->lock);
+
+    if (users > 0) {
+        return;
+    }
+
+    pthread_mutex_destroy(&chunk->lock);
+    flb_sds_destroy(chunk->tag);
+    flb_free(chunk->buf);
+    flb_free(chunk);
+}
+
+static void job_process(struct flb_sp_worker *worker, struct flb_sp_job *job)
+{
+    int ret;
+    int tag_len = 0;
+    char *tag = NULL;
+    char *out_buf = NULL;
+    size_t out_size = 0;
+    struct flb_sp_task *task = job->task;
+    struct flb_sp_worker_chunk *chunk = job->chunk;
+
+    switch (job->type) {
+    case FLB_SP_JOB_DATA:
+        tag = chunk->tag;
+        tag_len = flb_sds_len(chunk->tag);
+
+        if (task->aggregate_keys == FLB_TRUE) {
+            ret = sp_process_data_aggr(chunk->buf, chunk->size,
+                                       tag, tag_len,
+                                       task, worker->sp, chunk->str_conv);
+            if (ret == -1) {
+                flb_error("[sp] error processing records for '%s'",
+                          task->name);
+            }
+            else if (task->window.type == FLB_SP_WINDOW_DEFAULT) {
+                if (ret > 0) {
+                    package_results(tag, tag_len, &out_buf, &out_size, task);
+                }
+                flb_sp_window_prune(task);
+            }
+        }
+        else {
+            ret = sp_process_data(tag, tag_len,
+                                  chunk->buf, chunk->size,
+                                  &out_buf, &out_size,
+                                  task, worker->sp);
+            if (ret <= 0) {
+                if (ret == -1) {
+                    flb_error("[sp] error processing records for '%s'",
+                              task->name);
+                }
+                out_buf = NULL;
+                out_size = 0;
+            }
+        }
+        flb_sp_worker_chunk_release(chunk);
+        break;
+    case FLB_SP_JOB_WINDOW:
+        if (job->emit->tag) {
+            tag = job->emit->tag;
+            tag_len = flb_sds_len(job->emit->tag);
+        }
+        if (task->window.records > 0) {
+            package_results(tag, tag_len, &out_buf, &out_size, task);
+        }
+        flb_sp_window_prune(task);
+        break;
+    case FLB_SP_JOB_HOP:
+        sp_process_hopping_slot(NULL, 0, task);
+        break;
+    }
+
+    if (job->emit) {
+        emit_add(job->emit, out_buf, out_size);
+    }
+    else if (out_buf) {
+        flb_free(out_buf);
+    }
+}
+
+static void *worker_run(void *data)
+{
+    struct flb_sp_job *job;
+    struct flb_sp_worker *worker = data;
+
+    pthread_mutex_lock(&worker->lock);
+    while (1) {
+        while (worker->jobs == 0 && !worker->exit) {
+            pthread_cond_wait(&worker->cond, &worker->lock);
+        }
+
+        /* pending jobs are processed before leaving */
+        if (worker->jobs == 0) {
+            break;
+        }
+
+        job = mk_list_entry_first(&worker->queue, struct flb_sp_job, _head);
+        mk_list_del(&job->_head);
+        worker->jobs--;
+        pthread_cond_broadcast(&worker->cond);
+        pthread_mutex_unlock(&worker->lock);
+
+        job_process(worker, job);
+        flb_free(job);
+
+        pthread_mutex_lock(&worker->lock);
+    }
+    pthread_mutex_unlock(&worker->lock);
+
+    return NULL;
+}
+
+static void worker_push(struct flb_sp_worker *worker, struct flb_sp_job *job)
+{
+    pthread_mutex_lock(&worker->lock);
+    while (worker->jobs >= FLB_SP_WORKER_QUEUE_MAX && !worker->exit) {
+        pthread_cond_wait(&worker->cond, &worker->lock);
+    }
+    mk_list_add(&job->_head, &worker->queue);
+    worker->jobs++;
+    pthread_cond_broadcast(&worker->cond);
+    pthread_mutex_unlock(&worker->lock);
+}
+
+static struct flb_sp_worker *partition_worker(struct flb_sp *sp,
+                                              struct flb_sp_task *task,
+                                              int partition)
+{
+    return &sp->workers[(task->worker + partition) % sp->workers_size];
+}
+
+int flb_sp_worker_push_data(struct flb_sp *sp, struct flb_sp_task *task,
+                            struct flb_sp_worker_chunk *chunk)
+{
+    int i;
+    struct flb_sp_job *job;
+    struct flb_sp_worker_emit *emit = NULL;
+
+    /* results are emitted for every chunk, otherwise at window events */
+    if (task->aggregate_keys != FLB_TRUE ||
+        task->window.type == FLB_SP_WINDOW_DEFAULT) {
+        emit = emit_create(task, NULL, 0, task->partitions_size);
+        if (!emit) {
+            return -1;
+        }
+    }
+
+    for (i = 0; i < task->partitions_size; i++) {
+        job = flb_calloc(1, sizeof(struct flb_sp_job));
+        if (!job) {
+            flb_errno();
+            if (emit) {
+                emit_add(emit, NULL, 0);
+            }
+            continue;
+        }
+        job->type = FLB_SP_JOB_DATA;
+        job->task = task->partitions[i];
+        job->chunk = chunk;
+        job->emit = emit;
+        chunk_retain(chunk);
+
+        worker_push(partition_worker(sp, task, i), job);
+    }
+
+    return 0;
+}
+
+int flb_sp_worker_push_event(struct flb_sp *sp, struct flb_sp_task *task,
+                             int type, const char *tag, int tag_len)
+{
+    int i;
+    struct flb_sp_job *job;
+    struct flb_sp_worker_emit *emit = NULL;
+
+    if (type == FLB_SP_JOB_WINDOW) {
+        emit = emit_create(task, tag, tag_len, task->partitions_size);
+        if (!emit) {
+            return -1;
+        }
+    }
+
+    for (i = 0; i < task->partitions_size; i++) {
+        job = flb_calloc(1, sizeof(struct flb_sp_job));
+        if (!job) {
+            flb_errno();
+            if (emit) {
+                emit_add(emit, NULL, 0);
+            }
+            continue;
+        }
+        job->type = type;
+        job->task = task->partitions[i];
+        job->emit = emit;
+
+        worker_push(partition_worker(sp, task, i), job);
+    }
+
+    return 0;
+}
+
+/*
+ * Tasks with GROUP BY aggregations are split in one partition per worker,
+ * a record is aggregated by the partition owning the hash of its group,
+ * other tasks run in a single worker.
+ */
+int flb_sp_worker_task_init(struct flb_sp *sp, struct flb_sp_task *task)
+{
+    int i;
+    int size = 1;
+    struct flb_sp_task *part;
+    struct flb_sp_cmd *cmd = task->cmd;
+
+    if (sp->workers_size == 0) {
+        return 0;
+    }
+
+    /* snapshots are read by other tasks, they stay synchronous */
+    if (cmd->type == FLB_SP_CREATE_SNAPSHOT ||
+        cmd->type == FLB_SP_FLUSH_SNAPSHOT) {
+        return 0;
+    }
+
+    if (task->aggregate_keys == FLB_TRUE && mk_list_size(&cmd->gb_keys) > 0) {
+        size = sp->workers_size;
+    }
+
+    task->partitions = flb_calloc(size, sizeof(struct flb_sp_task *));
+    if (!task->partitions) {
+        flb_errno();
+        return -1;
+    }
+    task->partitions[0] = task;
+    task->partitions_size = 1;
+    task->worker = (mk_list_size(&sp->tasks) - 1) % sp->workers_size;
+
+    for (i = 1; i < size; i++) {
+        part = flb_calloc(1, sizeof(struct flb_sp_task));
+        if (!part) {
+            flb_errno();
+            flb_sp_worker_task_destroy(task);
+            return -1;
+        }
+        part->name = task->name;
+        part->query = task->query;
+        part->source_instance = task->source_instance;
+        part->stream = task->stream;
+        part->aggregate_keys = task->aggregate_keys;
+        part->sp = sp;
+        part->cmd = cmd;
+        part->condition = task->condition;
+        part->window.type = task->window.type;
+
+        task->partitions[i] = part;
+        task->partitions_size++;
+
+        if (flb_sp_window_init(part) == -1) {
+            flb_sp_worker_task_destroy(task);
+            return -1;
+        }
+        part->window.partition = i;
+        part->window.partitions = size;
+    }
+    task->window.partition = 0;
+    task->window.partitions = size;
+
+    return 0;
+}
+
+/* Release the partitions, the task itself is not touched */
+void flb_sp_worker_task_destroy(struct flb_sp_task *task)
+{
+    int i;
+
+    if (!task->partitions) {
+        return;
+    }
+
+    for (i = 1; i < task->partitions_size; i++) {
+        flb_sp_window_destroy(task->partitions[i]);
+        flb_free(task->partitions[i]);
+    }
+    flb_free(task->partitions);
+
+    task->partitions = NULL;
+    task->partitions_size = 0;
+    task->window.partitions = 0;
+}
+
+int flb_sp_workers_create(struct flb_sp *sp, int size)
+{
+    int i;
+    int ret;
+    struct flb_sp_worker *worker;
+
+    if (size <= 0) {
+        return 0;
+    }
+
+    if (size > FLB_SP_WORKERS_MAX) {
+        flb_error("[sp] invalid number of workers %i (max %i)",
+                  size, FLB_SP_WORKERS_MAX);
+        return -1;
+    }
+
+    sp->workers = flb_calloc(size, sizeof(struct flb_sp_worker));
+    if (!sp->workers) {
+        flb_errno();
+        return -1;
+    }
+
+    for (i = 0; i < size; i++) {
+        worker = &sp->workers[i];
+        worker->id = i;
+        worker->sp = sp;
+        mk_list_init(&worker->queue);
+        pthread_mutex_init(&worker->lock, NULL);
+        pthread_cond_init(&worker->cond, NULL);
+        sp->workers_size++;
+
+        ret = pthread_create(&worker->tid, NULL, worker_run, worker);
+        if (ret != 0) {
+            flb_error("[sp] could not start worker #%i", i);
+            flb_sp_workers_destroy(sp);
+            return -1;
+        }
+        worker->running = FLB_TRUE;
+    }
+
+    flb_info("[sp] %i workers started", size);
+    return 0;
+}
+
+/* Queued jobs are processed before the workers stop */
+void flb_sp_workers_destroy(struct flb_sp *sp)
+{
+    int i;
+    struct flb_sp_worker *worker;
+
+    for (i = 0; i < sp->workers_size; i++) {
+        worker = &sp->workers[i];
+        pthread_mutex_lock(&worker->lock);
+        worker->exit = FLB_TRUE;
+        pthread_cond_broadcast(&worker->cond);
+        pthread_mutex_unlock(&worker->lock);
+    }
+
+    for (i = 0; i < sp->workers_size; i++) {
+        worker = &sp->workers[i];
+        if (worker->running) {
+            pthread_join(worker->tid, NULL);
+        }
+        pthread_cond_destroy(&worker->cond);
+        pthread_mutex_destroy(&worker->lock);
+    }
+
+    flb_free(sp->workers);
+    sp->workers = NULL;
+    sp->workers_size = 0;
+}
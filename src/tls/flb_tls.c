@@ -513,6 +513,8 @@ int flb_tls_session_create(struct flb_tls *tls,
     int                     result;
     char                   *vhost;
     int                     flag;
+    int                     reused;
+    uint64_t                ts_start;
 
     session = flb_calloc(1, sizeof(struct flb_tls_session));
 
@@ -536,16 +538,35 @@ int flb_tls_session_create(struct flb_tls *tls,
     /* Create TLS session */
     session->ptr = tls->api->session_create(tls, connection->fd);
 
-    if (session == NULL) {
+    if (session->ptr == NULL) {
         flb_error("[tls] could not create TLS session for %s",
                   flb_connection_get_remote_address(connection));
 
+        flb_free(session);
+
+        if (vhost != NULL) {
+            flb_free(vhost);
+        }
+
         return -1;
     }
 
     session->tls = tls;
     session->connection = connection;
 
+    /*
+     * Connections to the same upstream share the last session handed out by
+     * the server, so new connections can resume it instead of running a full
+     * handshake.
+     */
+    if (connection->type == FLB_UPSTREAM_CONNECTION &&
+        tls->api->session_cache_set != NULL) {
+        tls->api->session_cache_set(session->ptr,
+                                    &connection->upstream->tls_session_cache);
+    }
+
+    ts_start = cfl_time_now();
+
     result = 0;
 
     event_restore_needed = FLB_FALSE;
@@ -663,6 +684,17 @@ cleanup:
     }
     else {
         connection->tls_session = session;
+
+        if (connection->type == FLB_UPSTREAM_CONNECTION) {
+            reused = FLB_FALSE;
+            if (tls->api->session_reused != NULL) {
+                reused = tls->api->session_reused(session->ptr);
+            }
+
+            flb_upstream_tls_handshake_report(connection->upstream,
+                                              cfl_time_now() - ts_start,
+                                              reused);
+        }
     }
 
     if (vhost != NULL) {
@@ -672,6 +704,47 @@ cleanup:
     return result;
 }
 
+/*
+ * Check if 'protocol' was selected through ALPN during the handshake, it
+ * returns FLB_FALSE if the peer did not agree on any protocol.
+ */
+int flb_tls_session_alpn_match(struct flb_tls_session *session,
+                               const char *protocol)
+{
+    int ret;
+    size_t len;
+    const char *selected = NULL;
+
+    if (session->tls->api->session_alpn_get == NULL) {
+        return FLB_FALSE;
+    }
+
+    ret = session->tls->api->session_alpn_get(session->ptr, &selected, &len);
+    if (ret != 0 || selected == NULL) {
+        return FLB_FALSE;
+    }
+
+    if (len != strlen(protocol) || strncmp(selected, protocol, len) != 0) {
+        return FLB_FALSE;
+    }
+
+    return FLB_TRUE;
+}
+
+/* Release a session cached for resumption by flb_tls_session_create() */
+void flb_tls_session_cache_destroy(struct flb_tls *tls, void **cache)
+{
+    if (*cache == NULL) {
+        return;
+    }
+
+    if (tls != NULL && tls->api->session_cache_destroy != NULL) {
+        tls->api->session_cache_destroy(tls->ctx, *cache);
+    }
+
+    *cache = NULL;
+}
+
 int flb_tls_session_destroy(struct flb_tls_session *session)
 {
     int ret;
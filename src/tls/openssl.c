@@ -53,6 +53,7 @@ struct tls_session {
     SSL *ssl;
     int fd;
     int continuation_flag;
+    SSL_SESSION **cache;           /* shared resumable session slot  */
     struct tls_context *parent;    /* parent struct tls_context ref */
 };
 
@@ -123,6 +124,29 @@ static void tls_info_callback(const SSL *s, int where, int ret)
     }
 }
 
+/*
+ * Client side: keep the newest session ticket issued by the server in the
+ * cache slot of the connection. It runs within SSL_connect() or SSL_read()
+ * (TLS 1.3 tickets arrive after the handshake), so under the context mutex.
+ */
+static int tls_session_new_callback(SSL *ssl, SSL_SESSION *ssl_session)
+{
+    struct tls_session *session;
+
+    session = SSL_get_app_data(ssl);
+    if (session == NULL || session->cache == NULL) {
+        return 0;
+    }
+
+    if (*session->cache != NULL) {
+        SSL_SESSION_free(*session->cache);
+    }
+    *session->cache = ssl_session;
+
+    /* we keep the reference */
+    return 1;
+}
+
 static void tls_context_destroy(void *ctx_backend)
 {
     struct tls_context *ctx = ctx_backend;
@@ -191,6 +215,13 @@ int tls_context_alpn_set(void *ctx_backend, const char *alpn)
         if (wire_format_alpn_index > 1) {
             wire_format_alpn[0] = (char) wire_format_alpn_index - 1;
             ctx->alpn = wire_format_alpn;
+
+            /* Clients advertise the protocol list during the handshake */
+            if (ctx->mode == FLB_TLS_CLIENT_MODE) {
+                result = SSL_CTX_set_alpn_protos(ctx->ctx,
+                                    (const unsigned char *) &ctx->alpn[1],
+                                    (unsigned int) ctx->alpn[0]);
+            }
         }
 
         free(alpn_working_copy);
@@ -373,6 +404,13 @@ static void *tls_context_create(int verify,
                                    tls_context_server_alpn_select_callback,
                                    ctx);
     }
+    else {
+        /* sessions are cached per upstream, not in the context */
+        SSL_CTX_set_session_cache_mode(ssl_ctx,
+                                       SSL_SESS_CACHE_CLIENT |
+                                       SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(ssl_ctx, tls_session_new_callback);
+    }
 
     /* Verify peer: by default OpenSSL always verify peer */
     if (verify == FLB_FALSE) {
@@ -473,6 +511,7 @@ static void *tls_session_create(struct flb_tls *tls,
     session->ssl = ssl;
     session->fd = fd;
     SSL_set_fd(ssl, fd);
+    SSL_set_app_data(ssl, session);
 
     /*
      * TLS Debug Levels:
@@ -514,6 +553,64 @@ static int tls_session_destroy(void *session)
     return 0;
 }
 
+/* Bind a resumption cache slot, resuming the session it holds if any */
+static int tls_session_cache_set(void *ptr_session, void **cache)
+{
+    int ret = 0;
+    struct tls_session *session = ptr_session;
+    struct tls_context *ctx;
+
+    ctx = session->parent;
+    pthread_mutex_lock(&ctx->mutex);
+
+    session->cache = (SSL_SESSION **) cache;
+
+    if (*session->cache != NULL) {
+        if (SSL_set_session(session->ssl, *session->cache) != 1) {
+            ret = -1;
+        }
+    }
+
+    pthread_mutex_unlock(&ctx->mutex);
+
+    return ret;
+}
+
+static int tls_session_reused(void *ptr_session)
+{
+    struct tls_session *session = ptr_session;
+
+    if (SSL_session_reused(session->ssl) == 1) {
+        return FLB_TRUE;
+    }
+
+    return FLB_FALSE;
+}
+
+static int tls_session_alpn_get(void *ptr_session,
+                                const char **protocol, size_t *length)
+{
+    unsigned int len;
+    const unsigned char *data;
+    struct tls_session *session = ptr_session;
+
+    SSL_get0_alpn_selected(session->ssl, &data, &len);
+
+    *protocol = (const char *) data;
+    *length = len;
+
+    return 0;
+}
+
+static void tls_session_cache_destroy(void *ctx_backend, void *cache)
+{
+    struct tls_context *ctx = ctx_backend;
+
+    pthread_mutex_lock(&ctx->mutex);
+    SSL_SESSION_free((SSL_SESSION *) cache);
+    pthread_mutex_unlock(&ctx->mutex);
+}
+
 static int tls_net_read(struct flb_tls_session *session,
                         void *buf, size_t len)
 {
@@ -754,6 +851,12 @@ static int tls_net_handshake(struct flb_tls *tls,
                 flb_error("[tls] error: %s", err_buf);
             }
 
+            /* do not offer a session the server might have rejected again */
+            if (session->cache != NULL && *session->cache != NULL) {
+                SSL_SESSION_free(*session->cache);
+                *session->cache = NULL;
+            }
+
             pthread_mutex_unlock(&ctx->mutex);
 
             return -1;
@@ -784,13 +887,17 @@ static int tls_net_handshake(struct flb_tls *tls,
 
 /* OpenSSL backend registration */
 static struct flb_tls_backend tls_openssl = {
-    .name                 = "openssl",
-    .context_create       = tls_context_create,
-    .context_destroy      = tls_context_destroy,
-    .context_alpn_set     = tls_context_alpn_set,
-    .session_create       = tls_session_create,
-    .session_destroy      = tls_session_destroy,
-    .net_read             = tls_net_read,
-    .net_write            = tls_net_write,
-    .net_handshake        = tls_net_handshake,
+    .name                  = "openssl",
+    .context_create        = tls_context_create,
+    .context_destroy       = tls_context_destroy,
+    .context_alpn_set      = tls_context_alpn_set,
+    .session_create        = tls_session_create,
+    .session_destroy       = tls_session_destroy,
+    .session_cache_set     = tls_session_cache_set,
+    .session_reused        = tls_session_reused,
+    .session_cache_destroy = tls_session_cache_destroy,
+    .session_alpn_get      = tls_session_alpn_get,
+    .net_read              = tls_net_read,
+    .net_write             = tls_net_write,
+    .net_handshake         = tls_net_handshake,
 };
@@ -26,6 +26,7 @@
 #include <fluent-bit/flb_mem.h>
 #include <fluent-bit/flb_log.h>
 #include <fluent-bit/flb_slist.h>
+#include <fluent-bit/flb_pthread.h>
 #include <fluent-bit/wasm/flb_wasm.h>
 
 #include <msgpack.h>
@@ -38,6 +39,40 @@
 #include <unistd.h>
 #endif
 
+/*
+ * The WAMR runtime is global to the process while instances are created and
+ * destroyed by several threads (filter workers): it is initialized by the
+ * first instance and destroyed with the last one. The lock also protects
+ * the list of instances.
+ */
+static pthread_mutex_t wasm_runtime_lock = PTHREAD_MUTEX_INITIALIZER;
+static int wasm_runtime_refs = 0;
+
+static int wasm_runtime_get(RuntimeInitArgs *args)
+{
+    pthread_mutex_lock(&wasm_runtime_lock);
+    if (wasm_runtime_refs == 0 && !wasm_runtime_full_init(args)) {
+        pthread_mutex_unlock(&wasm_runtime_lock);
+        return -1;
+    }
+    wasm_runtime_refs++;
+    pthread_mutex_unlock(&wasm_runtime_lock);
+
+    return 0;
+}
+
+static void wasm_runtime_put()
+{
+    pthread_mutex_lock(&wasm_runtime_lock);
+    if (wasm_runtime_refs > 0) {
+        wasm_runtime_refs--;
+        if (wasm_runtime_refs == 0) {
+            wasm_runtime_destroy();
+        }
+    }
+    pthread_mutex_unlock(&wasm_runtime_lock);
+}
+
 void flb_wasm_init(struct flb_config *config)
 {
     mk_list_init(&config->wasm_list);
@@ -166,8 +201,12 @@ struct flb_wasm *flb_wasm_instantiate(struct flb_config *config, const char *was
     wasm_args.mem_alloc_option.allocator.realloc_func = flb_realloc;
     wasm_args.mem_alloc_option.allocator.free_func = flb_free;
 
-    if (!wasm_runtime_full_init(&wasm_args)) {
+    if (wasm_runtime_get(&wasm_args) == -1) {
         flb_error("Init runtime environment failed.");
+#if WASM_ENABLE_LIBC_WASI != 0
+        flb_free(wasi_dir_list);
+#endif
+        flb_free(fw);
         return NULL;
     }
 
@@ -209,7 +248,9 @@ struct flb_wasm *flb_wasm_instantiate(struct flb_config *config, const char *was
     fw->module_inst = module_inst;
     fw->exec_env = exec_env;
 
+    pthread_mutex_lock(&wasm_runtime_lock);
     mk_list_add(&fw->_head, &config->wasm_list);
+    pthread_mutex_unlock(&wasm_runtime_lock);
 
 #if WASM_ENABLE_LIBC_WASI != 0
     flb_free(wasi_dir_list);
@@ -239,7 +280,7 @@ error:
         flb_free(fw);
     }
 
-    wasm_runtime_destroy();
+    wasm_runtime_put();
 
     return NULL;
 }
@@ -412,9 +453,13 @@ void flb_wasm_destroy(struct flb_wasm *fw)
     if (fw->buffer) {
         BH_FREE(fw->buffer);
     }
-    wasm_runtime_destroy();
 
+    pthread_mutex_lock(&wasm_runtime_lock);
     mk_list_del(&fw->_head);
+    pthread_mutex_unlock(&wasm_runtime_lock);
+
+    wasm_runtime_put();
+
     flb_free(fw);
 }
 
@@ -0,0 +1,43 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2020 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_TEST_INTERNAL_H
+#define FLB_TEST_INTERNAL_H
+
+#ifdef FLB_TEST_INIT_NOP
+static inline void init_nop() {};
+#define TEST_INIT { init_nop(); }
+#else
+#include "../include/flb_tests_initialize_tls.h"
+#define TEST_INIT { flb_test_env_config_init(); }
+#endif
+
+#ifdef FLB_TEST_FINI_NOP
+static inline void fini_nop() {};
+#define TEST_FINI { fini_nop(); }
+#else
+#include "../include/flb_tests_initialize_tls.h"
+#define TEST_FINI { flb_test_env_config_destroy(); }
+#endif
+
+#include "../lib/acutest/acutest.h"
+#define FLB_TESTS_DATA_PATH "/root/repo/tests/internal/"
+
+#endif
@@ -100,9 +100,46 @@ void test_not_overflow_for_concatenated_gzip()
     }
 }
 
+void test_uncompress_to()
+{
+    int ret;
+    int sample_len;
+    void *str;
+    size_t len;
+    size_t out_len;
+    size_t out_size;
+    char *out_buf;
+
+    sample_len = strlen(morpheus);
+    ret = flb_gzip_compress(morpheus, sample_len, &str, &len);
+    TEST_CHECK(ret == 0);
+
+    out_size = flb_gzip_uncompressed_size(str, len);
+    TEST_CHECK(out_size == sample_len);
+
+    out_buf = flb_malloc(out_size);
+    TEST_CHECK(out_buf != NULL);
+
+    /* the output buffer is too small */
+    ret = flb_gzip_uncompress_to(str, len, out_buf, out_size - 1, &out_len);
+    TEST_CHECK(ret == -1);
+
+    ret = flb_gzip_uncompress_to(str, len, out_buf, out_size, &out_len);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(out_len == sample_len);
+    TEST_CHECK(memcmp(morpheus, out_buf, sample_len) == 0);
+
+    /* not a gzip payload */
+    TEST_CHECK(flb_gzip_uncompressed_size(str, 10) == 0);
+
+    flb_free(out_buf);
+    flb_free(str);
+}
+
 TEST_LIST = {
     {"compress", test_compress},
     {"count",  test_concatenated_gzip_count},
     {"not_overflow", test_not_overflow_for_concatenated_gzip},
+    {"uncompress_to", test_uncompress_to},
     { 0 }
 };
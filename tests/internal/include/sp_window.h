@@ -48,6 +48,13 @@ struct task_check window_checks[] = {
         "STREAM:FLB WINDOW HOPPING (5 SECOND, ADVANCE BY 2 SECOND);",
         cb_forecast_hopping_window
     },
+    {
+        6, FLB_SP_WINDOW_HOPPING, 5, 2,
+        "hopping_window_groupby",
+        "SELECT bool, SUM(id), COUNT(*) FROM STREAM:FLB WINDOW HOPPING " \
+        "(5 SECOND, ADVANCE BY 2 SECOND) GROUP BY bool;",
+        cb_hopping_window_groupby
+    },
 };
 
 #endif
@@ -5,6 +5,11 @@
 #include <fluent-bit/flb_mem.h>
 #include <fluent-bit/flb_pack.h>
 #include <fluent-bit/flb_mp.h>
+#include <cmetrics/cmetrics.h>
+#include <cmetrics/cmt_counter.h>
+#include <cmetrics/cmt_encode_msgpack.h>
+#include <cmetrics/cmt_decode_msgpack.h>
+#include <cmetrics/cmt_encode_text.h>
 #include <msgpack.h>
 
 #include "flb_tests_internal.h"
@@ -437,6 +442,86 @@ void test_object_to_cfl_to_msgpack()
     cfl_object_destroy(obj);
 }
 
+/* metrics.delta chunk: keyframe plus deltas expanded to full contexts */
+void test_metrics_delta_expand()
+{
+    int i;
+    int ret;
+    int series;
+    size_t off;
+    size_t processed;
+    char *mp_buf;
+    size_t mp_size;
+    char *out_buf;
+    size_t out_size;
+    cfl_sds_t text;
+    cfl_sds_t texts[3];
+    struct cmt *cmt;
+    struct cmt *base = NULL;
+    struct cmt *out;
+    struct cmt_counter *c;
+    msgpack_sbuffer chunk;
+
+    cmt_initialize();
+    msgpack_sbuffer_init(&chunk);
+
+    cmt = cmt_create();
+    c = cmt_counter_create(cmt, "fluentbit", "test", "requests", "Requests",
+                           1, (char *[]) {"code"});
+
+    for (i = 0; i < 3; i++) {
+        cmt_counter_inc(c, 1000 + i, 1, (char *[]) {"200"});
+        cmt_counter_set(c, 1000, 5, 1, (char *[]) {"500"});
+        if (i == 2) {
+            cmt_counter_inc(c, 1002, 1, (char *[]) {"404"});
+        }
+
+        ret = cmt_encode_msgpack_delta_create(cmt, base, &mp_buf, &mp_size);
+        TEST_CHECK(ret == 0);
+        msgpack_sbuffer_write(&chunk, mp_buf, mp_size);
+
+        off = 0;
+        ret = cmt_decode_msgpack_delta_apply(&base, mp_buf, mp_size, &off, NULL);
+        TEST_CHECK(ret == CMT_DECODE_MSGPACK_SUCCESS);
+        cmt_encode_msgpack_destroy(mp_buf);
+
+        texts[i] = cmt_encode_text_create(cmt);
+    }
+
+    ret = flb_mp_validate_metric_chunk(chunk.data, chunk.size,
+                                       &series, &processed);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(series == 3);
+    TEST_CHECK(processed == chunk.size);
+
+    ret = flb_mp_metrics_delta_expand(chunk.data, chunk.size,
+                                      &out_buf, &out_size);
+    TEST_CHECK(ret == 0);
+
+    /* every expanded context decodes on its own */
+    off = 0;
+    i = 0;
+    while (cmt_decode_msgpack_create(&out, out_buf, out_size, &off) ==
+           CMT_DECODE_MSGPACK_SUCCESS) {
+        text = cmt_encode_text_create(out);
+        TEST_CHECK(i < 3 && strcmp(text, texts[i]) == 0);
+        TEST_MSG("context %i:\n%s", i, text);
+        cmt_encode_text_destroy(text);
+        cmt_destroy(out);
+        i++;
+    }
+    TEST_CHECK(i == 3);
+    TEST_CHECK(off == out_size);
+
+    for (i = 0; i < 3; i++) {
+        cmt_encode_text_destroy(texts[i]);
+    }
+    flb_free(out_buf);
+    msgpack_sbuffer_destroy(&chunk);
+    cmt_destroy(base);
+    cmt_destroy(cmt);
+}
+
 TEST_LIST = {
     {"count"                , test_count},
     {"map_header"           , test_map_header},
@@ -444,5 +529,6 @@ TEST_LIST = {
     {"accessor_keys_remove_subkey_key" , test_keys_remove_subkey_key},
     {"accessor_keys_remove_subkey_keys" , test_keys_remove_subkey_keys},
     {"object_to_cfl_to_msgpack" , test_object_to_cfl_to_msgpack},
+    {"metrics_delta_expand" , test_metrics_delta_expand},
     { 0 }
 };
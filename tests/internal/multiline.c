@@ -1457,6 +1457,190 @@ static void test_issue_5504()
 #endif
 }
 
+/* Rule prefilters must never discard content matched by the regex */
+static void test_rule_filter()
+{
+    int i;
+    int j;
+    int ret;
+    int match;
+    struct flb_ml_rule rule;
+    struct flb_regex *regex;
+    char *patterns[] = {
+        "/\\bpanic: /",
+        "/^$/",
+        "/^goroutine \\d+ \\[[^\\]]+\\]:$/",
+        "/^(?:[^\\s.:]+\\.)*[^\\s.():]+\\(|^created by /",
+        "/^\\s/",
+        "/(.)(?:Exception|Error|Throwable|V8 errors stack trace)[:\\r\\n]/",
+        "/^[\\r\\n]*$/",
+        "/^[\\t ]+(?:eval )?at /",
+        "/^[\\t ]*(?:Caused by|Suppressed):/",
+        "/^[\\t ]*... \\d+ (?:more|common frames omitted)/",
+        "/^Traceback \\(most recent call last\\):$/",
+        "/^[\\t ]+File /",
+        "/[^\\t ]/",
+        "/^.+:\\d+:in\\s+.*/",
+        "/^\\s+from\\s+.*:\\d+:in\\s+.*/",
+        "/^(?<date>\\d{4}-\\d{2})|ab+c{2}d?/",
+        "/^(?:abc|)x/",
+        "/(?i)error/",
+        "/^[^a-z]é+x/",
+        "^plain pattern",
+        "/error/i",
+        NULL
+    };
+    char *lines[] = {
+        "",
+        "\n",
+        "panic: runtime error",
+        "http: panic serving 1.2.3.4",
+        "goroutine 1 [running]:",
+        "main.main()",
+        "created by main.start",
+        "  at com.example.Main.main(Main.java:10)",
+        "\tat com.example.Main.main(Main.java:10)",
+        "java.lang.IllegalStateException: boom",
+        "Caused by: java.io.IOException",
+        "\t... 23 more",
+        "Traceback (most recent call last):",
+        "  File \"main.py\", line 1, in <module>",
+        "ValueError: invalid literal",
+        "app.rb:10:in `foo'",
+        "    from app.rb:3:in `<main>'",
+        "2024-01 something",
+        "xabbcc",
+        "x",
+        "abcx",
+        "ERROR found",
+        "Aééx",
+        "plain pattern",
+        "some line\nCaused by: x",
+        "a regular log line without anything special",
+        NULL
+    };
+
+    for (i = 0; patterns[i]; i++) {
+        memset(&rule, 0, sizeof(rule));
+        ret = flb_ml_rule_filter_create(&rule, patterns[i]);
+        TEST_CHECK(ret == 0);
+
+        regex = flb_regex_create(patterns[i]);
+        TEST_CHECK(regex != NULL);
+        if (!regex) {
+            continue;
+        }
+
+        for (j = 0; lines[j]; j++) {
+            match = flb_regex_match(regex, (unsigned char *) lines[j],
+                                    strlen(lines[j]));
+            ret = flb_ml_rule_filter_check(&rule.filter, lines[j],
+                                           strlen(lines[j]));
+            if (match > 0) {
+                TEST_CHECK(ret == FLB_TRUE);
+                TEST_MSG("pattern '%s' matched '%s' but was filtered",
+                         patterns[i], lines[j]);
+            }
+        }
+        flb_regex_destroy(regex);
+    }
+
+    /* patterns with options are not analyzed */
+    memset(&rule, 0, sizeof(rule));
+    flb_ml_rule_filter_create(&rule, "/error/i");
+    TEST_CHECK(rule.filter.anchored == FLB_FALSE && rule.filter.literals == 0);
+
+    /* anchored patterns and required literals */
+    memset(&rule, 0, sizeof(rule));
+    flb_ml_rule_filter_create(&rule, "/^[\\t ]+(?:eval )?at /");
+    TEST_CHECK(rule.filter.anchored == FLB_TRUE);
+    TEST_CHECK(rule.filter.first[' '] && rule.filter.first['\t']);
+    TEST_CHECK(!rule.filter.first['a']);
+    TEST_CHECK(rule.filter.literals == 1 &&
+               rule.filter.literal_len[0] == 3 &&
+               memcmp(rule.filter.literal[0], "at ", 3) == 0);
+
+    memset(&rule, 0, sizeof(rule));
+    flb_ml_rule_filter_create(&rule,
+        "/(.)(?:Exception|Error|Throwable|V8 errors stack trace)[:\\r\\n]/");
+    TEST_CHECK(rule.filter.anchored == FLB_FALSE);
+    TEST_CHECK(rule.filter.literals == 4);
+    TEST_CHECK(flb_ml_rule_filter_check(&rule.filter, "no stack", 8) == FLB_FALSE);
+}
+
+/*
+ * Time the processing of mostly non matching lines, only when
+ * FLB_BENCHMARK is set in the environment.
+ */
+static void test_rule_filter_benchmark()
+{
+    int i;
+    int ret;
+    int len;
+    int lines = 200000;
+    double elapsed;
+    uint64_t stream_id;
+    struct flb_time tm;
+    struct flb_time t_start;
+    struct flb_time t_end;
+    struct flb_time t_diff;
+    struct flb_config *config;
+    struct flb_ml *ml;
+    struct flb_ml_parser_ins *mlp_i;
+    msgpack_sbuffer mp_sbuf;
+    char *buf[] = {
+        "2024-05-07 18:57:50.904 INFO  [main] request served in 12ms status=200",
+        "2024-05-07 18:57:50.905 DEBUG [pool-1] connection returned to the pool",
+        "java.lang.IllegalStateException: boom",
+        "\tat com.example.Main.main(Main.java:10)",
+        "\tat com.example.Main.run(Main.java:22)",
+        "2024-05-07 18:57:50.906 WARN  [main] slow query took 350ms",
+        "Traceback (most recent call last):",
+        "  File \"main.py\", line 1, in <module>",
+        "ValueError: invalid literal",
+        "2024-05-07 18:57:50.907 INFO  [main] done",
+    };
+
+    if (!getenv("FLB_BENCHMARK")) {
+        printf("\nskipped, set FLB_BENCHMARK to run it\n");
+        return;
+    }
+
+    msgpack_sbuffer_init(&mp_sbuf);
+
+    config = flb_config_init();
+    ml = flb_ml_create(config, "filter-benchmark");
+    TEST_CHECK(ml != NULL);
+
+    mlp_i = flb_ml_parser_instance_create(ml, "java");
+    TEST_CHECK(mlp_i != NULL);
+    mlp_i = flb_ml_parser_instance_create(ml, "python");
+    TEST_CHECK(mlp_i != NULL);
+    mlp_i = flb_ml_parser_instance_create(ml, "go");
+    TEST_CHECK(mlp_i != NULL);
+
+    ret = flb_ml_stream_create(ml, "benchmark", -1, flush_callback_to_buf,
+                               &mp_sbuf, &stream_id);
+    TEST_CHECK(ret == 0);
+
+    flb_time_get(&t_start);
+    for (i = 0; i < lines; i++) {
+        len = strlen(buf[i % 10]);
+        flb_time_get(&tm);
+        flb_ml_append_text(ml, stream_id, &tm, buf[i % 10], len);
+    }
+    flb_time_get(&t_end);
+
+    flb_time_diff(&t_end, &t_start, &t_diff);
+    elapsed = flb_time_to_double(&t_diff);
+    printf("\n%i lines processed in %.3f seconds (%.0f lines/s)\n",
+           lines, elapsed, elapsed > 0 ? lines / elapsed : 0);
+
+    flb_ml_destroy(ml);
+    flb_config_exit(config);
+    msgpack_sbuffer_destroy(&mp_sbuf);
+}
+
 TEST_LIST = {
     /* Normal features tests */
     { "parser_docker",  test_parser_docker},
@@ -1468,6 +1652,8 @@ TEST_LIST = {
     { "parser_go",      test_parser_go},
     { "container_mix",  test_container_mix},
     { "endswith",       test_endswith},
+    { "rule_filter",    test_rule_filter},
+    { "rule_filter_benchmark", test_rule_filter_benchmark},
 
     /* Issues reported on Github */
     { "issue_3817_1"  , test_issue_3817_1},
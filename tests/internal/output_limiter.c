@@ -0,0 +1,112 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_output.h>
+#include <fluent-bit/flb_output_limiter.h>
+
+#include "flb_tests_internal.h"
+
+/* 10 milliseconds in nanoseconds */
+#define LATENCY   10000000ULL
+
+void test_create_bounds()
+{
+    struct flb_output_limiter *limiter;
+
+    limiter = flb_output_limiter_create(1, 64);
+    TEST_CHECK(limiter != NULL);
+    TEST_CHECK(limiter->limit == FLB_OUTPUT_LIMITER_INITIAL);
+    flb_output_limiter_destroy(limiter);
+
+    /* initial limit is clamped */
+    limiter = flb_output_limiter_create(1, 2);
+    TEST_CHECK(limiter->limit == 2);
+    flb_output_limiter_destroy(limiter);
+
+    limiter = flb_output_limiter_create(8, 4);
+    TEST_CHECK(limiter->min == 8 && limiter->max == 8);
+    TEST_CHECK(limiter->limit == 8);
+    flb_output_limiter_destroy(limiter);
+}
+
+void test_additive_increase()
+{
+    int i;
+    uint64_t now;
+    struct flb_output_limiter *limiter;
+
+    limiter = flb_output_limiter_create(1, 16);
+    now = 0;
+
+    /* not saturated: the limit does not grow */
+    limiter->in_flight = 1;
+    for (i = 0; i < 100; i++) {
+        now += LATENCY;
+        flb_output_limiter_update(limiter, now, LATENCY, FLB_OK);
+    }
+    TEST_CHECK(limiter->limit == FLB_OUTPUT_LIMITER_INITIAL);
+
+    /* saturated and healthy: about +1 per 'limit' completions */
+    for (i = 0; i < 1000; i++) {
+        limiter->in_flight = (int) limiter->limit;
+        now += LATENCY;
+        flb_output_limiter_update(limiter, now, LATENCY, FLB_OK);
+    }
+    TEST_CHECK(limiter->limit == 16);
+
+    flb_output_limiter_destroy(limiter);
+}
+
+void test_multiplicative_decrease()
+{
+    int i;
+    double limit;
+    uint64_t now;
+    struct flb_output_limiter *limiter;
+
+    limiter = flb_output_limiter_create(1, 64);
+    limiter->limit = 32;
+    limiter->in_flight = 32;
+    now = LATENCY;
+
+    /* establish the baseline */
+    flb_output_limiter_update(limiter, now, LATENCY, FLB_OK);
+    limit = limiter->limit;
+
+    /* a retry shrinks the limit by the backoff factor */
+    now += LATENCY;
+    flb_output_limiter_update(limiter, now, LATENCY, FLB_RETRY);
+    TEST_CHECK(limiter->limit < limit);
+    TEST_CHECK(limiter->limit > limit * FLB_OUTPUT_LIMITER_BACKOFF - 0.01);
+
+    /* burst of retries within the same round trip: a single decrease */
+    limit = limiter->limit;
+    for (i = 0; i < 10; i++) {
+        flb_output_limiter_update(limiter, now + i, LATENCY, FLB_RETRY);
+    }
+    TEST_CHECK(limiter->limit == limit);
+
+    /* latency way above the baseline is congestion too */
+    for (i = 0; i < 50; i++) {
+        now += LATENCY * 10;
+        flb_output_limiter_update(limiter, now, LATENCY * 10, FLB_OK);
+    }
+    TEST_CHECK(limiter->limit < limit);
+
+    /* never below the minimum */
+    for (i = 0; i < 100; i++) {
+        now += LATENCY * 100;
+        flb_output_limiter_update(limiter, now, LATENCY, FLB_RETRY);
+    }
+    TEST_CHECK(limiter->limit == 1);
+
+    flb_output_limiter_destroy(limiter);
+}
+
+TEST_LIST = {
+    {"create_bounds"          , test_create_bounds},
+    {"additive_increase"      , test_additive_increase},
+    {"multiplicative_decrease", test_multiplicative_decrease},
+    { 0 }
+};
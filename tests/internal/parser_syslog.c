@@ -0,0 +1,377 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2024 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_config.h>
+#include <fluent-bit/flb_parser.h>
+#include <cfl/cfl_time.h>
+#include "flb_tests_internal.h"
+
+/* regex decoder, the reference for the native one */
+int flb_parser_regex_do(struct flb_parser *parser,
+                        const char *buf, size_t length,
+                        void **out_buf, size_t *out_size,
+                        struct flb_time *out_time);
+
+/* stock definitions from conf/parsers.conf */
+#define RFC5424_REGEX                                                     \
+    "^\\<(?<pri>[0-9]{1,5})\\>1 (?<time>[^ ]+) (?<host>[^ ]+) "           \
+    "(?<ident>[^ ]+) (?<pid>[-0-9]+) (?<msgid>[^ ]+) "                    \
+    "(?<extradata>(\\[(.*?)\\]|-)) (?<message>.+)$"
+#define RFC5424_TIME   "%Y-%m-%dT%H:%M:%S.%L%z"
+
+#define RFC3164_LOCAL_REGEX                                               \
+    "^\\<(?<pri>[0-9]+)\\>(?<time>[^ ]* {1,2}[^ ]* [^ ]*) "               \
+    "(?<ident>[a-zA-Z0-9_\\/\\.\\-]*)(?:\\[(?<pid>[0-9]+)\\])?"           \
+    "(?:[^\\:]*\\:)? *(?<message>.*)$"
+
+#define RFC3164_REGEX                                                     \
+    "/^\\<(?<pri>[0-9]+)\\>(?<time>[^ ]* {1,2}[^ ]* [^ ]*) (?<host>[^ ]*) " \
+    "(?<ident>[a-zA-Z0-9_\\/\\.\\-]*)(?:\\[(?<pid>[0-9]+)\\])?"           \
+    "(?:[^\\:]*\\:)? *(?<message>.*)$/"
+#define RFC3164_TIME   "%b %d %H:%M:%S"
+
+static const char *rfc5424_msgs[] = {
+    "<34>1 2003-10-11T22:14:15.003Z mymachine.example.com su 12 ID47 - "
+    "'su root' failed for lonvick on /dev/pts/8",
+    "<165>1 2003-08-24T05:14:15.000003-07:00 192.0.2.1 myproc 8710 - - "
+    "%% It's time to make the do-nuts.",
+    "<165>1 2003-10-11T22:14:15.003Z mymachine.example.com evntslog - ID47 "
+    "[exampleSDID@32473 iut=\"3\" eventSource=\"Application\" "
+    "eventID=\"1011\"] An application event log entry...",
+    "<165>1 2003-10-11T22:14:15.123456789+0530 host app 1 ID1 "
+    "[a x=\"]\"][b y=\"1\"] msg with ] brackets",
+    "<1>1 2023-01-31T23:59:60.5+00:00 h i - - - x",
+    "<13>1 2024-02-29T12:00:00.000Z host app - - - message: ünïcödé",
+    /* malformed for the native decoder, handled by the regex */
+    "<34>1 2003-10-11T22:14:15Z mymachine.example.com su 12 ID47 - no fraction",
+    "<34>1 2003-10-11 22:14:15.003Z host su 12 ID47 - bad time",
+    "<34>1 2003-10-11T22:14:15.003Z hóst su 12 ID47 - utf-8 host",
+    "<34>1 2003-10-11T22:14:15.003Z host su 12 ID47 [a] ",
+    "<123456>1 2003-10-11T22:14:15.003Z host su 12 ID47 - long pri",
+    "<34>1 2003-10-11T22:14:15.003Z host su 12 ID47 - two\nlines",
+    "<34>2 2003-10-11T22:14:15.003Z host su 12 ID47 - version",
+    NULL
+};
+
+static const char *rfc3164_local_msgs[] = {
+    "<13>Oct 11 22:14:15 myapp[123]: hello world",
+    "<13>Oct  1 22:14:15 myapp: hello: world",
+    "<13>Feb 28 00:00:00 kernel: [ 0.000000] Linux version",
+    "<13>Oct 11 22:14:15 some message without colon",
+    "<13>Oct 11 22:14:15 app[12] extra text: message",
+    "<13>Oct 11 22:14:15 app[x]: not a pid",
+    "<13>Oct 11 22:14:15 app:",
+    "<13>Oct 11 22:14:15 app:    padded",
+    "<13>Oct 11 22:14:15 :: only colons",
+    "<13>Oct 11 22:14:15 app: ünïcödé",
+    /* malformed for the native decoder, handled by the regex */
+    "<13>October 11 22:14:15 app: full month",
+    "<13>oct 11 22:14:15 app: lower case month",
+    "<13>Oct 11 22:14 app: no seconds",
+    "<13>Oct 11 22:14:15 äpp: utf-8 ident",
+    "<13> no time",
+    "<13>Oct 11 22:14:15 app: two\nlines",
+    NULL
+};
+
+static const char *rfc3164_msgs[] = {
+    "<34>Oct 11 22:14:15 mymachine su: 'su root' failed for lonvick",
+    "<34>Oct  1 22:14:15 mymachine su[230]: message",
+    "<34>Oct 11 22:14:15 mymachine sshd[4321]: Accepted publickey for root",
+    "<34>Oct 11 22:14:15  su: empty host",
+    "<34>Oct 11 22:14:15 mymachine no colon here",
+    /* malformed for the native decoder, handled by the regex */
+    "<34>Oct 11 22:14:15 mymachine",
+    "<34>Oct 32 22:14:15 mymachine su: bad day",
+    "<34>Oct 11 25:14:15 mymachine su: bad hour",
+    NULL
+};
+
+static struct flb_parser *parser_create(struct flb_config *config,
+                                        const char *name, const char *regex,
+                                        const char *time_fmt,
+                                        int skip_empty, int time_keep)
+{
+    return flb_parser_create(name, "regex", regex, skip_empty,
+                             time_fmt, "time", NULL,
+                             time_keep, FLB_TRUE, FLB_FALSE, FLB_FALSE,
+                             NULL, 0, NULL, config);
+}
+
+/* Compare the native decoder against the regex one for every message */
+static void check_corpus(struct flb_parser *parser, const char **msgs,
+                         int expected_format)
+{
+    int i;
+    int ret_native;
+    int ret_regex;
+    void *out_native;
+    void *out_regex;
+    size_t size_native;
+    size_t size_regex;
+    struct flb_time t_native;
+    struct flb_time t_regex;
+
+    TEST_CHECK(parser != NULL);
+    if (!parser) {
+        return;
+    }
+    TEST_CHECK(parser->syslog_format == expected_format);
+
+    for (i = 0; msgs[i] != NULL; i++) {
+        out_native = NULL;
+        out_regex = NULL;
+        flb_time_zero(&t_native);
+        flb_time_zero(&t_regex);
+
+        ret_native = flb_parser_do(parser, msgs[i], strlen(msgs[i]),
+                                   &out_native, &size_native, &t_native);
+        ret_regex = flb_parser_regex_do(parser, msgs[i], strlen(msgs[i]),
+                                        &out_regex, &size_regex, &t_regex);
+
+        TEST_CHECK(ret_native == ret_regex);
+        TEST_MSG("message: %s", msgs[i]);
+        if (ret_native >= 0 && ret_regex >= 0) {
+            TEST_CHECK(size_native == size_regex &&
+                       memcmp(out_native, out_regex, size_regex) == 0);
+            TEST_MSG("record mismatch: %s", msgs[i]);
+
+            TEST_CHECK(flb_time_equal(&t_native, &t_regex));
+            TEST_MSG("time mismatch: %s native=%ld.%09ld regex=%ld.%09ld",
+                     msgs[i],
+                     (long) t_native.tm.tv_sec, t_native.tm.tv_nsec,
+                     (long) t_regex.tm.tv_sec, t_regex.tm.tv_nsec);
+        }
+
+        if (out_native) {
+            flb_free(out_native);
+        }
+        if (out_regex) {
+            flb_free(out_regex);
+        }
+    }
+}
+
+static void test_rfc5424()
+{
+    struct flb_config *config;
+    struct flb_parser *parser;
+
+    config = flb_config_init();
+    TEST_CHECK(config != NULL);
+
+    parser = parser_create(config, "syslog-rfc5424", RFC5424_REGEX,
+                           RFC5424_TIME, FLB_TRUE, FLB_TRUE);
+    check_corpus(parser, rfc5424_msgs, FLB_PARSER_SYSLOG_RFC5424);
+
+    flb_parser_exit(config);
+    flb_config_exit(config);
+}
+
+static void test_rfc3164_local()
+{
+    struct flb_config *config;
+    struct flb_parser *parser;
+
+    config = flb_config_init();
+    TEST_CHECK(config != NULL);
+
+    parser = parser_create(config, "syslog-rfc3164-local", RFC3164_LOCAL_REGEX,
+                           RFC3164_TIME, FLB_TRUE, FLB_TRUE);
+    check_corpus(parser, rfc3164_local_msgs, FLB_PARSER_SYSLOG_RFC3164_LOCAL);
+
+    flb_parser_exit(config);
+    flb_config_exit(config);
+}
+
+static void test_rfc3164()
+{
+    struct flb_config *config;
+    struct flb_parser *parser;
+
+    config = flb_config_init();
+    TEST_CHECK(config != NULL);
+
+    parser = parser_create(config, "syslog-rfc3164", RFC3164_REGEX,
+                           RFC3164_TIME, FLB_TRUE, FLB_TRUE);
+    check_corpus(parser, rfc3164_msgs, FLB_PARSER_SYSLOG_RFC3164);
+
+    flb_parser_exit(config);
+    flb_config_exit(config);
+}
+
+/* 'Skip_Empty_Values Off' and 'Time_Keep Off' change the record layout */
+static void test_options()
+{
+    struct flb_config *config;
+    struct flb_parser *parser;
+
+    config = flb_config_init();
+    TEST_CHECK(config != NULL);
+
+    parser = parser_create(config, "a", RFC3164_LOCAL_REGEX,
+                           RFC3164_TIME, FLB_FALSE, FLB_FALSE);
+    check_corpus(parser, rfc3164_local_msgs, FLB_PARSER_SYSLOG_RFC3164_LOCAL);
+
+    parser = parser_create(config, "b", RFC5424_REGEX,
+                           RFC5424_TIME, FLB_FALSE, FLB_FALSE);
+    check_corpus(parser, rfc5424_msgs, FLB_PARSER_SYSLOG_RFC5424);
+
+    flb_parser_exit(config);
+    flb_config_exit(config);
+}
+
+/* Custom patterns or time formats keep using the regex */
+static void test_detection()
+{
+    struct flb_config *config;
+    struct flb_parser *parser;
+
+    config = flb_config_init();
+    TEST_CHECK(config != NULL);
+
+    parser = parser_create(config, "a", RFC5424_REGEX,
+                           "%Y-%m-%dT%H:%M:%S%z", FLB_TRUE, FLB_TRUE);
+    TEST_CHECK(parser != NULL && parser->syslog_format == FLB_PARSER_SYSLOG_NONE);
+
+    parser = parser_create(config, "b", "^\\<(?<pri>[0-9]+)\\>(?<message>.*)$",
+                           NULL, FLB_TRUE, FLB_TRUE);
+    TEST_CHECK(parser != NULL && parser->syslog_format == FLB_PARSER_SYSLOG_NONE);
+
+    parser = flb_parser_create("c", "regex", RFC3164_REGEX, FLB_TRUE,
+                               RFC3164_TIME, "timestamp", NULL,
+                               FLB_TRUE, FLB_TRUE, FLB_FALSE, FLB_FALSE,
+                               NULL, 0, NULL, config);
+    TEST_CHECK(parser != NULL && parser->syslog_format == FLB_PARSER_SYSLOG_NONE);
+
+    flb_parser_exit(config);
+    flb_config_exit(config);
+}
+
+/*
+ * Throughput of both decoders over a stream shaped like a syslog capture:
+ * mostly daemon and kernel messages with a few structured data entries.
+ */
+#define BENCH_ROUNDS 20000
+
+static const char *bench_5424[] = {
+    "<165>1 2024-03-01T10:00:01.123456Z web-01 nginx 1201 - - "
+    "10.0.0.1 - - \"GET /index.html HTTP/1.1\" 200 612 \"-\" \"curl/8.0\"",
+    "<14>1 2024-03-01T10:00:01.223456+01:00 db-02 postgres 884 - - "
+    "LOG:  checkpoint complete: wrote 42 buffers (0.3%); 0 WAL file(s) added",
+    "<165>1 2024-03-01T10:00:02.000001Z app-03 billing - ID47 "
+    "[origin ip=\"10.0.0.3\" software=\"billing\"][meta sequenceId=\"2\"] "
+    "invoice 88123 generated",
+    NULL
+};
+
+static const char *bench_3164[] = {
+    "<38>Mar  1 10:00:01 sshd[4321]: Accepted publickey for deploy from "
+    "10.0.0.9 port 51812 ssh2",
+    "<6>Mar  1 10:00:01 kernel: [12345.678901] eth0: link up, 1000Mbps",
+    "<86>Mar  1 10:00:02 CRON[991]: pam_unix(cron:session): session opened",
+    NULL
+};
+
+static double bench_run(struct flb_parser *parser, const char **msgs,
+                        int native)
+{
+    int i;
+    int n;
+    int ret;
+    int count = 0;
+    void *out_buf;
+    size_t out_size;
+    uint64_t start;
+    uint64_t elapsed;
+    struct flb_time t;
+
+    start = cfl_time_now();
+    for (n = 0; n < BENCH_ROUNDS; n++) {
+        for (i = 0; msgs[i] != NULL; i++) {
+            if (native) {
+                ret = flb_parser_do(parser, msgs[i], strlen(msgs[i]),
+                                    &out_buf, &out_size, &t);
+            }
+            else {
+                ret = flb_parser_regex_do(parser, msgs[i], strlen(msgs[i]),
+                                          &out_buf, &out_size, &t);
+            }
+            if (ret >= 0) {
+                flb_free(out_buf);
+            }
+            count++;
+        }
+    }
+    elapsed = cfl_time_now() - start;
+    if (elapsed == 0) {
+        elapsed = 1;
+    }
+
+    return count / (elapsed / 1000000000.0);
+}
+
+/* Compare the regex and native parsers, only when FLB_BENCHMARK is set */
+static void test_benchmark()
+{
+    double regex;
+    double native;
+    struct flb_config *config;
+    struct flb_parser *p5424;
+    struct flb_parser *p3164;
+
+    if (!getenv("FLB_BENCHMARK")) {
+        printf("\nskipped, set FLB_BENCHMARK to run it\n");
+        return;
+    }
+
+    config = flb_config_init();
+    TEST_CHECK(config != NULL);
+
+    p5424 = parser_create(config, "syslog-rfc5424", RFC5424_REGEX,
+                          RFC5424_TIME, FLB_TRUE, FLB_TRUE);
+    p3164 = parser_create(config, "syslog-rfc3164-local", RFC3164_LOCAL_REGEX,
+                          RFC3164_TIME, FLB_TRUE, FLB_TRUE);
+    TEST_CHECK(p5424 != NULL && p3164 != NULL);
+
+    regex = bench_run(p5424, bench_5424, FLB_FALSE);
+    native = bench_run(p5424, bench_5424, FLB_TRUE);
+    printf("\nrfc5424: regex %.0f msgs/s, native %.0f msgs/s (x%.1f)\n",
+           regex, native, native / regex);
+
+    regex = bench_run(p3164, bench_3164, FLB_FALSE);
+    native = bench_run(p3164, bench_3164, FLB_TRUE);
+    printf("rfc3164: regex %.0f msgs/s, native %.0f msgs/s (x%.1f)\n",
+           regex, native, native / regex);
+
+    flb_parser_exit(config);
+    flb_config_exit(config);
+}
+
+TEST_LIST = {
+    {"rfc5424",       test_rfc5424},
+    {"rfc3164_local", test_rfc3164_local},
+    {"rfc3164",       test_rfc3164},
+    {"options",       test_options},
+    {"detection",     test_detection},
+    {"benchmark",     test_benchmark},
+    {0}
+};
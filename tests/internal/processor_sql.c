@@ -0,0 +1,314 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2015-2024 The Fluent Bit Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_lib.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_time.h>
+#include <fluent-bit/flb_processor.h>
+#include <fluent-bit/flb_log_event_decoder.h>
+#include <cfl/cfl_time.h>
+#include <msgpack.h>
+#include <inttypes.h>
+
+#include "flb_tests_internal.h"
+
+#define SQL_QUERY                                                    \
+    "SELECT id, msg AS message FROM STREAM "                         \
+    "WHERE level > 3 AND (status = 'ok' OR code >= 500);"
+
+#define BENCHMARK_RECORDS  1000000
+
+static void pack_str(msgpack_packer *mp_pck, char *str)
+{
+    msgpack_pack_str(mp_pck, strlen(str));
+    msgpack_pack_str_body(mp_pck, str, strlen(str));
+}
+
+/* 'count' records, expected_match() tells which ones SQL_QUERY selects */
+static void create_records(int count, char **out_buf, size_t *out_size)
+{
+    int i;
+    struct flb_time tm;
+    msgpack_sbuffer mp_sbuf;
+    msgpack_packer mp_pck;
+
+    msgpack_sbuffer_init(&mp_sbuf);
+    msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
+
+    for (i = 0; i < count; i++) {
+        msgpack_pack_array(&mp_pck, 2);
+        flb_time_set(&tm, 1700000000 + i, 0);
+        flb_time_append_to_msgpack(&tm, &mp_pck, 0);
+
+        msgpack_pack_map(&mp_pck, 6);
+        pack_str(&mp_pck, "id");
+        msgpack_pack_int64(&mp_pck, i);
+        pack_str(&mp_pck, "host");
+        pack_str(&mp_pck, "web-01.example.com");
+        pack_str(&mp_pck, "level");
+        if (i % 5 == 0) {
+            /* numbers as strings are compared as numbers */
+            pack_str(&mp_pck, (i % 8 > 3) ? "7" : "1");
+        }
+        else {
+            msgpack_pack_int64(&mp_pck, i % 8);
+        }
+        pack_str(&mp_pck, "status");
+        pack_str(&mp_pck, (i % 3) ? "ok" : "error");
+        pack_str(&mp_pck, "code");
+        if (i % 7 == 0) {
+            msgpack_pack_nil(&mp_pck);
+        }
+        else {
+            msgpack_pack_double(&mp_pck, (i % 3) ? 200.0 : 500.0 + (i % 4));
+        }
+        pack_str(&mp_pck, "msg");
+        pack_str(&mp_pck, "GET /index.html HTTP/1.1");
+    }
+
+    *out_buf = mp_sbuf.data;
+    *out_size = mp_sbuf.size;
+}
+
+static int expected_match(int i)
+{
+    int level = i % 8;
+
+    if (i % 5 == 0) {
+        level = (i % 8 > 3) ? 7 : 1;
+    }
+
+    if (level <= 3) {
+        return FLB_FALSE;
+    }
+
+    if (i % 3) {
+        return FLB_TRUE;
+    }
+
+    return i % 7 != 0;
+}
+
+static struct flb_processor *sql_processor_create(struct flb_config *config,
+                                                  char *columnar)
+{
+    int ret;
+    flb_sds_t query;
+    flb_sds_t mode;
+    struct flb_processor *proc;
+    struct flb_processor_unit *pu;
+    struct cfl_variant var = {
+        .type = CFL_VARIANT_STRING,
+        .data.as_string = NULL,
+    };
+
+    proc = flb_processor_create(config, "unit_test", NULL, 0);
+    TEST_CHECK(proc != NULL);
+
+    pu = flb_processor_unit_create(proc, FLB_PROCESSOR_LOGS, "sql");
+    TEST_CHECK(pu != NULL);
+
+    query = flb_sds_create(SQL_QUERY);
+    var.data.as_string = query;
+    ret = flb_processor_unit_set_property(pu, "query", &var);
+    TEST_CHECK(ret == 0);
+
+    mode = flb_sds_create(columnar);
+    var.data.as_string = mode;
+    ret = flb_processor_unit_set_property(pu, "columnar", &var);
+    TEST_CHECK(ret == 0);
+
+    ret = flb_processor_init(proc);
+    TEST_CHECK(ret == 0);
+
+    flb_sds_destroy(query);
+    flb_sds_destroy(mode);
+
+    return proc;
+}
+
+static int run(struct flb_processor *proc, char *buf, size_t size,
+               char **out_buf, size_t *out_size)
+{
+    int ret;
+    void *tmp = NULL;
+    size_t tmp_size = 0;
+
+    ret = flb_processor_run(proc, 0, FLB_PROCESSOR_LOGS, "TEST", 4,
+                            buf, size, &tmp, &tmp_size);
+    *out_buf = tmp;
+    *out_size = tmp_size;
+
+    return ret;
+}
+
+static void check_records(char *buf, size_t size, int count)
+{
+    int ret;
+    int i = 0;
+    int n = 0;
+    int64_t id;
+    msgpack_object *body;
+    struct flb_log_event event;
+    struct flb_log_event_decoder decoder;
+
+    ret = flb_log_event_decoder_init(&decoder, buf, size);
+    TEST_CHECK(ret == FLB_EVENT_DECODER_SUCCESS);
+
+    while (flb_log_event_decoder_next(&decoder, &event) ==
+           FLB_EVENT_DECODER_SUCCESS) {
+        body = event.body;
+        if (!TEST_CHECK(body->type == MSGPACK_OBJECT_MAP &&
+                        body->via.map.size == 2)) {
+            break;
+        }
+
+        TEST_CHECK(body->via.map.ptr[0].key.via.str.size == 2);
+        TEST_CHECK(strncmp(body->via.map.ptr[1].key.via.str.ptr,
+                           "message", 7) == 0);
+
+        /* records keep their order */
+        id = body->via.map.ptr[0].val.via.i64;
+        while (i < count && !expected_match(i)) {
+            i++;
+        }
+        TEST_CHECK(id == i);
+        TEST_MSG("record %i, expected id %i got %" PRId64, n, i, id);
+        i++;
+        n++;
+    }
+    flb_log_event_decoder_destroy(&decoder);
+
+    while (i < count && !expected_match(i)) {
+        i++;
+    }
+    TEST_CHECK(i == count);
+}
+
+static void test_columnar()
+{
+    int ret;
+    int count;
+    char *buf;
+    size_t size;
+    char *row_buf;
+    size_t row_size;
+    char *col_buf;
+    size_t col_size;
+    struct flb_config *config;
+    struct flb_processor *row;
+    struct flb_processor *col;
+
+    flb_init_env();
+
+    config = flb_config_init();
+    TEST_CHECK(config != NULL);
+
+    row = sql_processor_create(config, "false");
+    col = sql_processor_create(config, "true");
+
+    /* smaller, equal to and larger than a batch */
+    for (count = 1; count <= 3000; count = count * 3 + 7) {
+        create_records(count, &buf, &size);
+
+        ret = run(row, buf, size, &row_buf, &row_size);
+        TEST_CHECK(ret == 0);
+        ret = run(col, buf, size, &col_buf, &col_size);
+        TEST_CHECK(ret == 0);
+
+        TEST_CHECK(row_size == col_size &&
+                   memcmp(row_buf, col_buf, row_size) == 0);
+        TEST_MSG("%i records: row %zu bytes, columnar %zu bytes",
+                 count, row_size, col_size);
+        check_records(col_buf, col_size, count);
+
+        if (row_buf != buf) {
+            flb_free(row_buf);
+        }
+        if (col_buf != buf) {
+            flb_free(col_buf);
+        }
+        flb_free(buf);
+    }
+
+    flb_processor_destroy(row);
+    flb_processor_destroy(col);
+    flb_config_exit(config);
+}
+
+/*
+ * Throughput of both modes, too slow for every test run: it only runs
+ * when FLB_BENCHMARK is set in the environment.
+ */
+static void test_benchmark()
+{
+    int i;
+    int ret;
+    char *buf;
+    size_t size;
+    char *out_buf;
+    size_t out_size;
+    uint64_t t1;
+    uint64_t t2;
+    char *modes[] = {"false", "true"};
+    struct flb_config *config;
+    struct flb_processor *proc;
+
+    if (!getenv("FLB_BENCHMARK")) {
+        printf("\nskipped, set FLB_BENCHMARK to run it\n");
+        return;
+    }
+
+    flb_init_env();
+
+    config = flb_config_init();
+    TEST_CHECK(config != NULL);
+
+    create_records(BENCHMARK_RECORDS, &buf, &size);
+
+    for (i = 0; i < 2; i++) {
+        proc = sql_processor_create(config, modes[i]);
+
+        t1 = cfl_time_now();
+        ret = run(proc, buf, size, &out_buf, &out_size);
+        t2 = cfl_time_now();
+        TEST_CHECK(ret == 0);
+
+        printf("\n[columnar=%s] %i records in %.3f ms, %.0f records/s",
+               modes[i], BENCHMARK_RECORDS, (t2 - t1) / 1000000.0,
+               BENCHMARK_RECORDS / ((t2 - t1) / 1000000000.0));
+
+        if (out_buf != buf) {
+            flb_free(out_buf);
+        }
+        flb_processor_destroy(proc);
+    }
+    printf("\n");
+
+    flb_free(buf);
+    flb_config_exit(config);
+}
+
+TEST_LIST = {
+    { "columnar", test_columnar },
+    { "benchmark", test_benchmark },
+    { 0 }
+};
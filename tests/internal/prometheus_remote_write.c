@@ -0,0 +1,518 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_config.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_output.h>
+#include <fluent-bit/flb_socket.h>
+#include <cmetrics/cmetrics.h>
+#include <cmetrics/cmt_gauge.h>
+#include <prometheus_remote_write/remote.pb-c.h>
+#include <snappy.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <poll.h>
+
+#include "flb_tests_internal.h"
+
+#include "../../plugins/out_prometheus_remote_write/remote_write.h"
+#include "../../plugins/out_prometheus_remote_write/remote_write_shards.h"
+
+#define RW_TEST_PORT          9391
+#define RW_TEST_MAX_REQUESTS  64
+#define RW_TEST_MAX_SERIES    64
+
+/*
+ * Remote write backend: one request per connection, the payloads are kept
+ * uncompressed and every request is answered with the status set for it.
+ */
+struct mock_server {
+    int exit;
+    int count;
+    int status[RW_TEST_MAX_REQUESTS];       /* 0 means 200                 */
+    flb_sds_t body[RW_TEST_MAX_REQUESTS];
+    flb_sockfd_t fd;
+    pthread_t tid;
+    pthread_mutex_t mutex;
+};
+
+static struct mock_server server;
+
+static flb_sds_t request_read(flb_sockfd_t fd)
+{
+    int n;
+    char buf[4096];
+    char *p;
+    size_t len;
+    size_t body_len;
+    size_t content_length = 0;
+    flb_sds_t req;
+    flb_sds_t body = NULL;
+
+    req = flb_sds_create_size(4096);
+    while (1) {
+        p = strstr(req, "\r\n\r\n");
+        if (p) {
+            body_len = flb_sds_len(req) - (p + 4 - req);
+            if (body_len >= content_length) {
+                break;
+            }
+        }
+
+        n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            flb_sds_destroy(req);
+            return NULL;
+        }
+        flb_sds_cat_safe(&req, buf, n);
+
+        p = strstr(req, "Content-Length: ");
+        if (p && content_length == 0) {
+            content_length = strtoul(p + 16, NULL, 10);
+        }
+    }
+
+    p = strstr(req, "\r\n\r\n") + 4;
+    if (snappy_uncompressed_length(p, content_length, &len)) {
+        body = flb_sds_create_size(len + 1);
+        if (snappy_uncompress(p, content_length, body) == 0) {
+            flb_sds_len_set(body, len);
+        }
+        else {
+            flb_sds_destroy(body);
+            body = NULL;
+        }
+    }
+    flb_sds_destroy(req);
+
+    return body;
+}
+
+static void *server_worker(void *data)
+{
+    int id;
+    int ret;
+    int status;
+    char resp[128];
+    flb_sockfd_t fd;
+    flb_sds_t body;
+    struct pollfd pfd;
+
+    while (!server.exit) {
+        pfd.fd = server.fd;
+        pfd.events = POLLIN;
+        ret = poll(&pfd, 1, 100);
+        if (ret <= 0) {
+            continue;
+        }
+
+        fd = accept(server.fd, NULL, NULL);
+        if (fd == -1) {
+            continue;
+        }
+
+        body = request_read(fd);
+
+        pthread_mutex_lock(&server.mutex);
+        id = server.count;
+        status = 200;
+        if (id < RW_TEST_MAX_REQUESTS) {
+            server.body[id] = body;
+            server.count++;
+            if (server.status[id] != 0) {
+                status = server.status[id];
+            }
+        }
+        else if (body) {
+            flb_sds_destroy(body);
+        }
+        pthread_mutex_unlock(&server.mutex);
+
+        snprintf(resp, sizeof(resp),
+                 "HTTP/1.1 %i Test\r\n"
+                 "Content-Length: 0\r\n"
+                 "Connection: close\r\n\r\n", status);
+        send(fd, resp, strlen(resp), 0);
+        flb_socket_close(fd);
+    }
+
+    return NULL;
+}
+
+static int server_start()
+{
+    int on = 1;
+    struct sockaddr_in addr;
+
+    memset(&server, 0, sizeof(server));
+    pthread_mutex_init(&server.mutex, NULL);
+
+    server.fd = socket(PF_INET, SOCK_STREAM, 0);
+    if (server.fd == -1) {
+        return -1;
+    }
+    setsockopt(server.fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(RW_TEST_PORT);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    if (bind(server.fd, (struct sockaddr *) &addr, sizeof(addr)) == -1 ||
+        listen(server.fd, 16) == -1) {
+        flb_socket_close(server.fd);
+        return -1;
+    }
+
+    return pthread_create(&server.tid, NULL, server_worker, NULL);
+}
+
+static void server_stop()
+{
+    int i;
+
+    server.exit = FLB_TRUE;
+    pthread_join(server.tid, NULL);
+    flb_socket_close(server.fd);
+
+    for (i = 0; i < server.count; i++) {
+        if (server.body[i]) {
+            flb_sds_destroy(server.body[i]);
+        }
+    }
+    pthread_mutex_destroy(&server.mutex);
+}
+
+/* Decode a payload into the 'id' label of its series, returns the count */
+static int payload_ids(flb_sds_t body, int *ids, int size)
+{
+    int n = 0;
+    size_t i;
+    size_t j;
+    Prometheus__WriteRequest *req;
+    Prometheus__TimeSeries *series;
+
+    if (!body) {
+        return -1;
+    }
+
+    req = prometheus__write_request__unpack(NULL, flb_sds_len(body),
+                                            (uint8_t *) body);
+    if (!req) {
+        return -1;
+    }
+
+    for (i = 0; i < req->n_timeseries && n < size; i++) {
+        series = req->timeseries[i];
+        TEST_CHECK(series->n_samples == 1);
+        for (j = 0; j < series->n_labels; j++) {
+            if (strcmp(series->labels[j]->name, "id") == 0) {
+                ids[n++] = atoi(series->labels[j]->value);
+            }
+        }
+    }
+    prometheus__write_request__free_unpacked(req, NULL);
+
+    return n;
+}
+
+/* 'count' gauge series with one sample each, labeled id=0..count-1 */
+static struct cmt *series_create(int count)
+{
+    int i;
+    char id[16];
+    uint64_t ts;
+    struct cmt *cmt;
+    struct cmt_gauge *g;
+
+    cmt = cmt_create();
+    g = cmt_gauge_create(cmt, "test", "rw", "value", "Test value.",
+                         1, (char *[]) {"id"});
+
+    ts = cfl_time_now();
+    for (i = 0; i < count; i++) {
+        snprintf(id, sizeof(id), "%i", i);
+        cmt_gauge_set(g, ts, i, 1, (char *[]) {id});
+    }
+
+    return cmt;
+}
+
+static struct flb_config *rw_create(char *min_shards, char *max_shards,
+                                    char *max_samples)
+{
+    int ret;
+    char port[16];
+    struct flb_config *config;
+    struct flb_output_instance *ins;
+
+    config = flb_config_init();
+    if (!config) {
+        return NULL;
+    }
+    config->evl = mk_event_loop_create(256);
+    flb_log_create(config, FLB_LOG_STDERR, FLB_LOG_INFO, NULL);
+
+    ins = flb_output_new(config, "prometheus_remote_write", NULL, FLB_TRUE);
+    if (!TEST_CHECK(ins != NULL)) {
+        flb_config_exit(config);
+        return NULL;
+    }
+
+    snprintf(port, sizeof(port), "%i", RW_TEST_PORT);
+    flb_output_set_property(ins, "match", "*");
+    flb_output_set_property(ins, "host", "127.0.0.1");
+    flb_output_set_property(ins, "port", port);
+    flb_output_set_property(ins, "workers", "0");
+    flb_output_set_property(ins, "net.keepalive", "off");
+    flb_output_set_property(ins, "min_shards", min_shards);
+    flb_output_set_property(ins, "max_shards", max_shards);
+    flb_output_set_property(ins, "max_samples_per_send", max_samples);
+
+    ret = flb_output_init_all(config);
+    if (!TEST_CHECK(ret == 0)) {
+        flb_output_exit(config);
+        flb_config_exit(config);
+        return NULL;
+    }
+
+    return config;
+}
+
+static struct prometheus_remote_write_context *rw_context(struct flb_config *config)
+{
+    struct flb_output_instance *ins;
+
+    ins = mk_list_entry_first(&config->outputs, struct flb_output_instance, _head);
+    return ins->context;
+}
+
+static void rw_destroy(struct flb_config *config)
+{
+    flb_output_exit(config);
+    flb_config_exit(config);
+}
+
+/* Flush 'count' series and wait for the shard senders */
+static int rw_flush(struct prometheus_remote_write_context *ctx, int count)
+{
+    int ret;
+    struct cmt *cmt;
+    struct prom_rw_flush flush;
+
+    ret = prom_rw_flush_init(ctx->shards, &flush);
+    if (!TEST_CHECK(ret == 0)) {
+        return -1;
+    }
+
+    cmt = series_create(count);
+    ret = prom_rw_flush_append(&flush, cmt);
+    TEST_CHECK(ret == 0);
+    cmt_destroy(cmt);
+
+    return prom_rw_flush_wait(&flush, FLB_FALSE);
+}
+
+/* Batches are cut at max_samples_per_send, the remainder is sent at the end */
+void test_batch_split()
+{
+    int i;
+    int n;
+    int ret;
+    int ids[RW_TEST_MAX_SERIES];
+    int seen[RW_TEST_MAX_SERIES] = {0};
+    int sizes[] = {10, 10, 5};
+    struct flb_config *config;
+
+    if (!TEST_CHECK(server_start() == 0)) {
+        return;
+    }
+
+    config = rw_create("1", "1", "10");
+    if (!config) {
+        server_stop();
+        return;
+    }
+
+    ret = rw_flush(rw_context(config), 25);
+    TEST_CHECK(ret == FLB_OK);
+
+    if (TEST_CHECK(server.count == 3)) {
+        for (i = 0; i < server.count; i++) {
+            n = payload_ids(server.body[i], ids, RW_TEST_MAX_SERIES);
+            if (!TEST_CHECK(n == sizes[i])) {
+                TEST_MSG("payload %i: %i series, expected %i", i, n, sizes[i]);
+                continue;
+            }
+            while (n-- > 0) {
+                seen[ids[n]]++;
+            }
+        }
+        for (i = 0; i < 25; i++) {
+            TEST_CHECK(seen[i] == 1);
+        }
+    }
+
+    rw_destroy(config);
+    server_stop();
+}
+
+/* A series always lands in the same shard, with the same neighbours */
+void test_series_hash()
+{
+    int i;
+    int k;
+    int n;
+    int ret;
+    int first;
+    int requests;
+    int ids[RW_TEST_MAX_SERIES];
+    int group[2][40];
+    struct flb_config *config;
+
+    if (!TEST_CHECK(server_start() == 0)) {
+        return;
+    }
+
+    config = rw_create("4", "4", "1000");
+    if (!config) {
+        server_stop();
+        return;
+    }
+
+    for (k = 0; k < 2; k++) {
+        for (i = 0; i < 40; i++) {
+            group[k][i] = -1;
+        }
+
+        first = server.count;
+        ret = rw_flush(rw_context(config), 40);
+        TEST_CHECK(ret == FLB_OK);
+
+        /* one batch per shard holding series */
+        requests = server.count - first;
+        TEST_CHECK(requests > 1 && requests <= 4);
+
+        for (i = first; i < server.count; i++) {
+            n = payload_ids(server.body[i], ids, RW_TEST_MAX_SERIES);
+            TEST_CHECK(n > 0);
+            while (n-- > 0) {
+                TEST_CHECK(group[k][ids[n]] == -1);
+                group[k][ids[n]] = i - first;
+            }
+        }
+    }
+
+    /* same partition of the series in both flushes */
+    for (i = 0; i < 40; i++) {
+        TEST_CHECK(group[0][i] != -1);
+        for (k = 0; k < 40; k++) {
+            if ((group[0][i] == group[0][k]) != (group[1][i] == group[1][k])) {
+                TEST_CHECK(FLB_FALSE);
+                TEST_MSG("series %i and %i moved between flushes", i, k);
+            }
+        }
+    }
+
+    rw_destroy(config);
+    server_stop();
+}
+
+/* A retry of any batch wins over errors: the chunk is sent again */
+void test_retry_over_error()
+{
+    int i;
+    int ret;
+    struct flb_config *config;
+    struct {
+        int status[2];
+        int result;
+    } cases[] = {
+        {{400, 500}, FLB_RETRY},
+        {{500, 400}, FLB_RETRY},
+        {{400, 200}, FLB_ERROR},
+        {{200, 400}, FLB_ERROR},
+        {{200, 200}, FLB_OK},
+    };
+
+    if (!TEST_CHECK(server_start() == 0)) {
+        return;
+    }
+
+    /* one shard keeps the order of the two batches */
+    config = rw_create("1", "1", "10");
+    if (!config) {
+        server_stop();
+        return;
+    }
+
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        pthread_mutex_lock(&server.mutex);
+        server.status[server.count] = cases[i].status[0];
+        server.status[server.count + 1] = cases[i].status[1];
+        pthread_mutex_unlock(&server.mutex);
+
+        ret = rw_flush(rw_context(config), 20);
+        if (!TEST_CHECK(ret == cases[i].result)) {
+            TEST_MSG("statuses %i, %i: ret=%i, expected %i",
+                     cases[i].status[0], cases[i].status[1],
+                     ret, cases[i].result);
+        }
+    }
+    TEST_CHECK(server.count == 10);
+
+    rw_destroy(config);
+    server_stop();
+}
+
+/* The shard count follows the samples per flush, within the tolerance */
+void test_resharding()
+{
+    int i;
+    int ret;
+    struct flb_config *config;
+    struct prom_rw_flush flush;
+    struct prometheus_remote_write_context *ctx;
+    struct {
+        double samples_in;
+        int shards;
+    } cases[] = {
+        {0,    1},      /* min_shards                         */
+        {35,   4},      /* ceil(35 / 10)                      */
+        {30,   4},      /* 3 is within 30% of 4, no reshard   */
+        {1000, 4},      /* max_shards                         */
+        {10,   1},
+        {12,   2},      /* tolerance is relative to 1 shard   */
+    };
+
+    config = rw_create("1", "4", "10");
+    if (!config) {
+        return;
+    }
+    ctx = rw_context(config);
+
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        ctx->shards->samples_in = cases[i].samples_in;
+
+        ret = prom_rw_flush_init(ctx->shards, &flush);
+        TEST_CHECK(ret == 0);
+        if (!TEST_CHECK(flush.shards == cases[i].shards)) {
+            TEST_MSG("samples_in=%.0f: %i shards, expected %i",
+                     cases[i].samples_in, flush.shards, cases[i].shards);
+        }
+        prom_rw_flush_wait(&flush, FLB_TRUE);
+    }
+
+    rw_destroy(config);
+}
+
+TEST_LIST = {
+    {"batch_split",      test_batch_split},
+    {"series_hash",      test_series_hash},
+    {"retry_over_error", test_retry_over_error},
+    {"resharding",       test_resharding},
+    {0}
+};
@@ -25,10 +25,14 @@
 #include <fluent-bit/flb_error.h>
 #include <fluent-bit/flb_router.h>
 #include <fluent-bit/flb_storage.h>
+#include <fluent-bit/flb_input_chunk.h>
+#include <fluent-bit/flb_log_event_decoder.h>
 #include <fluent-bit/stream_processor/flb_sp.h>
 #include <fluent-bit/stream_processor/flb_sp_parser.h>
+#include <fluent-bit/stream_processor/flb_sp_program.h>
 #include <fluent-bit/stream_processor/flb_sp_stream.h>
 #include <fluent-bit/stream_processor/flb_sp_window.h>
+#include <fluent-bit/stream_processor/flb_sp_worker.h>
 #include <msgpack.h>
 
 #include "flb_tests_internal.h"
@@ -923,6 +927,450 @@ static void test_conv_from_str_to_num()
     flb_config_exit(config);
 }
 
+/*
+ * With workers a GROUP BY task is split in partitions, every group must be
+ * aggregated by exactly one of them.
+ */
+static void test_partitions()
+{
+    int i;
+    int ret;
+    int groups = 0;
+    int records = 0;
+    struct mk_list *head;
+    struct flb_config *config;
+    struct flb_sp *sp;
+    struct flb_sp_task *task;
+    struct flb_sp_task *part;
+    struct aggregate_node *aggr_node;
+    msgpack_sbuffer sbuf;
+    msgpack_packer pck;
+
+    flb_init_env();
+
+    config = flb_calloc(1, sizeof(struct flb_config));
+    if (!config) {
+        flb_errno();
+        return;
+    }
+    mk_list_init(&config->inputs);
+    mk_list_init(&config->stream_processor_tasks);
+    config->stream_processor_workers = 4;
+    config->evl = mk_event_loop_create(256);
+
+    sp = flb_sp_create(config);
+    if (!TEST_CHECK(sp != NULL)) {
+        TEST_MSG("[sp test] cannot create stream processor context");
+        mk_event_loop_destroy(config->evl);
+        flb_free(config);
+        return;
+    }
+    TEST_CHECK(sp->workers_size == 4);
+
+    task = flb_sp_task_create(sp, "partitions",
+                              "SELECT id, COUNT(*) FROM STREAM:FLB "
+                              "WINDOW TUMBLING (1 SECOND) GROUP BY id;");
+    if (!TEST_CHECK(task != NULL)) {
+        goto exit;
+    }
+    TEST_CHECK(task->partitions_size == 4);
+
+    /* 10 groups of 10 records */
+    msgpack_sbuffer_init(&sbuf);
+    msgpack_packer_init(&pck, &sbuf, msgpack_sbuffer_write);
+    for (i = 0; i < 100; i++) {
+        msgpack_pack_array(&pck, 2);
+        flb_pack_time_now(&pck);
+        msgpack_pack_map(&pck, 1);
+        msgpack_pack_str(&pck, 2);
+        msgpack_pack_str_body(&pck, "id", 2);
+        msgpack_pack_int64(&pck, i % 10);
+    }
+
+    /* run the partitions in this thread, workers are not involved */
+    for (i = 0; i < task->partitions_size; i++) {
+        part = task->partitions[i];
+        ret = sp_process_data_aggr(sbuf.data, sbuf.size, "FLB", 3,
+                                   part, sp, FLB_TRUE);
+        TEST_CHECK(ret != -1);
+
+        records += part->window.records;
+        mk_list_foreach(head, &part->window.aggregate_list) {
+            aggr_node = mk_list_entry(head, struct aggregate_node, _head);
+            TEST_CHECK(aggr_node->records == 10);
+            groups++;
+        }
+        flb_sp_window_prune(part);
+    }
+    msgpack_sbuffer_destroy(&sbuf);
+
+    TEST_CHECK(records == 100);
+    TEST_MSG("records: %i", records);
+    TEST_CHECK(groups == 10);
+    TEST_MSG("groups: %i", groups);
+
+ exit:
+    flb_sp_destroy(sp);
+    mk_event_loop_destroy(config->evl);
+    flb_free(config);
+}
+
+/* Look up 'name' in the map of the record number 'n' of a buffer */
+static int record_key_type(struct sp_buffer *buf, int n, char *name)
+{
+    int i;
+    int type = -1;
+    size_t off = 0;
+    msgpack_object map;
+    msgpack_object key;
+    msgpack_unpacked result;
+
+    msgpack_unpacked_init(&result);
+    while (msgpack_unpack_next(&result, buf->buffer, buf->size, &off) == MP_UOK) {
+        if (n-- > 0) {
+            continue;
+        }
+
+        map = result.data.via.array.ptr[1];
+        for (i = 0; i < map.via.map.size; i++) {
+            key = map.via.map.ptr[i].key;
+            if (key.via.str.size == strlen(name) &&
+                strncmp(key.via.str.ptr, name, key.via.str.size) == 0) {
+                type = map.via.map.ptr[i].val.type;
+                break;
+            }
+        }
+        break;
+    }
+    msgpack_unpacked_destroy(&result);
+
+    return type;
+}
+
+static int records_count(struct sp_buffer *buf)
+{
+    int count = 0;
+    size_t off = 0;
+    msgpack_unpacked result;
+
+    if (!buf->buffer) {
+        return 0;
+    }
+
+    msgpack_unpacked_init(&result);
+    while (msgpack_unpack_next(&result, buf->buffer, buf->size, &off) == MP_UOK) {
+        count++;
+    }
+    msgpack_unpacked_destroy(&result);
+
+    return count;
+}
+
+/*
+ * Arrays, binaries and extensions are selected as they are, with a compiled
+ * condition and with the interpreted one.
+ */
+static void test_select_non_scalar()
+{
+    int i;
+    int ret;
+    char query[1024];
+    struct sp_buffer data_buf;
+    struct sp_buffer out_buf;
+    struct flb_config *config;
+    struct flb_sp *sp;
+    struct flb_sp_task *task;
+    msgpack_sbuffer sbuf;
+    msgpack_packer pck;
+
+    flb_init_env();
+
+    config = flb_calloc(1, sizeof(struct flb_config));
+    if (!config) {
+        flb_errno();
+        return;
+    }
+    mk_list_init(&config->inputs);
+    mk_list_init(&config->stream_processor_tasks);
+    config->evl = mk_event_loop_create(256);
+
+    sp = flb_sp_create(config);
+    if (!TEST_CHECK(sp != NULL)) {
+        TEST_MSG("[sp test] cannot create stream processor context");
+        mk_event_loop_destroy(config->evl);
+        flb_free(config);
+        return;
+    }
+
+    /* {"id": N, "tags": ["a", "b"], "raw": <bin>, "ext": <ext>} */
+    msgpack_sbuffer_init(&sbuf);
+    msgpack_packer_init(&pck, &sbuf, msgpack_sbuffer_write);
+    for (i = 1; i <= 2; i++) {
+        msgpack_pack_array(&pck, 2);
+        flb_pack_time_now(&pck);
+        msgpack_pack_map(&pck, 4);
+        msgpack_pack_str(&pck, 2);
+        msgpack_pack_str_body(&pck, "id", 2);
+        msgpack_pack_int64(&pck, i);
+        msgpack_pack_str(&pck, 4);
+        msgpack_pack_str_body(&pck, "tags", 4);
+        msgpack_pack_array(&pck, 2);
+        msgpack_pack_str(&pck, 1);
+        msgpack_pack_str_body(&pck, "a", 1);
+        msgpack_pack_str(&pck, 1);
+        msgpack_pack_str_body(&pck, "b", 1);
+        msgpack_pack_str(&pck, 3);
+        msgpack_pack_str_body(&pck, "raw", 3);
+        msgpack_pack_bin(&pck, 3);
+        msgpack_pack_bin_body(&pck, "xyz", 3);
+        msgpack_pack_str(&pck, 3);
+        msgpack_pack_str_body(&pck, "ext", 3);
+        msgpack_pack_ext(&pck, 2, 1);
+        msgpack_pack_ext_body(&pck, "ab", 2);
+    }
+    data_buf.buffer = sbuf.data;
+    data_buf.size = sbuf.size;
+
+    /* no condition */
+    task = flb_sp_task_create(sp, "non_scalar",
+                              "SELECT id, tags, raw, ext FROM STREAM:samples;");
+    if (TEST_CHECK(task != NULL)) {
+        out_buf.buffer = NULL;
+        out_buf.size = 0;
+        ret = flb_sp_do_test(sp, task, "samples", 7, &data_buf, &out_buf);
+        TEST_CHECK(ret == 0);
+        TEST_CHECK(records_count(&out_buf) == 2);
+        TEST_CHECK(record_key_type(&out_buf, 0, "id") ==
+                   MSGPACK_OBJECT_POSITIVE_INTEGER);
+        TEST_CHECK(record_key_type(&out_buf, 0, "tags") == MSGPACK_OBJECT_ARRAY);
+        TEST_CHECK(record_key_type(&out_buf, 0, "raw") == MSGPACK_OBJECT_BIN);
+        TEST_CHECK(record_key_type(&out_buf, 0, "ext") == MSGPACK_OBJECT_EXT);
+        TEST_CHECK(record_key_type(&out_buf, 1, "tags") == MSGPACK_OBJECT_ARRAY);
+        flb_free(out_buf.buffer);
+        flb_sp_task_destroy(task);
+    }
+
+    /* compiled condition */
+    task = flb_sp_task_create(sp, "non_scalar_compiled",
+                              "SELECT tags AS t FROM STREAM:samples "
+                              "WHERE id = 1;");
+    if (TEST_CHECK(task != NULL)) {
+        TEST_CHECK(task->condition != NULL);
+        out_buf.buffer = NULL;
+        out_buf.size = 0;
+        ret = flb_sp_do_test(sp, task, "samples", 7, &data_buf, &out_buf);
+        TEST_CHECK(ret == 0);
+        TEST_CHECK(records_count(&out_buf) == 1);
+        TEST_CHECK(record_key_type(&out_buf, 0, "t") == MSGPACK_OBJECT_ARRAY);
+        flb_free(out_buf.buffer);
+        flb_sp_task_destroy(task);
+    }
+
+    /*
+     * interpreted condition: it references more keys than a compiled
+     * program can hold
+     */
+    ret = snprintf(query, sizeof(query),
+                   "SELECT tags, raw FROM STREAM:samples WHERE id = 1");
+    for (i = 0; i < FLB_SP_PROGRAM_SLOTS_MAX; i++) {
+        ret += snprintf(query + ret, sizeof(query) - ret, " OR k%i = 1", i);
+    }
+    snprintf(query + ret, sizeof(query) - ret, ";");
+
+    task = flb_sp_task_create(sp, "non_scalar_interpreted", query);
+    if (TEST_CHECK(task != NULL)) {
+        TEST_CHECK(task->condition == NULL);
+        out_buf.buffer = NULL;
+        out_buf.size = 0;
+        ret = flb_sp_do_test(sp, task, "samples", 7, &data_buf, &out_buf);
+        TEST_CHECK(ret == 0);
+        TEST_CHECK(records_count(&out_buf) == 1);
+        TEST_CHECK(record_key_type(&out_buf, 0, "tags") == MSGPACK_OBJECT_ARRAY);
+        TEST_CHECK(record_key_type(&out_buf, 0, "raw") == MSGPACK_OBJECT_BIN);
+        flb_free(out_buf.buffer);
+        flb_sp_task_destroy(task);
+    }
+
+    msgpack_sbuffer_destroy(&sbuf);
+    flb_sp_destroy(sp);
+    mk_event_loop_destroy(config->evl);
+    flb_free(config);
+}
+
+static int64_t map_get_int(msgpack_object *map, char *name)
+{
+    int i;
+    msgpack_object *key;
+    msgpack_object *val;
+
+    for (i = 0; i < map->via.map.size; i++) {
+        key = &map->via.map.ptr[i].key;
+        val = &map->via.map.ptr[i].val;
+        if (key->via.str.size != strlen(name) ||
+            strncmp(key->via.str.ptr, name, key->via.str.size) != 0) {
+            continue;
+        }
+
+        if (val->type == MSGPACK_OBJECT_POSITIVE_INTEGER ||
+            val->type == MSGPACK_OBJECT_NEGATIVE_INTEGER) {
+            return val->via.i64;
+        }
+        else if (val->type == MSGPACK_OBJECT_FLOAT32 ||
+                 val->type == MSGPACK_OBJECT_FLOAT) {
+            return (int64_t) val->via.f64;
+        }
+    }
+
+    return -1;
+}
+
+/*
+ * With sp.workers the partitions of a GROUP BY task run in the workers:
+ * every window must report all the groups with their aggregated values,
+ * and the windows must reach the stream in the order they were closed.
+ */
+#define WORKERS_WINDOWS  3
+#define WORKERS_GROUPS   10
+
+static void test_workers()
+{
+    int i;
+    int w;
+    int ret;
+    int records = 0;
+    int seen[WORKERS_WINDOWS] = {0};
+    char *buf;
+    size_t size;
+    int64_t id;
+    struct mk_list *head;
+    struct flb_config *config;
+    struct flb_sp *sp = NULL;
+    struct flb_sp_task *task;
+    struct flb_input_instance *in;
+    struct flb_output_instance *out;
+    struct flb_input_collector *coll;
+    struct flb_input_chunk *ic;
+    struct flb_log_event event;
+    struct flb_log_event_decoder decoder;
+    msgpack_sbuffer sbuf;
+    msgpack_packer pck;
+
+    flb_init_env();
+
+    config = flb_config_init();
+    config->evl = mk_event_loop_create(256);
+    config->stream_processor_workers = 4;
+
+    ret = flb_storage_create(config);
+    if (!TEST_CHECK(ret == 0)) {
+        TEST_MSG("flb_storage_create failed");
+        flb_config_exit(config);
+        return;
+    }
+
+    /* the results need a route to be kept in the stream chunks */
+    out = flb_output_new(config, "null", NULL, FLB_TRUE);
+    TEST_CHECK(out != NULL);
+    flb_output_set_property(out, "match", "results");
+
+    sp = flb_sp_create(config);
+    if (!TEST_CHECK(sp != NULL)) {
+        TEST_MSG("[sp test] cannot create stream processor context");
+        goto exit;
+    }
+    TEST_CHECK(sp->workers_size == 4);
+
+    task = flb_sp_task_create(sp, "workers",
+                              "CREATE STREAM results WITH (tag='results') AS "
+                              "SELECT id, COUNT(*) AS cnt, SUM(v) AS total "
+                              "FROM TAG:'data' WINDOW TUMBLING (1 SECOND) "
+                              "GROUP BY id;");
+    if (!TEST_CHECK(task != NULL && task->stream != NULL)) {
+        goto exit;
+    }
+    TEST_CHECK(task->partitions_size == 4);
+    in = ((struct flb_sp_stream *) task->stream)->in;
+
+    /* in window 'w' every group gets 10 records with v = w + 1 */
+    for (w = 0; w < WORKERS_WINDOWS; w++) {
+        msgpack_sbuffer_init(&sbuf);
+        msgpack_packer_init(&pck, &sbuf, msgpack_sbuffer_write);
+        for (i = 0; i < WORKERS_GROUPS * 10; i++) {
+            msgpack_pack_array(&pck, 2);
+            flb_pack_time_now(&pck);
+            msgpack_pack_map(&pck, 2);
+            msgpack_pack_str(&pck, 2);
+            msgpack_pack_str_body(&pck, "id", 2);
+            msgpack_pack_int64(&pck, i % WORKERS_GROUPS);
+            msgpack_pack_str(&pck, 1);
+            msgpack_pack_str_body(&pck, "v", 1);
+            msgpack_pack_int64(&pck, w + 1);
+        }
+
+        flb_sp_do(sp, in, "data", 4, sbuf.data, sbuf.size);
+        msgpack_sbuffer_destroy(&sbuf);
+
+        /* close the window as its timer would */
+        ret = flb_sp_worker_push_event(sp, task, FLB_SP_JOB_WINDOW,
+                                       "data", 4);
+        TEST_CHECK(ret == 0);
+    }
+
+    /* pending jobs are completed before the workers leave */
+    flb_sp_workers_destroy(sp);
+
+    /* ingest the results queued on the stream */
+    coll = mk_list_entry_first(&in->collectors,
+                               struct flb_input_collector, _head);
+    coll->cb_collect(in, config, in->context);
+
+    mk_list_foreach(head, &in->chunks) {
+        ic = mk_list_entry(head, struct flb_input_chunk, _head);
+        ret = cio_chunk_get_content(ic->chunk, &buf, &size);
+        if (!TEST_CHECK(ret == 0)) {
+            continue;
+        }
+
+        flb_log_event_decoder_init(&decoder, buf, size);
+        while (flb_log_event_decoder_next(&decoder, &event) ==
+               FLB_EVENT_DECODER_SUCCESS) {
+            /* windows are emitted in order, one result per group */
+            w = records / WORKERS_GROUPS;
+            records++;
+            if (!TEST_CHECK(w < WORKERS_WINDOWS)) {
+                break;
+            }
+
+            id = map_get_int(event.body, "id");
+            if (!TEST_CHECK(id >= 0 && id < WORKERS_GROUPS)) {
+                continue;
+            }
+            TEST_CHECK((seen[w] & (1 << id)) == 0);
+            seen[w] |= 1 << id;
+
+            TEST_CHECK(map_get_int(event.body, "cnt") == 10);
+            if (!TEST_CHECK(map_get_int(event.body, "total") == 10 * (w + 1))) {
+                TEST_MSG("window %i, group %" PRId64 ": total=%" PRId64,
+                         w, id, map_get_int(event.body, "total"));
+            }
+        }
+        flb_log_event_decoder_destroy(&decoder);
+    }
+
+    TEST_CHECK(records == WORKERS_WINDOWS * WORKERS_GROUPS);
+    TEST_MSG("records: %i", records);
+    for (w = 0; w < WORKERS_WINDOWS; w++) {
+        TEST_CHECK(seen[w] == (1 << WORKERS_GROUPS) - 1);
+    }
+
+ exit:
+    if (sp) {
+        flb_sp_destroy(sp);
+    }
+    flb_storage_destroy(config);
+    flb_config_exit(config);
+}
+
 TEST_LIST = {
     { "invalid_queries", invalid_queries},
     { "select_keys",     test_select_keys},
@@ -930,5 +1378,8 @@ TEST_LIST = {
     { "window",          test_window},
     { "snapshot",        test_snapshot},
     { "conv_from_str_to_num", test_conv_from_str_to_num},
+    { "partitions",      test_partitions},
+    { "select_non_scalar", test_select_non_scalar},
+    { "workers",         test_workers},
     { NULL }
 };
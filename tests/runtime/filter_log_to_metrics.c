@@ -60,6 +60,7 @@ void flb_test_log_to_metrics_counter(void);
 void flb_test_log_to_metrics_counter_k8s_two_tuples(void);
 void flb_test_log_to_metrics_gauge(void);
 void flb_test_log_to_metrics_histogram(void);
+void flb_test_log_to_metrics_histogram_buckets(void);
 void flb_test_log_to_metrics_reg(void);
 void flb_test_log_to_metrics_empty_label_keys_regex(void);
 void flb_test_log_to_metrics_label(void);
@@ -121,6 +122,7 @@ TEST_LIST = {
     {"counter_k8s_two_tuples", flb_test_log_to_metrics_counter_k8s_two_tuples },
     {"gauge",                  flb_test_log_to_metrics_gauge                  },
     {"histogram",              flb_test_log_to_metrics_histogram              },
+    {"histogram_buckets",      flb_test_log_to_metrics_histogram_buckets      },
     {"counter_regex",          flb_test_log_to_metrics_reg                    },
     {"regex_empty_label_keys", flb_test_log_to_metrics_empty_label_keys_regex },
     {"label",                  flb_test_log_to_metrics_label                  },
@@ -525,6 +527,78 @@ void flb_test_log_to_metrics_histogram(void)
 
 }
 
+void flb_test_log_to_metrics_histogram_buckets(void)
+{
+    int ret;
+    int i;
+    flb_ctx_t *ctx;
+    int in_ffd;
+    int filter_ffd;
+    int out_ffd;
+    char *result = NULL;
+    struct flb_lib_out_cb cb_data;
+    char input[256];
+    char finalString[32768] = "";
+    /* one value below, two on a bound, the others in the last buckets */
+    char *durations[] = {"0.5", "1", "\"3\"", "5", "7", "20"};
+    const char *expected = "\"histogram\":{\"buckets\":" \
+                           "[2,4,5,6],\"" \
+                           "sum\":36.5,\"count\":6},\"" \
+                           "labels\":[\"red\"]";
+    ctx = flb_create();
+    flb_service_set(ctx, "Flush", "0.200000000", "Grace", "1", "Log_Level",
+                    "error", NULL);
+
+    cb_data.cb = callback_test;
+    cb_data.data = NULL;
+
+    in_ffd = flb_input(ctx, (char *) "lib", NULL);
+    TEST_CHECK(in_ffd >= 0);
+    flb_input_set(ctx, in_ffd, "tag", "test", NULL);
+
+    filter_ffd = flb_filter(ctx, (char *) "log_to_metrics", NULL);
+    TEST_CHECK(filter_ffd >= 0);
+    ret = flb_filter_set(ctx, filter_ffd,
+                         "Match", "*",
+                         "Tag", "test_metric",
+                         "metric_mode", "histogram",
+                         "metric_name", "test",
+                         "metric_description", "Histogram of duration",
+                         "metric_subsystem", "",
+                         "kubernetes_mode", "off",
+                         "value_field", "duration",
+                         "label_field", "color",
+                         "bucket", "10",
+                         "bucket", "1",
+                         "bucket", "5",
+                         NULL);
+
+    out_ffd = flb_output(ctx, (char *) "lib", (void *)&cb_data);
+    TEST_CHECK(out_ffd >= 0);
+    flb_output_set(ctx, out_ffd,
+                   "match", "*",
+                   "format", "json",
+                   NULL);
+
+    ret = flb_start(ctx);
+    TEST_CHECK(ret == 0);
+
+    for (i = 0; i < sizeof(durations) / sizeof(char *); i++) {
+        snprintf(input, sizeof(input) - 1,
+                 "[1448403340, {\"color\": \"red\", \"duration\": %s}]",
+                 durations[i]);
+        flb_lib_push(ctx, in_ffd, input, strlen(input));
+    }
+
+    wait_with_timeout(2000, finalString);
+    result = strstr(finalString, expected);
+    if (!TEST_CHECK(result != NULL)) {
+        TEST_MSG("expected substring:\n%s\ngot:\n%s\n", expected, finalString);
+    }
+    filter_test_destroy(ctx);
+
+}
+
 void flb_test_log_to_metrics_reg(void)
 {
     int ret;
@@ -968,6 +968,358 @@ void flb_test_invalid_metatable(void)
     flb_destroy(ctx);
 }
 
+void flb_test_batch_mode(void)
+{
+    int i;
+    int ret;
+    flb_ctx_t *ctx;
+    int in_ffd;
+    int out_ffd;
+    int filter_ffd;
+    struct flb_lib_out_cb cb_data;
+    char *output = NULL;
+    flb_sds_t outbuf = flb_sds_create("");
+    char *input[] = {
+        "[1, {\"k\":\"drop\"}]",
+        "[2, {\"k\":\"keep\"}]",
+        "[3, {\"k\":\"mod\"}]",
+        NULL
+    };
+    const char *expected =
+        "[2.000000,{\"k\":\"keep\"}]"
+        "[5.000000,{\"k\":\"modified\"}]";
+    char *script_body = ""
+      "function lua_main(tag, timestamps, records)\n"
+      "    local codes = {}\n"
+      "    for i = 1, #records do\n"
+      "        local k = records[i].k\n"
+      "        if k == 'drop' then\n"
+      "            codes[i] = -1\n"
+      "        elseif k == 'mod' then\n"
+      "            records[i].k = 'modified'\n"
+      "            timestamps[i] = 5\n"
+      "            codes[i] = 1\n"
+      "        else\n"
+      "            codes[i] = 0\n"
+      "        end\n"
+      "    end\n"
+      "    return codes, timestamps, records\n"
+      "end\n";
+
+    clear_output();
+
+    /* Create context, flush every second (some checks omitted here) */
+    ctx = flb_create();
+    flb_service_set(ctx, "flush", FLUSH_INTERVAL, "grace", "1", NULL);
+
+    /* Prepare output callback context*/
+    cb_data.cb = callback_cat;
+    cb_data.data = &outbuf;
+
+    ret = create_script(script_body, strlen(script_body));
+    TEST_CHECK(ret == 0);
+    /* Filter */
+    filter_ffd = flb_filter(ctx, (char *) "lua", NULL);
+    TEST_CHECK(filter_ffd >= 0);
+    ret = flb_filter_set(ctx, filter_ffd,
+                         "Match", "*",
+                         "call", "lua_main",
+                         "script", TMP_LUA_PATH,
+                         "batch_mode", "true",
+                         NULL);
+
+    /* Input */
+    in_ffd = flb_input(ctx, (char *) "lib", NULL);
+    flb_input_set(ctx, in_ffd, "tag", "test", NULL);
+    TEST_CHECK(in_ffd >= 0);
+
+    /* Lib output */
+    out_ffd = flb_output(ctx, (char *) "lib", (void *)&cb_data);
+    TEST_CHECK(out_ffd >= 0);
+    flb_output_set(ctx, out_ffd,
+                   "match", "test",
+                   "format", "json",
+                   NULL);
+
+    ret = flb_start(ctx);
+    TEST_CHECK(ret==0);
+
+    for (i = 0; input[i]; i++) {
+        flb_lib_push(ctx, in_ffd, input[i], strlen(input[i]));
+    }
+    wait_with_timeout(2000, &output);
+    if (!TEST_CHECK(!strcmp(outbuf, expected))) {
+        TEST_MSG("expected:\n%s\ngot:\n%s\n", expected, outbuf);
+    }
+
+    /* clean up */
+    flb_lib_free(output);
+    delete_script();
+
+    flb_stop(ctx);
+    flb_destroy(ctx);
+    flb_sds_destroy(outbuf);
+}
+
+void flb_test_lazy_records(void)
+{
+    int i;
+    int ret;
+    flb_ctx_t *ctx;
+    int in_ffd;
+    int out_ffd;
+    int filter_ffd;
+    struct flb_lib_out_cb cb_data;
+    char *output = NULL;
+    flb_sds_t outbuf = flb_sds_create("");
+    char *input[] = {
+        "[0, {\"a\":\"x\",\"b\":\"y\",\"c\":{\"d\":1},\"f\":3}]",
+        NULL
+    };
+    const char *expected =
+        "[5.000000,{\"a\":\"x\",\"c\":{\"d\":2},\"f\":3,\"e\":\"x!\"}]";
+    char *script_body = ""
+      "function lua_main(tag, timestamp, record)\n"
+      "    record.b = nil\n"
+      "    record.c.d = 2\n"
+      "    record.e = record.a .. '!'\n"
+      "    return 1, 5, record\n"
+      "end\n";
+
+    clear_output();
+
+    /* Create context, flush every second (some checks omitted here) */
+    ctx = flb_create();
+    flb_service_set(ctx, "flush", FLUSH_INTERVAL, "grace", "1", NULL);
+
+    /* Prepare output callback context*/
+    cb_data.cb = callback_cat;
+    cb_data.data = &outbuf;
+
+    ret = create_script(script_body, strlen(script_body));
+    TEST_CHECK(ret == 0);
+    /* Filter */
+    filter_ffd = flb_filter(ctx, (char *) "lua", NULL);
+    TEST_CHECK(filter_ffd >= 0);
+    ret = flb_filter_set(ctx, filter_ffd,
+                         "Match", "*",
+                         "call", "lua_main",
+                         "script", TMP_LUA_PATH,
+                         "lazy_records", "true",
+                         NULL);
+
+    /* Input */
+    in_ffd = flb_input(ctx, (char *) "lib", NULL);
+    flb_input_set(ctx, in_ffd, "tag", "test", NULL);
+    TEST_CHECK(in_ffd >= 0);
+
+    /* Lib output */
+    out_ffd = flb_output(ctx, (char *) "lib", (void *)&cb_data);
+    TEST_CHECK(out_ffd >= 0);
+    flb_output_set(ctx, out_ffd,
+                   "match", "test",
+                   "format", "json",
+                   NULL);
+
+    ret = flb_start(ctx);
+    TEST_CHECK(ret==0);
+
+    for (i = 0; input[i]; i++) {
+        flb_lib_push(ctx, in_ffd, input[i], strlen(input[i]));
+    }
+    wait_with_timeout(2000, &output);
+    if (!TEST_CHECK(!strcmp(outbuf, expected))) {
+        TEST_MSG("expected:\n%s\ngot:\n%s\n", expected, outbuf);
+    }
+
+    /* clean up */
+    flb_lib_free(output);
+    delete_script();
+
+    flb_stop(ctx);
+    flb_destroy(ctx);
+    flb_sds_destroy(outbuf);
+}
+
+void flb_test_batch_mode_lazy_records(void)
+{
+    int i;
+    int ret;
+    flb_ctx_t *ctx;
+    int in_ffd;
+    int out_ffd;
+    int filter_ffd;
+    struct flb_lib_out_cb cb_data;
+    char *output = NULL;
+    flb_sds_t outbuf = flb_sds_create("");
+    char *input[] = {
+        "[1, {\"k\":\"a\",\"v\":1}]",
+        "[2, {\"k\":\"b\",\"v\":2}]",
+        NULL
+    };
+    const char *expected =
+        "[1.000000,{\"k\":\"a\",\"v\":1,\"tag\":\"test\"}]"
+        "[2.000000,{\"k\":\"b\",\"v\":2,\"tag\":\"test\"}]";
+    char *script_body = ""
+      "function lua_main(tag, timestamps, records)\n"
+      "    for i = 1, #records do\n"
+      "        records[i].tag = tag\n"
+      "    end\n"
+      "    return 2, timestamps, records\n"
+      "end\n";
+
+    clear_output();
+
+    /* Create context, flush every second (some checks omitted here) */
+    ctx = flb_create();
+    flb_service_set(ctx, "flush", FLUSH_INTERVAL, "grace", "1", NULL);
+
+    /* Prepare output callback context*/
+    cb_data.cb = callback_cat;
+    cb_data.data = &outbuf;
+
+    ret = create_script(script_body, strlen(script_body));
+    TEST_CHECK(ret == 0);
+    /* Filter */
+    filter_ffd = flb_filter(ctx, (char *) "lua", NULL);
+    TEST_CHECK(filter_ffd >= 0);
+    ret = flb_filter_set(ctx, filter_ffd,
+                         "Match", "*",
+                         "call", "lua_main",
+                         "script", TMP_LUA_PATH,
+                         "batch_mode", "true",
+                         "lazy_records", "true",
+                         NULL);
+
+    /* Input */
+    in_ffd = flb_input(ctx, (char *) "lib", NULL);
+    flb_input_set(ctx, in_ffd, "tag", "test", NULL);
+    TEST_CHECK(in_ffd >= 0);
+
+    /* Lib output */
+    out_ffd = flb_output(ctx, (char *) "lib", (void *)&cb_data);
+    TEST_CHECK(out_ffd >= 0);
+    flb_output_set(ctx, out_ffd,
+                   "match", "test",
+                   "format", "json",
+                   NULL);
+
+    ret = flb_start(ctx);
+    TEST_CHECK(ret==0);
+
+    for (i = 0; input[i]; i++) {
+        flb_lib_push(ctx, in_ffd, input[i], strlen(input[i]));
+    }
+    wait_with_timeout(2000, &output);
+    if (!TEST_CHECK(!strcmp(outbuf, expected))) {
+        TEST_MSG("expected:\n%s\ngot:\n%s\n", expected, outbuf);
+    }
+
+    /* clean up */
+    flb_lib_free(output);
+    delete_script();
+
+    flb_stop(ctx);
+    flb_destroy(ctx);
+    flb_sds_destroy(outbuf);
+}
+
+void flb_test_workers(void)
+{
+    int i;
+    int ret;
+    int records = 1000;
+    flb_ctx_t *ctx;
+    int in_ffd;
+    int out_ffd;
+    int filter_ffd;
+    struct flb_lib_out_cb cb_data;
+    char *output = NULL;
+    char tmp[128];
+    flb_sds_t input = flb_sds_create("");
+    flb_sds_t expected = flb_sds_create("");
+    flb_sds_t outbuf = flb_sds_create("");
+    char *script_body = ""
+      "function lua_main(tag, timestamp, record)\n"
+      "    local n = record.n\n"
+      "    for i = 1, 100 do n = (n * 31 + i) % 1000003 end\n"
+      "    record.h = n\n"
+      "    return 2, timestamp, record\n"
+      "end\n";
+    long n;
+
+    clear_output();
+
+    /*
+     * records are split between the Lua states, order must be kept. Lazy
+     * records keep the order of the fields.
+     */
+    for (i = 0; i < records; i++) {
+        snprintf(tmp, sizeof(tmp) - 1,
+                 "[%i, {\"n\": %i, \"pad\": \"xxxxxxxxxxxxxxxxxxxxxxxx\"}]",
+                 i, i);
+        flb_sds_cat_safe(&input, tmp, strlen(tmp));
+
+        n = i;
+        for (ret = 1; ret <= 100; ret++) {
+            n = (n * 31 + ret) % 1000003;
+        }
+        snprintf(tmp, sizeof(tmp) - 1,
+                 "[%i.000000,{\"n\":%i,\"pad\":\"xxxxxxxxxxxxxxxxxxxxxxxx\","
+                 "\"h\":%ld}]", i, i, n);
+        flb_sds_cat_safe(&expected, tmp, strlen(tmp));
+    }
+
+    ctx = flb_create();
+    flb_service_set(ctx, "flush", FLUSH_INTERVAL, "grace", "1", NULL);
+
+    cb_data.cb = callback_cat;
+    cb_data.data = &outbuf;
+
+    ret = create_script(script_body, strlen(script_body));
+    TEST_CHECK(ret == 0);
+    filter_ffd = flb_filter(ctx, (char *) "lua", NULL);
+    TEST_CHECK(filter_ffd >= 0);
+    ret = flb_filter_set(ctx, filter_ffd,
+                         "Match", "*",
+                         "call", "lua_main",
+                         "script", TMP_LUA_PATH,
+                         "workers", "4",
+                         "lazy_records", "true",
+                         NULL);
+
+    in_ffd = flb_input(ctx, (char *) "lib", NULL);
+    flb_input_set(ctx, in_ffd, "tag", "test", NULL);
+    TEST_CHECK(in_ffd >= 0);
+
+    out_ffd = flb_output(ctx, (char *) "lib", (void *)&cb_data);
+    TEST_CHECK(out_ffd >= 0);
+    flb_output_set(ctx, out_ffd,
+                   "match", "test",
+                   "format", "json",
+                   NULL);
+
+    ret = flb_start(ctx);
+    TEST_CHECK(ret==0);
+
+    flb_lib_push(ctx, in_ffd, input, flb_sds_len(input));
+    wait_with_timeout(3000, &output);
+    if (!TEST_CHECK(!strcmp(outbuf, expected))) {
+        TEST_MSG("expected %zu bytes, got %zu bytes",
+                 flb_sds_len(expected), flb_sds_len(outbuf));
+    }
+
+    /* clean up */
+    flb_lib_free(output);
+    delete_script();
+
+    flb_stop(ctx);
+    flb_destroy(ctx);
+    flb_sds_destroy(input);
+    flb_sds_destroy(expected);
+    flb_sds_destroy(outbuf);
+}
+
 TEST_LIST = {
     {"hello_world",  flb_test_helloworld},
     {"append_tag",   flb_test_append_tag},
@@ -980,5 +1332,9 @@ TEST_LIST = {
     {"split_record", flb_test_split_record},
     {"empty_array", flb_test_empty_array},
     {"invalid_metatable", flb_test_invalid_metatable},
+    {"batch_mode", flb_test_batch_mode},
+    {"lazy_records", flb_test_lazy_records},
+    {"batch_mode_lazy_records", flb_test_batch_mode_lazy_records},
+    {"workers", flb_test_workers},
     {NULL, NULL}
 };
@@ -19,6 +19,7 @@
 
 #include <fluent-bit.h>
 #include <fluent-bit/flb_time.h>
+#include <fluent-bit/flb_sds.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -519,6 +520,102 @@ void flb_test_append_kv_on_msgpack(void)
     flb_destroy(ctx);
 }
 
+/* records of a chunk are split between the instances, order must be kept */
+static int workers_next = 0;
+static int workers_errors = 0;
+
+static int callback_workers(void *record, size_t size, void *data)
+{
+    int seq;
+    char *p;
+
+    pthread_mutex_lock(&result_mutex);
+    p = strstr(record, "\"seq\":");
+    seq = p ? atoi(p + 6) : -1;
+    if (seq != workers_next || strstr(record, "\"tag\":\"test.wasm\"") == NULL) {
+        workers_errors++;
+    }
+    workers_next = seq + 1;
+    num_output++;
+    pthread_mutex_unlock(&result_mutex);
+
+    flb_free(record);
+    return 0;
+}
+
+void flb_test_workers(void)
+{
+    int i;
+    int ret;
+    int records = 1000;
+    flb_ctx_t *ctx;
+    int in_ffd;
+    int out_ffd;
+    int filter_ffd;
+    char tmp[128];
+    flb_sds_t input = flb_sds_create("");
+    struct flb_lib_out_cb cb_data;
+
+    clear_output_num();
+    workers_next = 0;
+    workers_errors = 0;
+
+    for (i = 0; i < records; i++) {
+        snprintf(tmp, sizeof(tmp) - 1,
+                 "[%i, {\"seq\": %i, \"pad\": \"xxxxxxxxxxxxxxxxxxxxxxxx\"}]",
+                 i, i);
+        flb_sds_cat_safe(&input, tmp, strlen(tmp));
+    }
+
+    ctx = flb_create();
+    flb_service_set(ctx, "flush", FLUSH_INTERVAL, "grace", "1", NULL);
+
+    cb_data.cb = callback_workers;
+    cb_data.data = NULL;
+
+    filter_ffd = flb_filter(ctx, (char *) "wasm", NULL);
+    TEST_CHECK(filter_ffd >= 0);
+    ret = flb_filter_set(ctx, filter_ffd,
+                         "Match", "*",
+                         "wasm_path", DPATH_WASM "/append_tag.wasm",
+                         "function_name", "filter_append_tag",
+                         "workers", "4",
+                         NULL);
+    TEST_CHECK(ret == 0);
+
+    in_ffd = flb_input(ctx, (char *) "lib", NULL);
+    flb_input_set(ctx, in_ffd, "tag", "test.wasm", NULL);
+    TEST_CHECK(in_ffd >= 0);
+
+    out_ffd = flb_output(ctx, (char *) "lib", (void *)&cb_data);
+    TEST_CHECK(out_ffd >= 0);
+    flb_output_set(ctx, out_ffd,
+                   "match", "test.wasm",
+                   "format", "json",
+                   NULL);
+
+    ret = flb_start(ctx);
+    TEST_CHECK(ret==0);
+
+    flb_lib_push(ctx, in_ffd, input, flb_sds_len(input));
+
+    for (i = 0; i < 50 && get_output_num() < records; i++) {
+        flb_time_msleep(100);
+    }
+
+    ret = get_output_num();
+    if (!TEST_CHECK(ret == records)) {
+        TEST_MSG("expected %i records, got %i", records, ret);
+    }
+    if (!TEST_CHECK(workers_errors == 0)) {
+        TEST_MSG("%i records out of order or not filtered", workers_errors);
+    }
+
+    flb_stop(ctx);
+    flb_destroy(ctx);
+    flb_sds_destroy(input);
+}
+
 TEST_LIST = {
     {"hello_world", flb_test_helloworld},
     {"append_tag", flb_test_append_tag},
@@ -526,5 +623,6 @@ TEST_LIST = {
     {"array_contains_null", flb_test_array_contains_null},
     {"drop_all_records", flb_test_drop_all_records},
     {"append_kv_on_msgpack_format", flb_test_append_kv_on_msgpack},
+    {"workers", flb_test_workers},
     {NULL, NULL}
 };
@@ -23,6 +23,8 @@
 #include <fluent-bit/flb_time.h>
 #include <fluent-bit/flb_pack.h>
 #include <fluent-bit/flb_socket.h>
+#include <fluent-bit/flb_input.h>
+#include <msgpack.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #ifdef FLB_HAVE_UNIX_SOCKET
@@ -245,6 +247,91 @@ void flb_test_forward()
     test_ctx_destroy(ctx);
 }
 
+/* Forward mode batch split in two writes, the ACK must be sent back */
+void flb_test_forward_mode()
+{
+    struct flb_lib_out_cb cb_data;
+    struct test_ctx *ctx;
+    flb_sockfd_t fd;
+    int ret;
+    int num;
+    int root_type;
+    ssize_t w_size;
+    ssize_t r_size;
+    char ack[64];
+    char json[] = "[\"test\", [[1234567890, {\"test\":\"msg\",\"seq\":1}],"
+                  "[1234567891, {\"test\":\"msg\",\"seq\":2}],"
+                  "[1234567892, {\"test\":\"msg\",\"seq\":3}]],"
+                  "{\"chunk\":\"abc\"}]";
+    char *buf;
+    size_t size;
+    size_t half;
+
+    clear_output_num();
+
+    cb_data.cb = cb_check_result_json;
+    cb_data.data = "\"test\":\"msg\"";
+
+    ctx = test_ctx_create(&cb_data);
+    if (!TEST_CHECK(ctx != NULL)) {
+        TEST_MSG("test_ctx_create failed");
+        exit(EXIT_FAILURE);
+    }
+
+    ret = flb_output_set(ctx->flb, ctx->o_ffd,
+                         "match", "test",
+                         "format", "json",
+                         NULL);
+    TEST_CHECK(ret == 0);
+
+    /* Start the engine */
+    ret = flb_start(ctx->flb);
+    TEST_CHECK(ret == 0);
+
+    /* use default host/port */
+    fd = connect_tcp(NULL, -1);
+    if (!TEST_CHECK(fd >= 0)) {
+        exit(EXIT_FAILURE);
+    }
+
+    ret = flb_pack_json(json, strlen(json), &buf, &size, &root_type, NULL);
+    TEST_CHECK(ret == 0);
+
+    /* the first write ends in the middle of an entry */
+    half = size / 2;
+    w_size = send(fd, buf, half, 0);
+    TEST_CHECK(w_size == half);
+    flb_time_msleep(200);
+
+    w_size = send(fd, buf + half, size - half, 0);
+    flb_free(buf);
+    if (!TEST_CHECK(w_size == size - half)) {
+        TEST_MSG("failed to send, errno=%d", errno);
+        flb_socket_close(fd);
+        exit(EXIT_FAILURE);
+    }
+
+    /* {"ack": "abc"} */
+    r_size = recv(fd, ack, sizeof(ack) - 1, 0);
+    if (r_size > 0) {
+        ack[r_size] = '\0';
+    }
+    if (!TEST_CHECK(r_size > 0 && strstr(ack, "abc") != NULL)) {
+        TEST_MSG("ACK not received");
+    }
+
+    /* waiting to flush */
+    flb_time_msleep(1500);
+
+    num = get_output_num();
+    if (!TEST_CHECK(num == 3))  {
+        TEST_MSG("expected 3 records, got %d", num);
+    }
+
+    flb_socket_close(fd);
+    test_ctx_destroy(ctx);
+}
+
 void flb_test_forward_port()
 {
     struct flb_lib_out_cb cb_data;
@@ -566,10 +653,199 @@ void flb_test_unix_perm()
 #endif /* FLB_HAVE_UNIX_SOCKET */
 
 
+/*
+ * Backpressure with network workers: the input is paused many times while
+ * clients spread over the workers keep sending. Every message asks for an
+ * ACK and is sent again on a new connection when none comes back, so no
+ * record may be missing once the engine drained everything.
+ */
+#define PAUSE_RECORDS      600
+#define PAUSE_CONNECTIONS  8
+#define PAUSE_PAD_SIZE     1024
+
+static char pause_seen[PAUSE_RECORDS];
+
+static int cb_pause_record(void *record, size_t size, void *data)
+{
+    int seq;
+    char *p;
+
+    p = strstr((char *) record, "\"seq\":");
+    if (p != NULL) {
+        seq = atoi(p + 6);
+        pthread_mutex_lock(&result_mutex);
+        if (seq >= 0 && seq < PAUSE_RECORDS) {
+            pause_seen[seq] = 1;
+        }
+        pthread_mutex_unlock(&result_mutex);
+    }
+
+    flb_free(record);
+    return 0;
+}
+
+static int pause_seen_count()
+{
+    int i;
+    int count = 0;
+
+    pthread_mutex_lock(&result_mutex);
+    for (i = 0; i < PAUSE_RECORDS; i++) {
+        count += pause_seen[i];
+    }
+    pthread_mutex_unlock(&result_mutex);
+
+    return count;
+}
+
+/* ["test", [[ts, {"seq": N, "pad": "..."}]], {"chunk": "N"}] */
+static void pack_pause_message(msgpack_sbuffer *sbuf, int seq, char *pad)
+{
+    char chunk[16];
+    msgpack_packer pck;
+
+    msgpack_packer_init(&pck, sbuf, msgpack_sbuffer_write);
+    snprintf(chunk, sizeof(chunk), "%d", seq);
+
+    msgpack_pack_array(&pck, 3);
+    msgpack_pack_str_with_body(&pck, "test", 4);
+    msgpack_pack_array(&pck, 1);
+    msgpack_pack_array(&pck, 2);
+    msgpack_pack_uint64(&pck, 1234567890);
+    msgpack_pack_map(&pck, 2);
+    msgpack_pack_str_with_body(&pck, "seq", 3);
+    msgpack_pack_int(&pck, seq);
+    msgpack_pack_str_with_body(&pck, "pad", 3);
+    msgpack_pack_str_with_body(&pck, pad, PAUSE_PAD_SIZE);
+    msgpack_pack_map(&pck, 1);
+    msgpack_pack_str_with_body(&pck, "chunk", 5);
+    msgpack_pack_str_with_body(&pck, chunk, strlen(chunk));
+}
+
+void flb_test_workers_pause()
+{
+    int i;
+    int ret;
+    int tries;
+    int paused = FLB_FALSE;
+    int fds[PAUSE_CONNECTIONS];
+    char ack[64];
+    char pad[PAUSE_PAD_SIZE];
+    ssize_t w_size;
+    ssize_t r_size;
+    struct timeval tv;
+    msgpack_sbuffer sbuf;
+    struct flb_lib_out_cb cb_data;
+    struct flb_input_instance *ins;
+    struct test_ctx *ctx;
+
+    memset(pause_seen, 0, sizeof(pause_seen));
+    memset(pad, 'x', sizeof(pad));
+
+    cb_data.cb = cb_pause_record;
+    cb_data.data = NULL;
+
+    ctx = test_ctx_create(&cb_data);
+    if (!TEST_CHECK(ctx != NULL)) {
+        TEST_MSG("test_ctx_create failed");
+        exit(EXIT_FAILURE);
+    }
+
+    ret = flb_input_set(ctx->flb, ctx->i_ffd,
+                        "net.accept_workers", "4",
+                        "mem_buf_limit", "32k",
+                        NULL);
+    TEST_CHECK(ret == 0);
+
+    ret = flb_output_set(ctx->flb, ctx->o_ffd,
+                         "match", "test",
+                         "format", "json",
+                         NULL);
+    TEST_CHECK(ret == 0);
+
+    ret = flb_start(ctx->flb);
+    TEST_CHECK(ret == 0);
+
+    ins = mk_list_entry_first(&ctx->flb->config->inputs,
+                              struct flb_input_instance, _head);
+
+    for (i = 0; i < PAUSE_CONNECTIONS; i++) {
+        fds[i] = -1;
+    }
+
+    tv.tv_sec = 2;
+    tv.tv_usec = 0;
+
+    for (i = 0; i < PAUSE_RECORDS; i++) {
+        msgpack_sbuffer_init(&sbuf);
+        pack_pause_message(&sbuf, i, pad);
+
+        for (tries = 0; tries < 50; tries++) {
+            if (fds[i % PAUSE_CONNECTIONS] == -1) {
+                fds[i % PAUSE_CONNECTIONS] = connect_tcp(NULL, -1);
+                if (fds[i % PAUSE_CONNECTIONS] == -1) {
+                    break;
+                }
+                setsockopt(fds[i % PAUSE_CONNECTIONS], SOL_SOCKET, SO_RCVTIMEO,
+                           &tv, sizeof(tv));
+            }
+
+            w_size = send(fds[i % PAUSE_CONNECTIONS], sbuf.data, sbuf.size,
+                          MSG_NOSIGNAL);
+            if (w_size == sbuf.size) {
+                r_size = recv(fds[i % PAUSE_CONNECTIONS], ack,
+                              sizeof(ack) - 1, 0);
+                if (r_size > 0) {
+                    break;
+                }
+            }
+
+            /* the connection was dropped by the pause, send it again */
+            flb_socket_close(fds[i % PAUSE_CONNECTIONS]);
+            fds[i % PAUSE_CONNECTIONS] = -1;
+            flb_time_msleep(100);
+        }
+        msgpack_sbuffer_destroy(&sbuf);
+
+        if (!TEST_CHECK(tries < 50 && fds[i % PAUSE_CONNECTIONS] != -1)) {
+            TEST_MSG("record %d was never acknowledged", i);
+            break;
+        }
+
+        if (flb_input_buf_paused(ins)) {
+            paused = FLB_TRUE;
+        }
+    }
+
+    for (i = 0; i < PAUSE_CONNECTIONS; i++) {
+        if (fds[i] != -1) {
+            flb_socket_close(fds[i]);
+        }
+    }
+
+    /* waiting to flush */
+    for (tries = 0; tries < 50 && pause_seen_count() < PAUSE_RECORDS; tries++) {
+        flb_time_msleep(200);
+    }
+
+    if (!TEST_CHECK(paused == FLB_TRUE)) {
+        TEST_MSG("the input was never paused");
+    }
+    ret = pause_seen_count();
+    if (!TEST_CHECK(ret == PAUSE_RECORDS)) {
+        TEST_MSG("expected %d records, got %d", PAUSE_RECORDS, ret);
+    }
+
+    test_ctx_destroy(ctx);
+}
+
+
 TEST_LIST = {
     {"forward", flb_test_forward},
+    {"forward_mode", flb_test_forward_mode},
     {"forward_port", flb_test_forward_port},
     {"tag_prefix", flb_test_tag_prefix},
+    {"workers_pause", flb_test_workers_pause},
 #ifdef FLB_HAVE_UNIX_SOCKET
     {"unix_path", flb_test_unix_path},
     {"unix_perm", flb_test_unix_perm},
@@ -24,10 +24,16 @@
 #include <fluent-bit/flb_time.h>
 #include <fluent-bit/flb_pack.h>
 #include <fluent-bit/flb_http_client.h>
+#include <fluent-bit/flb_log_event_decoder.h>
 #include <monkey/mk_core.h>
+#include <fluent-otel-proto/fluent-otel.h>
+#include <cfl/cfl_time.h>
 #include "flb_tests_runtime.h"
 
 #define JSON_CONTENT_TYPE "application/json"
+#define PROTOBUF_CONTENT_TYPE "application/x-protobuf"
+
+#define BENCHMARK_RECORDS 100000
 
 #define PORT_OTEL 4318
 #define TEST_MSG_OTEL_LOGS "{\"resourceLogs\":[{\"resource\":{},\"scopeLogs\":[{\"scope\":{},\"logRecords\":[{\"timeUnixNano\":\"1660296023390371588\",\"body\":{\"stringValue\":\"{\\\"message\\\":\\\"test\\\"}\"}}]}]}]}"
@@ -104,6 +110,211 @@ static int cb_check_result_json(void *record, size_t size, void *data)
     return 0;
 }
 
+/* Callback to collect the raw msgpack output */
+static flb_sds_t output_buf = NULL;
+
+static int cb_collect_msgpack(void *record, size_t size, void *data)
+{
+    pthread_mutex_lock(&result_mutex);
+    if (output_buf != NULL) {
+        output_buf = flb_sds_cat(output_buf, record, size);
+    }
+    num_output++;
+    pthread_mutex_unlock(&result_mutex);
+
+    flb_free(record);
+    return 0;
+}
+
+typedef Opentelemetry__Proto__Common__V1__AnyValue otlp_any_value;
+typedef Opentelemetry__Proto__Common__V1__KeyValue otlp_key_value;
+
+static void otlp_string_set(otlp_any_value *value, char *str)
+{
+    opentelemetry__proto__common__v1__any_value__init(value);
+    value->value_case = OPENTELEMETRY__PROTO__COMMON__V1__ANY_VALUE__VALUE_STRING_VALUE;
+    value->string_value = str;
+}
+
+static void otlp_int_set(otlp_any_value *value, int64_t val)
+{
+    opentelemetry__proto__common__v1__any_value__init(value);
+    value->value_case = OPENTELEMETRY__PROTO__COMMON__V1__ANY_VALUE__VALUE_INT_VALUE;
+    value->int_value = val;
+}
+
+static void otlp_key_value_set(otlp_key_value *kv, char *key, otlp_any_value *value)
+{
+    opentelemetry__proto__common__v1__key_value__init(kv);
+    kv->key = key;
+    kv->value = value;
+}
+
+/*
+ * ExportLogsServiceRequest with every AnyValue type, optional field and
+ * body kind. Every record has a timestamp so the output is deterministic.
+ */
+static char *otlp_logs_payload_create(int resources, int scopes, int records,
+                                      size_t *out_size)
+{
+    int i;
+    int r;
+    int s;
+    char *buf;
+    static uint8_t raw[] = {0x00, 0x01, 0xfe, 0xff};
+    static uint8_t trace_id[16] = {0x5b, 0x8e, 0xff, 0xf7, 0x98, 0x03, 0x81, 0x03,
+                                   0xd2, 0x69, 0xb6, 0x33, 0x81, 0x3f, 0xc6, 0x0c};
+    static uint8_t span_id[8] = {0xee, 0xe1, 0x9b, 0x7e, 0xc3, 0xc1, 0xb1, 0x74};
+    otlp_any_value values[12];
+    otlp_any_value *array_values[2];
+    otlp_any_value bodies[4];
+    otlp_key_value kvs[9];
+    otlp_key_value *attributes[7];
+    otlp_key_value *kvlist_values[2];
+    Opentelemetry__Proto__Common__V1__ArrayValue array;
+    Opentelemetry__Proto__Common__V1__KeyValueList kvlist;
+    Opentelemetry__Proto__Common__V1__InstrumentationScope scope[2];
+    Opentelemetry__Proto__Resource__V1__Resource resource[2];
+    Opentelemetry__Proto__Logs__V1__LogRecord *log_records;
+    Opentelemetry__Proto__Logs__V1__LogRecord **log_record_ptrs;
+    Opentelemetry__Proto__Logs__V1__ScopeLogs *scope_logs;
+    Opentelemetry__Proto__Logs__V1__ScopeLogs **scope_log_ptrs;
+    Opentelemetry__Proto__Logs__V1__ResourceLogs *resource_logs;
+    Opentelemetry__Proto__Logs__V1__ResourceLogs **resource_log_ptrs;
+    Opentelemetry__Proto__Collector__Logs__V1__ExportLogsServiceRequest request;
+
+    /* attribute values */
+    otlp_string_set(&values[0], "checkout");
+    otlp_int_set(&values[1], -4242);
+    opentelemetry__proto__common__v1__any_value__init(&values[2]);
+    values[2].value_case = OPENTELEMETRY__PROTO__COMMON__V1__ANY_VALUE__VALUE_DOUBLE_VALUE;
+    values[2].double_value = 0.25;
+    opentelemetry__proto__common__v1__any_value__init(&values[3]);
+    values[3].value_case = OPENTELEMETRY__PROTO__COMMON__V1__ANY_VALUE__VALUE_BOOL_VALUE;
+    values[3].bool_value = 1;
+    opentelemetry__proto__common__v1__any_value__init(&values[4]);
+    values[4].value_case = OPENTELEMETRY__PROTO__COMMON__V1__ANY_VALUE__VALUE_BYTES_VALUE;
+    values[4].bytes_value.data = raw;
+    values[4].bytes_value.len = sizeof(raw);
+
+    otlp_string_set(&values[5], "a");
+    otlp_int_set(&values[6], 7);
+    array_values[0] = &values[5];
+    array_values[1] = &values[6];
+    opentelemetry__proto__common__v1__array_value__init(&array);
+    array.values = array_values;
+    array.n_values = 2;
+    opentelemetry__proto__common__v1__any_value__init(&values[7]);
+    values[7].value_case = OPENTELEMETRY__PROTO__COMMON__V1__ANY_VALUE__VALUE_ARRAY_VALUE;
+    values[7].array_value = &array;
+
+    otlp_string_set(&values[8], "GET");
+    otlp_int_set(&values[9], 200);
+    otlp_key_value_set(&kvs[7], "method", &values[8]);
+    otlp_key_value_set(&kvs[8], "status", &values[9]);
+    kvlist_values[0] = &kvs[7];
+    kvlist_values[1] = &kvs[8];
+    opentelemetry__proto__common__v1__key_value_list__init(&kvlist);
+    kvlist.values = kvlist_values;
+    kvlist.n_values = 2;
+    opentelemetry__proto__common__v1__any_value__init(&values[10]);
+    values[10].value_case = OPENTELEMETRY__PROTO__COMMON__V1__ANY_VALUE__VALUE_KVLIST_VALUE;
+    values[10].kvlist_value = &kvlist;
+
+    otlp_key_value_set(&kvs[0], "service.name", &values[0]);
+    otlp_key_value_set(&kvs[1], "pid", &values[1]);
+    otlp_key_value_set(&kvs[2], "ratio", &values[2]);
+    otlp_key_value_set(&kvs[3], "sampled", &values[3]);
+    otlp_key_value_set(&kvs[4], "raw", &values[4]);
+    otlp_key_value_set(&kvs[5], "tags", &values[7]);
+    otlp_key_value_set(&kvs[6], "http", &values[10]);
+    for (i = 0; i < 7; i++) {
+        attributes[i] = &kvs[i];
+    }
+
+    /* bodies: string, kvlist, int and array */
+    otlp_string_set(&bodies[0], "GET /index.html HTTP/1.1 200 2326 \"-\" \"curl/8.5.0\"");
+    bodies[1] = values[10];
+    otlp_int_set(&bodies[2], 1234567);
+    bodies[3] = values[7];
+
+    for (i = 0; i < 2; i++) {
+        opentelemetry__proto__common__v1__instrumentation_scope__init(&scope[i]);
+        scope[i].name = "io.opentelemetry.test";
+        scope[i].version = i ? "1.0.0" : "";
+        scope[i].attributes = &attributes[i];
+        scope[i].n_attributes = i + 1;
+        scope[i].dropped_attributes_count = i;
+
+        opentelemetry__proto__resource__v1__resource__init(&resource[i]);
+        resource[i].attributes = attributes;
+        resource[i].n_attributes = 2 + i;
+        resource[i].dropped_attributes_count = i * 3;
+    }
+
+    log_records = flb_calloc(records, sizeof(*log_records));
+    log_record_ptrs = flb_calloc(records, sizeof(*log_record_ptrs));
+    for (i = 0; i < records; i++) {
+        opentelemetry__proto__logs__v1__log_record__init(&log_records[i]);
+        log_records[i].time_unix_nano = 1700000000000000000ULL + i * 1000;
+        log_records[i].observed_time_unix_nano = 1700000000000000000ULL + i * 1000 + 1;
+        log_records[i].severity_number = i % 26;
+        log_records[i].severity_text = (i % 2) ? "INFO" : "";
+        log_records[i].body = &bodies[i % 4];
+        log_records[i].attributes = attributes;
+        log_records[i].n_attributes = i % 8;
+        log_records[i].flags = i & 0x1ff;
+        if (i % 3 == 0) {
+            log_records[i].trace_id.data = trace_id;
+            log_records[i].trace_id.len = sizeof(trace_id);
+            log_records[i].span_id.data = span_id;
+            log_records[i].span_id.len = sizeof(span_id);
+        }
+        log_record_ptrs[i] = &log_records[i];
+    }
+
+    scope_logs = flb_calloc(resources * scopes, sizeof(*scope_logs));
+    scope_log_ptrs = flb_calloc(resources * scopes, sizeof(*scope_log_ptrs));
+    resource_logs = flb_calloc(resources, sizeof(*resource_logs));
+    resource_log_ptrs = flb_calloc(resources, sizeof(*resource_log_ptrs));
+
+    for (r = 0; r < resources; r++) {
+        for (s = 0; s < scopes; s++) {
+            i = r * scopes + s;
+            opentelemetry__proto__logs__v1__scope_logs__init(&scope_logs[i]);
+            scope_logs[i].scope = &scope[s % 2];
+            scope_logs[i].log_records = log_record_ptrs;
+            scope_logs[i].n_log_records = records;
+            scope_log_ptrs[i] = &scope_logs[i];
+        }
+
+        opentelemetry__proto__logs__v1__resource_logs__init(&resource_logs[r]);
+        resource_logs[r].resource = &resource[r % 2];
+        resource_logs[r].scope_logs = &scope_log_ptrs[r * scopes];
+        resource_logs[r].n_scope_logs = scopes;
+        resource_logs[r].schema_url = (r % 2) ? "" : "https://opentelemetry.io/schemas/1.21.0";
+        resource_log_ptrs[r] = &resource_logs[r];
+    }
+
+    opentelemetry__proto__collector__logs__v1__export_logs_service_request__init(&request);
+    request.resource_logs = resource_log_ptrs;
+    request.n_resource_logs = resources;
+
+    *out_size = opentelemetry__proto__collector__logs__v1__export_logs_service_request__get_packed_size(&request);
+    buf = flb_malloc(*out_size);
+    TEST_CHECK(buf != NULL);
+    opentelemetry__proto__collector__logs__v1__export_logs_service_request__pack(&request, (uint8_t *) buf);
+
+    flb_free(log_records);
+    flb_free(log_record_ptrs);
+    flb_free(scope_logs);
+    flb_free(scope_log_ptrs);
+    flb_free(resource_logs);
+    flb_free(resource_log_ptrs);
+
+    return buf;
+}
+
 struct http_client_ctx* http_client_ctx_create()
 {
     struct http_client_ctx *ret_ctx = NULL;
@@ -143,6 +354,9 @@ struct http_client_ctx* http_client_ctx_create()
         return NULL;
     }
 
+    /* large payloads must not yield, there is no coroutine here */
+    flb_stream_disable_async_mode(&ret_ctx->u->base);
+
     ret_ctx->u_conn = flb_upstream_conn_get(ret_ctx->u);
     TEST_CHECK(ret_ctx->u_conn != NULL);
 
@@ -441,11 +655,512 @@ void flb_test_otel_tag_from_uri_false()
     test_ctx_destroy(ctx);
 }
 
+struct otlp_payload {
+    char *buf;
+    size_t size;
+    int status;     /* expected response */
+};
+
+/*
+ * Post protobuf payloads with the given 'logs_stream_decoder' value, one
+ * request each, check the responses, wait for 'expected' events and return
+ * the time spent serving the requests.
+ */
+static uint64_t otel_protobuf_post_all(char *stream_decoder,
+                                       struct otlp_payload *payloads, int count,
+                                       int expected,
+                                       int (*cb)(void *, size_t, void *))
+{
+    int i;
+    int ret;
+    size_t b_sent;
+    uint64_t t1;
+    uint64_t elapsed = 0;
+    struct flb_lib_out_cb cb_data;
+    struct test_ctx *ctx;
+    struct flb_http_client *c;
+
+    clear_output_num();
+
+    cb_data.cb = cb;
+    cb_data.data = NULL;
+
+    ctx = test_ctx_create(&cb_data);
+    if (!TEST_CHECK(ctx != NULL)) {
+        TEST_MSG("test_ctx_create failed");
+        exit(EXIT_FAILURE);
+    }
+
+    ret = flb_input_set(ctx->flb, ctx->i_ffd,
+                        "logs_stream_decoder", stream_decoder,
+                        NULL);
+    TEST_CHECK(ret == 0);
+
+    ret = flb_output_set(ctx->flb, ctx->o_ffd,
+                         "match", "*",
+                         NULL);
+    TEST_CHECK(ret == 0);
+
+    /* Start the engine */
+    ret = flb_start(ctx->flb);
+    TEST_CHECK(ret == 0);
+
+    ctx->httpc = http_client_ctx_create();
+    TEST_CHECK(ctx->httpc != NULL);
+
+    for (i = 0; i < count; i++) {
+        c = flb_http_client(ctx->httpc->u_conn, FLB_HTTP_POST, V1_ENDPOINT_LOGS,
+                            payloads[i].buf, payloads[i].size,
+                            "127.0.0.1", PORT_OTEL, NULL, 0);
+        if (!TEST_CHECK(c != NULL)) {
+            TEST_MSG("http_client failed");
+            exit(EXIT_FAILURE);
+        }
+        ret = flb_http_add_header(c, FLB_HTTP_HEADER_CONTENT_TYPE, strlen(FLB_HTTP_HEADER_CONTENT_TYPE),
+                                  PROTOBUF_CONTENT_TYPE, strlen(PROTOBUF_CONTENT_TYPE));
+        TEST_CHECK(ret == 0);
+
+        t1 = cfl_time_now();
+        ret = flb_http_do(c, &b_sent);
+        elapsed += cfl_time_now() - t1;
+        if (!TEST_CHECK(ret == 0)) {
+            TEST_MSG("ret error. ret=%d\n", ret);
+        }
+        else if (!TEST_CHECK(c->resp.status == payloads[i].status)) {
+            TEST_MSG("payload %d: http response code error. expect: %d, got: %d\n",
+                     i, payloads[i].status, c->resp.status);
+        }
+        flb_http_client_destroy(c);
+    }
+
+    /* waiting to flush, then let any unexpected event show up */
+    for (i = 0; i < 100 && get_output_num() < expected; i++) {
+        flb_time_msleep(100);
+    }
+    flb_time_msleep(500);
+    if (!TEST_CHECK(get_output_num() == expected)) {
+        TEST_MSG("expected %d events, got %d", expected, get_output_num());
+    }
+
+    flb_upstream_conn_release(ctx->httpc->u_conn);
+    test_ctx_destroy(ctx);
+
+    return elapsed;
+}
+
+static uint64_t otel_protobuf_post(char *stream_decoder, char *buf, size_t size,
+                                   int expected, int (*cb)(void *, size_t, void *))
+{
+    struct otlp_payload payload = {buf, size, 201};
+
+    return otel_protobuf_post_all(stream_decoder, &payload, 1, expected, cb);
+}
+
+/* Events for a payload: a group start and end around each scope records */
+#define OTLP_PAYLOAD_EVENTS(resources, scopes, records) \
+    ((resources) * (scopes) * ((records) + 2))
+
+void flb_test_otel_logs_stream_decoder()
+{
+    char *buf;
+    size_t size;
+    flb_sds_t stream_out;
+    flb_sds_t protobuf_c_out;
+
+    buf = otlp_logs_payload_create(3, 2, 40, &size);
+
+    output_buf = flb_sds_create_size(4096);
+    otel_protobuf_post("false", buf, size, OTLP_PAYLOAD_EVENTS(3, 2, 40),
+                       cb_collect_msgpack);
+    protobuf_c_out = output_buf;
+
+    output_buf = flb_sds_create_size(4096);
+    otel_protobuf_post("true", buf, size, OTLP_PAYLOAD_EVENTS(3, 2, 40),
+                       cb_collect_msgpack);
+    stream_out = output_buf;
+    output_buf = NULL;
+
+    TEST_CHECK(flb_sds_len(protobuf_c_out) > 0);
+    TEST_CHECK(flb_sds_len(stream_out) == flb_sds_len(protobuf_c_out) &&
+               memcmp(stream_out, protobuf_c_out, flb_sds_len(stream_out)) == 0);
+    TEST_MSG("protobuf-c %zu bytes, stream %zu bytes",
+             flb_sds_len(protobuf_c_out), flb_sds_len(stream_out));
+
+    flb_sds_destroy(protobuf_c_out);
+    flb_sds_destroy(stream_out);
+    flb_free(buf);
+}
+
+static int cb_count(void *record, size_t size, void *data)
+{
+    set_output_num(get_output_num() + 1);
+    flb_free(record);
+    return 0;
+}
+
+/*
+ * Records with missing values: no body, an empty body, attributes without
+ * value or with an empty one, and empty values in kvlist and array bodies.
+ */
+static char *otlp_logs_missing_values_create(size_t *out_size)
+{
+    int i;
+    char *buf;
+    otlp_any_value empty;
+    otlp_any_value one;
+    otlp_any_value text;
+    otlp_any_value kvlist_body;
+    otlp_any_value array_body;
+    otlp_any_value *array_values[2];
+    otlp_key_value kvs[3];
+    otlp_key_value *attributes[2];
+    otlp_key_value *kvlist_values[1];
+    Opentelemetry__Proto__Common__V1__ArrayValue array;
+    Opentelemetry__Proto__Common__V1__KeyValueList kvlist;
+    Opentelemetry__Proto__Common__V1__InstrumentationScope scope;
+    Opentelemetry__Proto__Resource__V1__Resource resource;
+    Opentelemetry__Proto__Logs__V1__LogRecord log_records[5];
+    Opentelemetry__Proto__Logs__V1__LogRecord *log_record_ptrs[5];
+    Opentelemetry__Proto__Logs__V1__ScopeLogs scope_logs;
+    Opentelemetry__Proto__Logs__V1__ScopeLogs *scope_log_ptrs[1];
+    Opentelemetry__Proto__Logs__V1__ResourceLogs resource_logs;
+    Opentelemetry__Proto__Logs__V1__ResourceLogs *resource_log_ptrs[1];
+    Opentelemetry__Proto__Collector__Logs__V1__ExportLogsServiceRequest request;
+
+    opentelemetry__proto__common__v1__any_value__init(&empty);
+    otlp_int_set(&one, 1);
+    otlp_string_set(&text, "text");
+
+    otlp_key_value_set(&kvs[0], "a", NULL);
+    otlp_key_value_set(&kvs[1], "b", &empty);
+    attributes[0] = &kvs[0];
+    attributes[1] = &kvs[1];
+
+    otlp_key_value_set(&kvs[2], "k", NULL);
+    kvlist_values[0] = &kvs[2];
+    opentelemetry__proto__common__v1__key_value_list__init(&kvlist);
+    kvlist.values = kvlist_values;
+    kvlist.n_values = 1;
+    opentelemetry__proto__common__v1__any_value__init(&kvlist_body);
+    kvlist_body.value_case = OPENTELEMETRY__PROTO__COMMON__V1__ANY_VALUE__VALUE_KVLIST_VALUE;
+    kvlist_body.kvlist_value = &kvlist;
+
+    array_values[0] = &empty;
+    array_values[1] = &one;
+    opentelemetry__proto__common__v1__array_value__init(&array);
+    array.values = array_values;
+    array.n_values = 2;
+    opentelemetry__proto__common__v1__any_value__init(&array_body);
+    array_body.value_case = OPENTELEMETRY__PROTO__COMMON__V1__ANY_VALUE__VALUE_ARRAY_VALUE;
+    array_body.array_value = &array;
+
+    for (i = 0; i < 5; i++) {
+        opentelemetry__proto__logs__v1__log_record__init(&log_records[i]);
+        log_records[i].time_unix_nano = 1700000000000000000ULL + i * 1000;
+        log_record_ptrs[i] = &log_records[i];
+    }
+    log_records[1].body = &empty;
+    log_records[2].body = &text;
+    log_records[2].attributes = attributes;
+    log_records[2].n_attributes = 2;
+    log_records[3].body = &kvlist_body;
+    log_records[4].body = &array_body;
+
+    opentelemetry__proto__common__v1__instrumentation_scope__init(&scope);
+    scope.name = "io.opentelemetry.test";
+    opentelemetry__proto__resource__v1__resource__init(&resource);
+    resource.attributes = attributes;
+    resource.n_attributes = 2;
+
+    opentelemetry__proto__logs__v1__scope_logs__init(&scope_logs);
+    scope_logs.scope = &scope;
+    scope_logs.log_records = log_record_ptrs;
+    scope_logs.n_log_records = 5;
+    scope_log_ptrs[0] = &scope_logs;
+
+    opentelemetry__proto__logs__v1__resource_logs__init(&resource_logs);
+    resource_logs.resource = &resource;
+    resource_logs.scope_logs = scope_log_ptrs;
+    resource_logs.n_scope_logs = 1;
+    resource_log_ptrs[0] = &resource_logs;
+
+    opentelemetry__proto__collector__logs__v1__export_logs_service_request__init(&request);
+    request.resource_logs = resource_log_ptrs;
+    request.n_resource_logs = 1;
+
+    *out_size = opentelemetry__proto__collector__logs__v1__export_logs_service_request__get_packed_size(&request);
+    buf = flb_malloc(*out_size);
+    TEST_CHECK(buf != NULL);
+    opentelemetry__proto__collector__logs__v1__export_logs_service_request__pack(&request, (uint8_t *) buf);
+
+    return buf;
+}
+
+static msgpack_object *map_get(msgpack_object *map, char *key)
+{
+    int i;
+    msgpack_object_kv *kv;
+
+    if (map == NULL || map->type != MSGPACK_OBJECT_MAP) {
+        return NULL;
+    }
+
+    for (i = 0; i < map->via.map.size; i++) {
+        kv = &map->via.map.ptr[i];
+        if (kv->key.type == MSGPACK_OBJECT_STR &&
+            kv->key.via.str.size == strlen(key) &&
+            strncmp(kv->key.via.str.ptr, key, kv->key.via.str.size) == 0) {
+            return &kv->val;
+        }
+    }
+
+    return NULL;
+}
+
+void flb_test_otel_logs_missing_values()
+{
+    int i;
+    int ret;
+    char *buf;
+    size_t size;
+    flb_sds_t stream_out;
+    flb_sds_t protobuf_c_out;
+    msgpack_object *obj;
+    struct flb_log_event event;
+    struct flb_log_event_decoder decoder;
+
+    buf = otlp_logs_missing_values_create(&size);
+
+    output_buf = flb_sds_create_size(4096);
+    otel_protobuf_post("false", buf, size, OTLP_PAYLOAD_EVENTS(1, 1, 5),
+                       cb_collect_msgpack);
+    protobuf_c_out = output_buf;
+
+    output_buf = flb_sds_create_size(4096);
+    otel_protobuf_post("true", buf, size, OTLP_PAYLOAD_EVENTS(1, 1, 5),
+                       cb_collect_msgpack);
+    stream_out = output_buf;
+    output_buf = NULL;
+
+    TEST_CHECK(flb_sds_len(stream_out) == flb_sds_len(protobuf_c_out) &&
+               memcmp(stream_out, protobuf_c_out, flb_sds_len(stream_out)) == 0);
+    TEST_MSG("protobuf-c %zu bytes, stream %zu bytes",
+             flb_sds_len(protobuf_c_out), flb_sds_len(stream_out));
+
+    ret = flb_log_event_decoder_init(&decoder, stream_out, flb_sds_len(stream_out));
+    TEST_CHECK(ret == FLB_EVENT_DECODER_SUCCESS);
+    flb_log_event_decoder_read_groups(&decoder, FLB_FALSE);
+
+    i = 0;
+    while (flb_log_event_decoder_next(&decoder, &event) == FLB_EVENT_DECODER_SUCCESS) {
+        switch (i) {
+        case 0:
+            /* no body: empty map */
+            TEST_CHECK(event.body->type == MSGPACK_OBJECT_MAP &&
+                       event.body->via.map.size == 0);
+            break;
+        case 1:
+            /* empty body: null message */
+            obj = map_get(event.body, "message");
+            TEST_CHECK(obj != NULL && obj->type == MSGPACK_OBJECT_NIL);
+            break;
+        case 2:
+            obj = map_get(map_get(event.metadata, "otlp"), "attributes");
+            TEST_CHECK(obj != NULL && obj->via.map.size == 2);
+            obj = map_get(map_get(map_get(event.metadata, "otlp"), "attributes"), "a");
+            TEST_CHECK(obj != NULL && obj->type == MSGPACK_OBJECT_NIL);
+            obj = map_get(map_get(map_get(event.metadata, "otlp"), "attributes"), "b");
+            TEST_CHECK(obj != NULL && obj->type == MSGPACK_OBJECT_NIL);
+            break;
+        case 3:
+            obj = map_get(event.body, "k");
+            TEST_CHECK(obj != NULL && obj->type == MSGPACK_OBJECT_NIL);
+            break;
+        case 4:
+            obj = map_get(event.body, "message");
+            TEST_CHECK(obj != NULL && obj->type == MSGPACK_OBJECT_ARRAY &&
+                       obj->via.array.size == 2 &&
+                       obj->via.array.ptr[0].type == MSGPACK_OBJECT_NIL);
+            break;
+        }
+        i++;
+    }
+    TEST_CHECK(i == 5);
+    flb_log_event_decoder_destroy(&decoder);
+
+    flb_sds_destroy(protobuf_c_out);
+    flb_sds_destroy(stream_out);
+    flb_free(buf);
+}
+
+/* Protobuf writer for hand made payloads */
+static void pb_varint(flb_sds_t *buf, uint64_t value)
+{
+    char byte;
+
+    do {
+        byte = value & 0x7f;
+        value >>= 7;
+        if (value > 0) {
+            byte |= 0x80;
+        }
+        flb_sds_cat_safe(buf, &byte, 1);
+    } while (value > 0);
+}
+
+static void pb_len(flb_sds_t *buf, int number, const char *data, size_t len)
+{
+    pb_varint(buf, (number << 3) | 2);
+    pb_varint(buf, len);
+    flb_sds_cat_safe(buf, data, len);
+}
+
+/* ExportLogsServiceRequest holding a single raw LogRecord */
+static flb_sds_t otlp_request_wrap(const char *record, size_t len)
+{
+    flb_sds_t scope_logs;
+    flb_sds_t resource_logs;
+    flb_sds_t request;
+
+    scope_logs = flb_sds_create_size(len + 16);
+    pb_len(&scope_logs, 2, record, len);
+
+    resource_logs = flb_sds_create_size(len + 32);
+    pb_len(&resource_logs, 2, scope_logs, flb_sds_len(scope_logs));
+
+    request = flb_sds_create_size(len + 48);
+    pb_len(&request, 1, resource_logs, flb_sds_len(resource_logs));
+
+    flb_sds_destroy(scope_logs);
+    flb_sds_destroy(resource_logs);
+
+    return request;
+}
+
+/* LogRecord whose body is a string nested in 'depth' arrays */
+static flb_sds_t otlp_record_nested_body(int depth)
+{
+    int i;
+    flb_sds_t tmp;
+    flb_sds_t value;
+    flb_sds_t record;
+
+    value = flb_sds_create_size(16);
+    pb_len(&value, 1, "x", 1);
+
+    for (i = 0; i < depth; i++) {
+        tmp = flb_sds_create_size(flb_sds_len(value) + 8);
+        pb_len(&tmp, 1, value, flb_sds_len(value));
+        flb_sds_len_set(value, 0);
+        pb_len(&value, 5, tmp, flb_sds_len(tmp));
+        flb_sds_destroy(tmp);
+    }
+
+    record = flb_sds_create_size(flb_sds_len(value) + 8);
+    pb_len(&record, 5, value, flb_sds_len(value));
+    flb_sds_destroy(value);
+
+    return record;
+}
+
+/* Malformed requests are dropped, the valid ones around them are kept */
+void flb_test_otel_logs_stream_decoder_malformed()
+{
+    int i;
+    flb_sds_t record;
+    struct otlp_payload payloads[9];
+    struct {
+        char *record;
+        size_t len;
+    } records[] = {
+        /* truncated varint: severity_number without its last byte */
+        {"\x10\x80", 2},
+        /* length past the end: severity_text of 10 bytes */
+        {"\x1a\x0a" "ab", 4},
+        /* wrong wire type: body as a varint */
+        {"\x28\x01", 2},
+        /* wrong wire type: string_value as a varint */
+        {"\x2a\x02\x08\x01", 4},
+        /* wrong wire type: attribute value as a varint */
+        {"\x32\x05\x0a\x01" "a" "\x10\x01", 7},
+        /* empty record, valid */
+        {"", 0},
+    };
+
+    for (i = 0; i < 6; i++) {
+        payloads[i].buf = otlp_request_wrap(records[i].record, records[i].len);
+        payloads[i].size = flb_sds_len(payloads[i].buf);
+        payloads[i].status = 400;
+    }
+    payloads[5].status = 201;
+
+    /* truncated length of the first resource logs */
+    payloads[6].buf = flb_sds_create_len("\x0a\xff", 2);
+    payloads[6].size = 2;
+    payloads[6].status = 400;
+
+    /* deeper than OTLP_MAX_DEPTH */
+    record = otlp_record_nested_body(70);
+    payloads[7].buf = otlp_request_wrap(record, flb_sds_len(record));
+    payloads[7].size = flb_sds_len(payloads[7].buf);
+    payloads[7].status = 400;
+    flb_sds_destroy(record);
+
+    /* valid nesting */
+    record = otlp_record_nested_body(20);
+    payloads[8].buf = otlp_request_wrap(record, flb_sds_len(record));
+    payloads[8].size = flb_sds_len(payloads[8].buf);
+    payloads[8].status = 201;
+    flb_sds_destroy(record);
+
+    otel_protobuf_post_all("true", payloads, 9,
+                           2 * OTLP_PAYLOAD_EVENTS(1, 1, 1), cb_count);
+
+    for (i = 0; i < 9; i++) {
+        flb_sds_destroy(payloads[i].buf);
+    }
+}
+
+/* Compare both decoders on a large request, only when FLB_BENCHMARK is set */
+void flb_test_otel_logs_stream_decoder_benchmark()
+{
+    int i;
+    char *buf;
+    size_t size;
+    uint64_t elapsed;
+    char *modes[] = {"false", "true"};
+
+    if (!getenv("FLB_BENCHMARK")) {
+        printf("\nskipped, set FLB_BENCHMARK to run it\n");
+        return;
+    }
+
+    buf = otlp_logs_payload_create(1, 1, BENCHMARK_RECORDS, &size);
+
+    for (i = 0; i < 2; i++) {
+        elapsed = otel_protobuf_post(modes[i], buf, size,
+                                     OTLP_PAYLOAD_EVENTS(1, 1, BENCHMARK_RECORDS),
+                                     cb_count);
+
+        printf("\n[logs_stream_decoder=%s] %i records (%zu bytes) in %.3f ms, "
+               "%.0f records/s",
+               modes[i], BENCHMARK_RECORDS, size, elapsed / 1000000.0,
+               BENCHMARK_RECORDS / (elapsed / 1000000000.0));
+    }
+    printf("\n");
+
+    flb_free(buf);
+}
+
 TEST_LIST = {
     {"otel_logs", flb_test_otel_logs},
     {"successful_response_code_200", flb_test_otel_successful_response_code_200},
     {"successful_response_code_204", flb_test_otel_successful_response_code_204},
     {"tag_from_uri_false", flb_test_otel_tag_from_uri_false},
+    {"logs_stream_decoder", flb_test_otel_logs_stream_decoder},
+    {"logs_missing_values", flb_test_otel_logs_missing_values},
+    {"logs_stream_decoder_malformed", flb_test_otel_logs_stream_decoder_malformed},
+    {"logs_stream_decoder_benchmark", flb_test_otel_logs_stream_decoder_benchmark},
     {NULL, NULL}
 };
 
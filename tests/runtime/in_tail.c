@@ -578,7 +578,7 @@ int write_long_lines(int fd) {
     return 0;
 }
 
-void flb_test_in_tail_skip_long_lines()
+static void test_skip_long_lines(char *high_throughput)
 {
     int64_t ret;
     flb_ctx_t    *ctx    = NULL;
@@ -639,6 +639,7 @@ void flb_test_in_tail_skip_long_lines()
                              "path"          , path,
                              "read_from_head", "true",
                              "skip_long_lines", "on",
+                             "high_throughput", high_throughput,
                              NULL) == 0);
 
     out_ffd = flb_output(ctx, (char *) "lib", &cb);
@@ -676,6 +677,17 @@ void flb_test_in_tail_skip_long_lines()
     unlink(path);
 }
 
+void flb_test_in_tail_skip_long_lines()
+{
+    test_skip_long_lines("off");
+}
+
+/* the read-ahead buffer is larger than buffer_max_size, the limit holds */
+void flb_test_in_tail_skip_long_lines_high_throughput()
+{
+    test_skip_long_lines("on");
+}
+
 /* 
  * test case for https://github.com/fluent/fluent-bit/issues/3943
  * 
@@ -1075,6 +1087,148 @@ void flb_test_offset_key()
     test_tail_ctx_destroy(ctx);
 }
 
+/*
+ * high_throughput: lines of every length are written before and while the
+ * file is tailed, each one must come out complete and in the file order.
+ */
+#define HT_LINES     20000
+#define HT_PAD_MAX   300
+
+struct ht_result {
+    int next;          /* sequence expected next */
+    int errors;
+};
+
+static void ht_line(char *buf, size_t size, int seq)
+{
+    int pad;
+
+    pad = (seq * 37) % HT_PAD_MAX;
+    snprintf(buf, size, "%06d-%.*s", seq, pad,
+             "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+             "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+             "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+             "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa");
+}
+
+static int cb_check_ht_order(void *record, size_t size, void *data)
+{
+    int seq;
+    char *p;
+    char line[HT_PAD_MAX + 32];
+    char expected[HT_PAD_MAX + 64];
+    struct ht_result *res = data;
+
+    pthread_mutex_lock(&result_mutex);
+
+    p = strstr((char *) record, "\"log\":\"");
+    seq = p ? atoi(p + 7) : -1;
+
+    if (seq != res->next) {
+        if (res->errors++ == 0) {
+            flb_error("expected line %d, got '%s'", res->next, (char *) record);
+        }
+    }
+    else {
+        ht_line(line, sizeof(line), seq);
+        snprintf(expected, sizeof(expected), "\"log\":\"%s\"", line);
+        if (strstr((char *) record, expected) == NULL && res->errors++ == 0) {
+            flb_error("line %d is not complete: '%s'", seq, (char *) record);
+        }
+    }
+    res->next = seq + 1;
+    num_output++;
+
+    pthread_mutex_unlock(&result_mutex);
+
+    flb_free(record);
+    return 0;
+}
+
+static int ht_write_lines(int fd, int from, int to)
+{
+    int i;
+    int len;
+    char line[HT_PAD_MAX + 32];
+
+    for (i = from; i < to; i++) {
+        ht_line(line, sizeof(line) - 1, i);
+        len = strlen(line);
+        line[len++] = '\n';
+        if (write(fd, line, len) != len) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void flb_test_high_throughput()
+{
+    int i;
+    int ret;
+    int num;
+    struct ht_result res = {0};
+    struct flb_lib_out_cb cb_data;
+    struct test_tail_ctx *ctx;
+    char *file[] = {"high_throughput.log"};
+
+    clear_output_num();
+
+    cb_data.cb = cb_check_ht_order;
+    cb_data.data = &res;
+
+    ctx = test_tail_ctx_create(&cb_data, &file[0], sizeof(file)/sizeof(char *), FLB_TRUE);
+    if (!TEST_CHECK(ctx != NULL)) {
+        TEST_MSG("test_ctx_create failed");
+        exit(EXIT_FAILURE);
+    }
+
+    /* small buffers so lines are split between reads */
+    ret = flb_input_set(ctx->flb, ctx->i_ffd,
+                        "path", file[0],
+                        "read_from_head", "true",
+                        "buffer_chunk_size", "1k",
+                        "buffer_max_size", "1k",
+                        "high_throughput", "true",
+                        "high_throughput.buffer_size", "16k",
+                        NULL);
+    TEST_CHECK(ret == 0);
+
+    ret = flb_output_set(ctx->flb, ctx->o_ffd,
+                         "format", "json",
+                         NULL);
+    TEST_CHECK(ret == 0);
+
+    /* half of the file is there before tailing starts */
+    ret = ht_write_lines(ctx->fds[0], 0, HT_LINES / 2);
+    TEST_CHECK(ret == 0);
+
+    ret = flb_start(ctx->flb);
+    TEST_CHECK(ret == 0);
+
+    for (i = HT_LINES / 2; i < HT_LINES; i += 1000) {
+        ret = ht_write_lines(ctx->fds[0], i, i + 1000);
+        TEST_CHECK(ret == 0);
+        flb_time_msleep(20);
+    }
+
+    /* waiting to flush */
+    for (i = 0; i < 100 && get_output_num() < HT_LINES; i++) {
+        flb_time_msleep(100);
+    }
+
+    num = get_output_num();
+    if (!TEST_CHECK(num == HT_LINES)) {
+        TEST_MSG("expected %d records, got %d", HT_LINES, num);
+    }
+    if (!TEST_CHECK(res.errors == 0)) {
+        TEST_MSG("%d records out of order or incomplete", res.errors);
+    }
+
+    test_tail_ctx_destroy(ctx);
+}
+
 void flb_test_skip_empty_lines()
 {
     struct flb_lib_out_cb cb_data;
@@ -1370,6 +1524,167 @@ void flb_test_inotify_watcher_false()
     test_tail_ctx_destroy(ctx);
 }
 
+/* files created after the start are found through the directory watch */
+void flb_test_inotify_watch_dirs()
+{
+    struct flb_lib_out_cb cb_data;
+    struct test_tail_ctx *ctx;
+    char *dir = "/tmp/flb-rt-in_tail-watch-dirs";
+    char *file[] = {"/tmp/flb-rt-in_tail-watch-dirs/sub/new.log"};
+    char *msg = "hello world";
+    int ret;
+    int num;
+
+    char *expected_strs[] = {msg};
+    struct str_list expected = {
+                                .size = sizeof(expected_strs)/sizeof(char*),
+                                .lists = &expected_strs[0],
+    };
+
+    clear_output_num();
+
+    cb_data.cb = cb_check_json_str_list;
+    cb_data.data = &expected;
+
+    mkdir(dir, S_IRWXU);
+
+    ctx = test_tail_ctx_create(&cb_data, NULL, 0, FLB_FALSE);
+    if (!TEST_CHECK(ctx != NULL)) {
+        TEST_MSG("test_ctx_create failed");
+        exit(EXIT_FAILURE);
+    }
+
+    ret = flb_input_set(ctx->flb, ctx->i_ffd,
+                        "path", "/tmp/flb-rt-in_tail-watch-dirs/*/*.log",
+                        "read_from_head", "true",
+                        "inotify_watch_dirs", "true",
+                        NULL);
+    TEST_CHECK(ret == 0);
+
+    ret = flb_output_set(ctx->flb, ctx->o_ffd,
+                         "format", "json",
+                         NULL);
+    TEST_CHECK(ret == 0);
+
+    /* Start the engine */
+    ret = flb_start(ctx->flb);
+    TEST_CHECK(ret == 0);
+
+    /* the sub directory and the file do not exist on the first scan */
+    flb_time_msleep(500);
+    mkdir("/tmp/flb-rt-in_tail-watch-dirs/sub", S_IRWXU);
+
+    ctx->fds = flb_malloc(sizeof(int));
+    ctx->filepaths = file;
+    ctx->fd_num = 1;
+    ctx->fds[0] = open(file[0], O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+    if (!TEST_CHECK(ctx->fds[0] >= 0)) {
+        TEST_MSG("open failed. errno=%d", errno);
+        ctx->fd_num = 0;
+        test_tail_ctx_destroy(ctx);
+        exit(EXIT_FAILURE);
+    }
+
+    ret = write_msg(ctx, msg, strlen(msg));
+    if (!TEST_CHECK(ret > 0)) {
+        test_tail_ctx_destroy(ctx);
+        exit(EXIT_FAILURE);
+    }
+
+    /* waiting to flush */
+    flb_time_msleep(1500);
+
+    num = get_output_num();
+    if (!TEST_CHECK(num > 0))  {
+        TEST_MSG("no output");
+    }
+
+    test_tail_ctx_destroy(ctx);
+    rmdir("/tmp/flb-rt-in_tail-watch-dirs/sub");
+    rmdir(dir);
+}
+
+/* a pattern that cannot be watched keeps the 'refresh_interval' re-scans */
+void flb_test_inotify_watch_dirs_unwatched()
+{
+    struct flb_lib_out_cb cb_data;
+    struct test_tail_ctx *ctx;
+    char *dir = "/tmp/flb-rt-in_tail-unwatched";
+    char *file[] = {"/tmp/flb-rt-in_tail-unwatched/new.log"};
+    char *msg = "hello world";
+    int ret;
+    int num;
+
+    char *expected_strs[] = {msg};
+    struct str_list expected = {
+                                .size = sizeof(expected_strs)/sizeof(char*),
+                                .lists = &expected_strs[0],
+    };
+
+    clear_output_num();
+
+    cb_data.cb = cb_check_json_str_list;
+    cb_data.data = &expected;
+
+    unlink(file[0]);
+    rmdir(dir);
+
+    ctx = test_tail_ctx_create(&cb_data, NULL, 0, FLB_FALSE);
+    if (!TEST_CHECK(ctx != NULL)) {
+        TEST_MSG("test_ctx_create failed");
+        exit(EXIT_FAILURE);
+    }
+
+    ret = flb_input_set(ctx->flb, ctx->i_ffd,
+                        "path", "/tmp/flb-rt-in_tail-unwatched/*.log",
+                        "read_from_head", "true",
+                        "refresh_interval", "1",
+                        "inotify_watch_dirs", "true",
+                        NULL);
+    TEST_CHECK(ret == 0);
+
+    ret = flb_output_set(ctx->flb, ctx->o_ffd,
+                         "format", "json",
+                         NULL);
+    TEST_CHECK(ret == 0);
+
+    /* Start the engine */
+    ret = flb_start(ctx->flb);
+    TEST_CHECK(ret == 0);
+
+    /* the directory does not exist on the first scan, nothing is watched */
+    flb_time_msleep(500);
+    mkdir(dir, S_IRWXU);
+
+    ctx->fds = flb_malloc(sizeof(int));
+    ctx->filepaths = file;
+    ctx->fd_num = 1;
+    ctx->fds[0] = open(file[0], O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+    if (!TEST_CHECK(ctx->fds[0] >= 0)) {
+        TEST_MSG("open failed. errno=%d", errno);
+        ctx->fd_num = 0;
+        test_tail_ctx_destroy(ctx);
+        exit(EXIT_FAILURE);
+    }
+
+    ret = write_msg(ctx, msg, strlen(msg));
+    if (!TEST_CHECK(ret > 0)) {
+        test_tail_ctx_destroy(ctx);
+        exit(EXIT_FAILURE);
+    }
+
+    /* waiting for the re-scan and the flush */
+    flb_time_msleep(2500);
+
+    num = get_output_num();
+    if (!TEST_CHECK(num > 0))  {
+        TEST_MSG("no output");
+    }
+
+    test_tail_ctx_destroy(ctx);
+    rmdir(dir);
+}
+
 #ifdef FLB_HAVE_REGEX
 void flb_test_parser()
 {
@@ -1615,6 +1930,114 @@ void flb_test_db()
     unlink(db);
 }
 
+/* offsets kept in memory are committed when the plugin exits */
+void flb_test_db_checkpoint()
+{
+    struct flb_lib_out_cb cb_data;
+    struct test_tail_ctx *ctx;
+    char *file[] = {"test_db_checkpoint.log"};
+    char *db = "test_db_checkpoint.db";
+    char *msg_init = "hello world";
+    char *msg = "hello db";
+    int i;
+    int ret;
+    int num;
+    int unused;
+
+    unlink(db);
+
+    clear_output_num();
+
+    cb_data.cb = cb_count_msgpack;
+    cb_data.data = &unused;
+
+    ctx = test_tail_ctx_create(&cb_data, &file[0], sizeof(file)/sizeof(char *), FLB_TRUE);
+    if (!TEST_CHECK(ctx != NULL)) {
+        TEST_MSG("test_ctx_create failed");
+        exit(EXIT_FAILURE);
+    }
+
+    ret = flb_input_set(ctx->flb, ctx->i_ffd,
+                        "path", file[0],
+                        "db", db,
+                        "db.checkpoint_interval", "60",
+                        NULL);
+    TEST_CHECK(ret == 0);
+
+    ret = flb_output_set(ctx->flb, ctx->o_ffd,
+                         NULL);
+    TEST_CHECK(ret == 0);
+
+    /* Start the engine */
+    ret = flb_start(ctx->flb);
+    TEST_CHECK(ret == 0);
+
+    ret = write_msg(ctx, msg_init, strlen(msg_init));
+    if (!TEST_CHECK(ret > 0)) {
+        test_tail_ctx_destroy(ctx);
+        unlink(db);
+        exit(EXIT_FAILURE);
+    }
+
+    /* waiting to flush */
+    flb_time_msleep(500);
+
+    num = get_output_num();
+    if (!TEST_CHECK(num > 0))  {
+        TEST_MSG("no output");
+    }
+
+    if (ctx->fds != NULL) {
+        for (i=0; i<ctx->fd_num; i++) {
+            close(ctx->fds[i]);
+        }
+        flb_free(ctx->fds);
+    }
+    flb_stop(ctx->flb);
+    flb_destroy(ctx->flb);
+    flb_free(ctx);
+
+    /* re-init: the offset was committed before the interval on exit */
+    clear_output_num();
+
+    ctx = test_tail_ctx_create(&cb_data, &file[0], sizeof(file)/sizeof(char *), FLB_FALSE);
+    if (!TEST_CHECK(ctx != NULL)) {
+        TEST_MSG("test_ctx_create failed");
+        unlink(db);
+        exit(EXIT_FAILURE);
+    }
+
+    ret = flb_input_set(ctx->flb, ctx->i_ffd,
+                        "path", file[0],
+                        "db", db,
+                        "db.checkpoint_interval", "60",
+                        NULL);
+    TEST_CHECK(ret == 0);
+
+    ret = write_msg(ctx, msg, strlen(msg));
+    if (!TEST_CHECK(ret > 0)) {
+        test_tail_ctx_destroy(ctx);
+        unlink(db);
+        exit(EXIT_FAILURE);
+    }
+
+    /* Start the engine */
+    ret = flb_start(ctx->flb);
+    TEST_CHECK(ret == 0);
+
+    /* waiting to flush */
+    flb_time_msleep(500);
+
+    num = get_output_num();
+    if (!TEST_CHECK(num == 1))  {
+        /* 1 = msg */
+        TEST_MSG("num error. expect=1 got=%d", num);
+    }
+
+    test_tail_ctx_destroy(ctx);
+    unlink(db);
+}
+
 void flb_test_db_delete_stale_file()
 {
     struct flb_lib_out_cb cb_data;
@@ -1956,15 +2379,19 @@ TEST_LIST = {
     {"issue_3943", flb_test_in_tail_issue_3943},
     /* Properties */
     {"skip_long_lines", flb_test_in_tail_skip_long_lines},
+    {"skip_long_lines_high_throughput", flb_test_in_tail_skip_long_lines_high_throughput},
     {"path_comma", flb_test_path_comma},
     {"path_key", flb_test_path_key},
     {"exclude_path", flb_test_exclude_path},
     {"offset_key", flb_test_offset_key},
+    {"high_throughput", flb_test_high_throughput},
     {"skip_empty_lines", flb_test_skip_empty_lines},
     {"skip_empty_lines_crlf", flb_test_skip_empty_lines_crlf},
     {"ignore_older", flb_test_ignore_older},
 #ifdef FLB_HAVE_INOTIFY
     {"inotify_watcher_false", flb_test_inotify_watcher_false},
+    {"inotify_watch_dirs", flb_test_inotify_watch_dirs},
+    {"inotify_watch_dirs_unwatched", flb_test_inotify_watch_dirs_unwatched},
 #endif /* FLB_HAVE_INOTIFY */
 
 #ifdef FLB_HAVE_REGEX
@@ -1974,6 +2401,7 @@ TEST_LIST = {
 
 #ifdef FLB_HAVE_SQLDB
     {"db", flb_test_db},
+    {"db_checkpoint", flb_test_db_checkpoint},
     {"db_delete_stale_file", flb_test_db_delete_stale_file},
     {"db_compare_filename", flb_test_db_compare_filename},
 #endif
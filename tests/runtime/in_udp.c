@@ -431,10 +431,226 @@ void flb_test_format_none_separator()
     test_ctx_destroy(ctx);
 }
 
+/* datagrams larger than the receive buffer are dropped, not truncated */
+void flb_test_truncated_datagram()
+{
+    struct flb_lib_out_cb cb_data;
+    struct test_ctx *ctx;
+    struct sockaddr_in addr;
+    flb_sockfd_t fd;
+    int ret;
+    int num;
+    ssize_t w_size;
+    char big[2048];
+    char *buf = "message\n";
+    size_t size = strlen(buf);
+
+    /* a truncated read would still deliver the 'first' record */
+    memset(big, 'a', sizeof(big));
+    memcpy(big, "first\n", 6);
+    big[sizeof(big) - 1] = '\n';
+
+    clear_output_num();
+
+    cb_data.cb = cb_check_result_json;
+    cb_data.data = "\"log\":\"message\"";
+
+    ctx = test_ctx_create(&cb_data);
+    if (!TEST_CHECK(ctx != NULL)) {
+        TEST_MSG("test_ctx_create failed");
+        exit(EXIT_FAILURE);
+    }
+
+    ret = flb_output_set(ctx->flb, ctx->o_ffd,
+                         "match", "*",
+                         "format", "json",
+                         NULL);
+    TEST_CHECK(ret == 0);
+
+    /* 1KB receive slots */
+    ret = flb_input_set(ctx->flb, ctx->i_ffd,
+                        "format", "none",
+                        "chunk_size", "1",
+                        NULL);
+    TEST_CHECK(ret == 0);
+
+    /* Start the engine */
+    ret = flb_start(ctx->flb);
+    TEST_CHECK(ret == 0);
+
+    /* use default host/port */
+    fd = init_udp(NULL, -1, &addr);
+    if (!TEST_CHECK(fd >= 0)) {
+        exit(EXIT_FAILURE);
+    }
+
+    w_size = sendto(fd, big, sizeof(big), 0,
+                    (const struct sockaddr *)&addr, sizeof(addr));
+    TEST_CHECK(w_size == sizeof(big));
+
+    w_size = sendto(fd, buf, size, 0, (const struct sockaddr *)&addr, sizeof(addr));
+    TEST_CHECK(w_size == size);
+
+    /* waiting to flush */
+    flb_time_msleep(1500);
+
+    num = get_output_num();
+    if (!TEST_CHECK(num == 1))  {
+        TEST_MSG("expected 1 record, got %i", num);
+    }
+
+    flb_socket_close(fd);
+    test_ctx_destroy(ctx);
+}
+
+/* a datagram of exactly the receive buffer size is not truncated */
+void flb_test_exact_size_datagram()
+{
+    struct flb_lib_out_cb cb_data;
+    struct test_ctx *ctx;
+    struct sockaddr_in addr;
+    flb_sockfd_t fd;
+    int ret;
+    int num;
+    ssize_t w_size;
+    char buf[1024];
+
+    /* the separator is the last byte of the datagram */
+    memset(buf, 'a', sizeof(buf));
+    memcpy(buf + sizeof(buf) - 6, "exact\n", 6);
+
+    clear_output_num();
+
+    cb_data.cb = cb_check_result_json;
+    cb_data.data = "aexact\"";
+
+    ctx = test_ctx_create(&cb_data);
+    if (!TEST_CHECK(ctx != NULL)) {
+        TEST_MSG("test_ctx_create failed");
+        exit(EXIT_FAILURE);
+    }
+
+    ret = flb_output_set(ctx->flb, ctx->o_ffd,
+                         "match", "*",
+                         "format", "json",
+                         NULL);
+    TEST_CHECK(ret == 0);
+
+    /* 1KB receive slots */
+    ret = flb_input_set(ctx->flb, ctx->i_ffd,
+                        "format", "none",
+                        "chunk_size", "1",
+                        NULL);
+    TEST_CHECK(ret == 0);
+
+    /* Start the engine */
+    ret = flb_start(ctx->flb);
+    TEST_CHECK(ret == 0);
+
+    /* use default host/port */
+    fd = init_udp(NULL, -1, &addr);
+    if (!TEST_CHECK(fd >= 0)) {
+        exit(EXIT_FAILURE);
+    }
+
+    w_size = sendto(fd, buf, sizeof(buf), 0,
+                    (const struct sockaddr *)&addr, sizeof(addr));
+    TEST_CHECK(w_size == sizeof(buf));
+
+    /* waiting to flush */
+    flb_time_msleep(1500);
+
+    num = get_output_num();
+    if (!TEST_CHECK(num == 1))  {
+        TEST_MSG("expected 1 record, got %i", num);
+    }
+
+    flb_socket_close(fd);
+    test_ctx_destroy(ctx);
+}
+
+/* several receivers share the port, every datagram is collected once */
+void flb_test_udp_receivers()
+{
+    struct flb_lib_out_cb cb_data;
+    struct test_ctx *ctx;
+    struct sockaddr_in addr;
+    flb_sockfd_t fds[8];
+    int i;
+    int ret;
+    int num;
+    int trys;
+    int total = 400;
+    ssize_t w_size;
+    char *buf = "message\n";
+    size_t size = strlen(buf);
+
+    clear_output_num();
+
+    cb_data.cb = cb_check_result_json;
+    cb_data.data = "\"log\":\"message\"";
+
+    ctx = test_ctx_create(&cb_data);
+    if (!TEST_CHECK(ctx != NULL)) {
+        TEST_MSG("test_ctx_create failed");
+        exit(EXIT_FAILURE);
+    }
+
+    ret = flb_output_set(ctx->flb, ctx->o_ffd,
+                         "match", "*",
+                         "format", "json",
+                         NULL);
+    TEST_CHECK(ret == 0);
+
+    ret = flb_input_set(ctx->flb, ctx->i_ffd,
+                        "format", "none",
+                        "net.udp_receivers", "4",
+                        NULL);
+    TEST_CHECK(ret == 0);
+
+    /* Start the engine */
+    ret = flb_start(ctx->flb);
+    TEST_CHECK(ret == 0);
+
+    /* different source ports spread the traffic between the receivers */
+    for (i = 0; i < 8; i++) {
+        fds[i] = init_udp(NULL, -1, &addr);
+        if (!TEST_CHECK(fds[i] >= 0)) {
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (i = 0; i < total; i++) {
+        w_size = sendto(fds[i % 8], buf, size, 0,
+                        (const struct sockaddr *)&addr, sizeof(addr));
+        TEST_CHECK(w_size == size);
+        if (i % 50 == 0) {
+            flb_time_msleep(10);
+        }
+    }
+
+    for (trys = 0, num = 0; trys < 20 && num < total; trys++) {
+        flb_time_msleep(250);
+        num = get_output_num();
+    }
+
+    if (!TEST_CHECK(num == total))  {
+        TEST_MSG("expected %i records, got %i", total, num);
+    }
+
+    for (i = 0; i < 8; i++) {
+        flb_socket_close(fds[i]);
+    }
+    test_ctx_destroy(ctx);
+}
+
 TEST_LIST = {
     {"udp", flb_test_udp},
     {"udp_with_source_address", flb_test_udp_with_source_address},
     {"format_none", flb_test_format_none},
     {"format_none_separator", flb_test_format_none_separator},
+    {"truncated_datagram", flb_test_truncated_datagram},
+    {"exact_size_datagram", flb_test_exact_size_datagram},
+    {"udp_receivers", flb_test_udp_receivers},
     {NULL, NULL}
 };
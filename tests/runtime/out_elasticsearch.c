@@ -1,6 +1,12 @@
 /* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
 
 #include <fluent-bit.h>
+#include <fluent-bit/flb_sds.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <pthread.h>
 #include "flb_tests_runtime.h"
 
 /* Test data */
@@ -799,6 +805,286 @@ void flb_test_logstash_prefix_separator()
     flb_destroy(ctx);
 }
 
+
+/*
+ * Minimal Elasticsearch Bulk API mock: it records every request body and
+ * replies with the configured responses, the last one is repeated.
+ */
+#define ES_MOCK_MAX_REQUESTS 8
+
+#define ES_BULK_PARTIAL_429                                               \
+    "{\"took\":1,\"errors\":true,\"items\":["                             \
+    "{\"create\":{\"status\":201}},"                                      \
+    "{\"create\":{\"status\":429,\"error\":"                              \
+    "{\"type\":\"es_rejected_execution_exception\"}}}]}"
+
+#define ES_BULK_ONE_429                                                   \
+    "{\"took\":1,\"errors\":true,\"items\":["                             \
+    "{\"create\":{\"status\":429,\"error\":"                              \
+    "{\"type\":\"es_rejected_execution_exception\"}}}]}"
+
+#define ES_BULK_ONE_OK                                                    \
+    "{\"took\":1,\"errors\":false,\"items\":["                            \
+    "{\"create\":{\"status\":201}}]}"
+
+#define ES_BULK_TWO_OK                                                    \
+    "{\"took\":1,\"errors\":false,\"items\":["                            \
+    "{\"create\":{\"status\":201}},"                                      \
+    "{\"create\":{\"status\":201}}]}"
+
+struct es_mock {
+    int fd;
+    int port;
+    int stop;
+    int requests;
+    char **responses;
+    int responses_count;
+    flb_sds_t bodies[ES_MOCK_MAX_REQUESTS];
+    pthread_t tid;
+    pthread_mutex_t lock;
+};
+
+static void es_mock_serve(struct es_mock *mock, int fd)
+{
+    int n;
+    int len;
+    size_t size = 0;
+    size_t body_len;
+    char *p;
+    char *response;
+    char buf[8192];
+    char header[256];
+
+    /* read headers and body */
+    while (size < sizeof(buf) - 1) {
+        n = recv(fd, buf + size, sizeof(buf) - 1 - size, 0);
+        if (n <= 0) {
+            return;
+        }
+        size += n;
+        buf[size] = '\0';
+
+        p = strstr(buf, "\r\n\r\n");
+        if (!p) {
+            continue;
+        }
+        p += 4;
+
+        body_len = 0;
+        if (strstr(buf, "Content-Length:")) {
+            body_len = atoi(strstr(buf, "Content-Length:") + 15);
+        }
+        if (size - (p - buf) >= body_len) {
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&mock->lock);
+    n = mock->requests;
+    if (n < ES_MOCK_MAX_REQUESTS) {
+        mock->bodies[n] = flb_sds_create(p);
+    }
+    mock->requests++;
+    if (n >= mock->responses_count) {
+        n = mock->responses_count - 1;
+    }
+    response = mock->responses[n];
+    pthread_mutex_unlock(&mock->lock);
+
+    len = snprintf(header, sizeof(header) - 1,
+                   "HTTP/1.1 200 OK\r\n"
+                   "Content-Type: application/json\r\n"
+                   "Content-Length: %zu\r\n"
+                   "Connection: close\r\n\r\n", strlen(response));
+    send(fd, header, len, 0);
+    send(fd, response, strlen(response), 0);
+}
+
+static void *es_mock_worker(void *data)
+{
+    int fd;
+    struct pollfd pfd;
+    struct es_mock *mock = data;
+
+    pfd.fd = mock->fd;
+    pfd.events = POLLIN;
+
+    while (!mock->stop) {
+        if (poll(&pfd, 1, 100) <= 0) {
+            continue;
+        }
+
+        fd = accept(mock->fd, NULL, NULL);
+        if (fd == -1) {
+            continue;
+        }
+        es_mock_serve(mock, fd);
+        close(fd);
+    }
+
+    return NULL;
+}
+
+static int es_mock_start(struct es_mock *mock, char **responses, int count)
+{
+    int on = 1;
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+
+    memset(mock, 0, sizeof(struct es_mock));
+    mock->responses = responses;
+    mock->responses_count = count;
+    pthread_mutex_init(&mock->lock, NULL);
+
+    mock->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (mock->fd == -1) {
+        return -1;
+    }
+    setsockopt(mock->fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+
+    if (bind(mock->fd, (struct sockaddr *) &addr, sizeof(addr)) == -1 ||
+        listen(mock->fd, 16) == -1 ||
+        getsockname(mock->fd, (struct sockaddr *) &addr, &len) == -1) {
+        close(mock->fd);
+        return -1;
+    }
+    mock->port = ntohs(addr.sin_port);
+
+    return pthread_create(&mock->tid, NULL, es_mock_worker, mock);
+}
+
+static void es_mock_stop(struct es_mock *mock)
+{
+    int i;
+
+    mock->stop = FLB_TRUE;
+    pthread_join(mock->tid, NULL);
+    close(mock->fd);
+
+    for (i = 0; i < ES_MOCK_MAX_REQUESTS; i++) {
+        if (mock->bodies[i]) {
+            flb_sds_destroy(mock->bodies[i]);
+        }
+    }
+    pthread_mutex_destroy(&mock->lock);
+}
+
+static int count_occurrences(char *str, char *pattern)
+{
+    int count = 0;
+
+    while ((str = strstr(str, pattern)) != NULL) {
+        count++;
+        str += strlen(pattern);
+    }
+
+    return count;
+}
+
+static void es_mock_run(struct es_mock *mock, char *retries)
+{
+    int ret;
+    int in_ffd;
+    int out_ffd;
+    char port[16];
+    char *record1 = "[1448403340,{\"key\":\"first\"}]";
+    char *record2 = "[1448403340,{\"key\":\"second\"}]";
+    flb_ctx_t *ctx;
+
+    snprintf(port, sizeof(port) - 1, "%i", mock->port);
+
+    ctx = flb_create();
+    flb_service_set(ctx, "flush", "1", "grace", "1",
+                    "scheduler.base", "1", "scheduler.cap", "1", NULL);
+
+    in_ffd = flb_input(ctx, (char *) "lib", NULL);
+    flb_input_set(ctx, in_ffd, "tag", "test", NULL);
+
+    out_ffd = flb_output(ctx, (char *) "es", NULL);
+    flb_output_set(ctx, out_ffd,
+                   "match", "test",
+                   "host", "127.0.0.1",
+                   "port", port,
+                   "write_operation", "create",
+                   "suppress_type_name", "on",
+                   "retry_failed_items", retries,
+                   "retry_limit", "1",
+                   NULL);
+
+    ret = flb_start(ctx);
+    TEST_CHECK(ret == 0);
+
+    flb_lib_push(ctx, in_ffd, record1, strlen(record1));
+    flb_lib_push(ctx, in_ffd, record2, strlen(record2));
+
+    sleep(6);
+    flb_stop(ctx);
+    flb_destroy(ctx);
+}
+
+/* Only the item rejected with 429 is sent again */
+void flb_test_retry_failed_items()
+{
+    int ret;
+    struct es_mock mock;
+    char *responses[] = { ES_BULK_PARTIAL_429, ES_BULK_ONE_OK };
+
+    ret = es_mock_start(&mock, responses, 2);
+    TEST_CHECK(ret == 0);
+    if (ret != 0) {
+        return;
+    }
+
+    es_mock_run(&mock, "2");
+
+    TEST_CHECK(mock.requests == 2);
+    TEST_MSG("requests=%i", mock.requests);
+    if (mock.requests == 2) {
+        TEST_CHECK(count_occurrences(mock.bodies[0], "{\"create\":") == 2);
+        TEST_CHECK(count_occurrences(mock.bodies[1], "{\"create\":") == 1);
+        TEST_CHECK(strstr(mock.bodies[1], "\"second\"") != NULL);
+        TEST_CHECK(strstr(mock.bodies[1], "\"first\"") == NULL);
+    }
+
+    es_mock_stop(&mock);
+}
+
+/*
+ * Once the partial retries are exhausted the whole chunk is retried by the
+ * engine, no document is dropped.
+ */
+void flb_test_retry_failed_items_exhausted()
+{
+    int ret;
+    struct es_mock mock;
+    char *responses[] = { ES_BULK_PARTIAL_429, ES_BULK_ONE_429,
+                          ES_BULK_TWO_OK };
+
+    ret = es_mock_start(&mock, responses, 3);
+    TEST_CHECK(ret == 0);
+    if (ret != 0) {
+        return;
+    }
+
+    es_mock_run(&mock, "1");
+
+    TEST_CHECK(mock.requests == 3);
+    TEST_MSG("requests=%i", mock.requests);
+    if (mock.requests == 3) {
+        TEST_CHECK(count_occurrences(mock.bodies[1], "{\"create\":") == 1);
+        TEST_CHECK(count_occurrences(mock.bodies[2], "{\"create\":") == 2);
+        TEST_CHECK(strstr(mock.bodies[2], "\"first\"") != NULL);
+        TEST_CHECK(strstr(mock.bodies[2], "\"second\"") != NULL);
+    }
+
+    es_mock_stop(&mock);
+}
+
 /* Test list */
 TEST_LIST = {
     {"long_index"            , flb_test_long_index },
@@ -814,5 +1100,7 @@ TEST_LIST = {
     {"replace_dots"          , flb_test_replace_dots },
     {"id_key"                , flb_test_id_key },
     {"logstash_prefix_separator" , flb_test_logstash_prefix_separator },
+    {"retry_failed_items"    , flb_test_retry_failed_items },
+    {"retry_failed_items_exhausted", flb_test_retry_failed_items_exhausted },
     {NULL, NULL}
 };
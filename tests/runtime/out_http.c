@@ -23,9 +23,16 @@
 #include <fluent-bit/flb_time.h>
 #include <float.h>
 #include <math.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <poll.h>
 #include <msgpack.h>
 #include "flb_tests_runtime.h"
 
+#define TLS_CERTIFICATE_FILENAME FLB_TESTS_DATA_PATH "/data/tls/certificate.pem"
+#define TLS_PRIVATE_KEY_FILENAME FLB_TESTS_DATA_PATH "/data/tls/private_key.pem"
+
 struct test_ctx {
     flb_ctx_t *flb;    /* Fluent Bit library context */
     int i_ffd;         /* Input fd  */
@@ -1139,6 +1146,226 @@ void flb_test_in_http()
     test_ctx_destroy(ctx);
 }
 
+
+/*
+ * Send records from out_http to in_http with HTTP/2 enabled on the client,
+ * 'in_http2' and 'tls' select what the server side offers.
+ */
+static void test_http2_pipeline(char *in_http2, int tls,
+                                char *max_connections, int records)
+{
+    struct test_ctx *ctx;
+    int i;
+    int ret;
+    int num;
+    int i_ffd;
+    int o_ffd;
+    int trys;
+    struct flb_lib_out_cb cb;
+    char *buf = "[1, {\"msg\":\"hello world\"}]";
+    size_t size = strlen(buf);
+
+    cb.cb   = callback_test;
+    cb.data = NULL;
+    clear_output_num();
+
+    ctx = test_ctx_create();
+    if (!TEST_CHECK(ctx != NULL)) {
+        TEST_MSG("test_ctx_create failed");
+        exit(EXIT_FAILURE);
+    }
+
+    ret = flb_input_set(ctx->flb, ctx->i_ffd, "tag", "lib", NULL);
+    TEST_CHECK(ret == 0);
+
+    /* Input */
+    i_ffd = flb_input(ctx->flb, (char *) "http", NULL);
+    TEST_CHECK(i_ffd >= 0);
+    ret = flb_input_set(ctx->flb, i_ffd,
+                        "port", "8888",
+                        "tag", "http",
+                        "host", "127.0.0.1",
+                        "http2", in_http2,
+                        NULL);
+    TEST_CHECK(ret == 0);
+
+    if (tls) {
+        ret = flb_input_set(ctx->flb, i_ffd,
+                            "tls", "on",
+                            "tls.crt_file", TLS_CERTIFICATE_FILENAME,
+                            "tls.key_file", TLS_PRIVATE_KEY_FILENAME,
+                            NULL);
+        TEST_CHECK(ret == 0);
+    }
+
+    /* Output */
+    o_ffd = flb_output(ctx->flb, (char *) "lib", &cb);
+    TEST_CHECK(o_ffd >= 0);
+    ret = flb_output_set(ctx->flb, o_ffd, "match", "http", NULL);
+    TEST_CHECK(ret == 0);
+
+    ret = flb_output_set(ctx->flb, ctx->o_ffd,
+                         "match", "lib",
+                         "host", "127.0.0.1",
+                         "port", "8888",
+                         "http2", "on",
+                         "workers", "1",
+                         "net.max_worker_connections", max_connections,
+                         NULL);
+    TEST_CHECK(ret == 0);
+
+    if (tls) {
+        ret = flb_output_set(ctx->flb, ctx->o_ffd,
+                             "tls", "on",
+                             "tls.verify", "off",
+                             NULL);
+        TEST_CHECK(ret == 0);
+    }
+
+    /* Start the engines */
+    ret = flb_start(ctx->flb);
+    TEST_CHECK(ret == 0);
+
+    for (i = 0; i < records; i++) {
+        ret = flb_lib_push(ctx->flb, ctx->i_ffd, (char *) buf, size);
+        TEST_CHECK(ret >= 0);
+        flb_time_msleep(50);
+    }
+
+    for (trys = 0, num = 0; trys < 20 && num < records; trys++) {
+        num = get_output_num();
+        if (num < records) {
+            flb_time_msleep(500);
+        }
+    }
+
+    if (!TEST_CHECK(num == records))  {
+        TEST_MSG("expected %i records, got %i", records, num);
+    }
+
+    test_ctx_destroy(ctx);
+}
+
+/* plain text HTTP/2 with prior knowledge */
+void flb_test_http2_h2c()
+{
+    test_http2_pipeline("on", FLB_FALSE, "0", 1);
+}
+
+/* HTTP/2 negotiated through ALPN */
+void flb_test_http2_tls_alpn()
+{
+    test_http2_pipeline("on", FLB_TRUE, "0", 1);
+}
+
+/* the server does not agree on 'h2', the client falls back to HTTP/1.1 */
+void flb_test_http2_tls_alpn_fallback()
+{
+    test_http2_pipeline("off", FLB_TRUE, "0", 1);
+}
+
+/* streams are bounded by net.max_worker_connections, nothing is lost */
+void flb_test_http2_max_worker_connections()
+{
+    test_http2_pipeline("on", FLB_FALSE, "1", 10);
+}
+
+
+/* Count the connections a listener accepts while the output is running */
+static int test_warm_connections(char *warm, char *max_connections)
+{
+    int on = 1;
+    int fd;
+    int ret;
+    int count = 0;
+    int loops;
+    int conns[16];
+    char port[16];
+    struct pollfd pfd;
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    struct test_ctx *ctx;
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (!TEST_CHECK(fd != -1)) {
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    ret = bind(fd, (struct sockaddr *) &addr, sizeof(addr));
+    TEST_CHECK(ret == 0);
+    ret = listen(fd, 16);
+    TEST_CHECK(ret == 0);
+    ret = getsockname(fd, (struct sockaddr *) &addr, &len);
+    TEST_CHECK(ret == 0);
+    snprintf(port, sizeof(port) - 1, "%i", ntohs(addr.sin_port));
+
+    ctx = test_ctx_create();
+    if (!TEST_CHECK(ctx != NULL)) {
+        close(fd);
+        return -1;
+    }
+
+    ret = flb_output_set(ctx->flb, ctx->o_ffd,
+                         "match", "*",
+                         "host", "127.0.0.1",
+                         "port", port,
+                         "workers", "1",
+                         "net.warm_connections", warm,
+                         "net.max_worker_connections", max_connections,
+                         NULL);
+    TEST_CHECK(ret == 0);
+
+    ret = flb_start(ctx->flb);
+    TEST_CHECK(ret == 0);
+
+    /* the warm-up timer runs every 1.5 seconds, give it a few rounds */
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    for (loops = 0; loops < 40; loops++) {
+        if (poll(&pfd, 1, 100) > 0 && count < 16) {
+            conns[count] = accept(fd, NULL, NULL);
+            if (conns[count] != -1) {
+                count++;
+            }
+        }
+    }
+
+    test_ctx_destroy(ctx);
+
+    for (loops = 0; loops < count; loops++) {
+        close(conns[loops]);
+    }
+    close(fd);
+
+    return count;
+}
+
+void flb_test_warm_connections()
+{
+    int count;
+
+    count = test_warm_connections("2", "0");
+    if (!TEST_CHECK(count == 2)) {
+        TEST_MSG("expected 2 warm connections, got %i", count);
+    }
+}
+
+/* warm connections never go beyond net.max_worker_connections */
+void flb_test_warm_connections_max_worker_connections()
+{
+    int count;
+
+    count = test_warm_connections("4", "1");
+    if (!TEST_CHECK(count == 1)) {
+        TEST_MSG("expected 1 warm connection, got %i", count);
+    }
+}
+
 /* Test list */
 TEST_LIST = {
     {"format_msgpack" , flb_test_format_msgpack},
@@ -1156,5 +1383,12 @@ TEST_LIST = {
     {"json_date_format_iso8601" , flb_test_json_date_format_iso8601},
     {"json_date_format_java_sql_timestamp" , flb_test_json_date_format_java_sql_timestamp},
     {"in_http", flb_test_in_http},
+    {"http2_h2c", flb_test_http2_h2c},
+    {"http2_tls_alpn", flb_test_http2_tls_alpn},
+    {"http2_tls_alpn_fallback", flb_test_http2_tls_alpn_fallback},
+    {"http2_max_worker_connections", flb_test_http2_max_worker_connections},
+    {"warm_connections", flb_test_warm_connections},
+    {"warm_connections_max_worker_connections",
+     flb_test_warm_connections_max_worker_connections},
     {NULL, NULL}
 };
@@ -0,0 +1,382 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fluent-bit.h>
+#include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_gzip.h>
+#include <fluent-bit/flb_time.h>
+#include <fluent-bit/flb_socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "flb_tests_runtime.h"
+
+#include "../../plugins/out_prometheus_exporter/prom_http.h"
+
+#define PROM_TEST_PORT    2121
+
+static void check_openmetrics(char *in, char *expected)
+{
+    flb_sds_t out;
+
+    out = prom_http_openmetrics_convert(in, strlen(in));
+    if (!TEST_CHECK(out != NULL)) {
+        return;
+    }
+    if (!TEST_CHECK(strcmp(out, expected) == 0)) {
+        TEST_MSG("expected:\n%s\ngot:\n%s", expected, out);
+    }
+    flb_sds_destroy(out);
+}
+
+void flb_test_openmetrics_convert()
+{
+    /* counter families drop the _total suffix, samples keep it */
+    check_openmetrics(
+        "# HELP fluentbit_input_records_total Number of input records.\n"
+        "# TYPE fluentbit_input_records_total counter\n"
+        "fluentbit_input_records_total{name=\"cpu.0\"} 10\n",
+        "# HELP fluentbit_input_records Number of input records.\n"
+        "# TYPE fluentbit_input_records counter\n"
+        "fluentbit_input_records_total{name=\"cpu.0\"} 10\n"
+        "# EOF\n");
+
+    /* counter samples without the suffix get it */
+    check_openmetrics(
+        "# HELP requests Requests.\n"
+        "# TYPE requests counter\n"
+        "requests 3\n",
+        "# HELP requests Requests.\n"
+        "# TYPE requests counter\n"
+        "requests_total 3\n"
+        "# EOF\n");
+
+    /* untyped becomes unknown, gauges are left alone */
+    check_openmetrics(
+        "# HELP temp Temperature.\n"
+        "# TYPE temp untyped\n"
+        "temp 1.5\n"
+        "# HELP size_total Size.\n"
+        "# TYPE size_total gauge\n"
+        "size_total 7\n",
+        "# HELP temp Temperature.\n"
+        "# TYPE temp unknown\n"
+        "temp 1.5\n"
+        "# HELP size_total Size.\n"
+        "# TYPE size_total gauge\n"
+        "size_total 7\n"
+        "# EOF\n");
+
+    /* timestamps are in seconds */
+    check_openmetrics(
+        "# HELP up Up.\n"
+        "# TYPE up gauge\n"
+        "up{a=\"x y\"} 1 1700000000123\n"
+        "up 0 1700000000005\n",
+        "# HELP up Up.\n"
+        "# TYPE up gauge\n"
+        "up{a=\"x y\"} 1 1700000000.123\n"
+        "up 0 1700000000.005\n"
+        "# EOF\n");
+
+    /* label values may contain spaces, braces and escaped quotes */
+    check_openmetrics(
+        "# HELP http_requests_total Requests.\n"
+        "# TYPE http_requests_total counter\n"
+        "http_requests_total{path=\"/a b\",msg=\"x}\"} 2 1700000000123\n"
+        "http_requests_total{msg=\"a\\\"} b \\\\\"} 3 1700000000456\n",
+        "# HELP http_requests Requests.\n"
+        "# TYPE http_requests counter\n"
+        "http_requests_total{path=\"/a b\",msg=\"x}\"} 2 1700000000.123\n"
+        "http_requests_total{msg=\"a\\\"} b \\\\\"} 3 1700000000.456\n"
+        "# EOF\n");
+
+    /* empty input still terminates the exposition */
+    check_openmetrics("", "# EOF\n");
+}
+
+static int response_complete(flb_sds_t resp)
+{
+    size_t len;
+    char *p;
+
+    p = strstr(resp, "\r\n\r\n");
+    if (!p) {
+        return FLB_FALSE;
+    }
+    p += 4;
+    len = flb_sds_len(resp) - (p - resp);
+
+    if (strstr(resp, "Content-Length: ")) {
+        return len >= strtoul(strstr(resp, "Content-Length: ") + 16, NULL, 10);
+    }
+
+    /* chunked: the last chunk is empty */
+    return len >= 5 &&
+           memcmp(resp + flb_sds_len(resp) - 5, "0\r\n\r\n", 5) == 0;
+}
+
+/* Issue a GET /metrics and return the full response, NULL on error */
+static flb_sds_t scrape(char *headers)
+{
+    int n;
+    char buf[4096];
+    flb_sockfd_t fd;
+    flb_sds_t req;
+    flb_sds_t resp;
+    struct timeval tv;
+    struct sockaddr_in addr;
+
+    fd = socket(PF_INET, SOCK_STREAM, 0);
+    if (fd == -1) {
+        return NULL;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(PROM_TEST_PORT);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    if (connect(fd, (const struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        flb_socket_close(fd);
+        return NULL;
+    }
+
+    req = flb_sds_create("GET /metrics HTTP/1.1\r\nHost: 127.0.0.1\r\n");
+    flb_sds_cat_safe(&req, headers, strlen(headers));
+    flb_sds_cat_safe(&req, "Connection: close\r\n\r\n", 21);
+    send(fd, req, flb_sds_len(req), 0);
+    flb_sds_destroy(req);
+
+    /* the server may keep the connection open, stop at the end of it */
+    tv.tv_sec = 5;
+    tv.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    resp = flb_sds_create_size(4096);
+    while (!response_complete(resp) &&
+           (n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+        flb_sds_cat_safe(&resp, buf, n);
+    }
+    flb_socket_close(fd);
+
+    return resp;
+}
+
+/* Locate the body of a response, undoing the chunked transfer encoding */
+static flb_sds_t response_body(flb_sds_t resp)
+{
+    size_t len;
+    char *p;
+    char *end;
+    flb_sds_t body;
+
+    p = strstr(resp, "\r\n\r\n");
+    if (!p) {
+        return NULL;
+    }
+    *p = '\0';
+    p += 4;
+    end = resp + flb_sds_len(resp);
+
+    body = flb_sds_create_size(end - p);
+    if (!strstr(resp, "Transfer-Encoding: chunked")) {
+        flb_sds_cat_safe(&body, p, end - p);
+        return body;
+    }
+
+    while (p < end) {
+        len = strtoul(p, &p, 16);
+        if (len == 0) {
+            break;
+        }
+        p += 2;
+        if (p + len > end) {
+            flb_sds_destroy(body);
+            return NULL;
+        }
+        flb_sds_cat_safe(&body, p, len);
+        p += len + 2;
+    }
+    return body;
+}
+
+/* Accept header sent by Prometheus */
+#define PROM_SCRAPE_ACCEPT                                              \
+    "Accept: application/openmetrics-text;version=1.0.0,"               \
+    "application/openmetrics-text;version=0.0.1;q=0.75,"                \
+    "text/plain;version=0.0.4;q=0.5,*/*;q=0.1\r\n"
+
+static flb_ctx_t *exporter_start(char *openmetrics)
+{
+    int ret;
+    int in_ffd;
+    int out_ffd;
+    char port[16];
+    flb_ctx_t *ctx;
+
+    ctx = flb_create();
+    flb_service_set(ctx, "Flush", "0.5", "Grace", "1", NULL);
+
+    in_ffd = flb_input(ctx, (char *) "fluentbit_metrics", NULL);
+    TEST_CHECK(in_ffd >= 0);
+    flb_input_set(ctx, in_ffd, "tag", "metrics", "scrape_interval", "1", NULL);
+
+    snprintf(port, sizeof(port), "%d", PROM_TEST_PORT);
+    out_ffd = flb_output(ctx, (char *) "prometheus_exporter", NULL);
+    TEST_CHECK(out_ffd >= 0);
+    flb_output_set(ctx, out_ffd, "match", "metrics",
+                   "host", "127.0.0.1", "port", port,
+                   "openmetrics", openmetrics, NULL);
+
+    ret = flb_start(ctx);
+    TEST_CHECK(ret == 0);
+
+    /* let a couple of scrapes reach the exporter */
+    flb_time_msleep(3000);
+
+    return ctx;
+}
+
+/* Tell if a scrape sent with the given headers is served OpenMetrics */
+static int scrape_is_openmetrics(char *headers)
+{
+    int ret;
+    flb_sds_t resp;
+
+    resp = scrape(headers);
+    if (!TEST_CHECK(resp != NULL)) {
+        return -1;
+    }
+    ret = strstr(resp, "application/openmetrics-text") != NULL;
+    flb_sds_destroy(resp);
+
+    return ret;
+}
+
+void flb_test_gzip_roundtrip()
+{
+    int ret;
+    void *out_buf = NULL;
+    size_t out_size = 0;
+    char *headers;
+    flb_ctx_t *ctx;
+    flb_sds_t resp;
+    flb_sds_t body;
+    flb_sds_t text;
+
+    ctx = exporter_start("on");
+
+    /* gzip text exposition */
+    resp = scrape("Accept-Encoding: gzip\r\n");
+    TEST_CHECK(resp != NULL);
+    if (resp) {
+        body = response_body(resp);
+        headers = resp;
+        TEST_CHECK(strstr(headers, " 200 ") != NULL);
+        if (!TEST_CHECK(strstr(headers, "Content-Encoding: gzip") != NULL)) {
+            TEST_MSG("headers:\n%s", headers);
+        }
+        TEST_CHECK(strstr(headers, "Vary: Accept-Encoding") != NULL);
+
+        TEST_CHECK(body != NULL);
+        if (body) {
+            ret = flb_gzip_uncompress(body, flb_sds_len(body),
+                                      &out_buf, &out_size);
+            TEST_CHECK(ret == 0);
+            if (ret == 0) {
+                text = flb_sds_create_len(out_buf, out_size);
+                TEST_CHECK(strncmp(text, "# HELP fluentbit_", 17) == 0);
+                TEST_CHECK(strstr(text, "# EOF") == NULL);
+                flb_sds_destroy(text);
+                flb_free(out_buf);
+            }
+            flb_sds_destroy(body);
+        }
+        flb_sds_destroy(resp);
+    }
+
+    /* gzip OpenMetrics exposition */
+    resp = scrape("Accept: application/openmetrics-text\r\n"
+                  "Accept-Encoding: gzip\r\n");
+    TEST_CHECK(resp != NULL);
+    if (resp) {
+        body = response_body(resp);
+        headers = resp;
+        TEST_CHECK(strstr(headers, "Content-Encoding: gzip") != NULL);
+        TEST_CHECK(strstr(headers, "application/openmetrics-text") != NULL);
+        TEST_CHECK(body != NULL);
+        if (body) {
+            ret = flb_gzip_uncompress(body, flb_sds_len(body),
+                                      &out_buf, &out_size);
+            TEST_CHECK(ret == 0);
+            if (ret == 0) {
+                TEST_CHECK(out_size > 6);
+                TEST_CHECK(memcmp((char *) out_buf + out_size - 6,
+                                  "# EOF\n", 6) == 0);
+                flb_free(out_buf);
+            }
+            flb_sds_destroy(body);
+        }
+        flb_sds_destroy(resp);
+    }
+
+    /* without Accept-Encoding the body is plain text */
+    resp = scrape("");
+    TEST_CHECK(resp != NULL);
+    if (resp) {
+        body = response_body(resp);
+        headers = resp;
+        TEST_CHECK(strstr(headers, "Content-Encoding") == NULL);
+        TEST_CHECK(strstr(headers, "Vary: Accept-Encoding") != NULL);
+        TEST_CHECK(body != NULL);
+        if (body) {
+            TEST_CHECK(strncmp(body, "# HELP fluentbit_", 17) == 0);
+            flb_sds_destroy(body);
+        }
+        flb_sds_destroy(resp);
+    }
+
+    flb_stop(ctx);
+    flb_destroy(ctx);
+}
+
+void flb_test_openmetrics_negotiation()
+{
+    flb_ctx_t *ctx;
+
+    ctx = exporter_start("on");
+
+    TEST_CHECK(scrape_is_openmetrics(PROM_SCRAPE_ACCEPT) == FLB_TRUE);
+    TEST_CHECK(scrape_is_openmetrics("Accept: text/plain;q=0.9, "
+                                     "application/openmetrics-text;q=0.5"
+                                     "\r\n") == FLB_FALSE);
+    TEST_CHECK(scrape_is_openmetrics("Accept: application/openmetrics-text;"
+                                     "q=0\r\n") == FLB_FALSE);
+    TEST_CHECK(scrape_is_openmetrics("Accept: */*\r\n") == FLB_FALSE);
+    TEST_CHECK(scrape_is_openmetrics("") == FLB_FALSE);
+
+    flb_stop(ctx);
+    flb_destroy(ctx);
+}
+
+/* OpenMetrics is only served when enabled */
+void flb_test_openmetrics_disabled()
+{
+    flb_ctx_t *ctx;
+
+    ctx = exporter_start("off");
+
+    TEST_CHECK(scrape_is_openmetrics(PROM_SCRAPE_ACCEPT) == FLB_FALSE);
+    TEST_CHECK(scrape_is_openmetrics("Accept: application/openmetrics-text"
+                                     "\r\n") == FLB_FALSE);
+
+    flb_stop(ctx);
+    flb_destroy(ctx);
+}
+
+TEST_LIST = {
+    {"openmetrics_convert", flb_test_openmetrics_convert},
+    {"gzip_roundtrip",      flb_test_gzip_roundtrip},
+    {"openmetrics_negotiation", flb_test_openmetrics_negotiation},
+    {"openmetrics_disabled", flb_test_openmetrics_disabled},
+    {NULL, NULL}
+};